@@ -0,0 +1,377 @@
+// SPDX-License-Identifier: LGPL-2.0-or-later
+// Copyright © CloudCompare Project
+
+//Compares the query throughput of the flat KD-tree (unique and batched queries) with the octree
+//(and with the former KD-tree for the nearest neighbour search), and checks that the results are the same.
+//Usage: KdTreeBenchmark [point count (default: 1 000 000) or ASCII 'X Y Z' file] [query count (default: 200 000)] [k (default: 16)] [radius (default: 0.1)]
+
+//CCCoreLib
+#include <CCConst.h>
+#include <DgmOctree.h>
+#include <FlatKdTree.h>
+#include <KdTree.h>
+#include <PointCloud.h>
+
+//system
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace CCCoreLib;
+
+namespace
+{
+	//! Generates a synthetic cloud (noisy surfaces + uniform clutter, in random order)
+	void GenerateCloud(PointCloud& cloud, unsigned pointCount)
+	{
+		std::mt19937 generator(12345);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+		std::normal_distribution<float> noise(0.0f, 0.01f);
+
+		cloud.reserve(pointCount);
+		for (unsigned i = 0; i < pointCount; ++i)
+		{
+			float u = uniform(generator) * 50.0f;
+			float v = uniform(generator) * 50.0f;
+			switch (i % 4)
+			{
+			case 0: //ground
+				cloud.addPoint(CCVector3(u, v, noise(generator)));
+				break;
+			case 1: //wall
+				cloud.addPoint(CCVector3(u, noise(generator), v / 5));
+				break;
+			case 2: //cylinder
+			{
+				float angle = u / 50.0f * static_cast<float>(2 * M_PI);
+				cloud.addPoint(CCVector3(25.0f + 5.0f * std::cos(angle), 25.0f + 5.0f * std::sin(angle), v / 5 + noise(generator)));
+			}
+			break;
+			default: //clutter
+				cloud.addPoint(CCVector3(u, v, uniform(generator) * 10.0f));
+				break;
+			}
+		}
+	}
+
+	//! Loads an ASCII cloud (one 'X Y Z [...]' point per line)
+	bool LoadCloud(PointCloud& cloud, const char* filename)
+	{
+		FILE* fp = std::fopen(filename, "r");
+		if (!fp)
+		{
+			return false;
+		}
+
+		char line[1024];
+		while (std::fgets(line, sizeof(line), fp))
+		{
+			double x = 0;
+			double y = 0;
+			double z = 0;
+			if (std::sscanf(line, "%lf %lf %lf", &x, &y, &z) == 3 || std::sscanf(line, "%lf,%lf,%lf", &x, &y, &z) == 3)
+			{
+				cloud.addPoint(CCVector3(static_cast<PointCoordinateType>(x), static_cast<PointCoordinateType>(y), static_cast<PointCoordinateType>(z)));
+			}
+		}
+		std::fclose(fp);
+
+		return cloud.size() != 0;
+	}
+
+	//! Generates the query points (cloud points slightly moved, inside the cloud bounding box)
+	std::vector<CCVector3> GenerateQueries(PointCloud& cloud, unsigned queryCount)
+	{
+		std::mt19937 generator(54321);
+		std::uniform_int_distribution<unsigned> index(0, cloud.size() - 1);
+		std::normal_distribution<float> noise(0.0f, 0.02f);
+
+		CCVector3 bbMin;
+		CCVector3 bbMax;
+		cloud.getBoundingBox(bbMin, bbMax);
+
+		std::vector<CCVector3> queries(queryCount);
+		for (CCVector3& Q : queries)
+		{
+			Q = *cloud.getPoint(index(generator));
+			for (unsigned j = 0; j < 3; ++j)
+			{
+				Q.u[j] = std::max(bbMin.u[j], std::min(bbMax.u[j], Q.u[j] + noise(generator)));
+			}
+		}
+		return queries;
+	}
+
+	using Clock = std::chrono::steady_clock;
+
+	double ElapsedSeconds(const Clock::time_point& start)
+	{
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	//! Compares two squared distances (computed in double and float)
+	bool SameDistance(double a, double b)
+	{
+		return std::abs(a - b) <= 1.0e-5 * std::max(1.0, std::max(a, b));
+	}
+
+	//! Prints the timing of a run
+	void PrintRun(const char* name, double time, double referenceTime, unsigned queryCount, size_t mismatches)
+	{
+		std::printf("  [%s]  %.3f s - %.0f queries/s - speed-up: x%.1f - mismatches: %zu\n", name, time, queryCount / time, referenceTime / time, mismatches);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	PointCloud cloud;
+	if (argc > 1 && std::strtoul(argv[1], nullptr, 10) == 0)
+	{
+		if (!LoadCloud(cloud, argv[1]))
+		{
+			std::printf("Failed to load '%s'\n", argv[1]);
+			return EXIT_FAILURE;
+		}
+	}
+	else
+	{
+		GenerateCloud(cloud, argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10)) : 1000000);
+	}
+	unsigned queryCount = (argc > 2 ? static_cast<unsigned>(std::strtoul(argv[2], nullptr, 10)) : 200000);
+	unsigned k = (argc > 3 ? static_cast<unsigned>(std::strtoul(argv[3], nullptr, 10)) : 16);
+	PointCoordinateType radius = (argc > 4 ? static_cast<PointCoordinateType>(std::atof(argv[4])) : static_cast<PointCoordinateType>(0.1));
+	if (queryCount == 0 || k == 0 || radius <= 0)
+	{
+		std::printf("Invalid parameters\n");
+		return EXIT_FAILURE;
+	}
+
+	std::printf("Points: %u - queries: %u - k: %u - radius: %g\n", cloud.size(), queryCount, k, radius);
+	std::vector<CCVector3> queries = GenerateQueries(cloud, queryCount);
+
+	//build
+	DgmOctree octree(&cloud);
+	Clock::time_point start = Clock::now();
+	if (octree.build() <= 0)
+	{
+		std::printf("Octree computation failed\n");
+		return EXIT_FAILURE;
+	}
+	std::printf("[Build] Octree: %.3f s\n", ElapsedSeconds(start));
+
+	KDTree legacyTree;
+	start = Clock::now();
+	if (!legacyTree.buildFromCloud(&cloud))
+	{
+		std::printf("KD-tree computation failed\n");
+		return EXIT_FAILURE;
+	}
+	std::printf("[Build] Former KD-tree: %.3f s\n", ElapsedSeconds(start));
+
+	FlatKdTree tree;
+	start = Clock::now();
+	if (!tree.buildFromCloud(&cloud))
+	{
+		std::printf("Flat KD-tree computation failed\n");
+		return EXIT_FAILURE;
+	}
+	std::printf("[Build] Flat KD-tree: %.3f s (%u nodes)\n", ElapsedSeconds(start), tree.nodeCount());
+
+	size_t totalMismatches = 0;
+
+	//nearest neighbour
+	{
+		std::printf("Nearest neighbour:\n");
+		ScalarType maxDist = static_cast<ScalarType>(octree.getCellSize(0));
+		unsigned char level = octree.findBestLevelForAGivenPopulationPerCell(4);
+
+		std::vector<double> octreeDists(queryCount);
+		start = Clock::now();
+		{
+			DgmOctree::NearestNeighboursSearchStruct nNSS;
+			nNSS.level = level;
+			for (unsigned i = 0; i < queryCount; ++i)
+			{
+				nNSS.queryPoint = queries[i];
+				octree.getTheCellPosWhichIncludesThePoint(&nNSS.queryPoint, nNSS.cellPos, level);
+				octree.computeCellCenter(nNSS.cellPos, level, nNSS.cellCenter);
+				nNSS.minimalCellsSetToVisit.resize(0);
+				nNSS.alreadyVisitedNeighbourhoodSize = 0;
+				octreeDists[i] = octree.findTheNearestNeighborStartingFromCell(nNSS);
+			}
+		}
+		double octreeTime = ElapsedSeconds(start);
+		std::printf("  [Octree]          %.3f s - %.0f queries/s\n", octreeTime, queryCount / octreeTime);
+
+		std::vector<unsigned> legacyIndexes(queryCount);
+		start = Clock::now();
+		for (unsigned i = 0; i < queryCount; ++i)
+		{
+			legacyTree.findNearestNeighbour(queries[i].u, legacyIndexes[i], maxDist);
+		}
+		double legacyTime = ElapsedSeconds(start);
+
+		std::vector<unsigned> indexes(queryCount);
+		start = Clock::now();
+		for (unsigned i = 0; i < queryCount; ++i)
+		{
+			tree.findNearestNeighbour(queries[i].u, indexes[i], maxDist);
+		}
+		double time = ElapsedSeconds(start);
+
+		size_t legacyMismatches = 0;
+		size_t mismatches = 0;
+		for (unsigned i = 0; i < queryCount; ++i)
+		{
+			if (!SameDistance(octreeDists[i], (queries[i] - *cloud.getPoint(legacyIndexes[i])).norm2d()))
+				++legacyMismatches;
+			if (!SameDistance(octreeDists[i], (queries[i] - *cloud.getPoint(indexes[i])).norm2d()))
+				++mismatches;
+		}
+		totalMismatches += mismatches;
+		PrintRun("Former KD-tree  ", legacyTime, octreeTime, queryCount, legacyMismatches);
+		PrintRun("Flat KD-tree    ", time, octreeTime, queryCount, mismatches);
+	}
+
+	//k nearest neighbours
+	{
+		std::printf("%u nearest neighbours:\n", k);
+		unsigned char level = octree.findBestLevelForAGivenPopulationPerCell(k);
+
+		std::vector<double> octreeDists(queryCount);
+		start = Clock::now();
+		{
+			DgmOctree::NearestNeighboursSearchStruct nNSS;
+			nNSS.level = level;
+			nNSS.minNumberOfNeighbors = k;
+			for (unsigned i = 0; i < queryCount; ++i)
+			{
+				nNSS.queryPoint = queries[i];
+				octree.getTheCellPosWhichIncludesThePoint(&nNSS.queryPoint, nNSS.cellPos, level);
+				octree.computeCellCenter(nNSS.cellPos, level, nNSS.cellCenter);
+				nNSS.pointsInNeighbourhood.resize(0);
+				nNSS.alreadyVisitedNeighbourhoodSize = 0;
+				unsigned found = octree.findNearestNeighborsStartingFromCell(nNSS);
+				octreeDists[i] = (found >= k ? nNSS.pointsInNeighbourhood[k - 1].squareDistd : -1.0);
+			}
+		}
+		double octreeTime = ElapsedSeconds(start);
+		std::printf("  [Octree]          %.3f s - %.0f queries/s\n", octreeTime, queryCount / octreeTime);
+
+		//the farthest neighbour distance is compared
+		auto countMismatches = [&](const std::vector<unsigned>& indexes)
+		{
+			size_t mismatches = 0;
+			for (unsigned i = 0; i < queryCount; ++i)
+			{
+				unsigned farthest = indexes[static_cast<size_t>(i) * k + k - 1];
+				double d2 = (farthest != FlatKdTree::InvalidIndex ? (queries[i] - *cloud.getPoint(farthest)).norm2d() : -1.0);
+				if (!SameDistance(octreeDists[i], d2))
+					++mismatches;
+			}
+			return mismatches;
+		};
+
+		std::vector<unsigned> indexes(static_cast<size_t>(queryCount) * k);
+		std::vector<ScalarType> squareDistances(static_cast<size_t>(queryCount) * k);
+		start = Clock::now();
+		for (unsigned i = 0; i < queryCount; ++i)
+		{
+			unsigned* queryIndexes = indexes.data() + static_cast<size_t>(i) * k;
+			unsigned found = tree.findKNearestNeighbours(queries[i].u, k, queryIndexes, squareDistances.data() + static_cast<size_t>(i) * k);
+			std::fill(queryIndexes + found, queryIndexes + k, FlatKdTree::InvalidIndex);
+		}
+		double time = ElapsedSeconds(start);
+		size_t mismatches = countMismatches(indexes);
+		totalMismatches += mismatches;
+		PrintRun("Flat KD-tree    ", time, octreeTime, queryCount, mismatches);
+
+		start = Clock::now();
+		if (!tree.findKNearestNeighbours(queries.data(), queryCount, k, indexes, squareDistances))
+		{
+			std::printf("Batched k-NN search failed\n");
+			return EXIT_FAILURE;
+		}
+		time = ElapsedSeconds(start);
+		mismatches = countMismatches(indexes);
+		totalMismatches += mismatches;
+		PrintRun("Flat KD-tree (batched)", time, octreeTime, queryCount, mismatches);
+	}
+
+	//radius
+	{
+		std::printf("Radius search:\n");
+		unsigned char level = octree.findBestLevelForAGivenNeighbourhoodSizeExtraction(radius);
+		double squareRadius = static_cast<double>(radius) * radius;
+
+		std::vector<unsigned> octreeCounts(queryCount);
+		std::vector<unsigned> octreeInnerCounts(queryCount);
+		start = Clock::now();
+		{
+			DgmOctree::NeighboursSet neighbours;
+			for (unsigned i = 0; i < queryCount; ++i)
+			{
+				neighbours.resize(0);
+				octreeCounts[i] = static_cast<unsigned>(octree.getPointsInSphericalNeighbourhood(queries[i], radius, neighbours, level));
+			}
+		}
+		double octreeTime = ElapsedSeconds(start);
+		std::printf("  [Octree]          %.3f s - %.0f queries/s\n", octreeTime, queryCount / octreeTime);
+
+		//the points that lie (almost) exactly on the sphere may be extracted by one method and not by the other
+		{
+			DgmOctree::NeighboursSet neighbours;
+			for (unsigned i = 0; i < queryCount; ++i)
+			{
+				neighbours.resize(0);
+				octree.getPointsInSphericalNeighbourhood(queries[i], radius, neighbours, level);
+				octreeInnerCounts[i] = static_cast<unsigned>(std::count_if(neighbours.begin(), neighbours.end(), [&](const DgmOctree::PointDescriptor& p) { return p.squareDistd < squareRadius * (1.0 - 1.0e-5); }));
+			}
+		}
+		auto isMismatch = [&](unsigned i, const unsigned* begin, const unsigned* end)
+		{
+			unsigned count = static_cast<unsigned>(end - begin);
+			unsigned innerCount = static_cast<unsigned>(std::count_if(begin, end, [&](unsigned index) { return (queries[i] - *cloud.getPoint(index)).norm2d() < squareRadius * (1.0 - 1.0e-5); }));
+			return (innerCount > octreeCounts[i] || octreeInnerCounts[i] > count);
+		};
+
+		std::vector<unsigned> offsets(static_cast<size_t>(queryCount) + 1, 0);
+		std::vector<unsigned> neighbours;
+		start = Clock::now();
+		for (unsigned i = 0; i < queryCount; ++i)
+		{
+			offsets[i + 1] = offsets[i] + tree.findPointsInSphere(queries[i].u, radius, neighbours);
+		}
+		double time = ElapsedSeconds(start);
+		size_t mismatches = 0;
+		for (unsigned i = 0; i < queryCount; ++i)
+		{
+			if (isMismatch(i, neighbours.data() + offsets[i], neighbours.data() + offsets[i + 1]))
+				++mismatches;
+		}
+		totalMismatches += mismatches;
+		PrintRun("Flat KD-tree    ", time, octreeTime, queryCount, mismatches);
+
+		start = Clock::now();
+		if (!tree.findPointsInSphere(queries.data(), queryCount, radius, offsets, neighbours))
+		{
+			std::printf("Batched radius search failed\n");
+			return EXIT_FAILURE;
+		}
+		time = ElapsedSeconds(start);
+		mismatches = 0;
+		for (unsigned i = 0; i < queryCount; ++i)
+		{
+			if (isMismatch(i, neighbours.data() + offsets[i], neighbours.data() + offsets[i + 1]))
+				++mismatches;
+		}
+		totalMismatches += mismatches;
+		PrintRun("Flat KD-tree (batched)", time, octreeTime, queryCount, mismatches);
+	}
+
+	return (totalMismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
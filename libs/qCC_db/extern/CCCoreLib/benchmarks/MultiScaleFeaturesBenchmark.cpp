@@ -0,0 +1,180 @@
+// SPDX-License-Identifier: LGPL-2.0-or-later
+// Copyright © CloudCompare Project
+
+//Computes a set of geometric characteristics (eigen-based features, curvature, density, roughness) at several
+//scales on the same cloud, either one by one with the octree (one traversal per characteristic and per scale) or
+//all at once with GeometricalAnalysisTools::ComputeCharacteristics, and compares the results.
+//Usage: MultiScaleFeaturesBenchmark [point count (default: 500 000)] [smallest radius (default: 0.02)] [scale count (default: 3)]
+
+//CCCoreLib
+#include <DgmOctree.h>
+#include <GeometricalAnalysisTools.h>
+#include <PointCloud.h>
+#include <ScalarField.h>
+
+//system
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace CCCoreLib;
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	double ElapsedSeconds(const Clock::time_point& start)
+	{
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	//! Releases a scalar field (see CCShareable)
+	struct ScalarFieldReleaser
+	{
+		void operator()(ScalarField* sf) const { sf->release(); }
+	};
+	using ScalarFieldPtr = std::unique_ptr<ScalarField, ScalarFieldReleaser>;
+
+	//! Generates a synthetic cloud (noisy undulating surface)
+	void GenerateCloud(PointCloud& cloud, unsigned pointCount)
+	{
+		std::mt19937 generator(12345);
+		std::uniform_real_distribution<float> uniform(0.0f, 10.0f);
+		std::normal_distribution<float> noise(0.0f, 0.01f);
+
+		cloud.reserve(pointCount);
+		for (unsigned i = 0; i < pointCount; ++i)
+		{
+			float x = uniform(generator);
+			float y = uniform(generator);
+			float z = 0.3f * std::sin(x) * std::cos(y) + noise(generator);
+			cloud.addPoint(CCVector3(x, y, z));
+		}
+	}
+
+	//! Returns the number of values that differ (relative tolerance)
+	size_t CountDifferences(const std::vector<ScalarType>& a, const ScalarField& b)
+	{
+		size_t count = 0;
+		for (size_t i = 0; i < a.size(); ++i)
+		{
+			bool aIsNaN = std::isnan(a[i]);
+			bool bIsNaN = std::isnan(b[i]);
+			if (aIsNaN != bIsNaN || (!aIsNaN && std::abs(a[i] - b[i]) > 1.0e-3 * std::max<ScalarType>(1, std::abs(a[i]))))
+			{
+				++count;
+			}
+		}
+		return count;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned pointCount = (argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10)) : 500000);
+	PointCoordinateType radius = (argc > 2 ? static_cast<PointCoordinateType>(std::atof(argv[2])) : static_cast<PointCoordinateType>(0.02));
+	int scaleCount = (argc > 3 ? std::atoi(argv[3]) : 3);
+	if (pointCount < 4 || radius <= 0 || scaleCount <= 0)
+	{
+		std::printf("Invalid parameters\n");
+		return EXIT_FAILURE;
+	}
+
+	PointCloud cloud;
+	GenerateCloud(cloud, pointCount);
+	if (!cloud.enableScalarField())
+	{
+		std::printf("Not enough memory\n");
+		return EXIT_FAILURE;
+	}
+
+	//characteristics computed at each scale
+	const std::vector< std::pair<GeometricalAnalysisTools::GeomCharacteristic, int> > characteristics
+	{
+		{ GeometricalAnalysisTools::Feature, Neighbourhood::EigenValuesSum },
+		{ GeometricalAnalysisTools::Feature, Neighbourhood::Omnivariance },
+		{ GeometricalAnalysisTools::Feature, Neighbourhood::Anisotropy },
+		{ GeometricalAnalysisTools::Feature, Neighbourhood::Planarity },
+		{ GeometricalAnalysisTools::Feature, Neighbourhood::Linearity },
+		{ GeometricalAnalysisTools::Feature, Neighbourhood::SurfaceVariation },
+		{ GeometricalAnalysisTools::Feature, Neighbourhood::Sphericity },
+		{ GeometricalAnalysisTools::Feature, Neighbourhood::Verticality },
+		{ GeometricalAnalysisTools::Curvature, Neighbourhood::NORMAL_CHANGE_RATE },
+		{ GeometricalAnalysisTools::LocalDensity, GeometricalAnalysisTools::DENSITY_3D },
+		{ GeometricalAnalysisTools::Roughness, 0 },
+		{ GeometricalAnalysisTools::MomentOrder1, 0 }
+	};
+
+	std::vector<GeometricalAnalysisTools::CharacteristicRequest> requests;
+	std::vector<ScalarFieldPtr> scalarFields;
+	for (int s = 0; s < scaleCount; ++s)
+	{
+		PointCoordinateType scaleRadius = radius * (s + 1);
+		for (const auto& c : characteristics)
+		{
+			scalarFields.emplace_back(new ScalarField("feature"));
+			if (!scalarFields.back()->resizeSafe(pointCount))
+			{
+				std::printf("Not enough memory\n");
+				return EXIT_FAILURE;
+			}
+			requests.emplace_back(c.first, c.second, scaleRadius, scalarFields.back().get());
+		}
+	}
+	std::printf("Points: %u - characteristics: %zu - scales: %i (radius: %g to %g)\n", pointCount, characteristics.size(), scaleCount, radius, radius * scaleCount);
+
+	//one octree traversal per characteristic and per scale
+	std::vector< std::vector<ScalarType> > octreeResults(requests.size());
+	Clock::time_point start = Clock::now();
+	{
+		DgmOctree octree(&cloud);
+		if (octree.build() <= 0)
+		{
+			std::printf("Failed to build the octree\n");
+			return EXIT_FAILURE;
+		}
+
+		for (size_t i = 0; i < requests.size(); ++i)
+		{
+			const GeometricalAnalysisTools::CharacteristicRequest& request = requests[i];
+			if (GeometricalAnalysisTools::ComputeCharactersitic(request.c, request.subOption, &cloud, request.radius, nullptr, &octree) != GeometricalAnalysisTools::NoError)
+			{
+				std::printf("Octree-based computation failed\n");
+				return EXIT_FAILURE;
+			}
+			octreeResults[i].resize(pointCount);
+			for (unsigned j = 0; j < pointCount; ++j)
+			{
+				octreeResults[i][j] = cloud.getPointScalarValue(j);
+			}
+		}
+	}
+	double octreeTime = ElapsedSeconds(start);
+	std::printf("  [One by one]  %.3f s\n", octreeTime);
+
+	//single pass
+	start = Clock::now();
+	if (GeometricalAnalysisTools::ComputeCharacteristics(requests, &cloud) != GeometricalAnalysisTools::NoError)
+	{
+		std::printf("Single pass computation failed\n");
+		return EXIT_FAILURE;
+	}
+	double singlePassTime = ElapsedSeconds(start);
+	std::printf("  [Single pass] %.3f s - speed-up: x%.1f\n", singlePassTime, octreeTime / singlePassTime);
+
+	//the results may only differ for a few points (on the kernel boundary, or ill-conditioned neighbourhoods)
+	size_t maxDiff = 0;
+	for (size_t i = 0; i < requests.size(); ++i)
+	{
+		maxDiff = std::max(maxDiff, CountDifferences(octreeResults[i], *scalarFields[i]));
+	}
+	bool valid = (maxDiff * 1000 <= pointCount);
+	std::printf("  Max. differences per characteristic: %zu%s\n", maxDiff, valid ? "" : " - INVALID RESULT");
+
+	return (valid ? EXIT_SUCCESS : EXIT_FAILURE);
+}
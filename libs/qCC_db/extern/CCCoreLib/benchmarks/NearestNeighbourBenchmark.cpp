@@ -0,0 +1,224 @@
+// SPDX-License-Identifier: LGPL-2.0-or-later
+// Copyright © CloudCompare Project
+
+//Compares the batched nearest neighbour search of the cloud-to-cloud distances (with each kernel)
+//with the former point-by-point search, and checks that the results are the same.
+//Usage: NearestNeighbourBenchmark [point count (default: 2 000 000) or ASCII 'X Y Z' compared file] [ASCII 'X Y Z' reference file] [max search distance (default: none)]
+
+//CCCoreLib
+#include <CCConst.h>
+#include <DistanceComputationTools.h>
+#include <PointCloud.h>
+#include <ReferenceCloud.h>
+#include <ScalarField.h>
+
+//system
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace CCCoreLib;
+
+namespace
+{
+	//! Generates a synthetic scan (noisy surfaces + uniform clutter, in random order)
+	/** The same seed with a different offset gives a second (slightly shifted) scan of the same scene.
+	**/
+	void GenerateCloud(PointCloud& cloud, unsigned pointCount, unsigned seed, float offset)
+	{
+		std::mt19937 generator(seed);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+		std::normal_distribution<float> noise(0.0f, 0.01f);
+
+		cloud.reserve(pointCount);
+		for (unsigned i = 0; i < pointCount; ++i)
+		{
+			float u = uniform(generator) * 50.0f;
+			float v = uniform(generator) * 50.0f;
+			switch (i % 4)
+			{
+			case 0: //ground
+				cloud.addPoint(CCVector3(u, v, offset + noise(generator)));
+				break;
+			case 1: //wall
+				cloud.addPoint(CCVector3(u, offset + noise(generator), v / 5));
+				break;
+			case 2: //cylinder
+			{
+				float angle = u / 50.0f * static_cast<float>(2 * M_PI);
+				cloud.addPoint(CCVector3(25.0f + (5.0f + offset) * std::cos(angle), 25.0f + (5.0f + offset) * std::sin(angle), v / 5 + noise(generator)));
+			}
+			break;
+			default: //clutter
+				cloud.addPoint(CCVector3(u, v, uniform(generator) * 10.0f));
+				break;
+			}
+		}
+	}
+
+	//! Loads an ASCII cloud (one 'X Y Z [...]' point per line)
+	bool LoadCloud(PointCloud& cloud, const char* filename)
+	{
+		FILE* fp = std::fopen(filename, "r");
+		if (!fp)
+		{
+			return false;
+		}
+
+		char line[1024];
+		while (std::fgets(line, sizeof(line), fp))
+		{
+			double x = 0;
+			double y = 0;
+			double z = 0;
+			if (std::sscanf(line, "%lf %lf %lf", &x, &y, &z) == 3 || std::sscanf(line, "%lf,%lf,%lf", &x, &y, &z) == 3)
+			{
+				cloud.addPoint(CCVector3(static_cast<PointCoordinateType>(x), static_cast<PointCoordinateType>(y), static_cast<PointCoordinateType>(z)));
+			}
+		}
+		std::fclose(fp);
+
+		return cloud.size() != 0;
+	}
+
+	using Clock = std::chrono::steady_clock;
+
+	double ElapsedSeconds(const Clock::time_point& start)
+	{
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	//! Distances and closest points of a run
+	struct Result
+	{
+		std::vector<ScalarType> distances;
+		std::vector<unsigned> nearestIndexes;
+		double time = 0.0;
+	};
+
+	//! Computes the cloud-to-cloud distances (and the closest point set if no max search distance is set)
+	bool Run(PointCloud& compared, PointCloud& reference, ScalarType maxSearchDist, bool batched, DgmOctree::NearestNeighbourKernel kernel, Result& result)
+	{
+		ReferenceCloud CPSet(&reference);
+
+		DistanceComputationTools::Cloud2CloudDistanceComputationParams params;
+		params.maxSearchDist = maxSearchDist;
+		params.CPSet = (maxSearchDist > 0 ? nullptr : &CPSet);
+		params.batchedNNSearch = batched;
+		params.nnKernel = kernel;
+
+		Clock::time_point start = Clock::now();
+		if (DistanceComputationTools::computeCloud2CloudDistance(&compared, &reference, params) < 0)
+		{
+			return false;
+		}
+		result.time = ElapsedSeconds(start);
+
+		unsigned pointCount = compared.size();
+		result.distances.resize(pointCount);
+		for (unsigned i = 0; i < pointCount; ++i)
+		{
+			result.distances[i] = compared.getPointScalarValue(i);
+		}
+		if (params.CPSet)
+		{
+			result.nearestIndexes.resize(pointCount);
+			for (unsigned i = 0; i < pointCount; ++i)
+			{
+				result.nearestIndexes[i] = CPSet.getPointGlobalIndex(i);
+			}
+		}
+		return true;
+	}
+
+	//! Compares a run with the reference (former) run
+	/** Equidistant neighbours may be picked in a different order, hence a different
+		closest point is only a mismatch if it is not at the very same distance.
+		\return the number of mismatches
+	**/
+	size_t Compare(const Result& legacy, const Result& result, const PointCloud& compared, const PointCloud& reference)
+	{
+		size_t mismatches = 0;
+		for (size_t i = 0; i < legacy.distances.size(); ++i)
+		{
+			ScalarType a = legacy.distances[i];
+			ScalarType b = result.distances[i];
+			if (a != b && !(std::isnan(a) && std::isnan(b)))
+			{
+				++mismatches;
+			}
+			else if (!legacy.nearestIndexes.empty() && legacy.nearestIndexes[i] != result.nearestIndexes[i])
+			{
+				const CCVector3* Q = compared.getPoint(static_cast<unsigned>(i));
+				double da = (*Q - *reference.getPoint(legacy.nearestIndexes[i])).norm2d();
+				double db = (*Q - *reference.getPoint(result.nearestIndexes[i])).norm2d();
+				if (da != db)
+				{
+					++mismatches;
+				}
+			}
+		}
+		return mismatches;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	PointCloud compared;
+	PointCloud reference;
+	if (argc > 2 && std::strtoul(argv[1], nullptr, 10) == 0)
+	{
+		if (!LoadCloud(compared, argv[1]) || !LoadCloud(reference, argv[2]))
+		{
+			std::printf("Failed to load '%s' or '%s'\n", argv[1], argv[2]);
+			return EXIT_FAILURE;
+		}
+	}
+	else
+	{
+		unsigned pointCount = (argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10)) : 2000000);
+		GenerateCloud(compared, pointCount, 12345, 0.0f);
+		GenerateCloud(reference, pointCount, 54321, 0.05f);
+	}
+	ScalarType maxSearchDist = (argc > 3 ? static_cast<ScalarType>(std::atof(argv[3])) : 0);
+
+	if (!compared.enableScalarField())
+	{
+		std::printf("Not enough memory\n");
+		return EXIT_FAILURE;
+	}
+
+	std::printf("Compared points: %u - reference points: %u - max search distance: %g\n", compared.size(), reference.size(), maxSearchDist);
+	std::printf("Best kernel: %i\n", static_cast<int>(DgmOctree::GetBestNearestNeighbourKernel()));
+
+	Result legacy;
+	if (!Run(compared, reference, maxSearchDist, false, DgmOctree::NN_KERNEL_AUTO, legacy))
+	{
+		std::printf("Cloud-to-cloud distances computation failed\n");
+		return EXIT_FAILURE;
+	}
+	std::printf("[Point by point]  %.3f s\n", legacy.time);
+
+	const DgmOctree::NearestNeighbourKernel kernels[] = { DgmOctree::NN_KERNEL_SCALAR, DgmOctree::NN_KERNEL_SSE2, DgmOctree::NN_KERNEL_AVX2 };
+	const char* kernelNames[] = { "Batched scalar", "Batched SSE2  ", "Batched AVX2  " };
+
+	size_t totalMismatches = 0;
+	for (size_t k = 0; k < 3; ++k)
+	{
+		Result result;
+		if (!Run(compared, reference, maxSearchDist, true, kernels[k], result))
+		{
+			std::printf("Cloud-to-cloud distances computation failed\n");
+			return EXIT_FAILURE;
+		}
+		size_t mismatches = Compare(legacy, result, compared, reference);
+		totalMismatches += mismatches;
+		std::printf("[%s]  %.3f s - speed-up: x%.1f - mismatches: %zu\n", kernelNames[k], result.time, legacy.time / result.time, mismatches);
+	}
+
+	return (totalMismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
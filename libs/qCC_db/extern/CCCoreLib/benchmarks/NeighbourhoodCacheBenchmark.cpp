@@ -0,0 +1,226 @@
+// SPDX-License-Identifier: LGPL-2.0-or-later
+// Copyright © CloudCompare Project
+
+//Runs a typical cleaning chain (SOR filter, noise filter, roughness and curvature at the same scale) on the
+//same cloud, either with the octree (neighbours extracted by each process) or with a neighbourhood cache
+//(neighbours extracted once), and compares the results.
+//The SOR and noise filters must keep the same points. The roughness and curvature values must be equal (relative
+//tolerance: 1e-3) on all the points for the roughness and on 99.5% of the points for the curvature: the cached
+//neighbours are not visited in the octree order, and the quadric fitting (conjugate gradient) is sensitive to it.
+//Usage: NeighbourhoodCacheBenchmark [point count (default: 1 000 000)] [radius (default: 0.05)] [knn (default: 6)]
+
+//CCCoreLib
+#include <CloudSamplingTools.h>
+#include <DgmOctree.h>
+#include <GeometricalAnalysisTools.h>
+#include <NeighbourhoodCache.h>
+#include <PointCloud.h>
+#include <ReferenceCloud.h>
+
+//system
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace CCCoreLib;
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	//! Relative tolerance on the scalar values
+	const ScalarType c_valueTolerance = static_cast<ScalarType>(1.0e-3);
+	//! Max ratio of points with a different roughness value
+	const double c_maxRoughnessDiffRatio = 0.0;
+	//! Max ratio of points with a different curvature value (order dependent quadric fitting)
+	const double c_maxCurvatureDiffRatio = 0.005;
+
+	double ElapsedSeconds(const Clock::time_point& start)
+	{
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	//! Generates a synthetic cloud (noisy undulating surface + a few outliers)
+	void GenerateCloud(PointCloud& cloud, unsigned pointCount)
+	{
+		std::mt19937 generator(12345);
+		std::uniform_real_distribution<float> uniform(0.0f, 10.0f);
+		std::normal_distribution<float> noise(0.0f, 0.01f);
+
+		cloud.reserve(pointCount);
+		for (unsigned i = 0; i < pointCount; ++i)
+		{
+			float x = uniform(generator);
+			float y = uniform(generator);
+			float z = 0.3f * std::sin(x) * std::cos(y) + noise(generator);
+			if (i % 50 == 0)
+			{
+				z += uniform(generator) / 10; //outlier
+			}
+			cloud.addPoint(CCVector3(x, y, z));
+		}
+	}
+
+	//! Returns the sorted indexes of a reference cloud
+	std::vector<unsigned> SortedIndexes(const ReferenceCloud* cloud)
+	{
+		std::vector<unsigned> indexes;
+		if (cloud)
+		{
+			indexes.resize(cloud->size());
+			for (unsigned i = 0; i < cloud->size(); ++i)
+			{
+				indexes[i] = cloud->getPointGlobalIndex(i);
+			}
+			std::sort(indexes.begin(), indexes.end());
+		}
+		return indexes;
+	}
+
+	//! Results of the chain
+	struct ChainResults
+	{
+		std::vector<unsigned> sor;
+		std::vector<unsigned> noise;
+		std::vector<ScalarType> roughness;
+		std::vector<ScalarType> curvature;
+		double time = 0;
+	};
+
+	//! Reads the current scalar field values
+	std::vector<ScalarType> ScalarValues(PointCloud& cloud)
+	{
+		std::vector<ScalarType> values(cloud.size());
+		for (unsigned i = 0; i < cloud.size(); ++i)
+		{
+			values[i] = cloud.getPointScalarValue(i);
+		}
+		return values;
+	}
+
+	//! Runs the chain (with the octree or with the caches)
+	bool RunChain(PointCloud& cloud, PointCoordinateType radius, int knn, const NeighbourhoodCache* knnCache, const NeighbourhoodCache* radiusCache, ChainResults& results)
+	{
+		Clock::time_point start = Clock::now();
+
+		std::unique_ptr<DgmOctree> octree;
+		if (!knnCache || !radiusCache)
+		{
+			octree.reset(new DgmOctree(&cloud));
+			if (octree->build() <= 0)
+			{
+				return false;
+			}
+		}
+
+		std::unique_ptr<ReferenceCloud> sorCloud(CloudSamplingTools::sorFilter(&cloud, knn, 1.0, octree.get(), nullptr, knnCache));
+		std::unique_ptr<ReferenceCloud> noiseCloud(CloudSamplingTools::noiseFilter(&cloud, radius, 1.0, false, false, knn, false, 0.0, octree.get(), nullptr, radiusCache));
+		if (!sorCloud || !noiseCloud)
+		{
+			return false;
+		}
+
+		if (GeometricalAnalysisTools::ComputeCharactersitic(GeometricalAnalysisTools::Roughness, 0, &cloud, radius, nullptr, octree.get(), radiusCache) != GeometricalAnalysisTools::NoError)
+		{
+			return false;
+		}
+		results.roughness = ScalarValues(cloud);
+
+		if (GeometricalAnalysisTools::ComputeCharactersitic(GeometricalAnalysisTools::Curvature, Neighbourhood::MEAN_CURV, &cloud, radius, nullptr, octree.get(), radiusCache) != GeometricalAnalysisTools::NoError)
+		{
+			return false;
+		}
+		results.curvature = ScalarValues(cloud);
+
+		results.time = ElapsedSeconds(start);
+		results.sor = SortedIndexes(sorCloud.get());
+		results.noise = SortedIndexes(noiseCloud.get());
+
+		return true;
+	}
+
+	//! Returns the number of values that differ (relative tolerance)
+	size_t CountDifferences(const std::vector<ScalarType>& a, const std::vector<ScalarType>& b)
+	{
+		size_t count = 0;
+		for (size_t i = 0; i < a.size(); ++i)
+		{
+			bool aIsNaN = std::isnan(a[i]);
+			bool bIsNaN = std::isnan(b[i]);
+			if (aIsNaN != bIsNaN || (!aIsNaN && std::abs(a[i] - b[i]) > c_valueTolerance * std::max<ScalarType>(1, std::abs(a[i]))))
+			{
+				++count;
+			}
+		}
+		return count;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned pointCount = (argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10)) : 1000000);
+	PointCoordinateType radius = (argc > 2 ? static_cast<PointCoordinateType>(std::atof(argv[2])) : static_cast<PointCoordinateType>(0.05));
+	int knn = (argc > 3 ? std::atoi(argv[3]) : 6);
+	if (pointCount <= static_cast<unsigned>(knn) || radius <= 0 || knn <= 0)
+	{
+		std::printf("Invalid parameters\n");
+		return EXIT_FAILURE;
+	}
+
+	PointCloud cloud;
+	GenerateCloud(cloud, pointCount);
+	if (!cloud.enableScalarField())
+	{
+		std::printf("Not enough memory\n");
+		return EXIT_FAILURE;
+	}
+	std::printf("Points: %u - radius: %g - knn: %i\n", pointCount, radius, knn);
+
+	ChainResults octreeResults;
+	if (!RunChain(cloud, radius, knn, nullptr, nullptr, octreeResults))
+	{
+		std::printf("Octree-based chain failed\n");
+		return EXIT_FAILURE;
+	}
+	std::printf("  [Octree]  %.3f s\n", octreeResults.time);
+
+	//the caches are computed once (and could be shared by more processes)
+	Clock::time_point start = Clock::now();
+	NeighbourhoodCache knnCache;
+	NeighbourhoodCache radiusCache;
+	if (!knnCache.computeKNN(&cloud, static_cast<unsigned>(knn)) || !radiusCache.computeRadius(&cloud, radius))
+	{
+		std::printf("Failed to compute the caches\n");
+		return EXIT_FAILURE;
+	}
+	double cacheTime = ElapsedSeconds(start);
+	std::printf("  [Caches]  %.3f s - %.1f MB - %.1f neighbours per point (radius)\n", cacheTime, (knnCache.memoryUsage() + radiusCache.memoryUsage()) / 1.0e6, static_cast<double>(radiusCache.neighbourTotalCount()) / pointCount);
+
+	ChainResults cacheResults;
+	if (!RunChain(cloud, radius, knn, &knnCache, &radiusCache, cacheResults))
+	{
+		std::printf("Cache-based chain failed\n");
+		return EXIT_FAILURE;
+	}
+	std::printf("  [Cached]  %.3f s (%.3f s with the caches) - speed-up: x%.1f\n", cacheResults.time, cacheResults.time + cacheTime, octreeResults.time / (cacheResults.time + cacheTime));
+
+	//the neighbours are the same (but they may be visited in a different order)
+	size_t roughnessDiff = CountDifferences(octreeResults.roughness, cacheResults.roughness);
+	size_t curvatureDiff = CountDifferences(octreeResults.curvature, cacheResults.curvature);
+	bool valid = (	octreeResults.sor == cacheResults.sor
+				&&	octreeResults.noise == cacheResults.noise
+				&&	roughnessDiff <= static_cast<size_t>(c_maxRoughnessDiffRatio * pointCount)
+				&&	curvatureDiff <= static_cast<size_t>(c_maxCurvatureDiffRatio * pointCount) );
+	std::printf("  SOR: %zu/%zu points - noise: %zu/%zu points - roughness diff.: %zu - curvature diff.: %zu%s\n",
+				cacheResults.sor.size(), octreeResults.sor.size(),
+				cacheResults.noise.size(), octreeResults.noise.size(),
+				roughnessDiff, curvatureDiff,
+				valid ? "" : " - INVALID RESULT");
+
+	return (valid ? EXIT_SUCCESS : EXIT_FAILURE);
+}
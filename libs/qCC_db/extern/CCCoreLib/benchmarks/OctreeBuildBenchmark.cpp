@@ -0,0 +1,243 @@
+// SPDX-License-Identifier: LGPL-2.0-or-later
+// Copyright © CloudCompare Project
+
+//Compares the parallel octree build (chunked cell code generation + radix sort)
+//with the former serial code generation followed by a comparison sort (and one pass per
+//level for the cells statistics).
+//Usage: OctreeBuildBenchmark [point count (default: 10 000 000) or ASCII 'X Y Z' file] [repetitions (default: 3)]
+
+//CCCoreLib
+#include <CCConst.h>
+#include <DgmOctree.h>
+#include <PointCloud.h>
+
+//system
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace CCCoreLib;
+
+namespace
+{
+	//! Generates a synthetic cloud (noisy surfaces + uniform clutter, in random order)
+	void GenerateCloud(PointCloud& cloud, unsigned pointCount)
+	{
+		std::mt19937 generator(12345);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+		std::normal_distribution<float> noise(0.0f, 0.01f);
+
+		cloud.reserve(pointCount);
+		for (unsigned i = 0; i < pointCount; ++i)
+		{
+			float u = uniform(generator) * 50.0f;
+			float v = uniform(generator) * 50.0f;
+			switch (i % 4)
+			{
+			case 0: //ground
+				cloud.addPoint(CCVector3(u, v, noise(generator)));
+				break;
+			case 1: //wall
+				cloud.addPoint(CCVector3(u, noise(generator), v / 5));
+				break;
+			case 2: //cylinder
+			{
+				float angle = u / 50.0f * static_cast<float>(2 * M_PI);
+				cloud.addPoint(CCVector3(25.0f + 5.0f * std::cos(angle), 25.0f + 5.0f * std::sin(angle), v / 5 + noise(generator)));
+			}
+			break;
+			default: //clutter
+				cloud.addPoint(CCVector3(u, v, uniform(generator) * 10.0f));
+				break;
+			}
+		}
+	}
+
+	//! Loads an ASCII cloud (one 'X Y Z [...]' point per line)
+	bool LoadCloud(PointCloud& cloud, const char* filename)
+	{
+		FILE* fp = std::fopen(filename, "r");
+		if (!fp)
+		{
+			return false;
+		}
+
+		char line[1024];
+		while (std::fgets(line, sizeof(line), fp))
+		{
+			double x = 0;
+			double y = 0;
+			double z = 0;
+			if (std::sscanf(line, "%lf %lf %lf", &x, &y, &z) == 3 || std::sscanf(line, "%lf,%lf,%lf", &x, &y, &z) == 3)
+			{
+				cloud.addPoint(CCVector3(static_cast<PointCoordinateType>(x), static_cast<PointCoordinateType>(y), static_cast<PointCoordinateType>(z)));
+			}
+		}
+		std::fclose(fp);
+
+		return cloud.size() != 0;
+	}
+
+	//! Former approach: serial cell code generation followed by a comparison sort
+	/** The octree is only used for its (already computed) bounding-box and cell sizes.
+		Assumes a non-empty cloud.
+		\param[out] cellCounts number of cells per level
+		\param[out] maxCellPopulations max cell population per level
+	**/
+	void LegacyBuild(	const DgmOctree& octree,
+						PointCloud& cloud,
+						DgmOctree::cellsContainer& cells,
+						unsigned* cellCounts,
+						unsigned* maxCellPopulations)
+	{
+		unsigned pointCount = cloud.size();
+		cells.resize(pointCount);
+
+		DgmOctree::cellsContainer::iterator it = cells.begin();
+		for (unsigned i = 0; i < pointCount; ++i, ++it)
+		{
+			Tuple3i cellPos;
+			octree.getTheCellPosWhichIncludesThePoint(cloud.getPoint(i), cellPos);
+			cellPos.x = std::min(std::max(cellPos.x, 0), DgmOctree::MAX_OCTREE_LENGTH - 1);
+			cellPos.y = std::min(std::max(cellPos.y, 0), DgmOctree::MAX_OCTREE_LENGTH - 1);
+			cellPos.z = std::min(std::max(cellPos.z, 0), DgmOctree::MAX_OCTREE_LENGTH - 1);
+
+			it->theIndex = i;
+			it->theCode = DgmOctree::GenerateTruncatedCellCode(cellPos, DgmOctree::MAX_OCTREE_LEVEL);
+		}
+
+		std::sort(cells.begin(), cells.end(), DgmOctree::IndexAndCode::codeComp);
+
+		//cells statistics for each level (unchanged step of the build, for a fair comparison)
+		for (unsigned char level = 1; level <= DgmOctree::MAX_OCTREE_LEVEL; ++level)
+		{
+			unsigned char bitShift = DgmOctree::GET_BIT_SHIFT(level);
+			DgmOctree::CellCode predCode = (cells.front().theCode >> bitShift);
+			unsigned population = 0;
+			unsigned cellCount = 0;
+			unsigned maxCellPopulation = 0;
+			for (const DgmOctree::IndexAndCode& cell : cells)
+			{
+				DgmOctree::CellCode code = (cell.theCode >> bitShift);
+				if (code != predCode)
+				{
+					++cellCount;
+					maxCellPopulation = std::max(maxCellPopulation, population);
+					population = 0;
+					predCode = code;
+				}
+				++population;
+			}
+			cellCounts[level] = cellCount + 1;
+			maxCellPopulations[level] = std::max(maxCellPopulation, population);
+		}
+	}
+
+	using Clock = std::chrono::steady_clock;
+
+	double ElapsedSeconds(const Clock::time_point& start)
+	{
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	PointCloud cloud;
+	if (argc > 1 && std::strtoul(argv[1], nullptr, 10) == 0)
+	{
+		if (!LoadCloud(cloud, argv[1]))
+		{
+			std::printf("Failed to load '%s'\n", argv[1]);
+			return EXIT_FAILURE;
+		}
+	}
+	else
+	{
+		unsigned pointCount = (argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10)) : 10000000);
+		GenerateCloud(cloud, pointCount);
+	}
+	int repetitions = (argc > 2 ? std::max(1, std::atoi(argv[2])) : 3);
+
+	unsigned pointCount = cloud.size();
+	std::printf("Points: %u - repetitions: %i\n", pointCount, repetitions);
+
+	DgmOctree octree(&cloud);
+	double buildTime = 0;
+	for (int r = 0; r < repetitions; ++r)
+	{
+		octree.clear();
+		Clock::time_point start = Clock::now();
+		if (octree.build() <= 0)
+		{
+			std::printf("DgmOctree::build failed\n");
+			return EXIT_FAILURE;
+		}
+		double t = ElapsedSeconds(start);
+		buildTime = (r == 0 ? t : std::min(buildTime, t));
+	}
+
+	DgmOctree::cellsContainer legacyCells;
+	unsigned legacyCellCounts[DgmOctree::MAX_OCTREE_LEVEL + 1] = { 0 };
+	unsigned legacyMaxCellPopulations[DgmOctree::MAX_OCTREE_LEVEL + 1] = { 0 };
+	double legacyTime = 0;
+	for (int r = 0; r < repetitions; ++r)
+	{
+		Clock::time_point start = Clock::now();
+		LegacyBuild(octree, cloud, legacyCells, legacyCellCounts, legacyMaxCellPopulations);
+		double t = ElapsedSeconds(start);
+		legacyTime = (r == 0 ? t : std::min(legacyTime, t));
+	}
+
+	std::printf("[Legacy build]    %.3f s (%.1f Mpts/s)\n", legacyTime, pointCount / legacyTime / 1.0e6);
+	std::printf("[DgmOctree::build] %.3f s (%.1f Mpts/s) - speed-up: x%.1f\n", buildTime, pointCount / buildTime / 1.0e6, legacyTime / buildTime);
+
+	//the codes must be the same, and so must the indexes once each cell is sorted by index
+	//(the in-place MSD split of the large clouds is not stable)
+	DgmOctree::cellsContainer cells = octree.pointsAndTheirCellCodes();
+	if (cells.size() != legacyCells.size())
+	{
+		std::printf("Mismatch: %zu cells vs %zu\n", cells.size(), legacyCells.size());
+		return EXIT_FAILURE;
+	}
+	auto codeThenIndexComp = [](const DgmOctree::IndexAndCode& a, const DgmOctree::IndexAndCode& b)
+	{
+		return a.theCode < b.theCode || (a.theCode == b.theCode && a.theIndex < b.theIndex);
+	};
+	std::sort(cells.begin(), cells.end(), codeThenIndexComp);
+	std::sort(legacyCells.begin(), legacyCells.end(), codeThenIndexComp);
+	size_t codeMismatches = 0;
+	size_t indexMismatches = 0;
+	for (size_t i = 0; i < cells.size(); ++i)
+	{
+		if (cells[i].theCode != legacyCells[i].theCode)
+		{
+			++codeMismatches;
+		}
+		else if (cells[i].theIndex != legacyCells[i].theIndex)
+		{
+			++indexMismatches;
+		}
+	}
+	std::printf("Code mismatches: %zu - index mismatches: %zu\n", codeMismatches, indexMismatches);
+
+	//so must the cells statistics
+	DgmOctree::Structure structure;
+	octree.getStructure(structure);
+	unsigned statisticsMismatches = 0;
+	for (unsigned char level = 1; level <= DgmOctree::MAX_OCTREE_LEVEL; ++level)
+	{
+		if (	structure.cellCount[level] != legacyCellCounts[level]
+			||	structure.maxCellPopulation[level] != legacyMaxCellPopulations[level])
+		{
+			++statisticsMismatches;
+		}
+	}
+	std::printf("Levels with different cell statistics: %u\n", statisticsMismatches);
+
+	return (codeMismatches == 0 && indexMismatches == 0 && statisticsMismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: LGPL-2.0-or-later
+// Copyright © CloudCompare Project
+
+//Compares the different ways of filling a ReferenceCloud from several threads: one lock per point
+//(addPointIndex), per-thread builders merged at once, and per-point flags adopted at once.
+//Usage: ReferenceCloudBenchmark [point count (default: 20 000 000)] [thread count (default: all)]
+
+//CCCoreLib
+#include <PointCloud.h>
+#include <ReferenceCloud.h>
+
+//system
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace CCCoreLib;
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	double ElapsedSeconds(const Clock::time_point& start)
+	{
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	//! Selection criterion (about 2 points out of 3, with some irregularity)
+	inline bool IsSelected(unsigned index)
+	{
+		unsigned h = index * 2654435761u;
+		return (h >> 16) % 3 != 0;
+	}
+
+	//! Runs a function on all the points, split in contiguous ranges (one per thread)
+	template <typename Func> void RunInParallel(unsigned pointCount, unsigned threadCount, const Func& func)
+	{
+		std::vector<std::thread> threads;
+		unsigned rangeSize = (pointCount + threadCount - 1) / threadCount;
+		for (unsigned t = 0; t < threadCount; ++t)
+		{
+			unsigned first = std::min(t * rangeSize, pointCount);
+			unsigned last = std::min(first + rangeSize, pointCount);
+			threads.emplace_back([&func, t, first, last]() { func(t, first, last); });
+		}
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+	}
+
+	//! Checks that a reference cloud contains the expected indexes (in any order)
+	bool CheckIndexes(const ReferenceCloud& cloud, const std::vector<unsigned>& expected)
+	{
+		std::vector<unsigned> indexes(cloud.size());
+		for (unsigned i = 0; i < cloud.size(); ++i)
+		{
+			indexes[i] = cloud.getPointGlobalIndex(i);
+		}
+		std::sort(indexes.begin(), indexes.end());
+		return indexes == expected;
+	}
+
+	//! Prints the timing of a run
+	void PrintRun(const char* name, double time, double referenceTime, unsigned pointCount, bool valid)
+	{
+		std::printf("  [%s]  %.3f s - %.1f M. points/s - speed-up: x%.1f%s\n", name, time, pointCount / time / 1.0e6, referenceTime / time, valid ? "" : " - INVALID RESULT");
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned pointCount = (argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10)) : 20000000);
+	unsigned threadCount = (argc > 2 ? static_cast<unsigned>(std::strtoul(argv[2], nullptr, 10)) : std::max(1u, std::thread::hardware_concurrency()));
+	if (pointCount == 0 || threadCount == 0)
+	{
+		std::printf("Invalid parameters\n");
+		return EXIT_FAILURE;
+	}
+	std::printf("Points: %u - threads: %u\n", pointCount, threadCount);
+
+	//the associated cloud is never accessed
+	PointCloud cloud;
+
+	std::vector<unsigned> expected;
+	for (unsigned i = 0; i < pointCount; ++i)
+	{
+		if (IsSelected(i))
+		{
+			expected.push_back(i);
+		}
+	}
+	std::printf("Selected points: %zu\n", expected.size());
+
+	bool allValid = true;
+
+	//one lock per point
+	ReferenceCloud lockedCloud(&cloud);
+	Clock::time_point start = Clock::now();
+	RunInParallel(pointCount, threadCount, [&](unsigned, unsigned first, unsigned last)
+	{
+		for (unsigned i = first; i < last; ++i)
+		{
+			if (IsSelected(i))
+			{
+				lockedCloud.addPointIndex(i);
+			}
+		}
+	});
+	double lockedTime = ElapsedSeconds(start);
+	bool valid = CheckIndexes(lockedCloud, expected);
+	allValid &= valid;
+	PrintRun("addPointIndex (1 lock per point)", lockedTime, lockedTime, pointCount, valid);
+
+	//per-thread builders
+	ReferenceCloud builtCloud(&cloud);
+	start = Clock::now();
+	{
+		std::vector<ReferenceCloud::IndexBuilder> builders(threadCount);
+		RunInParallel(pointCount, threadCount, [&](unsigned t, unsigned first, unsigned last)
+		{
+			for (unsigned i = first; i < last; ++i)
+			{
+				if (IsSelected(i))
+				{
+					builders[t].add(i);
+				}
+			}
+		});
+		builtCloud.addPointIndexes(builders);
+	}
+	double time = ElapsedSeconds(start);
+	valid = CheckIndexes(builtCloud, expected);
+	allValid &= valid;
+	PrintRun("Per-thread builders             ", time, lockedTime, pointCount, valid);
+
+	//per-point flags
+	ReferenceCloud flaggedCloud(&cloud);
+	start = Clock::now();
+	{
+		std::vector<unsigned char> flags(pointCount, 0);
+		RunInParallel(pointCount, threadCount, [&](unsigned, unsigned first, unsigned last)
+		{
+			for (unsigned i = first; i < last; ++i)
+			{
+				flags[i] = (IsSelected(i) ? 1 : 0);
+			}
+		});
+		flaggedCloud.addFlaggedPointIndexes(flags.data(), pointCount);
+	}
+	time = ElapsedSeconds(start);
+	valid = CheckIndexes(flaggedCloud, expected);
+	allValid &= valid;
+	PrintRun("Flags adoption                  ", time, lockedTime, pointCount, valid);
+
+	return (allValid ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: LGPL-2.0-or-later
+// Copyright © CloudCompare Project
+
+//Compares the z-buffer visibility engine (VisibilityTools) with the former
+//'nested vectors' depth grid used to clean the unrolled shafts.
+//Usage: VisibilityBenchmark [point count (default: 5 000 000)] [cell size (default: 0.02)]
+
+//CCCoreLib
+#include <CCConst.h>
+#include <PointCloud.h>
+#include <ReferenceCloud.h>
+#include <VisibilityTools.h>
+
+//system
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace CCCoreLib;
+
+namespace
+{
+	//! Generates a synthetic unrolled shaft (X = arc length, Y = height, Z = -distance to the axis)
+	void GenerateUnrolledShaft(PointCloud& cloud, unsigned pointCount)
+	{
+		const float radius = 3.0f;
+		const float height = 20.0f;
+		const float perimeter = static_cast<float>(2 * M_PI) * radius;
+
+		std::mt19937 generator(12345);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+		std::normal_distribution<float> noise(0.0f, 0.005f);
+
+		cloud.reserve(pointCount);
+		for (unsigned i = 0; i < pointCount; ++i)
+		{
+			CCVector3 P(uniform(generator) * perimeter, uniform(generator) * height, -radius + noise(generator));
+			//10% of clutter (pipes, cables, etc.) in front of the wall
+			if (i % 10 == 0)
+			{
+				P.z += 0.1f + uniform(generator) * 0.5f;
+			}
+			cloud.addPoint(P);
+		}
+	}
+
+	//! Former approach: one depth grid made of nested vectors, filled serially
+	unsigned LegacyVisibility(PointCloud& cloud, PointCoordinateType cellSize, std::vector<unsigned char>& visibility)
+	{
+		CCVector3 bbMin;
+		CCVector3 bbMax;
+		cloud.getBoundingBox(bbMin, bbMax);
+
+		int width = static_cast<int>(std::ceil((bbMax.x - bbMin.x) / cellSize)) + 1;
+		int height = static_cast<int>(std::ceil((bbMax.y - bbMin.y) / cellSize)) + 1;
+		std::vector<std::vector<int>> zDepthMat(height, std::vector<int>(width, INT_MAX));
+
+		unsigned pointCount = cloud.size();
+		std::vector<Tuple3i> cellPos(pointCount);
+		for (unsigned i = 0; i < pointCount; ++i)
+		{
+			const CCVector3* P = cloud.getPoint(i);
+			Tuple3i& pos = cellPos[i];
+			pos.x = static_cast<int>((P->x - bbMin.x) / cellSize);
+			pos.y = static_cast<int>((P->y - bbMin.y) / cellSize);
+			pos.z = static_cast<int>((P->z - bbMin.z) / cellSize);
+			zDepthMat[pos.y][pos.x] = std::min(zDepthMat[pos.y][pos.x], pos.z);
+		}
+
+		unsigned visibleCount = 0;
+		visibility.resize(pointCount);
+		for (unsigned i = 0; i < pointCount; ++i)
+		{
+			const Tuple3i& pos = cellPos[i];
+			int minZ = INT_MAX;
+			for (int dy = -1; dy <= 1; ++dy)
+			{
+				for (int dx = -1; dx <= 1; ++dx)
+				{
+					int x = pos.x + dx;
+					int y = pos.y + dy;
+					if (x >= 0 && x < width && y >= 0 && y < height)
+					{
+						minZ = std::min(minZ, zDepthMat[y][x]);
+					}
+				}
+			}
+			bool visible = (pos.z <= minZ + 2);
+			visibility[i] = (visible ? POINT_VISIBLE : POINT_HIDDEN);
+			if (visible)
+			{
+				++visibleCount;
+			}
+		}
+
+		return visibleCount;
+	}
+
+	using Clock = std::chrono::steady_clock;
+
+	double ElapsedSeconds(const Clock::time_point& start)
+	{
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned pointCount = (argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10)) : 5000000);
+	PointCoordinateType cellSize = (argc > 2 ? static_cast<PointCoordinateType>(std::atof(argv[2])) : static_cast<PointCoordinateType>(0.02));
+	if (pointCount == 0 || cellSize <= 0)
+	{
+		std::printf("Usage: %s [point count] [cell size]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	PointCloud cloud;
+	GenerateUnrolledShaft(cloud, pointCount);
+	std::printf("Points: %u - cell size: %f\n", pointCount, static_cast<double>(cellSize));
+
+	std::vector<unsigned char> legacyVisibility;
+	Clock::time_point start = Clock::now();
+	unsigned legacyCount = LegacyVisibility(cloud, cellSize, legacyVisibility);
+	double legacyTime = ElapsedSeconds(start);
+	std::printf("[Legacy grid]      visible: %u - %.3f s (%.1f Mpts/s)\n", legacyCount, legacyTime, pointCount / legacyTime / 1.0e6);
+
+	VisibilityTools::DepthBufferParams params;
+	params.mode = VisibilityTools::PLANAR;
+	params.pixelSize = cellSize;
+	params.neighbourhood = 1;
+	params.depthTolerance = 2 * cellSize;
+	params.reverseDepth = true;
+
+	std::vector<unsigned char> visibility;
+	unsigned visibleCount = 0;
+	start = Clock::now();
+	if (!VisibilityTools::ComputeVisibility(&cloud, params, visibility, &visibleCount))
+	{
+		std::printf("VisibilityTools::ComputeVisibility failed\n");
+		return EXIT_FAILURE;
+	}
+	double engineTime = ElapsedSeconds(start);
+	std::printf("[VisibilityTools]  visible: %u - %.3f s (%.1f Mpts/s) - speed-up: x%.1f\n", visibleCount, engineTime, pointCount / engineTime / 1.0e6, legacyTime / engineTime);
+
+	unsigned agreement = 0;
+	for (unsigned i = 0; i < pointCount; ++i)
+	{
+		if (visibility[i] == legacyVisibility[i])
+		{
+			++agreement;
+		}
+	}
+	std::printf("Agreement: %.2f%%\n", (100.0 * agreement) / pointCount);
+
+	start = Clock::now();
+	ReferenceCloud hiddenPoints(&cloud);
+	ReferenceCloud* visiblePoints = VisibilityTools::RemoveHiddenPoints(&cloud, params, &hiddenPoints);
+	double extractionTime = ElapsedSeconds(start);
+	if (!visiblePoints)
+	{
+		std::printf("VisibilityTools::RemoveHiddenPoints failed\n");
+		return EXIT_FAILURE;
+	}
+	std::printf("[RemoveHiddenPoints] visible: %u - hidden: %u - %.3f s\n", visiblePoints->size(), hiddenPoints.size(), extractionTime);
+	delete visiblePoints;
+
+	return EXIT_SUCCESS;
+}
@@ -39,6 +39,9 @@ namespace CCCoreLib
 		//! 'Enlarges' the bounding box with a point
 		void add(const CCVector3& aPoint);
 
+		//! 'Enlarges' the bounding box with an array of points
+		void add(const CCVector3* points, std::size_t count);
+
 		//! Returns min corner (const)
 		inline const CCVector3& minCorner() const { return m_bbMin; }
 		//! Returns max corner (const)
@@ -13,6 +13,7 @@ namespace CCCoreLib
 	class GenericIndexedCloudPersist;
 	class GenericIndexedMesh;
 	class GenericProgressCallback;
+	class NeighbourhoodCache;
 	class PointCloud;
 	class ReferenceCloud;
 	class ReferenceCloudPersist;
@@ -151,13 +152,15 @@ namespace CCCoreLib
 			\param nSigma number of sigmas under which the points should be kept
 			\param octree associated octree if available
 			\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+			\param cache neighbourhood cache (optional: used instead of the octree if it can provide the 'knn' nearest neighbours of the cloud points)
 			\return a reference cloud corresponding to the filtered cloud
 		**/
 		static ReferenceCloud* sorFilter(	GenericIndexedCloudPersist* cloud,
 											int knn = 6,
 											double nSigma = 1.0,
 											DgmOctree* octree = nullptr,
-											GenericProgressCallback* progressCb = nullptr);
+											GenericProgressCallback* progressCb = nullptr,
+											const NeighbourhoodCache* cache = nullptr);
 
 		//! Noise filter based on the distance to the approximate local surface
 		/** This filter removes points based on their distance relatively to the best fit plane computed on their neighbors.
@@ -171,6 +174,7 @@ namespace CCCoreLib
 			\param absoluteError absolute error (if useAbsoluteError is true)
 			\param octree associated octree if available
 			\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+			\param cache neighbourhood cache (optional: used instead of the octree if it can provide the neighbors of the cloud points, either the 'knn' nearest ones or the ones inside the kernel)
 			\return a reference cloud corresponding to the filtered cloud
 		**/
 		static ReferenceCloud* noiseFilter(	GenericIndexedCloudPersist* cloud,
@@ -182,7 +186,8 @@ namespace CCCoreLib
 											bool useAbsoluteError = true,
 											double absoluteError = 0.0,
 											DgmOctree* octree = nullptr,
-											GenericProgressCallback* progressCb = nullptr);
+											GenericProgressCallback* progressCb = nullptr,
+											const NeighbourhoodCache* cache = nullptr);
 
 	protected:
 
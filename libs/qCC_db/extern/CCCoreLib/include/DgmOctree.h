@@ -8,6 +8,7 @@
 #include "CCPlatform.h"
 
 //system
+#include <atomic>
 #include <cassert>
 #include <cstddef>
 #include <vector>
@@ -328,13 +329,6 @@ namespace CCCoreLib
 			{
 			}
 
-			//! Copy constructor
-			IndexAndCode(const IndexAndCode& ic)
-				: theIndex(ic.theIndex)
-				, theCode(ic.theCode)
-			{
-			}
-
 			//! Code-based 'less than' comparison operator
 			inline bool operator < (const IndexAndCode& iac) const
 			{
@@ -452,6 +446,50 @@ namespace CCCoreLib
 					const CCVector3* pointsMaxFilter = nullptr,
 					GenericProgressCallback* progressCb = nullptr);
 
+		//! Octree structure (everything but the sorted cell codes)
+		/** Used with the sorted cell codes (see pointsAndTheirCellCodes) to save and
+			restore a computed octree without rebuilding it (see restore).
+			Plain data (can be written to and read from a file as is).
+		**/
+		struct Structure
+		{
+			//! Min coordinates of the octree bounding-box
+			CCVector3 dimMin;
+			//! Max coordinates of the octree bounding-box
+			CCVector3 dimMax;
+			//! Min coordinates of the bounding-box of the points projected in the octree
+			CCVector3 pointsMin;
+			//! Max coordinates of the bounding-box of the points projected in the octree
+			CCVector3 pointsMax;
+			//! Number of points projected in the octree
+			unsigned numberOfProjectedPoints;
+			//! Nearest power of 2 less than the number of points
+			unsigned nearestPow2;
+			//! Min and max occupied cells indexes, for all dimensions and every subdivision level
+			int fillIndexes[(MAX_OCTREE_LEVEL+1)*6];
+			//! Number of cells per level of subdivision
+			unsigned cellCount[MAX_OCTREE_LEVEL+1];
+			//! Max cell population per level of subdivision
+			unsigned maxCellPopulation[MAX_OCTREE_LEVEL+1];
+			//! Average cell population per level of subdivision
+			double averageCellPopulation[MAX_OCTREE_LEVEL+1];
+			//! Std. dev. of cell population per level of subdivision
+			double stdDevCellPopulation[MAX_OCTREE_LEVEL+1];
+		};
+
+		//! Returns the structure of the octree (see restore)
+		void getStructure(Structure& structure) const;
+
+		//! Restores a computed octree without rebuilding it
+		/** The structure and the cell codes must come from an octree computed on the same
+			cloud (i.e. with the same points, in the same order), see getStructure and
+			pointsAndTheirCellCodes. The cell codes are copied.
+			\param structure octree structure
+			\param cellCodes sorted cell codes (structure.numberOfProjectedPoints values)
+			\return success
+		**/
+		bool restore(const Structure& structure, const IndexAndCode* cellCodes);
+
 		/**** GETTERS ****/
 
 		//! Returns the number of points projected into the octree
@@ -606,6 +644,41 @@ namespace CCCoreLib
 		**/
 		double findTheNearestNeighborStartingFromCell(NearestNeighboursSearchStruct &nNSS) const;
 
+		//! Kernels for the batched nearest neighbour search (see findTheNearestNeighboursOfCellPoints)
+		enum NearestNeighbourKernel
+		{
+			NN_KERNEL_AUTO = 0,		//!< Best kernel supported by the CPU
+			NN_KERNEL_SCALAR = 1,	//!< Scalar (portable) kernel
+			NN_KERNEL_SSE2 = 2,		//!< SSE2 kernel (x86 only, falls back to the scalar one otherwise)
+			NN_KERNEL_AVX2 = 3,		//!< AVX2 kernel (x86 only, falls back to the scalar one otherwise)
+		};
+
+		//! Returns the best nearest neighbour kernel supported by the CPU
+		static NearestNeighbourKernel GetBestNearestNeighbourKernel();
+
+		//! Batched form of the nearest neighbour search algorithm (unique neighbour)
+		/** All the query points must fall in the same cell. They are processed together: the points of the
+			neighbour cells are gathered only once (shell by shell) in a structure-of-arrays buffer, and each
+			query point stops as soon as its nearest neighbour is certain (or too far).
+			The distances are exactly the same as with findTheNearestNeighborStartingFromCell, whatever the
+			kernel (only the nearest point may differ if several points are at exactly the same distance).
+			\param cellPos position of the cell that includes the query points (at the given level)
+			\param level the subdivision level of the octree at which to perform the search
+			\param queryPoints the query points
+			\param maxSearchSquareDist the maximum (squared) search distance (ignored if <= 0)
+			\param[out] squareDists the squared distance between each query point and its nearest neighbour (or -1 if none was found)
+			\param[out] nearestIndexes the index of the nearest neighbour of each query point
+			\param kernel kernel used to compute the distances
+			\return false if there's not enough memory
+		**/
+		bool findTheNearestNeighboursOfCellPoints(	const Tuple3i& cellPos,
+													unsigned char level,
+													const std::vector<CCVector3>& queryPoints,
+													double maxSearchSquareDist,
+													std::vector<double>& squareDists,
+													std::vector<unsigned>& nearestIndexes,
+													NearestNeighbourKernel kernel = NN_KERNEL_AUTO) const;
+
 		//! Advanced form of the nearest neighbours search algorithm (multiple neighbours)
 		/** This version is optimized for a multiple nearest neighbours search
 			that is applied around several query points included in the same octree
@@ -1137,6 +1210,12 @@ namespace CCCoreLib
 
 	protected:
 
+		//! Returns the (persistent) address of a point of the associated cloud
+		/** \param points direct access to the associated cloud points (see PointSpans::points) or nullptr
+			\param index point index
+		**/
+		inline const CCVector3* associatedPoint(const CCVector3* points, unsigned index) const;
+
 		/*******************************/
 		/**         STRUCTURES        **/
 		/*******************************/
@@ -1269,6 +1348,8 @@ namespace CCCoreLib
 		};
 
 		//! Structure containing objects needed to run octree operations in parallel
+		/** One instance per call (so that several functions can be run concurrently on the same octree).
+		**/
 		struct multiThreadingWrapper
 		{
 			DgmOctree *octree = nullptr;
@@ -1276,11 +1357,14 @@ namespace CCCoreLib
 			void **userParams = nullptr;
 			GenericProgressCallback *progressCb = nullptr;
 			NormalizedProgress *normProgressCb = nullptr;
-			bool cellFunc_success = true;
+			std::atomic<bool> cellFunc_success{ true };
 
-			void launchOctreeCellFunc(const octreeCellDesc& desc);
+			//! Applies the cell function to a cell (returns false if the process should stop)
+			bool launchOctreeCellFunc(const octreeCellDesc& desc);
 		};
-		multiThreadingWrapper m_MT_wrapper;
+
+		//! Applies the cell function to a set of cells (with the task scheduler)
+		static bool LaunchOctreeCellFuncs(multiThreadingWrapper& wrapper, const std::vector<octreeCellDesc>& cells, int maxThreadCount);
 #endif
 	};
 
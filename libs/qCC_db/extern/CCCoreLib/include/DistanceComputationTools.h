@@ -92,6 +92,17 @@ namespace CCCoreLib
 			**/
 			bool resetFormerDistances;
 
+			//! Whether to process the points of each cell together (batched nearest neighbour search)
+			/** Only without local model (see DgmOctree::findTheNearestNeighboursOfCellPoints).
+				The distances are the same, but the batched search is faster.
+			**/
+			bool batchedNNSearch;
+
+			//! Kernel of the batched nearest neighbour search
+			/** See batchedNNSearch and DgmOctree::NearestNeighbourKernel.
+			**/
+			DgmOctree::NearestNeighbourKernel nnKernel;
+
 			//! Default constructor/initialization
 			Cloud2CloudDistanceComputationParams()
 				: octreeLevel(0)
@@ -105,6 +116,8 @@ namespace CCCoreLib
 				, reuseExistingLocalModels(false)
 				, CPSet(nullptr)
 				, resetFormerDistances(true)
+				, batchedNNSearch(true)
+				, nnKernel(DgmOctree::NN_KERNEL_AUTO)
 			{
 				splitDistances[0] = splitDistances[1] = splitDistances[2] = nullptr;
 			}
@@ -0,0 +1,276 @@
+// SPDX-License-Identifier: LGPL-2.0-or-later
+// Copyright © CloudCompare Project
+
+#pragma once
+
+//Local
+#include "CCGeom.h"
+#include "CCTypes.h"
+
+//system
+#include <vector>
+
+namespace CCCoreLib
+{
+	class GenericIndexedCloud;
+	class GenericProgressCallback;
+
+	//! Cache-friendly KD-tree (flat array of nodes, bucketed leaves)
+	/** The nodes are stored in a single array (depth-first order: the left child of a node
+		is always the next node) and a copy of the points is stored in leaf order, so that the
+		points of a leaf (and of a sub-tree) are contiguous in memory. The nodes are split at
+		the median of their largest dimension, and each node keeps the tight bounding box of
+		its points (used to prune the search).
+		The tree is built in parallel (see TaskScheduler). Once built, it is read-only: all the
+		queries are const and can be called concurrently by several threads.
+		It offers the same query API as KDTree (with the same semantics), plus k-NN and radius
+		queries (unique and batched).
+		The returned indexes are always the indexes of the points in the associated cloud.
+	**/
+	class CC_CORE_LIB_API FlatKdTree
+	{
+	public:
+
+		//! Default max number of points per leaf
+		static const unsigned DefaultLeafSize = 16;
+
+		//! Invalid point index (see the batched k-NN search)
+		static const unsigned InvalidIndex = 0xFFFFFFFF;
+
+		//! Default constructor
+		FlatKdTree();
+
+		//! Destructor
+		virtual ~FlatKdTree() = default;
+
+		//! Builds the KD-tree
+		/** \param cloud the point cloud from which to build the tree (its points are copied)
+			\param progressCb the client method can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+			\param leafSize max number of points per leaf
+			\param maxThreadCount max number of threads used to build the tree (0 = all)
+			\return success
+		**/
+		bool buildFromCloud(GenericIndexedCloud* cloud,
+							GenericProgressCallback* progressCb = nullptr,
+							unsigned leafSize = DefaultLeafSize,
+							int maxThreadCount = 0);
+
+		//! Clears the tree
+		void clear();
+
+		//! Gets the point cloud from which the tree has been build
+		GenericIndexedCloud* getAssociatedCloud() const { return m_associatedCloud; }
+
+		//! Returns the number of points in the tree
+		inline unsigned size() const { return static_cast<unsigned>(m_indexes.size()); }
+		//! Returns the number of nodes
+		inline unsigned nodeCount() const { return static_cast<unsigned>(m_nodes.size()); }
+		//! Returns the max number of points per leaf
+		inline unsigned leafSize() const { return m_leafSize; }
+
+		//! Returns the points in leaf order
+		/** Spatially coherent sequences of query points (such as this one) are processed faster.
+		**/
+		inline const CCVector3* points() const { return m_points.data(); }
+		//! Returns the index (in the associated cloud) of the ith point in leaf order
+		inline unsigned pointIndex(unsigned i) const { return m_indexes[i]; }
+
+		/*** KDTree API ***/
+
+		//! Nearest point search
+		/** \param queryPoint coordinates of the query point from which we want the nearest point in the tree
+			\param nearestPointIndex [out] index of the point that lies the nearest from query Point
+			\param maxDist distance above which the function doesn't consider points
+			\return true if it finds a point p such that ||p-queryPoint||<maxDist. False otherwise
+		**/
+		bool findNearestNeighbour(	const PointCoordinateType* queryPoint,
+									unsigned& nearestPointIndex,
+									ScalarType maxDist) const;
+
+		//! Optimized version of nearest point search method
+		/** Only checks if there is a point p into the tree such that ||p-queryPoint||<maxDist (see findNearestNeighbour())
+		**/
+		bool findPointBelowDistance(const PointCoordinateType* queryPoint,
+									ScalarType maxDist) const;
+
+		//! Searches for the points that lie to a given distance (up to a tolerance) from a query point
+		/** \param queryPoint query point coordinates
+			\param distance distance wished between the query point and resulting points
+			\param tolerance error allowed by the function : each resulting point p is such that distance-tolerance<=||p-queryPoint||<=distance+tolerance
+			\param points [out] array of point indexes (the points are appended)
+			\return the size of the output array
+		**/
+		unsigned findPointsLyingToDistance(	const PointCoordinateType* queryPoint,
+											ScalarType distance,
+											ScalarType tolerance,
+											std::vector<unsigned>& points) const;
+
+		/*** k-NN and radius queries ***/
+
+		//! Searches for the k nearest neighbours of a query point
+		/** \param queryPoint query point coordinates
+			\param k number of neighbours
+			\param[out] indexes indexes of the neighbours (sorted by increasing distance), at least k values
+			\param[out] squareDistances squared distances of the neighbours, at least k values
+			\param maxDist max search distance (ignored if <= 0): only the points such that ||p-queryPoint||<=maxDist are considered
+			\return the number of neighbours found (k, or less if the max search distance is reached)
+		**/
+		unsigned findKNearestNeighbours(const PointCoordinateType* queryPoint,
+										unsigned k,
+										unsigned* indexes,
+										ScalarType* squareDistances,
+										ScalarType maxDist = 0) const;
+
+		//! Searches for the points falling inside a sphere
+		/** \param queryPoint sphere center
+			\param radius sphere radius (the points such that ||p-queryPoint||<=radius are extracted)
+			\param[out] indexes indexes of the points (appended, in no particular order)
+			\param[out] squareDistances squared distances of the points (optional, appended)
+			\return the number of points found
+		**/
+		unsigned findPointsInSphere(const PointCoordinateType* queryPoint,
+									PointCoordinateType radius,
+									std::vector<unsigned>& indexes,
+									std::vector<ScalarType>* squareDistances = nullptr) const;
+
+		//! Batched k-NN search (in parallel)
+		/** \param queryPoints query points
+			\param queryCount number of query points
+			\param k number of neighbours per query point
+			\param[out] indexes k indexes per query point (sorted by increasing distance, padded with InvalidIndex)
+			\param[out] squareDistances k squared distances per query point (padded with NAN_VALUE)
+			\param maxDist max search distance (ignored if <= 0)
+			\param maxThreadCount max number of threads (0 = all)
+			\param progressCb progress callback (optional: only used for cancellation)
+			\return false if there's not enough memory or if the process has been cancelled
+		**/
+		bool findKNearestNeighbours(const CCVector3* queryPoints,
+									unsigned queryCount,
+									unsigned k,
+									std::vector<unsigned>& indexes,
+									std::vector<ScalarType>& squareDistances,
+									ScalarType maxDist = 0,
+									int maxThreadCount = 0,
+									GenericProgressCallback* progressCb = nullptr) const;
+
+		//! Batched radius search (in parallel)
+		/** The neighbours of the ith query point are indexes[offsets[i]] to indexes[offsets[i+1]-1].
+			\param queryPoints query points
+			\param queryCount number of query points
+			\param radius sphere radius
+			\param[out] offsets first neighbour of each query point (queryCount + 1 values)
+			\param[out] indexes neighbours of all the query points
+			\param maxThreadCount max number of threads (0 = all)
+			\param progressCb progress callback (optional: only used for cancellation)
+			\return false if there's not enough memory or if the process has been cancelled
+		**/
+		bool findPointsInSphere(const CCVector3* queryPoints,
+								unsigned queryCount,
+								PointCoordinateType radius,
+								std::vector<unsigned>& offsets,
+								std::vector<unsigned>& indexes,
+								int maxThreadCount = 0,
+								GenericProgressCallback* progressCb = nullptr) const;
+
+		/*** Serialization ***/
+
+		//! Tree node
+		struct Node
+		{
+			//! Tight bounding box (min corner)
+			CCVector3 bbMin;
+			//! Tight bounding box (max corner)
+			CCVector3 bbMax;
+			//! First point (in leaf order)
+			unsigned first = 0;
+			//! Number of points
+			unsigned count = 0;
+			//! Index of the right child (0 for leaves, the left child being always the next node)
+			unsigned right = 0;
+
+			//! Returns whether the node is a leaf
+			inline bool isLeaf() const { return right == 0; }
+		};
+
+		//! Returns the nodes (depth-first order)
+		inline const std::vector<Node>& nodes() const { return m_nodes; }
+
+		//! Restores a tree without rebuilding it
+		/** The data must come from a tree built on the same cloud (see nodes, points and
+			pointIndex). The data are copied.
+			\param cloud associated cloud
+			\param leafSize max number of points per leaf
+			\param nodes nodes
+			\param nodeCount number of nodes
+			\param points points (leaf order, as many as the cloud points)
+			\param indexes indexes of the points in the cloud (leaf order)
+			\return success
+		**/
+		bool restore(	GenericIndexedCloud* cloud,
+						unsigned leafSize,
+						const Node* nodes,
+						unsigned nodeCount,
+						const CCVector3* points,
+						const unsigned* indexes);
+
+	protected:
+
+		//! Point (and its index) used during the build process
+		struct BuildPoint
+		{
+			CCVector3 P;
+			unsigned index;
+		};
+
+		//! Sub-tree to build
+		struct SubTree
+		{
+			//! Root node index
+			unsigned nodeIndex;
+			//! First point
+			unsigned first;
+			//! Number of points
+			unsigned count;
+			//! Cell bounding box (delimited by the cutting planes, used to choose the split dimension)
+			CCVector3 boxMin;
+			CCVector3 boxMax;
+		};
+
+		//! Returns the number of nodes of a sub-tree
+		/** The nodes are always split in two halves (count / 2 and count - count / 2),
+			so that the size of each sub-tree (and the position of each node) is known in
+			advance: the sub-trees can be built independently.
+		**/
+		static unsigned SubTreeNodeCount(unsigned pointCount, unsigned leafSize);
+
+		//! Builds a sub-tree (recursively)
+		/** \param points points (to be reordered)
+			\param subTree sub-tree to build
+			\param pendingSubTrees if set, the sub-trees with less than 'minTaskSize' points are not built but pushed in this container instead
+			\param minTaskSize see 'pendingSubTrees'
+			\param topNodes if set, the built internal nodes are pushed in this container (their bounding boxes are not updated)
+		**/
+		void buildSubTree(	BuildPoint* points,
+							const SubTree& subTree,
+							std::vector<SubTree>* pendingSubTrees = nullptr,
+							unsigned minTaskSize = 0,
+							std::vector<unsigned>* topNodes = nullptr);
+
+		//! Updates the bounding box of an internal node (from its children)
+		void updateBoundingBox(unsigned nodeIndex);
+
+		//! Max depth of the tree (large enough for 2^32 points)
+		static const unsigned MaxDepth = 64;
+
+		//! Nodes (depth-first order)
+		std::vector<Node> m_nodes;
+		//! Points (leaf order)
+		std::vector<CCVector3> m_points;
+		//! Indexes of the points in the associated cloud (leaf order)
+		std::vector<unsigned> m_indexes;
+		//! Associated cloud
+		GenericIndexedCloud* m_associatedCloud;
+		//! Max number of points per leaf
+		unsigned m_leafSize;
+	};
+}
@@ -5,6 +5,7 @@
 
 //Local
 #include "GenericCloud.h"
+#include "PointSpans.h"
 
 namespace CCCoreLib
 {
@@ -39,5 +40,12 @@ namespace CCCoreLib
 			\param P output point
 		**/
 		virtual void getPoint(unsigned index, CCVector3& P) const = 0;
+
+		//! Returns a direct (read-only) access to the points coordinates, if possible
+		/**	Allows the processing loops to avoid a virtual call per point (see PointSpans).
+			The view is only valid as long as the cloud is not modified.
+			\return the points coordinates (or an invalid view if the points are not stored in memory as arrays)
+		**/
+		virtual PointSpans getPointSpans() const { return PointSpans(); }
 	};
 }
@@ -9,8 +9,10 @@
 
 namespace CCCoreLib
 {
+	class FlatKdTree;
 	class GenericProgressCallback;
 	class GenericCloud;
+	class NeighbourhoodCache;
 	class ScalarField;
 
 	//! Several algorithms to compute point-clouds geometric characteristics  (curvature, density, etc.)
@@ -50,6 +52,7 @@ namespace CCCoreLib
 			\param kernelRadius neighbouring sphere radius
 			\param progressCb client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
 			\param inputOctree if not set as input, octree will be automatically computed.
+			\param cache neighbourhood cache (optional: used instead of the octree if it can provide the neighbours inside the kernel, see NeighbourhoodCache::canProvideRadius)
 			\return succes
 		**/
 		static ErrorCode ComputeCharactersitic(	GeomCharacteristic c,
@@ -57,7 +60,52 @@ namespace CCCoreLib
 												GenericIndexedCloudPersist* cloud,
 												PointCoordinateType kernelRadius,
 												GenericProgressCallback* progressCb = nullptr,
-												DgmOctree* inputOctree = nullptr);
+												DgmOctree* inputOctree = nullptr,
+												const NeighbourhoodCache* cache = nullptr);
+
+		//! Geometric characteristic to compute at a given scale (see ComputeCharacteristics)
+		struct CharacteristicRequest
+		{
+			//! Default constructor
+			CharacteristicRequest(GeomCharacteristic _c = Feature, int _subOption = 0, PointCoordinateType _radius = 0, ScalarField* _sf = nullptr)
+				: c(_c)
+				, subOption(_subOption)
+				, radius(_radius)
+				, sf(_sf)
+			{}
+
+			//! Geometric characteristic (ApproxLocalDensity is not supported)
+			GeomCharacteristic c;
+			//! Feature / curvature type / local density computation algorithm or nothing (0)
+			int subOption;
+			//! Neighbouring sphere radius
+			PointCoordinateType radius;
+			//! Output scalar field (must have as many values as the cloud has points)
+			ScalarField* sf;
+		};
+
+		//! Computes several geometric characteristics, at several scales, in a single pass
+		/** The neighbourhood of each point is extracted only once (with the largest radius), then
+			sorted by increasing distance so that the neighbourhoods at the smaller radii are simply
+			prefixes of it. The covariance-based characteristics (features, normal change rate,
+			roughness, 1st order moment, density) are all deduced from the same moments, updated
+			incrementally from one radius to the next, with a single eigen decomposition per scale.
+			The points are processed in parallel and each request writes its own scalar field.
+			The results are the same as with ComputeCharactersitic (up to numerical precision).
+			\param requests characteristics to compute (each one with its radius and output scalar field)
+			\param cloud cloud to compute the characteristics on
+			\param progressCb client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+			\param cache neighbourhood cache (optional: used if it can provide the neighbours inside the largest kernel, see NeighbourhoodCache::canProvideRadius)
+			\param kdTree KD-tree of the cloud (optional: a temporary one is built if necessary)
+			\param maxThreadCount max number of threads (0 = all)
+			\return success (0) or error code (<0)
+		**/
+		static ErrorCode ComputeCharacteristics(const std::vector<CharacteristicRequest>& requests,
+												GenericIndexedCloudPersist* cloud,
+												GenericProgressCallback* progressCb = nullptr,
+												const NeighbourhoodCache* cache = nullptr,
+												const FlatKdTree* kdTree = nullptr,
+												int maxThreadCount = 0);
 
 		//! Computes the local density (approximate)
 		/** Old method (based only on the distance to the nearest neighbor).
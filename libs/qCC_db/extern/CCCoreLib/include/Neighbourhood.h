@@ -187,6 +187,14 @@ namespace CCCoreLib
 		**/
 		double computeFeature(GeomFeature feature);
 
+		//! Computes the given feature from the eigen decomposition of a covariance matrix
+		/** \param feature feature
+			\param eigVectors eigenvectors (see Jacobi)
+			\param eigValues eigenvalues (sorted in decreasing order, see Jacobi::SortEigenValuesAndVectors)
+			\return feature value
+		**/
+		static double ComputeFeature(GeomFeature feature, const SquareMatrixd& eigVectors, const std::vector<double>& eigValues);
+
 		//! Computes the 1st order moment of a set of point (based on the eigenvalues)
 		/** \return 1st order moment at a given position P
 			DGM: The article states that the result should be between 0 and 1,
@@ -0,0 +1,182 @@
+// SPDX-License-Identifier: LGPL-2.0-or-later
+// Copyright © CloudCompare Project
+
+#pragma once
+
+//Local
+#include "DgmOctree.h"
+
+//system
+#include <functional>
+#include <vector>
+
+namespace CCCoreLib
+{
+	class FlatKdTree;
+	class GenericIndexedCloud;
+	class GenericIndexedCloudPersist;
+	class GenericProgressCallback;
+
+	//! Neighbourhoods of all the points of a cloud, computed once and shared by several processes
+	/** The neighbourhoods are either the k nearest neighbours of each point (KNN) or the points
+		inside a sphere centered on each point (RADIUS). They are computed in parallel with a
+		FlatKdTree and stored in a compact 'CSR' structure: the indexes and squared distances of
+		all the neighbourhoods are stored contiguously, each neighbourhood being sorted by
+		increasing distance (the point itself is part of its own neighbourhood).
+		A cache can then be passed to the processes that accept one (SOR and noise filters,
+		geometric characteristics, normals, etc.) so that a chain of processes working at the
+		same scale on the same cloud only pays for the neighbour search once. As the
+		neighbourhoods are sorted, a KNN cache can answer any smaller k and a RADIUS cache any
+		smaller radius (see canProvideKNN and canProvideRadius).
+		Once computed, the cache is read-only and can be accessed concurrently by several threads.
+	**/
+	class CC_CORE_LIB_API NeighbourhoodCache
+	{
+	public:
+
+		//! Neighbourhood types
+		enum Type
+		{
+			NONE = 0,	/**< Not computed **/
+			KNN,		/**< k nearest neighbours **/
+			RADIUS		/**< Points inside a sphere **/
+		};
+
+		//! Default constructor
+		NeighbourhoodCache();
+
+		//! Destructor
+		virtual ~NeighbourhoodCache() = default;
+
+		//! Computes the k nearest neighbours of all the points
+		/** If the cloud has less than k points, k is reduced to the number of points.
+			\param cloud point cloud
+			\param k number of neighbours per point (including the point itself)
+			\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+			\param kdTree KD-tree of the cloud if available (otherwise a temporary one is built)
+			\param maxThreadCount max number of threads (0 = all)
+			\return success
+		**/
+		bool computeKNN(GenericIndexedCloudPersist* cloud,
+						unsigned k,
+						GenericProgressCallback* progressCb = nullptr,
+						const FlatKdTree* kdTree = nullptr,
+						int maxThreadCount = 0);
+
+		//! Computes the points inside a sphere centered on each point
+		/** \param cloud point cloud
+			\param radius sphere radius
+			\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+			\param kdTree KD-tree of the cloud if available (otherwise a temporary one is built)
+			\param maxThreadCount max number of threads (0 = all)
+			\return success
+		**/
+		bool computeRadius(	GenericIndexedCloudPersist* cloud,
+							PointCoordinateType radius,
+							GenericProgressCallback* progressCb = nullptr,
+							const FlatKdTree* kdTree = nullptr,
+							int maxThreadCount = 0);
+
+		//! Clears the cache
+		void clear();
+
+		//! Returns the neighbourhood type
+		inline Type type() const { return m_type; }
+		//! Returns the associated cloud
+		inline GenericIndexedCloudPersist* getAssociatedCloud() const { return m_associatedCloud; }
+		//! Returns the number of points (i.e. of neighbourhoods)
+		inline unsigned size() const { return m_pointCount; }
+		//! Returns the number of neighbours per point (KNN only)
+		inline unsigned k() const { return m_k; }
+		//! Returns the sphere radius (RADIUS only)
+		inline PointCoordinateType radius() const { return m_radius; }
+
+		//! Returns the total number of neighbours (all points)
+		inline size_t neighbourTotalCount() const { return m_indexes.size(); }
+		//! Returns the memory used by the cache (in bytes)
+		size_t memoryUsage() const;
+
+		//! Returns the number of neighbours of a given point
+		inline unsigned neighbourCount(unsigned pointIndex) const
+		{
+			return (m_type == KNN ? m_k : static_cast<unsigned>(m_offsets[pointIndex + 1] - m_offsets[pointIndex]));
+		}
+		//! Returns the neighbours of a given point (sorted by increasing distance, see neighbourCount)
+		inline const unsigned* neighbours(unsigned pointIndex) const { return m_indexes.data() + offset(pointIndex); }
+		//! Returns the squared distances of the neighbours of a given point (sorted, see neighbourCount)
+		inline const ScalarType* squareDistances(unsigned pointIndex) const { return m_squareDistances.data() + offset(pointIndex); }
+
+		//! Returns whether the cache can provide the k nearest neighbours of the points of a given cloud
+		bool canProvideKNN(const GenericIndexedCloud* cloud, unsigned k) const;
+		//! Returns whether the cache can provide the neighbours of the points of a given cloud inside a sphere
+		bool canProvideRadius(const GenericIndexedCloud* cloud, PointCoordinateType radius) const;
+
+		//! Returns the number of neighbours of a point inside a (smaller) sphere
+		/** \param pointIndex point index
+			\param radius sphere radius (should be smaller than the cache radius for RADIUS caches)
+			\return the number of neighbours such that ||p-P||<=radius, compared in double as with DgmOctree (they are the first ones)
+		**/
+		unsigned countInSphere(unsigned pointIndex, PointCoordinateType radius) const;
+
+		//! Copies the first neighbours of a point in a DgmOctree::NeighboursSet structure
+		/** So that they can be used with DgmOctreeReferenceCloud and Neighbourhood, like
+			the neighbours extracted from an octree.
+			\param pointIndex point index
+			\param count max number of neighbours
+			\param[out] neighbours the first neighbours of the point (with their squared distances)
+			\return the number of neighbours copied
+		**/
+		unsigned getNeighbours(unsigned pointIndex, unsigned count, DgmOctree::NeighboursSet& neighbours) const;
+
+		//! Range function (processes the points from 'first' to 'last' - excluded - and returns false to stop the whole process)
+		using RangeFunction = std::function<bool(unsigned first, unsigned last)>;
+
+		//! Runs a function on all the points, by ranges of consecutive points processed in parallel
+		/** Helper for the processes using the cache (each range can use its own working structures).
+			\param func range function
+			\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+			\param title process title (for the progress callback)
+			\param maxThreadCount max number of threads (0 = all)
+			\return false if the process has been stopped (or cancelled)
+		**/
+		bool forEachPointRange(	const RangeFunction& func,
+								GenericProgressCallback* progressCb = nullptr,
+								const char* title = nullptr,
+								int maxThreadCount = 0) const;
+
+	protected:
+
+		//! Returns the position of the first neighbour of a given point
+		inline size_t offset(unsigned pointIndex) const
+		{
+			return (m_type == KNN ? static_cast<size_t>(pointIndex) * m_k : m_offsets[pointIndex]);
+		}
+
+		//! Computes the neighbourhoods (common part)
+		bool compute(	GenericIndexedCloudPersist* cloud,
+						Type type,
+						unsigned k,
+						PointCoordinateType radius,
+						GenericProgressCallback* progressCb,
+						const FlatKdTree* kdTree,
+						int maxThreadCount);
+
+		//! Neighbourhood type
+		Type m_type;
+		//! Associated cloud
+		GenericIndexedCloudPersist* m_associatedCloud;
+		//! Number of points
+		unsigned m_pointCount;
+		//! Number of neighbours per point (KNN)
+		unsigned m_k;
+		//! Sphere radius (RADIUS)
+		PointCoordinateType m_radius;
+
+		//! First neighbour of each point (RADIUS only: pointCount + 1 values)
+		std::vector<size_t> m_offsets;
+		//! Indexes of the neighbours
+		std::vector<unsigned> m_indexes;
+		//! Squared distances of the neighbours
+		std::vector<ScalarType> m_squareDistances;
+	};
+}
@@ -103,10 +103,7 @@ namespace CCCoreLib
 			if (!m_bbox.isValid())
 			{
 				m_bbox.clear();
-				for (const CCVector3& P : m_points)
-				{
-					m_bbox.add(P);
-				}
+				m_bbox.add(m_points.data(), m_points.size());
 			}
 
 			bbMin = m_bbox.minCorner();
@@ -203,6 +200,8 @@ namespace CCCoreLib
 
 		inline const CCVector3* getPointPersistentPtr(unsigned index) const override { return point(index); }
 
+		inline PointSpans getPointSpans() const override { return PointSpans::FromPoints(m_points.data(), m_points.size()); }
+
 		//! Resizes the point database
 		/** The cloud database is resized with the specified size. If the new size
 			is smaller, the overflooding points will be deleted. If its greater,
@@ -0,0 +1,165 @@
+// SPDX-License-Identifier: LGPL-2.0-or-later
+// Copyright © CloudCompare Project
+
+#pragma once
+
+//Local
+#include "CCGeom.h"
+
+//system
+#include <cassert>
+#include <cstddef>
+
+namespace CCCoreLib
+{
+	//! View on a contiguous array of values (no bounds checking)
+	template <typename T> class Span
+	{
+	public:
+
+		//! Default constructor (empty span)
+		Span() = default;
+
+		//! Constructor from an array
+		Span(T* data, std::size_t size) : m_data(data), m_size(size) {}
+
+		//! Returns the number of values
+		inline std::size_t size() const { return m_size; }
+		//! Returns whether the span is empty
+		inline bool empty() const { return m_size == 0; }
+		//! Returns the first value address
+		inline T* data() const { return m_data; }
+
+		//! Returns the ith value (unchecked)
+		inline T& operator[](std::size_t i) const { assert(i < m_size); return m_data[i]; }
+
+		inline T* begin() const { return m_data; }
+		inline T* end() const { return m_data + m_size; }
+
+	protected:
+
+		//! Values
+		T* m_data = nullptr;
+		//! Number of values
+		std::size_t m_size = 0;
+	};
+
+	//! View on an array of values separated by a constant stride (no bounds checking)
+	/** E.g. the X coordinates of an array of points (stride = 3) or an array of X coordinates (stride = 1).
+	**/
+	template <typename T> class StridedSpan
+	{
+	public:
+
+		//! Default constructor (empty span)
+		StridedSpan() = default;
+
+		//! Constructor from an array
+		/** \param data first value address
+			\param size number of values
+			\param stride number of elements between two consecutive values
+		**/
+		StridedSpan(T* data, std::size_t size, std::size_t stride = 1) : m_data(data), m_size(size), m_stride(stride) {}
+
+		//! Returns the number of values
+		inline std::size_t size() const { return m_size; }
+		//! Returns whether the span is empty
+		inline bool empty() const { return m_size == 0; }
+		//! Returns the first value address
+		inline T* data() const { return m_data; }
+		//! Returns the stride
+		inline std::size_t stride() const { return m_stride; }
+		//! Returns whether the values are contiguous
+		inline bool isContiguous() const { return m_stride == 1; }
+
+		//! Returns the ith value (unchecked)
+		inline T& operator[](std::size_t i) const { assert(i < m_size); return m_data[i * m_stride]; }
+
+	protected:
+
+		//! Values
+		T* m_data = nullptr;
+		//! Number of values
+		std::size_t m_size = 0;
+		//! Number of elements between two consecutive values
+		std::size_t m_stride = 1;
+	};
+
+	//! Read-only view on the coordinates of the points of a cloud
+	/** Gives a direct access (without virtual call) to the X, Y and Z coordinates of the points,
+		whether they are stored as an array of points (see PointCloudTpl) or as separate arrays
+		of coordinates (structure of arrays). An invalid view means that the points are not
+		stored in memory in one of these ways (e.g. ReferenceCloud): the caller should then
+		fall back to GenericIndexedCloud::getPoint.
+	**/
+	class PointSpans
+	{
+	public:
+
+		//! Default constructor (invalid view)
+		PointSpans() = default;
+
+		//! Creates a view on an array of points
+		static PointSpans FromPoints(const CCVector3* points, std::size_t count)
+		{
+			PointSpans spans;
+			spans.m_points = points;
+			spans.m_count = count;
+			spans.m_valid = true;
+			if (points)
+			{
+				spans.m_x = StridedSpan<const PointCoordinateType>(points->u + 0, count, 3);
+				spans.m_y = StridedSpan<const PointCoordinateType>(points->u + 1, count, 3);
+				spans.m_z = StridedSpan<const PointCoordinateType>(points->u + 2, count, 3);
+			}
+			return spans;
+		}
+
+		//! Creates a view on separate arrays of coordinates
+		static PointSpans FromArrays(const PointCoordinateType* xs, const PointCoordinateType* ys, const PointCoordinateType* zs, std::size_t count)
+		{
+			PointSpans spans;
+			spans.m_x = StridedSpan<const PointCoordinateType>(xs, count);
+			spans.m_y = StridedSpan<const PointCoordinateType>(ys, count);
+			spans.m_z = StridedSpan<const PointCoordinateType>(zs, count);
+			spans.m_count = count;
+			spans.m_valid = true;
+			return spans;
+		}
+
+		//! Returns whether the view is valid
+		inline bool isValid() const { return m_valid; }
+		//! Returns the number of points
+		inline std::size_t size() const { return m_count; }
+
+		//! Returns the X coordinates
+		inline const StridedSpan<const PointCoordinateType>& x() const { return m_x; }
+		//! Returns the Y coordinates
+		inline const StridedSpan<const PointCoordinateType>& y() const { return m_y; }
+		//! Returns the Z coordinates
+		inline const StridedSpan<const PointCoordinateType>& z() const { return m_z; }
+
+		//! Returns the array of points (or nullptr if the coordinates are stored in separate arrays)
+		/** The returned pointers are persistent (see GenericIndexedCloudPersist).
+		**/
+		inline const CCVector3* points() const { return m_points; }
+
+		//! Returns the ith point (unchecked)
+		inline CCVector3 point(std::size_t i) const { return m_points ? m_points[i] : CCVector3(m_x[i], m_y[i], m_z[i]); }
+
+	protected:
+
+		//! X coordinates
+		StridedSpan<const PointCoordinateType> m_x;
+		//! Y coordinates
+		StridedSpan<const PointCoordinateType> m_y;
+		//! Z coordinates
+		StridedSpan<const PointCoordinateType> m_z;
+		//! Array of points (if any)
+		const CCVector3* m_points = nullptr;
+		//! Number of points
+		std::size_t m_count = 0;
+		//! Validity
+		bool m_valid = false;
+	};
+}
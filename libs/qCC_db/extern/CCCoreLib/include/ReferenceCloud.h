@@ -154,6 +154,106 @@ namespace CCCoreLib
 		**/
 		bool add(const ReferenceCloud& cloud);
 
+		/*** Bulk construction (a single lock and a single allocation per call) ***/
+
+		//! Per-thread container of point global indexes
+		/** Each thread fills its own builder (without any lock), then all the builders
+			are merged at once (see addPointIndexes).
+		**/
+		class IndexBuilder
+		{
+		public:
+
+			//! Adds a point global index (no lock)
+			/** \return false if not enough memory
+			**/
+			inline bool add(unsigned globalIndex)
+			{
+				try
+				{
+					m_indexes.push_back(globalIndex);
+				}
+				catch (const std::bad_alloc&)
+				{
+					return false;
+				}
+				return true;
+			}
+
+			//! Reserves some memory
+			inline bool reserve(unsigned n)
+			{
+				try
+				{
+					m_indexes.reserve(n);
+				}
+				catch (const std::bad_alloc&)
+				{
+					return false;
+				}
+				return true;
+			}
+
+			//! Returns the number of indexes
+			inline unsigned size() const { return static_cast<unsigned>(m_indexes.size()); }
+			//! Clears the builder
+			inline void clear() { m_indexes.clear(); }
+			//! Returns the indexes
+			inline const std::vector<unsigned>& indexes() const { return m_indexes; }
+
+		protected:
+
+			//! Point global indexes
+			std::vector<unsigned> m_indexes;
+		};
+
+		//! Appends a span of point global indexes to be filled by the caller
+		/** The span is filled by the caller without any lock.
+			\warning The returned pointer is invalidated by any other append or resize
+			(addPointIndex, addPointIndexes, appendPointIndexSpan, reserve, resize, etc.),
+			even from another thread: the caller must fill the span before any of them
+			can happen.
+			\param count number of indexes (> 0)
+			\return the first index of the span (or nullptr if not enough memory)
+			Thread safe (the allocation only).
+		**/
+		unsigned* appendPointIndexSpan(unsigned count);
+
+		//! Adds a set of point global indexes
+		/** \param globalIndexes point global indexes
+			\param count number of indexes
+			\return false if not enough memory
+			Thread safe.
+		**/
+		bool addPointIndexes(const unsigned* globalIndexes, unsigned count);
+
+		//! Merges a set of per-thread builders (in their order)
+		/** \param builders per-thread builders
+			\return false if not enough memory
+			Thread safe.
+		**/
+		bool addPointIndexes(const std::vector<IndexBuilder>& builders);
+
+		//! Adds the points with a given flag
+		/** The points are added by increasing global index.
+			\param flags one flag per point (the ith flag corresponds to the point with global index firstIndex + i)
+			\param count number of flags
+			\param flagValue flag value of the points to add
+			\param firstIndex global index of the first flag
+			\return false if not enough memory
+			Thread safe.
+		**/
+		bool addFlaggedPointIndexes(const unsigned char* flags,
+									unsigned count,
+									unsigned char flagValue = 1,
+									unsigned firstIndex = 0);
+
+		//! Replaces the point global indexes (no copy)
+		/** \param globalIndexes point global indexes (swapped with the current ones)
+			Thread safe.
+		**/
+		void adoptPointIndexes(std::vector<unsigned>& globalIndexes);
+
 		//! Invalidates the bounding-box
 		inline void invalidateBoundingBox() { m_bbox.setValidity(false); }
 
@@ -13,7 +13,7 @@ namespace CCCoreLib
 	class GenericCloud;
 	class GenericIndexedMesh;
 	class GenericIndexedCloud;
-	class KDTree;
+	class FlatKdTree;
 	class ScalarField;
 
 	//! Common point cloud registration algorithms
@@ -277,7 +277,7 @@ namespace CCCoreLib
 			\param results the resulting bases
 			\return the number of bases found (number of element in the results array) or -1 is a problem occurred
 		**/
-		static int FindCongruentBases(	KDTree* tree,
+		static int FindCongruentBases(	FlatKdTree* tree,
 										ScalarType delta,
 										const CCVector3* base[4],
 		std::vector<Base>& results);
@@ -290,7 +290,7 @@ namespace CCCoreLib
 			\param delta tolerance above which data points are not counted (if a point is less than delta-apart from the model cloud, then it is counted)
 			\return the number of data points which are distance-apart from the model cloud
 		**/
-		static unsigned ComputeRegistrationScore(	KDTree *modelTree,
+		static unsigned ComputeRegistrationScore(	FlatKdTree *modelTree,
 													GenericIndexedCloud *dataCloud,
 													ScalarType delta,
 													const ScaledTransformation& dataToModel);
@@ -6,8 +6,10 @@
 //Local
 #include "CCConst.h"
 #include "CCShareable.h"
+#include "PointSpans.h"
 
 //System
+#include <limits>
 #include <vector>
 
 namespace CCCoreLib
@@ -79,6 +81,11 @@ namespace CCCoreLib
 		inline unsigned currentSize() const { return static_cast<unsigned>(size()); }
 		inline void swap(std::size_t i1, std::size_t i2) { std::swap(at(i1), at(i2)); }
 
+		//! Returns a direct access to the values (no bounds checking)
+		inline Span<ScalarType> values() { return Span<ScalarType>(data(), size()); }
+		//! Returns a direct (read-only) access to the values (no bounds checking)
+		inline Span<const ScalarType> values() const { return Span<const ScalarType>(data(), size()); }
+
 	protected: //methods
 
 		//! Default destructor
@@ -101,26 +108,23 @@ namespace CCCoreLib
 	{
 		if (!empty())
 		{
-			bool minMaxInitialized = false;
-			for (std::size_t i = 0; i < size(); ++i)
+			//branchless min/max reductions (NaN values are automatically ignored as all comparisons with NaN fail)
+			ScalarType minVal = std::numeric_limits<ScalarType>::infinity();
+			ScalarType maxVal = -std::numeric_limits<ScalarType>::infinity();
+			const ScalarType* _values = data();
+			const std::size_t count = size();
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				const ScalarType val = _values[i];
+				minVal = (val < minVal ? val : minVal);
+				maxVal = (val > maxVal ? val : maxVal);
+			}
+
+			//at least one valid value?
+			if (minVal <= maxVal)
 			{
-				const ScalarType& val = at(i);
-				if (ValidValue(val))
-				{
-					if (minMaxInitialized)
-					{
-						if (val < m_minVal)
-							m_minVal = val;
-						else if (val > m_maxVal)
-							m_maxVal = val;
-					}
-					else
-					{
-						//first valid value is used to init min and max
-						m_minVal = m_maxVal = val;
-						minMaxInitialized = true;
-					}
-				}
+				m_minVal = minVal;
+				m_maxVal = maxVal;
 			}
 		}
 		else //particular case: no value
@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: LGPL-2.0-or-later
+// Copyright © CloudCompare Project
+
+#pragma once
+
+//Local
+#include "CCCoreLib.h"
+
+//system
+#include <functional>
+
+namespace CCCoreLib
+{
+	class GenericProgressCallback;
+
+	//! Parallel scheduler for a set of independent tasks (e.g. octree cells)
+	/** The tasks are grouped in contiguous batches of (roughly) the same cost. Each thread
+		starts with its own deque of consecutive batches, and idle threads steal batches
+		from the back of the other deques, so that unbalanced workloads (e.g. a few very
+		populated cells) still keep all the threads busy.
+		Each scheduler has its own thread budget and its own threads: concurrent
+		schedulers don't interfere (the global thread pool is not used).
+		Without multi-threading support (or in debug mode), the tasks are run sequentially.
+	**/
+	class CC_CORE_LIB_API TaskScheduler
+	{
+	public:
+
+		//! Task function (returns false to stop the whole process)
+		using TaskFunction = std::function<bool(unsigned taskIndex)>;
+
+		//! Task cost function (e.g. the number of points of a cell)
+		using CostFunction = std::function<unsigned(unsigned taskIndex)>;
+
+		//! Default constructor
+		/** \param maxThreadCount max number of threads used by this scheduler (0 = all)
+		**/
+		explicit TaskScheduler(int maxThreadCount = 0);
+
+		//! Returns the max number of threads used by this scheduler
+		inline int maxThreadCount() const { return m_maxThreadCount; }
+
+		//! Runs a set of tasks (the calling thread takes part in the process)
+		/** The process stops as soon as a task returns false, or as soon as a cancel
+			request is detected on the progress callback (checked between two batches).
+			Note that the tasks already started are always completed.
+			\param taskCount number of tasks
+			\param func task function
+			\param costFunc task cost function (optional: same cost for all tasks if not set)
+			\param progressCb progress callback (optional: only used for cancellation)
+			\return false if the process has been stopped
+		**/
+		bool run(	unsigned taskCount,
+					const TaskFunction& func,
+					const CostFunction& costFunc = CostFunction(),
+					GenericProgressCallback* progressCb = nullptr) const;
+
+		//! Returns the number of threads used by default
+		static int IdealThreadCount();
+
+		//! Number of batches per thread (when there are enough tasks)
+		static const unsigned BatchesPerThread = 16;
+
+	protected:
+
+		//! Max number of threads
+		int m_maxThreadCount;
+	};
+}
@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: LGPL-2.0-or-later
+// Copyright © CloudCompare Project
+
+#pragma once
+
+//Local
+#include "CCGeom.h"
+#include "CCToolbox.h"
+
+//system
+#include <vector>
+
+namespace CCCoreLib
+{
+	class GenericIndexedCloud;
+	class GenericIndexedCloudPersist;
+	class GenericProgressCallback;
+	class ReferenceCloud;
+
+	//! Z-buffer based visibility algorithms (hidden points removal)
+	/** The points are projected in a 2D image space (plane, cylinder or sphere) and only the
+		points close to the minimum depth of their neighbourhood in this image are kept.
+		The depth buffer is a flat, tiled buffer filled tile by tile (in parallel if possible).
+	**/
+	class CC_CORE_LIB_API VisibilityTools : public CCToolbox
+	{
+	public:
+
+		//! Image space in which the depth buffer is built
+		enum ProjectionMode
+		{
+			PLANAR = 0,			//!< (X, Y) are the image coordinates, the depth is -Z (e.g. unrolled clouds)
+			CYLINDRICAL = 1,	//!< (longitude, height) around an axis, the depth is the distance to the axis
+			SPHERICAL = 2,		//!< (longitude, latitude) around a viewpoint, the depth is the distance to the viewpoint
+		};
+
+		//! Depth buffer parameters
+		struct DepthBufferParams
+		{
+			//! Projection mode
+			ProjectionMode mode = PLANAR;
+			//! A point of the axis (CYLINDRICAL) or the viewpoint (SPHERICAL)
+			CCVector3 center = CCVector3(0, 0, 0);
+			//! Cylinder axis (X=0, Y=1 or Z=2) - CYLINDRICAL mode only
+			unsigned char axisDim = 2;
+			//! Metric pixel size (PLANAR mode, and along the axis in CYLINDRICAL mode)
+			PointCoordinateType pixelSize = 0;
+			//! Angular pixel size (longitude in CYLINDRICAL mode, longitude and latitude in SPHERICAL mode)
+			double angularStep_rad = 0;
+			//! Half-size (in pixels) of the neighbourhood in which the minimum depth is looked for
+			unsigned neighbourhood = 1;
+			//! Points deeper than the minimum depth of their neighbourhood + this tolerance are hidden
+			PointCoordinateType depthTolerance = 0;
+			//! Whether the depth is reversed (i.e. the farthest points are visible)
+			/** E.g. to keep the walls of a shaft and remove the equipment in front of them.
+			**/
+			bool reverseDepth = false;
+			//! Max thread count (0 = ideal thread count)
+			int maxThreadCount = 0;
+		};
+
+		//! Computes the visibility of each point
+		/** \warning the cloud 'getPoint' method must be thread-safe
+			\param cloud input cloud
+			\param params depth buffer parameters
+			\param visibility [out] visibility of each point (POINT_VISIBLE or POINT_HIDDEN)
+			\param visibleCount [out] optional: number of visible points
+			\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+			\return success
+		**/
+		static bool ComputeVisibility(	GenericIndexedCloud* cloud,
+										const DepthBufferParams& params,
+										std::vector<unsigned char>& visibility,
+										unsigned* visibleCount = nullptr,
+										GenericProgressCallback* progressCb = nullptr);
+
+		//! Extracts the visible points of a cloud
+		/** \param cloud input cloud
+			\param params depth buffer parameters
+			\param hiddenPoints [out] optional: the hidden points will be added to this cloud (must be associated to the same input cloud)
+			\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+			\return the visible points (or nullptr if an error occurred)
+		**/
+		static ReferenceCloud* RemoveHiddenPoints(	GenericIndexedCloudPersist* cloud,
+													const DepthBufferParams& params,
+													ReferenceCloud* hiddenPoints = nullptr,
+													GenericProgressCallback* progressCb = nullptr);
+	};
+}
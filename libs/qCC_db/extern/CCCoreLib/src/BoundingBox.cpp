@@ -149,6 +149,32 @@ void BoundingBox::add(const CCVector3& aPoint)
 	}
 }
 
+void BoundingBox::add(const CCVector3* points, std::size_t count)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	//branchless min/max reductions (vectorizable)
+	CCVector3 bbMin = (m_valid ? m_bbMin : points[0]);
+	CCVector3 bbMax = (m_valid ? m_bbMax : points[0]);
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		const CCVector3& P = points[i];
+		bbMin.x = (P.x < bbMin.x ? P.x : bbMin.x);
+		bbMin.y = (P.y < bbMin.y ? P.y : bbMin.y);
+		bbMin.z = (P.z < bbMin.z ? P.z : bbMin.z);
+		bbMax.x = (P.x > bbMax.x ? P.x : bbMax.x);
+		bbMax.y = (P.y > bbMax.y ? P.y : bbMax.y);
+		bbMax.z = (P.z > bbMax.z ? P.z : bbMax.z);
+	}
+
+	m_bbMin = bbMin;
+	m_bbMax = bbMax;
+	m_valid = true;
+}
+
 PointCoordinateType BoundingBox::minDistTo(const BoundingBox& box) const
 {
 	if (m_valid && box.isValid())
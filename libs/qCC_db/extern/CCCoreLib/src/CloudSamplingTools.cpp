@@ -8,6 +8,7 @@
 #include <DistanceComputationTools.h>
 #include <GenericProgressCallback.h>
 #include <Neighbourhood.h>
+#include <NeighbourhoodCache.h>
 #include <PointCloud.h>
 #include <ReferenceCloud.h>
 #include <ScalarField.h>
@@ -20,6 +21,80 @@
 
 using namespace CCCoreLib;
 
+namespace
+{
+	//! Noise filter: decides whether a point should be kept, based on its neighbourhood
+	/** \param neighbours neighbours (should include the query point, which is moved at the end)
+		\param neighborCount number of neighbours
+		\param globalIndex index of the query point
+		\param queryPoint query point
+		\param nSigma number of sigmas under which the points should be kept
+		\param removeIsolatedPoints whether to remove isolated points
+		\param useAbsoluteError whether to use an absolute error instead of 'n' sigmas
+		\param absoluteError absolute error
+		\return whether the point should be kept
+	**/
+	bool NoiseFilterKeepsPoint(	DgmOctree::NeighboursSet& neighbours,
+								unsigned neighborCount,
+								unsigned globalIndex,
+								const CCVector3& queryPoint,
+								double nSigma,
+								bool removeIsolatedPoints,
+								bool useAbsoluteError,
+								double absoluteError)
+	{
+		if (neighborCount <= 3) //we want 3 points or more (other than the point itself!)
+		{
+			//not enough points to fit a plane AND compute distances to it
+			return !removeIsolatedPoints;
+		}
+
+		//find the query point in the nearest neighbors set and place it at the end
+		//(if it's not there, e.g. with many duplicate points, the farthest neighbor is ignored instead)
+		unsigned localIndex = 0;
+		while (localIndex < neighborCount && neighbours[localIndex].pointIndex != globalIndex)
+			++localIndex;
+		if (localIndex + 1 < neighborCount) //no need to swap with another point if it's already at the end!
+		{
+			std::swap(neighbours[localIndex], neighbours[neighborCount - 1]);
+		}
+
+		unsigned realNeighborCount = neighborCount - 1;
+		DgmOctreeReferenceCloud neighboursCloud(&neighbours, realNeighborCount); //we don't take the query point into account!
+		Neighbourhood Z(&neighboursCloud);
+
+		const PointCoordinateType* lsPlane = Z.getLSPlane();
+		if (!lsPlane)
+		{
+			//TODO: ???
+			return false;
+		}
+
+		double maxD = absoluteError;
+		if (!useAbsoluteError)
+		{
+			//compute the std. dev. to this plane
+			double sum_d = 0;
+			double sum_d2 = 0;
+			for (unsigned j = 0; j < realNeighborCount; ++j)
+			{
+				const CCVector3* P = neighboursCloud.getPoint(j);
+				double d = DistanceComputationTools::computePoint2PlaneDistance(P, lsPlane);
+				sum_d += d;
+				sum_d2 += d*d;
+			}
+
+			double stddev = sqrt(std::abs(sum_d2*realNeighborCount - sum_d*sum_d)) / realNeighborCount;
+			maxD = stddev * nSigma;
+		}
+
+		//distance from the query point to the plane
+		double d = std::abs(DistanceComputationTools::computePoint2PlaneDistance(&queryPoint, lsPlane));
+
+		return (d <= maxD);
+	}
+}
+
 GenericIndexedCloud* CloudSamplingTools::resampleCloudWithOctree(	GenericIndexedCloudPersist* inputCloud,
 																	int newNumberOfPoints,
 																	RESAMPLING_CELL_METHOD resamplingMethod,
@@ -457,7 +532,8 @@ ReferenceCloud* CloudSamplingTools::sorFilter(	GenericIndexedCloudPersist* input
 												int knn/*=6*/,
 												double nSigma/*=1.0*/,
 												DgmOctree* inputOctree/*=0*/,
-												GenericProgressCallback* progressCb/*=0*/)
+												GenericProgressCallback* progressCb/*=0*/,
+												const NeighbourhoodCache* cache/*=nullptr*/)
 {
 	if (!inputCloud || knn <= 0 || inputCloud->size() <= static_cast<unsigned>(knn))
 	{
@@ -466,8 +542,11 @@ ReferenceCloud* CloudSamplingTools::sorFilter(	GenericIndexedCloudPersist* input
 		return nullptr;
 	}
 
+	//the octree is only needed if the cache can't provide the neighbors
+	bool useCache = (cache && cache->canProvideKNN(inputCloud, static_cast<unsigned>(knn)));
+
 	DgmOctree* octree = inputOctree;
-	if (!octree)
+	if (!octree && !useCache)
 	{
 		//compute the octree if necessary
 		octree = new DgmOctree(inputCloud);
@@ -501,22 +580,57 @@ ReferenceCloud* CloudSamplingTools::sorFilter(	GenericIndexedCloudPersist* input
 
 		//1st step: compute the average distance to the neighbors
 		{
-			//additional parameters
-			void* additionalParameters[] = {reinterpret_cast<void*>(&knn),
-											reinterpret_cast<void*>(&meanDistances)
-										   };
-
-			unsigned char octreeLevel = octree->findBestLevelForAGivenPopulationPerCell(knn);
-
-			if (octree->executeFunctionForAllCellsAtLevel(	octreeLevel,
-															&applySORFilterAtLevel,
-															additionalParameters,
-															true,
-															progressCb,
-															"SOR filter") == 0)
+			if (useCache)
 			{
-				//something went wrong
-				break;
+				if (!cache->forEachPointRange(	[&](unsigned first, unsigned last)
+												{
+													for (unsigned i = first; i < last; ++i)
+													{
+														const unsigned* neighbours = cache->neighbours(i);
+														const ScalarType* squareDistances = cache->squareDistances(i);
+														double sumDist = 0;
+														unsigned count = 0;
+														for (int j = 0; j < knn; ++j)
+														{
+															if (neighbours[j] != i)
+															{
+																sumDist += sqrt(static_cast<double>(squareDistances[j]));
+																++count;
+															}
+														}
+														if (count)
+														{
+															meanDistances[i] = static_cast<PointCoordinateType>(sumDist / count);
+														}
+													}
+													return true;
+												},
+												progressCb,
+												"SOR filter"))
+				{
+					//process cancelled by the user
+					break;
+				}
+			}
+			else
+			{
+				//additional parameters
+				void* additionalParameters[] = {reinterpret_cast<void*>(&knn),
+												reinterpret_cast<void*>(&meanDistances)
+											   };
+
+				unsigned char octreeLevel = octree->findBestLevelForAGivenPopulationPerCell(knn);
+
+				if (octree->executeFunctionForAllCellsAtLevel(	octreeLevel,
+																&applySORFilterAtLevel,
+																additionalParameters,
+																true,
+																progressCb,
+																"SOR filter") == 0)
+				{
+					//something went wrong
+					break;
+				}
 			}
 
 			//deduce the average distance and std. dev.
@@ -536,8 +650,23 @@ ReferenceCloud* CloudSamplingTools::sorFilter(	GenericIndexedCloudPersist* input
 			//deduce the max distance
 			double maxDist = avgDist + nSigma * stdDev;
 
+			unsigned keptCount = 0;
+			for (unsigned i = 0; i < pointCount; ++i)
+			{
+				if (meanDistances[i] <= maxDist)
+				{
+					++keptCount;
+				}
+			}
+
 			filteredCloud = new ReferenceCloud(inputCloud);
-			if (!filteredCloud->reserve(pointCount))
+			if (keptCount == 0)
+			{
+				break;
+			}
+
+			unsigned* keptIndexes = filteredCloud->appendPointIndexSpan(keptCount);
+			if (!keptIndexes)
 			{
 				//not enough memory
 				delete filteredCloud;
@@ -549,15 +678,13 @@ ReferenceCloud* CloudSamplingTools::sorFilter(	GenericIndexedCloudPersist* input
 			{
 				if (meanDistances[i] <= maxDist)
 				{
-					filteredCloud->addPointIndex(i);
+					*keptIndexes++ = i;
 				}
 			}
-
-			filteredCloud->resize(filteredCloud->size());
 		}
 	}
 
-	if (!inputOctree)
+	if (octree && !inputOctree)
 	{
 		delete octree;
 		octree = nullptr;
@@ -575,7 +702,8 @@ ReferenceCloud* CloudSamplingTools::noiseFilter(GenericIndexedCloudPersist* inpu
 												bool useAbsoluteError/*=true*/,
 												double absoluteError/*=0.0*/,
 												DgmOctree* inputOctree/*=0*/,
-												GenericProgressCallback* progressCb/*=0*/)
+												GenericProgressCallback* progressCb/*=0*/,
+												const NeighbourhoodCache* cache/*=nullptr*/)
 {
 	if (!inputCloud || inputCloud->size() < 2 || (useKnn && knn <= 0) || (!useKnn && kernelRadius <= 0))
 	{
@@ -584,8 +712,18 @@ ReferenceCloud* CloudSamplingTools::noiseFilter(GenericIndexedCloudPersist* inpu
 		return nullptr;
 	}
 
+	//the octree is only needed if the cache can't provide the neighbors
+	bool useCache = false;
+	if (cache)
+	{
+		if (useKnn)
+			useCache = cache->canProvideKNN(inputCloud, static_cast<unsigned>(knn));
+		else
+			useCache = cache->canProvideRadius(inputCloud, kernelRadius);
+	}
+
 	DgmOctree* octree = inputOctree;
-	if (!octree)
+	if (!octree && !useCache)
 	{
 		octree = new DgmOctree(inputCloud);
 		if (octree->build(progressCb) < 1)
@@ -595,56 +733,106 @@ ReferenceCloud* CloudSamplingTools::noiseFilter(GenericIndexedCloudPersist* inpu
 		}
 	}
 
-	ReferenceCloud* filteredCloud = new ReferenceCloud(inputCloud);
-
+	//the cells are processed in parallel: each thread flags the points to keep
+	//(without any lock), and they are all added to the output cloud at the end
 	unsigned pointCount = inputCloud->size();
-	if (!filteredCloud->reserve(pointCount))
+	std::vector<unsigned char> keepFlags;
+	try
+	{
+		keepFlags.resize(pointCount, 0);
+	}
+	catch (const std::bad_alloc&)
 	{
 		//not enough memory
 		if (!inputOctree)
 			delete octree;
-		delete filteredCloud;
 		return nullptr;
 	}
 
-	//additional parameters
-	void* additionalParameters[] = {reinterpret_cast<void*>(filteredCloud),
-									reinterpret_cast<void*>(&kernelRadius),
-									reinterpret_cast<void*>(&nSigma),
-									reinterpret_cast<void*>(&removeIsolatedPoints),
-									reinterpret_cast<void*>(&useKnn),
-									reinterpret_cast<void*>(&knn),
-									reinterpret_cast<void*>(&useAbsoluteError),
-									reinterpret_cast<void*>(&absoluteError)
-								   };
+	ReferenceCloud* filteredCloud = new ReferenceCloud(inputCloud);
 
-	unsigned char octreeLevel = 0;
-	if (useKnn)
-		octreeLevel = octree->findBestLevelForAGivenPopulationPerCell(knn);
+	if (useCache)
+	{
+		if (!cache->forEachPointRange(	[&](unsigned first, unsigned last)
+										{
+											DgmOctree::NeighboursSet neighbours;
+											try
+											{
+												for (unsigned i = first; i < last; ++i)
+												{
+													unsigned neighborCount = (useKnn ? static_cast<unsigned>(knn) : cache->countInSphere(i, kernelRadius));
+													neighborCount = cache->getNeighbours(i, neighborCount, neighbours);
+													if (NoiseFilterKeepsPoint(	neighbours,
+																				neighborCount,
+																				i,
+																				*inputCloud->getPointPersistentPtr(i),
+																				nSigma,
+																				removeIsolatedPoints,
+																				useAbsoluteError,
+																				absoluteError))
+													{
+														keepFlags[i] = 1;
+													}
+												}
+											}
+											catch (const std::bad_alloc&)
+											{
+												//not enough memory
+												return false;
+											}
+											return true;
+										},
+										progressCb,
+										"Noise filter"))
+		{
+			//something went wrong
+			delete filteredCloud;
+			filteredCloud = nullptr;
+		}
+	}
 	else
-		octreeLevel = octree->findBestLevelForAGivenNeighbourhoodSizeExtraction(kernelRadius);
-
-	if (octree->executeFunctionForAllCellsAtLevel(	octreeLevel,
-													&applyNoiseFilterAtLevel,
-													additionalParameters,
-													true,
-													progressCb,
-													"Noise filter" ) == 0)
 	{
-		//something went wrong
-		delete filteredCloud;
-		filteredCloud = nullptr;
+		//additional parameters
+		void* additionalParameters[] = {reinterpret_cast<void*>(&keepFlags),
+										reinterpret_cast<void*>(&kernelRadius),
+										reinterpret_cast<void*>(&nSigma),
+										reinterpret_cast<void*>(&removeIsolatedPoints),
+										reinterpret_cast<void*>(&useKnn),
+										reinterpret_cast<void*>(&knn),
+										reinterpret_cast<void*>(&useAbsoluteError),
+										reinterpret_cast<void*>(&absoluteError)
+									   };
+
+		unsigned char octreeLevel = 0;
+		if (useKnn)
+			octreeLevel = octree->findBestLevelForAGivenPopulationPerCell(knn);
+		else
+			octreeLevel = octree->findBestLevelForAGivenNeighbourhoodSizeExtraction(kernelRadius);
+
+		if (octree->executeFunctionForAllCellsAtLevel(	octreeLevel,
+														&applyNoiseFilterAtLevel,
+														additionalParameters,
+														true,
+														progressCb,
+														"Noise filter" ) == 0)
+		{
+			//something went wrong
+			delete filteredCloud;
+			filteredCloud = nullptr;
+		}
 	}
 
-	if (!inputOctree)
+	if (octree && !inputOctree)
 	{
 		delete octree;
 		octree = nullptr;
 	}
 
-	if (filteredCloud)
+	if (filteredCloud && !filteredCloud->addFlaggedPointIndexes(keepFlags.data(), pointCount))
 	{
-		filteredCloud->resize(filteredCloud->size());
+		//not enough memory
+		delete filteredCloud;
+		filteredCloud = nullptr;
 	}
 
 	return filteredCloud;
@@ -728,7 +916,7 @@ bool CloudSamplingTools::applyNoiseFilterAtLevel(	const DgmOctree::octreeCell& c
 													void** additionalParameters,
 													NormalizedProgress* nProgress/*=0*/)
 {
-	ReferenceCloud* cloud				=  static_cast<ReferenceCloud*>(additionalParameters[0]);
+	std::vector<unsigned char>& keepFlags	= *static_cast<std::vector<unsigned char>*>(additionalParameters[0]);
 	PointCoordinateType kernelRadius	= *static_cast<PointCoordinateType*>(additionalParameters[1]);
 	double nSigma						= *static_cast<double*>(additionalParameters[2]);
 	bool removeIsolatedPoints			= *static_cast<bool*>(additionalParameters[3]);
@@ -764,67 +952,17 @@ bool CloudSamplingTools::applyNoiseFilterAtLevel(	const DgmOctree::octreeCell& c
 		else
 			neighborCount = cell.parentOctree->findNeighborsInASphereStartingFromCell(nNSS, kernelRadius, false);
 
-		if (neighborCount > 3) //we want 3 points or more (other than the point itself!)
-		{
-			//find the query point in the nearest neighbors set and place it at the end
-			const unsigned globalIndex = cell.points->getPointGlobalIndex(i);
-			unsigned localIndex = 0;
-			while (localIndex < neighborCount && nNSS.pointsInNeighbourhood[localIndex].pointIndex != globalIndex)
-				++localIndex;
-			//the query point should be in the nearest neighbors set!
-			assert(localIndex < neighborCount);
-			if (localIndex + 1 < neighborCount) //no need to swap with another point if it's already at the end!
-			{
-				std::swap(nNSS.pointsInNeighbourhood[localIndex], nNSS.pointsInNeighbourhood[neighborCount - 1]);
-			}
-
-			unsigned realNeighborCount = neighborCount - 1;
-			DgmOctreeReferenceCloud neighboursCloud(&nNSS.pointsInNeighbourhood, realNeighborCount); //we don't take the query point into account!
-			Neighbourhood Z(&neighboursCloud);
-
-			const PointCoordinateType* lsPlane = Z.getLSPlane();
-			if (lsPlane)
-			{
-				double maxD = absoluteError;
-				if (!useAbsoluteError)
-				{
-					//compute the std. dev. to this plane
-					double sum_d = 0;
-					double sum_d2 = 0;
-					for (unsigned j = 0; j < realNeighborCount; ++j)
-					{
-						const CCVector3* P = neighboursCloud.getPoint(j);
-						double d = DistanceComputationTools::computePoint2PlaneDistance(P, lsPlane);
-						sum_d += d;
-						sum_d2 += d*d;
-					}
-
-					double stddev = sqrt(std::abs(sum_d2*realNeighborCount - sum_d*sum_d)) / realNeighborCount;
-					maxD = stddev * nSigma;
-				}
-
-				//distance from the query point to the plane
-				double d = std::abs(DistanceComputationTools::computePoint2PlaneDistance(&nNSS.queryPoint, lsPlane));
-
-				if (d <= maxD)
-				{
-					cloud->addPointIndex(globalIndex);
-				}
-			}
-			else
-			{
-				//TODO: ???
-			}
-		}
-		else
+		const unsigned globalIndex = cell.points->getPointGlobalIndex(i);
+		if (NoiseFilterKeepsPoint(	nNSS.pointsInNeighbourhood,
+									neighborCount,
+									globalIndex,
+									nNSS.queryPoint,
+									nSigma,
+									removeIsolatedPoints,
+									useAbsoluteError,
+									absoluteError))
 		{
-			//not enough points to fit a plane AND compute distances to it
-			if (!removeIsolatedPoints)
-			{
-				//we keep the point
-				unsigned globalIndex = cell.points->getPointGlobalIndex(i);
-				cloud->addPointIndex(globalIndex);
-			}
+			keepFlags[globalIndex] = 1;
 		}
 
 		if (nProgress && !nProgress->oneStep())
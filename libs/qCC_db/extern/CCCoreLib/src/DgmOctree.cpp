@@ -10,21 +10,22 @@
 #include <RayAndBox.h>
 #include <ReferenceCloud.h>
 #include <ScalarField.h>
+#include <TaskScheduler.h>
+#include "NearestNeighbourKernels.h"
 
 //system
+#include <algorithm>
+#include <atomic>
+#include <climits>
 #include <cstdio>
+#include <cstring>
+#include <limits>
 #include <utility>
 
 //DGM: tests in progress
 //#define COMPUTE_NN_SEARCH_STATISTICS
 //#define ADAPTATIVE_BINARY_SEARCH
 
-#ifdef ENABLE_MT_OCTREE
-#include <QThread>
-#include <QThreadPool>
-#include <QtConcurrentMap>
-#endif
-
 using namespace CCCoreLib;
 
 /**********************************/
@@ -99,6 +100,283 @@ struct MonoDimensionalCellCodes
 };
 static MonoDimensionalCellCodes PRE_COMPUTED_POS_CODES;
 
+/**********************************/
+/*		  OCTREE BUILD HELPERS	  */
+/**********************************/
+
+namespace
+{
+	//! Min number of points per chunk (octree build)
+	const unsigned c_buildChunkMinSize = 65536;
+
+	//! Below this number of cells, a range is sorted with std::sort (octree build)
+	const unsigned c_radixSortMinSize = 256;
+	//! Max number of cells sorted with an (out-of-place) LSD radix sort (octree build)
+	/** Larger ranges are first split in place on their most significant digit, so
+		that the extra memory is bounded (16 MB per thread here) whatever the cloud size.
+	**/
+	const unsigned c_radixSortBufferSize = 1 << 20;
+
+	//! Number of bits per radix sort digit
+	const unsigned c_radixBits = 8;
+	//! Number of buckets per radix sort digit
+	const unsigned c_radixBuckets = (1 << c_radixBits);
+
+	//! Chunk of points/cells processed by a single thread (octree build)
+	struct BuildChunk
+	{
+		//! First index
+		unsigned start = 0;
+		//! Last index (excluded)
+		unsigned stop = 0;
+		//! Number of projected points
+		unsigned count = 0;
+		//! Min and max cell positions (xMin, yMin, zMin, xMax, yMax, zMax)
+		int fillIndexes[6] = { INT_MAX, INT_MAX, INT_MAX, INT_MIN, INT_MIN, INT_MIN };
+		//! Radix sort histogram (then offsets)
+		unsigned histogram[c_radixBuckets];
+	};
+
+	//! Splits [0, count) in chunks (one or several per thread)
+	std::vector<BuildChunk> SplitInChunks(unsigned count, unsigned threadCount)
+	{
+		unsigned chunkSize = std::max(c_buildChunkMinSize, (count + 4 * threadCount - 1) / (4 * threadCount));
+
+		std::vector<BuildChunk> chunks;
+		chunks.reserve((count + chunkSize - 1) / chunkSize);
+		for (unsigned start = 0; start < count; start += chunkSize)
+		{
+			BuildChunk chunk;
+			chunk.start = start;
+			chunk.stop = std::min(count, start + chunkSize);
+			chunks.push_back(chunk);
+		}
+		return chunks;
+	}
+
+	//! Returns the number of threads to use to build the octree
+	unsigned BuildThreadCount()
+	{
+		return static_cast<unsigned>(TaskScheduler::IdealThreadCount());
+	}
+
+	//! Applies a function to all chunks (in parallel if possible)
+	template <class Func> void ForEachChunk(std::vector<BuildChunk>& chunks, const Func& func)
+	{
+		TaskScheduler().run(static_cast<unsigned>(chunks.size()), [&chunks, &func](unsigned i) { func(chunks[i]); return true; });
+	}
+
+	//! Returns the radix sort digit of a cell code
+	inline unsigned RadixDigit(const DgmOctree::IndexAndCode& cell, unsigned shift)
+	{
+		return static_cast<unsigned>(cell.theCode >> shift) & (c_radixBuckets - 1);
+	}
+
+	//! Moves the cells in place so that they are sorted by digit (American flag sort, not stable)
+	/** \param histogram number of cells per digit
+		\param[out] bucketStart index of the first cell of each digit (+ the total count)
+	**/
+	void PartitionCellsOnDigit(DgmOctree::IndexAndCode* cells, unsigned shift, const unsigned* histogram, unsigned* bucketStart)
+	{
+		unsigned heads[c_radixBuckets];
+		bucketStart[0] = 0;
+		for (unsigned b = 0; b < c_radixBuckets; ++b)
+		{
+			heads[b] = bucketStart[b];
+			bucketStart[b + 1] = bucketStart[b] + histogram[b];
+		}
+
+		for (unsigned b = 0; b < c_radixBuckets; ++b)
+		{
+			while (heads[b] < bucketStart[b + 1])
+			{
+				//follow the cycle starting with the first misplaced cell of this bucket
+				DgmOctree::IndexAndCode cell = cells[heads[b]];
+				unsigned digit = RadixDigit(cell, shift);
+				while (digit != b)
+				{
+					std::swap(cell, cells[heads[digit]++]);
+					digit = RadixDigit(cell, shift);
+				}
+				cells[heads[b]++] = cell;
+			}
+		}
+	}
+
+	//! Sorts a range of cells by ascending code (sequential)
+	/** Only the 'bitCount' lower bits of the codes may differ. Ranges of at most
+		c_radixSortBufferSize cells are sorted with a (stable) LSD radix sort, the
+		larger ones are first split in place on their most significant digit.
+		\param buffer at least min(count, c_radixSortBufferSize) cells
+	**/
+	void RadixSortCellRange(DgmOctree::IndexAndCode* cells, unsigned count, unsigned bitCount, DgmOctree::IndexAndCode* buffer)
+	{
+		if (count < c_radixSortMinSize)
+		{
+			std::sort(cells, cells + count, DgmOctree::IndexAndCode::codeComp);
+			return;
+		}
+
+		unsigned histogram[c_radixBuckets];
+
+		if (count > c_radixSortBufferSize)
+		{
+			//MSD split on the highest digit that is not shared by all the codes
+			while (bitCount != 0)
+			{
+				unsigned shift = (bitCount > c_radixBits ? bitCount - c_radixBits : 0);
+				memset(histogram, 0, sizeof(unsigned) * c_radixBuckets);
+				for (unsigned i = 0; i < count; ++i)
+				{
+					++histogram[RadixDigit(cells[i], shift)];
+				}
+				if (histogram[RadixDigit(cells[0], shift)] != count)
+				{
+					unsigned bucketStart[c_radixBuckets + 1];
+					PartitionCellsOnDigit(cells, shift, histogram, bucketStart);
+					for (unsigned b = 0; b < c_radixBuckets; ++b)
+					{
+						RadixSortCellRange(cells + bucketStart[b], bucketStart[b + 1] - bucketStart[b], shift, buffer);
+					}
+					return;
+				}
+				bitCount = shift;
+			}
+			return;
+		}
+
+		//LSD radix sort (the passes for which all the codes share the same digit are skipped)
+		DgmOctree::IndexAndCode* source = cells;
+		DgmOctree::IndexAndCode* dest = buffer;
+		for (unsigned shift = 0; shift < bitCount; shift += c_radixBits)
+		{
+			memset(histogram, 0, sizeof(unsigned) * c_radixBuckets);
+			for (unsigned i = 0; i < count; ++i)
+			{
+				++histogram[RadixDigit(source[i], shift)];
+			}
+			if (histogram[RadixDigit(source[0], shift)] == count)
+			{
+				continue;
+			}
+
+			unsigned offset = 0;
+			for (unsigned b = 0; b < c_radixBuckets; ++b)
+			{
+				unsigned n = histogram[b];
+				histogram[b] = offset;
+				offset += n;
+			}
+			for (unsigned i = 0; i < count; ++i)
+			{
+				dest[histogram[RadixDigit(source[i], shift)]++] = source[i];
+			}
+
+			std::swap(source, dest);
+		}
+
+		if (source != cells)
+		{
+			std::copy(source, source + count, cells);
+		}
+	}
+
+	//! Sorts the cells by ascending code (radix sort with a bounded extra memory)
+	/** Only the 3*MAX_OCTREE_LEVEL lower bits of the codes are considered. Large clouds
+		are first split in place on the most significant digit (parallel histogram),
+		then the resulting buckets are sorted in parallel (see RadixSortCellRange).
+		\return false if there's not enough memory (the cells are then only partially sorted)
+	**/
+	bool RadixSortCells(DgmOctree::cellsContainer& cells, unsigned threadCount)
+	{
+		unsigned count = static_cast<unsigned>(cells.size());
+		unsigned bitCount = 3 * DgmOctree::MAX_OCTREE_LEVEL;
+
+		if (count <= c_radixSortBufferSize)
+		{
+			DgmOctree::cellsContainer buffer;
+			try
+			{
+				buffer.resize(count);
+			}
+			catch (const std::bad_alloc&)
+			{
+				return false;
+			}
+			RadixSortCellRange(cells.data(), count, bitCount, buffer.data());
+			return true;
+		}
+
+		std::vector<BuildChunk> chunks = SplitInChunks(count, threadCount);
+
+		//MSD split on the highest digit that is not shared by all the codes
+		std::vector<unsigned> bucketStart(c_radixBuckets + 1, 0);
+		unsigned shift = 0;
+		while (true)
+		{
+			if (bitCount == 0)
+			{
+				//all the codes are the same
+				return true;
+			}
+			shift = (bitCount > c_radixBits ? bitCount - c_radixBits : 0);
+
+			//histograms (per chunk)
+			ForEachChunk(chunks, [&cells, shift](BuildChunk& chunk)
+			{
+				memset(chunk.histogram, 0, sizeof(unsigned) * c_radixBuckets);
+				const DgmOctree::IndexAndCode* cell = cells.data() + chunk.start;
+				for (unsigned i = chunk.start; i < chunk.stop; ++i, ++cell)
+				{
+					++chunk.histogram[RadixDigit(*cell, shift)];
+				}
+			});
+
+			unsigned histogram[c_radixBuckets];
+			for (unsigned b = 0; b < c_radixBuckets; ++b)
+			{
+				histogram[b] = 0;
+				for (const BuildChunk& chunk : chunks)
+				{
+					histogram[b] += chunk.histogram[b];
+				}
+			}
+
+			if (histogram[RadixDigit(cells.front(), shift)] != count)
+			{
+				PartitionCellsOnDigit(cells.data(), shift, histogram, bucketStart.data());
+				break;
+			}
+			bitCount = shift;
+		}
+
+		//then the buckets (in parallel, each task with its own buffer)
+		std::atomic<bool> notEnoughMemory(false);
+		TaskScheduler().run(c_radixBuckets, [&](unsigned b)
+		{
+			unsigned bucketSize = bucketStart[b + 1] - bucketStart[b];
+			DgmOctree::cellsContainer buffer;
+			if (bucketSize >= c_radixSortMinSize)
+			{
+				try
+				{
+					buffer.resize(std::min(bucketSize, c_radixSortBufferSize));
+				}
+				catch (const std::bad_alloc&)
+				{
+					notEnoughMemory = true;
+					return false;
+				}
+			}
+			RadixSortCellRange(cells.data() + bucketStart[b], bucketSize, shift, buffer.data());
+			return true;
+		},
+		[&bucketStart](unsigned b) { return bucketStart[b + 1] - bucketStart[b]; });
+
+		return !notEnoughMemory;
+	}
+}
+
 /**********************************/
 /*		  STATIC ACCESSORS		  */
 /**********************************/
@@ -220,6 +498,69 @@ int DgmOctree::build(	const CCVector3& octreeMin,
 	return genericBuild(progressCb);
 }
 
+void DgmOctree::getStructure(Structure& structure) const
+{
+	structure.dimMin = m_dimMin;
+	structure.dimMax = m_dimMax;
+	structure.pointsMin = m_pointsMin;
+	structure.pointsMax = m_pointsMax;
+	structure.numberOfProjectedPoints = m_numberOfProjectedPoints;
+	structure.nearestPow2 = m_nearestPow2;
+	memcpy(structure.fillIndexes, m_fillIndexes, sizeof(m_fillIndexes));
+	memcpy(structure.cellCount, m_cellCount, sizeof(m_cellCount));
+	memcpy(structure.maxCellPopulation, m_maxCellPopulation, sizeof(m_maxCellPopulation));
+	memcpy(structure.averageCellPopulation, m_averageCellPopulation, sizeof(m_averageCellPopulation));
+	memcpy(structure.stdDevCellPopulation, m_stdDevCellPopulation, sizeof(m_stdDevCellPopulation));
+}
+
+bool DgmOctree::restore(const Structure& structure, const IndexAndCode* cellCodes)
+{
+	clear();
+
+	unsigned pointCount = (m_theAssociatedCloud ? m_theAssociatedCloud->size() : 0);
+	if (!cellCodes || structure.numberOfProjectedPoints == 0 || structure.numberOfProjectedPoints > pointCount)
+	{
+		//incompatible cloud
+		return false;
+	}
+
+	try
+	{
+		m_thePointsAndTheirCellCodes.resize(structure.numberOfProjectedPoints);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return false;
+	}
+
+	//copy the cell codes (and check the point indexes, as they will be used without any check afterwards)
+	for (unsigned i = 0; i < structure.numberOfProjectedPoints; ++i)
+	{
+		if (cellCodes[i].theIndex >= pointCount)
+		{
+			clear();
+			return false;
+		}
+		m_thePointsAndTheirCellCodes[i] = cellCodes[i];
+	}
+
+	m_dimMin = structure.dimMin;
+	m_dimMax = structure.dimMax;
+	m_pointsMin = structure.pointsMin;
+	m_pointsMax = structure.pointsMax;
+	m_numberOfProjectedPoints = structure.numberOfProjectedPoints;
+	m_nearestPow2 = structure.nearestPow2;
+	memcpy(m_fillIndexes, structure.fillIndexes, sizeof(m_fillIndexes));
+	memcpy(m_cellCount, structure.cellCount, sizeof(m_cellCount));
+	memcpy(m_maxCellPopulation, structure.maxCellPopulation, sizeof(m_maxCellPopulation));
+	memcpy(m_averageCellPopulation, structure.averageCellPopulation, sizeof(m_averageCellPopulation));
+	memcpy(m_stdDevCellPopulation, structure.stdDevCellPopulation, sizeof(m_stdDevCellPopulation));
+	updateCellSizeTable();
+
+	return true;
+}
+
 int DgmOctree::genericBuild(GenericProgressCallback* progressCb)
 {
 	unsigned pointCount = (m_theAssociatedCloud ? m_theAssociatedCloud->size() : 0);
@@ -263,79 +604,110 @@ int DgmOctree::genericBuild(GenericProgressCallback* progressCb)
 	//fill indexes table (we'll fill the max. level, then deduce the others from this one)
 	int* fillIndexesAtMaxLevel = m_fillIndexes + (MAX_OCTREE_LEVEL * 6);
 
-	//for all points
-	cellsContainer::iterator it = m_thePointsAndTheirCellCodes.begin();
-	for (unsigned i=0; i<pointCount; i++)
+	//the points are projected by chunks (in parallel if possible)
+	unsigned threadCount = BuildThreadCount();
+	std::vector<BuildChunk> chunks;
+	try
+	{
+		chunks = SplitInChunks(pointCount, threadCount);
+	}
+	catch (const std::bad_alloc&)
+	{
+		m_thePointsAndTheirCellCodes.resize(0);
+		return -1;
+	}
+
+	std::atomic<bool> cancelled(false);
+	ForEachChunk(chunks, [&](BuildChunk& chunk)
 	{
-		const CCVector3* P = m_theAssociatedCloud->getPoint(i);
+		if (cancelled)
+		{
+			return;
+		}
 
-		//does the point falls in the 'accepted points' box?
-		//(potentially different from the octree box - see DgmOctree::build)
-		if (	(P->x >= m_pointsMin[0]) && (P->x <= m_pointsMax[0])
+		//the projected points of this chunk are stored (contiguously) from the chunk start
+		IndexAndCode* cell = m_thePointsAndTheirCellCodes.data() + chunk.start;
+		int* fillIndexes = chunk.fillIndexes;
+		for (unsigned i = chunk.start; i < chunk.stop; ++i)
+		{
+			const CCVector3* P = m_theAssociatedCloud->getPoint(i);
+
+			//does the point falls in the 'accepted points' box?
+			//(potentially different from the octree box - see DgmOctree::build)
+			if (	(P->x >= m_pointsMin[0]) && (P->x <= m_pointsMax[0])
 				&&	(P->y >= m_pointsMin[1]) && (P->y <= m_pointsMax[1])
 				&&	(P->z >= m_pointsMin[2]) && (P->z <= m_pointsMax[2]) )
-		{
-			//compute the position of the cell that includes this point
-			Tuple3i cellPos;
-			getTheCellPosWhichIncludesThePoint(P, cellPos);
-
-			//clipping X
-			if (cellPos.x < 0)
-				cellPos.x = 0;
-			else if (cellPos.x >= MAX_OCTREE_LENGTH)
-				cellPos.x = MAX_OCTREE_LENGTH-1;
-			//clipping Y
-			if (cellPos.y < 0)
-				cellPos.y = 0;
-			else if (cellPos.y >= MAX_OCTREE_LENGTH)
-				cellPos.y = MAX_OCTREE_LENGTH-1;
-			//clipping Z
-			if (cellPos.z < 0)
-				cellPos.z = 0;
-			else if (cellPos.z >= MAX_OCTREE_LENGTH)
-				cellPos.z = MAX_OCTREE_LENGTH-1;
-
-			it->theIndex = i;
-			it->theCode = GenerateTruncatedCellCode(cellPos, MAX_OCTREE_LEVEL);
-
-			if (m_numberOfProjectedPoints)
-			{
-				if (fillIndexesAtMaxLevel[0] > cellPos.x)
-					fillIndexesAtMaxLevel[0] = cellPos.x;
-				else if (fillIndexesAtMaxLevel[3] < cellPos.x)
-					fillIndexesAtMaxLevel[3] = cellPos.x;
-
-				if (fillIndexesAtMaxLevel[1] > cellPos.y)
-					fillIndexesAtMaxLevel[1] = cellPos.y;
-				else if (fillIndexesAtMaxLevel[4] < cellPos.y)
-					fillIndexesAtMaxLevel[4] = cellPos.y;
-
-				if (fillIndexesAtMaxLevel[2] > cellPos.z)
-					fillIndexesAtMaxLevel[2] = cellPos.z;
-				else if (fillIndexesAtMaxLevel[5] < cellPos.z)
-					fillIndexesAtMaxLevel[5] = cellPos.z;
-			}
-			else
 			{
-				fillIndexesAtMaxLevel[0] = fillIndexesAtMaxLevel[3] = cellPos.x;
-				fillIndexesAtMaxLevel[1] = fillIndexesAtMaxLevel[4] = cellPos.y;
-				fillIndexesAtMaxLevel[2] = fillIndexesAtMaxLevel[5] = cellPos.z;
+				//compute the position of the cell that includes this point
+				Tuple3i cellPos;
+				getTheCellPosWhichIncludesThePoint(P, cellPos);
+
+				//clipping
+				cellPos.x = std::min(std::max(cellPos.x, 0), MAX_OCTREE_LENGTH - 1);
+				cellPos.y = std::min(std::max(cellPos.y, 0), MAX_OCTREE_LENGTH - 1);
+				cellPos.z = std::min(std::max(cellPos.z, 0), MAX_OCTREE_LENGTH - 1);
+
+				cell->theIndex = i;
+				cell->theCode = GenerateTruncatedCellCode(cellPos, MAX_OCTREE_LEVEL);
+				++cell;
+
+				//per-chunk bounds (reduced afterwards)
+				fillIndexes[0] = std::min(fillIndexes[0], cellPos.x);
+				fillIndexes[1] = std::min(fillIndexes[1], cellPos.y);
+				fillIndexes[2] = std::min(fillIndexes[2], cellPos.z);
+				fillIndexes[3] = std::max(fillIndexes[3], cellPos.x);
+				fillIndexes[4] = std::max(fillIndexes[4], cellPos.y);
+				fillIndexes[5] = std::max(fillIndexes[5], cellPos.z);
 			}
+		}
+		chunk.count = static_cast<unsigned>(cell - (m_thePointsAndTheirCellCodes.data() + chunk.start));
 
-			++it;
-			++m_numberOfProjectedPoints;
+		if (!nprogress.steps(chunk.stop - chunk.start))
+		{
+			cancelled = true;
 		}
+	});
 
-		if (!nprogress.oneStep())
+	if (cancelled)
+	{
+		m_thePointsAndTheirCellCodes.resize(0);
+		m_numberOfProjectedPoints = 0;
+		if (progressCb)
 		{
-			m_thePointsAndTheirCellCodes.resize(0);
-			m_numberOfProjectedPoints = 0;
-			if (progressCb)
+			progressCb->stop();
+		}
+		return 0;
+	}
+
+	//bounds reduction and compaction (if some points have been rejected)
+	for (const BuildChunk& chunk : chunks)
+	{
+		if (chunk.count == 0)
+		{
+			continue;
+		}
+
+		if (m_numberOfProjectedPoints)
+		{
+			for (int dim = 0; dim < 3; ++dim)
 			{
-				progressCb->stop();
+				fillIndexesAtMaxLevel[dim] = std::min(fillIndexesAtMaxLevel[dim], chunk.fillIndexes[dim]);
+				fillIndexesAtMaxLevel[dim + 3] = std::max(fillIndexesAtMaxLevel[dim + 3], chunk.fillIndexes[dim + 3]);
 			}
-			return 0;
 		}
+		else
+		{
+			std::copy(chunk.fillIndexes, chunk.fillIndexes + 6, fillIndexesAtMaxLevel);
+		}
+
+		if (m_numberOfProjectedPoints != chunk.start)
+		{
+			//the destination is always before the source
+			std::copy(	m_thePointsAndTheirCellCodes.begin() + chunk.start,
+						m_thePointsAndTheirCellCodes.begin() + (chunk.start + chunk.count),
+						m_thePointsAndTheirCellCodes.begin() + m_numberOfProjectedPoints);
+		}
+		m_numberOfProjectedPoints += chunk.count;
 	}
 
 	//we deduce the lower levels 'fill indexes' from the highest level
@@ -359,7 +731,11 @@ int DgmOctree::genericBuild(GenericProgressCallback* progressCb)
 	}
 
 	//we sort the 'cells' by ascending code order
-	ParallelSort(m_thePointsAndTheirCellCodes.begin(), m_thePointsAndTheirCellCodes.end(), IndexAndCode::codeComp);
+	if (!RadixSortCells(m_thePointsAndTheirCellCodes, threadCount))
+	{
+		//not enough memory for the radix sort buffers
+		ParallelSort(m_thePointsAndTheirCellCodes.begin(), m_thePointsAndTheirCellCodes.end(), IndexAndCode::codeComp);
+	}
 
 	//update the pre-computed 'number of cells per level of subdivision' array
 	updateCellCountTable();
@@ -422,9 +798,64 @@ void DgmOctree::updateCellSizeTable()
 void DgmOctree::updateCellCountTable()
 {
 	//level 0 is just the octree bounding-box
-	for (unsigned char i=0; i<=MAX_OCTREE_LEVEL; ++i)
+	if (m_thePointsAndTheirCellCodes.size() < 2)
+	{
+		for (unsigned char i=0; i<=MAX_OCTREE_LEVEL; ++i)
+		{
+			computeCellsStatistics(i);
+		}
+		return;
+	}
+	computeCellsStatistics(0);
+
+	//the other levels are computed in a single pass over the (sorted) codes: when
+	//two consecutive codes differ at a given level, they differ at all the deeper ones
+	unsigned cellStart[MAX_OCTREE_LEVEL + 1] = { 0 };
+	unsigned counter[MAX_OCTREE_LEVEL + 1] = { 0 };
+	unsigned maxCellPop[MAX_OCTREE_LEVEL + 1] = { 0 };
+	double sum2[MAX_OCTREE_LEVEL + 1] = { 0.0 };
+
+	unsigned pointCount = static_cast<unsigned>(m_thePointsAndTheirCellCodes.size());
+	CellCode predCode = m_thePointsAndTheirCellCodes.front().theCode;
+	for (unsigned i = 1; i <= pointCount; ++i)
 	{
-		computeCellsStatistics(i);
+		//the end of the array closes the cells of all the levels
+		unsigned char firstLevel = 1;
+		if (i < pointCount)
+		{
+			CellCode currentCode = m_thePointsAndTheirCellCodes[i].theCode;
+			CellCode diff = (currentCode ^ predCode);
+			if (diff == 0)
+			{
+				continue;
+			}
+			predCode = currentCode;
+
+			firstLevel = MAX_OCTREE_LEVEL;
+			while (firstLevel > 1 && (diff >> GET_BIT_SHIFT(firstLevel - 1)) != 0)
+			{
+				--firstLevel;
+			}
+		}
+
+		for (unsigned char level = firstLevel; level <= MAX_OCTREE_LEVEL; ++level)
+		{
+			unsigned cellCounter = i - cellStart[level];
+			sum2[level] += static_cast<double>(cellCounter) * static_cast<double>(cellCounter);
+			if (maxCellPop[level] < cellCounter)
+				maxCellPop[level] = cellCounter;
+			cellStart[level] = i;
+			++counter[level];
+		}
+	}
+
+	for (unsigned char level = 1; level <= MAX_OCTREE_LEVEL; ++level)
+	{
+		assert(counter[level] > 0);
+		m_cellCount[level] = counter[level];
+		m_maxCellPopulation[level] = maxCellPop[level];
+		m_averageCellPopulation[level] = static_cast<double>(pointCount) / static_cast<double>(counter[level]);
+		m_stdDevCellPopulation[level] = sqrt(sum2[level] / static_cast<double>(counter[level]) - m_averageCellPopulation[level] * m_averageCellPopulation[level]);
 	}
 }
 
@@ -914,10 +1345,18 @@ void DgmOctree::getNeighborCellsAround( const Tuple3i& cellPos,
 	}
 }
 
+inline const CCVector3* DgmOctree::associatedPoint(const CCVector3* points, unsigned index) const
+{
+	return points ? points + index : m_theAssociatedCloud->getPointPersistentPtr(index);
+}
+
 void DgmOctree::getPointsInNeighbourCellsAround(NearestNeighboursSearchStruct &nNSS,
 												int neighbourhoodLength,
 												bool getOnlyPointsWithValidScalar/*=false*/) const
 {
+	//direct access to the points of the associated cloud (if possible)
+	const CCVector3* points = m_theAssociatedCloud->getPointSpans().points();
+
 	assert(neighbourhoodLength >= nNSS.alreadyVisitedNeighbourhoodSize);
 
 	//get distance form cell to octree neighbourhood borders
@@ -968,7 +1407,7 @@ void DgmOctree::getPointsInNeighbourCellsAround(NearestNeighboursSearchStruct &n
 						{
 							if (!getOnlyPointsWithValidScalar || ScalarField::ValidValue(m_theAssociatedCloud->getPointScalarValue(p->theIndex)))
 							{
-								nNSS.pointsInNeighbourhood.emplace_back(m_theAssociatedCloud->getPointPersistentPtr(p->theIndex), p->theIndex);
+								nNSS.pointsInNeighbourhood.emplace_back(associatedPoint(points, p->theIndex), p->theIndex);
 							}
 						}
 					}
@@ -998,7 +1437,7 @@ void DgmOctree::getPointsInNeighbourCellsAround(NearestNeighboursSearchStruct &n
 						{
 							if (!getOnlyPointsWithValidScalar || ScalarField::ValidValue(m_theAssociatedCloud->getPointScalarValue(p->theIndex)))
 							{
-								nNSS.pointsInNeighbourhood.emplace_back(m_theAssociatedCloud->getPointPersistentPtr(p->theIndex), p->theIndex);
+								nNSS.pointsInNeighbourhood.emplace_back(associatedPoint(points, p->theIndex), p->theIndex);
 							}
 						}
 					}
@@ -1025,7 +1464,7 @@ void DgmOctree::getPointsInNeighbourCellsAround(NearestNeighboursSearchStruct &n
 						{
 							if (!getOnlyPointsWithValidScalar || ScalarField::ValidValue(m_theAssociatedCloud->getPointScalarValue(p->theIndex)))
 							{
-								nNSS.pointsInNeighbourhood.emplace_back(m_theAssociatedCloud->getPointPersistentPtr(p->theIndex), p->theIndex);
+								nNSS.pointsInNeighbourhood.emplace_back(associatedPoint(points, p->theIndex), p->theIndex);
 							}
 						}
 					}
@@ -1040,6 +1479,9 @@ void DgmOctree::getPointsInNeighbourCellsAround(NearestNeighboursSphericalSearch
 												int minNeighbourhoodLength,
 												int maxNeighbourhoodLength) const
 {
+	//direct access to the points of the associated cloud (if possible)
+	const CCVector3* points = m_theAssociatedCloud->getPointSpans().points();
+
 	assert(minNeighbourhoodLength >= nNSS.alreadyVisitedNeighbourhoodSize);
 
 	//binary shift for cell code truncation
@@ -1060,7 +1502,7 @@ void DgmOctree::getPointsInNeighbourCellsAround(NearestNeighboursSphericalSearch
 
 			for (cellsContainer::const_iterator p = m_thePointsAndTheirCellCodes.begin()+index; (p != m_thePointsAndTheirCellCodes.end()) && ((p->theCode >> bitDec) == truncatedCellCode); ++p)
 			{
-				PointDescriptor newPoint(m_theAssociatedCloud->getPointPersistentPtr(p->theIndex),p->theIndex);
+				PointDescriptor newPoint(associatedPoint(points, p->theIndex),p->theIndex);
 				nNSS.pointsInSphericalNeighbourhood.push_back(newPoint);
 			}
 		}
@@ -1115,7 +1557,7 @@ void DgmOctree::getPointsInNeighbourCellsAround(NearestNeighboursSphericalSearch
 
 						for (cellsContainer::const_iterator p = m_thePointsAndTheirCellCodes.begin()+index; (p != m_thePointsAndTheirCellCodes.end()) && ((p->theCode >> bitDec) == c2); ++p)
 						{
-							PointDescriptor newPoint(m_theAssociatedCloud->getPointPersistentPtr(p->theIndex),p->theIndex);
+							PointDescriptor newPoint(associatedPoint(points, p->theIndex),p->theIndex);
 							nNSS.pointsInSphericalNeighbourhood.push_back(newPoint);
 						}
 
@@ -1155,7 +1597,7 @@ void DgmOctree::getPointsInNeighbourCellsAround(NearestNeighboursSphericalSearch
 
 						for (cellsContainer::const_iterator p = m_thePointsAndTheirCellCodes.begin()+index; (p != m_thePointsAndTheirCellCodes.end()) && ((p->theCode >> bitDec) == c2); ++p)
 						{
-							PointDescriptor newPoint(m_theAssociatedCloud->getPointPersistentPtr(p->theIndex),p->theIndex);
+							PointDescriptor newPoint(associatedPoint(points, p->theIndex),p->theIndex);
 							nNSS.pointsInSphericalNeighbourhood.push_back(newPoint);
 						}
 
@@ -1195,7 +1637,7 @@ void DgmOctree::getPointsInNeighbourCellsAround(NearestNeighboursSphericalSearch
 
 						for (cellsContainer::const_iterator p = m_thePointsAndTheirCellCodes.begin()+index; (p != m_thePointsAndTheirCellCodes.end()) && ((p->theCode >> bitDec) == c2); ++p)
 						{
-							PointDescriptor newPoint(m_theAssociatedCloud->getPointPersistentPtr(p->theIndex),p->theIndex);
+							PointDescriptor newPoint(associatedPoint(points, p->theIndex),p->theIndex);
 							nNSS.pointsInSphericalNeighbourhood.push_back(newPoint);
 						}
 
@@ -1235,7 +1677,7 @@ void DgmOctree::getPointsInNeighbourCellsAround(NearestNeighboursSphericalSearch
 
 						for (cellsContainer::const_iterator p = m_thePointsAndTheirCellCodes.begin()+index; (p != m_thePointsAndTheirCellCodes.end()) && ((p->theCode >> bitDec) == c2); ++p)
 						{
-							PointDescriptor newPoint(m_theAssociatedCloud->getPointPersistentPtr(p->theIndex),p->theIndex);
+							PointDescriptor newPoint(associatedPoint(points, p->theIndex),p->theIndex);
 							nNSS.pointsInSphericalNeighbourhood.push_back(newPoint);
 						}
 
@@ -1274,7 +1716,7 @@ void DgmOctree::getPointsInNeighbourCellsAround(NearestNeighboursSphericalSearch
 
 						for (cellsContainer::const_iterator p = m_thePointsAndTheirCellCodes.begin()+index; (p != m_thePointsAndTheirCellCodes.end()) && ((p->theCode >> bitDec) == c1); ++p)
 						{
-							PointDescriptor newPoint(m_theAssociatedCloud->getPointPersistentPtr(p->theIndex),p->theIndex);
+							PointDescriptor newPoint(associatedPoint(points, p->theIndex),p->theIndex);
 							nNSS.pointsInSphericalNeighbourhood.push_back(newPoint);
 						}
 
@@ -1313,7 +1755,7 @@ void DgmOctree::getPointsInNeighbourCellsAround(NearestNeighboursSphericalSearch
 
 						for (cellsContainer::const_iterator p = m_thePointsAndTheirCellCodes.begin()+index; (p != m_thePointsAndTheirCellCodes.end()) && ((p->theCode >> bitDec) == c1); ++p)
 						{
-							PointDescriptor newPoint(m_theAssociatedCloud->getPointPersistentPtr(p->theIndex),p->theIndex);
+							PointDescriptor newPoint(associatedPoint(points, p->theIndex),p->theIndex);
 							nNSS.pointsInSphericalNeighbourhood.push_back(newPoint);
 						}
 
@@ -1330,6 +1772,9 @@ void DgmOctree::getPointsInNeighbourCellsAround(NearestNeighboursSphericalSearch
 
 double DgmOctree::findTheNearestNeighborStartingFromCell(NearestNeighboursSearchStruct &nNSS) const
 {
+	//direct access to the points of the associated cloud (if possible)
+	const CCVector3* points = m_theAssociatedCloud->getPointSpans().points();
+
 	//binary shift for cell code truncation
 	unsigned char bitDec = GET_BIT_SHIFT(nNSS.level);
 
@@ -1450,7 +1895,7 @@ double DgmOctree::findTheNearestNeighborStartingFromCell(NearestNeighboursSearch
 			while (m < m_numberOfProjectedPoints && (p->theCode >> bitDec) == code)
 			{
 				//square distance to query point
-				double dist2 = (*m_theAssociatedCloud->getPointPersistentPtr(p->theIndex) - nNSS.queryPoint).norm2d();
+				double dist2 = (*associatedPoint(points, p->theIndex) - nNSS.queryPoint).norm2d();
 				//we keep track of the closest one
 				if (dist2 < minSquareDist || minSquareDist < 0)
 				{
@@ -1496,10 +1941,221 @@ double DgmOctree::findTheNearestNeighborStartingFromCell(NearestNeighboursSearch
 	return -1.0;
 }
 
+DgmOctree::NearestNeighbourKernel DgmOctree::GetBestNearestNeighbourKernel()
+{
+	if (NearestNeighbourKernels::AVX2Supported())
+	{
+		return NN_KERNEL_AVX2;
+	}
+	else if (NearestNeighbourKernels::SSE2Supported())
+	{
+		return NN_KERNEL_SSE2;
+	}
+	return NN_KERNEL_SCALAR;
+}
+
+bool DgmOctree::findTheNearestNeighboursOfCellPoints(	const Tuple3i& cellPos,
+														unsigned char level,
+														const std::vector<CCVector3>& queryPoints,
+														double maxSearchSquareDist,
+														std::vector<double>& squareDists,
+														std::vector<unsigned>& nearestIndexes,
+														NearestNeighbourKernel kernel/*=NN_KERNEL_AUTO*/) const
+{
+	const unsigned queryCount = static_cast<unsigned>(queryPoints.size());
+
+	//kernel
+	if (kernel == NN_KERNEL_AUTO)
+	{
+		kernel = GetBestNearestNeighbourKernel();
+	}
+	using FindNearestFunc = void(*)(const PointCoordinateType*, const PointCoordinateType*, const PointCoordinateType*, unsigned, unsigned, const CCVector3&, double&, unsigned&);
+	FindNearestFunc findNearest = NearestNeighbourKernels::FindNearestScalar;
+	if (kernel == NN_KERNEL_AVX2)
+	{
+		findNearest = NearestNeighbourKernels::FindNearestAVX2;
+	}
+	else if (kernel == NN_KERNEL_SSE2)
+	{
+		findNearest = NearestNeighbourKernels::FindNearestSSE2;
+	}
+
+	//binary shift for cell code truncation
+	const unsigned char bitDec = GET_BIT_SHIFT(level);
+
+	//cell size at the current level of subdivision
+	const PointCoordinateType& cs = getCellSize(level);
+
+	CCVector3 cellCenter;
+	computeCellCenter(cellPos, level, cellCenter);
+
+	//candidates (structure of arrays)
+	std::vector<PointCoordinateType> xs;
+	std::vector<PointCoordinateType> ys;
+	std::vector<PointCoordinateType> zs;
+	std::vector<unsigned> candidateIndexes;
+	//query points for which the nearest neighbour is not certain yet
+	std::vector<unsigned> pendingQueries;
+	//position of the nearest candidate of each query point
+	std::vector<unsigned> nearestPos;
+	//radius of the biggest sphere centered on each query point and included in the cell
+	std::vector<PointCoordinateType> minDistToBorder;
+	cellIndexesContainer shellCells;
+
+	//direct access to the coordinates of the associated cloud (if possible)
+	PointSpans spans = m_theAssociatedCloud->getPointSpans();
+
+	try
+	{
+		squareDists.resize(queryCount);
+		nearestIndexes.resize(queryCount);
+		pendingQueries.resize(queryCount);
+		nearestPos.resize(queryCount);
+		minDistToBorder.resize(queryCount);
+	}
+	catch (const std::bad_alloc&)
+	{
+		return false;
+	}
+
+	for (unsigned q = 0; q < queryCount; ++q)
+	{
+		squareDists[q] = std::numeric_limits<double>::infinity();
+		nearestIndexes[q] = 0;
+		nearestPos[q] = 0;
+		pendingQueries[q] = q;
+		minDistToBorder[q] = ComputeMinDistanceToCellBorder(queryPoints[q], cs, cellCenter);
+	}
+
+	//the first 'shell' of cells to visit (0 = the cell itself)
+	int shell = 0;
+	CellCode truncatedCellCode = GenerateTruncatedCellCode(cellPos, level);
+	unsigned cellIndex = (truncatedCellCode == INVALID_CELL_CODE ? m_numberOfProjectedPoints : getCellIndex(truncatedCellCode, bitDec));
+	if (cellIndex >= m_numberOfProjectedPoints)
+	{
+		//the cell is empty: we can skip the (empty) shells between this cell and the filled part of the octree
+		const int* fillIndexes = m_fillIndexes + 6 * level;
+		shell = 1;
+		for (int dim = 0; dim < 3; ++dim)
+		{
+			int distToBorder = fillIndexes[dim] - cellPos.u[dim];
+			if (distToBorder < 0)
+			{
+				distToBorder = cellPos.u[dim] - fillIndexes[dim + 3];
+			}
+			shell = std::max(shell, distToBorder);
+		}
+	}
+
+	auto finalizeQuery = [&](unsigned q)
+	{
+		if (std::isinf(squareDists[q]) || (maxSearchSquareDist > 0 && squareDists[q] > maxSearchSquareDist))
+		{
+			squareDists[q] = -1.0;
+		}
+		else
+		{
+			nearestIndexes[q] = candidateIndexes[nearestPos[q]];
+		}
+	};
+
+	//maybe all the query points are already too far?
+	if (maxSearchSquareDist > 0 && shell > 1)
+	{
+		size_t remaining = 0;
+		for (unsigned q : pendingQueries)
+		{
+			double eligibleDist = static_cast<double>(shell - 1) * cs + minDistToBorder[q];
+			if (eligibleDist * eligibleDist >= maxSearchSquareDist)
+			{
+				squareDists[q] = -1.0;
+			}
+			else
+			{
+				pendingQueries[remaining++] = q;
+			}
+		}
+		pendingQueries.resize(remaining);
+	}
+
+	while (!pendingQueries.empty())
+	{
+		//gather the points of the (existing) cells of the current shell
+		unsigned candidateStart = static_cast<unsigned>(xs.size());
+		shellCells.clear();
+		try
+		{
+			if (shell == 0)
+			{
+				shellCells.push_back(cellIndex);
+			}
+			else
+			{
+				getNeighborCellsAround(cellPos, shellCells, shell, level);
+			}
+
+			for (unsigned index : shellCells)
+			{
+				cellsContainer::const_iterator p = m_thePointsAndTheirCellCodes.begin() + index;
+				CellCode code = (p->theCode >> bitDec);
+				for (; p != m_thePointsAndTheirCellCodes.end() && (p->theCode >> bitDec) == code; ++p)
+				{
+					CCVector3 P = (spans.isValid() ? spans.point(p->theIndex) : *m_theAssociatedCloud->getPoint(p->theIndex));
+					xs.push_back(P.x);
+					ys.push_back(P.y);
+					zs.push_back(P.z);
+					candidateIndexes.push_back(p->theIndex);
+				}
+			}
+		}
+		catch (const std::bad_alloc&)
+		{
+			return false;
+		}
+		unsigned candidateStop = static_cast<unsigned>(xs.size());
+
+		//once all the points have been gathered, the nearest neighbours are certain
+		bool allGathered = (candidateStop == m_numberOfProjectedPoints);
+
+		size_t remaining = 0;
+		for (unsigned q : pendingQueries)
+		{
+			if (candidateStop != candidateStart)
+			{
+				findNearest(xs.data(), ys.data(), zs.data(), candidateStart, candidateStop, queryPoints[q], squareDists[q], nearestPos[q]);
+			}
+
+			//radius of the biggest sphere centered on the query point and included in the visited shells
+			//(see findTheNearestNeighborStartingFromCell)
+			double eligibleDist = static_cast<double>(shell) * cs + minDistToBorder[q];
+			double squareEligibleDist = eligibleDist * eligibleDist;
+
+			if (	allGathered
+				||	squareDists[q] <= squareEligibleDist
+				||	(maxSearchSquareDist > 0 && squareEligibleDist >= maxSearchSquareDist) )
+			{
+				finalizeQuery(q);
+			}
+			else
+			{
+				pendingQueries[remaining++] = q;
+			}
+		}
+		pendingQueries.resize(remaining);
+
+		++shell;
+	}
+
+	return true;
+}
+
 //search for at least "minNumberOfNeighbors" points around a query point
 unsigned DgmOctree::findNearestNeighborsStartingFromCell(	NearestNeighboursSearchStruct &nNSS,
 															bool getOnlyPointsWithValidScalar/*=false*/) const
 {
+	//direct access to the points of the associated cloud (if possible)
+	const CCVector3* points = m_theAssociatedCloud->getPointSpans().points();
+
 	//binary shift for cell code truncation
 	unsigned char bitDec = GET_BIT_SHIFT(nNSS.level);
 
@@ -1532,7 +2188,7 @@ unsigned DgmOctree::findNearestNeighborsStartingFromCell(	NearestNeighboursSearc
 			{
 				if (!getOnlyPointsWithValidScalar || ScalarField::ValidValue(m_theAssociatedCloud->getPointScalarValue(p->theIndex)))
 				{
-					nNSS.pointsInNeighbourhood.emplace_back(m_theAssociatedCloud->getPointPersistentPtr(p->theIndex), p->theIndex);
+					nNSS.pointsInNeighbourhood.emplace_back(associatedPoint(points, p->theIndex), p->theIndex);
 					++p;
 				}
 			}
@@ -1669,6 +2325,9 @@ int DgmOctree::getPointsInSphericalNeighbourhood(	const CCVector3& sphereCenter,
 													NeighboursSet& neighbours,
 													unsigned char level/*=0*/) const
 {
+	//direct access to the points of the associated cloud (if possible)
+	const CCVector3* points = m_theAssociatedCloud->getPointSpans().points();
+
 	//cell size
 	const PointCoordinateType& cs = getCellSize(level);
 	PointCoordinateType halfCellSize = cs/2;
@@ -1733,7 +2392,7 @@ int DgmOctree::getPointsInSphericalNeighbourhood(	const CCVector3& sphereCenter,
 						//while the (partial) cell code matches this cell
 						for ( ; (p != m_thePointsAndTheirCellCodes.end()) && ((p->theCode >> bitDec) == searchCode); ++p)
 						{
-							const CCVector3* P = m_theAssociatedCloud->getPoint(p->theIndex);
+							const CCVector3* P = associatedPoint(points, p->theIndex);
 							double d2 = (*P - sphereCenter).norm2d();
 							//we keep the points falling inside the sphere
 							if (d2 <= squareRadius)
@@ -2621,11 +3280,22 @@ bool DgmOctree::getPointsInCellByCellIndex( ReferenceCloud* cloud,
 	}
 
 	//while the (partial) cell code matches this cell
-	while ((p != m_thePointsAndTheirCellCodes.end()) && ((p->theCode >> bitDec) == searchCode))
+	cellsContainer::const_iterator q = p;
+	while ((q != m_thePointsAndTheirCellCodes.end()) && ((q->theCode >> bitDec) == searchCode))
 	{
-		if (!cloud->addPointIndex(p->theIndex))
-			return false;
-		++p;
+		++q;
+	}
+
+	//add all the points at once
+	unsigned count = static_cast<unsigned>(q - p);
+	unsigned* indexes = cloud->appendPointIndexSpan(count);
+	if (!indexes)
+	{
+		return false;
+	}
+	for (; p != q; ++p)
+	{
+		*indexes++ = p->theIndex;
 	}
 
 	return true;
@@ -3241,12 +3911,12 @@ DgmOctree::octreeCell::~octreeCell()
 }
 
 #ifdef ENABLE_MT_OCTREE
-void DgmOctree::multiThreadingWrapper::launchOctreeCellFunc(const octreeCellDesc& desc)
+bool DgmOctree::multiThreadingWrapper::launchOctreeCellFunc(const octreeCellDesc& desc)
 {
 	//skip cell if process is aborted/has failed
 	if (!cellFunc_success)
 	{
-		return;
+		return false;
 	}
 
 	const DgmOctree::cellsContainer& pointsAndCodes = octree->pointsAndTheirCellCodes();
@@ -3256,14 +3926,18 @@ void DgmOctree::multiThreadingWrapper::launchOctreeCellFunc(const octreeCellDesc
 	cell.level = desc.level;
 	cell.index = desc.i1;
 	cell.truncatedCode = desc.truncatedCode;
-	if (cell.points->reserve(desc.i2 - desc.i1 + 1))
+	unsigned* indexes = cell.points->appendPointIndexSpan(desc.i2 - desc.i1 + 1);
+	if (indexes)
 	{
 		for (unsigned i = desc.i1; i <= desc.i2; ++i)
 		{
-			cell.points->addPointIndex(pointsAndCodes[i].theIndex);
+			*indexes++ = pointsAndCodes[i].theIndex;
 		}
 
-		cellFunc_success &= (*cell_func)(cell, userParams, normProgressCb);
+		if (!(*cell_func)(cell, userParams, normProgressCb))
+		{
+			cellFunc_success = false;
+		}
 	}
 	else
 	{
@@ -3280,16 +3954,28 @@ void DgmOctree::multiThreadingWrapper::launchOctreeCellFunc(const octreeCellDesc
 				progressCb->setInfo("Cancelling...");
 			}
 		}
+		return false;
+	}
 
-		//if (normProgressCb)
-		//{
-		//	if (!normProgressCb->oneStep())
-		//	{
-		//		cellFunc_success = false;
-		//		return;
-		//	}
-		//}
+	return true;
+}
+
+bool DgmOctree::LaunchOctreeCellFuncs(multiThreadingWrapper& wrapper, const std::vector<octreeCellDesc>& cells, int maxThreadCount)
+{
+	//the cells are batched by population (and idle threads steal the remaining batches of the others)
+	TaskScheduler scheduler(maxThreadCount);
+	bool success = scheduler.run(	static_cast<unsigned>(cells.size()),
+									[&wrapper, &cells](unsigned i) { return wrapper.launchOctreeCellFunc(cells[i]); },
+									[&cells](unsigned i) { return cells[i].i2 - cells[i].i1 + 1; },
+									wrapper.progressCb);
+
+	if (!success)
+	{
+		//cancelled by the user (between two batches)
+		wrapper.cellFunc_success = false;
 	}
+
+	return wrapper.cellFunc_success;
 }
 
 #endif
@@ -3307,7 +3993,7 @@ unsigned DgmOctree::executeFunctionForAllCellsAtLevel(	unsigned char level,
 
 #ifdef ENABLE_MT_OCTREE
 
-	//cells that will be processed by QtConcurrent::map
+	//cells that will be processed by the task scheduler
 	const unsigned cellsNumber = getCellNumber(level);
 	std::vector<octreeCellDesc> cells;
 
@@ -3466,17 +4152,12 @@ unsigned DgmOctree::executeFunctionForAllCellsAtLevel(	unsigned char level,
 		//don't forget the last cell!
 		cells.push_back(cellDesc);
 
-		//static wrap
-		m_MT_wrapper.octree = this;
-		m_MT_wrapper.cell_func = func;
-		m_MT_wrapper.userParams = additionalParameters;
-		m_MT_wrapper.cellFunc_success = true;
-		m_MT_wrapper.progressCb = progressCb;
-		if (m_MT_wrapper.normProgressCb)
-		{
-			delete m_MT_wrapper.normProgressCb;
-			m_MT_wrapper.normProgressCb = 0;
-		}
+		//wrapper (specific to this call)
+		multiThreadingWrapper wrapper;
+		wrapper.octree = this;
+		wrapper.cell_func = func;
+		wrapper.userParams = additionalParameters;
+		wrapper.progressCb = progressCb;
 
 		//progress notification
 		if (progressCb)
@@ -3492,7 +4173,7 @@ unsigned DgmOctree::executeFunctionForAllCellsAtLevel(	unsigned char level,
 				progressCb->setInfo(buffer);
 			}
 			progressCb->update(0);
-			m_MT_wrapper.normProgressCb = new NormalizedProgress(progressCb,m_theAssociatedCloud->size());
+			wrapper.normProgressCb = new NormalizedProgress(progressCb,m_theAssociatedCloud->size());
 			progressCb->start();
 		}
 
@@ -3503,12 +4184,7 @@ unsigned DgmOctree::executeFunctionForAllCellsAtLevel(	unsigned char level,
 		s_binarySearchCount = 0.0;
 #endif
 
-		if (maxThreadCount == 0)
-		{
-			maxThreadCount = QThread::idealThreadCount();
-		}
-		QThreadPool::globalInstance()->setMaxThreadCount(maxThreadCount);
-		QtConcurrent::blockingMap(cells, [this](const octreeCellDesc& desc) { m_MT_wrapper.launchOctreeCellFunc(desc); } );
+		LaunchOctreeCellFuncs(wrapper, cells, maxThreadCount);
 
 #ifdef COMPUTE_NN_SEARCH_STATISTICS
 		FILE* fp = fopen("octree_log.txt", "at");
@@ -3525,21 +4201,15 @@ unsigned DgmOctree::executeFunctionForAllCellsAtLevel(	unsigned char level,
 		}
 #endif
 
-		m_MT_wrapper.octree = nullptr;
-		m_MT_wrapper.cell_func = nullptr;
-		m_MT_wrapper.userParams = nullptr;
-
 		if (progressCb)
 		{
 			progressCb->stop();
-			if (m_MT_wrapper.normProgressCb)
-				delete m_MT_wrapper.normProgressCb;
-			m_MT_wrapper.normProgressCb = nullptr;
-			m_MT_wrapper.progressCb = nullptr;
 		}
+		delete wrapper.normProgressCb;
+		wrapper.normProgressCb = nullptr;
 
 		//if something went wrong, we clear everything and return 0!
-		if (!m_MT_wrapper.cellFunc_success)
+		if (!wrapper.cellFunc_success)
 			cells.clear();
 
 		return static_cast<unsigned>(cells.size());
@@ -3568,7 +4238,7 @@ unsigned DgmOctree::executeFunctionForAllCellsStartingAtLevel(unsigned char star
 
 #ifdef ENABLE_MT_OCTREE
 
-	//cells that will be processed by QtConcurrent::map
+	//cells that will be processed by the task scheduler
 	std::vector<octreeCellDesc> cells;
 	if (multiThread)
 	{
@@ -3794,9 +4464,15 @@ unsigned DgmOctree::executeFunctionForAllCellsStartingAtLevel(unsigned char star
 			break;
 			}
 			*/
+			unsigned* indexes = cell.points->appendPointIndexSpan(elements);
+			if (!indexes) //not enough memory
+			{
+				result = false;
+				break;
+			}
 			for (unsigned i = 0; i < elements; ++i)
 			{
-				cell.points->addPointIndex((startingElement++)->theIndex);
+				*indexes++ = (startingElement++)->theIndex;
 			}
 
 			//call user method on current cell
@@ -4015,14 +4691,12 @@ unsigned DgmOctree::executeFunctionForAllCellsStartingAtLevel(unsigned char star
 		double mean = static_cast<double>(popSum) / cells.size();
 		double stddev = sqrt(static_cast<double>(popSum2 - popSum*popSum)) / cells.size();
 
-		//static wrap
-		m_MT_wrapper.octree = this;
-		m_MT_wrapper.cell_func = func;
-		m_MT_wrapper.userParams = additionalParameters;
-		m_MT_wrapper.cellFunc_success = true;
-		if (m_MT_wrapper.normProgressCb)
-			delete m_MT_wrapper.normProgressCb;
-		m_MT_wrapper.normProgressCb = nullptr;
+		//wrapper (specific to this call)
+		multiThreadingWrapper wrapper;
+		wrapper.octree = this;
+		wrapper.cell_func = func;
+		wrapper.userParams = additionalParameters;
+		wrapper.progressCb = progressCb;
 
 		//progress notification
 		if (progressCb)
@@ -4037,11 +4711,7 @@ unsigned DgmOctree::executeFunctionForAllCellsStartingAtLevel(unsigned char star
 				sprintf(buffer, "Octree levels %i - %i\nCells: %i\nAverage population: %3.2f (+/-%3.2f)\nMax population: %llu", startingLevel, MAX_OCTREE_LEVEL, static_cast<int>(cells.size()), mean, stddev, maxPop);
 				progressCb->setInfo(buffer);
 			}
-			if (m_MT_wrapper.normProgressCb)
-			{
-				delete m_MT_wrapper.normProgressCb;
-			}
-			m_MT_wrapper.normProgressCb = new NormalizedProgress(progressCb,static_cast<unsigned>(cells.size()));
+			wrapper.normProgressCb = new NormalizedProgress(progressCb,static_cast<unsigned>(cells.size()));
 			progressCb->update(0);
 			progressCb->start();
 		}
@@ -4053,12 +4723,7 @@ unsigned DgmOctree::executeFunctionForAllCellsStartingAtLevel(unsigned char star
 		s_binarySearchCount = 0.0;
 #endif
 
-		if (maxThreadCount == 0)
-		{
-			maxThreadCount = QThread::idealThreadCount();
-		}
-		QThreadPool::globalInstance()->setMaxThreadCount(maxThreadCount);
-		QtConcurrent::blockingMap(cells, [this](const octreeCellDesc& desc) { m_MT_wrapper.launchOctreeCellFunc(desc); } );
+		LaunchOctreeCellFuncs(wrapper, cells, maxThreadCount);
 
 #ifdef COMPUTE_NN_SEARCH_STATISTICS
 		FILE* fp=fopen("octree_log.txt","at");
@@ -4075,20 +4740,15 @@ unsigned DgmOctree::executeFunctionForAllCellsStartingAtLevel(unsigned char star
 		}
 #endif
 
-		m_MT_wrapper.octree = nullptr;
-		m_MT_wrapper.cell_func = nullptr;
-		m_MT_wrapper.userParams = nullptr;
-
 		if (progressCb)
 		{
 			progressCb->stop();
-			if (m_MT_wrapper.normProgressCb)
-				delete m_MT_wrapper.normProgressCb;
-			m_MT_wrapper.normProgressCb = nullptr;
 		}
+		delete wrapper.normProgressCb;
+		wrapper.normProgressCb = nullptr;
 
 		//if something went wrong, we clear everything and return 0!
-		if (!m_MT_wrapper.cellFunc_success)
+		if (!wrapper.cellFunc_success)
 			cells.resize(0);
 
 		return static_cast<unsigned>(cells.size());
@@ -457,8 +457,83 @@ bool DistanceComputationTools::computeCellHausdorffDistance(const DgmOctree::oct
 	//and we deduce its center
 	referenceOctree->computeCellCenter(nNSS.cellPos, cell.level, nNSS.cellCenter);
 
-	//for each point of the current cell (compared octree) we look for its nearest neighbour in the reference cloud
 	unsigned pointCount = cell.points->size();
+
+	if (params->batchedNNSearch)
+	{
+		//we process all the points of the current cell together
+		std::vector<CCVector3> queryPoints;
+		std::vector<unsigned> queryPositions;
+		std::vector<double> squareDists;
+		std::vector<unsigned> nearestIndexes;
+		try
+		{
+			queryPoints.reserve(pointCount);
+			queryPositions.reserve(pointCount);
+		}
+		catch (const std::bad_alloc&)
+		{
+			//not enough memory
+			return false;
+		}
+
+		for (unsigned i = 0; i < pointCount; i++)
+		{
+			const CCVector3* P = cell.points->getPoint(i);
+			if (params->CPSet || referenceCloud->testVisibility(*P) == POINT_VISIBLE) //to build the closest point set up we must process the point whatever its visibility is!
+			{
+				queryPoints.push_back(*P);
+				queryPositions.push_back(i);
+			}
+			else
+			{
+				cell.points->setPointScalarValue(i, NAN_VALUE);
+			}
+		}
+
+		if (!referenceOctree->findTheNearestNeighboursOfCellPoints(nNSS.cellPos, cell.level, queryPoints, *maxSearchSquareDistd, squareDists, nearestIndexes, params->nnKernel))
+		{
+			//not enough memory
+			return false;
+		}
+
+		for (size_t k = 0; k < queryPositions.size(); ++k)
+		{
+			if (squareDists[k] >= 0)
+			{
+				unsigned i = queryPositions[k];
+				ScalarType dist = static_cast<ScalarType>(sqrt(squareDists[k]));
+				cell.points->setPointScalarValue(i, dist);
+
+				if (params->CPSet)
+				{
+					params->CPSet->setPointIndex(cell.points->getPointGlobalIndex(i), nearestIndexes[k]);
+				}
+
+				if (computeSplitDistances)
+				{
+					CCVector3 P;
+					referenceCloud->getPoint(nearestIndexes[k], P);
+
+					unsigned index = cell.points->getPointGlobalIndex(i);
+					if (params->splitDistances[0])
+						params->splitDistances[0]->setValue(index, static_cast<ScalarType>(queryPoints[k].x - P.x));
+					if (params->splitDistances[1])
+						params->splitDistances[1]->setValue(index, static_cast<ScalarType>(queryPoints[k].y - P.y));
+					if (params->splitDistances[2])
+						params->splitDistances[2]->setValue(index, static_cast<ScalarType>(queryPoints[k].z - P.z));
+				}
+			}
+			else
+			{
+				assert(!params->CPSet);
+			}
+		}
+
+		return (!nProgress || nProgress->steps(pointCount));
+	}
+
+	//for each point of the current cell (compared octree) we look for its nearest neighbour in the reference cloud
 	for (unsigned i = 0; i < pointCount; i++)
 	{
 		cell.points->getPoint(i, nNSS.queryPoint);
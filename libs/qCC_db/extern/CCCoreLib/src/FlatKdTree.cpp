@@ -0,0 +1,822 @@
+// SPDX-License-Identifier: LGPL-2.0-or-later
+// Copyright © CloudCompare Project
+
+#include <FlatKdTree.h>
+
+//local
+#include <CCConst.h>
+#include <GenericIndexedCloud.h>
+#include <GenericProgressCallback.h>
+#include <PointSpans.h>
+#include <TaskScheduler.h>
+
+//system
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+using namespace CCCoreLib;
+
+namespace
+{
+	//! Number of query points processed by each task of the batched searches
+	const unsigned QueriesPerTask = 64;
+
+	//! Squared distance between a query point and a bounding box (0 if the point is inside)
+	/** Computed with the same operations as CCVector3::vdistance2, so that it is never greater
+		than the (computed) distance to any point inside the box.
+	**/
+	inline PointCoordinateType BoxSquareDistance(const CCVector3& bbMin, const CCVector3& bbMax, const PointCoordinateType* Q)
+	{
+		PointCoordinateType d[3];
+		for (unsigned i = 0; i < 3; ++i)
+		{
+			if (Q[i] < bbMin.u[i])
+				d[i] = bbMin.u[i] - Q[i];
+			else if (Q[i] > bbMax.u[i])
+				d[i] = Q[i] - bbMax.u[i];
+			else
+				d[i] = 0;
+		}
+		return (d[0] * d[0]) + (d[1] * d[1]) + (d[2] * d[2]);
+	}
+
+	//! Squared distance between a query point and the farthest corner of a bounding box
+	inline PointCoordinateType BoxMaxSquareDistance(const CCVector3& bbMin, const CCVector3& bbMax, const PointCoordinateType* Q)
+	{
+		PointCoordinateType d[3];
+		for (unsigned i = 0; i < 3; ++i)
+		{
+			d[i] = std::max(std::abs(Q[i] - bbMin.u[i]), std::abs(Q[i] - bbMax.u[i]));
+		}
+		return (d[0] * d[0]) + (d[1] * d[1]) + (d[2] * d[2]);
+	}
+
+	//! Same as BoxSquareDistance, but the squares are summed in double (radius search)
+	/** Consistent with (P - Q).norm2d() for any point P inside the box.
+	**/
+	inline double BoxSquareDistanced(const CCVector3& bbMin, const CCVector3& bbMax, const PointCoordinateType* Q)
+	{
+		PointCoordinateType d[3];
+		for (unsigned i = 0; i < 3; ++i)
+		{
+			if (Q[i] < bbMin.u[i])
+				d[i] = bbMin.u[i] - Q[i];
+			else if (Q[i] > bbMax.u[i])
+				d[i] = Q[i] - bbMax.u[i];
+			else
+				d[i] = 0;
+		}
+		return CCVector3::vnorm2d(d);
+	}
+
+	//! Same as BoxMaxSquareDistance, but the squares are summed in double (radius search)
+	inline double BoxMaxSquareDistanced(const CCVector3& bbMin, const CCVector3& bbMax, const PointCoordinateType* Q)
+	{
+		PointCoordinateType d[3];
+		for (unsigned i = 0; i < 3; ++i)
+		{
+			d[i] = std::max(std::abs(Q[i] - bbMin.u[i]), std::abs(Q[i] - bbMax.u[i]));
+		}
+		return CCVector3::vnorm2d(d);
+	}
+
+	//! Node to visit (and its distance to the query point)
+	struct StackEntry
+	{
+		unsigned nodeIndex;
+		PointCoordinateType squareDist;
+	};
+}
+
+FlatKdTree::FlatKdTree()
+	: m_associatedCloud(nullptr)
+	, m_leafSize(DefaultLeafSize)
+{
+}
+
+void FlatKdTree::clear()
+{
+	m_nodes.clear();
+	m_nodes.shrink_to_fit();
+	m_points.clear();
+	m_points.shrink_to_fit();
+	m_indexes.clear();
+	m_indexes.shrink_to_fit();
+	m_associatedCloud = nullptr;
+}
+
+unsigned FlatKdTree::SubTreeNodeCount(unsigned pointCount, unsigned leafSize)
+{
+	//the nodes of a given depth only have two possible sizes (s and s+1)
+	unsigned s = pointCount;
+	size_t countS = 1;
+	size_t countS1 = 0;
+	size_t nodeCount = 0;
+
+	while (countS + countS1 != 0)
+	{
+		nodeCount += countS + countS1;
+
+		//the children sizes are s/2 or s/2+1
+		unsigned childS = s / 2;
+		size_t nextCountS = 0;
+		size_t nextCountS1 = 0;
+		auto addChildren = [&](unsigned size, size_t count)
+		{
+			if (size <= leafSize || count == 0)
+				return;
+			unsigned left = size / 2;
+			unsigned right = size - left;
+			(left == childS ? nextCountS : nextCountS1) += count;
+			(right == childS ? nextCountS : nextCountS1) += count;
+		};
+		addChildren(s, countS);
+		addChildren(s + 1, countS1);
+
+		s = childS;
+		countS = nextCountS;
+		countS1 = nextCountS1;
+	}
+
+	return static_cast<unsigned>(nodeCount);
+}
+
+void FlatKdTree::updateBoundingBox(unsigned nodeIndex)
+{
+	Node& node = m_nodes[nodeIndex];
+	assert(!node.isLeaf());
+	const Node& left = m_nodes[nodeIndex + 1];
+	const Node& right = m_nodes[node.right];
+	for (unsigned i = 0; i < 3; ++i)
+	{
+		node.bbMin.u[i] = std::min(left.bbMin.u[i], right.bbMin.u[i]);
+		node.bbMax.u[i] = std::max(left.bbMax.u[i], right.bbMax.u[i]);
+	}
+}
+
+void FlatKdTree::buildSubTree(	BuildPoint* points,
+								const SubTree& subTree,
+								std::vector<SubTree>* pendingSubTrees/*=nullptr*/,
+								unsigned minTaskSize/*=0*/,
+								std::vector<unsigned>* topNodes/*=nullptr*/)
+{
+	if (pendingSubTrees && subTree.count <= minTaskSize)
+	{
+		pendingSubTrees->push_back(subTree);
+		return;
+	}
+
+	Node& node = m_nodes[subTree.nodeIndex];
+	node.first = subTree.first;
+	node.count = subTree.count;
+
+	BuildPoint* begin = points + subTree.first;
+
+	if (subTree.count <= m_leafSize)
+	{
+		//leaf
+		node.right = 0;
+		node.bbMin = node.bbMax = begin[0].P;
+		for (unsigned i = 1; i < subTree.count; ++i)
+		{
+			const CCVector3& P = begin[i].P;
+			for (unsigned j = 0; j < 3; ++j)
+			{
+				node.bbMin.u[j] = std::min(node.bbMin.u[j], P.u[j]);
+				node.bbMax.u[j] = std::max(node.bbMax.u[j], P.u[j]);
+			}
+		}
+		return;
+	}
+
+	//split the largest dimension of the cell at the median
+	CCVector3 diag = subTree.boxMax - subTree.boxMin;
+	unsigned char dim = (diag.x >= diag.y ? (diag.x >= diag.z ? 0 : 2) : (diag.y >= diag.z ? 1 : 2));
+
+	unsigned leftCount = subTree.count / 2;
+	std::nth_element(	begin,
+						begin + leftCount,
+						begin + subTree.count,
+						[dim](const BuildPoint& a, const BuildPoint& b) { return a.P.u[dim] < b.P.u[dim]; });
+	PointCoordinateType split = begin[leftCount].P.u[dim];
+
+	node.right = subTree.nodeIndex + 1 + SubTreeNodeCount(leftCount, m_leafSize);
+
+	SubTree left = subTree;
+	left.nodeIndex = subTree.nodeIndex + 1;
+	left.count = leftCount;
+	left.boxMax.u[dim] = split;
+
+	SubTree right = subTree;
+	right.nodeIndex = node.right;
+	right.first = subTree.first + leftCount;
+	right.count = subTree.count - leftCount;
+	right.boxMin.u[dim] = split;
+
+	if (topNodes)
+	{
+		topNodes->push_back(subTree.nodeIndex);
+	}
+
+	buildSubTree(points, left, pendingSubTrees, minTaskSize, topNodes);
+	buildSubTree(points, right, pendingSubTrees, minTaskSize, topNodes);
+
+	if (!topNodes)
+	{
+		updateBoundingBox(subTree.nodeIndex);
+	}
+}
+
+bool FlatKdTree::buildFromCloud(GenericIndexedCloud* cloud,
+								GenericProgressCallback* progressCb/*=nullptr*/,
+								unsigned leafSize/*=DefaultLeafSize*/,
+								int maxThreadCount/*=0*/)
+{
+	clear();
+
+	if (!cloud || cloud->size() == 0)
+	{
+		return false;
+	}
+	unsigned pointCount = cloud->size();
+	m_leafSize = std::max(leafSize, 1u);
+
+	std::vector<BuildPoint> buildPoints;
+	try
+	{
+		buildPoints.resize(pointCount);
+		m_nodes.resize(SubTreeNodeCount(pointCount, m_leafSize));
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		clear();
+		return false;
+	}
+
+	if (progressCb)
+	{
+		if (progressCb->textCanBeEdited())
+		{
+			progressCb->setInfo("Building KD-tree");
+		}
+		progressCb->update(0);
+		progressCb->start();
+	}
+
+	//copy the points (and compute their bounding box)
+	SubTree root;
+	root.nodeIndex = 0;
+	root.first = 0;
+	root.count = pointCount;
+	{
+		PointSpans spans = cloud->getPointSpans();
+		for (unsigned i = 0; i < pointCount; ++i)
+		{
+			BuildPoint& bp = buildPoints[i];
+			if (spans.isValid())
+				bp.P = spans.point(i);
+			else
+				cloud->getPoint(i, bp.P);
+			bp.index = i;
+		}
+		root.boxMin = root.boxMax = buildPoints[0].P;
+		for (const BuildPoint& bp : buildPoints)
+		{
+			for (unsigned j = 0; j < 3; ++j)
+			{
+				root.boxMin.u[j] = std::min(root.boxMin.u[j], bp.P.u[j]);
+				root.boxMax.u[j] = std::max(root.boxMax.u[j], bp.P.u[j]);
+			}
+		}
+	}
+
+	TaskScheduler scheduler(maxThreadCount);
+	bool success = true;
+	if (scheduler.maxThreadCount() > 1)
+	{
+		//build the top of the tree sequentially, then the (independent) sub-trees in parallel
+		unsigned minTaskSize = std::max(pointCount / (static_cast<unsigned>(scheduler.maxThreadCount()) * TaskScheduler::BatchesPerThread), 4096u);
+		std::vector<SubTree> subTrees;
+		std::vector<unsigned> topNodes;
+		buildSubTree(buildPoints.data(), root, &subTrees, minTaskSize, &topNodes);
+
+		success = scheduler.run(static_cast<unsigned>(subTrees.size()),
+								[&](unsigned taskIndex)
+								{
+									buildSubTree(buildPoints.data(), subTrees[taskIndex]);
+									return true;
+								},
+								[&](unsigned taskIndex)
+								{
+									return subTrees[taskIndex].count;
+								},
+								progressCb);
+
+		//the children are always after their parent
+		for (auto it = topNodes.rbegin(); it != topNodes.rend(); ++it)
+		{
+			updateBoundingBox(*it);
+		}
+	}
+	else
+	{
+		buildSubTree(buildPoints.data(), root);
+	}
+
+	if (success)
+	{
+		try
+		{
+			m_points.resize(pointCount);
+			m_indexes.resize(pointCount);
+		}
+		catch (const std::bad_alloc&)
+		{
+			//not enough memory
+			success = false;
+		}
+	}
+
+	if (progressCb)
+	{
+		progressCb->stop();
+	}
+
+	if (!success)
+	{
+		clear();
+		return false;
+	}
+
+	for (unsigned i = 0; i < pointCount; ++i)
+	{
+		m_points[i] = buildPoints[i].P;
+		m_indexes[i] = buildPoints[i].index;
+	}
+	m_associatedCloud = cloud;
+
+	return true;
+}
+
+bool FlatKdTree::restore(GenericIndexedCloud* cloud,
+						unsigned leafSize,
+						const Node* nodes,
+						unsigned nodeCount,
+						const CCVector3* points,
+						const unsigned* indexes)
+{
+	clear();
+
+	if (!cloud || cloud->size() == 0 || !nodes || !points || !indexes)
+	{
+		return false;
+	}
+	unsigned pointCount = cloud->size();
+	m_leafSize = std::max(leafSize, 1u);
+	if (nodeCount != SubTreeNodeCount(pointCount, m_leafSize))
+	{
+		//incompatible tree
+		return false;
+	}
+
+	//check the nodes and the indexes, as they will be used without any check afterwards
+	for (unsigned i = 0; i < nodeCount; ++i)
+	{
+		const Node& node = nodes[i];
+		if (	static_cast<size_t>(node.first) + node.count > pointCount
+			||	(!node.isLeaf() && (node.right <= i + 1 || node.right >= nodeCount)))
+		{
+			return false;
+		}
+	}
+	for (unsigned i = 0; i < pointCount; ++i)
+	{
+		if (indexes[i] >= pointCount)
+		{
+			return false;
+		}
+	}
+
+	try
+	{
+		m_nodes.assign(nodes, nodes + nodeCount);
+		m_points.assign(points, points + pointCount);
+		m_indexes.assign(indexes, indexes + pointCount);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		clear();
+		return false;
+	}
+	m_associatedCloud = cloud;
+
+	return true;
+}
+
+bool FlatKdTree::findNearestNeighbour(	const PointCoordinateType* queryPoint,
+										unsigned& nearestPointIndex,
+										ScalarType maxDist) const
+{
+	if (m_nodes.empty())
+	{
+		return false;
+	}
+
+	PointCoordinateType maxSquareDist = static_cast<PointCoordinateType>(maxDist) * static_cast<PointCoordinateType>(maxDist);
+	bool found = false;
+
+	StackEntry stack[MaxDepth];
+	unsigned stackSize = 0;
+	stack[stackSize++] = { 0, BoxSquareDistance(m_nodes[0].bbMin, m_nodes[0].bbMax, queryPoint) };
+
+	while (stackSize != 0)
+	{
+		StackEntry entry = stack[--stackSize];
+		if (entry.squareDist >= maxSquareDist)
+		{
+			continue;
+		}
+
+		const Node& node = m_nodes[entry.nodeIndex];
+		if (node.isLeaf())
+		{
+			for (unsigned i = node.first; i < node.first + node.count; ++i)
+			{
+				PointCoordinateType squareDist = CCVector3::vdistance2(m_points[i].u, queryPoint);
+				if (squareDist < maxSquareDist)
+				{
+					maxSquareDist = squareDist;
+					nearestPointIndex = m_indexes[i];
+					found = true;
+				}
+			}
+		}
+		else
+		{
+			//visit the nearest child first
+			unsigned leftIndex = entry.nodeIndex + 1;
+			PointCoordinateType leftDist = BoxSquareDistance(m_nodes[leftIndex].bbMin, m_nodes[leftIndex].bbMax, queryPoint);
+			PointCoordinateType rightDist = BoxSquareDistance(m_nodes[node.right].bbMin, m_nodes[node.right].bbMax, queryPoint);
+			if (leftDist <= rightDist)
+			{
+				stack[stackSize++] = { node.right, rightDist };
+				stack[stackSize++] = { leftIndex, leftDist };
+			}
+			else
+			{
+				stack[stackSize++] = { leftIndex, leftDist };
+				stack[stackSize++] = { node.right, rightDist };
+			}
+		}
+	}
+
+	return found;
+}
+
+bool FlatKdTree::findPointBelowDistance(const PointCoordinateType* queryPoint,
+										ScalarType maxDist) const
+{
+	if (m_nodes.empty())
+	{
+		return false;
+	}
+
+	PointCoordinateType maxSquareDist = static_cast<PointCoordinateType>(maxDist) * static_cast<PointCoordinateType>(maxDist);
+
+	unsigned stack[MaxDepth];
+	unsigned stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize != 0)
+	{
+		unsigned nodeIndex = stack[--stackSize];
+		const Node& node = m_nodes[nodeIndex];
+		if (BoxSquareDistance(node.bbMin, node.bbMax, queryPoint) >= maxSquareDist)
+		{
+			continue;
+		}
+
+		if (node.isLeaf())
+		{
+			for (unsigned i = node.first; i < node.first + node.count; ++i)
+			{
+				if (CCVector3::vdistance2(m_points[i].u, queryPoint) < maxSquareDist)
+				{
+					return true;
+				}
+			}
+		}
+		else
+		{
+			stack[stackSize++] = node.right;
+			stack[stackSize++] = nodeIndex + 1;
+		}
+	}
+
+	return false;
+}
+
+unsigned FlatKdTree::findPointsLyingToDistance(	const PointCoordinateType* queryPoint,
+												ScalarType distance,
+												ScalarType tolerance,
+												std::vector<unsigned>& points) const
+{
+	if (m_nodes.empty())
+	{
+		return 0;
+	}
+
+	PointCoordinateType minDist = static_cast<PointCoordinateType>(distance - tolerance);
+	PointCoordinateType maxDist = static_cast<PointCoordinateType>(distance + tolerance);
+
+	unsigned stack[MaxDepth];
+	unsigned stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize != 0)
+	{
+		unsigned nodeIndex = stack[--stackSize];
+		const Node& node = m_nodes[nodeIndex];
+		if (	std::sqrt(BoxSquareDistance(node.bbMin, node.bbMax, queryPoint)) > maxDist
+			||	std::sqrt(BoxMaxSquareDistance(node.bbMin, node.bbMax, queryPoint)) < minDist)
+		{
+			continue;
+		}
+
+		if (node.isLeaf())
+		{
+			for (unsigned i = node.first; i < node.first + node.count; ++i)
+			{
+				PointCoordinateType dist = CCVector3::vdistance(queryPoint, m_points[i].u);
+				if (minDist <= dist && dist <= maxDist)
+				{
+					points.push_back(m_indexes[i]);
+				}
+			}
+		}
+		else
+		{
+			stack[stackSize++] = node.right;
+			stack[stackSize++] = nodeIndex + 1;
+		}
+	}
+
+	return static_cast<unsigned>(points.size());
+}
+
+unsigned FlatKdTree::findKNearestNeighbours(const PointCoordinateType* queryPoint,
+											unsigned k,
+											unsigned* indexes,
+											ScalarType* squareDistances,
+											ScalarType maxDist/*=0*/) const
+{
+	if (m_nodes.empty() || k == 0)
+	{
+		return 0;
+	}
+
+	PointCoordinateType bound = (maxDist > 0 ? static_cast<PointCoordinateType>(maxDist) * static_cast<PointCoordinateType>(maxDist) : std::numeric_limits<PointCoordinateType>::max());
+	unsigned found = 0;
+
+	StackEntry stack[MaxDepth];
+	unsigned stackSize = 0;
+	stack[stackSize++] = { 0, BoxSquareDistance(m_nodes[0].bbMin, m_nodes[0].bbMax, queryPoint) };
+
+	while (stackSize != 0)
+	{
+		StackEntry entry = stack[--stackSize];
+		if (entry.squareDist > bound)
+		{
+			continue;
+		}
+
+		const Node& node = m_nodes[entry.nodeIndex];
+		if (node.isLeaf())
+		{
+			for (unsigned i = node.first; i < node.first + node.count; ++i)
+			{
+				PointCoordinateType squareDist = CCVector3::vdistance2(m_points[i].u, queryPoint);
+				if (found == k ? squareDist >= bound : squareDist > bound)
+				{
+					continue;
+				}
+
+				//insertion (the neighbours are kept sorted by increasing distance, k being generally small)
+				unsigned pos = (found < k ? found++ : k - 1);
+				while (pos > 0 && squareDistances[pos - 1] > squareDist)
+				{
+					squareDistances[pos] = squareDistances[pos - 1];
+					indexes[pos] = indexes[pos - 1];
+					--pos;
+				}
+				squareDistances[pos] = static_cast<ScalarType>(squareDist);
+				indexes[pos] = m_indexes[i];
+
+				if (found == k)
+				{
+					bound = static_cast<PointCoordinateType>(squareDistances[k - 1]);
+				}
+			}
+		}
+		else
+		{
+			//visit the nearest child first
+			unsigned leftIndex = entry.nodeIndex + 1;
+			PointCoordinateType leftDist = BoxSquareDistance(m_nodes[leftIndex].bbMin, m_nodes[leftIndex].bbMax, queryPoint);
+			PointCoordinateType rightDist = BoxSquareDistance(m_nodes[node.right].bbMin, m_nodes[node.right].bbMax, queryPoint);
+			if (leftDist <= rightDist)
+			{
+				stack[stackSize++] = { node.right, rightDist };
+				stack[stackSize++] = { leftIndex, leftDist };
+			}
+			else
+			{
+				stack[stackSize++] = { leftIndex, leftDist };
+				stack[stackSize++] = { node.right, rightDist };
+			}
+		}
+	}
+
+	return found;
+}
+
+unsigned FlatKdTree::findPointsInSphere(const PointCoordinateType* queryPoint,
+										PointCoordinateType radius,
+										std::vector<unsigned>& indexes,
+										std::vector<ScalarType>* squareDistances/*=nullptr*/) const
+{
+	if (m_nodes.empty())
+	{
+		return 0;
+	}
+
+	size_t initialSize = indexes.size();
+	//same as DgmOctree: the squared distances are compared in double
+	const double squareRadius = static_cast<double>(radius) * static_cast<double>(radius);
+	const CCVector3 Q = CCVector3::fromArray(queryPoint);
+
+	unsigned stack[MaxDepth];
+	unsigned stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize != 0)
+	{
+		unsigned nodeIndex = stack[--stackSize];
+		const Node& node = m_nodes[nodeIndex];
+		if (BoxSquareDistanced(node.bbMin, node.bbMax, queryPoint) > squareRadius)
+		{
+			continue;
+		}
+
+		if (!squareDistances && BoxMaxSquareDistanced(node.bbMin, node.bbMax, queryPoint) <= squareRadius)
+		{
+			//the whole node is inside the sphere
+			indexes.insert(indexes.end(), m_indexes.begin() + node.first, m_indexes.begin() + node.first + node.count);
+		}
+		else if (node.isLeaf())
+		{
+			for (unsigned i = node.first; i < node.first + node.count; ++i)
+			{
+				double squareDist = (m_points[i] - Q).norm2d();
+				if (squareDist <= squareRadius)
+				{
+					indexes.push_back(m_indexes[i]);
+					if (squareDistances)
+					{
+						squareDistances->push_back(static_cast<ScalarType>(squareDist));
+					}
+				}
+			}
+		}
+		else
+		{
+			stack[stackSize++] = node.right;
+			stack[stackSize++] = nodeIndex + 1;
+		}
+	}
+
+	return static_cast<unsigned>(indexes.size() - initialSize);
+}
+
+bool FlatKdTree::findKNearestNeighbours(const CCVector3* queryPoints,
+										unsigned queryCount,
+										unsigned k,
+										std::vector<unsigned>& indexes,
+										std::vector<ScalarType>& squareDistances,
+										ScalarType maxDist/*=0*/,
+										int maxThreadCount/*=0*/,
+										GenericProgressCallback* progressCb/*=nullptr*/) const
+{
+	try
+	{
+		indexes.resize(static_cast<size_t>(queryCount) * k);
+		squareDistances.resize(static_cast<size_t>(queryCount) * k);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return false;
+	}
+
+	unsigned taskCount = (queryCount + QueriesPerTask - 1) / QueriesPerTask;
+	return TaskScheduler(maxThreadCount).run(taskCount,
+		[&](unsigned taskIndex)
+		{
+			unsigned first = taskIndex * QueriesPerTask;
+			unsigned last = std::min(first + QueriesPerTask, queryCount);
+			for (unsigned i = first; i < last; ++i)
+			{
+				unsigned* queryIndexes = indexes.data() + static_cast<size_t>(i) * k;
+				ScalarType* querySquareDistances = squareDistances.data() + static_cast<size_t>(i) * k;
+				unsigned found = findKNearestNeighbours(queryPoints[i].u, k, queryIndexes, querySquareDistances, maxDist);
+				for (unsigned j = found; j < k; ++j)
+				{
+					queryIndexes[j] = InvalidIndex;
+					querySquareDistances[j] = NAN_VALUE;
+				}
+			}
+			return true;
+		},
+		TaskScheduler::CostFunction(),
+		progressCb);
+}
+
+bool FlatKdTree::findPointsInSphere(const CCVector3* queryPoints,
+									unsigned queryCount,
+									PointCoordinateType radius,
+									std::vector<unsigned>& offsets,
+									std::vector<unsigned>& indexes,
+									int maxThreadCount/*=0*/,
+									GenericProgressCallback* progressCb/*=nullptr*/) const
+{
+	indexes.clear();
+
+	unsigned taskCount = (queryCount + QueriesPerTask - 1) / QueriesPerTask;
+	std::vector< std::vector<unsigned> > taskIndexes;
+	try
+	{
+		offsets.resize(static_cast<size_t>(queryCount) + 1);
+		taskIndexes.resize(taskCount);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return false;
+	}
+
+	//each task stores its neighbours in its own container (and the neighbour count of each query point in 'offsets')
+	bool success = TaskScheduler(maxThreadCount).run(taskCount,
+		[&](unsigned taskIndex)
+		{
+			unsigned first = taskIndex * QueriesPerTask;
+			unsigned last = std::min(first + QueriesPerTask, queryCount);
+			try
+			{
+				for (unsigned i = first; i < last; ++i)
+				{
+					offsets[i + 1] = findPointsInSphere(queryPoints[i].u, radius, taskIndexes[taskIndex]);
+				}
+			}
+			catch (const std::bad_alloc&)
+			{
+				//not enough memory
+				return false;
+			}
+			return true;
+		},
+		TaskScheduler::CostFunction(),
+		progressCb);
+
+	if (!success)
+	{
+		return false;
+	}
+
+	offsets[0] = 0;
+	for (unsigned i = 0; i < queryCount; ++i)
+	{
+		offsets[i + 1] += offsets[i];
+	}
+
+	try
+	{
+		indexes.reserve(offsets[queryCount]);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return false;
+	}
+	for (std::vector<unsigned>& neighbours : taskIndexes)
+	{
+		indexes.insert(indexes.end(), neighbours.begin(), neighbours.end());
+		neighbours.clear();
+		neighbours.shrink_to_fit();
+	}
+
+	return true;
+}
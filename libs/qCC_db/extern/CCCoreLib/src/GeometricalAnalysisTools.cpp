@@ -7,13 +7,18 @@
 #include <CCMath.h>
 #include <DgmOctreeReferenceCloud.h>
 #include <DistanceComputationTools.h>
+#include <FlatKdTree.h>
 #include <GenericProgressCallback.h>
+#include <Jacobi.h>
+#include <NeighbourhoodCache.h>
 #include <ReferenceCloud.h>
 #include <ScalarField.h>
 #include <ScalarFieldTools.h>
+#include <TaskScheduler.h>
 
 //system
 #include <algorithm>
+#include <cstdio>
 #include <random>
 
 using namespace CCCoreLib;
@@ -21,13 +26,102 @@ using namespace CCCoreLib;
 //volume of a unit sphere
 static double s_UnitSphereVolume = 4.0 * M_PI / 3.0;
 
+//! Computes a geometric characteristic at a given point from its neighbours
+/** \param c geometric characterstic
+	\param subOption feature / curvature type / local density computation algorithm or nothing (0)
+	\param neighbours neighbours of the point inside the kernel (including the point itself, which may be moved at the end)
+	\param neighborCount number of neighbours
+	\param globalIndex index of the point
+	\param queryPoint point
+	\return the characteristic value (or NAN_VALUE if it can't be computed)
+**/
+static ScalarType ComputeGeomCharacteristic(GeometricalAnalysisTools::GeomCharacteristic c,
+											int subOption,
+											DgmOctree::NeighboursSet& neighbours,
+											unsigned neighborCount,
+											unsigned globalIndex,
+											const CCVector3& queryPoint)
+{
+	ScalarType value = NAN_VALUE;
+
+	switch (c)
+	{
+		case GeometricalAnalysisTools::Feature:
+			if (neighborCount > 3)
+			{
+				DgmOctreeReferenceCloud neighboursCloud(&neighbours, neighborCount);
+				Neighbourhood Z(&neighboursCloud);
+				value = static_cast<ScalarType>(Z.computeFeature(static_cast<Neighbourhood::GeomFeature>(subOption)));
+			}
+			break;
+
+		case GeometricalAnalysisTools::Curvature:
+			if (neighborCount > 5)
+			{
+				DgmOctreeReferenceCloud neighboursCloud(&neighbours, neighborCount);
+				Neighbourhood Z(&neighboursCloud);
+				value = Z.computeCurvature(queryPoint, static_cast<Neighbourhood::CurvatureType>(subOption));
+			}
+			break;
+
+		case GeometricalAnalysisTools::LocalDensity:
+		{
+			value = static_cast<ScalarType>(neighborCount);
+		}
+			break;
+
+		case GeometricalAnalysisTools::Roughness:
+			if (neighborCount > 3)
+			{
+				//find the query point in the nearest neighbors set and place it at the end
+				unsigned localIndex = 0;
+				while (localIndex < neighborCount && neighbours[localIndex].pointIndex != globalIndex)
+				{
+					++localIndex;
+				}
+				//the query point should be in the nearest neighbors set!
+				assert(localIndex < neighborCount);
+				if (localIndex + 1 < neighborCount) //no need to swap with another point if it's already at the end!
+				{
+					std::swap(neighbours[localIndex], neighbours[neighborCount - 1]);
+				}
+
+				DgmOctreeReferenceCloud neighboursCloud(&neighbours, neighborCount - 1); //we don't take the query point into account!
+				Neighbourhood Z(&neighboursCloud);
+				value = Z.computeRoughness(queryPoint);
+
+				//swap the points back to their original position (DGM: not necessary in this case)
+				//if (localIndex+1 < neighborCount)
+				//{
+				//	std::swap(neighbours[localIndex],neighbours[neighborCount-1]);
+				//}
+			}
+			break;
+
+		case GeometricalAnalysisTools::MomentOrder1:
+		{
+			DgmOctreeReferenceCloud neighboursCloud(&neighbours, neighborCount);
+			Neighbourhood Z(&neighboursCloud);
+			value = Z.computeMomentOrder1(queryPoint);
+		}
+			break;
+
+		default:
+			assert(false);
+			break;
+	}
+
+	return value;
+}
+
 GeometricalAnalysisTools::ErrorCode GeometricalAnalysisTools::ComputeCharactersitic(
 		GeomCharacteristic c,
 		int subOption,
 		GenericIndexedCloudPersist* cloud,
 		PointCoordinateType kernelRadius,
 		GenericProgressCallback* progressCb/*=nullptr*/,
-		DgmOctree* inputOctree/*=nullptr*/)
+		DgmOctree* inputOctree/*=nullptr*/,
+		const NeighbourhoodCache* cache/*=nullptr*/)
 {
 	if (!cloud)
 	{
@@ -81,49 +175,84 @@ GeometricalAnalysisTools::ErrorCode GeometricalAnalysisTools::ComputeCharactersi
 			return UnhandledCharacteristic;
 	}
 
-	DgmOctree* octree = inputOctree;
-	if (!octree)
+	ErrorCode result = NoError;
+
+	if (cache && cache->canProvideRadius(cloud, kernelRadius))
 	{
-		//try to build the octree if none was provided
-		octree = new DgmOctree(cloud);
-		if (octree->build(progressCb) < 1)
+		//enable a scalar field for storing the characteristic values
+		cloud->enableScalarField();
+
+		//the neighbours are directly read from the cache
+		if (!cache->forEachPointRange(	[&](unsigned first, unsigned last)
+										{
+											DgmOctree::NeighboursSet neighbours;
+											try
+											{
+												for (unsigned i = first; i < last; ++i)
+												{
+													unsigned neighborCount = cache->getNeighbours(i, cache->countInSphere(i, kernelRadius), neighbours);
+													ScalarType value = ComputeGeomCharacteristic(c, subOption, neighbours, neighborCount, i, *cloud->getPointPersistentPtr(i));
+													cloud->setPointScalarValue(i, value);
+												}
+											}
+											catch (const std::bad_alloc&)
+											{
+												//not enough memory
+												return false;
+											}
+											return true;
+										},
+										progressCb,
+										label.c_str()))
 		{
-			delete octree;
-			return OctreeComputationFailed;
+			//something went wrong
+			result = ProcessFailed;
 		}
 	}
+	else
+	{
+		DgmOctree* octree = inputOctree;
+		if (!octree)
+		{
+			//try to build the octree if none was provided
+			octree = new DgmOctree(cloud);
+			if (octree->build(progressCb) < 1)
+			{
+				delete octree;
+				return OctreeComputationFailed;
+			}
+		}
 
-	//enable a scalar field for storing the characteristic values
-	cloud->enableScalarField();
-
-	//find the best octree leve to perform the computation
-	unsigned char level = octree->findBestLevelForAGivenNeighbourhoodSizeExtraction(kernelRadius);
+		//enable a scalar field for storing the characteristic values
+		cloud->enableScalarField();
 
-	//parameters
-	void* additionalParameters[] =
-	{
-		static_cast<void*>(&c),
-		static_cast<void*>(&subOption),
-		static_cast<void*>(&kernelRadius)
-	};
+		//find the best octree leve to perform the computation
+		unsigned char level = octree->findBestLevelForAGivenNeighbourhoodSizeExtraction(kernelRadius);
 
-	ErrorCode result = NoError;
+		//parameters
+		void* additionalParameters[] =
+		{
+			static_cast<void*>(&c),
+			static_cast<void*>(&subOption),
+			static_cast<void*>(&kernelRadius)
+		};
 
-	if (octree->executeFunctionForAllCellsAtLevel(	level,
-													&ComputeGeomCharacteristicAtLevel,
-													additionalParameters,
-													true,
-													progressCb,
-													label.c_str()) == 0)
-	{
-		//something went wrong
-		result = ProcessFailed;
-	}
+		if (octree->executeFunctionForAllCellsAtLevel(	level,
+														&ComputeGeomCharacteristicAtLevel,
+														additionalParameters,
+														true,
+														progressCb,
+														label.c_str()) == 0)
+		{
+			//something went wrong
+			result = ProcessFailed;
+		}
 
-	if (octree && !inputOctree)
-	{
-		delete octree;
-		octree = nullptr;
+		if (!inputOctree)
+		{
+			delete octree;
+			octree = nullptr;
+		}
 	}
 
 	//we need to finish the work for the Density computation
@@ -163,6 +292,468 @@ GeometricalAnalysisTools::ErrorCode GeometricalAnalysisTools::ComputeCharactersi
 	return result;
 }
 
+//! Moments of a neighbourhood, expressed relatively to the query point (see ComputeCharacteristics)
+/** As the query point is at the origin, it doesn't contribute to the sums: the moments of
+	the neighbourhood without the query point only differ by the number of points.
+**/
+struct RelativeMoments
+{
+	RelativeMoments()
+		: count(0)
+		, sx(0), sy(0), sz(0)
+		, sxx(0), syy(0), szz(0)
+		, sxy(0), sxz(0), syz(0)
+	{}
+
+	//! Adds a point (relatively to the query point)
+	inline void add(const CCVector3d& P)
+	{
+		++count;
+		sx += P.x;
+		sy += P.y;
+		sz += P.z;
+		sxx += P.x * P.x;
+		syy += P.y * P.y;
+		szz += P.z * P.z;
+		sxy += P.x * P.y;
+		sxz += P.x * P.z;
+		syz += P.y * P.z;
+	}
+
+	//! Returns the covariance matrix of the points, assuming there are 'n' of them
+	SquareMatrixd covarianceMatrix(unsigned n) const
+	{
+		assert(n != 0);
+		double mx = sx / n;
+		double my = sy / n;
+		double mz = sz / n;
+
+		SquareMatrixd covMat(3);
+		covMat.m_values[0][0] = sxx / n - mx * mx;
+		covMat.m_values[1][1] = syy / n - my * my;
+		covMat.m_values[2][2] = szz / n - mz * mz;
+		covMat.m_values[1][0] = covMat.m_values[0][1] = sxy / n - mx * my;
+		covMat.m_values[2][0] = covMat.m_values[0][2] = sxz / n - mx * mz;
+		covMat.m_values[2][1] = covMat.m_values[1][2] = syz / n - my * mz;
+
+		return covMat;
+	}
+
+	//! Returns the sum of the squared projections of the points on a given direction
+	inline double squareProjectionSum(const CCVector3d& u) const
+	{
+		return	u.x * u.x * sxx + u.y * u.y * syy + u.z * u.z * szz
+			+	2 * (u.x * u.y * sxy + u.x * u.z * sxz + u.y * u.z * syz);
+	}
+
+	unsigned count;
+	double sx, sy, sz;
+	double sxx, syy, szz, sxy, sxz, syz;
+};
+
+//! Eigen decomposition of a covariance matrix (with the eigenvalues sorted in decreasing order)
+static bool ComputeSortedEigenValuesAndVectors(const SquareMatrixd& covMat, SquareMatrixd& eigVectors, std::vector<double>& eigValues)
+{
+	if (!Jacobi<double>::ComputeEigenValuesAndVectors(covMat, eigVectors, eigValues, true))
+	{
+		return false;
+	}
+	return Jacobi<double>::SortEigenValuesAndVectors(eigVectors, eigValues);
+}
+
+//! Returns whether the 3 neighbours of a point (the first 4 points, including the point itself) are colinear
+static bool AreColinear(GenericIndexedCloudPersist* cloud, const unsigned* indexes, unsigned pointIndex)
+{
+	const CCVector3* P[3] = { nullptr, nullptr, nullptr };
+	unsigned count = 0;
+	bool queryPointSkipped = false;
+	for (unsigned j = 0; j < 4; ++j)
+	{
+		if (!queryPointSkipped && indexes[j] == pointIndex)
+		{
+			queryPointSkipped = true;
+		}
+		else if (count < 3)
+		{
+			P[count++] = cloud->getPointPersistentPtr(indexes[j]);
+		}
+	}
+	assert(count == 3);
+
+	CCVector3 N = (*P[1] - *P[0]).cross(*P[2] - *P[0]);
+	return LessThanEpsilon(N.norm2());
+}
+
+//! Returns the dimensional coefficient of the local density
+static double GetDensityDimensionalCoef(GeometricalAnalysisTools::Density densityType, PointCoordinateType kernelRadius)
+{
+	switch (densityType)
+	{
+		case GeometricalAnalysisTools::DENSITY_2D:
+			return M_PI * pow(kernelRadius, 2.0);
+		case GeometricalAnalysisTools::DENSITY_3D:
+			return s_UnitSphereVolume * pow(kernelRadius, 3.0);
+		default:
+			break;
+	}
+	return 1.0;
+}
+
+GeometricalAnalysisTools::ErrorCode GeometricalAnalysisTools::ComputeCharacteristics(
+		const std::vector<CharacteristicRequest>& requests,
+		GenericIndexedCloudPersist* cloud,
+		GenericProgressCallback* progressCb/*=nullptr*/,
+		const NeighbourhoodCache* cache/*=nullptr*/,
+		const FlatKdTree* kdTree/*=nullptr*/,
+		int maxThreadCount/*=0*/)
+{
+	if (!cloud || requests.empty())
+	{
+		//invalid input
+		return InvalidInput;
+	}
+
+	unsigned numberOfPoints = cloud->size();
+
+	//the requests are grouped by scale (in increasing order)
+	struct KernelScale
+	{
+		PointCoordinateType radius = 0;
+		ScalarType squareRadius = 0;
+		std::vector<size_t> requestIndexes;
+		bool needsEigen = false;		//eigen decomposition of the neighbourhood
+		bool needsPlaneEigen = false;	//eigen decomposition of the neighbourhood without the query point (roughness)
+		bool needsNeighbours = false;	//explicit neighbours (quadric-based curvatures)
+	};
+	std::vector<KernelScale> scales;
+	std::vector<double> densityCoefs(requests.size(), 1.0);
+
+	try
+	{
+		for (size_t i = 0; i < requests.size(); ++i)
+		{
+			const CharacteristicRequest& request = requests[i];
+			if (!request.sf || request.sf->size() < numberOfPoints || request.radius <= 0)
+			{
+				return InvalidInput;
+			}
+
+			switch (request.c)
+			{
+				case Feature:
+				case Curvature:
+				case LocalDensity:
+					if (request.subOption == 0)
+						return InvalidInput;
+					if (numberOfPoints < (request.c == Curvature ? 5u : request.c == Feature ? 4u : 3u))
+						return NotEnoughPoints;
+					break;
+				case Roughness:
+				case MomentOrder1:
+					if (numberOfPoints < 4)
+						return NotEnoughPoints;
+					break;
+				case ApproxLocalDensity:
+					//not based on the points inside a kernel (see ComputeLocalDensityApprox)
+					return UnhandledCharacteristic;
+				default:
+					assert(false);
+					return UnhandledCharacteristic;
+			}
+
+			std::vector<KernelScale>::iterator it = std::find_if(scales.begin(), scales.end(), [&](const KernelScale& s) { return s.radius == request.radius; });
+			if (it == scales.end())
+			{
+				KernelScale scale;
+				scale.radius = request.radius;
+				scale.squareRadius = static_cast<ScalarType>(request.radius * request.radius);
+				it = scales.insert(scales.end(), scale);
+			}
+			it->requestIndexes.push_back(i);
+
+			switch (request.c)
+			{
+				case Feature:
+				case MomentOrder1:
+					it->needsEigen = true;
+					break;
+				case Curvature:
+					if (request.subOption == Neighbourhood::NORMAL_CHANGE_RATE)
+						it->needsEigen = true;
+					else
+						it->needsNeighbours = true;
+					break;
+				case LocalDensity:
+					densityCoefs[i] = GetDensityDimensionalCoef(static_cast<Density>(request.subOption), request.radius);
+					break;
+				case Roughness:
+					it->needsPlaneEigen = true;
+					break;
+				default:
+					break;
+			}
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		return NotEnoughMemory;
+	}
+
+	std::sort(scales.begin(), scales.end(), [](const KernelScale& a, const KernelScale& b) { return a.radius < b.radius; });
+	PointCoordinateType maxRadius = scales.back().radius;
+
+	//computes all the requested characteristics at a given point, from its (sorted) neighbours inside the largest kernel
+	auto processPoint = [&](unsigned pointIndex,
+							const unsigned* indexes,
+							const ScalarType* squareDistances,
+							unsigned neighbourCount,
+							DgmOctree::NeighboursSet& neighbours)
+	{
+		const CCVector3* Q = cloud->getPointPersistentPtr(pointIndex);
+
+		RelativeMoments moments;
+		unsigned neighboursSetSize = 0;
+		SquareMatrixd eigVectors;
+		std::vector<double> eigValues;
+		SquareMatrixd planeEigVectors;
+		std::vector<double> planeEigValues;
+
+		for (const KernelScale& scale : scales)
+		{
+			//the neighbours at this scale are the first ones
+			unsigned n = static_cast<unsigned>(std::upper_bound(squareDistances + moments.count, squareDistances + neighbourCount, scale.squareRadius) - squareDistances);
+
+			//incremental update of the moments
+			for (unsigned j = moments.count; j < n; ++j)
+			{
+				const CCVector3* P = cloud->getPointPersistentPtr(indexes[j]);
+				moments.add(CCVector3d(	static_cast<double>(P->x) - Q->x,
+										static_cast<double>(P->y) - Q->y,
+										static_cast<double>(P->z) - Q->z));
+			}
+
+			bool eigenIsValid = (scale.needsEigen && n >= 3 && ComputeSortedEigenValuesAndVectors(moments.covarianceMatrix(n), eigVectors, eigValues));
+			bool planeEigenIsValid = (scale.needsPlaneEigen && n > 3 && ComputeSortedEigenValuesAndVectors(moments.covarianceMatrix(n - 1), planeEigVectors, planeEigValues));
+
+			if (scale.needsNeighbours && neighboursSetSize < n)
+			{
+				if (neighbours.size() < n)
+				{
+					neighbours.resize(n);
+				}
+				for (; neighboursSetSize < n; ++neighboursSetSize)
+				{
+					unsigned index = indexes[neighboursSetSize];
+					neighbours[neighboursSetSize] = DgmOctree::PointDescriptor(cloud->getPointPersistentPtr(index), index, squareDistances[neighboursSetSize]);
+				}
+			}
+
+			for (size_t requestIndex : scale.requestIndexes)
+			{
+				const CharacteristicRequest& request = requests[requestIndex];
+				ScalarType value = NAN_VALUE;
+
+				switch (request.c)
+				{
+					case Feature:
+						if (n > 3 && eigenIsValid)
+						{
+							value = static_cast<ScalarType>(Neighbourhood::ComputeFeature(static_cast<Neighbourhood::GeomFeature>(request.subOption), eigVectors, eigValues));
+						}
+						break;
+
+					case Curvature:
+						if (n > 5)
+						{
+							if (request.subOption == Neighbourhood::NORMAL_CHANGE_RATE)
+							{
+								if (eigenIsValid)
+								{
+									double sum = eigValues[0] + eigValues[1] + eigValues[2];
+									if (!LessThanEpsilon(sum))
+									{
+										value = static_cast<ScalarType>(eigValues[2] / sum);
+									}
+								}
+							}
+							else
+							{
+								//quadric-based curvatures can't be deduced from the moments
+								DgmOctreeReferenceCloud neighboursCloud(&neighbours, n);
+								Neighbourhood Z(&neighboursCloud);
+								value = Z.computeCurvature(*Q, static_cast<Neighbourhood::CurvatureType>(request.subOption));
+							}
+						}
+						break;
+
+					case LocalDensity:
+						value = static_cast<ScalarType>(n / densityCoefs[requestIndex]);
+						break;
+
+					case Roughness:
+						if (planeEigenIsValid && n == 4 && AreColinear(cloud, indexes, pointIndex))
+						{
+							//same behavior as Neighbourhood::computeLeastSquareBestFittingPlane with 3 points
+							planeEigenIsValid = false;
+						}
+						if (planeEigenIsValid)
+						{
+							//distance from the query point to the LS plane of its neighbours (the plane goes through their centroid)
+							CCVector3d N;
+							Jacobi<double>::GetEigenVector(planeEigVectors, 2, N.u);
+							value = static_cast<ScalarType>(std::abs(moments.sx * N.x + moments.sy * N.y + moments.sz * N.z) / (n - 1));
+						}
+						break;
+
+					case MomentOrder1:
+						if (eigenIsValid)
+						{
+							//see Neighbourhood::computeMomentOrder1
+							CCVector3d e2;
+							Jacobi<double>::GetEigenVector(eigVectors, 1, e2.u);
+							double m1 = moments.sx * e2.x + moments.sy * e2.y + moments.sz * e2.z;
+							double m2 = moments.squareProjectionSum(e2);
+							if (m2 >= std::numeric_limits<double>::epsilon())
+							{
+								value = static_cast<ScalarType>((m1 * m1) / m2);
+							}
+						}
+						break;
+
+					default:
+						assert(false);
+						break;
+				}
+
+				request.sf->setValue(pointIndex, value);
+			}
+		}
+	};
+
+	const char* title = "Geometric characteristics computation";
+	bool success = true;
+
+	if (cache && cache->canProvideRadius(cloud, maxRadius))
+	{
+		//the neighbours are directly read from the cache
+		success = cache->forEachPointRange(	[&](unsigned first, unsigned last)
+											{
+												DgmOctree::NeighboursSet neighbours;
+												try
+												{
+													for (unsigned i = first; i < last; ++i)
+													{
+														processPoint(i, cache->neighbours(i), cache->squareDistances(i), cache->neighbourCount(i), neighbours);
+													}
+												}
+												catch (const std::bad_alloc&)
+												{
+													//not enough memory
+													return false;
+												}
+												return true;
+											},
+											progressCb,
+											title,
+											maxThreadCount);
+	}
+	else
+	{
+		//build a temporary KD-tree if necessary
+		FlatKdTree localKdTree;
+		if (kdTree)
+		{
+			if (kdTree->getAssociatedCloud() != cloud || kdTree->size() != numberOfPoints)
+			{
+				//the KD-tree doesn't match the cloud
+				return InvalidInput;
+			}
+		}
+		else
+		{
+			if (!localKdTree.buildFromCloud(cloud, progressCb, FlatKdTree::DefaultLeafSize, maxThreadCount))
+			{
+				return OctreeComputationFailed;
+			}
+			kdTree = &localKdTree;
+		}
+
+		if (progressCb)
+		{
+			if (progressCb->textCanBeEdited())
+			{
+				progressCb->setMethodTitle(title);
+				char buffer[64];
+				snprintf(buffer, 64, "Points: %u - scales: %zu", numberOfPoints, scales.size());
+				progressCb->setInfo(buffer);
+			}
+			progressCb->update(0);
+			progressCb->start();
+		}
+		NormalizedProgress nProgress(progressCb, numberOfPoints);
+
+		//the points are processed in the KD-tree leaf order (spatially coherent queries)
+		static const unsigned PointsPerTask = 256;
+		unsigned taskCount = (numberOfPoints + PointsPerTask - 1) / PointsPerTask;
+		success = TaskScheduler(maxThreadCount).run(taskCount,
+			[&](unsigned taskIndex)
+			{
+				unsigned first = taskIndex * PointsPerTask;
+				unsigned last = std::min(first + PointsPerTask, numberOfPoints);
+
+				DgmOctree::NeighboursSet neighbours;
+				std::vector<unsigned> indexes;
+				std::vector<ScalarType> squareDistances;
+				std::vector< std::pair<ScalarType, unsigned> > sortedNeighbours;
+				try
+				{
+					for (unsigned j = first; j < last; ++j)
+					{
+						indexes.clear();
+						squareDistances.clear();
+						unsigned count = kdTree->findPointsInSphere(kdTree->points()[j].u, maxRadius, indexes, &squareDistances);
+
+						//sort the neighbours by increasing distance
+						sortedNeighbours.resize(count);
+						for (unsigned k = 0; k < count; ++k)
+						{
+							sortedNeighbours[k] = { squareDistances[k], indexes[k] };
+						}
+						std::sort(sortedNeighbours.begin(), sortedNeighbours.end());
+						for (unsigned k = 0; k < count; ++k)
+						{
+							squareDistances[k] = sortedNeighbours[k].first;
+							indexes[k] = sortedNeighbours[k].second;
+						}
+
+						processPoint(kdTree->pointIndex(j), indexes.data(), squareDistances.data(), count, neighbours);
+					}
+				}
+				catch (const std::bad_alloc&)
+				{
+					//not enough memory
+					return false;
+				}
+
+				return nProgress.steps(last - first);
+			},
+			TaskScheduler::CostFunction(),
+			progressCb);
+
+		if (progressCb)
+		{
+			progressCb->stop();
+		}
+	}
+
+	if (!success)
+	{
+		return (progressCb && progressCb->isCancelRequested() ? ProcessCancelledByUser : ProcessFailed);
+	}
+
+	return NoError;
+}
+
 bool GeometricalAnalysisTools::ComputeGeomCharacteristicAtLevel(const DgmOctree::octreeCell& cell,
 																void** additionalParameters,
 																NormalizedProgress* nProgress/*=0*/)
@@ -211,75 +802,7 @@ bool GeometricalAnalysisTools::ComputeGeomCharacteristicAtLevel(const DgmOctree:
 		//warning: there may be more points at the end of nNSS.pointsInNeighbourhood than the actual nearest neighbors (neighborCount)!
 		unsigned neighborCount = cell.parentOctree->findNeighborsInASphereStartingFromCell(nNSS, radius, false);
 
-		ScalarType value = NAN_VALUE;
-
-		switch (c)
-		{
-			case Feature:
-				if (neighborCount > 3)
-				{
-					DgmOctreeReferenceCloud neighboursCloud(&nNSS.pointsInNeighbourhood, neighborCount);
-					Neighbourhood Z(&neighboursCloud);
-					value = static_cast<ScalarType>(Z.computeFeature(static_cast<Neighbourhood::GeomFeature>(subOption)));
-				}
-				break;
-
-			case Curvature:
-				if (neighborCount > 5)
-				{
-					DgmOctreeReferenceCloud neighboursCloud(&nNSS.pointsInNeighbourhood, neighborCount);
-					Neighbourhood Z(&neighboursCloud);
-					value = Z.computeCurvature(nNSS.queryPoint, static_cast<Neighbourhood::CurvatureType>(subOption));
-				}
-				break;
-
-			case LocalDensity:
-			{
-				value = static_cast<ScalarType>(neighborCount);
-			}
-				break;
-
-			case Roughness:
-				if (neighborCount > 3)
-				{
-					//find the query point in the nearest neighbors set and place it at the end
-					const unsigned globalIndex = cell.points->getPointGlobalIndex(i);
-					unsigned localIndex = 0;
-					while (localIndex < neighborCount && nNSS.pointsInNeighbourhood[localIndex].pointIndex != globalIndex)
-					{
-						++localIndex;
-					}
-					//the query point should be in the nearest neighbors set!
-					assert(localIndex < neighborCount);
-					if (localIndex + 1 < neighborCount) //no need to swap with another point if it's already at the end!
-					{
-						std::swap(nNSS.pointsInNeighbourhood[localIndex], nNSS.pointsInNeighbourhood[neighborCount - 1]);
-					}
-
-					DgmOctreeReferenceCloud neighboursCloud(&nNSS.pointsInNeighbourhood, neighborCount - 1); //we don't take the query point into account!
-					Neighbourhood Z(&neighboursCloud);
-					value = Z.computeRoughness(nNSS.queryPoint);
-
-					//swap the points back to their original position (DGM: not necessary in this case)
-					//if (localIndex+1 < neighborCount)
-					//{
-					//	std::swap(nNSS.pointsInNeighbourhood[localIndex],nNSS.pointsInNeighbourhood[neighborCount-1]);
-					//}
-				}
-				break;
-
-			case MomentOrder1:
-			{
-				DgmOctreeReferenceCloud neighboursCloud(&nNSS.pointsInNeighbourhood, neighborCount);
-				Neighbourhood Z(&neighboursCloud);
-				value = Z.computeMomentOrder1(nNSS.queryPoint);
-			}
-				break;
-
-			default:
-				assert(false);
-				return false;
-		}
+		ScalarType value = ComputeGeomCharacteristic(c, subOption, nNSS.pointsInNeighbourhood, neighborCount, cell.points->getPointGlobalIndex(i), nNSS.queryPoint);
 
 		cell.points->setPointScalarValue(i, value);
 
@@ -537,11 +1060,29 @@ CCVector3 GeometricalAnalysisTools::ComputeGravityCenter(GenericCloud* cloud)
 
 	CCVector3d sum(0, 0, 0);
 
-	cloud->placeIteratorAtBeginning();
-	const CCVector3 *P = nullptr;
-	while ((P = cloud->getNextPoint()))
+	GenericIndexedCloud* indexedCloud = dynamic_cast<GenericIndexedCloud*>(cloud);
+	PointSpans spans = (indexedCloud ? indexedCloud->getPointSpans() : PointSpans());
+	if (spans.isValid() && spans.size() == count)
+	{
+		//direct access to the coordinates (no virtual call per point)
+		const StridedSpan<const PointCoordinateType>& xs = spans.x();
+		const StridedSpan<const PointCoordinateType>& ys = spans.y();
+		const StridedSpan<const PointCoordinateType>& zs = spans.z();
+		for (unsigned i = 0; i < count; ++i)
+		{
+			sum.x += xs[i];
+			sum.y += ys[i];
+			sum.z += zs[i];
+		}
+	}
+	else
 	{
-		sum += CCVector3d::fromArray(P->u);
+		cloud->placeIteratorAtBeginning();
+		const CCVector3 *P = nullptr;
+		while ((P = cloud->getNextPoint()))
+		{
+			sum += CCVector3d::fromArray(P->u);
+		}
 	}
 
 	sum /= static_cast<double>(count);
@@ -8,8 +8,10 @@
 #include <PointCloud.h>
 #include <Polyline.h>
 #include <SimpleMesh.h>
+#include <TaskScheduler.h>
 
 //system
+#include <algorithm>
 #include <cstdint>
 #include <map>
 
@@ -22,36 +24,67 @@ ReferenceCloud* ManualSegmentationTools::segment(GenericIndexedCloudPersist* aCl
 
 	SquareMatrix* trans = (viewMat ? new SquareMatrix(viewMat) : nullptr);
 
-	ReferenceCloud* Y = new ReferenceCloud(aCloud);
-
 	//we check for each point if it falls inside the polyline
+	//(in parallel, by chunks: each chunk has its own index builder)
+	static const unsigned ChunkSize = (1 << 16);
 	unsigned count = aCloud->size();
-	for (unsigned i = 0; i < count; ++i)
+	unsigned chunkCount = (count + ChunkSize - 1) / ChunkSize;
+
+	ReferenceCloud* Y = new ReferenceCloud(aCloud);
+	std::vector<ReferenceCloud::IndexBuilder> builders;
+	try
+	{
+		builders.resize(chunkCount);
+	}
+	catch (const std::bad_alloc&)
 	{
-		CCVector3 P;
-		aCloud->getPoint(i, P);
+		//not enough memory
+		delete trans;
+		delete Y;
+		return nullptr;
+	}
 
-		//we project the point in screen space first if necessary
-		if (trans)
-		{
-			P = (*trans) * P;
-		}
+	bool success = TaskScheduler().run(chunkCount, [&](unsigned chunkIndex)
+	{
+		unsigned first = chunkIndex * ChunkSize;
+		unsigned last = std::min(first + ChunkSize, count);
+		ReferenceCloud::IndexBuilder& builder = builders[chunkIndex];
 
-		bool pointInside = isPointInsidePoly(CCVector2(P.x, P.y), poly);
-		if ((keepInside && pointInside) || (!keepInside && !pointInside))
+		for (unsigned i = first; i < last; ++i)
 		{
-			if (!Y->addPointIndex(i))
+			CCVector3 P;
+			aCloud->getPoint(i, P);
+
+			//we project the point in screen space first if necessary
+			if (trans)
 			{
-				//not enough memory
-				delete Y;
-				Y = nullptr;
-				break;
+				P = (*trans) * P;
+			}
+
+			bool pointInside = isPointInsidePoly(CCVector2(P.x, P.y), poly);
+			if ((keepInside && pointInside) || (!keepInside && !pointInside))
+			{
+				if (!builder.add(i))
+				{
+					//not enough memory
+					return false;
+				}
 			}
 		}
-	}
+
+		return true;
+	});
 
 	delete trans;
 
+	//the points are added in the same order as the sequential version
+	if (!success || !Y->addPointIndexes(builders))
+	{
+		//not enough memory
+		delete Y;
+		Y = nullptr;
+	}
+
 	return Y;
 }
 
@@ -0,0 +1,323 @@
+// SPDX-License-Identifier: LGPL-2.0-or-later
+// Copyright © CloudCompare Project
+
+#include "NearestNeighbourKernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+//SIMD kernels (x86 only)
+#define CC_NN_KERNELS_X86
+
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+//the SIMD kernels are compiled for their own instruction set (the CPU support is checked at runtime)
+//FMA must NOT be enabled here (the results would differ from the scalar version)
+#if defined(__GNUC__) || defined(__clang__)
+#define CC_NN_TARGET_SSE2 __attribute__((target("sse2")))
+#define CC_NN_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CC_NN_TARGET_SSE2
+#define CC_NN_TARGET_AVX2
+#endif
+#endif
+
+using namespace CCCoreLib;
+
+void NearestNeighbourKernels::FindNearestScalar(const PointCoordinateType* xs,
+												const PointCoordinateType* ys,
+												const PointCoordinateType* zs,
+												unsigned start,
+												unsigned stop,
+												const CCVector3& Q,
+												double& minSquareDist,
+												unsigned& nearestPos)
+{
+	for (unsigned i = start; i < stop; ++i)
+	{
+		//same computation as '(P - Q).norm2d()'
+		PointCoordinateType dx = xs[i] - Q.x;
+		PointCoordinateType dy = ys[i] - Q.y;
+		PointCoordinateType dz = zs[i] - Q.z;
+		double squareDist = static_cast<double>(dx) * dx + static_cast<double>(dy) * dy + static_cast<double>(dz) * dz;
+		if (squareDist < minSquareDist)
+		{
+			minSquareDist = squareDist;
+			nearestPos = i;
+		}
+	}
+}
+
+#ifdef CC_NN_KERNELS_X86
+
+namespace
+{
+	//! Reduces the per-lane results (the first candidate is kept in case of equidistant candidates)
+	void ReduceLanes(const double* laneDists, const double* lanePos, unsigned laneCount, double& minSquareDist, unsigned& nearestPos)
+	{
+		double bestDist = minSquareDist;
+		double bestPos = -1.0;
+		for (unsigned l = 0; l < laneCount; ++l)
+		{
+			//lanes that have never been updated have a negative position
+			if (lanePos[l] >= 0 && (laneDists[l] < bestDist || (laneDists[l] == bestDist && lanePos[l] < bestPos)))
+			{
+				bestDist = laneDists[l];
+				bestPos = lanePos[l];
+			}
+		}
+
+		if (bestPos >= 0)
+		{
+			minSquareDist = bestDist;
+			nearestPos = static_cast<unsigned>(bestPos);
+		}
+	}
+
+	//! Returns whether the CPU (and the OS) support the AVX2 instructions
+	bool CPUSupportsAVX2()
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") != 0;
+#elif defined(_MSC_VER)
+		int regs[4] = { 0, 0, 0, 0 };
+		__cpuid(regs, 0);
+		if (regs[0] < 7)
+		{
+			return false;
+		}
+		__cpuid(regs, 1);
+		bool osUsesXSave = ((regs[2] & (1 << 27)) != 0);
+		bool cpuHasAVX = ((regs[2] & (1 << 28)) != 0);
+		if (!osUsesXSave || !cpuHasAVX)
+		{
+			return false;
+		}
+		//the OS must save the YMM registers
+		if ((_xgetbv(0) & 0x6) != 0x6)
+		{
+			return false;
+		}
+		__cpuidex(regs, 7, 0);
+		return ((regs[1] & (1 << 5)) != 0);
+#else
+		return false;
+#endif
+	}
+
+	//! Returns whether the CPU supports the SSE2 instructions
+	bool CPUSupportsSSE2()
+	{
+#if defined(__x86_64__) || defined(_M_X64)
+		//always available on x86-64
+		return true;
+#elif defined(__GNUC__) || defined(__clang__)
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("sse2") != 0;
+#elif defined(_MSC_VER)
+		int regs[4] = { 0, 0, 0, 0 };
+		__cpuid(regs, 1);
+		return ((regs[3] & (1 << 26)) != 0);
+#else
+		return false;
+#endif
+	}
+
+	CC_NN_TARGET_SSE2 void FindNearestSSE2Impl(	const PointCoordinateType* xs,
+												const PointCoordinateType* ys,
+												const PointCoordinateType* zs,
+												unsigned start,
+												unsigned stop,
+												const CCVector3& Q,
+												double& minSquareDist,
+												unsigned& nearestPos)
+	{
+		unsigned vectorStop = start + ((stop - start) & ~3u);
+		if (vectorStop != start)
+		{
+			const __m128 qx = _mm_set1_ps(Q.x);
+			const __m128 qy = _mm_set1_ps(Q.y);
+			const __m128 qz = _mm_set1_ps(Q.z);
+
+			__m128d bestLo = _mm_set1_pd(minSquareDist);
+			__m128d bestHi = bestLo;
+			__m128d posLo = _mm_set1_pd(-1.0);
+			__m128d posHi = posLo;
+			__m128d indexLo = _mm_set_pd(start + 1.0, static_cast<double>(start));
+			__m128d indexHi = _mm_set_pd(start + 3.0, start + 2.0);
+			const __m128d four = _mm_set1_pd(4.0);
+
+			for (unsigned i = start; i < vectorStop; i += 4)
+			{
+				__m128 dx = _mm_sub_ps(_mm_loadu_ps(xs + i), qx);
+				__m128 dy = _mm_sub_ps(_mm_loadu_ps(ys + i), qy);
+				__m128 dz = _mm_sub_ps(_mm_loadu_ps(zs + i), qz);
+
+				//lower half
+				{
+					__m128d dxd = _mm_cvtps_pd(dx);
+					__m128d dyd = _mm_cvtps_pd(dy);
+					__m128d dzd = _mm_cvtps_pd(dz);
+					__m128d d2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dxd, dxd), _mm_mul_pd(dyd, dyd)), _mm_mul_pd(dzd, dzd));
+					__m128d closer = _mm_cmplt_pd(d2, bestLo);
+					bestLo = _mm_or_pd(_mm_and_pd(closer, d2), _mm_andnot_pd(closer, bestLo));
+					posLo = _mm_or_pd(_mm_and_pd(closer, indexLo), _mm_andnot_pd(closer, posLo));
+				}
+				//upper half
+				{
+					__m128d dxd = _mm_cvtps_pd(_mm_movehl_ps(dx, dx));
+					__m128d dyd = _mm_cvtps_pd(_mm_movehl_ps(dy, dy));
+					__m128d dzd = _mm_cvtps_pd(_mm_movehl_ps(dz, dz));
+					__m128d d2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dxd, dxd), _mm_mul_pd(dyd, dyd)), _mm_mul_pd(dzd, dzd));
+					__m128d closer = _mm_cmplt_pd(d2, bestHi);
+					bestHi = _mm_or_pd(_mm_and_pd(closer, d2), _mm_andnot_pd(closer, bestHi));
+					posHi = _mm_or_pd(_mm_and_pd(closer, indexHi), _mm_andnot_pd(closer, posHi));
+				}
+
+				indexLo = _mm_add_pd(indexLo, four);
+				indexHi = _mm_add_pd(indexHi, four);
+			}
+
+			double laneDists[4];
+			double lanePos[4];
+			_mm_storeu_pd(laneDists, bestLo);
+			_mm_storeu_pd(laneDists + 2, bestHi);
+			_mm_storeu_pd(lanePos, posLo);
+			_mm_storeu_pd(lanePos + 2, posHi);
+			ReduceLanes(laneDists, lanePos, 4, minSquareDist, nearestPos);
+		}
+
+		//remaining candidates
+		NearestNeighbourKernels::FindNearestScalar(xs, ys, zs, vectorStop, stop, Q, minSquareDist, nearestPos);
+	}
+
+	CC_NN_TARGET_AVX2 void FindNearestAVX2Impl(	const PointCoordinateType* xs,
+												const PointCoordinateType* ys,
+												const PointCoordinateType* zs,
+												unsigned start,
+												unsigned stop,
+												const CCVector3& Q,
+												double& minSquareDist,
+												unsigned& nearestPos)
+	{
+		unsigned vectorStop = start + ((stop - start) & ~7u);
+		if (vectorStop != start)
+		{
+			const __m256 qx = _mm256_set1_ps(Q.x);
+			const __m256 qy = _mm256_set1_ps(Q.y);
+			const __m256 qz = _mm256_set1_ps(Q.z);
+
+			__m256d bestLo = _mm256_set1_pd(minSquareDist);
+			__m256d bestHi = bestLo;
+			__m256d posLo = _mm256_set1_pd(-1.0);
+			__m256d posHi = posLo;
+			__m256d indexLo = _mm256_set_pd(start + 3.0, start + 2.0, start + 1.0, static_cast<double>(start));
+			__m256d indexHi = _mm256_set_pd(start + 7.0, start + 6.0, start + 5.0, start + 4.0);
+			const __m256d eight = _mm256_set1_pd(8.0);
+
+			for (unsigned i = start; i < vectorStop; i += 8)
+			{
+				__m256 dx = _mm256_sub_ps(_mm256_loadu_ps(xs + i), qx);
+				__m256 dy = _mm256_sub_ps(_mm256_loadu_ps(ys + i), qy);
+				__m256 dz = _mm256_sub_ps(_mm256_loadu_ps(zs + i), qz);
+
+				//lower half
+				{
+					__m256d dxd = _mm256_cvtps_pd(_mm256_castps256_ps128(dx));
+					__m256d dyd = _mm256_cvtps_pd(_mm256_castps256_ps128(dy));
+					__m256d dzd = _mm256_cvtps_pd(_mm256_castps256_ps128(dz));
+					__m256d d2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dxd, dxd), _mm256_mul_pd(dyd, dyd)), _mm256_mul_pd(dzd, dzd));
+					__m256d closer = _mm256_cmp_pd(d2, bestLo, _CMP_LT_OQ);
+					bestLo = _mm256_blendv_pd(bestLo, d2, closer);
+					posLo = _mm256_blendv_pd(posLo, indexLo, closer);
+				}
+				//upper half
+				{
+					__m256d dxd = _mm256_cvtps_pd(_mm256_extractf128_ps(dx, 1));
+					__m256d dyd = _mm256_cvtps_pd(_mm256_extractf128_ps(dy, 1));
+					__m256d dzd = _mm256_cvtps_pd(_mm256_extractf128_ps(dz, 1));
+					__m256d d2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dxd, dxd), _mm256_mul_pd(dyd, dyd)), _mm256_mul_pd(dzd, dzd));
+					__m256d closer = _mm256_cmp_pd(d2, bestHi, _CMP_LT_OQ);
+					bestHi = _mm256_blendv_pd(bestHi, d2, closer);
+					posHi = _mm256_blendv_pd(posHi, indexHi, closer);
+				}
+
+				indexLo = _mm256_add_pd(indexLo, eight);
+				indexHi = _mm256_add_pd(indexHi, eight);
+			}
+
+			double laneDists[8];
+			double lanePos[8];
+			_mm256_storeu_pd(laneDists, bestLo);
+			_mm256_storeu_pd(laneDists + 4, bestHi);
+			_mm256_storeu_pd(lanePos, posLo);
+			_mm256_storeu_pd(lanePos + 4, posHi);
+			ReduceLanes(laneDists, lanePos, 8, minSquareDist, nearestPos);
+		}
+
+		//remaining candidates
+		NearestNeighbourKernels::FindNearestScalar(xs, ys, zs, vectorStop, stop, Q, minSquareDist, nearestPos);
+	}
+}
+
+#endif //CC_NN_KERNELS_X86
+
+bool NearestNeighbourKernels::SSE2Supported()
+{
+#ifdef CC_NN_KERNELS_X86
+	static const bool s_supported = CPUSupportsSSE2();
+	return s_supported;
+#else
+	return false;
+#endif
+}
+
+bool NearestNeighbourKernels::AVX2Supported()
+{
+#ifdef CC_NN_KERNELS_X86
+	static const bool s_supported = CPUSupportsAVX2();
+	return s_supported;
+#else
+	return false;
+#endif
+}
+
+void NearestNeighbourKernels::FindNearestSSE2(	const PointCoordinateType* xs,
+												const PointCoordinateType* ys,
+												const PointCoordinateType* zs,
+												unsigned start,
+												unsigned stop,
+												const CCVector3& Q,
+												double& minSquareDist,
+												unsigned& nearestPos)
+{
+#ifdef CC_NN_KERNELS_X86
+	if (SSE2Supported())
+	{
+		FindNearestSSE2Impl(xs, ys, zs, start, stop, Q, minSquareDist, nearestPos);
+		return;
+	}
+#endif
+	FindNearestScalar(xs, ys, zs, start, stop, Q, minSquareDist, nearestPos);
+}
+
+void NearestNeighbourKernels::FindNearestAVX2(	const PointCoordinateType* xs,
+												const PointCoordinateType* ys,
+												const PointCoordinateType* zs,
+												unsigned start,
+												unsigned stop,
+												const CCVector3& Q,
+												double& minSquareDist,
+												unsigned& nearestPos)
+{
+#ifdef CC_NN_KERNELS_X86
+	if (AVX2Supported())
+	{
+		FindNearestAVX2Impl(xs, ys, zs, start, stop, Q, minSquareDist, nearestPos);
+		return;
+	}
+#endif
+	FindNearestScalar(xs, ys, zs, start, stop, Q, minSquareDist, nearestPos);
+}
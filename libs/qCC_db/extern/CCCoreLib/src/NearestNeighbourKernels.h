@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: LGPL-2.0-or-later
+// Copyright © CloudCompare Project
+
+#pragma once
+
+//Local
+#include "CCGeom.h"
+
+namespace CCCoreLib
+{
+	//! Nearest neighbour kernels (internal use only, see DgmOctree::findTheNearestNeighboursOfCellPoints)
+	/** The candidates are stored as a structure of arrays (X, Y and Z arrays). The squared distances
+		are computed exactly as Vector3Tpl::norm2d does (coordinates differences in single precision,
+		sum of squares in double precision) so that all the kernels give exactly the same results.
+		In case of equidistant candidates, the first one is kept.
+	**/
+	namespace NearestNeighbourKernels
+	{
+		//! Updates the nearest candidate of a query point (scalar version)
+		/** \param xs candidates X coordinates
+			\param ys candidates Y coordinates
+			\param zs candidates Z coordinates
+			\param start first candidate
+			\param stop last candidate (excluded)
+			\param Q query point
+			\param[in,out] minSquareDist squared distance to the nearest candidate (only candidates strictly closer are considered)
+			\param[in,out] nearestPos position of the nearest candidate
+		**/
+		void FindNearestScalar(	const PointCoordinateType* xs,
+								const PointCoordinateType* ys,
+								const PointCoordinateType* zs,
+								unsigned start,
+								unsigned stop,
+								const CCVector3& Q,
+								double& minSquareDist,
+								unsigned& nearestPos);
+
+		//! Updates the nearest candidate of a query point (SSE2 version)
+		/** Falls back to the scalar version if not supported.
+		**/
+		void FindNearestSSE2(	const PointCoordinateType* xs,
+								const PointCoordinateType* ys,
+								const PointCoordinateType* zs,
+								unsigned start,
+								unsigned stop,
+								const CCVector3& Q,
+								double& minSquareDist,
+								unsigned& nearestPos);
+
+		//! Updates the nearest candidate of a query point (AVX2 version)
+		/** Falls back to the scalar version if not supported.
+		**/
+		void FindNearestAVX2(	const PointCoordinateType* xs,
+								const PointCoordinateType* ys,
+								const PointCoordinateType* zs,
+								unsigned start,
+								unsigned stop,
+								const CCVector3& Q,
+								double& minSquareDist,
+								unsigned& nearestPos);
+
+		//! Returns whether the SSE2 kernel is supported (by the build and by the CPU)
+		bool SSE2Supported();
+
+		//! Returns whether the AVX2 kernel is supported (by the build and by the CPU)
+		bool AVX2Supported();
+	}
+}
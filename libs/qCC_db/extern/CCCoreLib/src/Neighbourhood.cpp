@@ -820,6 +820,11 @@ double Neighbourhood::computeFeature(GeomFeature feature)
 
 	Jacobi<double>::SortEigenValuesAndVectors(eigVectors, eigValues); //sort the eigenvectors in decreasing order of their associated eigenvalues
 
+	return ComputeFeature(feature, eigVectors, eigValues);
+}
+
+double Neighbourhood::ComputeFeature(GeomFeature feature, const SquareMatrixd& eigVectors, const std::vector<double>& eigValues)
+{
 	//shortcuts
 	const double& l1 = eigValues[0];
 	const double& l2 = eigValues[1];
@@ -0,0 +1,421 @@
+// SPDX-License-Identifier: LGPL-2.0-or-later
+// Copyright © CloudCompare Project
+
+#include <NeighbourhoodCache.h>
+
+//local
+#include <FlatKdTree.h>
+#include <GenericIndexedCloudPersist.h>
+#include <GenericProgressCallback.h>
+#include <TaskScheduler.h>
+
+//system
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+
+using namespace CCCoreLib;
+
+namespace
+{
+	//! Number of (consecutive) points processed by each task
+	const unsigned PointsPerTask = 256;
+
+	//! Sorts a neighbourhood by ascending squared distance to the query point
+	/** The squared distances are computed in double, the same way as DgmOctree does ((P - Q).norm2d()),
+		then stored as ScalarType values (the rounding preserves the order, see NeighbourhoodCache::countInSphere).
+	**/
+	void SortNeighbourhood(	const GenericIndexedCloudPersist* cloud,
+							const CCVector3& Q,
+							unsigned* indexes,
+							ScalarType* squareDistances,
+							unsigned count,
+							std::vector< std::pair<double, unsigned> >& neighbours)
+	{
+		neighbours.resize(count);
+		for (unsigned n = 0; n < count; ++n)
+		{
+			neighbours[n] = { (*cloud->getPointPersistentPtr(indexes[n]) - Q).norm2d(), indexes[n] };
+		}
+		std::sort(neighbours.begin(), neighbours.end());
+		for (unsigned n = 0; n < count; ++n)
+		{
+			squareDistances[n] = static_cast<ScalarType>(neighbours[n].first);
+			indexes[n] = neighbours[n].second;
+		}
+	}
+}
+
+NeighbourhoodCache::NeighbourhoodCache()
+	: m_type(NONE)
+	, m_associatedCloud(nullptr)
+	, m_pointCount(0)
+	, m_k(0)
+	, m_radius(0)
+{
+}
+
+void NeighbourhoodCache::clear()
+{
+	m_type = NONE;
+	m_associatedCloud = nullptr;
+	m_pointCount = 0;
+	m_k = 0;
+	m_radius = 0;
+
+	m_offsets.clear();
+	m_offsets.shrink_to_fit();
+	m_indexes.clear();
+	m_indexes.shrink_to_fit();
+	m_squareDistances.clear();
+	m_squareDistances.shrink_to_fit();
+}
+
+size_t NeighbourhoodCache::memoryUsage() const
+{
+	return m_offsets.capacity() * sizeof(size_t)
+		+ m_indexes.capacity() * sizeof(unsigned)
+		+ m_squareDistances.capacity() * sizeof(ScalarType);
+}
+
+bool NeighbourhoodCache::computeKNN(	GenericIndexedCloudPersist* cloud,
+										unsigned k,
+										GenericProgressCallback* progressCb/*=nullptr*/,
+										const FlatKdTree* kdTree/*=nullptr*/,
+										int maxThreadCount/*=0*/)
+{
+	if (k == 0)
+	{
+		assert(false);
+		return false;
+	}
+	return compute(cloud, KNN, k, 0, progressCb, kdTree, maxThreadCount);
+}
+
+bool NeighbourhoodCache::computeRadius(	GenericIndexedCloudPersist* cloud,
+										PointCoordinateType radius,
+										GenericProgressCallback* progressCb/*=nullptr*/,
+										const FlatKdTree* kdTree/*=nullptr*/,
+										int maxThreadCount/*=0*/)
+{
+	if (radius <= 0)
+	{
+		assert(false);
+		return false;
+	}
+	return compute(cloud, RADIUS, 0, radius, progressCb, kdTree, maxThreadCount);
+}
+
+bool NeighbourhoodCache::compute(	GenericIndexedCloudPersist* cloud,
+									Type type,
+									unsigned k,
+									PointCoordinateType radius,
+									GenericProgressCallback* progressCb,
+									const FlatKdTree* kdTree,
+									int maxThreadCount)
+{
+	clear();
+
+	if (!cloud || cloud->size() == 0)
+	{
+		return false;
+	}
+	unsigned pointCount = cloud->size();
+
+	//build a temporary KD-tree if necessary
+	FlatKdTree localKdTree;
+	if (kdTree)
+	{
+		if (kdTree->getAssociatedCloud() != cloud || kdTree->size() != pointCount)
+		{
+			//the KD-tree doesn't match the cloud
+			assert(false);
+			return false;
+		}
+	}
+	else
+	{
+		if (!localKdTree.buildFromCloud(cloud, progressCb, FlatKdTree::DefaultLeafSize, maxThreadCount))
+		{
+			return false;
+		}
+		kdTree = &localKdTree;
+	}
+
+	if (type == KNN)
+	{
+		k = std::min(k, pointCount);
+	}
+
+	unsigned taskCount = (pointCount + PointsPerTask - 1) / PointsPerTask;
+	std::vector< std::vector<unsigned> > taskIndexes;
+	std::vector< std::vector<ScalarType> > taskSquareDistances;
+	try
+	{
+		if (type == KNN)
+		{
+			m_indexes.resize(static_cast<size_t>(pointCount) * k);
+			m_squareDistances.resize(static_cast<size_t>(pointCount) * k);
+		}
+		else
+		{
+			m_offsets.resize(static_cast<size_t>(pointCount) + 1, 0);
+			taskIndexes.resize(taskCount);
+			taskSquareDistances.resize(taskCount);
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		clear();
+		return false;
+	}
+
+	if (progressCb)
+	{
+		if (progressCb->textCanBeEdited())
+		{
+			progressCb->setMethodTitle("Neighbourhood cache");
+			progressCb->setInfo(type == KNN ? "Searching the nearest neighbours" : "Searching the neighbours in spheres");
+		}
+		progressCb->update(0);
+		progressCb->start();
+	}
+	NormalizedProgress nProgress(progressCb, pointCount);
+
+	//the points are processed in the KD-tree leaf order (spatially coherent queries)
+	TaskScheduler scheduler(maxThreadCount);
+	bool success = scheduler.run(taskCount,
+		[&](unsigned taskIndex)
+		{
+			unsigned first = taskIndex * PointsPerTask;
+			unsigned last = std::min(first + PointsPerTask, pointCount);
+
+			std::vector< std::pair<double, unsigned> > neighbours;
+			if (type == KNN)
+			{
+				for (unsigned j = first; j < last; ++j)
+				{
+					size_t pos = static_cast<size_t>(kdTree->pointIndex(j)) * k;
+					unsigned found = kdTree->findKNearestNeighbours(kdTree->points()[j].u, k, m_indexes.data() + pos, m_squareDistances.data() + pos);
+					if (found != k)
+					{
+						//shouldn't happen (k <= pointCount)
+						assert(false);
+						return false;
+					}
+					SortNeighbourhood(cloud, kdTree->points()[j], m_indexes.data() + pos, m_squareDistances.data() + pos, k, neighbours);
+				}
+			}
+			else
+			{
+				//each task stores its (sorted) neighbourhoods in its own containers, and their sizes in 'm_offsets'
+				std::vector<unsigned>& indexes = taskIndexes[taskIndex];
+				std::vector<ScalarType>& squareDistances = taskSquareDistances[taskIndex];
+				try
+				{
+					for (unsigned j = first; j < last; ++j)
+					{
+						size_t start = indexes.size();
+						unsigned count = kdTree->findPointsInSphere(kdTree->points()[j].u, radius, indexes);
+						squareDistances.resize(indexes.size());
+						SortNeighbourhood(cloud, kdTree->points()[j], indexes.data() + start, squareDistances.data() + start, count, neighbours);
+
+						m_offsets[kdTree->pointIndex(j) + 1] = count;
+					}
+				}
+				catch (const std::bad_alloc&)
+				{
+					//not enough memory
+					return false;
+				}
+			}
+
+			return nProgress.steps(last - first);
+		},
+		TaskScheduler::CostFunction(),
+		progressCb);
+
+	if (success && type == RADIUS)
+	{
+		//deduce the offsets
+		for (unsigned i = 0; i < pointCount; ++i)
+		{
+			m_offsets[i + 1] += m_offsets[i];
+		}
+
+		try
+		{
+			m_indexes.resize(m_offsets[pointCount]);
+			m_squareDistances.resize(m_offsets[pointCount]);
+		}
+		catch (const std::bad_alloc&)
+		{
+			//not enough memory
+			success = false;
+		}
+
+		//move the neighbourhoods at their final position
+		if (success)
+		{
+			success = scheduler.run(taskCount,
+				[&](unsigned taskIndex)
+				{
+					unsigned first = taskIndex * PointsPerTask;
+					unsigned last = std::min(first + PointsPerTask, pointCount);
+
+					std::vector<unsigned>& indexes = taskIndexes[taskIndex];
+					std::vector<ScalarType>& squareDistances = taskSquareDistances[taskIndex];
+					size_t start = 0;
+					for (unsigned j = first; j < last; ++j)
+					{
+						unsigned pointIndex = kdTree->pointIndex(j);
+						size_t count = m_offsets[pointIndex + 1] - m_offsets[pointIndex];
+						std::copy(indexes.begin() + start, indexes.begin() + start + count, m_indexes.begin() + m_offsets[pointIndex]);
+						std::copy(squareDistances.begin() + start, squareDistances.begin() + start + count, m_squareDistances.begin() + m_offsets[pointIndex]);
+						start += count;
+					}
+					assert(start == indexes.size());
+
+					//release the memory as soon as possible
+					indexes.clear();
+					indexes.shrink_to_fit();
+					squareDistances.clear();
+					squareDistances.shrink_to_fit();
+
+					return true;
+				});
+		}
+	}
+
+	if (progressCb)
+	{
+		progressCb->stop();
+	}
+
+	if (!success)
+	{
+		clear();
+		return false;
+	}
+
+	m_type = type;
+	m_associatedCloud = cloud;
+	m_pointCount = pointCount;
+	m_k = k;
+	m_radius = radius;
+
+	return true;
+}
+
+bool NeighbourhoodCache::canProvideKNN(const GenericIndexedCloud* cloud, unsigned k) const
+{
+	return m_type == KNN
+		&& cloud == m_associatedCloud
+		&& cloud->size() == m_pointCount
+		&& k <= m_k;
+}
+
+bool NeighbourhoodCache::canProvideRadius(const GenericIndexedCloud* cloud, PointCoordinateType radius) const
+{
+	return m_type == RADIUS
+		&& cloud == m_associatedCloud
+		&& cloud->size() == m_pointCount
+		&& radius <= m_radius;
+}
+
+unsigned NeighbourhoodCache::countInSphere(unsigned pointIndex, PointCoordinateType radius) const
+{
+	assert(pointIndex < m_pointCount);
+	assert(m_type != RADIUS || radius <= m_radius);
+
+	const ScalarType* squareDistances = this->squareDistances(pointIndex);
+	unsigned count = neighbourCount(pointIndex);
+
+	//same as DgmOctree: the squared distances are compared in double
+	const double squareRadius = static_cast<double>(radius) * static_cast<double>(radius);
+	const ScalarType roundedSquareRadius = static_cast<ScalarType>(squareRadius);
+
+	//the stored distances are rounded: the ones below the rounded radius are inside the sphere,
+	//but the ones equal to it must be compared again (they are sorted by exact distance)
+	unsigned inside = static_cast<unsigned>(std::lower_bound(squareDistances, squareDistances + count, roundedSquareRadius) - squareDistances);
+	if (inside < count && squareDistances[inside] == roundedSquareRadius)
+	{
+		const CCVector3* Q = m_associatedCloud->getPointPersistentPtr(pointIndex);
+		const unsigned* indexes = neighbours(pointIndex);
+		while (	inside < count
+			&&	squareDistances[inside] == roundedSquareRadius
+			&&	(*m_associatedCloud->getPointPersistentPtr(indexes[inside]) - *Q).norm2d() <= squareRadius)
+		{
+			++inside;
+		}
+	}
+
+	return inside;
+}
+
+unsigned NeighbourhoodCache::getNeighbours(unsigned pointIndex, unsigned count, DgmOctree::NeighboursSet& neighbours) const
+{
+	assert(pointIndex < m_pointCount);
+
+	count = std::min(count, neighbourCount(pointIndex));
+	if (neighbours.size() < count)
+	{
+		neighbours.resize(count);
+	}
+
+	const unsigned* indexes = this->neighbours(pointIndex);
+	const ScalarType* squareDistances = this->squareDistances(pointIndex);
+	for (unsigned i = 0; i < count; ++i)
+	{
+		neighbours[i] = DgmOctree::PointDescriptor(m_associatedCloud->getPointPersistentPtr(indexes[i]), indexes[i], squareDistances[i]);
+	}
+
+	return count;
+}
+
+bool NeighbourhoodCache::forEachPointRange(	const RangeFunction& func,
+											GenericProgressCallback* progressCb/*=nullptr*/,
+											const char* title/*=nullptr*/,
+											int maxThreadCount/*=0*/) const
+{
+	if (m_pointCount == 0)
+	{
+		return false;
+	}
+
+	if (progressCb)
+	{
+		if (progressCb->textCanBeEdited())
+		{
+			if (title)
+			{
+				progressCb->setMethodTitle(title);
+			}
+			char buffer[64];
+			snprintf(buffer, 64, "Points: %u (cached neighbourhoods)", m_pointCount);
+			progressCb->setInfo(buffer);
+		}
+		progressCb->update(0);
+		progressCb->start();
+	}
+	NormalizedProgress nProgress(progressCb, m_pointCount);
+
+	unsigned taskCount = (m_pointCount + PointsPerTask - 1) / PointsPerTask;
+	bool success = TaskScheduler(maxThreadCount).run(taskCount,
+		[&](unsigned taskIndex)
+		{
+			unsigned first = taskIndex * PointsPerTask;
+			unsigned last = std::min(first + PointsPerTask, m_pointCount);
+			return func(first, last) && nProgress.steps(last - first);
+		},
+		TaskScheduler::CostFunction(),
+		progressCb);
+
+	if (progressCb)
+	{
+		progressCb->stop();
+	}
+
+	return success;
+}
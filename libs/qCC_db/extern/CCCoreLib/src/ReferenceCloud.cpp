@@ -5,6 +5,7 @@
 
 //system
 #include <algorithm>
+#include <cstring>
 
 using namespace CCCoreLib;
 
@@ -39,9 +40,21 @@ void ReferenceCloud::getBoundingBox(CCVector3& bbMin, CCVector3& bbMax)
 	if (!m_bbox.isValid())
 	{
 		m_bbox.clear();
-		for (unsigned index : m_theIndexes)
+		PointSpans spans = m_theAssociatedCloud->getPointSpans();
+		if (spans.isValid())
 		{
-			m_bbox.add(*m_theAssociatedCloud->getPoint(index));
+			//direct access to the associated cloud points
+			for (unsigned index : m_theIndexes)
+			{
+				m_bbox.add(spans.point(index));
+			}
+		}
+		else
+		{
+			for (unsigned index : m_theIndexes)
+			{
+				m_bbox.add(*m_theAssociatedCloud->getPoint(index));
+			}
 		}
 	}
 
@@ -229,3 +242,158 @@ bool ReferenceCloud::add(const ReferenceCloud& cloud)
 	m_mutex.unlock();
 	return true;
 }
+
+unsigned* ReferenceCloud::appendPointIndexSpan(unsigned count)
+{
+	assert(count != 0);
+
+	m_mutex.lock();
+
+	std::size_t currentSize = m_theIndexes.size();
+	try
+	{
+		m_theIndexes.resize(currentSize + count);
+	}
+	catch (const std::bad_alloc&)
+	{
+		m_mutex.unlock();
+		return nullptr;
+	}
+
+	invalidateBoundingBox();
+	unsigned* span = m_theIndexes.data() + currentSize;
+
+	m_mutex.unlock();
+	return span;
+}
+
+bool ReferenceCloud::addPointIndexes(const unsigned* globalIndexes, unsigned count)
+{
+	if (count == 0)
+	{
+		return true;
+	}
+	assert(globalIndexes);
+
+	m_mutex.lock();
+
+	std::size_t currentSize = m_theIndexes.size();
+	try
+	{
+		m_theIndexes.resize(currentSize + count);
+	}
+	catch (const std::bad_alloc&)
+	{
+		m_mutex.unlock();
+		return false;
+	}
+
+	//the copy must be done under the lock (another thread could resize the cloud)
+	memcpy(m_theIndexes.data() + currentSize, globalIndexes, count * sizeof(unsigned));
+
+	invalidateBoundingBox();
+
+	m_mutex.unlock();
+	return true;
+}
+
+bool ReferenceCloud::addPointIndexes(const std::vector<IndexBuilder>& builders)
+{
+	std::size_t totalCount = 0;
+	for (const IndexBuilder& builder : builders)
+	{
+		totalCount += builder.size();
+	}
+	if (totalCount == 0)
+	{
+		return true;
+	}
+
+	m_mutex.lock();
+
+	std::size_t pos = m_theIndexes.size();
+	try
+	{
+		m_theIndexes.resize(pos + totalCount);
+	}
+	catch (const std::bad_alloc&)
+	{
+		m_mutex.unlock();
+		return false;
+	}
+
+	for (const IndexBuilder& builder : builders)
+	{
+		if (builder.size() != 0)
+		{
+			memcpy(m_theIndexes.data() + pos, builder.indexes().data(), builder.size() * sizeof(unsigned));
+			pos += builder.size();
+		}
+	}
+
+	invalidateBoundingBox();
+
+	m_mutex.unlock();
+	return true;
+}
+
+bool ReferenceCloud::addFlaggedPointIndexes(const unsigned char* flags,
+											unsigned count,
+											unsigned char flagValue/*=1*/,
+											unsigned firstIndex/*=0*/)
+{
+	if (count == 0)
+	{
+		return true;
+	}
+	assert(flags);
+
+	//count the flagged points first (so as to allocate the memory only once)
+	unsigned flaggedCount = 0;
+	for (unsigned i = 0; i < count; ++i)
+	{
+		if (flags[i] == flagValue)
+		{
+			++flaggedCount;
+		}
+	}
+	if (flaggedCount == 0)
+	{
+		return true;
+	}
+
+	m_mutex.lock();
+
+	std::size_t pos = m_theIndexes.size();
+	try
+	{
+		m_theIndexes.resize(pos + flaggedCount);
+	}
+	catch (const std::bad_alloc&)
+	{
+		m_mutex.unlock();
+		return false;
+	}
+
+	unsigned* indexes = m_theIndexes.data() + pos;
+	for (unsigned i = 0; i < count; ++i)
+	{
+		if (flags[i] == flagValue)
+		{
+			*indexes++ = firstIndex + i;
+		}
+	}
+
+	invalidateBoundingBox();
+
+	m_mutex.unlock();
+	return true;
+}
+
+void ReferenceCloud::adoptPointIndexes(std::vector<unsigned>& globalIndexes)
+{
+	m_mutex.lock();
+	m_theIndexes.swap(globalIndexes);
+	invalidateBoundingBox();
+	m_mutex.unlock();
+}
@@ -7,11 +7,11 @@
 #include <CCMath.h>
 #include <CloudSamplingTools.h>
 #include <DistanceComputationTools.h>
+#include <FlatKdTree.h>
 #include <Garbage.h>
 #include <GenericProgressCallback.h>
 #include <GeometricalAnalysisTools.h>
 #include <Jacobi.h>
-#include <KdTree.h>
 #include <ManualSegmentationTools.h>
 #include <NormalDistribution.h>
 #include <ParallelSort.h>
@@ -1127,7 +1127,7 @@ bool FPCSRegistrationTools::RegisterClouds(	GenericIndexedCloud* modelCloud,
 											GenericProgressCallback* progressCb,
 											unsigned nbMaxCandidates)
 {
-	//DGM: KDTree::buildFromCloud will call reset right away!
+	//FlatKdTree::buildFromCloud will call reset right away!
 	//if (progressCb)
 	//{
 	//	if (progressCb->textCanBeEdited())
@@ -1157,13 +1157,13 @@ bool FPCSRegistrationTools::RegisterClouds(	GenericIndexedCloud* modelCloud,
 	}
 
 	//Build the associated KDtrees
-	KDTree* dataTree = new KDTree();
+	FlatKdTree* dataTree = new FlatKdTree();
 	if (!dataTree->buildFromCloud(dataCloud, progressCb))
 	{
 		delete dataTree;
 		return false;
 	}
-	KDTree* modelTree = new KDTree();
+	FlatKdTree* modelTree = new FlatKdTree();
 	if (!modelTree->buildFromCloud(modelCloud, progressCb))
 	{
 		delete dataTree;
@@ -1271,7 +1271,7 @@ bool FPCSRegistrationTools::RegisterClouds(	GenericIndexedCloud* modelCloud,
 }
 
 
-unsigned FPCSRegistrationTools::ComputeRegistrationScore(	KDTree *modelTree,
+unsigned FPCSRegistrationTools::ComputeRegistrationScore(	FlatKdTree *modelTree,
 															GenericIndexedCloud *dataCloud,
 															ScalarType delta,
 															const ScaledTransformation& dataToModel)
@@ -1439,7 +1439,7 @@ bool FPCSRegistrationTools::FindBase(	GenericIndexedCloud* cloud,
 //pair of indexes
 using IndexPair = std::pair<unsigned,unsigned>;
 
-int FPCSRegistrationTools::FindCongruentBases( KDTree* tree,
+int FPCSRegistrationTools::FindCongruentBases( FlatKdTree* tree,
 											   ScalarType delta,
 											   const CCVector3* base[4],
 											   std::vector<Base>& results )
@@ -1554,7 +1554,7 @@ int FPCSRegistrationTools::FindCongruentBases( KDTree* tree,
 		}
 
 		//build kdtree for nearest neighbour fast research
-		KDTree intermediateTree;
+		FlatKdTree intermediateTree;
 		if (!intermediateTree.buildFromCloud(&tmpCloud1))
 			return -4;
 
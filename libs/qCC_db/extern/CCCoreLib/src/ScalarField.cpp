@@ -34,9 +34,11 @@ void ScalarField::computeMeanAndVariance(ScalarType &mean, ScalarType* variance)
 	double _std2 = 0.0;
 	std::size_t count = 0;
 
-	for (std::size_t i = 0; i < size(); ++i)
+	const ScalarType* _values = data();
+	const std::size_t valueCount = size();
+	for (std::size_t i = 0; i < valueCount; ++i)
 	{
-		const ScalarType& val = at(i);
+		const ScalarType val = _values[i];
 		if (ValidValue(val))
 		{
 			_mean += val;
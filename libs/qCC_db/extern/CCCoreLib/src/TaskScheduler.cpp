@@ -0,0 +1,255 @@
+// SPDX-License-Identifier: LGPL-2.0-or-later
+// Copyright © CloudCompare Project
+
+#include <TaskScheduler.h>
+
+//local
+#include <GenericProgressCallback.h>
+
+//system
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <mutex>
+#include <vector>
+
+#ifdef CC_CORE_LIB_USES_QT_CONCURRENT
+#ifndef CC_DEBUG
+//enables multi-threading handling (Release only)
+#define ENABLE_MT_SCHEDULER
+
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrentRun>
+#endif
+#endif
+
+using namespace CCCoreLib;
+
+namespace
+{
+	//! Deque of batches [head, tail) owned by a thread
+	/** The owner pops the batches from the front, thieves steal them from the back.
+	**/
+	struct BatchDeque
+	{
+		std::mutex mutex;
+		unsigned head = 0;
+		unsigned tail = 0;
+		//! Padding (to avoid false sharing between neighbouring deques)
+		char padding[64];
+
+		bool popFront(unsigned& batch)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (head == tail)
+			{
+				return false;
+			}
+			batch = head++;
+			return true;
+		}
+
+		bool stealBack(unsigned& batch)
+		{
+			std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+			if (!lock.owns_lock() || head == tail)
+			{
+				return false;
+			}
+			batch = --tail;
+			return true;
+		}
+
+		bool empty()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return head == tail;
+		}
+	};
+
+	//! Groups the tasks in contiguous batches of (roughly) the same cost
+	/** \return the first task of each batch (+ the task count)
+	**/
+	std::vector<unsigned> MakeBatches(unsigned taskCount, const TaskScheduler::CostFunction& costFunc, unsigned targetBatchCount)
+	{
+		std::vector<unsigned> batchStarts;
+		batchStarts.reserve(targetBatchCount + 1);
+		batchStarts.push_back(0);
+
+		if (!costFunc)
+		{
+			unsigned batchSize = std::max(1u, (taskCount + targetBatchCount - 1) / targetBatchCount);
+			for (unsigned start = batchSize; start < taskCount; start += batchSize)
+			{
+				batchStarts.push_back(start);
+			}
+		}
+		else
+		{
+			//we need the total cost first
+			double totalCost = 0.0;
+			for (unsigned i = 0; i < taskCount; ++i)
+			{
+				totalCost += costFunc(i);
+			}
+			double targetCost = std::max(1.0, totalCost / targetBatchCount);
+
+			double batchCost = 0.0;
+			for (unsigned i = 0; i < taskCount; ++i)
+			{
+				//a very expensive task gets its own batch
+				double cost = costFunc(i);
+				if (batchCost != 0.0 && batchCost + cost > targetCost)
+				{
+					batchStarts.push_back(i);
+					batchCost = 0.0;
+				}
+				batchCost += cost;
+			}
+		}
+
+		batchStarts.push_back(taskCount);
+		return batchStarts;
+	}
+}
+
+TaskScheduler::TaskScheduler(int maxThreadCount/*=0*/)
+	: m_maxThreadCount(maxThreadCount > 0 ? maxThreadCount : IdealThreadCount())
+{
+}
+
+int TaskScheduler::IdealThreadCount()
+{
+#ifdef ENABLE_MT_SCHEDULER
+	return std::max(1, QThread::idealThreadCount());
+#else
+	return 1;
+#endif
+}
+
+bool TaskScheduler::run(unsigned taskCount,
+						const TaskFunction& func,
+						const CostFunction& costFunc/*=CostFunction()*/,
+						GenericProgressCallback* progressCb/*=nullptr*/) const
+{
+	if (taskCount == 0)
+	{
+		return true;
+	}
+	assert(func);
+
+	unsigned threadCount = static_cast<unsigned>(std::max(1, m_maxThreadCount));
+#ifndef ENABLE_MT_SCHEDULER
+	threadCount = 1;
+#endif
+
+	std::vector<unsigned> batchStarts;
+	try
+	{
+		batchStarts = MakeBatches(taskCount, costFunc, threadCount * BatchesPerThread);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory: a single batch
+		batchStarts.clear();
+		threadCount = 1;
+	}
+
+	if (threadCount == 1 || batchStarts.size() <= 2)
+	{
+		//sequential process
+		for (unsigned i = 0; i < taskCount; ++i)
+		{
+			if (!func(i))
+			{
+				return false;
+			}
+			if (progressCb && (i & 63) == 63 && progressCb->isCancelRequested())
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	unsigned batchCount = static_cast<unsigned>(batchStarts.size()) - 1;
+	threadCount = std::min(threadCount, batchCount);
+
+	//each thread gets a contiguous set of batches (for data locality)
+	std::vector<BatchDeque> deques(threadCount);
+	for (unsigned t = 0; t < threadCount; ++t)
+	{
+		deques[t].head = static_cast<unsigned>((static_cast<unsigned long long>(batchCount) * t) / threadCount);
+		deques[t].tail = static_cast<unsigned>((static_cast<unsigned long long>(batchCount) * (t + 1)) / threadCount);
+	}
+
+	std::atomic<bool> cancelled(false);
+
+	auto worker = [&](unsigned threadIndex)
+	{
+		while (!cancelled)
+		{
+			unsigned batch = 0;
+			if (!deques[threadIndex].popFront(batch))
+			{
+				//try to steal a batch from another thread
+				bool found = false;
+				bool allEmpty = false;
+				while (!found && !allEmpty && !cancelled)
+				{
+					allEmpty = true;
+					for (unsigned k = 1; k < threadCount; ++k)
+					{
+						BatchDeque& victim = deques[(threadIndex + k) % threadCount];
+						if (victim.stealBack(batch))
+						{
+							found = true;
+							break;
+						}
+						if (!victim.empty())
+						{
+							//it was locked: we'll try again
+							allEmpty = false;
+						}
+					}
+				}
+				if (!found)
+				{
+					//no more work
+					return;
+				}
+			}
+
+			for (unsigned i = batchStarts[batch]; i < batchStarts[batch + 1]; ++i)
+			{
+				if (!func(i))
+				{
+					cancelled = true;
+					return;
+				}
+			}
+
+			if (progressCb && progressCb->isCancelRequested())
+			{
+				cancelled = true;
+			}
+		}
+	};
+
+#ifdef ENABLE_MT_SCHEDULER
+	//dedicated pool (the calling thread is the first worker)
+	QThreadPool pool;
+	pool.setMaxThreadCount(static_cast<int>(threadCount) - 1);
+	for (unsigned t = 1; t < threadCount; ++t)
+	{
+		QtConcurrent::run(&pool, worker, t);
+	}
+	worker(0);
+	pool.waitForDone();
+#else
+	worker(0);
+#endif
+
+	return !cancelled;
+}
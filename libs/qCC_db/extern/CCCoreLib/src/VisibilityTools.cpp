@@ -0,0 +1,643 @@
+// SPDX-License-Identifier: LGPL-2.0-or-later
+// Copyright © CloudCompare Project
+
+#include <VisibilityTools.h>
+
+//local
+#include <CCConst.h>
+#include <GenericIndexedCloudPersist.h>
+#include <GenericProgressCallback.h>
+#include <ReferenceCloud.h>
+#include <TaskScheduler.h>
+
+//system
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#ifdef CC_CORE_LIB_USES_QT_CONCURRENT
+#ifndef CC_DEBUG
+//enables multi-threading handling (Release only)
+#define ENABLE_MT_VISIBILITY
+
+#include <QThread>
+#endif
+#endif
+
+using namespace CCCoreLib;
+
+namespace
+{
+	//! Side of the (square) depth buffer tiles (in pixels)
+	constexpr unsigned c_tileSize = 32;
+	//! Number of pixels per tile
+	constexpr unsigned c_tilePixelCount = c_tileSize * c_tileSize;
+	//! Invalid pixel address (e.g. for non-finite points)
+	constexpr uint32_t c_invalidPixel = std::numeric_limits<uint32_t>::max();
+	//! Minimum number of items per range (below this, the threading overhead is not worth it)
+	constexpr unsigned c_minRangeSize = 4096;
+
+	//! Range of items [start, stop)
+	struct Range
+	{
+		unsigned index;
+		unsigned start;
+		unsigned stop;
+	};
+
+	//! Returns the number of threads to use
+	int GetThreadCount(int maxThreadCount)
+	{
+#ifdef ENABLE_MT_VISIBILITY
+		return (maxThreadCount > 0 ? maxThreadCount : QThread::idealThreadCount());
+#else
+		(void)maxThreadCount;
+		return 1;
+#endif
+	}
+
+	//! Splits [0, count) in (roughly) 'rangeCount' ranges
+	std::vector<Range> SplitInRanges(unsigned count, unsigned rangeCount, unsigned minRangeSize)
+	{
+		unsigned rangeSize = std::max(minRangeSize, (count + rangeCount - 1) / std::max(rangeCount, 1u));
+		rangeSize = std::max(rangeSize, 1u);
+
+		std::vector<Range> ranges;
+		ranges.reserve((count + rangeSize - 1) / rangeSize);
+		for (unsigned start = 0; start < count; start += rangeSize)
+		{
+			ranges.push_back({ static_cast<unsigned>(ranges.size()), start, std::min(start + rangeSize, count) });
+		}
+		return ranges;
+	}
+
+	//! Applies a function to each range (in parallel if possible)
+	template <class Func> void ForEachRange(std::vector<Range>& ranges, int threadCount, const Func& func)
+	{
+		TaskScheduler(threadCount).run(static_cast<unsigned>(ranges.size()), [&ranges, &func](unsigned i) { func(ranges[i]); return true; });
+	}
+
+	//! Tiled depth buffer
+	/** The pixels are stored tile by tile so that filling (or filtering) a tile only touches
+		a small and contiguous chunk of memory.
+	**/
+	struct DepthBuffer
+	{
+		bool init(unsigned w, unsigned h)
+		{
+			width = w;
+			height = h;
+			tilesX = (w + c_tileSize - 1) / c_tileSize;
+			tilesY = (h + c_tileSize - 1) / c_tileSize;
+
+			//the pixel addresses must fit on 32 bits
+			if (static_cast<double>(tilesX) * tilesY * c_tilePixelCount >= static_cast<double>(c_invalidPixel))
+			{
+				return false;
+			}
+
+			try
+			{
+				depths.resize(static_cast<size_t>(tilesX) * tilesY * c_tilePixelCount, std::numeric_limits<float>::infinity());
+			}
+			catch (const std::bad_alloc&)
+			{
+				return false;
+			}
+			return true;
+		}
+
+		inline uint32_t address(unsigned x, unsigned y) const
+		{
+			return ((y / c_tileSize) * tilesX + (x / c_tileSize)) * c_tilePixelCount + (y % c_tileSize) * c_tileSize + (x % c_tileSize);
+		}
+
+		inline unsigned tileCount() const { return tilesX * tilesY; }
+
+		static inline unsigned TileOf(uint32_t address) { return address / c_tilePixelCount; }
+
+		unsigned width = 0;
+		unsigned height = 0;
+		unsigned tilesX = 0;
+		unsigned tilesY = 0;
+		std::vector<float> depths;
+	};
+
+	//! Projects the points in the depth buffer image space
+	class DepthProjector
+	{
+	public:
+
+		bool init(const VisibilityTools::DepthBufferParams& params, GenericIndexedCloud* cloud)
+		{
+			m_params = params;
+			m_dimZ = std::min<unsigned char>(params.axisDim, 2);
+			m_dimX = (m_dimZ + 1) % 3;
+			m_dimY = (m_dimX + 1) % 3;
+
+			CCVector3 bbMin;
+			CCVector3 bbMax;
+			cloud->getBoundingBox(bbMin, bbMax);
+
+			static const double PI = M_PI;
+			switch (params.mode)
+			{
+			case VisibilityTools::PLANAR:
+			{
+				if (params.pixelSize <= 0)
+					return false;
+				m_uMin = static_cast<double>(bbMin.x) / params.pixelSize;
+				m_vMin = static_cast<double>(bbMin.y) / params.pixelSize;
+				m_width = static_cast<double>(bbMax.x - bbMin.x) / params.pixelSize;
+				m_height = static_cast<double>(bbMax.y - bbMin.y) / params.pixelSize;
+				m_wrapU = false;
+			}
+			break;
+
+			case VisibilityTools::CYLINDRICAL:
+			{
+				if (params.pixelSize <= 0 || params.angularStep_rad <= 0)
+					return false;
+				m_uMin = -PI / params.angularStep_rad;
+				m_width = 2 * PI / params.angularStep_rad;
+				m_vMin = static_cast<double>(bbMin.u[m_dimZ] - params.center.u[m_dimZ]) / params.pixelSize;
+				m_height = static_cast<double>(bbMax.u[m_dimZ] - bbMin.u[m_dimZ]) / params.pixelSize;
+				m_wrapU = true;
+			}
+			break;
+
+			case VisibilityTools::SPHERICAL:
+			{
+				if (params.angularStep_rad <= 0)
+					return false;
+				m_uMin = -PI / params.angularStep_rad;
+				m_width = 2 * PI / params.angularStep_rad;
+				m_vMin = -PI / (2 * params.angularStep_rad);
+				m_height = PI / params.angularStep_rad;
+				m_wrapU = true;
+			}
+			break;
+
+			default:
+				assert(false);
+				return false;
+			}
+
+			if (!std::isfinite(m_width) || !std::isfinite(m_height) || m_width >= std::numeric_limits<unsigned>::max() - 1 || m_height >= std::numeric_limits<unsigned>::max() - 1)
+			{
+				return false;
+			}
+
+			if (m_wrapU)
+			{
+				//the last column would overlap the first one
+				m_imageWidth = std::max(1u, static_cast<unsigned>(std::ceil(m_width)));
+			}
+			else
+			{
+				m_imageWidth = static_cast<unsigned>(std::floor(m_width)) + 1;
+			}
+			m_imageHeight = static_cast<unsigned>(std::floor(m_height)) + 1;
+
+			return true;
+		}
+
+		inline unsigned imageWidth() const { return m_imageWidth; }
+		inline unsigned imageHeight() const { return m_imageHeight; }
+		inline bool wrapU() const { return m_wrapU; }
+
+		//! Projects a point
+		/** \return false if the point can't be projected
+		**/
+		inline bool project(const CCVector3& P, unsigned& x, unsigned& y, float& depth) const
+		{
+			double u = 0;
+			double v = 0;
+			double d = 0;
+
+			switch (m_params.mode)
+			{
+			case VisibilityTools::PLANAR:
+			{
+				u = static_cast<double>(P.x) / m_params.pixelSize;
+				v = static_cast<double>(P.y) / m_params.pixelSize;
+				d = -static_cast<double>(P.z);
+			}
+			break;
+
+			case VisibilityTools::CYLINDRICAL:
+			{
+				CCVector3 AP = P - m_params.center;
+				double a = AP.u[m_dimX];
+				double b = AP.u[m_dimY];
+				u = std::atan2(a, b) / m_params.angularStep_rad;
+				v = static_cast<double>(AP.u[m_dimZ]) / m_params.pixelSize;
+				d = std::sqrt(a * a + b * b);
+			}
+			break;
+
+			case VisibilityTools::SPHERICAL:
+			{
+				CCVector3d AP = CCVector3d::fromArray((P - m_params.center).u);
+				d = AP.norm();
+				if (d > 0)
+				{
+					u = std::atan2(AP.x, AP.y) / m_params.angularStep_rad;
+					v = std::asin(std::max(-1.0, std::min(1.0, AP.z / d))) / m_params.angularStep_rad;
+				}
+			}
+			break;
+
+			default:
+				return false;
+			}
+
+			if (!std::isfinite(u) || !std::isfinite(v) || !std::isfinite(d))
+			{
+				return false;
+			}
+
+			double fx = std::floor(u - m_uMin);
+			double fy = std::floor(v - m_vMin);
+			if (m_wrapU)
+			{
+				long long ix = static_cast<long long>(fx) % static_cast<long long>(m_imageWidth);
+				x = static_cast<unsigned>(ix < 0 ? ix + m_imageWidth : ix);
+			}
+			else
+			{
+				x = static_cast<unsigned>(std::max(0.0, std::min(fx, static_cast<double>(m_imageWidth - 1))));
+			}
+			y = static_cast<unsigned>(std::max(0.0, std::min(fy, static_cast<double>(m_imageHeight - 1))));
+
+			depth = static_cast<float>(m_params.reverseDepth ? -d : d);
+			return true;
+		}
+
+	protected:
+
+		VisibilityTools::DepthBufferParams m_params;
+		unsigned char m_dimX = 0;
+		unsigned char m_dimY = 1;
+		unsigned char m_dimZ = 2;
+		double m_uMin = 0;
+		double m_vMin = 0;
+		double m_width = 0;
+		double m_height = 0;
+		unsigned m_imageWidth = 0;
+		unsigned m_imageHeight = 0;
+		bool m_wrapU = false;
+	};
+
+	//! 1D min filter of half-size 'n' along the rows (or the columns) of a depth buffer
+	void MinFilter1D(	const DepthBuffer& buffer,
+						const std::vector<float>& input,
+						std::vector<float>& output,
+						unsigned n,
+						bool alongRows,
+						bool wrap,
+						std::vector<Range>& rowRanges,
+						int threadCount)
+	{
+		const unsigned length = (alongRows ? buffer.width : buffer.height);
+
+		ForEachRange(rowRanges, threadCount, [&](const Range& range)
+		{
+			for (unsigned j = range.start; j < range.stop; ++j) //row (or column) index
+			{
+				for (unsigned i = 0; i < length; ++i)
+				{
+					float minDepth = std::numeric_limits<float>::infinity();
+					for (int k = -static_cast<int>(n); k <= static_cast<int>(n); ++k)
+					{
+						long long ik = static_cast<long long>(i) + k;
+						if (ik < 0 || ik >= static_cast<long long>(length))
+						{
+							if (!wrap)
+								continue;
+							ik = (ik + length) % length;
+						}
+						uint32_t address = (alongRows ? buffer.address(static_cast<unsigned>(ik), j) : buffer.address(j, static_cast<unsigned>(ik)));
+						minDepth = std::min(minDepth, input[address]);
+					}
+					output[alongRows ? buffer.address(i, j) : buffer.address(j, i)] = minDepth;
+				}
+			}
+		});
+	}
+}
+
+bool VisibilityTools::ComputeVisibility(GenericIndexedCloud* cloud,
+										const DepthBufferParams& params,
+										std::vector<unsigned char>& visibility,
+										unsigned* visibleCount/*=nullptr*/,
+										GenericProgressCallback* progressCb/*=nullptr*/)
+{
+	if (visibleCount)
+	{
+		*visibleCount = 0;
+	}
+
+	if (!cloud)
+	{
+		assert(false);
+		return false;
+	}
+
+	const unsigned pointCount = cloud->size();
+	try
+	{
+		visibility.resize(pointCount, POINT_HIDDEN);
+	}
+	catch (const std::bad_alloc&)
+	{
+		return false;
+	}
+	if (pointCount == 0)
+	{
+		return true;
+	}
+
+	DepthProjector projector;
+	if (!projector.init(params, cloud))
+	{
+		//invalid parameters or image too big
+		return false;
+	}
+
+	DepthBuffer buffer;
+	if (!buffer.init(projector.imageWidth(), projector.imageHeight()))
+	{
+		//not enough memory
+		return false;
+	}
+
+	const int threadCount = GetThreadCount(params.maxThreadCount);
+	//more ranges than threads, to balance the load
+	std::vector<Range> pointRanges = SplitInRanges(pointCount, 4 * threadCount, c_minRangeSize);
+	const unsigned tileCount = buffer.tileCount();
+
+	std::vector<uint32_t> pixels;
+	std::vector<float> depths;
+	std::vector<std::vector<unsigned>> tileHistograms;
+	try
+	{
+		pixels.resize(pointCount);
+		depths.resize(pointCount);
+		tileHistograms.resize(pointRanges.size(), std::vector<unsigned>(tileCount, 0));
+	}
+	catch (const std::bad_alloc&)
+	{
+		return false;
+	}
+
+	NormalizedProgress nprogress(progressCb, 5);
+	if (progressCb)
+	{
+		if (progressCb->textCanBeEdited())
+		{
+			progressCb->setMethodTitle("Hidden points removal");
+			char infoStr[64];
+			snprintf(infoStr, 64, "Points: %u\nDepth buffer: %u x %u", pointCount, projector.imageWidth(), projector.imageHeight());
+			progressCb->setInfo(infoStr);
+		}
+		progressCb->update(0);
+		progressCb->start();
+	}
+
+	//1) projection of all points (+ tile histogram of each range)
+	ForEachRange(pointRanges, threadCount, [&](const Range& range)
+	{
+		std::vector<unsigned>& histogram = tileHistograms[range.index];
+		for (unsigned i = range.start; i < range.stop; ++i)
+		{
+			unsigned x = 0;
+			unsigned y = 0;
+			if (projector.project(*cloud->getPoint(i), x, y, depths[i]))
+			{
+				pixels[i] = buffer.address(x, y);
+				++histogram[DepthBuffer::TileOf(pixels[i])];
+			}
+			else
+			{
+				pixels[i] = c_invalidPixel;
+			}
+		}
+	});
+
+	if (progressCb && !nprogress.oneStep())
+	{
+		//process cancelled by the user
+		return false;
+	}
+
+	//2) sort the points by tile (counting sort, the histograms become the write cursors of each range)
+	std::vector<unsigned> tileStart;
+	std::vector<unsigned> sortedPoints;
+	try
+	{
+		tileStart.resize(tileCount + 1);
+		unsigned offset = 0;
+		for (unsigned t = 0; t < tileCount; ++t)
+		{
+			tileStart[t] = offset;
+			for (std::vector<unsigned>& histogram : tileHistograms)
+			{
+				unsigned count = histogram[t];
+				histogram[t] = offset;
+				offset += count;
+			}
+		}
+		tileStart[tileCount] = offset;
+		sortedPoints.resize(offset);
+	}
+	catch (const std::bad_alloc&)
+	{
+		return false;
+	}
+
+	ForEachRange(pointRanges, threadCount, [&](const Range& range)
+	{
+		std::vector<unsigned>& cursors = tileHistograms[range.index];
+		for (unsigned i = range.start; i < range.stop; ++i)
+		{
+			if (pixels[i] != c_invalidPixel)
+			{
+				sortedPoints[cursors[DepthBuffer::TileOf(pixels[i])]++] = i;
+			}
+		}
+	});
+	tileHistograms.clear();
+	tileHistograms.shrink_to_fit();
+
+	if (progressCb && !nprogress.oneStep())
+	{
+		//process cancelled by the user
+		return false;
+	}
+
+	//3) fill the depth buffer (each tile is written by a single thread, no synchronization needed)
+	{
+		std::vector<Range> tileRanges = SplitInRanges(tileCount, 4 * threadCount, 1);
+		ForEachRange(tileRanges, threadCount, [&](const Range& range)
+		{
+			for (unsigned t = range.start; t < range.stop; ++t)
+			{
+				for (unsigned j = tileStart[t]; j < tileStart[t + 1]; ++j)
+				{
+					unsigned pointIndex = sortedPoints[j];
+					float& pixelDepth = buffer.depths[pixels[pointIndex]];
+					if (depths[pointIndex] < pixelDepth)
+					{
+						pixelDepth = depths[pointIndex];
+					}
+				}
+			}
+		});
+	}
+	sortedPoints.clear();
+	sortedPoints.shrink_to_fit();
+
+	if (progressCb && !nprogress.oneStep())
+	{
+		//process cancelled by the user
+		return false;
+	}
+
+	//4) minimum depth in the neighbourhood of each pixel (separable min filter)
+	if (params.neighbourhood != 0)
+	{
+		std::vector<float> tempDepths;
+		try
+		{
+			tempDepths.resize(buffer.depths.size(), std::numeric_limits<float>::infinity());
+		}
+		catch (const std::bad_alloc&)
+		{
+			return false;
+		}
+
+		std::vector<Range> rowRanges = SplitInRanges(buffer.height, 4 * threadCount, 1);
+		MinFilter1D(buffer, buffer.depths, tempDepths, params.neighbourhood, true, projector.wrapU(), rowRanges, threadCount);
+		std::vector<Range> columnRanges = SplitInRanges(buffer.width, 4 * threadCount, 1);
+		MinFilter1D(buffer, tempDepths, buffer.depths, params.neighbourhood, false, false, columnRanges, threadCount);
+	}
+
+	if (progressCb && !nprogress.oneStep())
+	{
+		//process cancelled by the user
+		return false;
+	}
+
+	//5) visibility test
+	std::vector<unsigned> rangeVisibleCounts(pointRanges.size(), 0);
+	const float tolerance = static_cast<float>(std::max<PointCoordinateType>(0, params.depthTolerance));
+	ForEachRange(pointRanges, threadCount, [&](const Range& range)
+	{
+		unsigned count = 0;
+		for (unsigned i = range.start; i < range.stop; ++i)
+		{
+			if (pixels[i] != c_invalidPixel && depths[i] <= buffer.depths[pixels[i]] + tolerance)
+			{
+				visibility[i] = POINT_VISIBLE;
+				++count;
+			}
+			else
+			{
+				visibility[i] = POINT_HIDDEN;
+			}
+		}
+		rangeVisibleCounts[range.index] = count;
+	});
+
+	if (progressCb)
+	{
+		nprogress.oneStep();
+		progressCb->stop();
+	}
+
+	if (visibleCount)
+	{
+		for (unsigned count : rangeVisibleCounts)
+		{
+			*visibleCount += count;
+		}
+	}
+
+	return true;
+}
+
+ReferenceCloud* VisibilityTools::RemoveHiddenPoints(GenericIndexedCloudPersist* cloud,
+													const DepthBufferParams& params,
+													ReferenceCloud* hiddenPoints/*=nullptr*/,
+													GenericProgressCallback* progressCb/*=nullptr*/)
+{
+	if (!cloud)
+	{
+		assert(false);
+		return nullptr;
+	}
+	assert(!hiddenPoints || hiddenPoints->getAssociatedCloud() == cloud);
+
+	std::vector<unsigned char> visibility;
+	unsigned visibleCount = 0;
+	if (!ComputeVisibility(cloud, params, visibility, &visibleCount, progressCb))
+	{
+		return nullptr;
+	}
+
+	const unsigned pointCount = cloud->size();
+	const unsigned hiddenCount = pointCount - visibleCount;
+	const unsigned hiddenOffset = (hiddenPoints ? hiddenPoints->size() : 0);
+
+	//the indexes are written in pre-sized spans (setPointIndex would invalidate the bounding-box of the clouds concurrently)
+	ReferenceCloud* visiblePoints = new ReferenceCloud(cloud);
+	unsigned* visibleIndexes = (visibleCount != 0 ? visiblePoints->appendPointIndexSpan(visibleCount) : nullptr);
+	unsigned* hiddenIndexes = (hiddenPoints && hiddenCount != 0 ? hiddenPoints->appendPointIndexSpan(hiddenCount) : nullptr);
+	if ((visibleCount != 0 && !visibleIndexes) || (hiddenPoints && hiddenCount != 0 && !hiddenIndexes))
+	{
+		//not enough memory
+		delete visiblePoints;
+		if (hiddenPoints)
+		{
+			hiddenPoints->resize(hiddenOffset);
+		}
+		return nullptr;
+	}
+
+	//fill the output clouds in bulk (each range writes its own slots)
+	const int threadCount = GetThreadCount(params.maxThreadCount);
+	std::vector<Range> pointRanges = SplitInRanges(pointCount, 4 * threadCount, c_minRangeSize);
+	std::vector<unsigned> visibleStart(pointRanges.size() + 1, 0);
+	for (const Range& range : pointRanges)
+	{
+		unsigned count = 0;
+		for (unsigned i = range.start; i < range.stop; ++i)
+		{
+			if (visibility[i] == POINT_VISIBLE)
+				++count;
+		}
+		visibleStart[range.index + 1] = visibleStart[range.index] + count;
+	}
+
+	ForEachRange(pointRanges, threadCount, [&](const Range& range)
+	{
+		unsigned visibleIndex = visibleStart[range.index];
+		unsigned hiddenIndex = range.start - visibleStart[range.index];
+		for (unsigned i = range.start; i < range.stop; ++i)
+		{
+			if (visibility[i] == POINT_VISIBLE)
+			{
+				visibleIndexes[visibleIndex++] = i;
+			}
+			else if (hiddenIndexes)
+			{
+				hiddenIndexes[hiddenIndex++] = i;
+			}
+		}
+	});
+
+	return visiblePoints;
+}
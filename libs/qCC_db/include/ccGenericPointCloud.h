@@ -120,6 +120,20 @@ public:
 	//! Erases the octree
 	virtual void deleteOctree();
 
+	//! Sets the path of the persistent index cache of this cloud (see ccIndexCache)
+	/** If set (and if the cache is enabled for this cloud), computeOctree first tries
+		to load the octree from the cache, and saves the computed octree otherwise.
+		The cache is only used while the cloud matches the BIN file (see ccIndexCache::IsClean).
+		This path is transient (it is not saved in BIN files nor copied).
+		\param path index cache path
+		\param contentHash hash of the points of the cloud, as saved in the BIN file (see ccIndexCache::ComputeContentHash)
+	**/
+	inline void setIndexCachePath(const QString& path, quint64 contentHash) { m_indexCachePath = path; m_indexCacheHash = contentHash; }
+	//! Returns the path of the persistent index cache of this cloud (if any)
+	inline const QString& getIndexCachePath() const { return m_indexCachePath; }
+	//! Returns the hash of the points of this cloud, as saved in the BIN file of its index cache
+	inline quint64 getIndexCacheHash() const { return m_indexCacheHash; }
+
 
 	/***************************************************
 					Features getters
@@ -332,6 +346,11 @@ protected:
 	//! Point size (won't be applied if 0)
 	unsigned char m_pointSize;
 
+	//! Path of the persistent index cache (see ccIndexCache)
+	QString m_indexCachePath;
+	//! Hash of the points as saved in the BIN file of the persistent index cache
+	quint64 m_indexCacheHash;
+
 };
 
 #endif //CC_GENERIC_POINT_CLOUD_HEADER
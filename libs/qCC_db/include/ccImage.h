@@ -22,6 +22,7 @@
 #include "ccHObject.h"
 
 //Qt
+#include <QDateTime>
 #include <QImage>
 
 class ccCameraSensor;
@@ -51,13 +52,36 @@ public:
 	bool load(const QString& filename, QString& error);
 
 	//! Returns image data
-	inline QImage& data() { return m_image; }
+	/** The data of the images loaded from a BIN file (dataVersion >= 53) is only read when first accessed.
+	**/
+	inline QImage& data() { loadDeferredData(); return m_image; }
 	//! Returns image data (const version)
-	inline const QImage& data() const { return m_image; }
+	inline const QImage& data() const { loadDeferredData(); return m_image; }
+
+	//! Returns whether the image data has not been read (or decoded) yet (see data)
+	inline bool hasDeferredData() const { return !m_deferredFilename.isEmpty() || !m_deferredEncodedData.isEmpty(); }
+
+	//! Returns the (absolute) path of the BIN file from which the image data has not been read yet (if any)
+	inline const QString& getDeferredFilename() const { return m_deferredFilename; }
 
 	//! Sets image data
 	void setData(const QImage& image);
 
+	//! Sets encoded image data (JPEG, PNG, etc.)
+	/** The data is only decoded when first accessed (see data).
+		\param encodedData encoded image
+		\param format image format (see QImage::loadFromData)
+		\param size image size (in pixels)
+	**/
+	void setEncodedData(const QByteArray& encodedData, const QByteArray& format, const QSize& size);
+
+	//! Returns the encoded image data (if it has not been decoded yet)
+	/** \param[out] encodedData encoded image
+		\param[out] format image format
+		\return whether the image data is still encoded
+	**/
+	bool getEncodedData(QByteArray& encodedData, QByteArray& format) const;
+
 	//! Returns image width
 	inline unsigned getW() const { return m_width; }
 
@@ -84,7 +108,7 @@ public:
 	void setAssociatedSensor(ccCameraSensor* sensor);
 
 	//! GetImage
-	QImage getImage(){ return m_image; }
+	QImage getImage(){ return data(); }
 
 	//! Returns associated sensor
 	ccCameraSensor* getAssociatedSensor() { return m_associatedSensor; }
@@ -106,6 +130,9 @@ protected:
 	//! Updates aspect ratio
 	void updateAspectRatio();
 
+	//! Reads the image data from the BIN file or decodes it (if it has not been done yet)
+	void loadDeferredData() const;
+
 	//! Image width (in pixels)
 	unsigned m_width;
 	//! Image height (in pixels)
@@ -121,7 +148,23 @@ protected:
 	float m_texAlpha;
 
 	//! Image data
-	QImage m_image;
+	mutable QImage m_image;
+
+	//! BIN file containing the image data (if it has not been read yet)
+	mutable QString m_deferredFilename;
+	//! Position of the image data in the BIN file
+	qint64 m_deferredOffset;
+	//! Size of the image data in the BIN file (in bytes)
+	qint64 m_deferredByteCount;
+	//! Size of the BIN file when the image has been loaded (to detect if it has changed since)
+	qint64 m_deferredFileSize;
+	//! Last modification time of the BIN file when the image has been loaded
+	QDateTime m_deferredFileTime;
+
+	//! Encoded image data (if it has not been decoded yet)
+	mutable QByteArray m_deferredEncodedData;
+	//! Format of the encoded image data
+	QByteArray m_deferredFormat;
 
 	//! Associated sensor
 	ccCameraSensor* m_associatedSensor;
@@ -0,0 +1,128 @@
+//##########################################################################
+//#                                                                        #
+//#                              CLOUDCOMPARE                              #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                    COPYRIGHT: CloudCompare project                     #
+//#                                                                        #
+//##########################################################################
+
+#ifndef CC_INDEX_CACHE_HEADER
+#define CC_INDEX_CACHE_HEADER
+
+//local
+#include "qCC_db.h"
+#include "ccOctree.h"
+
+//Qt
+#include <QString>
+
+namespace CCCoreLib
+{
+	class FlatKdTree;
+	class GenericIndexedCloud;
+}
+
+class ccGenericPointCloud;
+
+//! Persistent cache of the spatial indexes (octree, KD-tree) of the clouds
+/** The indexes are saved in 'sidecar' files next to the BIN file from which the
+	cloud has been loaded (one file per cloud and per index type, see
+	ccGenericPointCloud::setIndexCachePath). Each file is validated against the
+	cloud content (number of points and hash of their coordinates) and is
+	memory-mapped when loaded: the cell codes don't need to be computed and sorted
+	again, which is most of the octree computation time for large clouds.
+	The files are only read and written while the cloud matches its BIN file (see
+	IsClean): an edited cloud doesn't rewrite them each time its octree is computed.
+	They are written again once the cloud is saved (see Attach).
+**/
+class QCC_DB_LIB_API ccIndexCache
+{
+public:
+
+	//! Index types
+	enum IndexType
+	{
+		OCTREE = 0,
+		KD_TREE = 1
+	};
+
+	//! Returns whether the cache is enabled (persistent setting, true by default)
+	static bool IsEnabled();
+	//! Enables or disables the cache (persistent setting)
+	static void SetEnabled(bool state);
+
+	//! Returns the min number of points of the cached clouds (persistent setting)
+	/** The indexes of smaller clouds are computed almost as fast as they are loaded.
+	**/
+	static unsigned GetMinPointCount();
+	//! Sets the min number of points of the cached clouds (persistent setting)
+	static void SetMinPointCount(unsigned count);
+
+	//! Returns whether the indexes of a given cloud are cached
+	/** The cache must be enabled, the cloud must have an index cache path and
+		enough points.
+	**/
+	static bool IsCached(const ccGenericPointCloud* cloud);
+
+	//! Associates a cloud to the BIN file it has been loaded from (or saved in)
+	/** Sets the index cache path of the cloud, with the hash of its current content
+		(only computed if the cloud is cached).
+		\param cloud cloud
+		\param path index cache path (see ccGenericPointCloud::setIndexCachePath)
+	**/
+	static void Attach(ccGenericPointCloud* cloud, const QString& path);
+
+	//! Returns whether the indexes of a cloud are cached and the cloud still matches its BIN file
+	/** \param cloud cloud
+		\param[out] contentHash the current hash of the cloud (to be passed to the Load and Save methods)
+	**/
+	static bool IsClean(ccGenericPointCloud* cloud, quint64& contentHash);
+
+	//! Returns the sidecar filename of a given index of a cloud
+	static QString SidecarFilename(const ccGenericPointCloud* cloud, IndexType type);
+
+	//! Computes the hash of the points coordinates of a cloud (in parallel)
+	static quint64 ComputeContentHash(CCCoreLib::GenericIndexedCloud* cloud);
+
+	//! Saves the octree of a cloud in its sidecar file
+	/** \param cloud cloud
+		\param octree octree of the cloud
+		\param contentHash current hash of the cloud (see ComputeContentHash)
+		\return success
+	**/
+	static bool SaveOctree(ccGenericPointCloud* cloud, const ccOctree& octree, quint64 contentHash);
+
+	//! Loads the octree of a cloud from its sidecar file
+	/** \param cloud cloud
+		\param contentHash current hash of the cloud (see ComputeContentHash)
+		\return the octree, or a null pointer if there's no (valid) sidecar file
+	**/
+	static ccOctree::Shared LoadOctree(ccGenericPointCloud* cloud, quint64 contentHash);
+
+	//! Saves a KD-tree of a cloud in its sidecar file
+	/** \param cloud cloud
+		\param kdTree KD-tree of the cloud
+		\param contentHash current hash of the cloud (see ComputeContentHash)
+		\return success
+	**/
+	static bool SaveKdTree(ccGenericPointCloud* cloud, const CCCoreLib::FlatKdTree& kdTree, quint64 contentHash);
+
+	//! Loads the KD-tree of a cloud from its sidecar file
+	/** \param cloud cloud
+		\param[out] kdTree KD-tree
+		\param contentHash current hash of the cloud (see ComputeContentHash)
+		\return false if there's no (valid) sidecar file
+	**/
+	static bool LoadKdTree(ccGenericPointCloud* cloud, CCCoreLib::FlatKdTree& kdTree, quint64 contentHash);
+};
+
+#endif //CC_INDEX_CACHE_HEADER
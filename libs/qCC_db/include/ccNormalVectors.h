@@ -24,6 +24,11 @@
 //System
 #include <vector>
 
+namespace CCCoreLib
+{
+	class NeighbourhoodCache;
+}
+
 //! Compressed normal vectors handler
 class QCC_DB_LIB_API ccNormalVectors
 {
@@ -77,6 +82,7 @@ public:
 		\param preferredOrientation specifies a preferred orientation for normals (optional)
 		\param progressCb progress notification (optional)
 		\param inputOctree inputOctree input cloud octree (optional).
+		\param cache neighbourhood cache (optional: used instead of the octree if it can provide the neighbours, i.e. a RADIUS cache for LS and QUADRIC, or a KNN cache for TRI)
 		\return success
 	**/
 	static bool ComputeCloudNormals(ccGenericPointCloud* cloud,
@@ -85,7 +91,8 @@ public:
 									PointCoordinateType localRadius,
 									Orientation preferredOrientation = UNDEFINED,
 									CCCoreLib::GenericProgressCallback* progressCb = 0,
-									CCCoreLib::DgmOctree* inputOctree = 0);
+									CCCoreLib::DgmOctree* inputOctree = 0,
+									const CCCoreLib::NeighbourhoodCache* cache = nullptr);
 
 	//! Tries to guess a very naive 'local radius' for normals computation (see ComputeCloudNormals)
 	/** \param cloud point cloud on which to process the normals.
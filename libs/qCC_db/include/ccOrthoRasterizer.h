@@ -0,0 +1,170 @@
+//##########################################################################
+//#                                                                        #
+//#                              CLOUDCOMPARE                              #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                    COPYRIGHT: CloudCompare project                     #
+//#                                                                        #
+//##########################################################################
+
+#ifndef CC_ORTHO_RASTERIZER_HEADER
+#define CC_ORTHO_RASTERIZER_HEADER
+
+//local
+#include "qCC_db.h"
+#include "ccBBox.h"
+
+//Qt
+#include <QColor>
+#include <QImage>
+#include <QRect>
+
+//system
+#include <vector>
+
+class ccPointCloud;
+
+namespace CCCoreLib
+{
+	class GenericProgressCallback;
+}
+
+//! Headless orthographic point splat rasterizer
+/** Renders a cloud seen from above (i.e. looking towards -Z, with Y up) in
+	images of a fixed metric resolution, without any OpenGL context.
+	The output area is split in 'sheets' (one QImage each), while the rendering
+	itself is done by small tiles, in parallel.
+	The points can be sorted by tile once (see Bin) and then rendered by
+	parts (e.g. one sheet at a time) without going through the whole cloud again.
+**/
+class QCC_DB_LIB_API ccOrthoRasterizer
+{
+public:
+
+	//! Color source
+	enum ColorSource
+	{
+		RGB_COLORS,		//!< Point colors
+		SCALAR_FIELD,	//!< Colors of a scalar field (with its current color scale and display range)
+		DEFAULT_COLOR,	//!< Single color
+	};
+
+	//! Rendering parameters
+	struct Parameters
+	{
+		//! Pixel size (in the cloud units, e.g. meters per pixel)
+		double pixelSize = 0.01;
+		//! Splat radius (in pixels, 0 = one pixel per point)
+		int splatRadius = 1;
+		//! Color source
+		ColorSource colorSource = RGB_COLORS;
+		//! Scalar field index (SCALAR_FIELD mode, -1 = currently displayed SF)
+		int sfIndex = -1;
+		//! Default color (DEFAULT_COLOR mode)
+		QColor defaultColor = Qt::white;
+		//! Background color (empty pixels)
+		QColor backgroundColor = Qt::transparent;
+		//! Sheet width (in pixels, 0 = the whole area width)
+		int sheetWidth = 0;
+		//! Sheet height (in pixels, 0 = the whole area height)
+		int sheetHeight = 0;
+		//! Max thread count (0 = all available threads)
+		int maxThreadCount = 0;
+	};
+
+	//! Output sheet
+	struct Sheet
+	{
+		//! Image
+		QImage image;
+		//! Area covered by the image (X and Y only)
+		ccBBox box;
+		//! Sheet column (from the left)
+		int column = 0;
+		//! Sheet row (from the bottom)
+		int row = 0;
+	};
+
+	//! Points of a cloud sorted by rendering tile
+	struct Binning
+	{
+		//! Binned cloud
+		const ccPointCloud* cloud = nullptr;
+		//! Min corner of the binned area (i.e. of the pixel grid)
+		CCVector3d minCorner;
+		//! Pixel size
+		double pixelSize = 0.0;
+		//! Splat radius (in pixels)
+		int splatRadius = 0;
+		//! Width of the binned area (in pixels)
+		int width = 0;
+		//! Height of the binned area (in pixels)
+		int height = 0;
+		//! Number of tiles along X
+		int tilesX = 0;
+		//! Number of tiles along Y
+		int tilesY = 0;
+		//! Index of the first point of each tile in 'sortedPoints' (+ the total count)
+		std::vector<unsigned> tileStart;
+		//! Point indexes, sorted by tile
+		std::vector<unsigned> sortedPoints;
+	};
+
+	//! Sorts the points of a cloud by rendering tile
+	/** Only the pixel size, the splat radius and the max thread count are used.
+		Points outside the area are ignored (except the splats overlapping its borders).
+		\param cloud cloud to render
+		\param area area to render (only X and Y are considered)
+		\param params rendering parameters
+		\param[out] binning output binning
+		eturn success
+	**/
+	static bool Bin(const ccPointCloud* cloud,
+					const ccBBox& area,
+					const Parameters& params,
+					Binning& binning);
+
+	//! Renders a part of a binned cloud
+	/** The pixel size and the splat radius of the binning are used (instead of
+		the ones of 'params'). The pixel rows go upwards (i.e. row 0 is the bottom
+		of the binned area).
+		\param binning binned cloud (see Bin)
+		\param window pixels to render (clipped to the binned area)
+		\param params rendering parameters
+		\param[out] sheets output sheets (aligned on the bottom-left corner of the window)
+		\param progressCb progress callback (optional)
+		eturn success
+	**/
+	static bool Render(	const Binning& binning,
+						const QRect& window,
+						const Parameters& params,
+						std::vector<Sheet>& sheets,
+						CCCoreLib::GenericProgressCallback* progressCb = nullptr);
+
+	//! Renders a cloud
+	/** The sheets are aligned on the min corner of the area (i.e. the bottom-left corner).
+		Points outside the area are ignored (except the splats overlapping its borders).
+		When several points fall in the same pixel, the highest one (in Z) is kept.
+		\param cloud cloud to render
+		\param area area to render (only X and Y are considered)
+		\param params rendering parameters
+		\param[out] sheets output sheets
+		\param progressCb progress callback (optional)
+		\return success
+	**/
+	static bool Render(	const ccPointCloud* cloud,
+						const ccBBox& area,
+						const Parameters& params,
+						std::vector<Sheet>& sheets,
+						CCCoreLib::GenericProgressCallback* progressCb = nullptr);
+};
+
+#endif //CC_ORTHO_RASTERIZER_HEADER
@@ -0,0 +1,330 @@
+//##########################################################################
+//#                                                                        #
+//#                              CLOUDCOMPARE                              #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                    COPYRIGHT: CloudCompare project                     #
+//#                                                                        #
+//##########################################################################
+
+#ifndef CC_OUT_OF_CORE_CLOUD_HEADER
+#define CC_OUT_OF_CORE_CLOUD_HEADER
+
+//local
+#include "qCC_db.h"
+#include "ccBasicTypes.h"
+#include "ccChunk.h"
+#include "ccColorTypes.h"
+
+//CCCoreLib
+#include <GenericIndexedCloudPersist.h>
+
+//Qt
+#include <QFile>
+#include <QString>
+#include <QStringList>
+
+//system
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class ccPointCloud;
+
+//! Out-of-core point cloud (backed by a memory-mapped chunked store)
+/** The points, colors, compressed normals and scalar fields are stored on disk, by
+	chunks of ccChunk::SIZE points (each chunk is a block aligned on 64 KiB, with all
+	the attributes of its points). The store is memory-mapped (read-only) and the
+	chunks are paged on demand: once the resident memory budget is exceeded, the
+	pages of the least recently used chunks are released (they are transparently
+	read again from the file if needed, so that the point pointers stay persistent).
+
+	The cloud can be used directly by the octree (CCCoreLib::DgmOctree) and by the
+	CCCoreLib algorithms (filters, distances, etc.). For display, a subsampled
+	preview (regular ccPointCloud, with LOD rendering) can be extracted. A region of
+	the cloud can be extracted in memory, edited, and committed back to the store
+	(the rest of the cloud stays read-only).
+
+	Stores are created with ccOutOfCoreCloud::Writer (points are streamed to disk,
+	the whole cloud never has to fit in memory).
+**/
+class QCC_DB_LIB_API ccOutOfCoreCloud : public CCCoreLib::GenericIndexedCloudPersist
+{
+public:
+
+	//! Streamed creation of an out-of-core store
+	class QCC_DB_LIB_API Writer
+	{
+	public:
+
+		//! Default constructor
+		Writer();
+		//! Destructor (closes the file if necessary)
+		~Writer();
+
+		//! Creates a new store
+		/** \param filename store filename
+			\param hasColors whether the points have colors
+			\param hasNormals whether the points have normals
+			\param sfNames scalar field names
+			\param globalShift global shift (see ccShiftedObject)
+			\param globalScale global scale (see ccShiftedObject)
+			\return success
+		**/
+		bool open(	const QString& filename,
+					bool hasColors,
+					bool hasNormals,
+					const QStringList& sfNames,
+					const CCVector3d& globalShift = CCVector3d(0, 0, 0),
+					double globalScale = 1.0);
+
+		//! Adds a point
+		/** \param P point
+			\param color point color (ignored if the store has no color)
+			\param normIndex point compressed normal (ignored if the store has no normal)
+			\param sfValues point scalar values (one per scalar field, or nullptr to set them to NaN)
+			\return false in case of error (write error or too many points)
+		**/
+		bool addPoint(const CCVector3& P, const ccColor::Rgba& color = ccColor::white, CompressedNormType normIndex = 0, const ScalarType* sfValues = nullptr);
+
+		//! Adds all the points of a cloud
+		/** The scalar fields are matched by name (missing ones are set to NaN).
+			The cloud global shift and scale are supposed to be the same as the store ones.
+		**/
+		bool addPoints(const ccPointCloud& cloud);
+
+		//! Writes the last chunk and the header, then closes the file
+		bool close();
+
+		//! Returns the number of points written so far
+		inline unsigned size() const { return m_pointCount; }
+
+	protected:
+
+		//! Writes the current chunk
+		bool flushChunk();
+
+		//! Store file
+		QFile m_file;
+		//! Number of written points
+		unsigned m_pointCount;
+		//! Whether the points have colors
+		bool m_hasColors;
+		//! Whether the points have normals
+		bool m_hasNormals;
+		//! Scalar field names
+		QStringList m_sfNames;
+		//! Global shift
+		CCVector3d m_globalShift;
+		//! Global scale
+		double m_globalScale;
+		//! Bounding-box
+		CCVector3 m_bbMin, m_bbMax;
+		//! Current chunk (in memory)
+		std::vector<char> m_chunk;
+		//! Number of points in the current chunk
+		unsigned m_chunkPointCount;
+	};
+
+	//! Creates a store from a (regular) cloud
+	/** Shortcut to Writer (open + addPoints + close).
+	**/
+	static bool Create(const ccPointCloud& cloud, const QString& filename);
+
+	//! Default constructor
+	ccOutOfCoreCloud();
+	//! Destructor
+	~ccOutOfCoreCloud() override;
+
+	//! Opens a store
+	bool open(const QString& filename);
+	//! Closes the store
+	void close();
+	//! Returns whether a store is opened
+	inline bool isOpen() const { return m_data != nullptr; }
+	//! Returns the store filename
+	inline QString filename() const { return m_file.fileName(); }
+
+	//! Sets the resident memory budget (in bytes)
+	/** At least one chunk always stays resident. Default: 1 GB.
+	**/
+	void setResidentMemoryBudget(size_t bytes);
+	//! Returns the resident memory budget (in bytes)
+	inline size_t residentMemoryBudget() const { return m_residentBudget; }
+	//! Returns the number of resident chunks
+	unsigned residentChunkCount() const;
+	//! Releases the memory of all the chunks
+	void releaseAllChunks();
+
+	//! Returns the number of chunks
+	inline unsigned chunkCount() const { return m_chunkCount; }
+	//! Returns the points of a chunk (ccChunk::Size(chunkIndex, size()) points)
+	const CCVector3* chunkPoints(unsigned chunkIndex) const;
+
+	//! Returns whether the points have colors
+	inline bool hasColors() const { return m_hasColors; }
+	//! Returns whether the points have normals
+	inline bool hasNormals() const { return m_hasNormals; }
+	//! Returns the color of a point (the store must have colors)
+	const ccColor::Rgba& getPointColor(unsigned index) const;
+	//! Returns the compressed normal of a point (the store must have normals)
+	const CompressedNormType& getPointNormalIndex(unsigned index) const;
+
+	//! Returns the number of scalar fields
+	inline unsigned getNumberOfScalarFields() const { return static_cast<unsigned>(m_sfNames.size()); }
+	//! Returns the name of a scalar field
+	inline QString getScalarFieldName(int index) const { return m_sfNames.value(index); }
+	//! Returns the index of a scalar field (or -1 if not found)
+	inline int getScalarFieldIndexByName(const QString& name) const { return m_sfNames.indexOf(name); }
+	//! Returns the value of a scalar field for a given point
+	ScalarType getScalarValue(int sfIndex, unsigned index) const;
+	//! Sets the current scalar field (see getPointScalarValue)
+	/** \warning The stored values are read-only (see commitRegion). setPointScalarValue
+		writes in an in-memory buffer instead (see enableScalarField).
+	**/
+	inline void setCurrentScalarField(int index) { m_currentSFIndex = index; }
+
+	//! Returns the global shift
+	inline const CCVector3d& getGlobalShift() const { return m_globalShift; }
+	//! Returns the global scale
+	inline double getGlobalScale() const { return m_globalScale; }
+
+	//! Creates a subsampled preview of the cloud (for display)
+	/** The points are regularly sampled (colors, normals and scalar fields are kept).
+		\param maxPointCount max number of points
+		\return the preview (or nullptr if not enough memory)
+	**/
+	ccPointCloud* createPreview(unsigned maxPointCount) const;
+
+	//! Extracts the points inside a box in memory (for edition)
+	/** \param bbMin box min corner
+		\param bbMax box max corner
+		\param[out] indexes indexes of the extracted points (in the store)
+		\return the extracted points (or nullptr if the region is empty or if there's not enough memory)
+	**/
+	ccPointCloud* extractRegion(const CCVector3& bbMin, const CCVector3& bbMax, std::vector<unsigned>& indexes) const;
+
+	//! Writes back an edited region in the store
+	/** Coordinates, colors, normals and scalar fields (matched by name) are updated.
+		The region must have the same number of points as when it was extracted.
+		Only the corresponding chunks are written, the rest of the store is untouched.
+		\param region edited region (see extractRegion)
+		\param indexes indexes of the region points (see extractRegion)
+		\return success
+	**/
+	bool commitRegion(const ccPointCloud& region, const std::vector<unsigned>& indexes);
+
+	//inherited from GenericIndexedCloudPersist
+	unsigned size() const override { return m_pointCount; }
+	void forEach(genericPointAction action) override;
+	void getBoundingBox(CCVector3& bbMin, CCVector3& bbMax) override;
+	void placeIteratorAtBeginning() override { m_currentPointIndex = 0; }
+	const CCVector3* getNextPoint() override;
+	bool enableScalarField() override;
+	bool isScalarFieldEnabled() const override;
+	void setPointScalarValue(unsigned pointIndex, ScalarType value) override;
+	ScalarType getPointScalarValue(unsigned pointIndex) const override;
+	const CCVector3* getPoint(unsigned index) const override { return point(index); }
+	void getPoint(unsigned index, CCVector3& P) const override { P = *point(index); }
+	const CCVector3* getPointPersistentPtr(unsigned index) const override { return point(index); }
+
+	//! Returns the in-memory output scalar field (see enableScalarField)
+	inline const std::vector<ScalarType>& outputScalarValues() const { return m_outputSF; }
+
+protected:
+
+	//! Chunk state
+	struct Chunk
+	{
+		//! Whether the chunk is resident
+		std::atomic<bool> resident{ false };
+		//! Last access 'time' (see m_accessClock)
+		std::atomic<unsigned> lastAccess{ 0 };
+	};
+
+	//! Returns the address of a chunk block (and marks it as accessed)
+	inline const char* chunkBlock(unsigned chunkIndex) const
+	{
+		Chunk& chunk = m_chunks[chunkIndex];
+		if (!chunk.resident.load(std::memory_order_relaxed))
+		{
+			makeResident(chunkIndex);
+		}
+		unsigned clock = m_accessClock.load(std::memory_order_relaxed);
+		if (chunk.lastAccess.load(std::memory_order_relaxed) != clock)
+		{
+			chunk.lastAccess.store(clock, std::memory_order_relaxed);
+		}
+		return m_data + m_headerSize + static_cast<size_t>(chunkIndex) * m_blockSize;
+	}
+
+	//! Returns a point
+	inline const CCVector3* point(unsigned index) const
+	{
+		assert(index < m_pointCount);
+		return reinterpret_cast<const CCVector3*>(chunkBlock(static_cast<unsigned>(index >> ccChunk::SIZE_POWER))) + (index & (ccChunk::SIZE - 1));
+	}
+
+	//! Marks a chunk as resident (and releases the least recently used chunks if necessary)
+	void makeResident(unsigned chunkIndex) const;
+	//! Releases the least recently used chunks until the resident memory is below a given size
+	void releaseChunks(size_t maxResidentSize, unsigned chunkToKeep) const;
+
+	//! Store file
+	QFile m_file;
+	//! Mapped store
+	const char* m_data;
+	//! Header size (in bytes)
+	size_t m_headerSize;
+	//! Chunk block size (in bytes)
+	size_t m_blockSize;
+	//! Offsets of the attributes inside a chunk block
+	size_t m_colorsOffset, m_normalsOffset, m_sfOffset;
+
+	//! Number of points
+	unsigned m_pointCount;
+	//! Number of chunks
+	unsigned m_chunkCount;
+	//! Whether the points have colors
+	bool m_hasColors;
+	//! Whether the points have normals
+	bool m_hasNormals;
+	//! Scalar field names
+	QStringList m_sfNames;
+	//! Global shift
+	CCVector3d m_globalShift;
+	//! Global scale
+	double m_globalScale;
+	//! Bounding-box
+	CCVector3 m_bbMin, m_bbMax;
+
+	//! Chunks state
+	std::unique_ptr<Chunk[]> m_chunks;
+	//! Access 'clock' (incremented each time a chunk becomes resident)
+	mutable std::atomic<unsigned> m_accessClock;
+	//! Number of resident chunks
+	mutable unsigned m_residentChunkCount;
+	//! Mutex for the chunks residency
+	mutable std::mutex m_residencyMutex;
+	//! Resident memory budget (in bytes)
+	size_t m_residentBudget;
+
+	//! Iterator
+	unsigned m_currentPointIndex;
+	//! Current (stored) scalar field
+	int m_currentSFIndex;
+	//! In-memory output scalar field (see enableScalarField)
+	std::vector<ScalarType> m_outputSF;
+};
+
+#endif //CC_OUT_OF_CORE_CLOUD_HEADER
@@ -36,6 +36,7 @@
 
 class ccScalarField;
 class ccPolyline;
+class ccTrajectoryIndex;
 class ccMesh;
 class QGLBuffer;
 class ccProgressDialog;
@@ -656,7 +657,7 @@ public: //other methods
 	**/
 	void hidePointsByScalarValue(ScalarType minVal, ScalarType maxVal);
 
-	enum UnrollMode { CYLINDER = 0, CONE = 1, STRAIGHTENED_CONE = 2, STRAIGHTENED_CONE2 = 3 };
+	enum UnrollMode { CYLINDER = 0, CONE = 1, STRAIGHTENED_CONE = 2, STRAIGHTENED_CONE2 = 3, TRAJECTORY = 4 };
 
 	struct UnrollBaseParams
 	{
@@ -672,10 +673,19 @@ public: //other methods
 		CCVector3 apex;				//! Cone apex
 		double coneAngle_deg;		//! Cone aperture angle (in degrees)
 	};
+	struct UnrollTrajectoryParams : public UnrollBaseParams
+	{
+		const ccPointCloud* trajectory = nullptr;	//! Trajectory (poses in acquisition order) used as centerline
+		PointCoordinateType controlStep = 0;		//! Min. spacing between two spline control points (0 = use all poses)
+		unsigned samplesPerSegment = 8;				//! Number of centerline samples between two control points
+	};
 
-	//! Unrolls the cloud and its normals on a cylinder or a cone
+	//! Unrolls the cloud and its normals on a cylinder, a cone or along a trajectory
 	/** This method is redundant with the "developCloudOnCylinder" method of CCCoreLib,
 		apart that it can also handle the cloud normals.
+		In TRAJECTORY mode, the cloud is unrolled around a spline fitted on the trajectory
+		poses: X is the chainage along the centerline, Y the arc length around it (0 = up)
+		and Z the opposite of the distance to the centerline. The angular range is ignored.
 		\param mode unrolling mode
 		\param params unrolling parameters (must match the unrolling mode)
 		\param exportDeviationSF to export the deviation fro the ideal cone as a scalar field
@@ -691,6 +701,24 @@ public: //other methods
 							double stopAngle_deg = 360.0,
 							CCCoreLib::GenericProgressCallback* progressCb = nullptr) const;
 
+	//! Creates a lightweight unrolled 'view' of this cloud
+	/** Only the unrolled coordinates are computed (by chunks, in parallel). The colors and
+		the scalar fields are shared with this cloud (normals are not exported). The view is
+		locked, and the shared attributes are duplicated before either cloud is resized or
+		reordered (see reserve, resize, addColor and swapPoints).
+		The deviation can be computed in the same pass: it is then directly written in the
+		'Deviation' scalar field of this cloud (and shared with the view).
+		\param mode unrolling mode
+		\param params unrolling parameters (must match the unrolling mode)
+		\param exportDeviationSF to export the deviation in this cloud as a scalar field
+		\param progressCb for progress notification
+		\return the unrolled view
+	**/
+	ccPointCloud* createUnrolledView(	UnrollMode mode,
+										UnrollBaseParams* params,
+										bool exportDeviationSF = false,
+										CCCoreLib::GenericProgressCallback* progressCb = nullptr);
+
 	//! Adds associated SF color ramp info to current GL context
 	void addColorRampInfo(CC_DRAW_CONTEXT& context);
 
@@ -763,10 +791,14 @@ public: //other methods
 	void setTrajectory(bool isTrajectory) { m_trajectory = isTrajectory; }
 	bool  isTrajectory() { return m_trajectory; }
 	
-	//! Set trajectory cloud Ptr
-	void setTrajectoryCloud(ccPointCloud*  cloud) { m_trajectoryPtr = cloud;}
+	//! Set trajectory cloud Ptr (and builds the spatial index of its poses)
+	void setTrajectoryCloud(ccPointCloud*  cloud);
 	//! Get the trajectory cloud Ptr
 	ccPointCloud* getTrajectoryCloud() { return m_trajectoryPtr;}
+	//! Returns the spatial index of the trajectory poses (rebuilt if the trajectory has changed)
+	/** \return nullptr if there's no trajectory
+	**/
+	const ccTrajectoryIndex* getTrajectoryIndex();
 
 	//! Set if it is the image PointCloud
 	void setImagePointCloud(bool isImagePointCloud) { m_imagePointCloud = isImagePointCloud; }
@@ -783,6 +815,16 @@ public: //other methods
 
 protected:
 
+	//! Unrolls the cloud along a trajectory (see unroll)
+	ccPointCloud* unrollAlongTrajectory(const UnrollTrajectoryParams& params,
+										bool exportDeviationSF,
+										CCCoreLib::GenericProgressCallback* progressCb) const;
+
+	//! Duplicates the colors and the scalar fields shared with other clouds (see createUnrolledView)
+	/** \return false if there's not enough memory
+	**/
+	bool unshareAttributes();
+
 	//inherited from ccHObject
 	void drawMeOnly(CC_DRAW_CONTEXT& context) override;
 	void applyGLTransformation(const ccGLMatrix& trans) override;
@@ -833,6 +875,10 @@ protected:
 	bool m_trajectory;
 	//! Set trajectory Ptr;
 	ccPointCloud* m_trajectoryPtr;
+	//! Spatial index of the trajectory poses
+	ccTrajectoryIndex* m_trajectoryIndex;
+	//! Whether the trajectory index should be rebuilt
+	bool m_trajectoryIndexIsDirty;
 	//! Set if it is the pointcloud image to be cropped
 	bool m_imagePointCloud;
 
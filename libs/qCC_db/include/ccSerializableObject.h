@@ -20,6 +20,7 @@
 
 //Local
 #include "ccLog.h"
+#include "qCC_db.h"
 
 //CCCoreLib
 #include <CCPlatform.h>
@@ -28,6 +29,7 @@
 //System
 #include <cassert>
 #include <cstdint>
+#include <vector>
 
 //Qt
 #include <QDataStream>
@@ -96,7 +98,7 @@ public:
 };
 
 //! Serialization helpers
-class ccSerializationHelper
+class QCC_DB_LIB_API ccSerializationHelper
 {
 public:
 
@@ -171,22 +173,11 @@ public:
 		if (out.write((const char*)&elementCount, 4) < 0)
 			return ccSerializableObject::WriteError();
 
-		//array data (dataVersion>=20)
-		{
-			//DGM: do it by chunks, in case it's too big to be processed by the system
-			const char* _data = (const char*)data.data();
-			qint64 byteCount = static_cast<qint64>(elementCount);
-			byteCount *= sizeof(Type);
-			while (byteCount != 0)
-			{
-				static const qint64 s_maxByteSaveCount = (1 << 26); //64 Mb each time
-				qint64 saveCount = std::min(byteCount, s_maxByteSaveCount);
-				if (out.write(_data, saveCount) < 0)
-					return ccSerializableObject::WriteError();
-				_data += saveCount;
-				byteCount -= saveCount;
-			}
-		}
+		//array data (dataVersion>=20, compressed by chunks if big enough since dataVersion>=53)
+		assert(sizeof(ComponentType) * N == sizeof(Type));
+		if (!WriteArrayData(out, data.data(), elementCount, sizeof(ComponentType), N))
+			return ccSerializableObject::WriteError();
+
 		return true;
 	}
 
@@ -220,28 +211,11 @@ public:
 			{
 				return ccSerializableObject::MemoryError();
 			}
-
-			//array data (dataVersion>=20)
-			{
-				//Apparently Qt and/or Windows don't like to read too many bytes in a row...
-				static const qint64 MaxElementPerChunk = (static_cast<qint64>(1) << 24);
-				assert(sizeof(ComponentType) * N == sizeof(Type));
-				qint64 byteCount = static_cast<qint64>(data.size()) * (sizeof(ComponentType) * N);
-				char* dest = (char*)data.data();
-				while (byteCount > 0)
-				{
-					qint64 chunkSize = std::min(MaxElementPerChunk, byteCount);
-					if (in.read(dest, chunkSize) < 0)
-					{
-						return ccSerializableObject::ReadError();
-					}
-					byteCount -= chunkSize;
-					dest += chunkSize;
-				}
-			}
 		}
 
-		return true;
+		//array data (dataVersion>=20, compressed by chunks since dataVersion>=53)
+		assert(sizeof(ComponentType) * N == sizeof(Type));
+		return ReadArrayData(in, dataVersion, data.data(), elementCount, sizeof(ComponentType), N);
 	}
 
 	//! Helper: loads a vector structure from a file stored with a different type
@@ -275,6 +249,31 @@ public:
 				return ccSerializableObject::MemoryError();
 			}
 
+			if (dataVersion >= 53)
+			{
+				//array data (dataVersion>=53): decoded as a block, then converted
+				std::vector<FileComponentType> fileData;
+				try
+				{
+					fileData.resize(static_cast<size_t>(elementCount) * N);
+				}
+				catch (const std::bad_alloc&)
+				{
+					return ccSerializableObject::MemoryError();
+				}
+				if (!ReadArrayData(in, dataVersion, fileData.data(), elementCount, sizeof(FileComponentType), N))
+				{
+					return false;
+				}
+
+				ComponentType* _data = (ComponentType*)data.data();
+				for (size_t i = 0; i < fileData.size(); ++i)
+				{
+					_data[i] = static_cast<ComponentType>(fileData[i]);
+				}
+				return true;
+			}
+
 			//array data (dataVersion>=20)
 			//--> saldy we can't read it as a block...
 			//we must convert each element, value by value!
@@ -296,10 +295,41 @@ public:
 				}
 			}
 		}
+		else if (dataVersion >= 53)
+		{
+			//empty array (dataVersion>=53)
+			return ReadArrayData(in, dataVersion, nullptr, 0, sizeof(FileComponentType), N);
+		}
 
 		return true;
 	}
 
+	//! Writes the data of an array (after its header)
+	/** Big arrays (dataVersion>=53) are split in chunks of consecutive elements, compressed in parallel:
+		the values of each component are delta-encoded (on their binary representation, i.e. losslessly),
+		then the bytes are grouped by significance ('byte shuffle') and compressed with zlib. A chunk
+		index is stored before the chunks so that they can be decoded independently.
+		\param out output file (must be already opened)
+		\param data array data
+		\param elementCount number of elements
+		\param componentSize size of each component (in bytes)
+		\param componentCount number of components per element
+		\return success
+	**/
+	static bool WriteArrayData(QFile& out, const void* data, qint64 elementCount, size_t componentSize, int componentCount);
+
+	//! Reads the data of an array (after its header)
+	/** The compressed chunks (dataVersion>=53) are decoded in parallel.
+		\param in input file (must be already opened)
+		\param dataVersion data version
+		\param data destination (already allocated)
+		\param elementCount number of elements
+		\param componentSize size of each component (in bytes)
+		\param componentCount number of components per element
+		\return success
+	**/
+	static bool ReadArrayData(QFile& in, short dataVersion, void* data, qint64 elementCount, size_t componentSize, int componentCount);
+
 protected:
 
 	static bool ReadArrayHeader(QFile& in,
@@ -0,0 +1,137 @@
+//##########################################################################
+//#                                                                        #
+//#                              CLOUDCOMPARE                              #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                    COPYRIGHT: CloudCompare project                     #
+//#                                                                        #
+//##########################################################################
+
+#ifndef CC_TRAJECTORY_INDEX_HEADER
+#define CC_TRAJECTORY_INDEX_HEADER
+
+//local
+#include "qCC_db.h"
+#include "ccGLMatrix.h"
+
+//system
+#include <vector>
+
+class ccPointCloud;
+
+//! Spatial index of the poses of a trajectory cloud
+/** The poses (position + 'qw', 'qx', 'qy' and 'qz' scalar fields) are copied
+	and indexed in a balanced KD-tree (stored in place, in a single array).
+	All queries are exact and thread-safe (the index is read-only once built).
+**/
+class QCC_DB_LIB_API ccTrajectoryIndex
+{
+public:
+
+	//! Camera pose
+	struct Pose
+	{
+		//! Camera center
+		CCVector3d center;
+		//! Global to camera transformation (the camera looks towards +Y, with Z up)
+		ccGLMatrixd toCamera;
+		//! Whether the orientation is known (i.e. the trajectory has quaternions)
+		bool hasOrientation = false;
+	};
+
+	//! Camera field of view (see findPosesSeeingPoint)
+	struct FieldOfView
+	{
+		//! Horizontal aperture (in degrees, 360 = full panorama)
+		double horizontalAngle_deg = 360.0;
+		//! Vertical aperture (in degrees, 180 = full panorama)
+		double verticalAngle_deg = 180.0;
+		//! Near distance
+		double zNear = 0.0;
+		//! Far distance
+		double zFar = 10.0;
+	};
+
+	//! Default constructor
+	ccTrajectoryIndex();
+
+	//! Builds the index from a trajectory cloud
+	/** \return false if the cloud is empty or if there's not enough memory
+	**/
+	bool build(ccPointCloud* trajectory);
+
+	//! Clears the index
+	void clear();
+
+	//! Returns the number of indexed poses
+	inline unsigned size() const { return static_cast<unsigned>(m_poses.size()); }
+	//! Returns whether the index is empty
+	inline bool empty() const { return m_poses.empty(); }
+
+	//! Returns a pose (by trajectory point index)
+	inline const Pose& pose(unsigned index) const { return m_poses[index]; }
+
+	//! Returns the closest pose to a point
+	/** \param P query point
+		\param[out] squareDist squared distance to the pose (optional)
+		\return the pose index (or -1 if the index is empty)
+	**/
+	int closestPose(const CCVector3d& P, double* squareDist = nullptr) const;
+
+	//! Returns the closest pose for each point of a set (in parallel)
+	void closestPoses(const std::vector<CCVector3d>& points, std::vector<int>& poseIndexes) const;
+
+	//! Returns the k nearest poses of a point (sorted by increasing distance)
+	void findNearestPoses(	const CCVector3d& P,
+							unsigned k,
+							std::vector<unsigned>& poseIndexes,
+							std::vector<double>* squareDistances = nullptr) const;
+
+	//! Returns the poses inside a sphere (sorted by increasing distance)
+	void findPosesInSphere(const CCVector3d& P, double radius, std::vector<unsigned>& poseIndexes) const;
+
+	//! Returns the poses that see a point, i.e. for which the point is in the field of view (sorted by increasing distance)
+	/** Occlusions are not taken into account.
+	**/
+	void findPosesSeeingPoint(const CCVector3d& P, const FieldOfView& fov, std::vector<unsigned>& poseIndexes) const;
+
+	//! Returns the closest pose that sees a point (or -1 if none)
+	int closestPoseSeeingPoint(const CCVector3d& P, const FieldOfView& fov) const;
+
+	//! Returns the closest pose seeing each point of a set (in parallel, -1 if none)
+	void closestPosesSeeingPoints(const std::vector<CCVector3d>& points, const FieldOfView& fov, std::vector<int>& poseIndexes) const;
+
+	//! Returns whether a point is in the field of view of a pose (distance and angles)
+	static bool IsInFieldOfView(const Pose& pose, const CCVector3d& P, const FieldOfView& fov);
+
+protected:
+
+	//! Candidate (squared distance, pose index)
+	using Candidate = std::pair<double, unsigned>;
+
+	//! Recursively builds the tree in [begin, end[
+	void buildNode(unsigned begin, unsigned end);
+
+	//! k-nearest neighbours search in [begin, end[ ('heap' is a max-heap of size <= k)
+	void searchKNN(unsigned begin, unsigned end, const CCVector3d& P, unsigned k, std::vector<Candidate>& heap) const;
+
+	//! Radius search in [begin, end[
+	void searchSphere(unsigned begin, unsigned end, const CCVector3d& P, double squareRadius, std::vector<Candidate>& candidates) const;
+
+	//! Poses (in the trajectory order)
+	std::vector<Pose> m_poses;
+	//! Tree nodes: the node of [begin, end[ is stored at (begin + end) / 2
+	std::vector<unsigned> m_nodes;
+	//! Split dimension of each node
+	std::vector<unsigned char> m_splitDims;
+};
+
+#endif //CC_TRAJECTORY_INDEX_HEADER
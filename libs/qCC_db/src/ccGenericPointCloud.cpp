@@ -29,6 +29,7 @@
 
 //Local
 #include "ccGenericGLDisplay.h"
+#include "ccIndexCache.h"
 #include "ccOctreeProxy.h"
 #include "ccPointCloud.h"
 #include "ccProgressDialog.h"
@@ -39,6 +40,7 @@
 ccGenericPointCloud::ccGenericPointCloud(QString name, unsigned uniqueID)
 	: ccShiftedObject(name, uniqueID)
 	, m_pointSize(0)
+	, m_indexCacheHash(0)
 {
 	setVisible(true);
 	lockVisibility(false);
@@ -48,6 +50,7 @@ ccGenericPointCloud::ccGenericPointCloud(const ccGenericPointCloud& cloud)
 	: ccShiftedObject(cloud)
 	, m_pointsVisibility(cloud.m_pointsVisibility)
 	, m_pointSize(cloud.m_pointSize)
+	, m_indexCacheHash(0)
 {
 }
 
@@ -217,11 +220,31 @@ void ccGenericPointCloud::setOctree(ccOctree::Shared octree, bool autoAddChild/*
 ccOctree::Shared ccGenericPointCloud::computeOctree(CCCoreLib::GenericProgressCallback* progressCb, bool autoAddChild/*=true*/)
 {
 	deleteOctree();
+
+	//try to load the octree from the persistent cache first
+	//(the cache is left untouched while the cloud doesn't match its BIN file, e.g. while it is edited)
+	quint64 contentHash = 0;
+	bool useIndexCache = ccIndexCache::IsClean(this, contentHash);
+	if (useIndexCache)
+	{
+		ccOctree::Shared octree = ccIndexCache::LoadOctree(this, contentHash);
+		if (octree)
+		{
+			setOctree(octree, autoAddChild);
+			return octree;
+		}
+	}
 	
 	ccOctree::Shared octree = ccOctree::Shared(new ccOctree(this));
 	if (octree->build(progressCb) > 0)
 	{
 		setOctree(octree, autoAddChild);
+
+		if (useIndexCache)
+		{
+			//not a big deal if it fails (a warning is already issued)
+			ccIndexCache::SaveOctree(this, *octree, contentHash);
+		}
 	}
 	else
 	{
@@ -542,17 +565,7 @@ CCCoreLib::ReferenceCloud* ccGenericPointCloud::getTheVisiblePoints(const Visibi
 	
 	if (pointCount)
 	{
-		if (rc->reserve(pointCount))
-		{
-			for (unsigned i = 0; i < count; ++i)
-			{
-				if (visTable->at(i) == CCCoreLib::POINT_VISIBLE)
-				{
-					rc->addPointIndex(i); //can't fail (see above)
-				}
-			}
-		}
-		else
+		if (!rc->addFlaggedPointIndexes(visTable->data(), count, CCCoreLib::POINT_VISIBLE))
 		{
 			ccLog::Warning("[ccGenericPointCloud::getTheVisiblePoints] Not enough memory!");
 			delete rc;
@@ -600,17 +613,7 @@ CCCoreLib::ReferenceCloud* ccGenericPointCloud::getTheHighlightedPoints(const Vi
 
 	if (pointCount)
 	{
-		if (rc->reserve(pointCount))
-		{
-			for (unsigned i = 0; i < count; ++i)
-			{
-				if (visTable->at(i) == CCCoreLib::POINT_HIGHLIGHTED)
-				{
-					rc->addPointIndex(i); //can't fail (see above)
-				}
-			}
-		}
-		else
+		if (!rc->addFlaggedPointIndexes(visTable->data(), count, CCCoreLib::POINT_HIGHLIGHTED))
 		{
 			ccLog::Warning("[ccGenericPointCloud::getTheVisiblePoints] Not enough memory!");
 			delete rc;
@@ -24,6 +24,7 @@
 #include "ccCameraSensor.h"
 
 //Qt
+#include <QBuffer>
 #include <QFileInfo>
 #include <QImageReader>
 #include <QOpenGLTexture>
@@ -34,6 +35,9 @@ ccImage::ccImage()
 	, m_height(0)
 	, m_aspectRatio(1.0f)
 	, m_texAlpha(1.0f)
+	, m_deferredOffset(0)
+	, m_deferredByteCount(0)
+	, m_deferredFileSize(0)
 	, m_associatedSensor(nullptr)
 {
 	setVisible(true);
@@ -49,6 +53,9 @@ ccImage::ccImage(const QImage& image, const QString& name)
 	, m_aspectRatio(1.0f)
 	, m_texAlpha(1.0f)
 	, m_image(image)
+	, m_deferredOffset(0)
+	, m_deferredByteCount(0)
+	, m_deferredFileSize(0)
 	, m_associatedSensor(nullptr)
 {
 	updateAspectRatio();
@@ -78,20 +85,92 @@ bool ccImage::load(const QString& filename, QString& error)
 
 void ccImage::setData(const QImage& image)
 {
+	m_deferredFilename.clear();
+	m_deferredEncodedData.clear();
 	m_image = image;
 	m_width = m_image.width();
 	m_height = m_image.height();
 	updateAspectRatio();
 }
 
+void ccImage::setEncodedData(const QByteArray& encodedData, const QByteArray& format, const QSize& size)
+{
+	m_deferredFilename.clear();
+	m_image = QImage();
+	m_deferredEncodedData = encodedData;
+	m_deferredFormat = format;
+	m_width = static_cast<unsigned>(qMax(0, size.width()));
+	m_height = static_cast<unsigned>(qMax(0, size.height()));
+	updateAspectRatio();
+}
+
+bool ccImage::getEncodedData(QByteArray& encodedData, QByteArray& format) const
+{
+	if (m_deferredEncodedData.isEmpty())
+	{
+		return false;
+	}
+
+	encodedData = m_deferredEncodedData;
+	format = m_deferredFormat;
+	return true;
+}
+
 void ccImage::updateAspectRatio()
 {
 	setAspectRatio(m_height != 0 ? static_cast<float>(m_width) / m_height : 1.0f);
 }
 
+void ccImage::loadDeferredData() const
+{
+	if (!m_deferredEncodedData.isEmpty())
+	{
+		QByteArray encodedData = m_deferredEncodedData;
+		m_deferredEncodedData.clear();
+
+		if (!m_image.loadFromData(encodedData, m_deferredFormat.isEmpty() ? nullptr : m_deferredFormat.constData()))
+		{
+			ccLog::Warning(QString("[ccImage] Failed to decode the data of image '%1'").arg(getName()));
+		}
+		return;
+	}
+
+	if (m_deferredFilename.isEmpty())
+	{
+		//nothing to do
+		return;
+	}
+
+	QString filename = m_deferredFilename;
+	m_deferredFilename.clear();
+
+	//the file may have been overwritten since the image has been loaded
+	QFileInfo fileInfo(filename);
+	if (fileInfo.size() != m_deferredFileSize || fileInfo.lastModified() != m_deferredFileTime)
+	{
+		ccLog::Warning(QString("[ccImage] Can't read the data of image '%1': file '%2' has changed since it was loaded").arg(getName(), filename));
+		return;
+	}
+
+	QByteArray imageBytes;
+	QFile in(filename);
+	if (in.open(QIODevice::ReadOnly) && in.seek(m_deferredOffset))
+	{
+		imageBytes = in.read(m_deferredByteCount);
+	}
+	if (imageBytes.size() != m_deferredByteCount)
+	{
+		ccLog::Warning(QString("[ccImage] Failed to read the data of image '%1' from file '%2'").arg(getName(), filename));
+		return;
+	}
+
+	QDataStream imageStream(imageBytes);
+	imageStream >> m_image;
+}
+
 void ccImage::drawMeOnly(CC_DRAW_CONTEXT& context)
 {
-	if (m_image.isNull())
+	if (data().isNull())
 		return;
 
 	if (!MACRO_Draw2D(context) || !MACRO_Foreground(context))
@@ -185,7 +264,17 @@ bool ccImage::toFile_MeOnly(QFile& out) const
 	outStream << texU;
 	outStream << texV;
 	outStream << m_texAlpha;
-	outStream << m_image;
+
+	//image data (dataVersion>=53: encoded separately, so that it can be read on demand)
+	QByteArray imageBytes;
+	{
+		QBuffer buffer(&imageBytes);
+		buffer.open(QIODevice::WriteOnly);
+		QDataStream imageStream(&buffer);
+		imageStream << data();
+	}
+	outStream << imageBytes;
+
 	QString fakeString;
 	outStream << fakeString; //formerly: 'complete filename'
 
@@ -216,7 +305,27 @@ bool ccImage::fromFile_MeOnly(QFile& in, short dataVersion, int flags, LoadedIDM
 	inStream >> texU;
 	inStream >> texV;
 	inStream >> m_texAlpha;
-	inStream >> m_image;
+	if (dataVersion >= 53)
+	{
+		//the image data is only read when first accessed (see data)
+		quint32 imageByteCount = 0;
+		inStream >> imageByteCount;
+		if (imageByteCount != 0 && imageByteCount != 0xFFFFFFFF) //0xFFFFFFFF = null QByteArray
+		{
+			QFileInfo fileInfo(in.fileName());
+			m_deferredFilename = fileInfo.absoluteFilePath();
+			m_deferredFileSize = fileInfo.size();
+			m_deferredFileTime = fileInfo.lastModified();
+			m_deferredOffset = in.pos();
+			m_deferredByteCount = static_cast<qint64>(imageByteCount);
+			if (!in.seek(m_deferredOffset + m_deferredByteCount))
+				return ReadError();
+		}
+	}
+	else
+	{
+		inStream >> m_image;
+	}
 	QString fakeString;
 	inStream >> fakeString; //formerly: 'complete filename'
 
@@ -0,0 +1,539 @@
+//##########################################################################
+//#                                                                        #
+//#                              CLOUDCOMPARE                              #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                    COPYRIGHT: CloudCompare project                     #
+//#                                                                        #
+//##########################################################################
+
+#include "ccIndexCache.h"
+
+//local
+#include "ccGenericPointCloud.h"
+#include "ccLog.h"
+
+//CCCoreLib
+#include <FlatKdTree.h>
+#include <TaskScheduler.h>
+
+//Qt
+#include <QFile>
+#include <QSaveFile>
+#include <QSettings>
+
+//system
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	//! Sidecar file header
+	struct SidecarHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t type;
+		uint32_t coordinateSize;
+		uint32_t pointCount;
+		uint64_t contentHash;
+		//! Index parameters (see SaveOctree and SaveKdTree)
+		uint32_t parameters[4];
+		//! Data sections (see SaveOctree and SaveKdTree)
+		uint64_t sectionOffsets[3];
+		uint64_t sectionSizes[3];
+	};
+
+	const char c_sidecarMagic[8] = { 'C', 'C', 'I', 'D', 'X', 'C', 'H', 'E' };
+	const uint32_t c_sidecarVersion = 1;
+
+	//! Alignment of the header and of the data sections (so that the mapped data are properly aligned)
+	const uint64_t c_sectionAlignment = 4096;
+	//! Max size of a single write
+	const uint64_t c_writeChunkSize = (1 << 26);
+	//! Number of points per hash chunk
+	const unsigned c_hashChunkSize = (1 << 16);
+
+	//persistent settings
+	const char c_settingsGroup[] = "IndexCache";
+	const char c_settingsEnabled[] = "Enabled";
+	const char c_settingsMinPointCount[] = "MinPointCount";
+	const unsigned c_defaultMinPointCount = 10000000;
+
+	inline uint64_t AlignOffset(uint64_t offset)
+	{
+		return ((offset + c_sectionAlignment - 1) / c_sectionAlignment) * c_sectionAlignment;
+	}
+
+	inline uint64_t HashMix(uint64_t h, uint64_t value)
+	{
+		h ^= value * 0x9E3779B97F4A7C15ULL;
+		h = (h << 31) | (h >> 33);
+		return h * 0xBF58476D1CE4E5B9ULL;
+	}
+
+	//! Data section (to write)
+	struct Section
+	{
+		const void* data;
+		uint64_t size;
+	};
+
+	bool WriteSidecar(const QString& filename, SidecarHeader& header, const std::vector<Section>& sections)
+	{
+		assert(sections.size() <= 3);
+
+		uint64_t offset = AlignOffset(sizeof(SidecarHeader));
+		for (size_t i = 0; i < sections.size(); ++i)
+		{
+			header.sectionOffsets[i] = offset;
+			header.sectionSizes[i] = sections[i].size;
+			offset = AlignOffset(offset + sections[i].size);
+		}
+
+		QSaveFile file(filename);
+		if (!file.open(QIODevice::WriteOnly))
+		{
+			ccLog::Warning(QString("[ccIndexCache] Failed to create file '%1'").arg(filename));
+			return false;
+		}
+
+		static const std::vector<char> s_padding(c_sectionAlignment, 0);
+
+		bool success = (file.write(reinterpret_cast<const char*>(&header), sizeof(SidecarHeader)) == static_cast<qint64>(sizeof(SidecarHeader)));
+		uint64_t written = sizeof(SidecarHeader);
+		for (size_t i = 0; i < sections.size() && success; ++i)
+		{
+			//padding
+			qint64 paddingSize = static_cast<qint64>(header.sectionOffsets[i] - written);
+			success = (paddingSize == 0 || file.write(s_padding.data(), paddingSize) == paddingSize);
+			written = header.sectionOffsets[i];
+
+			//data (by chunks)
+			const char* data = static_cast<const char*>(sections[i].data);
+			for (uint64_t pos = 0; pos < sections[i].size && success; pos += c_writeChunkSize)
+			{
+				qint64 chunkSize = static_cast<qint64>(std::min(c_writeChunkSize, sections[i].size - pos));
+				success = (file.write(data + pos, chunkSize) == chunkSize);
+			}
+			written += sections[i].size;
+		}
+
+		if (!success)
+		{
+			file.cancelWriting();
+			ccLog::Warning(QString("[ccIndexCache] Failed to write file '%1'").arg(filename));
+			return false;
+		}
+		if (!file.commit())
+		{
+			ccLog::Warning(QString("[ccIndexCache] Failed to save file '%1'").arg(filename));
+			return false;
+		}
+
+		return true;
+	}
+
+	//! Memory-mapped sidecar file
+	class MappedSidecar
+	{
+	public:
+
+		~MappedSidecar()
+		{
+			if (m_data)
+			{
+				m_file.unmap(m_data);
+			}
+		}
+
+		//! Maps and validates a sidecar file
+		/** \param contentHash current hash of the cloud (see ccIndexCache::ComputeContentHash)
+			\return false if the file doesn't exist or is invalid (or outdated)
+		**/
+		bool open(const QString& filename, ccIndexCache::IndexType type, ccGenericPointCloud* cloud, quint64 contentHash, unsigned sectionCount)
+		{
+			m_file.setFileName(filename);
+			if (!m_file.exists())
+			{
+				//nothing to do
+				return false;
+			}
+			if (!m_file.open(QIODevice::ReadOnly))
+			{
+				ccLog::Warning(QString("[ccIndexCache] Failed to open file '%1'").arg(filename));
+				return false;
+			}
+
+			qint64 fileSize = m_file.size();
+			if (fileSize < static_cast<qint64>(sizeof(SidecarHeader)))
+			{
+				ccLog::Warning(QString("[ccIndexCache] Invalid file '%1'").arg(filename));
+				return false;
+			}
+
+			m_data = m_file.map(0, fileSize);
+			if (!m_data)
+			{
+				ccLog::Warning(QString("[ccIndexCache] Failed to map file '%1'").arg(filename));
+				return false;
+			}
+
+			const SidecarHeader& h = header();
+			if (	memcmp(h.magic, c_sidecarMagic, sizeof(c_sidecarMagic)) != 0
+				||	h.version != c_sidecarVersion
+				||	h.type != static_cast<uint32_t>(type)
+				||	h.coordinateSize != sizeof(PointCoordinateType) )
+			{
+				ccLog::Warning(QString("[ccIndexCache] Invalid or incompatible file '%1'").arg(filename));
+				return false;
+			}
+
+			for (unsigned i = 0; i < sectionCount; ++i)
+			{
+				if (	h.sectionOffsets[i] > static_cast<uint64_t>(fileSize)
+					||	h.sectionSizes[i] > static_cast<uint64_t>(fileSize) - h.sectionOffsets[i]
+					||	(h.sectionOffsets[i] % c_sectionAlignment) != 0 )
+				{
+					ccLog::Warning(QString("[ccIndexCache] File '%1' is truncated or corrupted").arg(filename));
+					return false;
+				}
+			}
+
+			//eventually, check that the file matches the cloud
+			if (	h.pointCount != cloud->size()
+				||	h.contentHash != contentHash )
+			{
+				ccLog::Print(QString("[ccIndexCache] File '%1' is outdated (cloud '%2' has changed)").arg(filename, cloud->getName()));
+				return false;
+			}
+
+			return true;
+		}
+
+		inline const SidecarHeader& header() const { return *reinterpret_cast<const SidecarHeader*>(m_data); }
+		inline const uchar* section(unsigned i) const { return m_data + header().sectionOffsets[i]; }
+
+	protected:
+
+		QFile m_file;
+		uchar* m_data = nullptr;
+	};
+
+	void InitHeader(SidecarHeader& header, ccIndexCache::IndexType type, ccGenericPointCloud* cloud, quint64 contentHash)
+	{
+		memset(&header, 0, sizeof(SidecarHeader));
+		memcpy(header.magic, c_sidecarMagic, sizeof(c_sidecarMagic));
+		header.version = c_sidecarVersion;
+		header.type = static_cast<uint32_t>(type);
+		header.coordinateSize = sizeof(PointCoordinateType);
+		header.pointCount = cloud->size();
+		header.contentHash = contentHash;
+	}
+}
+
+bool ccIndexCache::IsEnabled()
+{
+	QSettings settings;
+	settings.beginGroup(c_settingsGroup);
+	return settings.value(c_settingsEnabled, true).toBool();
+}
+
+void ccIndexCache::SetEnabled(bool state)
+{
+	QSettings settings;
+	settings.beginGroup(c_settingsGroup);
+	settings.setValue(c_settingsEnabled, state);
+}
+
+unsigned ccIndexCache::GetMinPointCount()
+{
+	QSettings settings;
+	settings.beginGroup(c_settingsGroup);
+	return settings.value(c_settingsMinPointCount, c_defaultMinPointCount).toUInt();
+}
+
+void ccIndexCache::SetMinPointCount(unsigned count)
+{
+	QSettings settings;
+	settings.beginGroup(c_settingsGroup);
+	settings.setValue(c_settingsMinPointCount, count);
+}
+
+bool ccIndexCache::IsCached(const ccGenericPointCloud* cloud)
+{
+	return	cloud
+		&&	!cloud->getIndexCachePath().isEmpty()
+		&&	cloud->size() != 0
+		&&	cloud->size() >= GetMinPointCount()
+		&&	IsEnabled();
+}
+
+void ccIndexCache::Attach(ccGenericPointCloud* cloud, const QString& path)
+{
+	if (!cloud)
+	{
+		assert(false);
+		return;
+	}
+
+	cloud->setIndexCachePath(path, 0);
+	if (IsCached(cloud))
+	{
+		cloud->setIndexCachePath(path, ComputeContentHash(cloud));
+	}
+}
+
+bool ccIndexCache::IsClean(ccGenericPointCloud* cloud, quint64& contentHash)
+{
+	if (!IsCached(cloud))
+	{
+		return false;
+	}
+
+	contentHash = ComputeContentHash(cloud);
+	return (contentHash == cloud->getIndexCacheHash());
+}
+
+QString ccIndexCache::SidecarFilename(const ccGenericPointCloud* cloud, IndexType type)
+{
+	assert(cloud);
+	switch (type)
+	{
+	case OCTREE:
+		return cloud->getIndexCachePath() + ".octree.ccidx";
+	case KD_TREE:
+		return cloud->getIndexCachePath() + ".kdtree.ccidx";
+	}
+
+	assert(false);
+	return QString();
+}
+
+quint64 ccIndexCache::ComputeContentHash(CCCoreLib::GenericIndexedCloud* cloud)
+{
+	if (!cloud)
+	{
+		assert(false);
+		return 0;
+	}
+
+	unsigned pointCount = cloud->size();
+	unsigned chunkCount = (pointCount + c_hashChunkSize - 1) / c_hashChunkSize;
+	std::vector<uint64_t> chunkHashes(chunkCount, 0);
+	CCCoreLib::PointSpans spans = cloud->getPointSpans();
+
+	//each chunk is hashed independently (in parallel)
+	CCCoreLib::TaskScheduler().run(chunkCount, [&](unsigned chunkIndex)
+	{
+		unsigned first = chunkIndex * c_hashChunkSize;
+		unsigned last = std::min(first + c_hashChunkSize, pointCount);
+
+		uint64_t h = chunkIndex + 1;
+		for (unsigned i = first; i < last; ++i)
+		{
+			CCVector3 P;
+			if (spans.isValid())
+			{
+				P = spans.point(i);
+			}
+			else
+			{
+				cloud->getPoint(i, P);
+			}
+
+			uint32_t words[sizeof(CCVector3) / sizeof(uint32_t)];
+			memcpy(words, P.u, sizeof(CCVector3));
+			for (uint32_t w : words)
+			{
+				h = HashMix(h, w);
+			}
+		}
+		chunkHashes[chunkIndex] = h;
+
+		return true;
+	});
+
+	uint64_t h = pointCount;
+	for (uint64_t chunkHash : chunkHashes)
+	{
+		h = HashMix(h, chunkHash);
+	}
+
+	return h;
+}
+
+bool ccIndexCache::SaveOctree(ccGenericPointCloud* cloud, const ccOctree& octree, quint64 contentHash)
+{
+	if (!cloud || cloud->getIndexCachePath().isEmpty())
+	{
+		assert(false);
+		return false;
+	}
+
+	CCCoreLib::DgmOctree::Structure structure;
+	octree.getStructure(structure);
+	const CCCoreLib::DgmOctree::cellsContainer& cellCodes = octree.pointsAndTheirCellCodes();
+
+	SidecarHeader header;
+	InitHeader(header, OCTREE, cloud, contentHash);
+	header.parameters[0] = static_cast<uint32_t>(CCCoreLib::DgmOctree::MAX_OCTREE_LEVEL);
+	header.parameters[1] = sizeof(CCCoreLib::DgmOctree::Structure);
+	header.parameters[2] = sizeof(CCCoreLib::DgmOctree::IndexAndCode);
+
+	std::vector<Section> sections{	{ &structure, sizeof(CCCoreLib::DgmOctree::Structure) },
+									{ cellCodes.data(), cellCodes.size() * sizeof(CCCoreLib::DgmOctree::IndexAndCode) } };
+
+	QString filename = SidecarFilename(cloud, OCTREE);
+	if (!WriteSidecar(filename, header, sections))
+	{
+		return false;
+	}
+
+	ccLog::Print(QString("[ccIndexCache] Octree of cloud '%1' saved in '%2'").arg(cloud->getName(), filename));
+	return true;
+}
+
+ccOctree::Shared ccIndexCache::LoadOctree(ccGenericPointCloud* cloud, quint64 contentHash)
+{
+	if (!cloud || cloud->getIndexCachePath().isEmpty())
+	{
+		assert(false);
+		return ccOctree::Shared();
+	}
+
+	QString filename = SidecarFilename(cloud, OCTREE);
+	MappedSidecar sidecar;
+	if (!sidecar.open(filename, OCTREE, cloud, contentHash, 2))
+	{
+		return ccOctree::Shared();
+	}
+
+	const SidecarHeader& header = sidecar.header();
+	if (	header.parameters[0] != static_cast<uint32_t>(CCCoreLib::DgmOctree::MAX_OCTREE_LEVEL)
+		||	header.parameters[1] != sizeof(CCCoreLib::DgmOctree::Structure)
+		||	header.parameters[2] != sizeof(CCCoreLib::DgmOctree::IndexAndCode)
+		||	header.sectionSizes[0] != sizeof(CCCoreLib::DgmOctree::Structure) )
+	{
+		ccLog::Warning(QString("[ccIndexCache] Incompatible octree in file '%1'").arg(filename));
+		return ccOctree::Shared();
+	}
+
+	CCCoreLib::DgmOctree::Structure structure;
+	memcpy(&structure, sidecar.section(0), sizeof(CCCoreLib::DgmOctree::Structure));
+	if (header.sectionSizes[1] != static_cast<uint64_t>(structure.numberOfProjectedPoints) * sizeof(CCCoreLib::DgmOctree::IndexAndCode))
+	{
+		ccLog::Warning(QString("[ccIndexCache] File '%1' is corrupted").arg(filename));
+		return ccOctree::Shared();
+	}
+
+	ccOctree::Shared octree(new ccOctree(cloud));
+	if (!octree->restore(structure, reinterpret_cast<const CCCoreLib::DgmOctree::IndexAndCode*>(sidecar.section(1))))
+	{
+		ccLog::Warning(QString("[ccIndexCache] Failed to restore the octree from file '%1' (corrupted file or not enough memory)").arg(filename));
+		return ccOctree::Shared();
+	}
+
+	ccLog::Print(QString("[ccIndexCache] Octree of cloud '%1' loaded from '%2'").arg(cloud->getName(), filename));
+	return octree;
+}
+
+bool ccIndexCache::SaveKdTree(ccGenericPointCloud* cloud, const CCCoreLib::FlatKdTree& kdTree, quint64 contentHash)
+{
+	if (!cloud || cloud->getIndexCachePath().isEmpty() || kdTree.getAssociatedCloud() != cloud)
+	{
+		assert(false);
+		return false;
+	}
+	if (kdTree.size() != cloud->size())
+	{
+		ccLog::Warning("[ccIndexCache] The KD-tree doesn't match the cloud");
+		return false;
+	}
+
+	SidecarHeader header;
+	InitHeader(header, KD_TREE, cloud, contentHash);
+	header.parameters[0] = kdTree.leafSize();
+	header.parameters[1] = kdTree.nodeCount();
+	header.parameters[2] = sizeof(CCCoreLib::FlatKdTree::Node);
+
+	//the indexes are not exposed as an array
+	std::vector<unsigned> indexes;
+	try
+	{
+		indexes.resize(kdTree.size());
+	}
+	catch (const std::bad_alloc&)
+	{
+		ccLog::Warning("[ccIndexCache] Not enough memory");
+		return false;
+	}
+	for (unsigned i = 0; i < kdTree.size(); ++i)
+	{
+		indexes[i] = kdTree.pointIndex(i);
+	}
+
+	std::vector<Section> sections{	{ kdTree.nodes().data(), kdTree.nodes().size() * sizeof(CCCoreLib::FlatKdTree::Node) },
+									{ kdTree.points(), kdTree.size() * sizeof(CCVector3) },
+									{ indexes.data(), indexes.size() * sizeof(unsigned) } };
+
+	QString filename = SidecarFilename(cloud, KD_TREE);
+	if (!WriteSidecar(filename, header, sections))
+	{
+		return false;
+	}
+
+	ccLog::Print(QString("[ccIndexCache] KD-tree of cloud '%1' saved in '%2'").arg(cloud->getName(), filename));
+	return true;
+}
+
+bool ccIndexCache::LoadKdTree(ccGenericPointCloud* cloud, CCCoreLib::FlatKdTree& kdTree, quint64 contentHash)
+{
+	if (!cloud || cloud->getIndexCachePath().isEmpty())
+	{
+		assert(false);
+		return false;
+	}
+
+	QString filename = SidecarFilename(cloud, KD_TREE);
+	MappedSidecar sidecar;
+	if (!sidecar.open(filename, KD_TREE, cloud, contentHash, 3))
+	{
+		return false;
+	}
+
+	const SidecarHeader& header = sidecar.header();
+	unsigned nodeCount = header.parameters[1];
+	if (	header.parameters[2] != sizeof(CCCoreLib::FlatKdTree::Node)
+		||	header.sectionSizes[0] != static_cast<uint64_t>(nodeCount) * sizeof(CCCoreLib::FlatKdTree::Node)
+		||	header.sectionSizes[1] != static_cast<uint64_t>(header.pointCount) * sizeof(CCVector3)
+		||	header.sectionSizes[2] != static_cast<uint64_t>(header.pointCount) * sizeof(unsigned) )
+	{
+		ccLog::Warning(QString("[ccIndexCache] Incompatible or corrupted KD-tree in file '%1'").arg(filename));
+		return false;
+	}
+
+	if (!kdTree.restore(cloud,
+						header.parameters[0],
+						reinterpret_cast<const CCCoreLib::FlatKdTree::Node*>(sidecar.section(0)),
+						nodeCount,
+						reinterpret_cast<const CCVector3*>(sidecar.section(1)),
+						reinterpret_cast<const unsigned*>(sidecar.section(2))))
+	{
+		ccLog::Warning(QString("[ccIndexCache] Failed to restore the KD-tree from file '%1' (corrupted file or not enough memory)").arg(filename));
+		return false;
+	}
+
+	ccLog::Print(QString("[ccIndexCache] KD-tree of cloud '%1' loaded from '%2'").arg(cloud->getName(), filename));
+	return true;
+}
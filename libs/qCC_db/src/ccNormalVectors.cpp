@@ -28,6 +28,7 @@
 #include <GenericProgressCallback.h>
 #include <GeometricalAnalysisTools.h>
 #include <Neighbourhood.h>
+#include <NeighbourhoodCache.h>
 
 //System
 #include <cassert>
@@ -43,6 +44,86 @@ static const unsigned NUMBER_OF_POINTS_FOR_NORM_WITH_LS = 3;
 //Number of points for local modeling to compute normals with quadratic 'height' function
 static const unsigned NUMBER_OF_POINTS_FOR_NORM_WITH_QUADRIC = 6;
 
+//! Computes the normals with the neighbours read from a cache (see ccNormalVectors::ComputeCloudNormals)
+static bool ComputeNormsWithCache(	const CCCoreLib::NeighbourhoodCache& cache,
+									NormsTableType* theNorms,
+									CCCoreLib::LOCAL_MODEL_TYPES localModel,
+									PointCoordinateType localRadius,
+									CCCoreLib::GenericProgressCallback* progressCb)
+{
+	const char* title = (localModel == CCCoreLib::TRI ? "Normals Computation[TRI]" : localModel == CCCoreLib::LS ? "Normals Computation[LS]" : "Normals Computation[QUADRIC]");
+	unsigned minNeighbourCount = (localModel == CCCoreLib::LS ? NUMBER_OF_POINTS_FOR_NORM_WITH_LS : NUMBER_OF_POINTS_FOR_NORM_WITH_QUADRIC);
+
+	return cache.forEachPointRange(	[&](unsigned first, unsigned last)
+									{
+										CCCoreLib::DgmOctree::NeighboursSet neighbours;
+										try
+										{
+											for (unsigned i = first; i < last; ++i)
+											{
+												CCVector3 N;
+												if (localModel == CCCoreLib::TRI)
+												{
+													unsigned k = cache.getNeighbours(i, NUMBER_OF_POINTS_FOR_NORM_WITH_TRI * 3, neighbours);
+													if (k > NUMBER_OF_POINTS_FOR_NORM_WITH_TRI)
+													{
+														//the normal is computed at the first point (duplicate points may come before the query point)
+														for (unsigned j = 1; j < k; ++j)
+														{
+															if (neighbours[j].pointIndex == i)
+															{
+																std::swap(neighbours[0], neighbours[j]);
+																break;
+															}
+														}
+
+														CCCoreLib::DgmOctreeReferenceCloud neighboursCloud(&neighbours, k);
+														if (ccNormalVectors::ComputeNormalWithTri(&neighboursCloud, N))
+														{
+															theNorms->setValue(i, N);
+														}
+													}
+												}
+												else
+												{
+													//same radius increase as the octree-based computation (up to the cache radius)
+													unsigned k = cache.countInSphere(i, localRadius);
+													float cur_radius = localRadius;
+													while (k < minNeighbourCount && cur_radius < 16 * localRadius)
+													{
+														cur_radius *= 1.189207115f;
+														if (cur_radius > cache.radius())
+														{
+															break;
+														}
+														k = cache.countInSphere(i, cur_radius);
+													}
+
+													if (k >= minNeighbourCount)
+													{
+														k = cache.getNeighbours(i, k, neighbours);
+														CCCoreLib::DgmOctreeReferenceCloud neighboursCloud(&neighbours, k);
+														bool success = (localModel == CCCoreLib::LS	? ccNormalVectors::ComputeNormalWithLS(&neighboursCloud, N)
+																									: ccNormalVectors::ComputeNormalWithQuadric(&neighboursCloud, *cache.getAssociatedCloud()->getPointPersistentPtr(i), N));
+														if (success)
+														{
+															theNorms->setValue(i, N);
+														}
+													}
+												}
+											}
+										}
+										catch (const std::bad_alloc&)
+										{
+											//not enough memory
+											return false;
+										}
+										return true;
+									},
+									progressCb,
+									title);
+}
+
 ccNormalVectors* ccNormalVectors::GetUniqueInstance()
 {
 	if (!s_uniqueInstance.instance)
@@ -413,7 +494,8 @@ bool ccNormalVectors::ComputeCloudNormals(	ccGenericPointCloud* theCloud,
 											PointCoordinateType localRadius,
 											Orientation preferredOrientation/*=UNDEFINED*/,
 											CCCoreLib::GenericProgressCallback* progressCb/*=0*/,
-											CCCoreLib::DgmOctree* inputOctree/*=0*/)
+											CCCoreLib::DgmOctree* inputOctree/*=0*/,
+											const CCCoreLib::NeighbourhoodCache* cache/*=nullptr*/)
 {
 	assert(theCloud);
 
@@ -423,8 +505,18 @@ bool ccNormalVectors::ComputeCloudNormals(	ccGenericPointCloud* theCloud,
 		return false;
 	}
 
+	//the neighbours can be read from a cache instead of being extracted from the octree
+	bool useCache = false;
+	if (cache)
+	{
+		if (localModel == CCCoreLib::TRI)
+			useCache = cache->canProvideKNN(theCloud, NUMBER_OF_POINTS_FOR_NORM_WITH_TRI + 1);
+		else
+			useCache = cache->canProvideRadius(theCloud, localRadius);
+	}
+
 	CCCoreLib::DgmOctree* theOctree = inputOctree;
-	if (!theOctree)
+	if (!theOctree && !useCache)
 	{
 		theOctree = new CCCoreLib::DgmOctree(theCloud);
 		if (theOctree->build() <= 0)
@@ -460,46 +552,53 @@ bool ccNormalVectors::ComputeCloudNormals(	ccGenericPointCloud* theCloud,
 	void* additionalParameters[2] = { reinterpret_cast<void*>(theNorms), reinterpret_cast<void*>(&localRadius) };
 
 	unsigned processedCells = 0;
-	switch (localModel)
+	if (useCache)
 	{
-	case CCCoreLib::LS:
-		{
-			unsigned char level = theOctree->findBestLevelForAGivenNeighbourhoodSizeExtraction(localRadius);
-			processedCells = theOctree->executeFunctionForAllCellsAtLevel(	level,
-																			&(ComputeNormsAtLevelWithLS),
-																			additionalParameters,
-																			true,
-																			progressCb,
-																			"Normals Computation[LS]");
-		}
-		break;
-	case CCCoreLib::TRI:
-		{
-			unsigned char level = theOctree->findBestLevelForAGivenPopulationPerCell(NUMBER_OF_POINTS_FOR_NORM_WITH_TRI);
-			processedCells = theOctree->executeFunctionForAllCellsStartingAtLevel(	level,
-																					&(ComputeNormsAtLevelWithTri),
-																					additionalParameters,
-																					NUMBER_OF_POINTS_FOR_NORM_WITH_TRI / 2,
-																					NUMBER_OF_POINTS_FOR_NORM_WITH_TRI * 3,
-																					true,
-																					progressCb,
-																					"Normals Computation[TRI]");
-		}
-		break;
-	case CCCoreLib::QUADRIC:
+		processedCells = (ComputeNormsWithCache(*cache, theNorms, localModel, localRadius, progressCb) ? 1 : 0);
+	}
+	else
+	{
+		switch (localModel)
 		{
-			unsigned char level = theOctree->findBestLevelForAGivenNeighbourhoodSizeExtraction(localRadius);
-			processedCells = theOctree->executeFunctionForAllCellsAtLevel(	level,
-																			&(ComputeNormsAtLevelWithQuadric),
-																			additionalParameters,
-																			true,
-																			progressCb,
-																			"Normals Computation[QUADRIC]");
-		}
-		break;
+		case CCCoreLib::LS:
+			{
+				unsigned char level = theOctree->findBestLevelForAGivenNeighbourhoodSizeExtraction(localRadius);
+				processedCells = theOctree->executeFunctionForAllCellsAtLevel(	level,
+																				&(ComputeNormsAtLevelWithLS),
+																				additionalParameters,
+																				true,
+																				progressCb,
+																				"Normals Computation[LS]");
+			}
+			break;
+		case CCCoreLib::TRI:
+			{
+				unsigned char level = theOctree->findBestLevelForAGivenPopulationPerCell(NUMBER_OF_POINTS_FOR_NORM_WITH_TRI);
+				processedCells = theOctree->executeFunctionForAllCellsStartingAtLevel(	level,
+																						&(ComputeNormsAtLevelWithTri),
+																						additionalParameters,
+																						NUMBER_OF_POINTS_FOR_NORM_WITH_TRI / 2,
+																						NUMBER_OF_POINTS_FOR_NORM_WITH_TRI * 3,
+																						true,
+																						progressCb,
+																						"Normals Computation[TRI]");
+			}
+			break;
+		case CCCoreLib::QUADRIC:
+			{
+				unsigned char level = theOctree->findBestLevelForAGivenNeighbourhoodSizeExtraction(localRadius);
+				processedCells = theOctree->executeFunctionForAllCellsAtLevel(	level,
+																				&(ComputeNormsAtLevelWithQuadric),
+																				additionalParameters,
+																				true,
+																				progressCb,
+																				"Normals Computation[QUADRIC]");
+			}
+			break;
 
-	default:
-		break;
+		default:
+			break;
+		}
 	}
 
 	//error or canceled by user?
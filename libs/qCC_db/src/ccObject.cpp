@@ -63,8 +63,9 @@
 	v5.0 - 10/06/2019 - Point labels can now target the entity center
 	v5.1 - 03/29/2019 - New camera management (viewports have changed)
 	v5.2 - 11/30/2020 - New ccCoordinateSystem added
+	v5.3 - 10/17/2026 - Big arrays are stored as compressed chunks (decoded in parallel) and images are read on demand
 **/
-const unsigned c_currentDBVersion = 52; //5.2
+const unsigned c_currentDBVersion = 53; //5.3
 
 //! Default unique ID generator (using the system persistent settings as we did previously proved to be not reliable)
 static ccUniqueIDGenerator::Shared s_uniqueIDGenerator(new ccUniqueIDGenerator);
@@ -0,0 +1,418 @@
+//##########################################################################
+//#                                                                        #
+//#                              CLOUDCOMPARE                              #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                    COPYRIGHT: CloudCompare project                     #
+//#                                                                        #
+//##########################################################################
+
+#include "ccOrthoRasterizer.h"
+
+//local
+#include "ccLog.h"
+#include "ccPointCloud.h"
+#include "ccScalarField.h"
+
+//CCCoreLib
+#include <GenericProgressCallback.h>
+
+//system
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cmath>
+#include <limits>
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+//! Size of the (square) rendering tiles, in pixels
+static const int s_renderTileSize = 256;
+
+bool ccOrthoRasterizer::Bin(const ccPointCloud* cloud,
+							const ccBBox& area,
+							const Parameters& params,
+							Binning& binning)
+{
+	binning = Binning();
+
+	if (!cloud || !area.isValid() || params.pixelSize <= 0)
+	{
+		ccLog::Warning("[ccOrthoRasterizer] Invalid input parameters");
+		return false;
+	}
+
+	//image dimensions
+	const double pixelSize = params.pixelSize;
+	const CCVector3d minCorner = CCVector3d::fromArray(area.minCorner().u);
+	const CCVector3d maxCorner = CCVector3d::fromArray(area.maxCorner().u);
+	const double widthPx = std::max(1.0, std::ceil((maxCorner.x - minCorner.x) / pixelSize));
+	const double heightPx = std::max(1.0, std::ceil((maxCorner.y - minCorner.y) / pixelSize));
+	if (widthPx > INT_MAX / 2 || heightPx > INT_MAX / 2)
+	{
+		ccLog::Warning("[ccOrthoRasterizer] Pixel size is too small");
+		return false;
+	}
+	const int width = static_cast<int>(widthPx);
+	const int height = static_cast<int>(heightPx);
+	const int splatRadius = std::max(0, std::min(params.splatRadius, s_renderTileSize));
+
+	int threadCount = 1;
+#if defined(_OPENMP)
+	threadCount = (params.maxThreadCount > 0 ? params.maxThreadCount : omp_get_max_threads());
+#endif
+
+	const int tilesX = (width + s_renderTileSize - 1) / s_renderTileSize;
+	const int tilesY = (height + s_renderTileSize - 1) / s_renderTileSize;
+	const unsigned tileCount = static_cast<unsigned>(tilesX) * tilesY;
+	const unsigned pointCount = cloud->size();
+
+	std::vector<unsigned> pointTiles;
+	try
+	{
+		pointTiles.resize(pointCount);
+		binning.tileStart.resize(tileCount + 1, 0);
+	}
+	catch (const std::bad_alloc&)
+	{
+		ccLog::Warning("[ccOrthoRasterizer] Not enough memory");
+		binning = Binning();
+		return false;
+	}
+
+	const unsigned outsideTile = std::numeric_limits<unsigned>::max();
+#if defined(_OPENMP)
+#pragma omp parallel for num_threads(threadCount)
+#endif
+	for (int i = 0; i < static_cast<int>(pointCount); ++i)
+	{
+		const CCVector3* P = cloud->getPoint(static_cast<unsigned>(i));
+		double x = std::floor((P->x - minCorner.x) / pixelSize);
+		double y = std::floor((P->y - minCorner.y) / pixelSize);
+		if (!(	x >= -splatRadius && x < width + splatRadius
+			&&	y >= -splatRadius && y < height + splatRadius)) //also rejects NaN coordinates
+		{
+			pointTiles[i] = outsideTile;
+			continue;
+		}
+		int tx = std::max(0, std::min(static_cast<int>(x), width - 1)) / s_renderTileSize;
+		int ty = std::max(0, std::min(static_cast<int>(y), height - 1)) / s_renderTileSize;
+		pointTiles[i] = static_cast<unsigned>(ty * tilesX + tx);
+	}
+
+	std::vector<unsigned>& tileStart = binning.tileStart;
+	for (unsigned i = 0; i < pointCount; ++i)
+	{
+		if (pointTiles[i] != outsideTile)
+		{
+			++tileStart[pointTiles[i] + 1];
+		}
+	}
+	for (unsigned t = 0; t < tileCount; ++t)
+	{
+		tileStart[t + 1] += tileStart[t];
+	}
+	try
+	{
+		binning.sortedPoints.resize(tileStart[tileCount]);
+	}
+	catch (const std::bad_alloc&)
+	{
+		ccLog::Warning("[ccOrthoRasterizer] Not enough memory");
+		binning = Binning();
+		return false;
+	}
+	{
+		std::vector<unsigned> cursors(tileStart.begin(), tileStart.end() - 1);
+		for (unsigned i = 0; i < pointCount; ++i)
+		{
+			if (pointTiles[i] != outsideTile)
+			{
+				binning.sortedPoints[cursors[pointTiles[i]]++] = i;
+			}
+		}
+	}
+
+	binning.cloud = cloud;
+	binning.minCorner = minCorner;
+	binning.pixelSize = pixelSize;
+	binning.splatRadius = splatRadius;
+	binning.width = width;
+	binning.height = height;
+	binning.tilesX = tilesX;
+	binning.tilesY = tilesY;
+
+	return true;
+}
+
+bool ccOrthoRasterizer::Render(	const Binning& binning,
+								const QRect& window,
+								const Parameters& params,
+								std::vector<Sheet>& sheets,
+								CCCoreLib::GenericProgressCallback* progressCb/*=nullptr*/)
+{
+	sheets.clear();
+
+	const ccPointCloud* cloud = binning.cloud;
+	const QRect pixels = window.intersected(QRect(0, 0, binning.width, binning.height));
+	if (!cloud || pixels.isEmpty())
+	{
+		ccLog::Warning("[ccOrthoRasterizer] Invalid input parameters");
+		return false;
+	}
+
+	//color source
+	const ccScalarField* sf = nullptr;
+	switch (params.colorSource)
+	{
+	case RGB_COLORS:
+		if (!cloud->hasColors())
+		{
+			ccLog::Warning("[ccOrthoRasterizer] Cloud has no colors");
+			return false;
+		}
+		break;
+
+	case SCALAR_FIELD:
+		sf = static_cast<const ccScalarField*>(params.sfIndex < 0 ? cloud->getCurrentDisplayedScalarField() : cloud->getScalarField(params.sfIndex));
+		if (!sf || !sf->getColorScale())
+		{
+			ccLog::Warning("[ccOrthoRasterizer] Invalid scalar field (or no color scale)");
+			return false;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	//window dimensions (the pixel coordinates below are relative to the binned area)
+	const double pixelSize = binning.pixelSize;
+	const CCVector3d& minCorner = binning.minCorner;
+	const int windowX = pixels.x();
+	const int windowY = pixels.y();
+	const int width = pixels.width();
+	const int height = pixels.height();
+
+	//sheets
+	const int sheetWidth = (params.sheetWidth > 0 ? std::min(params.sheetWidth, width) : width);
+	const int sheetHeight = (params.sheetHeight > 0 ? std::min(params.sheetHeight, height) : height);
+	const int sheetColumns = (width + sheetWidth - 1) / sheetWidth;
+	const int sheetRows = (height + sheetHeight - 1) / sheetHeight;
+	std::vector<QRgb*> sheetBits;
+	std::vector<int> sheetStrides;
+	std::vector<int> sheetImageHeights;
+	try
+	{
+		sheets.resize(static_cast<size_t>(sheetColumns) * sheetRows);
+		sheetBits.resize(sheets.size());
+		sheetStrides.resize(sheets.size());
+		sheetImageHeights.resize(sheets.size());
+	}
+	catch (const std::bad_alloc&)
+	{
+		ccLog::Warning("[ccOrthoRasterizer] Not enough memory");
+		sheets.clear();
+		return false;
+	}
+
+	const QRgb backgroundColor = params.backgroundColor.rgba();
+	for (int r = 0; r < sheetRows; ++r)
+	{
+		for (int c = 0; c < sheetColumns; ++c)
+		{
+			size_t sheetIndex = static_cast<size_t>(r) * sheetColumns + c;
+			Sheet& sheet = sheets[sheetIndex];
+			int x0 = c * sheetWidth;
+			int y0 = r * sheetHeight;
+			int w = std::min(sheetWidth, width - x0);
+			int h = std::min(sheetHeight, height - y0);
+
+			sheet.image = QImage(w, h, QImage::Format_ARGB32);
+			if (sheet.image.isNull())
+			{
+				ccLog::Warning("[ccOrthoRasterizer] Not enough memory to create the images");
+				sheets.clear();
+				return false;
+			}
+			sheet.image.fill(backgroundColor);
+			sheet.box = ccBBox(	CCVector3(static_cast<PointCoordinateType>(minCorner.x + (windowX + x0) * pixelSize), static_cast<PointCoordinateType>(minCorner.y + (windowY + y0) * pixelSize), 0),
+								CCVector3(static_cast<PointCoordinateType>(minCorner.x + (windowX + x0 + w) * pixelSize), static_cast<PointCoordinateType>(minCorner.y + (windowY + y0 + h) * pixelSize), 0));
+			sheet.column = c;
+			sheet.row = r;
+
+			//QImage::bits detaches the image: it must be called before the parallel rendering
+			sheetBits[sheetIndex] = reinterpret_cast<QRgb*>(sheet.image.bits());
+			sheetStrides[sheetIndex] = sheet.image.bytesPerLine() / static_cast<int>(sizeof(QRgb));
+			sheetImageHeights[sheetIndex] = h;
+		}
+	}
+
+	//splat footprint
+	const int splatRadius = binning.splatRadius;
+	std::vector<std::pair<int, int>> splatOffsets;
+	for (int dy = -splatRadius; dy <= splatRadius; ++dy)
+	{
+		for (int dx = -splatRadius; dx <= splatRadius; ++dx)
+		{
+			if (dx * dx + dy * dy <= splatRadius * splatRadius + splatRadius)
+			{
+				splatOffsets.emplace_back(dx, dy);
+			}
+		}
+	}
+
+	int threadCount = 1;
+#if defined(_OPENMP)
+	threadCount = (params.maxThreadCount > 0 ? params.maxThreadCount : omp_get_max_threads());
+#endif
+
+	//tiles overlapping the window
+	const int tilesX = binning.tilesX;
+	const int tilesY = binning.tilesY;
+	const int firstTileX = windowX / s_renderTileSize;
+	const int lastTileX = (windowX + width - 1) / s_renderTileSize;
+	const int firstTileY = windowY / s_renderTileSize;
+	const int lastTileY = (windowY + height - 1) / s_renderTileSize;
+	const std::vector<unsigned>& tileStart = binning.tileStart;
+	const std::vector<unsigned>& sortedPoints = binning.sortedPoints;
+
+	CCCoreLib::NormalizedProgress nprogress(progressCb, static_cast<unsigned>(lastTileY - firstTileY + 1));
+	if (progressCb)
+	{
+		if (progressCb->textCanBeEdited())
+		{
+			progressCb->setMethodTitle("Rasterize");
+			progressCb->setInfo(qPrintable(QString("Points: %1\nImage: %2 x %3 (%4 sheet(s))").arg(cloud->size()).arg(width).arg(height).arg(sheets.size())));
+		}
+		progressCb->update(0);
+		progressCb->start();
+	}
+
+	const QRgb defaultColor = params.defaultColor.rgba();
+
+	//render the tiles (a row of tiles at a time, so as to update the progress from this thread)
+	for (int ty = firstTileY; ty <= lastTileY; ++ty)
+	{
+#if defined(_OPENMP)
+#pragma omp parallel for num_threads(threadCount) schedule(dynamic)
+#endif
+		for (int tx = firstTileX; tx <= lastTileX; ++tx)
+		{
+			//pixels of this tile (inside the window)
+			const int tileX0 = tx * s_renderTileSize;
+			const int tileY0 = ty * s_renderTileSize;
+			const int x0 = std::max(tileX0, windowX);
+			const int y0 = std::max(tileY0, windowY);
+			const int x1 = std::min(tileX0 + s_renderTileSize, windowX + width);
+			const int y1 = std::min(tileY0 + s_renderTileSize, windowY + height);
+
+			std::vector<PointCoordinateType> zBuffer(static_cast<size_t>(s_renderTileSize) * s_renderTileSize, -std::numeric_limits<PointCoordinateType>::infinity());
+
+			//the splats of the points of the neighbouring tiles may overlap this tile
+			for (int nty = std::max(0, ty - 1); nty <= std::min(tilesY - 1, ty + 1); ++nty)
+			{
+				for (int ntx = std::max(0, tx - 1); ntx <= std::min(tilesX - 1, tx + 1); ++ntx)
+				{
+					unsigned neighbourTile = static_cast<unsigned>(nty * tilesX + ntx);
+					for (unsigned j = tileStart[neighbourTile]; j < tileStart[neighbourTile + 1]; ++j)
+					{
+						const unsigned pointIndex = sortedPoints[j];
+						const CCVector3* P = cloud->getPoint(pointIndex);
+						const int x = static_cast<int>(std::floor((P->x - minCorner.x) / pixelSize));
+						const int y = static_cast<int>(std::floor((P->y - minCorner.y) / pixelSize));
+						if (x + splatRadius < x0 || x - splatRadius >= x1 || y + splatRadius < y0 || y - splatRadius >= y1)
+						{
+							continue;
+						}
+
+						QRgb color = defaultColor;
+						if (params.colorSource == RGB_COLORS)
+						{
+							const ccColor::Rgba& col = cloud->getPointColor(pointIndex);
+							color = qRgba(col.r, col.g, col.b, col.a);
+						}
+						else if (sf)
+						{
+							const ccColor::Rgb* col = sf->getValueColor(pointIndex);
+							if (!col)
+							{
+								//hidden value (NaN or out of the displayed range)
+								continue;
+							}
+							color = qRgb(col->r, col->g, col->b);
+						}
+
+						for (const std::pair<int, int>& offset : splatOffsets)
+						{
+							const int px = x + offset.first;
+							const int py = y + offset.second;
+							if (px < x0 || px >= x1 || py < y0 || py >= y1)
+							{
+								continue;
+							}
+
+							PointCoordinateType& z = zBuffer[static_cast<size_t>(py - tileY0) * s_renderTileSize + (px - tileX0)];
+							if (P->z <= z)
+							{
+								continue;
+							}
+							z = P->z;
+
+							//the images are top-down while the pixel rows go upwards
+							const int wx = px - windowX;
+							const int wy = py - windowY;
+							const int sheetColumn = wx / sheetWidth;
+							const int sheetRow = wy / sheetHeight;
+							const size_t sheetIndex = static_cast<size_t>(sheetRow) * sheetColumns + sheetColumn;
+							const int imageX = wx - sheetColumn * sheetWidth;
+							const int imageY = sheetImageHeights[sheetIndex] - 1 - (wy - sheetRow * sheetHeight);
+							sheetBits[sheetIndex][static_cast<size_t>(imageY) * sheetStrides[sheetIndex] + imageX] = color;
+						}
+					}
+				}
+			}
+		}
+
+		if (progressCb && !nprogress.oneStep())
+		{
+			ccLog::Warning("[ccOrthoRasterizer] Process cancelled by the user");
+			sheets.clear();
+			return false;
+		}
+	}
+
+	if (progressCb)
+	{
+		progressCb->stop();
+	}
+
+	return true;
+}
+
+bool ccOrthoRasterizer::Render(	const ccPointCloud* cloud,
+								const ccBBox& area,
+								const Parameters& params,
+								std::vector<Sheet>& sheets,
+								CCCoreLib::GenericProgressCallback* progressCb/*=nullptr*/)
+{
+	sheets.clear();
+
+	Binning binning;
+	if (!Bin(cloud, area, params, binning))
+	{
+		//error message already issued
+		return false;
+	}
+
+	return Render(binning, QRect(0, 0, binning.width, binning.height), params, sheets, progressCb);
+}
@@ -0,0 +1,949 @@
+//##########################################################################
+//#                                                                        #
+//#                              CLOUDCOMPARE                              #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                    COPYRIGHT: CloudCompare project                     #
+//#                                                                        #
+//##########################################################################
+
+#include "ccOutOfCoreCloud.h"
+
+//local
+#include "ccLog.h"
+#include "ccPointCloud.h"
+#include "ccScalarField.h"
+
+//Qt
+#include <QFileInfo>
+
+//system
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+	//! Store header ('magic' + fixed size part)
+	struct StoreHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t pointCount;
+		uint32_t chunkCount;
+		uint32_t sfCount;
+		uint8_t hasColors;
+		uint8_t hasNormals;
+		uint8_t coordinateSize;
+		uint8_t scalarSize;
+		double globalShift[3];
+		double globalScale;
+		PointCoordinateType bbMin[3];
+		PointCoordinateType bbMax[3];
+	};
+
+	const char c_storeMagic[8] = { 'C', 'C', 'O', 'O', 'C', 'S', 'T', 'R' };
+	const uint32_t c_storeVersion = 1;
+
+	//! Header size (the scalar field names follow the fixed size part)
+	const size_t c_headerSize = (1 << 16);
+	//! Max length of a scalar field name
+	const size_t c_sfNameLength = 256;
+	//! Max number of scalar fields
+	const size_t c_maxSFCount = (c_headerSize - sizeof(StoreHeader)) / c_sfNameLength;
+
+	//! Default resident memory budget
+	const size_t c_defaultResidentBudget = (size_t(1) << 30);
+
+	//! Layout of a chunk block (all attributes of ccChunk::SIZE points)
+	/** As ccChunk::SIZE = 64K, each attribute array is aligned on 64 KiB
+		(i.e. on the allocation granularity of all systems).
+	**/
+	struct BlockLayout
+	{
+		size_t colorsOffset = 0;
+		size_t normalsOffset = 0;
+		size_t sfOffset = 0;
+		size_t size = 0;
+
+		BlockLayout(bool hasColors, bool hasNormals, size_t sfCount)
+		{
+			colorsOffset = ccChunk::SIZE * sizeof(CCVector3);
+			normalsOffset = colorsOffset + (hasColors ? ccChunk::SIZE * sizeof(ccColor::Rgba) : 0);
+			sfOffset = normalsOffset + (hasNormals ? ccChunk::SIZE * sizeof(CompressedNormType) : 0);
+			size = sfOffset + sfCount * ccChunk::SIZE * sizeof(ScalarType);
+		}
+	};
+
+	//! Releases the (resident) pages of a mapped memory range
+	/** The range stays mapped: its content is read again from the file on the next access.
+	**/
+	void ReleasePages(const char* address, size_t size)
+	{
+#ifdef _WIN32
+		//unlocking pages that are not locked removes them from the working set
+		VirtualUnlock(const_cast<char*>(address), size);
+#else
+		madvise(const_cast<char*>(address), size, MADV_DONTNEED);
+#endif
+	}
+}
+
+ccOutOfCoreCloud::Writer::Writer()
+	: m_pointCount(0)
+	, m_hasColors(false)
+	, m_hasNormals(false)
+	, m_globalShift(0, 0, 0)
+	, m_globalScale(1.0)
+	, m_bbMin(0, 0, 0)
+	, m_bbMax(0, 0, 0)
+	, m_chunkPointCount(0)
+{
+}
+
+ccOutOfCoreCloud::Writer::~Writer()
+{
+	if (m_file.isOpen())
+	{
+		close();
+	}
+}
+
+bool ccOutOfCoreCloud::Writer::open(const QString& filename,
+									bool hasColors,
+									bool hasNormals,
+									const QStringList& sfNames,
+									const CCVector3d& globalShift/*=CCVector3d(0, 0, 0)*/,
+									double globalScale/*=1.0*/)
+{
+	if (m_file.isOpen())
+	{
+		close();
+	}
+
+	if (static_cast<size_t>(sfNames.size()) > c_maxSFCount)
+	{
+		ccLog::Warning(QString("[ccOutOfCoreCloud] Too many scalar fields (%1 max)").arg(c_maxSFCount));
+		return false;
+	}
+
+	m_pointCount = 0;
+	m_chunkPointCount = 0;
+	m_hasColors = hasColors;
+	m_hasNormals = hasNormals;
+	m_sfNames = sfNames;
+	m_globalShift = globalShift;
+	m_globalScale = globalScale;
+	m_bbMin = m_bbMax = CCVector3(0, 0, 0);
+
+	try
+	{
+		m_chunk.resize(BlockLayout(m_hasColors, m_hasNormals, m_sfNames.size()).size, 0);
+	}
+	catch (const std::bad_alloc&)
+	{
+		ccLog::Warning("[ccOutOfCoreCloud] Not enough memory");
+		return false;
+	}
+
+	m_file.setFileName(filename);
+	if (!m_file.open(QFile::WriteOnly | QFile::Truncate))
+	{
+		ccLog::Warning(QString("[ccOutOfCoreCloud] Failed to create file '%1'").arg(filename));
+		return false;
+	}
+
+	//the header will be written at the end (once the number of points is known)
+	std::vector<char> emptyHeader(c_headerSize, 0);
+	if (m_file.write(emptyHeader.data(), c_headerSize) != static_cast<qint64>(c_headerSize))
+	{
+		ccLog::Warning(QString("[ccOutOfCoreCloud] Failed to write in file '%1'").arg(filename));
+		m_file.close();
+		return false;
+	}
+
+	return true;
+}
+
+bool ccOutOfCoreCloud::Writer::addPoint(const CCVector3& P, const ccColor::Rgba& color/*=ccColor::white*/, CompressedNormType normIndex/*=0*/, const ScalarType* sfValues/*=nullptr*/)
+{
+	if (!m_file.isOpen() || m_pointCount == std::numeric_limits<unsigned>::max())
+	{
+		return false;
+	}
+
+	BlockLayout layout(m_hasColors, m_hasNormals, m_sfNames.size());
+	char* block = m_chunk.data();
+	unsigned i = m_chunkPointCount;
+
+	reinterpret_cast<CCVector3*>(block)[i] = P;
+	if (m_hasColors)
+	{
+		reinterpret_cast<ccColor::Rgba*>(block + layout.colorsOffset)[i] = color;
+	}
+	if (m_hasNormals)
+	{
+		reinterpret_cast<CompressedNormType*>(block + layout.normalsOffset)[i] = normIndex;
+	}
+	for (int k = 0; k < m_sfNames.size(); ++k)
+	{
+		reinterpret_cast<ScalarType*>(block + layout.sfOffset + k * ccChunk::SIZE * sizeof(ScalarType))[i] = (sfValues ? sfValues[k] : CCCoreLib::NAN_VALUE);
+	}
+
+	//update the bounding-box
+	if (m_pointCount == 0)
+	{
+		m_bbMin = m_bbMax = P;
+	}
+	else
+	{
+		for (unsigned d = 0; d < 3; ++d)
+		{
+			m_bbMin.u[d] = std::min(m_bbMin.u[d], P.u[d]);
+			m_bbMax.u[d] = std::max(m_bbMax.u[d], P.u[d]);
+		}
+	}
+
+	++m_pointCount;
+	if (++m_chunkPointCount == ccChunk::SIZE)
+	{
+		return flushChunk();
+	}
+
+	return true;
+}
+
+bool ccOutOfCoreCloud::Writer::addPoints(const ccPointCloud& cloud)
+{
+	//match the scalar fields by name
+	std::vector<CCCoreLib::ScalarField*> sfs(m_sfNames.size(), nullptr);
+	for (int k = 0; k < m_sfNames.size(); ++k)
+	{
+		int sfIndex = cloud.getScalarFieldIndexByName(qPrintable(m_sfNames[k]));
+		sfs[k] = (sfIndex >= 0 ? cloud.getScalarField(sfIndex) : nullptr);
+	}
+
+	bool hasColors = m_hasColors && cloud.hasColors();
+	bool hasNormals = m_hasNormals && cloud.hasNormals();
+	std::vector<ScalarType> sfValues(m_sfNames.size(), CCCoreLib::NAN_VALUE);
+
+	for (unsigned i = 0; i < cloud.size(); ++i)
+	{
+		for (size_t k = 0; k < sfs.size(); ++k)
+		{
+			sfValues[k] = (sfs[k] ? sfs[k]->getValue(i) : CCCoreLib::NAN_VALUE);
+		}
+
+		if (!addPoint(	*cloud.getPoint(i),
+						hasColors ? cloud.getPointColor(i) : ccColor::white,
+						hasNormals ? cloud.getPointNormalIndex(i) : 0,
+						sfValues.data()))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool ccOutOfCoreCloud::Writer::flushChunk()
+{
+	if (m_chunkPointCount == 0)
+	{
+		return true;
+	}
+
+	//the whole block is always written (so that the chunks have all the same size)
+	if (m_file.write(m_chunk.data(), m_chunk.size()) != static_cast<qint64>(m_chunk.size()))
+	{
+		ccLog::Warning(QString("[ccOutOfCoreCloud] Failed to write in file '%1'").arg(m_file.fileName()));
+		return false;
+	}
+
+	m_chunkPointCount = 0;
+	return true;
+}
+
+bool ccOutOfCoreCloud::Writer::close()
+{
+	if (!m_file.isOpen())
+	{
+		return false;
+	}
+
+	bool success = flushChunk();
+
+	if (success)
+	{
+		StoreHeader header;
+		memset(&header, 0, sizeof(StoreHeader));
+		memcpy(header.magic, c_storeMagic, sizeof(header.magic));
+		header.version = c_storeVersion;
+		header.pointCount = m_pointCount;
+		header.chunkCount = static_cast<uint32_t>(ccChunk::Count(m_pointCount));
+		header.sfCount = static_cast<uint32_t>(m_sfNames.size());
+		header.hasColors = (m_hasColors ? 1 : 0);
+		header.hasNormals = (m_hasNormals ? 1 : 0);
+		header.coordinateSize = static_cast<uint8_t>(sizeof(PointCoordinateType));
+		header.scalarSize = static_cast<uint8_t>(sizeof(ScalarType));
+		for (unsigned d = 0; d < 3; ++d)
+		{
+			header.globalShift[d] = m_globalShift.u[d];
+			header.bbMin[d] = m_bbMin.u[d];
+			header.bbMax[d] = m_bbMax.u[d];
+		}
+		header.globalScale = m_globalScale;
+
+		std::vector<char> headerBlock(c_headerSize, 0);
+		memcpy(headerBlock.data(), &header, sizeof(StoreHeader));
+		for (int k = 0; k < m_sfNames.size(); ++k)
+		{
+			QByteArray name = m_sfNames[k].toUtf8().left(static_cast<int>(c_sfNameLength) - 1);
+			memcpy(headerBlock.data() + sizeof(StoreHeader) + k * c_sfNameLength, name.constData(), name.size());
+		}
+
+		success = m_file.seek(0) && m_file.write(headerBlock.data(), c_headerSize) == static_cast<qint64>(c_headerSize);
+		if (!success)
+		{
+			ccLog::Warning(QString("[ccOutOfCoreCloud] Failed to write in file '%1'").arg(m_file.fileName()));
+		}
+	}
+
+	m_file.close();
+	m_chunk.clear();
+	m_chunk.shrink_to_fit();
+
+	return success;
+}
+
+bool ccOutOfCoreCloud::Create(const ccPointCloud& cloud, const QString& filename)
+{
+	QStringList sfNames;
+	for (unsigned k = 0; k < cloud.getNumberOfScalarFields(); ++k)
+	{
+		sfNames << QString::fromUtf8(cloud.getScalarFieldName(static_cast<int>(k)));
+	}
+
+	Writer writer;
+	if (!writer.open(filename, cloud.hasColors(), cloud.hasNormals(), sfNames, cloud.getGlobalShift(), cloud.getGlobalScale()))
+	{
+		return false;
+	}
+
+	if (!writer.addPoints(cloud))
+	{
+		writer.close();
+		return false;
+	}
+
+	return writer.close();
+}
+
+ccOutOfCoreCloud::ccOutOfCoreCloud()
+	: CCCoreLib::GenericIndexedCloudPersist()
+	, m_data(nullptr)
+	, m_headerSize(c_headerSize)
+	, m_blockSize(0)
+	, m_colorsOffset(0)
+	, m_normalsOffset(0)
+	, m_sfOffset(0)
+	, m_pointCount(0)
+	, m_chunkCount(0)
+	, m_hasColors(false)
+	, m_hasNormals(false)
+	, m_globalShift(0, 0, 0)
+	, m_globalScale(1.0)
+	, m_bbMin(0, 0, 0)
+	, m_bbMax(0, 0, 0)
+	, m_accessClock(0)
+	, m_residentChunkCount(0)
+	, m_residentBudget(c_defaultResidentBudget)
+	, m_currentPointIndex(0)
+	, m_currentSFIndex(-1)
+{
+}
+
+ccOutOfCoreCloud::~ccOutOfCoreCloud()
+{
+	close();
+}
+
+bool ccOutOfCoreCloud::open(const QString& filename)
+{
+	close();
+
+	m_file.setFileName(filename);
+	if (!m_file.open(QFile::ReadOnly))
+	{
+		ccLog::Warning(QString("[ccOutOfCoreCloud] Failed to open file '%1'").arg(filename));
+		return false;
+	}
+
+	QByteArray headerBlock = m_file.read(c_headerSize);
+	if (static_cast<size_t>(headerBlock.size()) != c_headerSize)
+	{
+		ccLog::Warning("[ccOutOfCoreCloud] Invalid store (truncated header)");
+		m_file.close();
+		return false;
+	}
+
+	StoreHeader header;
+	memcpy(&header, headerBlock.constData(), sizeof(StoreHeader));
+	if (	memcmp(header.magic, c_storeMagic, sizeof(header.magic)) != 0
+		||	header.version > c_storeVersion
+		||	header.coordinateSize != sizeof(PointCoordinateType)
+		||	header.scalarSize != sizeof(ScalarType)
+		||	header.sfCount > c_maxSFCount
+		||	header.chunkCount != ccChunk::Count(header.pointCount))
+	{
+		ccLog::Warning("[ccOutOfCoreCloud] Invalid or incompatible store");
+		m_file.close();
+		return false;
+	}
+
+	BlockLayout layout(header.hasColors != 0, header.hasNormals != 0, header.sfCount);
+	qint64 expectedSize = static_cast<qint64>(c_headerSize + static_cast<size_t>(header.chunkCount) * layout.size);
+	if (m_file.size() < expectedSize)
+	{
+		ccLog::Warning("[ccOutOfCoreCloud] Invalid store (truncated file)");
+		m_file.close();
+		return false;
+	}
+
+	//the whole store is mapped (only the address space is reserved)
+	uchar* data = m_file.map(0, expectedSize);
+	if (!data)
+	{
+		ccLog::Warning(QString("[ccOutOfCoreCloud] Failed to map file '%1'").arg(filename));
+		m_file.close();
+		return false;
+	}
+
+	try
+	{
+		m_chunks.reset(new Chunk[std::max(1u, header.chunkCount)]);
+	}
+	catch (const std::bad_alloc&)
+	{
+		ccLog::Warning("[ccOutOfCoreCloud] Not enough memory");
+		m_file.unmap(data);
+		m_file.close();
+		return false;
+	}
+
+	m_data = reinterpret_cast<const char*>(data);
+	m_blockSize = layout.size;
+	m_colorsOffset = layout.colorsOffset;
+	m_normalsOffset = layout.normalsOffset;
+	m_sfOffset = layout.sfOffset;
+	m_pointCount = header.pointCount;
+	m_chunkCount = header.chunkCount;
+	m_hasColors = (header.hasColors != 0);
+	m_hasNormals = (header.hasNormals != 0);
+	m_globalShift = CCVector3d::fromArray(header.globalShift);
+	m_globalScale = header.globalScale;
+	m_bbMin = CCVector3::fromArray(header.bbMin);
+	m_bbMax = CCVector3::fromArray(header.bbMax);
+	m_sfNames.clear();
+	for (uint32_t k = 0; k < header.sfCount; ++k)
+	{
+		const char* name = headerBlock.constData() + sizeof(StoreHeader) + k * c_sfNameLength;
+		m_sfNames << QString::fromUtf8(name, static_cast<int>(strnlen(name, c_sfNameLength)));
+	}
+	m_residentChunkCount = 0;
+	m_accessClock = 0;
+	m_currentPointIndex = 0;
+	m_currentSFIndex = -1;
+
+	return true;
+}
+
+void ccOutOfCoreCloud::close()
+{
+	if (m_data)
+	{
+		m_file.unmap(reinterpret_cast<uchar*>(const_cast<char*>(m_data)));
+		m_data = nullptr;
+	}
+	if (m_file.isOpen())
+	{
+		m_file.close();
+	}
+
+	m_chunks.reset();
+	m_pointCount = 0;
+	m_chunkCount = 0;
+	m_residentChunkCount = 0;
+	m_sfNames.clear();
+	m_outputSF.clear();
+	m_outputSF.shrink_to_fit();
+}
+
+void ccOutOfCoreCloud::setResidentMemoryBudget(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(m_residencyMutex);
+	m_residentBudget = bytes;
+	if (m_blockSize != 0 && m_residentChunkCount * m_blockSize > m_residentBudget)
+	{
+		releaseChunks(m_residentBudget, m_chunkCount);
+	}
+}
+
+unsigned ccOutOfCoreCloud::residentChunkCount() const
+{
+	std::lock_guard<std::mutex> lock(m_residencyMutex);
+	return m_residentChunkCount;
+}
+
+void ccOutOfCoreCloud::releaseAllChunks()
+{
+	std::lock_guard<std::mutex> lock(m_residencyMutex);
+	releaseChunks(0, m_chunkCount);
+}
+
+void ccOutOfCoreCloud::makeResident(unsigned chunkIndex) const
+{
+	std::lock_guard<std::mutex> lock(m_residencyMutex);
+
+	Chunk& chunk = m_chunks[chunkIndex];
+	if (chunk.resident)
+	{
+		//another thread was faster
+		return;
+	}
+
+	if ((m_residentChunkCount + 1) * m_blockSize > m_residentBudget)
+	{
+		//we release a quarter of the budget at once (to amortize the cost of the search)
+		releaseChunks(m_residentBudget - m_residentBudget / 4, chunkIndex);
+	}
+
+	chunk.lastAccess.store(++m_accessClock, std::memory_order_relaxed);
+	chunk.resident = true;
+	++m_residentChunkCount;
+}
+
+void ccOutOfCoreCloud::releaseChunks(size_t maxResidentSize, unsigned chunkToKeep) const
+{
+	//the lock must already be acquired
+
+	//resident chunks (by increasing last access time)
+	std::vector<std::pair<unsigned, unsigned>> residentChunks;
+	try
+	{
+		residentChunks.reserve(m_residentChunkCount);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory: we release all the chunks
+		maxResidentSize = 0;
+	}
+	for (unsigned i = 0; i < m_chunkCount; ++i)
+	{
+		if (i != chunkToKeep && m_chunks[i].resident)
+		{
+			if (maxResidentSize == 0)
+			{
+				m_chunks[i].resident = false;
+				ReleasePages(m_data + m_headerSize + static_cast<size_t>(i) * m_blockSize, m_blockSize);
+				--m_residentChunkCount;
+			}
+			else
+			{
+				residentChunks.emplace_back(m_chunks[i].lastAccess.load(std::memory_order_relaxed), i);
+			}
+		}
+	}
+	std::sort(residentChunks.begin(), residentChunks.end());
+
+	for (const std::pair<unsigned, unsigned>& residentChunk : residentChunks)
+	{
+		if (m_residentChunkCount * m_blockSize <= maxResidentSize)
+		{
+			break;
+		}
+
+		unsigned i = residentChunk.second;
+		m_chunks[i].resident = false;
+		ReleasePages(m_data + m_headerSize + static_cast<size_t>(i) * m_blockSize, m_blockSize);
+		--m_residentChunkCount;
+	}
+}
+
+const CCVector3* ccOutOfCoreCloud::chunkPoints(unsigned chunkIndex) const
+{
+	assert(chunkIndex < m_chunkCount);
+	return reinterpret_cast<const CCVector3*>(chunkBlock(chunkIndex));
+}
+
+const ccColor::Rgba& ccOutOfCoreCloud::getPointColor(unsigned index) const
+{
+	assert(m_hasColors && index < m_pointCount);
+	const char* block = chunkBlock(static_cast<unsigned>(index >> ccChunk::SIZE_POWER));
+	return reinterpret_cast<const ccColor::Rgba*>(block + m_colorsOffset)[index & (ccChunk::SIZE - 1)];
+}
+
+const CompressedNormType& ccOutOfCoreCloud::getPointNormalIndex(unsigned index) const
+{
+	assert(m_hasNormals && index < m_pointCount);
+	const char* block = chunkBlock(static_cast<unsigned>(index >> ccChunk::SIZE_POWER));
+	return reinterpret_cast<const CompressedNormType*>(block + m_normalsOffset)[index & (ccChunk::SIZE - 1)];
+}
+
+ScalarType ccOutOfCoreCloud::getScalarValue(int sfIndex, unsigned index) const
+{
+	assert(sfIndex >= 0 && sfIndex < m_sfNames.size() && index < m_pointCount);
+	const char* block = chunkBlock(static_cast<unsigned>(index >> ccChunk::SIZE_POWER));
+	return reinterpret_cast<const ScalarType*>(block + m_sfOffset + sfIndex * ccChunk::SIZE * sizeof(ScalarType))[index & (ccChunk::SIZE - 1)];
+}
+
+void ccOutOfCoreCloud::forEach(genericPointAction action)
+{
+	//there's no point of calling forEach if there's no activated scalar field!
+	if (!isScalarFieldEnabled())
+	{
+		assert(false);
+		return;
+	}
+
+	for (unsigned i = 0; i < m_pointCount; ++i)
+	{
+		action(*point(i), m_outputSF[i]);
+	}
+}
+
+void ccOutOfCoreCloud::getBoundingBox(CCVector3& bbMin, CCVector3& bbMax)
+{
+	//computed at creation time
+	bbMin = m_bbMin;
+	bbMax = m_bbMax;
+}
+
+const CCVector3* ccOutOfCoreCloud::getNextPoint()
+{
+	return (m_currentPointIndex < m_pointCount ? point(m_currentPointIndex++) : nullptr);
+}
+
+bool ccOutOfCoreCloud::enableScalarField()
+{
+	if (m_outputSF.size() == m_pointCount)
+	{
+		return true;
+	}
+
+	try
+	{
+		m_outputSF.resize(m_pointCount, CCCoreLib::NAN_VALUE);
+	}
+	catch (const std::bad_alloc&)
+	{
+		ccLog::Warning("[ccOutOfCoreCloud] Not enough memory");
+		return false;
+	}
+
+	return true;
+}
+
+bool ccOutOfCoreCloud::isScalarFieldEnabled() const
+{
+	return (m_pointCount != 0 && m_outputSF.size() == m_pointCount);
+}
+
+void ccOutOfCoreCloud::setPointScalarValue(unsigned pointIndex, ScalarType value)
+{
+	assert(isScalarFieldEnabled());
+	m_outputSF[pointIndex] = value;
+}
+
+ScalarType ccOutOfCoreCloud::getPointScalarValue(unsigned pointIndex) const
+{
+	if (isScalarFieldEnabled())
+	{
+		return m_outputSF[pointIndex];
+	}
+	else if (m_currentSFIndex >= 0 && m_currentSFIndex < m_sfNames.size())
+	{
+		return getScalarValue(m_currentSFIndex, pointIndex);
+	}
+	return CCCoreLib::NAN_VALUE;
+}
+
+namespace
+{
+	//! Copies some points of a store in a new (regular) cloud
+	ccPointCloud* ExtractPoints(const ccOutOfCoreCloud& store, const std::vector<unsigned>& indexes, const QString& name)
+	{
+		unsigned count = static_cast<unsigned>(indexes.size());
+
+		ccPointCloud* cloud = new ccPointCloud(name);
+		if (!cloud->reserve(count))
+		{
+			delete cloud;
+			return nullptr;
+		}
+		cloud->setGlobalShift(store.getGlobalShift());
+		cloud->setGlobalScale(store.getGlobalScale());
+
+		for (unsigned index : indexes)
+		{
+			cloud->addPoint(*store.getPoint(index));
+		}
+
+		if (store.hasColors())
+		{
+			if (!cloud->reserveTheRGBTable())
+			{
+				delete cloud;
+				return nullptr;
+			}
+			for (unsigned index : indexes)
+			{
+				cloud->addColor(store.getPointColor(index));
+			}
+			cloud->showColors(true);
+		}
+
+		if (store.hasNormals())
+		{
+			if (!cloud->reserveTheNormsTable())
+			{
+				delete cloud;
+				return nullptr;
+			}
+			for (unsigned index : indexes)
+			{
+				cloud->addNormIndex(store.getPointNormalIndex(index));
+			}
+			cloud->showNormals(true);
+		}
+
+		for (unsigned k = 0; k < store.getNumberOfScalarFields(); ++k)
+		{
+			ccScalarField* sf = new ccScalarField(qPrintable(store.getScalarFieldName(static_cast<int>(k))));
+			if (!sf->resizeSafe(count))
+			{
+				sf->release();
+				delete cloud;
+				return nullptr;
+			}
+			for (unsigned i = 0; i < count; ++i)
+			{
+				sf->setValue(i, store.getScalarValue(static_cast<int>(k), indexes[i]));
+			}
+			sf->computeMinAndMax();
+			cloud->addScalarField(sf);
+		}
+		if (cloud->getNumberOfScalarFields() != 0 && !store.hasColors())
+		{
+			cloud->setCurrentDisplayedScalarField(0);
+			cloud->showSF(true);
+		}
+
+		return cloud;
+	}
+}
+
+ccPointCloud* ccOutOfCoreCloud::createPreview(unsigned maxPointCount) const
+{
+	if (m_pointCount == 0 || maxPointCount == 0)
+	{
+		return nullptr;
+	}
+
+	std::vector<unsigned> indexes;
+	try
+	{
+		unsigned count = std::min(m_pointCount, maxPointCount);
+		indexes.resize(count);
+		double step = static_cast<double>(m_pointCount) / count;
+		for (unsigned i = 0; i < count; ++i)
+		{
+			indexes[i] = static_cast<unsigned>(i * step);
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		ccLog::Warning("[ccOutOfCoreCloud] Not enough memory");
+		return nullptr;
+	}
+
+	ccPointCloud* preview = ExtractPoints(*this, indexes, QFileInfo(m_file.fileName()).completeBaseName() + QString(" (preview)"));
+	if (!preview)
+	{
+		ccLog::Warning("[ccOutOfCoreCloud] Not enough memory");
+	}
+	return preview;
+}
+
+ccPointCloud* ccOutOfCoreCloud::extractRegion(const CCVector3& bbMin, const CCVector3& bbMax, std::vector<unsigned>& indexes) const
+{
+	indexes.clear();
+
+	try
+	{
+		//chunk by chunk (the points of a chunk are contiguous)
+		for (unsigned c = 0; c < m_chunkCount; ++c)
+		{
+			const CCVector3* points = chunkPoints(c);
+			unsigned chunkSize = static_cast<unsigned>(ccChunk::Size(c, m_chunkCount, m_pointCount));
+			unsigned firstIndex = static_cast<unsigned>(ccChunk::StartPos(c));
+			for (unsigned i = 0; i < chunkSize; ++i)
+			{
+				const CCVector3& P = points[i];
+				if (	P.x >= bbMin.x && P.y >= bbMin.y && P.z >= bbMin.z
+					&&	P.x <= bbMax.x && P.y <= bbMax.y && P.z <= bbMax.z)
+				{
+					indexes.push_back(firstIndex + i);
+				}
+			}
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		ccLog::Warning("[ccOutOfCoreCloud] Not enough memory");
+		indexes.clear();
+		return nullptr;
+	}
+
+	if (indexes.empty())
+	{
+		return nullptr;
+	}
+
+	ccPointCloud* region = ExtractPoints(*this, indexes, QFileInfo(m_file.fileName()).completeBaseName() + QString(" (region)"));
+	if (!region)
+	{
+		ccLog::Warning("[ccOutOfCoreCloud] Not enough memory");
+		indexes.clear();
+	}
+	return region;
+}
+
+bool ccOutOfCoreCloud::commitRegion(const ccPointCloud& region, const std::vector<unsigned>& indexes)
+{
+	if (!isOpen() || region.size() != indexes.size())
+	{
+		ccLog::Warning("[ccOutOfCoreCloud] Invalid region (the number of points has changed?)");
+		return false;
+	}
+
+	//the main mapping stays read-only: only the chunks of the region are mapped (one
+	//at a time) in read-write mode through a second handle (the mapped pages are shared,
+	//so that the edited values are immediately visible through the main mapping)
+	QFile file(m_file.fileName());
+	if (!file.open(QFile::ReadWrite))
+	{
+		ccLog::Warning(QString("[ccOutOfCoreCloud] Failed to open file '%1' for writing").arg(m_file.fileName()));
+		return false;
+	}
+
+	//scalar fields (matched by name)
+	std::vector<std::pair<int, const CCCoreLib::ScalarField*>> sfs;
+	for (int k = 0; k < m_sfNames.size(); ++k)
+	{
+		int sfIndex = region.getScalarFieldIndexByName(qPrintable(m_sfNames[k]));
+		if (sfIndex >= 0)
+		{
+			sfs.emplace_back(k, region.getScalarField(sfIndex));
+		}
+	}
+	bool hasColors = m_hasColors && region.hasColors();
+	bool hasNormals = m_hasNormals && region.hasNormals();
+
+	unsigned currentChunk = m_chunkCount;
+	uchar* block = nullptr;
+	bool success = true;
+
+	//the indexes are sorted by chunk (see extractRegion), so that each chunk is mapped once
+	for (unsigned i = 0; i < region.size() && success; ++i)
+	{
+		unsigned index = indexes[i];
+		if (index >= m_pointCount)
+		{
+			ccLog::Warning("[ccOutOfCoreCloud] Invalid region (index out of range)");
+			success = false;
+			break;
+		}
+
+		unsigned chunkIndex = static_cast<unsigned>(index >> ccChunk::SIZE_POWER);
+		if (chunkIndex != currentChunk)
+		{
+			if (block)
+			{
+				file.unmap(block);
+			}
+			currentChunk = chunkIndex;
+			block = file.map(static_cast<qint64>(m_headerSize + static_cast<size_t>(chunkIndex) * m_blockSize), static_cast<qint64>(m_blockSize));
+			if (!block)
+			{
+				ccLog::Warning(QString("[ccOutOfCoreCloud] Failed to map file '%1' for writing").arg(m_file.fileName()));
+				success = false;
+				break;
+			}
+		}
+
+		size_t localIndex = (index & (ccChunk::SIZE - 1));
+		reinterpret_cast<CCVector3*>(block)[localIndex] = *region.getPoint(i);
+		if (hasColors)
+		{
+			reinterpret_cast<ccColor::Rgba*>(block + m_colorsOffset)[localIndex] = region.getPointColor(i);
+		}
+		if (hasNormals)
+		{
+			reinterpret_cast<CompressedNormType*>(block + m_normalsOffset)[localIndex] = region.getPointNormalIndex(i);
+		}
+		for (const std::pair<int, const CCCoreLib::ScalarField*>& sf : sfs)
+		{
+			reinterpret_cast<ScalarType*>(block + m_sfOffset + sf.first * ccChunk::SIZE * sizeof(ScalarType))[localIndex] = sf.second->getValue(i);
+		}
+	}
+
+	if (block)
+	{
+		file.unmap(block);
+	}
+
+	if (success)
+	{
+		//update the bounding-box (it can only grow)
+		for (unsigned i = 0; i < region.size(); ++i)
+		{
+			const CCVector3* P = region.getPoint(i);
+			for (unsigned d = 0; d < 3; ++d)
+			{
+				m_bbMin.u[d] = std::min(m_bbMin.u[d], P->u[d]);
+				m_bbMax.u[d] = std::max(m_bbMax.u[d], P->u[d]);
+			}
+		}
+
+		StoreHeader header;
+		memcpy(&header, m_data, sizeof(StoreHeader));
+		for (unsigned d = 0; d < 3; ++d)
+		{
+			header.bbMin[d] = m_bbMin.u[d];
+			header.bbMax[d] = m_bbMax.u[d];
+		}
+		if (!file.seek(0) || file.write(reinterpret_cast<const char*>(&header), sizeof(StoreHeader)) != static_cast<qint64>(sizeof(StoreHeader)))
+		{
+			ccLog::Warning(QString("[ccOutOfCoreCloud] Failed to write in file '%1'").arg(m_file.fileName()));
+			success = false;
+		}
+	}
+
+	file.close();
+	return success;
+}
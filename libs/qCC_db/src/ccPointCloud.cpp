@@ -46,6 +46,7 @@
 #include "ccPolyline.h"
 #include "ccProgressDialog.h"
 #include "ccScalarField.h"
+#include "ccTrajectoryIndex.h"
 
 
 
@@ -57,8 +58,11 @@
 #include <QQuaternion>
 
 //system
+#include <algorithm>
 #include <cassert>
+#include <limits>
 #include <queue>
+#include <unordered_map>
 
 static const char s_deviationSFName[] = "Deviation";
 
@@ -80,6 +84,8 @@ ccPointCloud::ccPointCloud(QString name/*=QString()*/, unsigned uniqueID/*=ccUni
 	, m_fileDir("")
 	, m_trajectory(false)
 	, m_trajectoryPtr(nullptr)
+	, m_trajectoryIndex(nullptr)
+	, m_trajectoryIndexIsDirty(false)
 	, m_imagePointCloud(false)
 {
 	setName(name); //sadly we cannot use the ccGenericPointCloud constructor argument
@@ -452,6 +458,9 @@ ccPointCloud::~ccPointCloud()
 		delete m_lod;
 		m_lod = nullptr;
 	}
+
+	delete m_trajectoryIndex;
+	m_trajectoryIndex = nullptr;
 }
 
 void ccPointCloud::clear()
@@ -1141,6 +1150,11 @@ bool ccPointCloud::reserveTheRGBTable()
 		m_rgbaColors = new RGBAColorsTableType();
 		m_rgbaColors->link();
 	}
+	else if (!unshareAttributes()) //the shared colors (see createUnrolledView) must not be enlarged
+	{
+		ccLog::Error("[ccPointCloud::reserveTheRGBTable] Not enough memory!");
+		return false;
+	}
 
 	if (!m_rgbaColors->reserveSafe(m_points.capacity()))
 	{
@@ -1168,6 +1182,11 @@ bool ccPointCloud::resizeTheRGBTable(bool fillWithWhite/*=false*/)
 		m_rgbaColors = new RGBAColorsTableType();
 		m_rgbaColors->link();
 	}
+	else if (m_rgbaColors->size() != m_points.size() && !unshareAttributes()) //the shared colors (see createUnrolledView) must not be resized
+	{
+		ccLog::Error("[ccPointCloud::resizeTheRGBTable] Not enough memory!");
+		return false;
+	}
 
 	static const ccColor::Rgba s_white(ccColor::MAX, ccColor::MAX, ccColor::MAX, ccColor::MAX);
 	if (!m_rgbaColors->resizeSafe(m_points.size(), fillWithWhite, &s_white))
@@ -1401,6 +1420,13 @@ bool ccPointCloud::reserve(unsigned newNumberOfPoints)
 	if (newNumberOfPoints < size())
 		return false;
 
+	//the shared attributes (see createUnrolledView) must not be enlarged
+	if (newNumberOfPoints > size() && !unshareAttributes())
+	{
+		ccLog::Error("[ccPointCloud::reserve] Not enough memory!");
+		return false;
+	}
+
 	//call parent method first (for points + scalar fields)
 	if (	!BaseClass::reserve(newNumberOfPoints)
 		||	(hasColors() && !reserveTheRGBTable())
@@ -1426,6 +1452,13 @@ bool ccPointCloud::resize(unsigned newNumberOfPoints)
 	if (newNumberOfPoints < size() && isLocked())
 		return false;
 
+	//the shared attributes (see createUnrolledView) must not be resized
+	if (newNumberOfPoints != size() && !unshareAttributes())
+	{
+		ccLog::Error("[ccPointCloud::resize] Not enough memory!");
+		return false;
+	}
+
 	//call parent method first (for points + scalar fields)
 	if (!BaseClass::resize(newNumberOfPoints))
 	{
@@ -1559,6 +1592,14 @@ void ccPointCloud::invalidateBoundingBox()
 void ccPointCloud::addColor(const ccColor::Rgba& C)
 {
 	assert(m_rgbaColors && m_rgbaColors->isAllocated());
+
+	//the shared colors (see createUnrolledView) must not be enlarged
+	if (m_rgbaColors->getLinkCount() > 1 && !unshareAttributes())
+	{
+		ccLog::Error("[ccPointCloud::addColor] Not enough memory!");
+		return;
+	}
+
 	m_rgbaColors->emplace_back(C);
 
 	//We must update the VBOs
@@ -1991,6 +2032,7 @@ void ccPointCloud::applyRigidTransformation(const ccGLMatrix& trans)
 		}
 		m_trajectoryPtr->applyGLTransformation_recursive();
 		m_trajectoryPtr->prepareDisplayForRefresh_recursive();
+		m_trajectoryIndexIsDirty = true;
 	}
 
 
@@ -2205,6 +2247,13 @@ void ccPointCloud::swapPoints(unsigned firstIndex, unsigned secondIndex)
 	if (firstIndex == secondIndex)
 		return;
 
+	//the shared colors and scalar fields (see createUnrolledView) must not be reordered
+	if (!unshareAttributes())
+	{
+		ccLog::Error("[ccPointCloud::swapPoints] Not enough memory!");
+		return;
+	}
+
 	//points + associated SF values
 	BaseClass::swapPoints(firstIndex, secondIndex);
 
@@ -3688,204 +3737,709 @@ static void ProjectOnCone(	const CCVector3& AP,
 	}
 }
 
-ccPointCloud* ccPointCloud::unroll(	UnrollMode mode,
-									UnrollBaseParams* params,
-									bool exportDeviationSF/*=false*/,
-									double startAngle_deg/*=0.0*/,
-									double stopAngle_deg/*=360.0*/,
-									CCCoreLib::GenericProgressCallback* progressCb/*=nullptr*/) const
+//! Centerline sample (for unrolling along a trajectory)
+struct CenterlineSample
 {
-	if (	!params
-		||	params->axisDim > 2
-		||	startAngle_deg >= stopAngle_deg)
+	CCVector3 P;			//position
+	CCVector3 T;			//tangent (unit)
+	PointCoordinateType s;	//chainage
+};
+
+//! Samples a Catmull-Rom spline passing through the trajectory poses
+/** \warning may throw std::bad_alloc
+**/
+static bool BuildTrajectoryCenterline(	const ccPointCloud& trajectory,
+										PointCoordinateType controlStep,
+										unsigned samplesPerSegment,
+										std::vector<CenterlineSample>& centerline)
+{
+	//control points (the poses too close to the previous one are skipped,
+	//so that the spline doesn't follow the trajectory 'noise')
+	std::vector<CCVector3> controlPoints;
+	PointCoordinateType minStep = std::max(controlStep, static_cast<PointCoordinateType>(CCCoreLib::ZERO_TOLERANCE_F));
+	unsigned poseCount = trajectory.size();
+	for (unsigned i = 0; i < poseCount; ++i)
 	{
-		//invalid input parameters
-		assert(false);
-		return nullptr;
+		const CCVector3* P = trajectory.getPoint(i);
+		if (controlPoints.empty() || (*P - controlPoints.back()).norm() >= minStep)
+		{
+			controlPoints.push_back(*P);
+		}
+	}
+	if (poseCount != 0)
+	{
+		//always end at the last pose
+		const CCVector3* P = trajectory.getPoint(poseCount - 1);
+		if ((*P - controlPoints.back()).norm() > CCCoreLib::ZERO_TOLERANCE_F)
+		{
+			controlPoints.push_back(*P);
+		}
+	}
+	if (controlPoints.size() < 2)
+	{
+		return false;
 	}
 
-	QString modeStr;
-	UnrollCylinderParams* cylParams = nullptr;
-	UnrollConeParams* coneParams = nullptr;
+	samplesPerSegment = std::max(samplesPerSegment, 1u);
+	size_t controlCount = controlPoints.size();
+	centerline.clear();
+	centerline.reserve((controlCount - 1) * samplesPerSegment + 1);
 
-	switch (mode)
+	for (size_t k = 0; k + 1 < controlCount; ++k)
 	{
-	case CYLINDER:
-		modeStr = "Cylinder";
-		cylParams = static_cast<UnrollCylinderParams*>(params);
-		break;
-	case CONE:
-		modeStr = "Cone";
-		coneParams = static_cast<UnrollConeParams*>(params);
-		break;
-	case STRAIGHTENED_CONE:
-	case STRAIGHTENED_CONE2:
-		modeStr = "Straightened cone";
-		coneParams = static_cast<UnrollConeParams*>(params);
-		break;
-	default:
-		assert(false);
-		return nullptr;
-	}
+		const CCVector3& P0 = controlPoints[k == 0 ? 0 : k - 1];
+		const CCVector3& P1 = controlPoints[k];
+		const CCVector3& P2 = controlPoints[k + 1];
+		const CCVector3& P3 = controlPoints[k + 2 < controlCount ? k + 2 : controlCount - 1];
 
-	Tuple3ub dim;
-	dim.z = params->axisDim;
-	dim.x = (dim.z < 2 ? dim.z + 1 : 0);
-	dim.y = (dim.x < 2 ? dim.x + 1 : 0);
+		for (unsigned j = 0; j < samplesPerSegment; ++j)
+		{
+			PointCoordinateType t = static_cast<PointCoordinateType>(j) / samplesPerSegment;
+			PointCoordinateType t2 = t * t;
+			PointCoordinateType t3 = t2 * t;
 
-	unsigned numberOfPoints = size();
-	CCCoreLib::NormalizedProgress nprogress(progressCb, numberOfPoints);
-	if (progressCb)
+			CenterlineSample sample;
+			sample.P = (	P1 * 2
+						+	(P2 - P0) * t
+						+	(P0 * 2 - P1 * 5 + P2 * 4 - P3) * t2
+						+	(P1 * 3 - P0 - P2 * 3 + P3) * t3) / 2;
+			sample.s = 0;
+			centerline.push_back(sample);
+		}
+	}
 	{
-		if (progressCb->textCanBeEdited())
+		CenterlineSample sample;
+		sample.P = controlPoints.back();
+		sample.s = 0;
+		centerline.push_back(sample);
+	}
+
+	//chainage and tangents
+	size_t sampleCount = centerline.size();
+	for (size_t k = 0; k < sampleCount; ++k)
+	{
+		CenterlineSample& sample = centerline[k];
+		if (k != 0)
 		{
-			progressCb->setMethodTitle(qPrintable(QString("Unroll (%1)").arg(modeStr)));
-			progressCb->setInfo(qPrintable(QString("Number of points = %1").arg(numberOfPoints)));
+			sample.s = centerline[k - 1].s + (sample.P - centerline[k - 1].P).norm();
+		}
+		sample.T = centerline[k + 1 < sampleCount ? k + 1 : k].P - centerline[k == 0 ? 0 : k - 1].P;
+		if (sample.T.norm() > CCCoreLib::ZERO_TOLERANCE_F || k == 0)
+		{
+			sample.T.normalize();
+		}
+		else
+		{
+			sample.T = centerline[k - 1].T;
 		}
-		progressCb->update(0);
-		progressCb->start();
 	}
 
-	CCCoreLib::ReferenceCloud duplicatedPoints(const_cast<ccPointCloud*>(this));
-	std::vector<CCVector3> unrolledPoints;
+	return true;
+}
+
+//! Computes the local frame of the centerline ('up' is the vertical projected in the normal plane)
+static void ComputeCenterlineFrame(const CCVector3& tangent, CCVector3& T, CCVector3& up, CCVector3& side)
+{
+	T = tangent;
+	T.normalize();
+
+	static const CCVector3 Z(0, 0, 1);
+	up = Z - T * T.dot(Z);
+	if (up.norm() < static_cast<PointCoordinateType>(1.0e-3))
 	{
-		//compute an estimate of the final point count
-		unsigned newSize = static_cast<unsigned>(std::ceil((stopAngle_deg - startAngle_deg) / 360.0 * size()));
-		if (!duplicatedPoints.reserve(newSize))
+		//vertical centerline: use X as 'up' reference
+		static const CCVector3 X(1, 0, 0);
+		up = X - T * T.dot(X);
+	}
+	up.normalize();
+	side = T.cross(up);
+}
+
+//! Trajectory centerline (for unrolling along a trajectory)
+class TrajectoryCenterline
+{
+public:
+
+	//! Local frame at the projection of a point on the centerline
+	struct Frame
+	{
+		CCVector3 T;		//tangent
+		CCVector3 radial;	//from the centerline to the point
+		CCVector3 ortho;	//direction of increasing angles
+	};
+
+	//! Builds the centerline (spline) and its spatial index
+	bool init(const ccPointCloud::UnrollTrajectoryParams& params)
+	{
+		if (!params.trajectory)
+		{
+			return false;
+		}
+		m_radius = params.radius;
+
+		try
+		{
+			if (!BuildTrajectoryCenterline(*params.trajectory, params.controlStep, params.samplesPerSegment, m_samples))
+			{
+				ccLog::Warning("[Unroll] Not enough trajectory poses to build a centerline");
+				return false;
+			}
+		}
+		catch (const std::bad_alloc&)
 		{
 			ccLog::Error("Not enough memory");
-			return nullptr;
+			return false;
 		}
 
+		//spatial index on the centerline samples
 		try
 		{
-			unrolledPoints.reserve(newSize);
+			buildGrid();
 		}
 		catch (const std::bad_alloc&)
 		{
 			ccLog::Error("Not enough memory");
-			return nullptr;
+			return false;
 		}
+
+		return true;
 	}
 
-	std::vector<ScalarType> deviationValues;
-	if (exportDeviationSF)
-	try
-	{
-		deviationValues.resize(size());
+	//! Returns the centerline length
+	PointCoordinateType length() const { return m_samples.empty() ? 0 : m_samples.back().s; }
+
+	//! Unrolls a point (thread-safe)
+	/** X is the chainage, Y the arc length around the centerline (0 = up) and Z the opposite of the distance to the centerline.
+	**/
+	void unroll(const CCVector3& Pin, CCVector3& Pout, PointCoordinateType& delta, Frame* frame = nullptr) const
+	{
+		//nearest centerline sample
+		size_t nearestIndex = nearestSample(Pin);
+
+		//then nearest point on the adjacent segments (the first and last ones are extended)
+		const size_t lastSegment = m_samples.size() - 2;
+		size_t bestSegment = 0;
+		PointCoordinateType bestT = 0;
+		PointCoordinateType bestSquareDist = std::numeric_limits<PointCoordinateType>::max();
+		size_t firstCandidate = (nearestIndex != 0 ? nearestIndex - 1 : 0);
+		size_t lastCandidate = std::min<size_t>(nearestIndex, lastSegment);
+		for (size_t k = firstCandidate; k <= lastCandidate; ++k)
+		{
+			const CCVector3& A = m_samples[k].P;
+			CCVector3 AB = m_samples[k + 1].P - A;
+			PointCoordinateType squareLength = AB.norm2();
+			PointCoordinateType t = (squareLength > 0 ? (Pin - A).dot(AB) / squareLength : 0);
+			if (k != 0)
+				t = std::max(t, static_cast<PointCoordinateType>(0));
+			if (k != lastSegment)
+				t = std::min(t, static_cast<PointCoordinateType>(1));
+
+			PointCoordinateType squareDist = (Pin - (A + AB * t)).norm2();
+			if (squareDist < bestSquareDist)
+			{
+				bestSquareDist = squareDist;
+				bestSegment = k;
+				bestT = t;
+			}
+		}
+
+		const CenterlineSample& A = m_samples[bestSegment];
+		const CenterlineSample& B = m_samples[bestSegment + 1];
+		CCVector3 F = A.P + (B.P - A.P) * bestT;
+		PointCoordinateType chainage = A.s + (B.s - A.s) * bestT;
+
+		CCVector3 T;
+		CCVector3 up;
+		CCVector3 side;
+		ComputeCenterlineFrame(A.T * (1 - bestT) + B.T * bestT, T, up, side);
+
+		CCVector3 FP = Pin - F;
+		PointCoordinateType a = FP.dot(side);
+		PointCoordinateType b = FP.dot(up);
+		PointCoordinateType depth = sqrt(a * a + b * b);
+		PointCoordinateType angle_rad = atan2(a, b);
+
+		Pout = CCVector3(chainage, angle_rad * m_radius, -depth);
+		delta = depth - m_radius;
+
+		if (frame)
+		{
+			frame->T = T;
+			frame->radial = up;
+			frame->ortho = side;
+			if (depth > CCCoreLib::ZERO_TOLERANCE_F)
+			{
+				frame->radial = (side * a + up * b) / depth;
+				frame->ortho = (side * b - up * a) / depth;
+			}
+		}
 	}
-	catch (const std::bad_alloc&)
+
+protected:
+
+	//! Returns the key of a grid cell
+	static inline uint64_t CellKey(int x, int y, int z)
 	{
-		//not enough memory
-		return nullptr;
+		return static_cast<uint64_t>(x) | (static_cast<uint64_t>(y) << 21) | (static_cast<uint64_t>(z) << 42);
 	}
 
-	std::vector<CCVector3> unrolledNormals;
-	bool withNormals = hasNormals();
-	if (withNormals)
+	//! Builds the uniform grid on the centerline samples
+	/** \warning may throw std::bad_alloc
+	**/
+	void buildGrid()
 	{
-		//for normals, we can simply store at most one unrolled normal per original one
-		//same thing for deviation values
-		try
+		CCVector3 bbMin = m_samples.front().P;
+		CCVector3 bbMax = bbMin;
+		for (const CenterlineSample& sample : m_samples)
 		{
-			unrolledNormals.resize(size());
+			for (unsigned d = 0; d < 3; ++d)
+			{
+				bbMin.u[d] = std::min(bbMin.u[d], sample.P.u[d]);
+				bbMax.u[d] = std::max(bbMax.u[d], sample.P.u[d]);
+			}
 		}
-		catch (const std::bad_alloc&)
+
+		//the cells are roughly as large as the unrolling radius (the points are mostly at this distance)
+		PointCoordinateType maxDim = std::max((bbMax - bbMin).norm(), static_cast<PointCoordinateType>(CCCoreLib::ZERO_TOLERANCE_F));
+		m_cellSize = std::max(m_radius, maxDim / ((1 << 21) - 1));
+		m_origin = bbMin;
+		for (unsigned d = 0; d < 3; ++d)
 		{
-			//not enough memory
-			return nullptr;
+			m_gridSize.u[d] = static_cast<int>((bbMax.u[d] - bbMin.u[d]) / m_cellSize) + 1;
+		}
+
+		//sort the samples by cell
+		size_t sampleCount = m_samples.size();
+		std::vector<std::pair<uint64_t, unsigned>> keys(sampleCount);
+		for (size_t i = 0; i < sampleCount; ++i)
+		{
+			Tuple3i cell = cellPos(m_samples[i].P);
+			keys[i] = { CellKey(cell.x, cell.y, cell.z), static_cast<unsigned>(i) };
+		}
+		std::sort(keys.begin(), keys.end());
+
+		m_sortedIndexes.resize(sampleCount);
+		m_cells.clear();
+		for (size_t i = 0; i < sampleCount; ++i)
+		{
+			m_sortedIndexes[i] = keys[i].second;
+			if (i == 0 || keys[i].first != keys[i - 1].first)
+			{
+				m_cells[keys[i].first] = { static_cast<unsigned>(i), static_cast<unsigned>(i + 1) };
+			}
+			else
+			{
+				m_cells[keys[i].first].second = static_cast<unsigned>(i + 1);
+			}
 		}
 	}
-	
-	double startAngle_rad = CCCoreLib::DegreesToRadians( startAngle_deg );
-	double stopAngle_rad = CCCoreLib::DegreesToRadians( stopAngle_deg );
-	float circumference = params->radius * 2 * M_PI;
-	float radius = params->radius;
 
-	PointCoordinateType alpha_rad = 0;
-	PointCoordinateType sin_alpha = 0;
-	if (mode != CYLINDER)
+	//! Returns the (clamped) position of the cell containing a given point
+	inline Tuple3i cellPos(const CCVector3& P) const
 	{
-		alpha_rad = CCCoreLib::DegreesToRadians( coneParams->coneAngle_deg );
-		sin_alpha = static_cast<PointCoordinateType>(sin(alpha_rad));
-		
+		Tuple3i pos;
+		for (unsigned d = 0; d < 3; ++d)
+		{
+			int i = static_cast<int>(std::floor((P.u[d] - m_origin.u[d]) / m_cellSize));
+			pos.u[d] = std::max(0, std::min(i, m_gridSize.u[d] - 1));
+		}
+		return pos;
 	}
-	for (unsigned i = 0; i < numberOfPoints; i++)
+
+	//! Returns the index of the nearest centerline sample (thread-safe)
+	size_t nearestSample(const CCVector3& P) const
 	{
-		const CCVector3* Pin = getPoint(i);
+		Tuple3i center = cellPos(P);
+		int maxRing = std::max(m_gridSize.x, std::max(m_gridSize.y, m_gridSize.z));
 
-		//we project the point
-		CCVector3 AP;
-		CCVector3 Pout;
-		PointCoordinateType longitude_rad = 0; //longitude (rad)
-		PointCoordinateType delta = 0; //distance to the cone/cylinder surface
-		PointCoordinateType coneAbscissa = 0;
-		
+		size_t nearestIndex = 0;
+		PointCoordinateType minSquareDist = std::numeric_limits<PointCoordinateType>::max();
+		for (int r = 0; r <= maxRing; ++r)
+		{
+			//scan the cells at a (Chebyshev) distance r from the center cell
+			for (int dz = -r; dz <= r; ++dz)
+			{
+				int z = center.z + dz;
+				if (z < 0 || z >= m_gridSize.z)
+					continue;
+				for (int dy = -r; dy <= r; ++dy)
+				{
+					int y = center.y + dy;
+					if (y < 0 || y >= m_gridSize.y)
+						continue;
+					bool onShell = (std::abs(dz) == r || std::abs(dy) == r);
+					for (int dx = -r; dx <= r; dx += (onShell ? 1 : std::max(2 * r, 1)))
+					{
+						int x = center.x + dx;
+						if (x < 0 || x >= m_gridSize.x)
+							continue;
+						auto it = m_cells.find(CellKey(x, y, z));
+						if (it == m_cells.end())
+							continue;
+						for (unsigned j = it->second.first; j < it->second.second; ++j)
+						{
+							unsigned index = m_sortedIndexes[j];
+							PointCoordinateType squareDist = (P - m_samples[index].P).norm2();
+							if (squareDist < minSquareDist)
+							{
+								minSquareDist = squareDist;
+								nearestIndex = index;
+							}
+						}
+					}
+				}
+			}
+
+			//the samples in the next rings are at least at r * cellSize
+			PointCoordinateType ringDist = r * m_cellSize;
+			if (minSquareDist <= ringDist * ringDist)
+			{
+				break;
+			}
+		}
+
+		return nearestIndex;
+	}
+
+	//! Unrolling radius
+	PointCoordinateType m_radius = 0;
+	//! Centerline samples
+	std::vector<CenterlineSample> m_samples;
+
+	//! Grid cell size
+	PointCoordinateType m_cellSize = 1;
+	//! Grid origin
+	CCVector3 m_origin;
+	//! Grid size (in cells)
+	Tuple3i m_gridSize;
+	//! Sample indexes sorted by cell
+	std::vector<unsigned> m_sortedIndexes;
+	//! Cell key --> [begin, end) range in m_sortedIndexes
+	std::unordered_map<uint64_t, std::pair<unsigned, unsigned>> m_cells;
+};
+
+//! Unrolls points on a cylinder, a cone or along a trajectory (thread-safe once initialized)
+class PointUnroller
+{
+public:
+
+	//! Initializes the unroller
+	bool init(ccPointCloud::UnrollMode mode, ccPointCloud::UnrollBaseParams* params)
+	{
+		if (!params || params->axisDim > 2)
+		{
+			return false;
+		}
+
+		m_mode = mode;
+		m_radius = params->radius;
+		m_circumference = params->radius * 2 * static_cast<PointCoordinateType>(M_PI);
+		m_dim.z = params->axisDim;
+		m_dim.x = (m_dim.z < 2 ? m_dim.z + 1 : 0);
+		m_dim.y = (m_dim.x < 2 ? m_dim.x + 1 : 0);
 
 		switch (mode)
 		{
-		case CYLINDER:
+		case ccPointCloud::CYLINDER:
+			m_cylParams = static_cast<ccPointCloud::UnrollCylinderParams*>(params);
+			return true;
+		case ccPointCloud::CONE:
+		case ccPointCloud::STRAIGHTENED_CONE:
+		case ccPointCloud::STRAIGHTENED_CONE2:
+			m_coneParams = static_cast<ccPointCloud::UnrollConeParams*>(params);
+			m_alpha_rad = static_cast<PointCoordinateType>(CCCoreLib::DegreesToRadians(m_coneParams->coneAngle_deg));
+			m_sin_alpha = static_cast<PointCoordinateType>(sin(m_alpha_rad));
+			return true;
+		case ccPointCloud::TRAJECTORY:
+			return m_centerline.init(*static_cast<ccPointCloud::UnrollTrajectoryParams*>(params));
+		default:
+			assert(false);
+			break;
+		}
+		return false;
+	}
+
+	//! Returns the centerline (TRAJECTORY mode only)
+	const TrajectoryCenterline& centerline() const { return m_centerline; }
+
+	//! Unrolls a point (whatever the mode)
+	inline void unroll(const CCVector3& Pin, CCVector3& Pout, PointCoordinateType& delta) const
+	{
+		if (m_mode == ccPointCloud::TRAJECTORY)
+		{
+			m_centerline.unroll(Pin, Pout, delta);
+		}
+		else
+		{
+			CCVector3 AP;
+			PointCoordinateType longitude_rad = 0;
+			PointCoordinateType coneAbscissa = 0;
+			unrollOnAxis(Pin, AP, Pout, delta, longitude_rad, coneAbscissa);
+		}
+	}
+
+	//! Unrolls a point on the cylinder or the cone
+	/** \param AP [out] position relative to the cylinder center or to the cone apex
+	**/
+	void unrollOnAxis(	const CCVector3& Pin,
+						CCVector3& AP,
+						CCVector3& Pout,
+						PointCoordinateType& delta,
+						PointCoordinateType& longitude_rad,
+						PointCoordinateType& coneAbscissa) const
+	{
+		Pout = CCVector3(0, 0, 0);
+		delta = 0;
+
+		switch (m_mode)
 		{
-			AP = *Pin - cylParams->center;
+		case ccPointCloud::CYLINDER:
+		{
+			AP = Pin - m_cylParams->center;
 			//ProjectOnCylinder(AP, dim, params->radius, delta, longitude_rad);
-			float depth = sqrt(AP.x * AP.x + AP.y *AP.y);
-			float angle = atan2(AP.x, AP.y);
-			
-			float xCylinder = (angle / M_PI) * (circumference / 2);
+			PointCoordinateType depth = sqrt(AP.x * AP.x + AP.y *AP.y);
+			PointCoordinateType angle = atan2(AP.x, AP.y);
+
+			PointCoordinateType xCylinder = (angle / static_cast<PointCoordinateType>(M_PI)) * (m_circumference / 2);
 			//we project the point
 			//Pout.u[dim.x] = longitude_rad * radius;
 			Pout.x = xCylinder;
 			Pout.y = AP.z;
 			Pout.z = -depth;
-			delta = depth - radius;
-
+			delta = depth - m_radius;
 		}
 		break;
 
-		case STRAIGHTENED_CONE:
+		case ccPointCloud::STRAIGHTENED_CONE:
 		{
-			AP = *Pin - coneParams->apex;
-			ProjectOnCone(AP, alpha_rad, dim, coneAbscissa, delta, longitude_rad);
+			AP = Pin - m_coneParams->apex;
+			ProjectOnCone(AP, m_alpha_rad, m_dim, coneAbscissa, delta, longitude_rad);
 			//we simply develop the cone as a cylinder
 			//Pout.u[dim.x] = phi_rad * params->radius;
-			Pout.u[dim.y] = -delta;
+			Pout.u[m_dim.y] = -delta;
 			//Pout.u[dim.z] = Pin->u[dim.z];
-			Pout.u[dim.z] = coneParams->apex.u[dim.z] - coneAbscissa;
+			Pout.u[m_dim.z] = m_coneParams->apex.u[m_dim.z] - coneAbscissa;
 		}
 		break;
 
-		case STRAIGHTENED_CONE2:
+		case ccPointCloud::STRAIGHTENED_CONE2:
 		{
-			AP = *Pin - coneParams->apex;
-			ProjectOnCone(AP, alpha_rad, dim, coneAbscissa, delta, longitude_rad);
+			AP = Pin - m_coneParams->apex;
+			ProjectOnCone(AP, m_alpha_rad, m_dim, coneAbscissa, delta, longitude_rad);
 			//we simply develop the cone as a cylinder
 			//Pout.u[dim.x] = phi_rad * coneAbscissa * sin_alpha;
-			Pout.u[dim.y] = -delta;
+			Pout.u[m_dim.y] = -delta;
 			//Pout.u[dim.z] = Pin->u[dim.z];
-			Pout.u[dim.z] = coneParams->apex.u[dim.z] - coneAbscissa;
+			Pout.u[m_dim.z] = m_coneParams->apex.u[m_dim.z] - coneAbscissa;
 		}
 		break;
 
-		case CONE:
+		case ccPointCloud::CONE:
 		{
-			AP = *Pin - coneParams->apex;
-			ProjectOnCone(AP, alpha_rad, dim, coneAbscissa, delta, longitude_rad);
+			AP = Pin - m_coneParams->apex;
+			ProjectOnCone(AP, m_alpha_rad, m_dim, coneAbscissa, delta, longitude_rad);
 			//unrolling
-			PointCoordinateType theta_rad = longitude_rad * sin_alpha; //sin_alpha is a bit arbitrary here. The aim is mostly to reduce the angular range
+			PointCoordinateType theta_rad = longitude_rad * m_sin_alpha; //sin_alpha is a bit arbitrary here. The aim is mostly to reduce the angular range
 			//project the point
-			Pout.u[dim.y] = -coneAbscissa * cos(theta_rad);
-			Pout.u[dim.x] =  coneAbscissa * sin(theta_rad);
-			Pout.u[dim.z] = delta;
+			Pout.u[m_dim.y] = -coneAbscissa * cos(theta_rad);
+			Pout.u[m_dim.x] =  coneAbscissa * sin(theta_rad);
+			Pout.u[m_dim.z] = delta;
 		}
 		break;
 
 		default:
 			assert(false);
 		}
-		
-		// first unroll its normal if necessary
-		if (withNormals)
-		{
+	}
+
+protected:
+
+	ccPointCloud::UnrollMode m_mode = ccPointCloud::CYLINDER;
+	Tuple3ub m_dim;
+	PointCoordinateType m_radius = 0;
+	PointCoordinateType m_circumference = 0;
+	PointCoordinateType m_alpha_rad = 0;
+	PointCoordinateType m_sin_alpha = 0;
+	const ccPointCloud::UnrollCylinderParams* m_cylParams = nullptr;
+	const ccPointCloud::UnrollConeParams* m_coneParams = nullptr;
+	TrajectoryCenterline m_centerline;
+};
+
+//! Applies 'process(pointIndex)' to all points, by chunks processed in parallel
+/** The progress is updated (and cancellation checked) after each chunk.
+	\return false if the process has been cancelled
+**/
+template <class Process> static bool ParallelUnrollByChunks(unsigned numberOfPoints, Process process, CCCoreLib::NormalizedProgress& nprogress, bool withProgress)
+{
+	static const unsigned s_chunkSize = (1 << 16);
+	for (unsigned chunkStart = 0; chunkStart < numberOfPoints; chunkStart += s_chunkSize)
+	{
+		int chunkStop = static_cast<int>(std::min(chunkStart + s_chunkSize, numberOfPoints));
+
+#if defined(_OPENMP)
+#pragma omp parallel for
+#endif
+		for (int i = static_cast<int>(chunkStart); i < chunkStop; ++i)
+		{
+			process(static_cast<unsigned>(i));
+		}
+
+		//process canceled by user?
+		if (withProgress && !nprogress.steps(static_cast<unsigned>(chunkStop) - chunkStart))
+		{
+			ccLog::Warning("Process cancelled by user");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+ccPointCloud* ccPointCloud::unroll(	UnrollMode mode,
+									UnrollBaseParams* params,
+									bool exportDeviationSF/*=false*/,
+									double startAngle_deg/*=0.0*/,
+									double stopAngle_deg/*=360.0*/,
+									CCCoreLib::GenericProgressCallback* progressCb/*=nullptr*/) const
+{
+	if (	!params
+		||	params->axisDim > 2
+		||	startAngle_deg >= stopAngle_deg)
+	{
+		//invalid input parameters
+		assert(false);
+		return nullptr;
+	}
+
+	if (mode == TRAJECTORY)
+	{
+		//no angular range in this mode
+		return unrollAlongTrajectory(*static_cast<UnrollTrajectoryParams*>(params), exportDeviationSF, progressCb);
+	}
+
+	QString modeStr;
+	UnrollConeParams* coneParams = nullptr;
+
+	switch (mode)
+	{
+	case CYLINDER:
+		modeStr = "Cylinder";
+		break;
+	case CONE:
+		modeStr = "Cone";
+		coneParams = static_cast<UnrollConeParams*>(params);
+		break;
+	case STRAIGHTENED_CONE:
+	case STRAIGHTENED_CONE2:
+		modeStr = "Straightened cone";
+		coneParams = static_cast<UnrollConeParams*>(params);
+		break;
+	default:
+		assert(false);
+		return nullptr;
+	}
+
+	Tuple3ub dim;
+	dim.z = params->axisDim;
+	dim.x = (dim.z < 2 ? dim.z + 1 : 0);
+	dim.y = (dim.x < 2 ? dim.x + 1 : 0);
+
+	unsigned numberOfPoints = size();
+	CCCoreLib::NormalizedProgress nprogress(progressCb, numberOfPoints);
+	if (progressCb)
+	{
+		if (progressCb->textCanBeEdited())
+		{
+			progressCb->setMethodTitle(qPrintable(QString("Unroll (%1)").arg(modeStr)));
+			progressCb->setInfo(qPrintable(QString("Number of points = %1").arg(numberOfPoints)));
+		}
+		progressCb->update(0);
+		progressCb->start();
+	}
+
+	CCCoreLib::ReferenceCloud duplicatedPoints(const_cast<ccPointCloud*>(this));
+	std::vector<CCVector3> unrolledPoints;
+	{
+		//compute an estimate of the final point count
+		unsigned newSize = static_cast<unsigned>(std::ceil((stopAngle_deg - startAngle_deg) / 360.0 * size()));
+		if (!duplicatedPoints.reserve(newSize))
+		{
+			ccLog::Error("Not enough memory");
+			return nullptr;
+		}
+
+		try
+		{
+			unrolledPoints.reserve(newSize);
+		}
+		catch (const std::bad_alloc&)
+		{
+			ccLog::Error("Not enough memory");
+			return nullptr;
+		}
+	}
+
+	std::vector<ScalarType> deviationValues;
+	if (exportDeviationSF)
+	try
+	{
+		deviationValues.resize(size());
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return nullptr;
+	}
+
+	std::vector<CCVector3> unrolledNormals;
+	bool withNormals = hasNormals();
+	if (withNormals)
+	{
+		//for normals, we can simply store at most one unrolled normal per original one
+		//same thing for deviation values
+		try
+		{
+			unrolledNormals.resize(size());
+		}
+		catch (const std::bad_alloc&)
+		{
+			//not enough memory
+			return nullptr;
+		}
+	}
+	
+	PointUnroller unroller;
+	if (!unroller.init(mode, params))
+	{
+		assert(false);
+		return nullptr;
+	}
+
+	PointCoordinateType alpha_rad = 0;
+	PointCoordinateType sin_alpha = 0;
+	if (mode != CYLINDER)
+	{
+		alpha_rad = CCCoreLib::DegreesToRadians( coneParams->coneAngle_deg );
+		sin_alpha = static_cast<PointCoordinateType>(sin(alpha_rad));
+		
+	}
+	for (unsigned i = 0; i < numberOfPoints; i++)
+	{
+		const CCVector3* Pin = getPoint(i);
+
+		//we project the point
+		CCVector3 AP;
+		CCVector3 Pout;
+		PointCoordinateType longitude_rad = 0; //longitude (rad)
+		PointCoordinateType delta = 0; //distance to the cone/cylinder surface
+		PointCoordinateType coneAbscissa = 0;
+		
+
+		unroller.unrollOnAxis(*Pin, AP, Pout, delta, longitude_rad, coneAbscissa);
+		
+		// first unroll its normal if necessary
+		if (withNormals)
+		{
 			const CCVector3& N = getPointNormal(i);
 			CCVector3 AP2 = AP + N;
 			CCVector3 N2;
@@ -4054,6 +4608,297 @@ ccPointCloud* ccPointCloud::unroll(	UnrollMode mode,
 }
 
 
+
+
+ccPointCloud* ccPointCloud::unrollAlongTrajectory(	const UnrollTrajectoryParams& params,
+													bool exportDeviationSF,
+													CCCoreLib::GenericProgressCallback* progressCb) const
+{
+	PointUnroller unroller;
+	if (!unroller.init(TRAJECTORY, const_cast<UnrollTrajectoryParams*>(&params)))
+	{
+		return nullptr;
+	}
+	const TrajectoryCenterline& centerline = unroller.centerline();
+
+	unsigned numberOfPoints = size();
+	bool withNormals = hasNormals();
+
+	std::vector<CCVector3> unrolledPoints;
+	std::vector<CCVector3> unrolledNormals;
+	std::vector<ScalarType> deviationValues;
+	try
+	{
+		unrolledPoints.resize(numberOfPoints);
+		if (withNormals)
+		{
+			unrolledNormals.resize(numberOfPoints);
+		}
+		if (exportDeviationSF)
+		{
+			deviationValues.resize(numberOfPoints);
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		ccLog::Error("Not enough memory");
+		return nullptr;
+	}
+
+	CCCoreLib::NormalizedProgress nprogress(progressCb, numberOfPoints);
+	if (progressCb)
+	{
+		if (progressCb->textCanBeEdited())
+		{
+			progressCb->setMethodTitle("Unroll (Trajectory)");
+			progressCb->setInfo(qPrintable(QString("Number of points = %1\nCenterline length = %2").arg(numberOfPoints).arg(centerline.length())));
+		}
+		progressCb->update(0);
+		progressCb->start();
+	}
+
+	bool completed = ParallelUnrollByChunks(numberOfPoints, [&](unsigned i)
+	{
+		PointCoordinateType delta = 0;
+		TrajectoryCenterline::Frame frame;
+		centerline.unroll(*getPoint(i), unrolledPoints[i], delta, withNormals ? &frame : nullptr);
+
+		if (withNormals)
+		{
+			const CCVector3& N = getPointNormal(i);
+			CCVector3 N2(N.dot(frame.T), N.dot(frame.ortho), -N.dot(frame.radial));
+			N2.normalize();
+			unrolledNormals[i] = N2;
+		}
+		if (exportDeviationSF)
+		{
+			deviationValues[i] = static_cast<ScalarType>(delta);
+		}
+	}, nprogress, progressCb != nullptr);
+
+	if (progressCb)
+	{
+		progressCb->stop();
+	}
+	if (!completed)
+	{
+		return nullptr;
+	}
+
+	//now create the real cloud
+	CCCoreLib::ReferenceCloud allPoints(const_cast<ccPointCloud*>(this));
+	if (!allPoints.addPointIndex(0, numberOfPoints))
+	{
+		ccLog::Error("Not enough memory");
+		return nullptr;
+	}
+
+	ccPointCloud* clone = partialClone(&allPoints);
+	if (clone)
+	{
+		CCCoreLib::ScalarField* deviationSF = nullptr;
+		if (exportDeviationSF)
+		{
+			int sfIdx = clone->getScalarFieldIndexByName(s_deviationSFName);
+			if (sfIdx < 0)
+			{
+				sfIdx = clone->addScalarField(s_deviationSFName);
+				if (sfIdx < 0)
+				{
+					ccLog::Warning("[unrollAlongTrajectory] Not enough memory to init the deviation scalar field");
+				}
+			}
+			if (sfIdx >= 0)
+			{
+				deviationSF = clone->getScalarField(sfIdx);
+				clone->showSF(true);
+			}
+		}
+
+		//update the coordinates, the normals and the deviation SF
+		int count = static_cast<int>(numberOfPoints);
+#if defined(_OPENMP)
+#pragma omp parallel for
+#endif
+		for (int i = 0; i < count; ++i)
+		{
+			*clone->point(static_cast<unsigned>(i)) = unrolledPoints[i];
+			if (withNormals)
+			{
+				clone->setPointNormal(static_cast<unsigned>(i), unrolledNormals[i]);
+			}
+			if (deviationSF)
+			{
+				deviationSF->setValue(static_cast<unsigned>(i), deviationValues[i]);
+			}
+		}
+
+		if (deviationSF)
+		{
+			deviationSF->computeMinAndMax();
+		}
+
+		clone->setName(getName() + ".unrolled");
+		clone->refreshBB(); //calls notifyGeometryUpdate + releaseVBOs
+	}
+
+	return clone;
+}
+
+ccPointCloud* ccPointCloud::createUnrolledView(	UnrollMode mode,
+												UnrollBaseParams* params,
+												bool exportDeviationSF/*=false*/,
+												CCCoreLib::GenericProgressCallback* progressCb/*=nullptr*/)
+{
+	PointUnroller unroller;
+	if (!unroller.init(mode, params))
+	{
+		return nullptr;
+	}
+
+	//the deviation is directly written in a scalar field of this cloud (shared with the view)
+	CCCoreLib::ScalarField* deviationSF = nullptr;
+	int deviationSFIdx = -1;
+	bool deviationSFCreated = false;
+	if (exportDeviationSF)
+	{
+		deviationSFIdx = getScalarFieldIndexByName(s_deviationSFName);
+		if (deviationSFIdx < 0)
+		{
+			deviationSFIdx = addScalarField(s_deviationSFName);
+			deviationSFCreated = (deviationSFIdx >= 0);
+		}
+		if (deviationSFIdx >= 0)
+		{
+			deviationSF = getScalarField(deviationSFIdx);
+		}
+		else
+		{
+			ccLog::Warning("[createUnrolledView] Not enough memory to init the deviation scalar field");
+		}
+	}
+
+	unsigned numberOfPoints = size();
+	ccPointCloud* view = new ccPointCloud(getName() + ".unrolled");
+	if (!view->resize(numberOfPoints))
+	{
+		ccLog::Error("Not enough memory");
+		delete view;
+		if (deviationSFCreated)
+		{
+			deleteScalarField(deviationSFIdx);
+		}
+		return nullptr;
+	}
+
+	CCCoreLib::NormalizedProgress nprogress(progressCb, numberOfPoints);
+	if (progressCb)
+	{
+		if (progressCb->textCanBeEdited())
+		{
+			progressCb->setMethodTitle("Unroll (view)");
+			progressCb->setInfo(qPrintable(QString("Number of points = %1").arg(numberOfPoints)));
+		}
+		progressCb->update(0);
+		progressCb->start();
+	}
+
+	//only the coordinates (and the deviation) are computed
+	bool completed = ParallelUnrollByChunks(numberOfPoints, [&](unsigned i)
+	{
+		PointCoordinateType delta = 0;
+		unroller.unroll(*getPoint(i), *view->point(i), delta);
+		if (deviationSF)
+		{
+			deviationSF->setValue(i, static_cast<ScalarType>(delta));
+		}
+	}, nprogress, progressCb != nullptr);
+
+	if (progressCb)
+	{
+		progressCb->stop();
+	}
+	if (!completed)
+	{
+		delete view;
+		if (deviationSFCreated)
+		{
+			deleteScalarField(deviationSFIdx);
+		}
+		return nullptr;
+	}
+
+	if (deviationSF)
+	{
+		deviationSF->computeMinAndMax();
+	}
+
+	//the other attributes are shared
+	if (m_rgbaColors)
+	{
+		m_rgbaColors->link();
+		view->m_rgbaColors = m_rgbaColors;
+		view->showColors(colorsShown());
+	}
+	for (unsigned i = 0; i < getNumberOfScalarFields(); ++i)
+	{
+		view->addScalarField(static_cast<ccScalarField*>(getScalarField(static_cast<int>(i))));
+	}
+	if (m_currentDisplayedScalarFieldIndex >= 0)
+	{
+		view->setCurrentDisplayedScalarField(m_currentDisplayedScalarFieldIndex);
+		view->showSF(sfShown());
+	}
+
+	view->refreshBB(); //calls notifyGeometryUpdate + releaseVBOs
+	view->setDisplay(getDisplay());
+	//the view can't be edited as a standard cloud
+	view->setLocked(true);
+
+	return view;
+}
+
+bool ccPointCloud::unshareAttributes()
+{
+	if (m_rgbaColors && m_rgbaColors->getLinkCount() > 1)
+	{
+		RGBAColorsTableType* colors = m_rgbaColors->clone();
+		if (!colors)
+		{
+			return false;
+		}
+		colors->link();
+		m_rgbaColors->release();
+		m_rgbaColors = colors;
+		releaseVBOs();
+	}
+
+	for (ScalarField*& sf : m_scalarFields)
+	{
+		if (sf->getLinkCount() > 1)
+		{
+			ccScalarField* sfCopy = nullptr;
+			try
+			{
+				sfCopy = new ccScalarField(*static_cast<ccScalarField*>(sf));
+			}
+			catch (const std::bad_alloc&)
+			{
+				return false;
+			}
+			sfCopy->link();
+			if (m_currentDisplayedScalarField == sf)
+			{
+				m_currentDisplayedScalarField = sfCopy;
+			}
+			sf->release();
+			sf = sfCopy;
+		}
+	}
+
+	return true;
+}
+
 //void ccPointCloud::unrollOnCone(PointCoordinateType baseRadius,
 //	double alpha_deg,
 //	const CCVector3& apex,
@@ -4773,6 +5618,48 @@ void ccPointCloud::setImageFolder(QString folder) {
 	m_fileImageRelative = infoDir.path();
 };
 
+void ccPointCloud::setTrajectoryCloud(ccPointCloud* cloud)
+{
+	m_trajectoryPtr = cloud;
+
+	//the index is built once, when the trajectory is attached
+	delete m_trajectoryIndex;
+	m_trajectoryIndex = nullptr;
+	m_trajectoryIndexIsDirty = false;
+
+	if (cloud)
+	{
+		m_trajectoryIndex = new ccTrajectoryIndex;
+		if (!m_trajectoryIndex->build(cloud))
+		{
+			ccLog::Warning(QString("[ccPointCloud] Failed to index the trajectory of cloud '%1'").arg(getName()));
+		}
+	}
+}
+
+const ccTrajectoryIndex* ccPointCloud::getTrajectoryIndex()
+{
+	if (!m_trajectoryPtr)
+	{
+		return nullptr;
+	}
+
+	if (!m_trajectoryIndex)
+	{
+		m_trajectoryIndex = new ccTrajectoryIndex;
+		m_trajectoryIndexIsDirty = true;
+	}
+
+	//the trajectory may have been transformed or edited in the meantime
+	if (m_trajectoryIndexIsDirty || m_trajectoryIndex->size() != m_trajectoryPtr->size())
+	{
+		m_trajectoryIndex->build(m_trajectoryPtr);
+		m_trajectoryIndexIsDirty = false;
+	}
+
+	return m_trajectoryIndex;
+}
+
 
 unsigned ccPointCloud::getUniqueIDForDisplay() const
 {
@@ -0,0 +1,411 @@
+//##########################################################################
+//#                                                                        #
+//#                              CLOUDCOMPARE                              #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                    COPYRIGHT: CloudCompare project                     #
+//#                                                                        #
+//##########################################################################
+
+#include "ccSerializableObject.h"
+
+//CCCoreLib
+#include <TaskScheduler.h>
+
+//Qt
+#include <QByteArray>
+
+//system
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	//! Array data encodings (dataVersion>=53)
+	enum ArrayCodec : uint8_t
+	{
+		RAW_ARRAY			= 0,	/**< Raw values (as before) **/
+		COMPRESSED_ARRAY	= 1,	/**< Chunks of delta-encoded + byte-shuffled + zlib-compressed values **/
+	};
+
+	//! Uncompressed size of the chunks (in bytes)
+	const qint64 c_chunkByteSize = (4 << 20);
+	//! Arrays smaller than this (in bytes) are not compressed
+	const qint64 c_minCompressedByteSize = (64 << 10);
+	//! zlib compression level (fast)
+	const int c_compressionLevel = 3;
+	//! Max number of bytes read or written at once (Qt and/or Windows don't like to read too many bytes in a row...)
+	const qint64 c_maxByteIOCount = (1 << 26);
+
+	//! Writes raw bytes (by blocks)
+	bool WriteRawBytes(QFile& out, const char* data, qint64 byteCount)
+	{
+		while (byteCount > 0)
+		{
+			qint64 saveCount = std::min(byteCount, c_maxByteIOCount);
+			if (out.write(data, saveCount) != saveCount)
+				return false;
+			data += saveCount;
+			byteCount -= saveCount;
+		}
+		return true;
+	}
+
+	//! Reads raw bytes (by blocks)
+	bool ReadRawBytes(QFile& in, char* data, qint64 byteCount)
+	{
+		while (byteCount > 0)
+		{
+			qint64 readCount = std::min(byteCount, c_maxByteIOCount);
+			if (in.read(data, readCount) != readCount)
+				return false;
+			data += readCount;
+			byteCount -= readCount;
+		}
+		return true;
+	}
+
+	//! Delta-encodes the values of each component and groups their bytes by significance
+	/** \param src source values (valueCount * sizeof(T) bytes)
+		\param dest destination (same size)
+		\param valueCount number of values
+		\param stride number of components per element (the delta is computed between consecutive elements)
+	**/
+	template <typename T> void EncodeValues(const char* src, char* dest, size_t valueCount, size_t stride)
+	{
+		for (size_t i = 0; i < valueCount; ++i)
+		{
+			T value;
+			memcpy(&value, src + i * sizeof(T), sizeof(T));
+
+			T delta = value;
+			if (i >= stride)
+			{
+				T former;
+				memcpy(&former, src + (i - stride) * sizeof(T), sizeof(T));
+				delta = static_cast<T>(value - former);
+			}
+
+			for (size_t b = 0; b < sizeof(T); ++b)
+			{
+				dest[b * valueCount + i] = static_cast<char>((delta >> (8 * b)) & 0xFF);
+			}
+		}
+	}
+
+	//! Inverse of EncodeValues
+	template <typename T> void DecodeValues(const char* src, char* dest, size_t valueCount, size_t stride)
+	{
+		for (size_t i = 0; i < valueCount; ++i)
+		{
+			T value = 0;
+			for (size_t b = 0; b < sizeof(T); ++b)
+			{
+				value |= static_cast<T>(static_cast<T>(static_cast<unsigned char>(src[b * valueCount + i])) << (8 * b));
+			}
+
+			if (i >= stride)
+			{
+				T former;
+				memcpy(&former, dest + (i - stride) * sizeof(T), sizeof(T));
+				value = static_cast<T>(value + former);
+			}
+
+			memcpy(dest + i * sizeof(T), &value, sizeof(T));
+		}
+	}
+
+	//! Compresses a chunk
+	/** \return the compressed chunk, or the raw chunk if it can't be compressed (same size)
+	**/
+	QByteArray EncodeChunk(const char* data, qint64 byteCount, size_t componentSize, int componentCount)
+	{
+		QByteArray encoded(static_cast<int>(byteCount), Qt::Uninitialized);
+		size_t valueCount = static_cast<size_t>(byteCount) / componentSize;
+		size_t stride = static_cast<size_t>(componentCount);
+		switch (componentSize)
+		{
+		case 1:
+			EncodeValues<uint8_t>(data, encoded.data(), valueCount, stride);
+			break;
+		case 2:
+			EncodeValues<uint16_t>(data, encoded.data(), valueCount, stride);
+			break;
+		case 4:
+			EncodeValues<uint32_t>(data, encoded.data(), valueCount, stride);
+			break;
+		case 8:
+			EncodeValues<uint64_t>(data, encoded.data(), valueCount, stride);
+			break;
+		default:
+			assert(false);
+			return QByteArray(data, static_cast<int>(byteCount));
+		}
+
+		QByteArray compressed = qCompress(encoded, c_compressionLevel);
+		if (compressed.size() < byteCount)
+		{
+			return compressed;
+		}
+
+		//not worth it
+		return QByteArray(data, static_cast<int>(byteCount));
+	}
+
+	//! Decompresses a chunk
+	bool DecodeChunk(const char* chunk, qint64 chunkByteCount, char* data, qint64 byteCount, size_t componentSize, int componentCount)
+	{
+		if (chunkByteCount == byteCount)
+		{
+			//raw chunk
+			memcpy(data, chunk, static_cast<size_t>(byteCount));
+			return true;
+		}
+
+		QByteArray encoded = qUncompress(reinterpret_cast<const uchar*>(chunk), static_cast<int>(chunkByteCount));
+		if (encoded.size() != byteCount)
+		{
+			return false;
+		}
+
+		size_t valueCount = static_cast<size_t>(byteCount) / componentSize;
+		size_t stride = static_cast<size_t>(componentCount);
+		switch (componentSize)
+		{
+		case 1:
+			DecodeValues<uint8_t>(encoded.constData(), data, valueCount, stride);
+			break;
+		case 2:
+			DecodeValues<uint16_t>(encoded.constData(), data, valueCount, stride);
+			break;
+		case 4:
+			DecodeValues<uint32_t>(encoded.constData(), data, valueCount, stride);
+			break;
+		case 8:
+			DecodeValues<uint64_t>(encoded.constData(), data, valueCount, stride);
+			break;
+		default:
+			return false;
+		}
+
+		return true;
+	}
+
+	//! Returns the number of chunks processed at once (to limit the memory consumption)
+	unsigned ChunkBatchSize()
+	{
+		return static_cast<unsigned>(std::max(1, CCCoreLib::TaskScheduler::IdealThreadCount())) * 2;
+	}
+}
+
+bool ccSerializationHelper::WriteArrayData(QFile& out, const void* data, qint64 elementCount, size_t componentSize, int componentCount)
+{
+	assert(out.isOpen() && (out.openMode() & QIODevice::WriteOnly));
+	assert(componentCount > 0);
+
+	const qint64 elementByteSize = static_cast<qint64>(componentSize) * componentCount;
+	const qint64 byteCount = elementCount * elementByteSize;
+	const char* _data = static_cast<const char*>(data);
+
+	bool compressible = (componentSize == 1 || componentSize == 2 || componentSize == 4 || componentSize == 8);
+	if (!compressible || byteCount < c_minCompressedByteSize)
+	{
+		//raw array (dataVersion>=53)
+		uint8_t codec = RAW_ARRAY;
+		if (out.write((const char*)&codec, 1) != 1)
+			return false;
+
+		return WriteRawBytes(out, _data, byteCount);
+	}
+
+	//compressed array (dataVersion>=53)
+	uint8_t codec = COMPRESSED_ARRAY;
+	uint8_t componentSize_u8 = static_cast<uint8_t>(componentSize);
+	uint32_t chunkElementCount = static_cast<uint32_t>(std::max<qint64>(1, c_chunkByteSize / elementByteSize));
+	uint32_t chunkCount = static_cast<uint32_t>((elementCount + chunkElementCount - 1) / chunkElementCount);
+	if (	out.write((const char*)&codec, 1) != 1
+		||	out.write((const char*)&componentSize_u8, 1) != 1
+		||	out.write((const char*)&chunkElementCount, 4) != 4
+		||	out.write((const char*)&chunkCount, 4) != 4)
+	{
+		return false;
+	}
+
+	//chunk index (the compressed size of each chunk, updated once the chunks are written)
+	std::vector<uint32_t> chunkByteCounts;
+	try
+	{
+		chunkByteCounts.resize(chunkCount, 0);
+	}
+	catch (const std::bad_alloc&)
+	{
+		return false;
+	}
+	qint64 indexPos = out.pos();
+	if (!WriteRawBytes(out, (const char*)chunkByteCounts.data(), static_cast<qint64>(chunkCount) * 4))
+		return false;
+
+	//the chunks are compressed in parallel (by batches)
+	CCCoreLib::TaskScheduler scheduler;
+	const unsigned batchSize = ChunkBatchSize();
+	std::vector<QByteArray> chunks(batchSize);
+	for (uint32_t firstChunk = 0; firstChunk < chunkCount; firstChunk += batchSize)
+	{
+		unsigned currentBatchSize = std::min(batchSize, chunkCount - firstChunk);
+		bool success = scheduler.run(currentBatchSize, [&](unsigned i)
+		{
+			qint64 firstElement = static_cast<qint64>(firstChunk + i) * chunkElementCount;
+			qint64 chunkElements = std::min<qint64>(chunkElementCount, elementCount - firstElement);
+			try
+			{
+				chunks[i] = EncodeChunk(_data + firstElement * elementByteSize, chunkElements * elementByteSize, componentSize, componentCount);
+			}
+			catch (const std::bad_alloc&)
+			{
+				return false;
+			}
+			return !chunks[i].isEmpty();
+		});
+
+		if (!success)
+		{
+			return false;
+		}
+
+		for (unsigned i = 0; i < currentBatchSize; ++i)
+		{
+			chunkByteCounts[firstChunk + i] = static_cast<uint32_t>(chunks[i].size());
+			if (!WriteRawBytes(out, chunks[i].constData(), chunks[i].size()))
+				return false;
+			chunks[i].clear();
+		}
+	}
+
+	//update the chunk index
+	qint64 endPos = out.pos();
+	if (	!out.seek(indexPos)
+		||	!WriteRawBytes(out, (const char*)chunkByteCounts.data(), static_cast<qint64>(chunkCount) * 4)
+		||	!out.seek(endPos))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+bool ccSerializationHelper::ReadArrayData(QFile& in, short dataVersion, void* data, qint64 elementCount, size_t componentSize, int componentCount)
+{
+	assert(in.isOpen() && (in.openMode() & QIODevice::ReadOnly));
+
+	const qint64 elementByteSize = static_cast<qint64>(componentSize) * componentCount;
+	const qint64 byteCount = elementCount * elementByteSize;
+	char* _data = static_cast<char*>(data);
+
+	uint8_t codec = RAW_ARRAY;
+	if (dataVersion >= 53)
+	{
+		if (in.read((char*)&codec, 1) != 1)
+			return ccSerializableObject::ReadError();
+	}
+
+	if (codec == RAW_ARRAY)
+	{
+		if (!ReadRawBytes(in, _data, byteCount))
+			return ccSerializableObject::ReadError();
+		return true;
+	}
+	else if (codec != COMPRESSED_ARRAY)
+	{
+		return ccSerializableObject::CorruptError();
+	}
+
+	//compressed array (dataVersion>=53)
+	uint8_t componentSize_u8 = 0;
+	uint32_t chunkElementCount = 0;
+	uint32_t chunkCount = 0;
+	if (	in.read((char*)&componentSize_u8, 1) != 1
+		||	in.read((char*)&chunkElementCount, 4) != 4
+		||	in.read((char*)&chunkCount, 4) != 4)
+	{
+		return ccSerializableObject::ReadError();
+	}
+	if (	componentSize_u8 != componentSize
+		||	chunkElementCount == 0
+		||	static_cast<qint64>(chunkCount) != (elementCount + chunkElementCount - 1) / chunkElementCount)
+	{
+		return ccSerializableObject::CorruptError();
+	}
+
+	//chunk index
+	std::vector<uint32_t> chunkByteCounts;
+	try
+	{
+		chunkByteCounts.resize(chunkCount);
+	}
+	catch (const std::bad_alloc&)
+	{
+		return ccSerializableObject::MemoryError();
+	}
+	if (!ReadRawBytes(in, (char*)chunkByteCounts.data(), static_cast<qint64>(chunkCount) * 4))
+		return ccSerializableObject::ReadError();
+
+	//the chunks are read sequentially and decoded in parallel (by batches)
+	CCCoreLib::TaskScheduler scheduler;
+	const unsigned batchSize = ChunkBatchSize();
+	QByteArray buffer;
+	std::vector<qint64> chunkOffsets(batchSize + 1);
+	for (uint32_t firstChunk = 0; firstChunk < chunkCount; firstChunk += batchSize)
+	{
+		unsigned currentBatchSize = std::min(batchSize, chunkCount - firstChunk);
+
+		chunkOffsets[0] = 0;
+		for (unsigned i = 0; i < currentBatchSize; ++i)
+		{
+			chunkOffsets[i + 1] = chunkOffsets[i] + chunkByteCounts[firstChunk + i];
+		}
+		try
+		{
+			buffer.resize(static_cast<int>(chunkOffsets[currentBatchSize]));
+		}
+		catch (const std::bad_alloc&)
+		{
+			return ccSerializableObject::MemoryError();
+		}
+		if (!ReadRawBytes(in, buffer.data(), chunkOffsets[currentBatchSize]))
+			return ccSerializableObject::ReadError();
+
+		bool success = scheduler.run(currentBatchSize, [&](unsigned i)
+		{
+			qint64 firstElement = static_cast<qint64>(firstChunk + i) * chunkElementCount;
+			qint64 chunkElements = std::min<qint64>(chunkElementCount, elementCount - firstElement);
+			try
+			{
+				return DecodeChunk(	buffer.constData() + chunkOffsets[i],
+									chunkOffsets[i + 1] - chunkOffsets[i],
+									_data + firstElement * elementByteSize,
+									chunkElements * elementByteSize,
+									componentSize,
+									componentCount);
+			}
+			catch (const std::bad_alloc&)
+			{
+				return false;
+			}
+		});
+
+		if (!success)
+		{
+			return ccSerializableObject::CorruptError();
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,375 @@
+//##########################################################################
+//#                                                                        #
+//#                              CLOUDCOMPARE                              #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                    COPYRIGHT: CloudCompare project                     #
+//#                                                                        #
+//##########################################################################
+
+#include "ccTrajectoryIndex.h"
+
+//local
+#include "ccLog.h"
+#include "ccPointCloud.h"
+#include "ccScalarField.h"
+
+//CCCoreLib
+#include <CCMath.h>
+#include <SquareMatrix.h>
+
+//system
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#if defined(_OPENMP)
+//OpenMP
+#include <omp.h>
+#endif
+
+ccTrajectoryIndex::ccTrajectoryIndex()
+{
+}
+
+void ccTrajectoryIndex::clear()
+{
+	m_poses.clear();
+	m_nodes.clear();
+	m_splitDims.clear();
+}
+
+bool ccTrajectoryIndex::build(ccPointCloud* trajectory)
+{
+	clear();
+
+	if (!trajectory || trajectory->size() == 0)
+	{
+		return false;
+	}
+
+	unsigned count = trajectory->size();
+	try
+	{
+		m_poses.resize(count);
+		m_nodes.resize(count);
+		m_splitDims.resize(count, 0);
+	}
+	catch (const std::bad_alloc&)
+	{
+		ccLog::Warning("[ccTrajectoryIndex] Not enough memory");
+		clear();
+		return false;
+	}
+
+	//quaternion fields (x,y,z,qw,qx,qy,qz)
+	CCCoreLib::ScalarField* qFields[4] = { nullptr, nullptr, nullptr, nullptr };
+	{
+		const char* qNames[4] = { "qw", "qx", "qy", "qz" };
+		for (int i = 0; i < 4; ++i)
+		{
+			int sfIndex = trajectory->getScalarFieldIndexByName(qNames[i]);
+			qFields[i] = (sfIndex >= 0 ? trajectory->getScalarField(sfIndex) : nullptr);
+		}
+	}
+	bool hasOrientation = (qFields[0] && qFields[1] && qFields[2] && qFields[3]);
+
+	for (unsigned i = 0; i < count; ++i)
+	{
+		Pose& pose = m_poses[i];
+		pose.center = CCVector3d::fromArray(trajectory->getPoint(i)->u);
+		pose.hasOrientation = hasOrientation;
+		if (hasOrientation)
+		{
+			double q[4] = {	static_cast<double>(qFields[0]->getValue(i)),
+							static_cast<double>(qFields[1]->getValue(i)),
+							static_cast<double>(qFields[2]->getValue(i)),
+							static_cast<double>(qFields[3]->getValue(i)) };
+
+			ccGLMatrixd poseMat;
+			CCCoreLib::SquareMatrixd rotMat(3);
+			rotMat.initFromQuaternion(q);
+			rotMat.toGlMatrix(poseMat.data());
+			poseMat.setTranslation(pose.center);
+			pose.toCamera = poseMat.inverse();
+		}
+		else
+		{
+			pose.toCamera.toIdentity();
+			pose.toCamera.setTranslation(-pose.center);
+		}
+
+		m_nodes[i] = i;
+	}
+
+	buildNode(0, count);
+
+	return true;
+}
+
+void ccTrajectoryIndex::buildNode(unsigned begin, unsigned end)
+{
+	if (end - begin < 2)
+	{
+		return;
+	}
+
+	//split along the largest dimension of the node
+	CCVector3d bbMin = m_poses[m_nodes[begin]].center;
+	CCVector3d bbMax = bbMin;
+	for (unsigned i = begin + 1; i < end; ++i)
+	{
+		const CCVector3d& C = m_poses[m_nodes[i]].center;
+		for (unsigned char d = 0; d < 3; ++d)
+		{
+			bbMin.u[d] = std::min(bbMin.u[d], C.u[d]);
+			bbMax.u[d] = std::max(bbMax.u[d], C.u[d]);
+		}
+	}
+	CCVector3d diag = bbMax - bbMin;
+	unsigned char dim = (diag.x >= diag.y ? (diag.x >= diag.z ? 0 : 2) : (diag.y >= diag.z ? 1 : 2));
+
+	unsigned mid = (begin + end) / 2;
+	std::nth_element(m_nodes.begin() + begin, m_nodes.begin() + mid, m_nodes.begin() + end,
+		[this, dim](unsigned a, unsigned b) { return m_poses[a].center.u[dim] < m_poses[b].center.u[dim]; });
+	m_splitDims[mid] = dim;
+
+	buildNode(begin, mid);
+	buildNode(mid + 1, end);
+}
+
+void ccTrajectoryIndex::searchKNN(unsigned begin, unsigned end, const CCVector3d& P, unsigned k, std::vector<Candidate>& heap) const
+{
+	if (begin >= end)
+	{
+		return;
+	}
+
+	unsigned mid = (begin + end) / 2;
+	unsigned index = m_nodes[mid];
+	const CCVector3d& C = m_poses[index].center;
+
+	double squareDist = (C - P).norm2d();
+	if (heap.size() < k)
+	{
+		heap.emplace_back(squareDist, index);
+		std::push_heap(heap.begin(), heap.end());
+	}
+	else if (squareDist < heap.front().first)
+	{
+		std::pop_heap(heap.begin(), heap.end());
+		heap.back() = Candidate(squareDist, index);
+		std::push_heap(heap.begin(), heap.end());
+	}
+
+	double delta = P.u[m_splitDims[mid]] - C.u[m_splitDims[mid]];
+	if (delta < 0)
+	{
+		searchKNN(begin, mid, P, k, heap);
+		if (heap.size() < k || delta * delta < heap.front().first)
+		{
+			searchKNN(mid + 1, end, P, k, heap);
+		}
+	}
+	else
+	{
+		searchKNN(mid + 1, end, P, k, heap);
+		if (heap.size() < k || delta * delta < heap.front().first)
+		{
+			searchKNN(begin, mid, P, k, heap);
+		}
+	}
+}
+
+void ccTrajectoryIndex::searchSphere(unsigned begin, unsigned end, const CCVector3d& P, double squareRadius, std::vector<Candidate>& candidates) const
+{
+	if (begin >= end)
+	{
+		return;
+	}
+
+	unsigned mid = (begin + end) / 2;
+	unsigned index = m_nodes[mid];
+	const CCVector3d& C = m_poses[index].center;
+
+	double squareDist = (C - P).norm2d();
+	if (squareDist <= squareRadius)
+	{
+		candidates.emplace_back(squareDist, index);
+	}
+
+	double delta = P.u[m_splitDims[mid]] - C.u[m_splitDims[mid]];
+	if (delta <= 0 || delta * delta <= squareRadius)
+	{
+		searchSphere(begin, mid, P, squareRadius, candidates);
+	}
+	if (delta >= 0 || delta * delta <= squareRadius)
+	{
+		searchSphere(mid + 1, end, P, squareRadius, candidates);
+	}
+}
+
+int ccTrajectoryIndex::closestPose(const CCVector3d& P, double* squareDist/*=nullptr*/) const
+{
+	if (m_poses.empty())
+	{
+		return -1;
+	}
+
+	std::vector<Candidate> heap;
+	heap.reserve(1);
+	searchKNN(0, size(), P, 1, heap);
+	assert(heap.size() == 1);
+
+	if (squareDist)
+	{
+		*squareDist = heap.front().first;
+	}
+	return static_cast<int>(heap.front().second);
+}
+
+void ccTrajectoryIndex::closestPoses(const std::vector<CCVector3d>& points, std::vector<int>& poseIndexes) const
+{
+	poseIndexes.resize(points.size());
+
+	int count = static_cast<int>(points.size());
+#if defined(_OPENMP)
+#pragma omp parallel for
+#endif
+	for (int i = 0; i < count; ++i)
+	{
+		poseIndexes[i] = closestPose(points[i]);
+	}
+}
+
+void ccTrajectoryIndex::findNearestPoses(	const CCVector3d& P,
+											unsigned k,
+											std::vector<unsigned>& poseIndexes,
+											std::vector<double>* squareDistances/*=nullptr*/) const
+{
+	poseIndexes.clear();
+	if (squareDistances)
+	{
+		squareDistances->clear();
+	}
+	if (k == 0 || m_poses.empty())
+	{
+		return;
+	}
+
+	std::vector<Candidate> heap;
+	heap.reserve(std::min(k, size()));
+	searchKNN(0, size(), P, k, heap);
+	std::sort_heap(heap.begin(), heap.end());
+
+	poseIndexes.reserve(heap.size());
+	for (const Candidate& c : heap)
+	{
+		poseIndexes.push_back(c.second);
+		if (squareDistances)
+		{
+			squareDistances->push_back(c.first);
+		}
+	}
+}
+
+void ccTrajectoryIndex::findPosesInSphere(const CCVector3d& P, double radius, std::vector<unsigned>& poseIndexes) const
+{
+	poseIndexes.clear();
+	if (radius < 0 || m_poses.empty())
+	{
+		return;
+	}
+
+	std::vector<Candidate> candidates;
+	searchSphere(0, size(), P, radius * radius, candidates);
+	std::sort(candidates.begin(), candidates.end());
+
+	poseIndexes.reserve(candidates.size());
+	for (const Candidate& c : candidates)
+	{
+		poseIndexes.push_back(c.second);
+	}
+}
+
+bool ccTrajectoryIndex::IsInFieldOfView(const Pose& pose, const CCVector3d& P, const FieldOfView& fov)
+{
+	CCVector3d Pc = P;
+	pose.toCamera.apply(Pc);
+
+	double dist = Pc.normd();
+	if (dist < fov.zNear || dist > fov.zFar)
+	{
+		return false;
+	}
+	if (!pose.hasOrientation || dist == 0)
+	{
+		return true;
+	}
+
+	//same conventions as the spherical projection of the panoramas (see ccImageDrawer::projectSpherical)
+	if (fov.horizontalAngle_deg < 360.0)
+	{
+		double theta_deg = CCCoreLib::RadiansToDegrees(std::atan2(Pc.x, Pc.y)); //longitude
+		if (std::abs(theta_deg) > fov.horizontalAngle_deg / 2)
+		{
+			return false;
+		}
+	}
+	if (fov.verticalAngle_deg < 180.0)
+	{
+		double phi_deg = CCCoreLib::RadiansToDegrees(std::asin(Pc.z / dist)); //latitude
+		if (std::abs(phi_deg) > fov.verticalAngle_deg / 2)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void ccTrajectoryIndex::findPosesSeeingPoint(const CCVector3d& P, const FieldOfView& fov, std::vector<unsigned>& poseIndexes) const
+{
+	findPosesInSphere(P, fov.zFar, poseIndexes);
+
+	poseIndexes.erase(std::remove_if(poseIndexes.begin(), poseIndexes.end(),
+		[this, &P, &fov](unsigned index) { return !IsInFieldOfView(m_poses[index], P, fov); }),
+		poseIndexes.end());
+}
+
+int ccTrajectoryIndex::closestPoseSeeingPoint(const CCVector3d& P, const FieldOfView& fov) const
+{
+	std::vector<unsigned> poseIndexes;
+	findPosesInSphere(P, fov.zFar, poseIndexes);
+
+	for (unsigned index : poseIndexes)
+	{
+		if (IsInFieldOfView(m_poses[index], P, fov))
+		{
+			return static_cast<int>(index);
+		}
+	}
+	return -1;
+}
+
+void ccTrajectoryIndex::closestPosesSeeingPoints(const std::vector<CCVector3d>& points, const FieldOfView& fov, std::vector<int>& poseIndexes) const
+{
+	poseIndexes.resize(points.size());
+
+	int count = static_cast<int>(points.size());
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic, 64)
+#endif
+	for (int i = 0; i < count; ++i)
+	{
+		poseIndexes[i] = closestPoseSeeingPoint(points[i], fov);
+	}
+}
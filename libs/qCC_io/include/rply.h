@@ -10,9 +10,13 @@
  *
  * Modifications:
  *	- DGM (25/01/06) - get_plystorage_mode method added
+ *	- get_plydata_offset method added + binary elements without any read
+ *	  callback are skipped at once (instead of being read value by value)
  *
  * ---------------------------------------------------------------------- */
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -359,6 +363,24 @@ int ply_close(p_ply ply);
  * ---------------------------------------------------------------------- */
 int get_plystorage_mode(p_ply ply, e_ply_storage_mode *storage_mode);
 
+/* ----------------------------------------------------------------------
+ * Returns the position of the first element data in the file (i.e. the
+ * size of the header). Must be called after ply_read_header and before
+ * ply_read.
+ *
+ * ply: handle returned by ply_open
+ *
+ * Returns 1 if successful, 0 otherwise
+ * ---------------------------------------------------------------------- */
+int get_plydata_offset(p_ply ply, long *offset);
+
+/* ----------------------------------------------------------------------
+ * Returns the size of a (non list) property type in binary files
+ *
+ * Returns the size in bytes, 0 for PLY_LIST
+ * ---------------------------------------------------------------------- */
+size_t get_plytype_size(e_ply_type type);
+
 #ifdef __cplusplus
 }
 #endif
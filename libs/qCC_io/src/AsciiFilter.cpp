@@ -26,6 +26,7 @@
 //CClib
 #include <ScalarField.h>
 #include <Garbage.h>
+#include <TaskScheduler.h>
 
 //qCC_db
 #include <cc2DLabel.h>
@@ -36,8 +37,11 @@
 #include <ccScalarField.h>
 
 //System
+#include <algorithm>
 #include <cassert>
 #include <cstring>
+#include <limits>
+#include <vector>
 
 //Qt
 #include <QScopedPointer>
@@ -754,6 +758,379 @@ cloudAttributesDescriptor prepareCloud(	const AsciiOpenDlg::Sequence &openSequen
 	return cloudDesc;
 }
 
+//! Size of the chunks of lines parsed in parallel (in bytes)
+static const qint64 c_asciiChunkSize = (4 << 20);
+//! Size of the part of the file mapped (or read) at once (in bytes)
+static const qint64 c_asciiWindowSize = (128 << 20);
+
+//! Part of a line (first and last - excluded - characters)
+typedef std::pair<const char*, const char*> AsciiToken;
+
+//! Chunk of (complete) lines, parsed independently of the other chunks
+struct AsciiChunk
+{
+	//! First character
+	const char* begin = nullptr;
+	//! Last character (excluded)
+	const char* end = nullptr;
+	//! Position of the first character in the file
+	qint64 fileOffset = 0;
+
+	//! Number of lines (including the empty lines and the comments)
+	unsigned lineCount = 0;
+	//! Points (one per valid line)
+	std::vector<CCVector3d> points;
+	//! Normals (if any)
+	std::vector<CCVector3> normals;
+	//! Colors (if any)
+	std::vector<ccColor::Rgba> colors;
+	//! Scalar values (if any, one per scalar field and per point)
+	std::vector<ScalarType> scalarValues;
+	//! Labels (if any)
+	std::vector<AsciiToken> labels;
+	//! Corrupted lines (index of the line in the chunk, and number of parts found or -1 if a non numerical value was found)
+	std::vector< std::pair<unsigned, int> > corruptedLines;
+};
+
+//! Same whitespace characters as QChar::isSpace (ASCII only)
+static inline bool IsAsciiSpace(char c)
+{
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+//! Removes the leading and trailing whitespace characters of a token
+static inline void TrimToken(AsciiToken& token)
+{
+	while (token.first < token.second && IsAsciiSpace(*token.first))
+		++token.first;
+	while (token.second > token.first && IsAsciiSpace(token.second[-1]))
+		--token.second;
+}
+
+//! Splits a line in parts (same result as QString::simplified().split(separator, QString::SkipEmptyParts))
+/** \param begin first character of the line
+	\param end last character of the line (excluded)
+	\param separator separator
+	\param parts output parts (only the first 'parts.size()' ones are stored)
+	\return the total number of parts
+**/
+static int SplitAsciiLine(const char* begin, const char* end, char separator, std::vector<AsciiToken>& parts)
+{
+	const int maxPartCount = static_cast<int>(parts.size());
+	int partCount = 0;
+
+	if (IsAsciiSpace(separator))
+	{
+		//as the line is 'simplified', all the whitespace characters are separators
+		const char* c = begin;
+		while (true)
+		{
+			while (c < end && IsAsciiSpace(*c))
+				++c;
+			if (c == end)
+				break;
+			const char* partStart = c;
+			while (c < end && !IsAsciiSpace(*c))
+				++c;
+			if (partCount < maxPartCount)
+				parts[partCount] = AsciiToken(partStart, c);
+			++partCount;
+		}
+	}
+	else
+	{
+		AsciiToken line(begin, end);
+		TrimToken(line);
+
+		const char* partStart = line.first;
+		for (const char* c = line.first; c <= line.second; ++c)
+		{
+			if (c == line.second || *c == separator)
+			{
+				if (c != partStart) //empty parts are skipped
+				{
+					if (partCount < maxPartCount)
+						parts[partCount] = AsciiToken(partStart, c);
+					++partCount;
+				}
+				partStart = c + 1;
+			}
+		}
+	}
+
+	return partCount;
+}
+
+//! Converts a token to a double (same result as QLocale::toDouble)
+/** Numbers with up to 15 significant digits and a small exponent (i.e. the vast majority of the
+	values found in ASCII files) are converted without any allocation, with the same (correctly
+	rounded) result as the locale. The other ones are converted by the locale.
+**/
+static bool AsciiToDouble(AsciiToken token, char decimalPoint, const QLocale& locale, double& value)
+{
+	static const double s_powersOf10[] = {	1.0e0,  1.0e1,  1.0e2,  1.0e3,  1.0e4,  1.0e5,  1.0e6,  1.0e7,
+											1.0e8,  1.0e9,  1.0e10, 1.0e11, 1.0e12, 1.0e13, 1.0e14, 1.0e15,
+											1.0e16, 1.0e17, 1.0e18, 1.0e19, 1.0e20, 1.0e21, 1.0e22 };
+	static const uint64_t s_maxExactMantissa = (1ULL << 53);
+
+	TrimToken(token);
+
+	const char* c = token.first;
+	bool negative = false;
+	if (c < token.second && (*c == '-' || *c == '+'))
+	{
+		negative = (*c == '-');
+		++c;
+	}
+
+	uint64_t mantissa = 0;
+	int exponent = 0;
+	bool hasDigits = false;
+	bool fastPath = true;
+
+	//integer part
+	for (; c < token.second && *c >= '0' && *c <= '9'; ++c)
+	{
+		mantissa = mantissa * 10 + static_cast<uint64_t>(*c - '0');
+		hasDigits = true;
+		if (mantissa > s_maxExactMantissa)
+		{
+			fastPath = false;
+			break;
+		}
+	}
+
+	//decimal part
+	if (fastPath && c < token.second && *c == decimalPoint)
+	{
+		for (++c; c < token.second && *c >= '0' && *c <= '9'; ++c)
+		{
+			mantissa = mantissa * 10 + static_cast<uint64_t>(*c - '0');
+			--exponent;
+			hasDigits = true;
+			if (mantissa > s_maxExactMantissa)
+			{
+				fastPath = false;
+				break;
+			}
+		}
+	}
+
+	//exponent
+	if (fastPath && hasDigits && c < token.second && (*c == 'e' || *c == 'E'))
+	{
+		++c;
+		bool negativeExponent = false;
+		if (c < token.second && (*c == '-' || *c == '+'))
+		{
+			negativeExponent = (*c == '-');
+			++c;
+		}
+		if (c == token.second)
+		{
+			fastPath = false;
+		}
+		int e = 0;
+		for (; c < token.second && *c >= '0' && *c <= '9' && e < 1000; ++c)
+		{
+			e = e * 10 + (*c - '0');
+		}
+		exponent += (negativeExponent ? -e : e);
+	}
+
+	if (fastPath && hasDigits && c == token.second && exponent >= -22 && exponent <= 22)
+	{
+		//both the mantissa and the power of 10 are exact: the result is correctly rounded
+		double v = static_cast<double>(mantissa);
+		v = (exponent < 0 ? v / s_powersOf10[-exponent] : v * s_powersOf10[exponent]);
+		value = (negative ? -v : v);
+		return true;
+	}
+
+	//other cases (big numbers, group separators, 'nan', 'inf', invalid values, etc.)
+	bool ok = false;
+	value = locale.toDouble(QString::fromLatin1(token.first, static_cast<int>(token.second - token.first)), &ok);
+	return ok;
+}
+
+//! Converts a token to an integer (same result as QString::toInt)
+static int AsciiToInt(AsciiToken token)
+{
+	TrimToken(token);
+
+	const char* c = token.first;
+	bool negative = false;
+	if (c < token.second && (*c == '-' || *c == '+'))
+	{
+		negative = (*c == '-');
+		++c;
+	}
+	if (c == token.second)
+	{
+		return 0;
+	}
+
+	int64_t value = 0;
+	for (; c < token.second; ++c)
+	{
+		if (*c < '0' || *c > '9')
+		{
+			return 0;
+		}
+		value = value * 10 + (*c - '0');
+		if (value > static_cast<int64_t>(std::numeric_limits<int>::max()) + 1)
+		{
+			return 0;
+		}
+	}
+	if (negative)
+	{
+		value = -value;
+	}
+
+	return (value >= std::numeric_limits<int>::min() && value <= std::numeric_limits<int>::max() ? static_cast<int>(value) : 0);
+}
+
+//! Parses a chunk of lines
+/** Equivalent to the former line-by-line process (QTextStream::readLine + QString::split + QLocale::toDouble),
+	without any allocation per line. The chunks can be parsed in parallel.
+	\param chunk chunk of lines
+	\param cloudDesc columns description
+	\param maxPartIndex max column index
+	\param separator separator
+	\param commaAsDecimal whether a comma should be used as the decimal character
+**/
+static void ParseAsciiChunk(AsciiChunk& chunk,
+							const cloudAttributesDescriptor& cloudDesc,
+							int maxPartIndex,
+							char separator,
+							bool commaAsDecimal)
+{
+	QLocale locale(commaAsDecimal ? QLocale::French : QLocale::English);
+	const char decimalPoint = (commaAsDecimal ? ',' : '.');
+
+	std::vector<AsciiToken> parts(static_cast<size_t>(maxPartIndex + 1));
+	const bool hasColors = (cloudDesc.hasRGBColors || cloudDesc.greyIndex >= 0);
+	const size_t sfCount = cloudDesc.scalarIndexes.size();
+
+	const char* lineStart = chunk.begin;
+	while (lineStart < chunk.end)
+	{
+		const char* lineEnd = static_cast<const char*>(memchr(lineStart, '\n', chunk.end - lineStart));
+		if (!lineEnd)
+		{
+			lineEnd = chunk.end;
+		}
+		const char* nextLine = (lineEnd < chunk.end ? lineEnd + 1 : chunk.end);
+		if (lineEnd > lineStart && lineEnd[-1] == '\r')
+		{
+			--lineEnd;
+		}
+		const char* line = lineStart;
+		lineStart = nextLine;
+
+		unsigned lineIndex = chunk.lineCount++;
+
+		if (line == lineEnd || (lineEnd - line >= 2 && line[0] == '/' && line[1] == '/'))
+		{
+			//empty lines and comments are ignored
+			continue;
+		}
+
+		int nParts = SplitAsciiLine(line, lineEnd, separator, parts);
+		if (nParts <= maxPartIndex)
+		{
+			chunk.corruptedLines.emplace_back(lineIndex, nParts);
+			continue;
+		}
+
+		//read the point coordinates
+		CCVector3d P(0, 0, 0);
+		if (	(cloudDesc.xCoordIndex >= 0 && !AsciiToDouble(parts[cloudDesc.xCoordIndex], decimalPoint, locale, P.x))
+			||	(cloudDesc.yCoordIndex >= 0 && !AsciiToDouble(parts[cloudDesc.yCoordIndex], decimalPoint, locale, P.y))
+			||	(cloudDesc.zCoordIndex >= 0 && !AsciiToDouble(parts[cloudDesc.zCoordIndex], decimalPoint, locale, P.z)) )
+		{
+			chunk.corruptedLines.emplace_back(lineIndex, -1);
+			continue;
+		}
+		chunk.points.push_back(P);
+
+		//the other values are set to 0 if they can't be read (as QLocale::toDouble does)
+		double value = 0;
+
+		//Normal vector
+		if (cloudDesc.hasNorms)
+		{
+			CCVector3 N(0, 0, 0);
+			if (cloudDesc.xNormIndex >= 0)
+				N.x = static_cast<PointCoordinateType>(AsciiToDouble(parts[cloudDesc.xNormIndex], decimalPoint, locale, value) ? value : 0);
+			if (cloudDesc.yNormIndex >= 0)
+				N.y = static_cast<PointCoordinateType>(AsciiToDouble(parts[cloudDesc.yNormIndex], decimalPoint, locale, value) ? value : 0);
+			if (cloudDesc.zNormIndex >= 0)
+				N.z = static_cast<PointCoordinateType>(AsciiToDouble(parts[cloudDesc.zNormIndex], decimalPoint, locale, value) ? value : 0);
+			chunk.normals.push_back(N);
+		}
+
+		//Colors
+		if (hasColors)
+		{
+			ccColor::Rgba col(0, 0, 0, ccColor::MAX);
+			if (cloudDesc.hasRGBColors)
+			{
+				if (cloudDesc.iRgbaIndex >= 0)
+				{
+					const uint32_t rgba = static_cast<uint32_t>(AsciiToInt(parts[cloudDesc.iRgbaIndex]));
+					col.a = ((rgba >> 24) & 0x0000ff);
+					col.r = ((rgba >> 16) & 0x0000ff);
+					col.g = ((rgba >>  8) & 0x0000ff);
+					col.b = ((rgba      ) & 0x0000ff);
+				}
+				else if (cloudDesc.fRgbaIndex >= 0)
+				{
+					const float rgbaf = static_cast<float>(AsciiToDouble(parts[cloudDesc.fRgbaIndex], decimalPoint, locale, value) ? value : 0);
+					uint32_t rgba = 0;
+					memcpy(&rgba, &rgbaf, sizeof(uint32_t));
+					col.a = ((rgba >> 24) & 0x0000ff);
+					col.r = ((rgba >> 16) & 0x0000ff);
+					col.g = ((rgba >>  8) & 0x0000ff);
+					col.b = ((rgba      ) & 0x0000ff);
+				}
+				else
+				{
+					const int componentIndexes[4] = { cloudDesc.redIndex, cloudDesc.greenIndex, cloudDesc.blueIndex, cloudDesc.alphaIndex };
+					ColorCompType* components[4] = { &col.r, &col.g, &col.b, &col.a };
+					for (unsigned k = 0; k < 4; ++k)
+					{
+						if (componentIndexes[k] >= 0)
+						{
+							float multiplier = cloudDesc.hasFloatRGBColors[k] ? static_cast<float>(ccColor::MAX) : 1.0f;
+							float component = static_cast<float>(AsciiToDouble(parts[componentIndexes[k]], decimalPoint, locale, value) ? value : 0);
+							*components[k] = static_cast<ColorCompType>(component * multiplier);
+						}
+					}
+				}
+			}
+			else
+			{
+				col.r = col.g = col.b = static_cast<ColorCompType>(AsciiToInt(parts[cloudDesc.greyIndex]));
+			}
+			chunk.colors.push_back(col);
+		}
+
+		//Scalar values
+		for (size_t j = 0; j < sfCount; ++j)
+		{
+			chunk.scalarValues.push_back(static_cast<ScalarType>(AsciiToDouble(parts[cloudDesc.scalarIndexes[j]], decimalPoint, locale, value) ? value : 0));
+		}
+
+		//Label
+		if (cloudDesc.labelIndex >= 0)
+		{
+			chunk.labels.push_back(parts[cloudDesc.labelIndex]);
+		}
+	}
+}
+
 CC_FILE_ERROR AsciiFilter::loadCloudFromFormatedAsciiFile(	const QString& filename,
 															ccHObject& container,
 															const AsciiOpenDlg::Sequence& openSequence,
@@ -781,7 +1158,24 @@ CC_FILE_ERROR AsciiFilter::loadCloudFromFormatedAsciiFile(	const QString& filena
 		return CC_FERR_NOT_ENOUGH_MEMORY;
 	}
 
-	//we re-open the file (ASCII mode)
+	//the columns to parse (the same for all the parts)
+	cloudAttributesDescriptor parsingDesc = cloudDesc;
+	parsingDesc.cloud = nullptr;
+	parsingDesc.scalarFields.clear();
+
+	//position of the values of each scalar field of the current part in the parsed values
+	std::vector<size_t> sfValueIndexes;
+	auto updateSFValueIndexes = [&]()
+	{
+		sfValueIndexes.clear();
+		for (int sfColumn : cloudDesc.scalarIndexes)
+		{
+			sfValueIndexes.push_back(std::find(parsingDesc.scalarIndexes.begin(), parsingDesc.scalarIndexes.end(), sfColumn) - parsingDesc.scalarIndexes.begin());
+		}
+	};
+	updateSFValueIndexes();
+
+	//we re-open the file (binary mode: the lines are split and parsed by chunks)
 	QFile file(filename);
 	if (!file.open(QFile::ReadOnly))
 	{
@@ -789,13 +1183,23 @@ CC_FILE_ERROR AsciiFilter::loadCloudFromFormatedAsciiFile(	const QString& filena
 		clearStructure(cloudDesc);
 		return CC_FERR_READING;
 	}
-	QTextStream stream(&file);
+	fileSize = file.size();
 
-	//we skip lines as defined on input
+	//we skip the UTF-8 BOM (if any) and the lines as defined on input
 	{
-		for (unsigned i = 0; i < skipLines;)
+		char bom[3] = { 0, 0, 0 };
+		if (file.peek(bom, 3) == 3 && memcmp(bom, "\xEF\xBB\xBF", 3) == 0)
 		{
-			QString currentLine = stream.readLine();
+			file.seek(3);
+		}
+
+		for (unsigned i = 0; i < skipLines && !file.atEnd();)
+		{
+			QByteArray currentLine = file.readLine();
+			while (currentLine.endsWith('\n') || currentLine.endsWith('\r'))
+			{
+				currentLine.chop(1);
+			}
 			if (currentLine.isEmpty())
 			{
 				//empty lines are ignored
@@ -817,11 +1221,7 @@ CC_FILE_ERROR AsciiFilter::loadCloudFromFormatedAsciiFile(	const QString& filena
 	CCCoreLib::NormalizedProgress nprogress(pDlg.data(), approximateNumberOfLines);
 
 	//buffers
-	ScalarType D = 0;
-	CCVector3d P(0, 0, 0);
 	CCVector3d Pshift(0, 0, 0);
-	CCVector3 N(0, 0, 0);
-	ccColor::Rgba col(0, 0, 0, 255);
 	bool preserveCoordinateShift = true;
 
 	//other useful variables
@@ -829,264 +1229,275 @@ CC_FILE_ERROR AsciiFilter::loadCloudFromFormatedAsciiFile(	const QString& filena
 	unsigned pointsRead = 0;
 
 	CC_FILE_ERROR result = CC_FERR_NO_ERROR;
+	bool stopped = false;
 
-	QLocale locale(commaAsDecimal ? QLocale::French : QLocale::English);
-
-	//main process
+	//main process: the file is mapped (or read) by windows of complete lines, split in
+	//chunks parsed in parallel, then the chunks are added to the cloud(s) in order
 	unsigned nextLimit = /*cloudChunkPos+*/cloudChunkSize;
-	while (true)
+	qint64 windowOffset = file.pos();
+	qint64 windowMaxSize = c_asciiWindowSize;
+	while (windowOffset < fileSize && !stopped)
 	{
-		//read next line
-		QString currentLine = stream.readLine();
-		if (currentLine.isNull())
-		{
-			//end of file
-			break;
-		}
-		++linesRead;
+		qint64 windowSize = std::min(windowMaxSize, fileSize - windowOffset);
 
-		if (currentLine.isEmpty() || currentLine.startsWith("//"))
+		QByteArray buffer;
+		uchar* mappedData = file.map(windowOffset, windowSize);
+		const char* data = reinterpret_cast<const char*>(mappedData);
+		if (!data)
 		{
-			//empty lines and comments are ignored
-			continue;
+			//if the file can't be mapped, we read it
+			if (!file.seek(windowOffset))
+			{
+				result = CC_FERR_READING;
+				break;
+			}
+			buffer = file.read(windowSize);
+			if (buffer.size() != windowSize)
+			{
+				result = CC_FERR_READING;
+				break;
+			}
+			data = buffer.constData();
 		}
 
-		//if we have reached the max. number of points per cloud
-		if (pointsRead == nextLimit)
+		//only the complete lines are processed (the last one will be processed with the next window)
+		qint64 dataSize = windowSize;
+		if (windowOffset + windowSize < fileSize)
 		{
-			ccLog::PrintDebug("[ASCII] Point %i -> end of chunk (%i points)",pointsRead,cloudChunkSize);
-
-			//we re-evaluate the average line size
+			while (dataSize > 0 && data[dataSize - 1] != '\n')
 			{
-				double averageLineSize = static_cast<double>(file.pos()) / (pointsRead + skipLines);
-				double newNbOfLinesApproximation = std::max(1.0, static_cast<double>(fileSize) / averageLineSize - static_cast<double>(skipLines));
-
-				//if approximation is smaller than actual one, we add 2% by default
-				if (newNbOfLinesApproximation <= pointsRead)
+				--dataSize;
+			}
+			if (dataSize == 0)
+			{
+				//the line is bigger than the window
+				if (mappedData)
 				{
-					newNbOfLinesApproximation = std::max(static_cast<double>(cloudChunkPos + cloudChunkSize) + 1.0, static_cast<double>(pointsRead)* 1.02);
+					file.unmap(mappedData);
 				}
-				approximateNumberOfLines = static_cast<unsigned>(ceil(newNbOfLinesApproximation));
-				ccLog::PrintDebug("[ASCII] New approximate nb of lines: %i", approximateNumberOfLines);
+				windowMaxSize *= 2;
+				continue;
 			}
+		}
 
-			//we try to resize actual clouds
-			if (cloudChunkSize < maxCloudSize || approximateNumberOfLines - cloudChunkPos <= maxCloudSize)
+		//split the window in chunks (at line boundaries)
+		std::vector<AsciiChunk> chunks;
+		try
+		{
+			qint64 chunkStart = 0;
+			while (chunkStart < dataSize)
 			{
-				ccLog::PrintDebug("[ASCII] We choose to enlarge existing clouds");
-
-				cloudChunkSize = std::min(maxCloudSize, approximateNumberOfLines - cloudChunkPos);
-				if (!cloudDesc.cloud->reserve(cloudChunkSize))
+				qint64 chunkEnd = std::min(chunkStart + c_asciiChunkSize, dataSize);
+				while (chunkEnd < dataSize && data[chunkEnd - 1] != '\n')
 				{
-					ccLog::Error("Not enough memory! Process stopped ...");
-					result = CC_FERR_NOT_ENOUGH_MEMORY;
-					break;
+					++chunkEnd;
 				}
+
+				AsciiChunk chunk;
+				chunk.begin = data + chunkStart;
+				chunk.end = data + chunkEnd;
+				chunk.fileOffset = windowOffset + chunkStart;
+				chunks.push_back(chunk);
+
+				chunkStart = chunkEnd;
 			}
-			else //otherwise we have to create new clouds
+		}
+		catch (const std::bad_alloc&)
+		{
+			result = CC_FERR_NOT_ENOUGH_MEMORY;
+			break;
+		}
+
+		//parse the chunks in parallel
+		bool parsed = CCCoreLib::TaskScheduler().run(static_cast<unsigned>(chunks.size()), [&](unsigned chunkIndex)
+		{
+			try
+			{
+				ParseAsciiChunk(chunks[chunkIndex], parsingDesc, maxPartIndex, separator, commaAsDecimal);
+			}
+			catch (const std::bad_alloc&)
 			{
-				ccLog::PrintDebug("[ASCII] We choose to instantiate new clouds");
+				//not enough memory
+				return false;
+			}
+			return true;
+		});
 
-				//we store (and resize) actual cloud
-				if (!cloudDesc.cloud->resize(cloudChunkSize))
-					ccLog::Warning("Memory reallocation failed ... some memory may have been wasted ...");
-				if (!cloudDesc.scalarFields.empty())
-				{
-					for (unsigned k = 0; k < cloudDesc.scalarFields.size(); ++k)
-						cloudDesc.scalarFields[k]->computeMinAndMax();
-					cloudDesc.cloud->setCurrentDisplayedScalarField(0);
-					cloudDesc.cloud->showSF(true);
-				}
-				//we add this cloud to the output container
-				container.addChild(cloudDesc.cloud);
-				cloudDesc.reset();
-
-				//and create new one
-				cloudChunkPos = pointsRead;
-				cloudChunkSize = std::min(maxCloudSize, approximateNumberOfLines - cloudChunkPos);
-				cloudDesc = prepareCloud(openSequence, cloudChunkSize, maxPartIndex, ++chunkRank);
-				if (!cloudDesc.cloud)
+		if (!parsed)
+		{
+			ccLog::Error("Not enough memory! Process stopped ...");
+			result = CC_FERR_NOT_ENOUGH_MEMORY;
+			stopped = true;
+		}
+
+		//add the chunks to the cloud(s), in order
+		for (size_t chunkIndex = 0; chunkIndex < chunks.size() && !stopped; ++chunkIndex)
+		{
+			const AsciiChunk& chunk = chunks[chunkIndex];
+
+			for (const std::pair<unsigned, int>& corruptedLine : chunk.corruptedLines)
+			{
+				if (corruptedLine.second < 0)
 				{
-					ccLog::Error("Not enough memory! Process stopped ...");
-					break;
+					ccLog::Warning("[AsciiFilter::Load] Line %i is corrupted (non numerical value found)", linesRead + corruptedLine.first + 1);
 				}
-				if (preserveCoordinateShift)
+				else
 				{
-					cloudDesc.cloud->setGlobalShift(Pshift);
+					ccLog::Warning("[AsciiFilter::Load] Line %i is corrupted (found %i part(s) on %i expected)!", linesRead + corruptedLine.first + 1, corruptedLine.second, maxPartIndex + 1);
 				}
 			}
 
-			//we update the progress info
-			if (pDlg)
+			const size_t chunkPointCount = chunk.points.size();
+			const size_t parsedSFCount = parsingDesc.scalarIndexes.size();
+			for (size_t i = 0; i < chunkPointCount; ++i)
 			{
-				nprogress.scale(approximateNumberOfLines, 100, true);
-				pDlg->setInfo(QObject::tr("Approximate number of points: %1").arg(approximateNumberOfLines));
-			}
+				//if we have reached the max. number of points per cloud
+				if (pointsRead == nextLimit)
+				{
+					ccLog::PrintDebug("[ASCII] Point %i -> end of chunk (%i points)",pointsRead,cloudChunkSize);
 
-			nextLimit = cloudChunkPos+cloudChunkSize;
-		}
+					//we re-evaluate the average line size
+					{
+						double currentPos = chunk.fileOffset + static_cast<double>(chunk.end - chunk.begin) * i / chunkPointCount;
+						double averageLineSize = currentPos / (pointsRead + skipLines);
+						double newNbOfLinesApproximation = std::max(1.0, static_cast<double>(fileSize) / averageLineSize - static_cast<double>(skipLines));
 
-		//we split current line
-		QStringList parts = currentLine.simplified().split(separator, QString::SkipEmptyParts);
+						//if approximation is smaller than actual one, we add 2% by default
+						if (newNbOfLinesApproximation <= pointsRead)
+						{
+							newNbOfLinesApproximation = std::max(static_cast<double>(cloudChunkPos + cloudChunkSize) + 1.0, static_cast<double>(pointsRead)* 1.02);
+						}
+						approximateNumberOfLines = static_cast<unsigned>(ceil(newNbOfLinesApproximation));
+						ccLog::PrintDebug("[ASCII] New approximate nb of lines: %i", approximateNumberOfLines);
+					}
 
-		int nParts = parts.size();
-		if (nParts > maxPartIndex) //fake loop for easy break
-		{
-			//read the point coordinates
-			bool lineIsCorrupted = true;
-			for (int step = 0; step < 1; ++step) //fake loop for easy break
-			{
-				bool ok = true;
-				if (cloudDesc.xCoordIndex >= 0)
-				{
-					P.x = locale.toDouble(parts[cloudDesc.xCoordIndex], &ok);
-					if (!ok)
+					//we try to resize actual clouds
+					if (cloudChunkSize < maxCloudSize || approximateNumberOfLines - cloudChunkPos <= maxCloudSize)
 					{
-						break;
+						ccLog::PrintDebug("[ASCII] We choose to enlarge existing clouds");
+
+						cloudChunkSize = std::min(maxCloudSize, approximateNumberOfLines - cloudChunkPos);
+						if (!cloudDesc.cloud->reserve(cloudChunkSize))
+						{
+							ccLog::Error("Not enough memory! Process stopped ...");
+							result = CC_FERR_NOT_ENOUGH_MEMORY;
+							stopped = true;
+							break;
+						}
 					}
-				}
-				if (cloudDesc.yCoordIndex >= 0)
-				{
-					P.y = locale.toDouble(parts[cloudDesc.yCoordIndex], &ok);
-					if (!ok)
+					else //otherwise we have to create new clouds
 					{
-						break;
+						ccLog::PrintDebug("[ASCII] We choose to instantiate new clouds");
+
+						//we store (and resize) actual cloud
+						if (!cloudDesc.cloud->resize(cloudChunkSize))
+							ccLog::Warning("Memory reallocation failed ... some memory may have been wasted ...");
+						if (!cloudDesc.scalarFields.empty())
+						{
+							for (unsigned k = 0; k < cloudDesc.scalarFields.size(); ++k)
+								cloudDesc.scalarFields[k]->computeMinAndMax();
+							cloudDesc.cloud->setCurrentDisplayedScalarField(0);
+							cloudDesc.cloud->showSF(true);
+						}
+						//we add this cloud to the output container
+						container.addChild(cloudDesc.cloud);
+						cloudDesc.reset();
+
+						//and create new one
+						cloudChunkPos = pointsRead;
+						cloudChunkSize = std::min(maxCloudSize, approximateNumberOfLines - cloudChunkPos);
+						cloudDesc = prepareCloud(openSequence, cloudChunkSize, maxPartIndex, ++chunkRank);
+						if (!cloudDesc.cloud)
+						{
+							ccLog::Error("Not enough memory! Process stopped ...");
+							stopped = true;
+							break;
+						}
+						if (preserveCoordinateShift)
+						{
+							cloudDesc.cloud->setGlobalShift(Pshift);
+						}
+						updateSFValueIndexes();
 					}
-				}
-				if (cloudDesc.zCoordIndex >= 0)
-				{
-					P.z = locale.toDouble(parts[cloudDesc.zCoordIndex], &ok);
-					if (!ok)
+
+					//we update the progress info
+					if (pDlg)
 					{
-						break;
+						nprogress.scale(approximateNumberOfLines, 100, true);
+						pDlg->setInfo(QObject::tr("Approximate number of points: %1").arg(approximateNumberOfLines));
 					}
-				}
 
-				lineIsCorrupted = false;
-			}
+					nextLimit = cloudChunkPos+cloudChunkSize;
+				}
 
-			if (lineIsCorrupted)
-			{
-				ccLog::Warning("[AsciiFilter::Load] Line %i is corrupted (non numerical value found)", linesRead);
-				continue;
-			}
+				const CCVector3d& P = chunk.points[i];
 
-			//first point: check for 'big' coordinates
-			if (pointsRead == 0)
-			{
-				if (HandleGlobalShift(P, Pshift, preserveCoordinateShift, parameters))
+				//first point: check for 'big' coordinates
+				if (pointsRead == 0)
 				{
-					if (preserveCoordinateShift)
+					if (HandleGlobalShift(P, Pshift, preserveCoordinateShift, parameters))
 					{
-						cloudDesc.cloud->setGlobalShift(Pshift);
+						if (preserveCoordinateShift)
+						{
+							cloudDesc.cloud->setGlobalShift(Pshift);
+						}
+						ccLog::Warning("[ASCIIFilter::loadFile] Cloud has been recentered! Translation: (%.2f ; %.2f ; %.2f)", Pshift.x, Pshift.y, Pshift.z);
 					}
-					ccLog::Warning("[ASCIIFilter::loadFile] Cloud has been recentered! Translation: (%.2f ; %.2f ; %.2f)", Pshift.x, Pshift.y, Pshift.z);
 				}
-			}
 
-			//add point
-			cloudDesc.cloud->addPoint(CCVector3::fromArray((P + Pshift).u));
+				//add point
+				cloudDesc.cloud->addPoint(CCVector3::fromArray((P + Pshift).u));
 
-			//Normal vector
-			if (cloudDesc.hasNorms)
-			{
-				if (cloudDesc.xNormIndex >= 0)
-					N.x = static_cast<PointCoordinateType>(locale.toDouble(parts[cloudDesc.xNormIndex]));
-				if (cloudDesc.yNormIndex >= 0)
-					N.y = static_cast<PointCoordinateType>(locale.toDouble(parts[cloudDesc.yNormIndex]));
-				if (cloudDesc.zNormIndex >= 0)
-					N.z = static_cast<PointCoordinateType>(locale.toDouble(parts[cloudDesc.zNormIndex]));
-				cloudDesc.cloud->addNorm(N);
-			}
-
-			//Colors
-			if (cloudDesc.hasRGBColors)
-			{
-				if (cloudDesc.iRgbaIndex >= 0)
+				//Normal vector
+				if (cloudDesc.hasNorms)
 				{
-					const uint32_t rgba = parts[cloudDesc.iRgbaIndex].toInt();
-					col.a = ((rgba >> 24) & 0x0000ff);
-					col.r = ((rgba >> 16) & 0x0000ff);
-					col.g = ((rgba >>  8) & 0x0000ff);
-					col.b = ((rgba      ) & 0x0000ff);
-
+					cloudDesc.cloud->addNorm(chunk.normals.empty() ? CCVector3(0, 0, 0) : chunk.normals[i]);
 				}
-				else if (cloudDesc.fRgbaIndex >= 0)
+
+				//Colors
+				if (cloudDesc.hasRGBColors || cloudDesc.greyIndex >= 0)
 				{
-					const float rgbaf = locale.toFloat(parts[cloudDesc.fRgbaIndex]);
-					const uint32_t rgba = *(reinterpret_cast<const uint32_t *>(&rgbaf));
-					col.a = ((rgba >> 24) & 0x0000ff);
-					col.r = ((rgba >> 16) & 0x0000ff);
-					col.g = ((rgba >>  8) & 0x0000ff);
-					col.b = ((rgba      ) & 0x0000ff);
+					cloudDesc.cloud->addColor(chunk.colors.empty() ? ccColor::black : chunk.colors[i]);
 				}
-				else
+
+				//Scalar distance
+				for (size_t j = 0; j < cloudDesc.scalarFields.size(); ++j)
 				{
-					if (cloudDesc.redIndex >= 0)
-					{
-						float multiplier = cloudDesc.hasFloatRGBColors[0] ? static_cast<float>(ccColor::MAX) : 1.0f;
-						col.r = static_cast<ColorCompType>(locale.toFloat(parts[cloudDesc.redIndex]) * multiplier);
-					}
-					if (cloudDesc.greenIndex >= 0)
-					{
-						float multiplier = cloudDesc.hasFloatRGBColors[1] ? static_cast<float>(ccColor::MAX) : 1.0f;
-						col.g = static_cast<ColorCompType>(locale.toFloat(parts[cloudDesc.greenIndex]) * multiplier);
-					}
-					if (cloudDesc.blueIndex >= 0)
-					{
-						float multiplier = cloudDesc.hasFloatRGBColors[2] ? static_cast<float>(ccColor::MAX) : 1.0f;
-						col.b = static_cast<ColorCompType>(locale.toFloat(parts[cloudDesc.blueIndex]) * multiplier);
-					}
-					if (cloudDesc.alphaIndex >= 0)
-					{
-						float multiplier = cloudDesc.hasFloatRGBColors[3] ? static_cast<float>(ccColor::MAX) : 1.0f;
-						col.a = static_cast<ColorCompType>(locale.toFloat(parts[cloudDesc.alphaIndex]) * multiplier);
-					}
+					ScalarType D = (sfValueIndexes[j] < parsedSFCount ? chunk.scalarValues[i * parsedSFCount + sfValueIndexes[j]] : 0);
+					cloudDesc.scalarFields[j]->emplace_back(D);
 				}
-				cloudDesc.cloud->addColor(col);
-			}
-			else if (cloudDesc.greyIndex >= 0)
-			{
-				col.r = col.g = col.b = static_cast<ColorCompType>(parts[cloudDesc.greyIndex].toInt());
-				col.a = ccColor::MAX;
-				cloudDesc.cloud->addColor(col);
-			}
 
-			//Scalar distance
-			if (!cloudDesc.scalarIndexes.empty())
-			{
-				for (size_t j = 0; j < cloudDesc.scalarIndexes.size(); ++j)
+				//Label
+				if (cloudDesc.labelIndex >= 0 && !chunk.labels.empty())
 				{
-					D = static_cast<ScalarType>(locale.toDouble(parts[cloudDesc.scalarIndexes[j]]));
-					cloudDesc.scalarFields[j]->emplace_back(D);
+					const AsciiToken& labelToken = chunk.labels[i];
+					cc2DLabel* label = new cc2DLabel();
+					label->addPickedPoint(cloudDesc.cloud, cloudDesc.cloud->size() - 1);
+					label->setName(QString::fromUtf8(labelToken.first, static_cast<int>(labelToken.second - labelToken.first)).simplified());
+					label->setDisplayedIn2D(showLabelsIn2D);
+					label->displayPointLegend(!showLabelsIn2D);
+					label->setVisible(true);
+					cloudDesc.cloud->addChild(label);
 				}
+
+				++pointsRead;
 			}
 
-			//Label
-			if (cloudDesc.labelIndex >= 0)
+			linesRead += chunk.lineCount;
+
+			if (pDlg && !stopped && !nprogress.steps(chunk.lineCount))
 			{
-				cc2DLabel* label = new cc2DLabel();
-				label->addPickedPoint(cloudDesc.cloud, cloudDesc.cloud->size() - 1);
-				label->setName(parts[cloudDesc.labelIndex]);
-				label->setDisplayedIn2D(showLabelsIn2D);
-				label->displayPointLegend(!showLabelsIn2D);
-				label->setVisible(true);
-				cloudDesc.cloud->addChild(label);
+				//cancel requested
+				result = CC_FERR_CANCELED_BY_USER;
+				stopped = true;
 			}
-
-			++pointsRead;
-		}
-		else
-		{
-			ccLog::Warning("[AsciiFilter::Load] Line %i is corrupted (found %i part(s) on %i expected)!", linesRead, nParts, maxPartIndex + 1);
 		}
 
-		if (pDlg && !nprogress.oneStep())
+		if (mappedData)
 		{
-			//cancel requested
-			result = CC_FERR_CANCELED_BY_USER;
-			break;
+			file.unmap(mappedData);
 		}
+		windowOffset += dataSize;
 	}
 
 	file.close();
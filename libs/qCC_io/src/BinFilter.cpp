@@ -31,6 +31,7 @@
 #include <ccGenericPointCloud.h>
 #include <ccHObjectCaster.h>
 #include <ccImage.h>
+#include <ccIndexCache.h>
 #include <ccMaterialSet.h>
 #include <ccMesh.h>
 #include <ccPointCloud.h>
@@ -159,11 +160,78 @@ CC_FILE_ERROR _SaveFileV2()
 	return (s_file && s_container ? BinFilter::SaveFileV2(*s_file,s_container) : CC_FERR_BAD_ARGUMENT);
 }
 
+//! Reads the data of the images that has not been read yet from a BIN file that is going to be overwritten
+/** All the images of the DB tree(s) of the saved entities are checked, and not only the saved
+	ones, as other entities may have been loaded from the same file.
+**/
+static void LoadDeferredImages(ccHObject* root, const QString& filename)
+{
+	QString absoluteFilename = QFileInfo(filename).absoluteFilePath();
+
+	//the saved entities may be gathered in a temporary container (that is not their parent)
+	std::unordered_set<ccHObject*> treeRoots;
+	ccHObject::Container entities{ root };
+	for (unsigned i = 0; i < root->getChildrenNumber(); ++i)
+		entities.push_back(root->getChild(i));
+	for (ccHObject* entity : entities)
+	{
+		while (entity->getParent())
+			entity = entity->getParent();
+		treeRoots.insert(entity);
+	}
+
+	for (ccHObject* treeRoot : treeRoots)
+	{
+		ccHObject::Container images;
+		treeRoot->filterChildren(images, true, CC_TYPES::IMAGE, false);
+		if (treeRoot->isKindOf(CC_TYPES::IMAGE))
+			images.push_back(treeRoot);
+
+		for (ccHObject* object : images)
+		{
+			ccImage* image = static_cast<ccImage*>(object);
+			if (image->getDeferredFilename() == absoluteFilename)
+				image->data();
+		}
+	}
+}
+
+//! Associates the clouds of a BIN file to their persistent index cache (see ccIndexCache)
+/** \param clouds the clouds, in the order of the file
+	\param filename BIN file
+	\param saved whether the clouds have just been saved (otherwise they have just been loaded)
+**/
+static void AttachIndexCache(const ccHObject::Container& clouds, const QString& filename, bool saved)
+{
+	QString absoluteFilename = QFileInfo(filename).absoluteFilePath();
+
+	//one path per cloud (based on its position in the file)
+	for (size_t i = 0; i < clouds.size(); ++i)
+	{
+		ccGenericPointCloud* cloud = ccHObjectCaster::ToGenericPointCloud(clouds[i]);
+		if (!cloud || (!saved && !cloud->getIndexCachePath().isEmpty()))
+		{
+			continue;
+		}
+
+		ccIndexCache::Attach(cloud, QString("%1.%2").arg(absoluteFilename).arg(i));
+
+		//the saved cloud matches its file again: its octree can be written
+		if (saved && cloud->getOctree() && ccIndexCache::IsCached(cloud))
+		{
+			//not a big deal if it fails (a warning is already issued)
+			ccIndexCache::SaveOctree(cloud, *cloud->getOctree(), cloud->getIndexCacheHash());
+		}
+	}
+}
+
 CC_FILE_ERROR BinFilter::saveToFile(ccHObject* root, const QString& filename, const SaveParameters& parameters)
 {
 	if (!root || filename.isNull())
 		return CC_FERR_BAD_ARGUMENT;
 
+	LoadDeferredImages(root, filename);
+
 	QFile out(filename);
 	if (!out.open(QIODevice::WriteOnly))
 		return CC_FERR_WRITING;
@@ -204,6 +272,16 @@ CC_FILE_ERROR BinFilter::saveToFile(ccHObject* root, const QString& filename, co
 
 	CC_FILE_ERROR result = future.result();
 
+	if (result == CC_FERR_NO_ERROR)
+	{
+		//same order as when the file is loaded (see loadFile)
+		ccHObject::Container clouds;
+		if (root->isKindOf(CC_TYPES::POINT_CLOUD))
+			clouds.push_back(root);
+		root->filterChildren(clouds, true, CC_TYPES::POINT_CLOUD);
+		AttachIndexCache(clouds, filename, true);
+	}
+
 	return result;
 }
 
@@ -382,6 +460,7 @@ CC_FILE_ERROR BinFilter::loadFile(const QString& filename, ccHObject& container,
 		//	return CC_FERR_WRONG_FILE_TYPE;
 		//}
 
+		CC_FILE_ERROR result = CC_FERR_NO_ERROR;
 		if (parameters.alwaysDisplayLoadDialog)
 		{
 			QScopedPointer<ccProgressDialog> pDlg(nullptr);
@@ -419,12 +498,21 @@ CC_FILE_ERROR BinFilter::loadFile(const QString& filename, ccHObject& container,
 			s_file = nullptr;
 			s_container = nullptr;
 
-			return future.result();
+			result = future.result();
 		}
 		else
 		{
-			return BinFilter::LoadFileV2(in, container, flags);
+			result = BinFilter::LoadFileV2(in, container, flags);
 		}
+
+		if (result == CC_FERR_NO_ERROR)
+		{
+			ccHObject::Container clouds;
+			container.filterChildren(clouds, true, CC_TYPES::POINT_CLOUD);
+			AttachIndexCache(clouds, filename, false);
+		}
+
+		return result;
 	}
 }
 
@@ -22,6 +22,7 @@
 #include "PlyOpenDlg.h"
 
 //Qt
+#include <QFile>
 #include <QFileInfo>
 #include <QImage>
 #include <QMessageBox>
@@ -33,12 +34,17 @@
 #include <ccMaterial.h>
 #include <ccMaterialSet.h>
 #include <ccMesh.h>
+#include <ccNormalVectors.h>
 #include <ccPointCloud.h>
 #include <ccProgressDialog.h>
 #include <ccScalarField.h>
 
+//CCCoreLib
+#include <TaskScheduler.h>
+
 //System
 #include <cassert>
+#include <cstdint>
 #include <cstring>
 #if defined(CC_WINDOWS)
 #include <windows.h>
@@ -503,6 +509,36 @@ bool s_hasQuads = false;
 bool s_hasMaterials = false;
 std::vector<bool> s_triIsQuad;
 
+//! Handles the global shift when the first point is read
+static void HandleFirstPoint(const CCVector3d& P, ccPointCloud* cloud)
+{
+	//first point: check for 'big' coordinates
+	bool preserveCoordinateShift = true;
+	if (FileIOFilter::HandleGlobalShift(P, s_Pshift, preserveCoordinateShift, s_loadParameters))
+	{
+		if (preserveCoordinateShift)
+		{
+			cloud->setGlobalShift(s_Pshift);
+		}
+		ccLog::Warning("[PLYFilter::loadFile] Cloud (vertices) has been recentered! Translation: (%.2f ; %.2f ; %.2f)", s_Pshift.x, s_Pshift.y, s_Pshift.z);
+	}
+}
+
+//! Converts a PLY value to a color component (floating point values are expected in [0 ; 1])
+static inline ColorCompType ToColorComponent(double value, e_ply_type type)
+{
+	switch (type)
+	{
+	case PLY_FLOAT:
+	case PLY_DOUBLE:
+	case PLY_FLOAT32:
+	case PLY_FLOAT64:
+		return static_cast<ColorCompType>(std::min(std::max(0.0, value), 1.0) * ccColor::MAX);
+	default:
+		return static_cast<ColorCompType>(value);
+	}
+}
+
 static int vertex_cb(p_ply_argument argument)
 {
 	if (s_NotEnoughMemory)
@@ -534,18 +570,9 @@ static int vertex_cb(p_ply_argument argument)
 
 	if (flags & ELEM_EOL)
 	{
-		//first point: check for 'big' coordinates
 		if (s_PointCount == 0)
 		{
-			bool preserveCoordinateShift = true;
-			if (FileIOFilter::HandleGlobalShift(s_Point, s_Pshift, preserveCoordinateShift, s_loadParameters))
-			{
-				if (preserveCoordinateShift)
-				{
-					cloud->setGlobalShift(s_Pshift);
-				}
-				ccLog::Warning("[PLYFilter::loadFile] Cloud (vertices) has been recentered! Translation: (%.2f ; %.2f ; %.2f)", s_Pshift.x, s_Pshift.y, s_Pshift.z);
-			}
+			HandleFirstPoint(s_Point, cloud);
 		}
 
 		cloud->addPoint(CCVector3::fromArray((s_Point + s_Pshift).u));
@@ -602,25 +629,7 @@ static int rgb_cb(p_ply_argument argument)
 	ply_get_property_info(prop, nullptr, &type, nullptr, nullptr);
 
 	static ccColor::Rgba s_color(0, 0, 0, ccColor::MAX);
-
-	switch(type)
-	{
-	case PLY_FLOAT:
-	case PLY_DOUBLE:
-	case PLY_FLOAT32:
-	case PLY_FLOAT64:
-		s_color.rgba[flags & POS_MASK] = static_cast<ColorCompType>(std::min(std::max(0.0, ply_get_argument_value(argument)), 1.0) * ccColor::MAX);
-		break;
-	case PLY_INT8:
-	case PLY_UINT8:
-	case PLY_CHAR:
-	case PLY_UCHAR:
-		s_color.rgba[flags & POS_MASK] = static_cast<ColorCompType>(ply_get_argument_value(argument));
-		break;
-	default:
-		s_color.rgba[flags & POS_MASK] = static_cast<ColorCompType>(ply_get_argument_value(argument));
-		break;
-	}
+	s_color.rgba[flags & POS_MASK] = ToColorComponent(ply_get_argument_value(argument), type);
 
 	if (flags & ELEM_EOL)
 	{
@@ -649,26 +658,7 @@ static int grey_cb(p_ply_argument argument)
 	e_ply_type type;
 	ply_get_property_info(prop, nullptr, &type, nullptr, nullptr);
 
-	ColorCompType G;
-
-	switch(type)
-	{
-	case PLY_FLOAT:
-	case PLY_DOUBLE:
-	case PLY_FLOAT32:
-	case PLY_FLOAT64:
-		G = static_cast<ColorCompType>(std::min(std::max(0.0, ply_get_argument_value(argument)), 1.0) * ccColor::MAX);
-		break;
-	case PLY_INT8:
-	case PLY_UINT8:
-	case PLY_CHAR:
-	case PLY_UCHAR:
-		G = static_cast<ColorCompType>(ply_get_argument_value(argument));
-		break;
-	default:
-		G = static_cast<ColorCompType>(ply_get_argument_value(argument));
-		break;
-	}
+	ColorCompType G = ToColorComponent(ply_get_argument_value(argument), type);
 
 	cloud->addGreyColor(G);
 	++s_IntensityCount;
@@ -872,6 +862,338 @@ static int texIndexes_cb(p_ply_argument argument)
 	return 1;
 }
 
+//! Max number of records mapped (or read) at once by the binary fast path
+static const unsigned c_plyWindowRecordCount = (1 << 20);
+//! Number of records decoded by each task of the binary fast path
+static const unsigned c_plyTaskRecordCount = (1 << 16);
+
+//! Property of the point element decoded by the binary fast path (see LoadBinaryPointElement)
+struct PlyPointField
+{
+	enum Kind { COORDINATE, NORMAL, COLOR, GREY, SCALAR };
+
+	PlyPointField(Kind k, long f, const plyProperty& p, CCCoreLib::ScalarField* s = nullptr)
+		: kind(k)
+		, flags(f)
+		, property(p)
+		, sf(s)
+		, offset(0)
+	{}
+
+	Kind kind;
+	//! Same flags as the corresponding callback (component index)
+	long flags;
+	plyProperty property;
+	CCCoreLib::ScalarField* sf;
+	//! Position of the value in the element records (in bytes)
+	size_t offset;
+};
+
+//! Reads a value from a binary PLY record
+static inline double ReadBinaryValue(const char* data, e_ply_type type, bool swapBytes)
+{
+	char bytes[8];
+	size_t size = get_plytype_size(type);
+	assert(size != 0 && size <= 8);
+	if (swapBytes)
+	{
+		for (size_t i = 0; i < size; ++i)
+			bytes[i] = data[size - 1 - i];
+	}
+	else
+	{
+		memcpy(bytes, data, size);
+	}
+
+	switch (type)
+	{
+	case PLY_INT8:
+	case PLY_CHAR:
+	{
+		int8_t value;
+		memcpy(&value, bytes, sizeof(value));
+		return value;
+	}
+	case PLY_UINT8:
+	case PLY_UCHAR:
+	{
+		uint8_t value;
+		memcpy(&value, bytes, sizeof(value));
+		return value;
+	}
+	case PLY_INT16:
+	case PLY_SHORT:
+	{
+		int16_t value;
+		memcpy(&value, bytes, sizeof(value));
+		return value;
+	}
+	case PLY_UINT16:
+	case PLY_USHORT:
+	{
+		uint16_t value;
+		memcpy(&value, bytes, sizeof(value));
+		return value;
+	}
+	case PLY_INT32:
+	case PLY_INT:
+	{
+		int32_t value;
+		memcpy(&value, bytes, sizeof(value));
+		return value;
+	}
+	case PLY_UIN32:
+	case PLY_UINT:
+	{
+		uint32_t value;
+		memcpy(&value, bytes, sizeof(value));
+		return value;
+	}
+	case PLY_FLOAT32:
+	case PLY_FLOAT:
+	{
+		float value;
+		memcpy(&value, bytes, sizeof(value));
+		return value;
+	}
+	case PLY_FLOAT64:
+	case PLY_DOUBLE:
+	{
+		double value;
+		memcpy(&value, bytes, sizeof(value));
+		return value;
+	}
+	default:
+		assert(false);
+		return 0.0;
+	}
+}
+
+//! Decodes the point element of a binary PLY file in parallel (instead of using the rply callbacks)
+/** The records of the element must have a fixed size (no list property in this element or
+	in the previous ones). They are mapped (or read) by windows, decoded in parallel, then
+	added to the cloud in order (with the same conversions as the callbacks). The callbacks
+	of the element are then unregistered so that ply_read skips it.
+	\return 1 on success, 0 on error, -1 if the file can't be handled this way (the callbacks should be used)
+**/
+static int LoadBinaryPointElement(	const QString& filename,
+									p_ply ply,
+									e_ply_storage_mode storageMode,
+									const std::vector<plyElement>& pointElements,
+									std::vector<PlyPointField>& fields,
+									ccPointCloud* cloud)
+{
+	if (fields.empty() || (storageMode != PLY_BIG_ENDIAN && storageMode != PLY_LITTLE_ENDIAN))
+	{
+		return -1;
+	}
+
+	//all the properties must belong to the same element
+	int elemIndex = fields.front().property.elemIndex;
+	for (const PlyPointField& field : fields)
+	{
+		if (field.property.elemIndex != elemIndex)
+		{
+			return -1;
+		}
+	}
+	const plyElement& element = pointElements[elemIndex];
+	if (element.elementInstances <= 0)
+	{
+		return -1;
+	}
+	unsigned pointCount = static_cast<unsigned>(element.elementInstances);
+
+	//position of the element in the file and size of its records
+	long dataOffset = 0;
+	if (!get_plydata_offset(ply, &dataOffset))
+	{
+		return -1;
+	}
+	qint64 elementOffset = dataOffset;
+	size_t recordSize = 0;
+	for (p_ply_element elem = ply_get_next_element(ply, nullptr); elem; elem = ply_get_next_element(ply, elem))
+	{
+		long instances = 0;
+		ply_get_element_info(elem, nullptr, &instances);
+
+		size_t size = 0;
+		for (p_ply_property prop = ply_get_next_property(elem, nullptr); prop; prop = ply_get_next_property(elem, prop))
+		{
+			e_ply_type type;
+			ply_get_property_info(prop, nullptr, &type, nullptr, nullptr);
+			if (type == PLY_LIST)
+			{
+				//variable size records
+				return -1;
+			}
+			for (PlyPointField& field : fields)
+			{
+				if (field.property.prop == prop)
+				{
+					field.offset = size;
+				}
+			}
+			size += get_plytype_size(type);
+		}
+
+		if (elem == element.elem)
+		{
+			recordSize = size;
+			break;
+		}
+		elementOffset += static_cast<qint64>(size) * instances;
+	}
+	if (recordSize == 0)
+	{
+		return -1;
+	}
+
+	QFile file(filename);
+	if (!file.open(QFile::ReadOnly) || elementOffset + static_cast<qint64>(recordSize) * pointCount > file.size())
+	{
+		//rply will report the error
+		return -1;
+	}
+
+	const uint16_t endiannessTest = 1;
+	bool littleEndianHost = (*reinterpret_cast<const uint8_t*>(&endiannessTest) == 1);
+	bool swapBytes = ((storageMode == PLY_LITTLE_ENDIAN) != littleEndianHost);
+
+	bool hasNormals = false;
+	bool hasColors = false;
+	bool hasGreys = false;
+	for (const PlyPointField& field : fields)
+	{
+		hasNormals |= (field.kind == PlyPointField::NORMAL);
+		hasColors |= (field.kind == PlyPointField::COLOR);
+		hasGreys |= (field.kind == PlyPointField::GREY);
+	}
+
+	//decoded values (for one window)
+	unsigned windowMaxCount = std::min(pointCount, c_plyWindowRecordCount);
+	std::vector<CCVector3d> points;
+	std::vector<CompressedNormType> normals;
+	std::vector<ccColor::Rgba> colors;
+	try
+	{
+		points.resize(windowMaxCount);
+		if (hasNormals)
+			normals.resize(windowMaxCount);
+		if (hasColors || hasGreys)
+			colors.resize(windowMaxCount);
+	}
+	catch (const std::bad_alloc&)
+	{
+		s_NotEnoughMemory = true;
+		return 0;
+	}
+
+	CCCoreLib::TaskScheduler scheduler;
+	for (unsigned windowStart = 0; windowStart < pointCount; windowStart += windowMaxCount)
+	{
+		unsigned windowCount = std::min(windowMaxCount, pointCount - windowStart);
+		qint64 windowOffset = elementOffset + static_cast<qint64>(recordSize) * windowStart;
+		qint64 windowSize = static_cast<qint64>(recordSize) * windowCount;
+
+		QByteArray buffer;
+		uchar* mappedData = file.map(windowOffset, windowSize);
+		const char* data = reinterpret_cast<const char*>(mappedData);
+		if (!data)
+		{
+			//if the file can't be mapped, we read it
+			if (!file.seek(windowOffset))
+			{
+				return 0;
+			}
+			buffer = file.read(windowSize);
+			if (buffer.size() != windowSize)
+			{
+				return 0;
+			}
+			data = buffer.constData();
+		}
+
+		unsigned taskCount = (windowCount + c_plyTaskRecordCount - 1) / c_plyTaskRecordCount;
+		scheduler.run(taskCount, [&](unsigned taskIndex)
+		{
+			unsigned first = taskIndex * c_plyTaskRecordCount;
+			unsigned last = std::min(first + c_plyTaskRecordCount, windowCount);
+			for (unsigned i = first; i < last; ++i)
+			{
+				const char* record = data + recordSize * i;
+				CCVector3d P(0, 0, 0);
+				CCVector3 N(0, 0, 0);
+				ccColor::Rgba C(0, 0, 0, ccColor::MAX);
+
+				for (const PlyPointField& field : fields)
+				{
+					double value = ReadBinaryValue(record + field.offset, field.property.type, swapBytes);
+					switch (field.kind)
+					{
+					case PlyPointField::COORDINATE:
+						//NaN values are replaced by 0 (corrupted data)
+						P.u[field.flags & POS_MASK] = (value == value ? value : 0.0);
+						break;
+					case PlyPointField::NORMAL:
+						N.u[field.flags & POS_MASK] = static_cast<PointCoordinateType>(value);
+						break;
+					case PlyPointField::COLOR:
+						C.rgba[field.flags & POS_MASK] = ToColorComponent(value, field.property.type);
+						break;
+					case PlyPointField::GREY:
+						C.r = C.g = C.b = ToColorComponent(value, field.property.type);
+						break;
+					case PlyPointField::SCALAR:
+						field.sf->setValue(windowStart + i, static_cast<ScalarType>(value));
+						break;
+					}
+				}
+
+				points[i] = P;
+				if (hasNormals)
+					normals[i] = ccNormalVectors::GetNormIndex(N);
+				if (hasColors || hasGreys)
+					colors[i] = C;
+			}
+			return true;
+		});
+
+		if (mappedData)
+		{
+			file.unmap(mappedData);
+		}
+
+		//the decoded values are added in order
+		for (unsigned i = 0; i < windowCount; ++i)
+		{
+			if (s_PointCount == 0)
+			{
+				HandleFirstPoint(points[i], cloud);
+			}
+			cloud->addPoint(CCVector3::fromArray((points[i] + s_Pshift).u));
+			++s_PointCount;
+
+			if (hasNormals)
+				cloud->addNormIndex(normals[i]);
+			if (hasColors)
+				cloud->addColor(colors[i]);
+			else if (hasGreys)
+				cloud->addGreyColor(colors[i].r);
+		}
+
+		QCoreApplication::processEvents();
+	}
+
+	//rply will skip the element (if no other property of this element is read)
+	for (const PlyPointField& field : fields)
+	{
+		ply_set_read_cb(ply, element.elementName, field.property.propName, nullptr, nullptr, 0);
+	}
+
+	return 1;
+}
+
 CC_FILE_ERROR PlyFilter::loadFile(const QString& filename, ccHObject& container, LoadParameters& parameters)
 {
 	return loadFile(filename, QString(), container, parameters);
@@ -1347,6 +1669,9 @@ CC_FILE_ERROR PlyFilter::loadFile(const QString& filename, const QString& inputT
 		cloud->setMetaData("ply.comments", comments);
 	}
 
+	//properties of the point element (for the binary fast path)
+	std::vector<PlyPointField> pointFields;
+
 	/* POINTS (X,Y,Z) */
 
 	unsigned numberOfPoints = 0;
@@ -1362,6 +1687,7 @@ CC_FILE_ERROR PlyFilter::loadFile(const QString& filename, const QString& inputT
 
 		plyProperty& pp = stdProperties[xIndex - 1];
 		ply_set_read_cb(ply, pointElements[pp.elemIndex].elementName, pp.propName, vertex_cb, cloud, flags);
+		pointFields.emplace_back(PlyPointField::COORDINATE, flags, pp);
 
 		numberOfPoints = pointElements[pp.elemIndex].elementInstances;
 	}
@@ -1375,6 +1701,7 @@ CC_FILE_ERROR PlyFilter::loadFile(const QString& filename, const QString& inputT
 
 		plyProperty& pp = stdProperties[yIndex - 1];
 		ply_set_read_cb(ply, pointElements[pp.elemIndex].elementName, pp.propName, vertex_cb, cloud, flags);
+		pointFields.emplace_back(PlyPointField::COORDINATE, flags, pp);
 
 		if (numberOfPoints > 0)
 		{
@@ -1398,6 +1725,7 @@ CC_FILE_ERROR PlyFilter::loadFile(const QString& filename, const QString& inputT
 
 		plyProperty& pp = stdProperties[zIndex - 1];
 		ply_set_read_cb(ply, pointElements[pp.elemIndex].elementName, pp.propName, vertex_cb, cloud, flags);
+		pointFields.emplace_back(PlyPointField::COORDINATE, flags, pp);
 
 		if (numberOfPoints > 0)
 		{
@@ -1436,6 +1764,7 @@ CC_FILE_ERROR PlyFilter::loadFile(const QString& filename, const QString& inputT
 
 		plyProperty& pp = stdProperties[nxIndex - 1];
 		ply_set_read_cb(ply, pointElements[pp.elemIndex].elementName, pp.propName, normal_cb, cloud, flags);
+		pointFields.emplace_back(PlyPointField::NORMAL, flags, pp);
 
 		numberOfNormals = pointElements[pp.elemIndex].elementInstances;
 	}
@@ -1449,6 +1778,7 @@ CC_FILE_ERROR PlyFilter::loadFile(const QString& filename, const QString& inputT
 
 		plyProperty& pp = stdProperties[nyIndex - 1];
 		ply_set_read_cb(ply, pointElements[pp.elemIndex].elementName, pp.propName, normal_cb, cloud, flags);
+		pointFields.emplace_back(PlyPointField::NORMAL, flags, pp);
 
 		numberOfNormals = std::max(numberOfNormals, (unsigned)pointElements[pp.elemIndex].elementInstances);
 	}
@@ -1462,6 +1792,7 @@ CC_FILE_ERROR PlyFilter::loadFile(const QString& filename, const QString& inputT
 
 		plyProperty& pp = stdProperties[nzIndex - 1];
 		ply_set_read_cb(ply, pointElements[pp.elemIndex].elementName, pp.propName, normal_cb, cloud, flags);
+		pointFields.emplace_back(PlyPointField::NORMAL, flags, pp);
 
 		numberOfNormals = std::max(numberOfNormals, (unsigned)pointElements[pp.elemIndex].elementInstances);
 	}
@@ -1501,6 +1832,7 @@ CC_FILE_ERROR PlyFilter::loadFile(const QString& filename, const QString& inputT
 
 		plyProperty& pp = stdProperties[rIndex - 1];
 		ply_set_read_cb(ply, pointElements[pp.elemIndex].elementName, pp.propName, rgb_cb, cloud, flags);
+		pointFields.emplace_back(PlyPointField::COLOR, flags, pp);
 
 		numberOfColors = pointElements[pp.elemIndex].elementInstances;
 	}
@@ -1513,6 +1845,7 @@ CC_FILE_ERROR PlyFilter::loadFile(const QString& filename, const QString& inputT
 
 		plyProperty& pp = stdProperties[gIndex - 1];
 		ply_set_read_cb(ply, pointElements[pp.elemIndex].elementName, pp.propName, rgb_cb, cloud, flags);
+		pointFields.emplace_back(PlyPointField::COLOR, flags, pp);
 
 		numberOfColors = std::max(numberOfColors, (unsigned)pointElements[pp.elemIndex].elementInstances);
 	}
@@ -1525,6 +1858,7 @@ CC_FILE_ERROR PlyFilter::loadFile(const QString& filename, const QString& inputT
 
 		plyProperty& pp = stdProperties[bIndex - 1];
 		ply_set_read_cb(ply, pointElements[pp.elemIndex].elementName, pp.propName, rgb_cb, cloud, flags);
+		pointFields.emplace_back(PlyPointField::COLOR, flags, pp);
 
 		numberOfColors = std::max(numberOfColors, (unsigned)pointElements[pp.elemIndex].elementInstances);
 	}
@@ -1543,6 +1877,7 @@ CC_FILE_ERROR PlyFilter::loadFile(const QString& filename, const QString& inputT
 		{
 			plyProperty pp = stdProperties[iIndex - 1];
 			ply_set_read_cb(ply, pointElements[pp.elemIndex].elementName, pp.propName, grey_cb, cloud, 0);
+			pointFields.emplace_back(PlyPointField::GREY, 0, pp);
 
 			numberOfColors = pointElements[pp.elemIndex].elementInstances;
 		}
@@ -1599,6 +1934,7 @@ CC_FILE_ERROR PlyFilter::loadFile(const QString& filename, const QString& inputT
 					if (sf->resizeSafe(numberOfScalars))
 					{
 						ply_set_read_cb(ply, pointElements[pp.elemIndex].elementName, pp.propName, scalar_cb, sf, 1);
+						pointFields.emplace_back(PlyPointField::SCALAR, 1, pp, sf);
 					}
 					else
 					{
@@ -1708,7 +2044,12 @@ CC_FILE_ERROR PlyFilter::loadFile(const QString& filename, const QString& inputT
 	int success = 0;
 	try
 	{
-		success = ply_read(ply);
+		//binary files: the point element is decoded in parallel first (rply will then skip it)
+		success = LoadBinaryPointElement(filename, ply, storage_mode, pointElements, pointFields, cloud);
+		if (success != 0)
+		{
+			success = ply_read(ply);
+		}
 	}
 	catch (...)
 	{
@@ -720,6 +720,30 @@ int get_plystorage_mode(p_ply ply, e_ply_storage_mode *storage_mode)
 	return 1;
 }
 
+int get_plydata_offset(p_ply ply, long *offset)
+{
+	long pos;
+	if (!ply || !ply->fp || ply->io_mode != PLY_READ) return 0;
+
+	pos = ftell(ply->fp);
+	if (pos < 0) return 0;
+
+	/* the buffer may already contain the first bytes of data */
+	*offset = pos - (long) (ply->buffer_last - ply->buffer_first);
+	return 1;
+}
+
+size_t get_plytype_size(e_ply_type type)
+{
+	static const size_t type_sizes[] = {
+		1, 1, 2, 2,
+		4, 4, 4, 8,
+		1, 1, 2, 2,
+		4, 4, 4, 8,
+		0 };
+	return (type >= PLY_INT8 && type <= PLY_LIST) ? type_sizes[type] : 0;
+}
+
 /* ----------------------------------------------------------------------
  * Query support functions
  * ---------------------------------------------------------------------- */
@@ -893,9 +917,43 @@ static int ply_read_property(p_ply ply, p_ply_element element,
         return ply_read_scalar_property(ply, element, property, argument);
 }
 
+static int ply_skip_chunk(p_ply ply, uint64_t size) {
+    uint64_t buffered = ply->buffer_last - ply->buffer_first;
+    assert(ply && ply->fp && ply->io_mode == PLY_READ);
+    if (size <= buffered) {
+        ply->buffer_first += (size_t) size;
+        return 1;
+    }
+    /* skip the buffered data, then move in the file */
+    size -= buffered;
+    ply->buffer_first = ply->buffer_last = 0;
+    while (size > 0) {
+        long step = size > (uint64_t) LONG_MAX ? LONG_MAX : (long) size;
+        if (fseek(ply->fp, step, SEEK_CUR) != 0) return 0;
+        size -= (uint64_t) step;
+    }
+    return 1;
+}
+
 static int ply_read_element(p_ply ply, p_ply_element element, 
         p_ply_argument argument) {
     long j, k;
+    /* binary elements of fixed size without any callback are skipped at once */
+    if (ply->storage_mode != PLY_ASCII) {
+        size_t record_size = 0;
+        for (k = 0; k < element->nproperties; k++) {
+            p_ply_property property = &element->property[k];
+            if (property->type == PLY_LIST || property->read_cb) break;
+            record_size += get_plytype_size(property->type);
+        }
+        if (k == element->nproperties) {
+            if (!ply_skip_chunk(ply, (uint64_t) record_size * (uint64_t) element->ninstances)) {
+                ply_ferror(ply, "Error skipping '%s'", element->name);
+                return 0;
+            }
+            return 1;
+        }
+    }
     /* for each element of this type */
     for (j = 0; j < element->ninstances; j++) {
         argument->instance_index = j;
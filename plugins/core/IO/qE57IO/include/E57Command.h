@@ -0,0 +1,34 @@
+#ifndef E57COMMAND_H
+#define E57COMMAND_H
+
+//##########################################################################
+//#                                                                        #
+//#                      CLOUDCOMPARE PLUGIN                               #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 of the License.               #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: CloudCompare project                               #
+//#                                                                        #
+//##########################################################################
+
+#include "ccCommandLineInterface.h"
+
+//! E57 I/O options (-E57 [-BLOCK_SIZE {points}] [-MAX_THREAD_COUNT {count}])
+class E57Command : public ccCommandLineInterface::Command
+{
+public:
+	E57Command();
+
+	~E57Command() override = default;
+
+	bool process( ccCommandLineInterface& cmd ) override;
+};
+
+#endif
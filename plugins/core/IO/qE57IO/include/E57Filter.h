@@ -26,6 +26,18 @@ class E57Filter : public FileIOFilter
 {
 public:
 	E57Filter();
+
+	//! Sets the number of points read or written per block (default: 1M)
+	/** The memory used by each scan being read or written grows with this number.
+	**/
+	static void SetBlockSize(unsigned pointCount);
+
+	//! Sets the max number of threads (0 = all the available threads)
+	/** At loading time, this is the max number of scans read concurrently (each one
+		requires its own reader of the E57 file). At saving time, the points of each
+		block are converted in parallel while the previous block is written.
+	**/
+	static void SetMaxThreadCount(int count);
 	
 	//inherited from FileIOFilter
 	CC_FILE_ERROR loadFile(const QString& filename, ccHObject& container, LoadParameters& parameters) override;
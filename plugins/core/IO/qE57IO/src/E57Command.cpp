@@ -0,0 +1,86 @@
+//##########################################################################
+//#                                                                        #
+//#                      CLOUDCOMPARE PLUGIN                               #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 of the License.               #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: CloudCompare project                               #
+//#                                                                        #
+//##########################################################################
+
+#include "E57Command.h"
+#include "E57Filter.h"
+
+constexpr char COMMAND_E57[] = "E57";
+constexpr char COMMAND_E57_BLOCK_SIZE[] = "BLOCK_SIZE";
+constexpr char COMMAND_E57_MAX_THREAD_COUNT[] = "MAX_THREAD_COUNT";
+
+
+E57Command::E57Command() :
+	Command( "E57", COMMAND_E57 )
+{
+}
+
+bool E57Command::process( ccCommandLineInterface &cmd )
+{
+	cmd.print( "[E57]" );
+
+	while (!cmd.arguments().empty())
+	{
+		const QString& arg = cmd.arguments().front();
+
+		if (ccCommandLineInterface::IsCommand(arg, COMMAND_E57_BLOCK_SIZE))
+		{
+			cmd.arguments().pop_front();
+
+			if (cmd.arguments().empty())
+			{
+				return cmd.error(QObject::tr("Missing parameter: number of points after '%1'").arg(COMMAND_E57_BLOCK_SIZE));
+			}
+
+			bool ok = false;
+			unsigned blockSize = cmd.arguments().takeFirst().toUInt(&ok);
+			if (!ok || blockSize == 0)
+			{
+				return cmd.error(QObject::tr("Invalid block size! (after %1)").arg(COMMAND_E57_BLOCK_SIZE));
+			}
+
+			cmd.print(QObject::tr("E57 block size: %1 points").arg(blockSize));
+
+			E57Filter::SetBlockSize(blockSize);
+		}
+		else if (ccCommandLineInterface::IsCommand(arg, COMMAND_E57_MAX_THREAD_COUNT))
+		{
+			cmd.arguments().pop_front();
+
+			if (cmd.arguments().empty())
+			{
+				return cmd.error(QObject::tr("Missing parameter: max thread count after '%1'").arg(COMMAND_E57_MAX_THREAD_COUNT));
+			}
+
+			bool ok = false;
+			int maxThreadCount = cmd.arguments().takeFirst().toInt(&ok);
+			if (!ok || maxThreadCount < 0)
+			{
+				return cmd.error(QObject::tr("Invalid thread count! (after %1)").arg(COMMAND_E57_MAX_THREAD_COUNT));
+			}
+
+			cmd.print(QObject::tr("E57 max thread count: %1").arg(maxThreadCount));
+
+			E57Filter::SetMaxThreadCount(maxThreadCount);
+		}
+		else
+		{
+			break; //as soon as we encounter an unrecognized argument, we break the local loop to go back to the main one!
+		}
+	}
+
+	return true;
+}
@@ -34,15 +34,22 @@
 #include <ccScalarField.h>
 #include <ccHObjectCaster.h>
 
+//CCCoreLib
+#include <TaskScheduler.h>
+
 //Qt
 #include <QApplication>
 #include <QBuffer>
+#include <QImageReader>
 #include <QUuid>
 #include <QMessageBox>
 #include <Qquaternion.h>
 
 //system
+#include <atomic>
 #include <cassert>
+#include <exception>
+#include <mutex>
 #include <string>
 
 using colorFieldType = double;
@@ -60,8 +67,10 @@ namespace  {
 	
 	unsigned s_absoluteImageIndex = 0;
 	
-	ScalarType s_maxIntensity = 0;
-	ScalarType s_minIntensity = 0;
+	//number of points read/written per block
+	unsigned s_blockSize = (1 << 20);
+	//max number of threads (0 = all)
+	int s_maxThreadCount = 0;
 	
 	//for coordinate shift handling
 	FileIOFilter::LoadParameters s_loadParameters;
@@ -113,6 +122,16 @@ E57Filter::E57Filter()
 {
 }
 
+void E57Filter::SetBlockSize(unsigned pointCount)
+{
+	s_blockSize = std::max(1u, pointCount);
+}
+
+void E57Filter::SetMaxThreadCount(int count)
+{
+	s_maxThreadCount = std::max(0, count);
+}
+
 bool E57Filter::canSave(CC_CLASS_ENUM type, bool& multiple, bool& exclusive) const
 {
 	if (type == CC_TYPES::POINT_CLOUD)
@@ -401,11 +420,6 @@ static bool SaveScan(ccPointCloud* cloud, e57::StructureNode& scanNode, e57::Ima
 	/// This prototype will be used in creating the points CompressedVector.
 	e57::StructureNode proto = e57::StructureNode(imf);
 
-	//prepare temporary structures
-	const unsigned chunkSize = std::min<unsigned>(pointCount,(1 << 20)); //we save the file in several steps to limit the memory consumption
-	TempArrays arrays;
-	std::vector<e57::SourceDestBuffer> dbufs;
-
 	//Cartesian field
 	{
 		e57::FloatPrecision precision = sizeof(PointCoordinateType) == 8 || isScaled ? e57::E57_DOUBLE : e57::E57_SINGLE;
@@ -417,24 +431,18 @@ static bool SaveScan(ccPointCloud* cloud, e57::StructureNode& scanNode, e57::Ima
 												precision,
 												bbMin.x,
 												bbMax.x ) );
-		arrays.xData.resize(chunkSize);
-		dbufs.emplace_back( imf, "cartesianX",  arrays.xData.data(),  chunkSize, true, true );
 
 		proto.set("cartesianY", e57::FloatNode(	imf,
 												bbCenter.y,
 												precision,
 												bbMin.y,
 												bbMax.y ) );
-		arrays.yData.resize(chunkSize);
-		dbufs.emplace_back( imf, "cartesianY",  arrays.yData.data(),  chunkSize, true, true );
 
 		proto.set("cartesianZ", e57::FloatNode(	imf,
 												bbCenter.z,
 												precision,
 												bbMin.z,
 												bbMax.z ) );
-		arrays.zData.resize(chunkSize);
-		dbufs.emplace_back( imf, "cartesianZ",  arrays.zData.data(),  chunkSize, true, true );
 	}
 
 	//Normals
@@ -444,16 +452,8 @@ static bool SaveScan(ccPointCloud* cloud, e57::StructureNode& scanNode, e57::Ima
 		e57::FloatPrecision precision = sizeof(PointCoordinateType) == 8 ? e57::E57_DOUBLE : e57::E57_SINGLE;
 
 		proto.set("nor:normalX", e57::FloatNode(imf, 0.0, precision, -1.0, 1.0));
-		arrays.xNormData.resize(chunkSize);
-		dbufs.emplace_back( imf, "nor:normalX",  arrays.xNormData.data(),  chunkSize, true, true );
-
 		proto.set("nor:normalY", e57::FloatNode(imf, 0.0, precision, -1.0, 1.0));
-		arrays.yNormData.resize(chunkSize);
-		dbufs.emplace_back( imf, "nor:normalY",  arrays.yNormData.data(),  chunkSize, true, true );
-
 		proto.set("nor:normalZ", e57::FloatNode(imf, 0.0, precision, -1.0, 1.0));
-		arrays.zNormData.resize(chunkSize);
-		dbufs.emplace_back( imf, "nor:normalZ",  arrays.zNormData.data(),  chunkSize, true, true );
 	}
 
 	//Return index
@@ -461,21 +461,15 @@ static bool SaveScan(ccPointCloud* cloud, e57::StructureNode& scanNode, e57::Ima
 	{
 		assert(maxReturnIndex > minReturnIndex);
 		proto.set("returnIndex", e57::IntegerNode(imf, minReturnIndex, minReturnIndex, maxReturnIndex));
-		arrays.scanIndexData.resize(chunkSize);
-		dbufs.emplace_back( imf, "returnIndex",  arrays.scanIndexData.data(),  chunkSize, true, true );
 	}
 	//Intensity field
 	if (intensitySF)
 	{
 		proto.set("intensity", e57::FloatNode(imf, intensitySF->getMin(), sizeof(ScalarType) == 8 ? e57::E57_DOUBLE : e57::E57_SINGLE, intensitySF->getMin(), intensitySF->getMax()));
-		arrays.intData.resize(chunkSize);
-		dbufs.emplace_back( imf, "intensity",  arrays.intData.data(),  chunkSize, true, true );
 
 		if (hasInvalidIntensities)
 		{
 			proto.set("isIntensityInvalid", e57::IntegerNode(imf, 0, 0, 1));
-			arrays.isInvalidIntData.resize(chunkSize);
-			dbufs.emplace_back( imf, "isIntensityInvalid",  arrays.isInvalidIntData.data(),  chunkSize, true, true );
 		}
 	}
 
@@ -483,14 +477,8 @@ static bool SaveScan(ccPointCloud* cloud, e57::StructureNode& scanNode, e57::Ima
 	if (hasColors)
 	{
 		proto.set("colorRed",	e57::IntegerNode(imf, 0, 0, 255));
-		arrays.redData.resize(chunkSize);
-		dbufs.emplace_back( imf, "colorRed",  arrays.redData.data(),  chunkSize, true, true );
 		proto.set("colorGreen",	e57::IntegerNode(imf, 0, 0, 255));
-		arrays.greenData.resize(chunkSize);
-		dbufs.emplace_back( imf, "colorGreen",  arrays.greenData.data(),  chunkSize, true, true );
 		proto.set("colorBlue",	e57::IntegerNode(imf, 0, 0, 255));
-		arrays.blueData.resize(chunkSize);
-		dbufs.emplace_back( imf, "colorBlue",  arrays.blueData.data(),  chunkSize, true, true );
 	}
 
 	//ignored fields
@@ -505,6 +493,63 @@ static bool SaveScan(ccPointCloud* cloud, e57::StructureNode& scanNode, e57::Ima
 	//"isColorInvalid"
 	//"isTimeStampInvalid"
 
+	//prepare temporary structures
+	//we save the file in several steps to limit the memory consumption: while a block is
+	//written, the next one is filled (in parallel) in a second set of buffers
+	const unsigned chunkSize = std::min<unsigned>(pointCount, s_blockSize);
+	TempArrays blockArrays[2];
+	std::vector<e57::SourceDestBuffer> blockBuffers[2];
+	for (unsigned k = 0; k < 2; ++k)
+	{
+		TempArrays& arrays = blockArrays[k];
+		std::vector<e57::SourceDestBuffer>& dbufs = blockBuffers[k];
+
+		arrays.xData.resize(chunkSize);
+		dbufs.emplace_back( imf, "cartesianX",  arrays.xData.data(),  chunkSize, true, true );
+		arrays.yData.resize(chunkSize);
+		dbufs.emplace_back( imf, "cartesianY",  arrays.yData.data(),  chunkSize, true, true );
+		arrays.zData.resize(chunkSize);
+		dbufs.emplace_back( imf, "cartesianZ",  arrays.zData.data(),  chunkSize, true, true );
+
+		if (hasNormals)
+		{
+			arrays.xNormData.resize(chunkSize);
+			dbufs.emplace_back( imf, "nor:normalX",  arrays.xNormData.data(),  chunkSize, true, true );
+			arrays.yNormData.resize(chunkSize);
+			dbufs.emplace_back( imf, "nor:normalY",  arrays.yNormData.data(),  chunkSize, true, true );
+			arrays.zNormData.resize(chunkSize);
+			dbufs.emplace_back( imf, "nor:normalZ",  arrays.zNormData.data(),  chunkSize, true, true );
+		}
+
+		if (returnIndexSF)
+		{
+			arrays.scanIndexData.resize(chunkSize);
+			dbufs.emplace_back( imf, "returnIndex",  arrays.scanIndexData.data(),  chunkSize, true, true );
+		}
+
+		if (intensitySF)
+		{
+			arrays.intData.resize(chunkSize);
+			dbufs.emplace_back( imf, "intensity",  arrays.intData.data(),  chunkSize, true, true );
+
+			if (hasInvalidIntensities)
+			{
+				arrays.isInvalidIntData.resize(chunkSize);
+				dbufs.emplace_back( imf, "isIntensityInvalid",  arrays.isInvalidIntData.data(),  chunkSize, true, true );
+			}
+		}
+
+		if (hasColors)
+		{
+			arrays.redData.resize(chunkSize);
+			dbufs.emplace_back( imf, "colorRed",  arrays.redData.data(),  chunkSize, true, true );
+			arrays.greenData.resize(chunkSize);
+			dbufs.emplace_back( imf, "colorGreen",  arrays.greenData.data(),  chunkSize, true, true );
+			arrays.blueData.resize(chunkSize);
+			dbufs.emplace_back( imf, "colorBlue",  arrays.blueData.data(),  chunkSize, true, true );
+		}
+	}
+
 	// Make empty codecs vector for use in creating points CompressedVector.
 	/// If this vector is empty, it is assumed that all fields will use the BitPack codec.
 	e57::VectorNode codecs = e57::VectorNode(imf, true);
@@ -515,10 +560,10 @@ static bool SaveScan(ccPointCloud* cloud, e57::StructureNode& scanNode, e57::Ima
 	scanNode.set("points", points);
 	data3D.append(scanNode);
 
-	e57::CompressedVectorWriter writer = points.writer(dbufs);
+	e57::CompressedVectorWriter writer = points.writer(blockBuffers[0]);
 
 	//progress bar
-	CCCoreLib::NormalizedProgress nprogress(progressDlg, pointCount);
+	CCCoreLib::NormalizedProgress nprogress(progressDlg, (pointCount + chunkSize - 1) / chunkSize);
 	if (progressDlg)
 	{
 		progressDlg->setMethodTitle(QObject::tr("Write E57 file"));
@@ -533,15 +578,13 @@ static bool SaveScan(ccPointCloud* cloud, e57::StructureNode& scanNode, e57::Ima
 		inversePoseMat = ccGLMatrix(localPoseMat.inverse().data());
 	}
 
-	unsigned index = 0;
-	unsigned remainingPointCount = pointCount;
-	while (remainingPointCount != 0)
+	//fills the buffers with the points [firstIndex ; firstIndex + count[ (starting at 'firstIndex - blockStart')
+	auto fillBuffers = [&](TempArrays& arrays, unsigned blockStart, unsigned firstIndex, unsigned count)
 	{
-		unsigned thisChunkSize = std::min(remainingPointCount,chunkSize);
-
-		//load arrays
-		for (unsigned i = 0; i < thisChunkSize; ++i, ++index)
+		for (unsigned index = firstIndex; index < firstIndex + count; ++index)
 		{
+			unsigned i = index - blockStart;
+
 			const CCVector3* P = cloud->getPointPersistentPtr(index);
 			//CCVector3d Pglobal = cloud->toGlobal3d<PointCoordinateType>(*P);
 			CCVector3d Pglobal = CCVector3d::fromArray(P->u) / globalScale;
@@ -584,19 +627,74 @@ static bool SaveScan(ccPointCloud* cloud, e57::StructureNode& scanNode, e57::Ima
 				assert(!arrays.scanIndexData.empty());
 				arrays.scanIndexData[i] = static_cast<int8_t>(returnIndexSF->getValue(index));
 			}
-			
-			if (!nprogress.oneStep())
+		}
+	};
+
+	int threadCount = (s_maxThreadCount > 0 ? s_maxThreadCount : CCCoreLib::TaskScheduler::IdealThreadCount());
+	const unsigned partCount = static_cast<unsigned>(std::max(1, threadCount - 1)); //one thread is dedicated to the writer
+	CCCoreLib::TaskScheduler scheduler(static_cast<int>(partCount) + 1);
+
+	//fills a block of points (in parallel)
+	auto fillBlockPart = [&](TempArrays& arrays, unsigned blockStart, unsigned blockSize, unsigned partIndex)
+	{
+		unsigned partSize = (blockSize + partCount - 1) / partCount;
+		unsigned first = std::min(blockSize, partIndex * partSize);
+		fillBuffers(arrays, blockStart, blockStart + first, std::min(partSize, blockSize - first));
+	};
+
+	unsigned current = 0;
+	unsigned blockStart = 0;
+	unsigned blockSize = chunkSize;
+	scheduler.run(partCount, [&](unsigned partIndex)
+	{
+		fillBlockPart(blockArrays[0], 0, blockSize, partIndex);
+		return true;
+	});
+
+	std::exception_ptr writerException;
+	while (blockSize != 0)
+	{
+		const unsigned next = 1 - current;
+		const unsigned nextBlockStart = blockStart + blockSize;
+		const unsigned nextBlockSize = std::min(pointCount - nextBlockStart, chunkSize);
+
+		//the current block is written while the next one is filled
+		scheduler.run((nextBlockSize != 0 ? partCount : 0) + 1, [&](unsigned taskIndex)
+		{
+			if (taskIndex == 0)
 			{
-				QApplication::processEvents();
-				s_cancelRequestedByUser = true;
-				break;
+				try
+				{
+					writer.write(blockBuffers[current], blockSize);
+				}
+				catch (...)
+				{
+					writerException = std::current_exception();
+					return false;
+				}
 			}
+			else
+			{
+				fillBlockPart(blockArrays[next], nextBlockStart, nextBlockSize, taskIndex - 1);
+			}
+			return true;
+		});
+
+		if (writerException)
+		{
+			std::rethrow_exception(writerException);
 		}
 
-		writer.write(thisChunkSize);
-		
-		assert(thisChunkSize <= remainingPointCount);
-		remainingPointCount -= thisChunkSize;
+		if (!nprogress.oneStep())
+		{
+			QApplication::processEvents();
+			s_cancelRequestedByUser = true;
+			break;
+		}
+
+		current = next;
+		blockStart = nextBlockStart;
+		blockSize = nextBlockSize;
 	}
 
 	writer.close();
@@ -676,9 +774,13 @@ void SaveImage(const ccImage* image, const QString& scanGUID, e57::ImageFile& im
 	}
 
 
-	//save image data as PNG
+	//save image data (as is if it has not been decoded and is a JPEG or PNG image, as PNG otherwise)
 	QByteArray ba;
+	QByteArray imageFormat;
+	if (!image->getEncodedData(ba, imageFormat) || (imageFormat != "jpg" && imageFormat != "png"))
 	{
+		ba.clear();
+		imageFormat = "png";
 		QBuffer buffer(&ba);
 		buffer.open(QIODevice::WriteOnly);
 		image->data().save(&buffer, "PNG"); // writes image into ba in PNG format
@@ -689,7 +791,7 @@ void SaveImage(const ccImage* image, const QString& scanGUID, e57::ImageFile& im
 	QString cameraRepresentationStr("visualReferenceRepresentation");
 
 	e57::BlobNode blob(imf,imageSize);
-	cameraRepresentation.set("pngImage",blob);
+	cameraRepresentation.set(imageFormat == "jpg" ? "jpegImage" : "pngImage", blob);
 	cameraRepresentation.set("imageHeight", e57::IntegerNode(imf, image->getH()));
 	cameraRepresentation.set("imageWidth", e57::IntegerNode(imf, image->getW()));
 
@@ -1631,13 +1733,162 @@ static bool GetPoseInformation(const e57::StructureNode& node, ccGLMatrixd& pose
 	return validPoseMat;
 }
 
-static ccHObject* LoadScan(const e57::Node& node, QString& guidStr, ccProgressDialog* progressDlg = nullptr)
+//! Scan information (determined before the points are read, see PrepareScan)
+struct E57ScanInfo
+{
+	//! Scan GUID
+	QString guid;
+	//! Scan header
+	E57ScanHeader header;
+	//! Number of points
+	int64_t pointCount = 0;
+	//! Whether the points are expressed in spherical coordinates
+	bool sphericalMode = false;
+	//! Whether the scan has a valid pose
+	bool validPoseMat = false;
+	//! Scan pose (already shifted, if necessary)
+	ccGLMatrixd poseMat;
+	//! Shift applied to the points
+	CCVector3d Pshift = CCVector3d(0, 0, 0);
+	//! Whether the cloud should keep track of the global shift
+	bool hasGlobalShift = false;
+	//! Global shift of the cloud
+	CCVector3d globalShift = CCVector3d(0, 0, 0);
+};
+
+//Helper: adds the buffers of the point coordinates (and of their validity) to a set of buffers
+static void AddCoordinateBuffers(	const e57::Node& node,
+									const e57::StructureNode& prototype,
+									const E57ScanInfo& info,
+									unsigned chunkSize,
+									TempArrays& arrays,
+									std::vector<e57::SourceDestBuffer>& dbufs)
+{
+	static const char* s_sphericalFieldNames[4] = { "sphericalRange", "sphericalAzimuth", "sphericalElevation", "sphericalInvalidState" };
+	static const char* s_cartesianFieldNames[4] = { "cartesianX", "cartesianY", "cartesianZ", "cartesianInvalidState" };
+
+	const PointStandardizedFieldsAvailable& fields = info.header.pointFields;
+	const char** fieldNames = nullptr;
+	bool definedFields[4] = { false, false, false, false };
+	if (info.sphericalMode)
+	{
+		fieldNames = s_sphericalFieldNames;
+		definedFields[0] = fields.sphericalRangeField;
+		definedFields[1] = fields.sphericalAzimuthField;
+		definedFields[2] = fields.sphericalElevationField;
+		definedFields[3] = fields.sphericalInvalidStateField;
+	}
+	else
+	{
+		fieldNames = s_cartesianFieldNames;
+		definedFields[0] = fields.cartesianXField;
+		definedFields[1] = fields.cartesianYField;
+		definedFields[2] = fields.cartesianZField;
+		definedFields[3] = fields.cartesianInvalidStateField;
+	}
+
+	std::vector<double>* coordinates[3] = { &arrays.xData, &arrays.yData, &arrays.zData };
+	for (unsigned d = 0; d < 3; ++d)
+	{
+		if (definedFields[d])
+		{
+			coordinates[d]->resize(chunkSize);
+			dbufs.emplace_back( node.destImageFile(), fieldNames[d], coordinates[d]->data(), chunkSize, true, (prototype.get(fieldNames[d]).type() == e57::E57_SCALED_INTEGER) );
+		}
+	}
+
+	//data validity
+	if (definedFields[3])
+	{
+		arrays.isInvalidData.resize(chunkSize);
+		dbufs.emplace_back( node.destImageFile(), fieldNames[3], arrays.isInvalidData.data(), chunkSize, true, (prototype.get(fieldNames[3]).type() == e57::E57_SCALED_INTEGER) );
+	}
+}
+
+//Helper: returns the (cartesian) coordinates of a point read in the buffers
+static CCVector3d GetBufferPoint(const TempArrays& arrays, unsigned i, bool sphericalMode)
+{
+	CCVector3d Pd(0, 0, 0);
+	if (sphericalMode)
+	{
+		double r = (arrays.xData.empty() ? 0 : arrays.xData[i]);
+		double theta = (arrays.yData.empty() ? 0 : arrays.yData[i]);	//Azimuth
+		double phi = (arrays.zData.empty() ? 0 : arrays.zData[i]);		//Elevation
+
+		double cos_phi = cos(phi);
+		Pd.x = r * cos_phi * cos(theta);
+		Pd.y = r * cos_phi * sin(theta);
+		Pd.z = r * sin(phi);
+	}
+	//DGM TODO: not handled yet (-->what are the standard cylindrical field names?)
+	/*else if (cylindricalMode)
+	{
+		//from cylindrical coordinates
+		assert(arrays.xData);
+		double theta = (arrays.yData ? arrays.yData[i] : 0);
+		Pd.x = arrays.xData[i] * cos(theta);
+		Pd.y = arrays.xData[i] * sin(theta);
+		if (arrays.zData)
+			Pd.z = arrays.zData[i];
+	}
+	//*/
+	else //cartesian
+	{
+		if (!arrays.xData.empty())
+			Pd.x = arrays.xData[i];
+		if (!arrays.yData.empty())
+			Pd.y = arrays.yData[i];
+		if (!arrays.zData.empty())
+			Pd.z = arrays.zData[i];
+	}
+
+	return Pd;
+}
+
+//Helper: reads the first valid point of a scan
+static bool ReadFirstValidPoint(const e57::Node& node, const E57ScanInfo& info, CCVector3d& Pd)
+{
+	e57::StructureNode scanNode(node);
+	e57::CompressedVectorNode points(scanNode.get("points"));
+	e57::StructureNode prototype(points.prototype());
+
+	const unsigned chunkSize = static_cast<unsigned>(std::min<int64_t>(info.pointCount, 1024));
+	TempArrays arrays;
+	std::vector<e57::SourceDestBuffer> dbufs;
+	AddCoordinateBuffers(node, prototype, info, chunkSize, arrays, dbufs);
+
+	e57::CompressedVectorReader dataReader = points.reader(dbufs);
+
+	bool found = false;
+	unsigned size = 0;
+	while (!found && (size = dataReader.read()))
+	{
+		for (unsigned i = 0; i < size; ++i)
+		{
+			if (arrays.isInvalidData.empty() || arrays.isInvalidData[i] == 0)
+			{
+				Pd = GetBufferPoint(arrays, i, info.sphericalMode);
+				found = true;
+				break;
+			}
+		}
+	}
+
+	dataReader.close();
+
+	return found;
+}
+
+//! Reads the scan information and determines its global shift
+/** Must be called on each scan, in order, before the points are read (see LoadScan),
+	as the global shift may be asked to the user.
+**/
+static bool PrepareScan(const e57::Node& node, E57ScanInfo& info)
 {
-	bool lazType = true;
 	if (node.type() != e57::E57_STRUCTURE)
 	{
 		ccLog::Warning("[E57Filter] Scan nodes should be STRUCTURES!");
-		return nullptr;
+		return false;
 	}
 	e57::StructureNode scanNode(node);
 
@@ -1647,10 +1898,7 @@ static ccHObject* LoadScan(const e57::Node& node, QString& guidStr, ccProgressDi
 	if (scanName == QString("Point Laz"))
 	{
 		ccLog::Print(QString("[Point Laz] Point Laz scan recognized, Shaft initialisation"));
-		lazType = true;
-
 	}
-	
 
 	//log
 	ccLog::Print(QString("[E57] Reading new scan node (%1) - %2").arg(scanNode.elementName().c_str()).arg(scanName));
@@ -1658,7 +1906,7 @@ static ccHObject* LoadScan(const e57::Node& node, QString& guidStr, ccProgressDi
 	if (!scanNode.isDefined("points"))
 	{
 		ccLog::Warning(QString("[E57Filter] No point in scan '%1'!").arg(scanNode.elementName().c_str()));
-		return nullptr;
+		return false;
 	}
 
 	//unique GUID
@@ -1666,46 +1914,45 @@ static ccHObject* LoadScan(const e57::Node& node, QString& guidStr, ccProgressDi
 	{
 		e57::Node guidNode = scanNode.get("guid");
 		assert(guidNode.type() == e57::E57_STRING);
-		guidStr = QString(static_cast<e57::StringNode>(guidNode).value().c_str());
+		info.guid = QString(static_cast<e57::StringNode>(guidNode).value().c_str());
 	}
 	else
 	{
 		//No GUID!
-		guidStr.clear();
+		info.guid.clear();
 	}
 
 	//points
 	e57::CompressedVectorNode points(scanNode.get("points"));
-	const int64_t pointCount = points.childCount();
-	
+	info.pointCount = points.childCount();
+
 	//prototype for points
 	e57::StructureNode prototype(points.prototype());
-	E57ScanHeader header;
-	DecodePrototype(scanNode, prototype, header);
+	DecodePrototype(scanNode, prototype, info.header);
 
-	bool sphericalMode = false;
+	info.sphericalMode = false;
 	//no cartesian fields?
-	if (!header.pointFields.cartesianXField &&
-		!header.pointFields.cartesianYField && 
-		!header.pointFields.cartesianZField)
+	if (!info.header.pointFields.cartesianXField &&
+		!info.header.pointFields.cartesianYField &&
+		!info.header.pointFields.cartesianZField)
 	{
 		//let's look for spherical ones
-		if (!header.pointFields.sphericalRangeField &&
-			!header.pointFields.sphericalAzimuthField &&
-			!header.pointFields.sphericalElevationField)
+		if (!info.header.pointFields.sphericalRangeField &&
+			!info.header.pointFields.sphericalAzimuthField &&
+			!info.header.pointFields.sphericalElevationField)
 		{
 			ccLog::Warning(QString("[E57Filter] No readable point in scan '%1'! (only cartesian and spherical coordinates are supported right now)").arg(scanNode.elementName().c_str()));
-			return nullptr;
+			return false;
 		}
-		sphericalMode = true;
+		info.sphericalMode = true;
 	}
-	ccPointCloud* cloud = new ccPointCloud();
 
-	if (scanNode.isDefined("name"))
-	{		
-		cloud->setName(scanName);
+	if (info.pointCount <= 0)
+	{
+		ccLog::Warning(QString("[E57] No valid point in scan '%1'!").arg(scanNode.elementName().c_str()));
+		return false;
 	}
-	
+
 	if (scanNode.isDefined("description"))
 	{
 		ccLog::Print( QStringLiteral("[E57] Internal description: %1").arg(
@@ -1732,35 +1979,78 @@ static ccHObject* LoadScan(const e57::Node& node, QString& guidStr, ccProgressDi
 	//*/
 
 	//scan "pose" relatively to the others
-	ccGLMatrixd poseMat;
 	std::vector<double> t;
-	const bool validPoseMat = GetPoseInformation(scanNode, poseMat,t);
+	info.validPoseMat = GetPoseInformation(scanNode, info.poseMat, t);
 	bool poseMatWasShifted = false;
-	ccGBLSensor* sensor = nullptr;
 
-	if (validPoseMat)
+	if (info.validPoseMat)
 	{
-		const CCVector3d T = poseMat.getTranslationAsVec3D();
+		const CCVector3d T = info.poseMat.getTranslationAsVec3D();
 		CCVector3d Tshift;
 		bool preserveCoordinateShift = true;
 		if (FileIOFilter::HandleGlobalShift(T, Tshift, preserveCoordinateShift, s_loadParameters))
 		{
-			poseMat.setTranslation((T + Tshift).u);
+			info.poseMat.setTranslation((T + Tshift).u);
 			if (preserveCoordinateShift)
 			{
-				cloud->setGlobalShift(Tshift);
+				info.hasGlobalShift = true;
+				info.globalShift = Tshift;
 			}
 			poseMatWasShifted = true;
-			ccLog::Warning("[E57Filter::loadFile] Cloud %s has been recentered! Translation: (%.2f ; %.2f ; %.2f)", qPrintable(guidStr), Tshift.x, Tshift.y, Tshift.z);
+			ccLog::Warning("[E57Filter::loadFile] Cloud %s has been recentered! Translation: (%.2f ; %.2f ; %.2f)", qPrintable(info.guid), Tshift.x, Tshift.y, Tshift.z);
 		}
+	}
 
-		//cloud->setGLTransformation(poseMat); //TODO-> apply it at the end instead! Otherwise we will loose original coordinates!
+	//first (valid) point: check for 'big' coordinates
+	if (!info.validPoseMat || !poseMatWasShifted)
+	{
+		CCVector3d Pd(0, 0, 0);
+		if (ReadFirstValidPoint(node, info, Pd))
+		{
+			bool preserveCoordinateShift = true;
+			if (FileIOFilter::HandleGlobalShift(Pd, info.Pshift, preserveCoordinateShift, s_loadParameters))
+			{
+				if (preserveCoordinateShift)
+				{
+					info.hasGlobalShift = true;
+					info.globalShift = info.Pshift;
+				}
+				ccLog::Warning("[E57Filter::loadFile] Cloud %s has been recentered! Translation: (%.2f ; %.2f ; %.2f)", qPrintable(info.guid), info.Pshift.x, info.Pshift.y, info.Pshift.z);
+			}
+		}
+	}
 
-		
+	return true;
+}
+
+//! Reads the points of a scan
+/** The scan must have been prepared first (see PrepareScan).
+	Can be called concurrently on different scans, as long as each thread uses its own e57::ImageFile.
+**/
+static ccHObject* LoadScan(const e57::Node& node, const E57ScanInfo& info, unsigned blockSize, CCCoreLib::NormalizedProgress& nprogress, std::atomic<bool>& cancelRequested)
+{
+	e57::StructureNode scanNode(node);
+	const E57ScanHeader& header = info.header;
+
+	//points
+	e57::CompressedVectorNode points(scanNode.get("points"));
+	const int64_t pointCount = info.pointCount;
+	e57::StructureNode prototype(points.prototype());
+
+	ccPointCloud* cloud = new ccPointCloud();
+
+	if (scanNode.isDefined("name"))
+	{
+		cloud->setName(QString::fromStdString( e57::StringNode(scanNode.get("name")).value()));
+	}
+
+	if (info.hasGlobalShift)
+	{
+		cloud->setGlobalShift(info.globalShift);
 	}
 
 	//prepare temporary structures
-	const unsigned chunkSize = std::min<unsigned>(pointCount, (1 << 20)); //we load the file in several steps to limit the memory consumption
+	const unsigned chunkSize = static_cast<unsigned>(std::min<int64_t>(pointCount, blockSize)); //we load the file in several steps to limit the memory consumption
 	TempArrays arrays;
 	std::vector<e57::SourceDestBuffer> dbufs;
 
@@ -1771,57 +2061,8 @@ static ccHObject* LoadScan(const e57::Node& node, QString& guidStr, ccProgressDi
 		return nullptr;
 	}
 
-	if (sphericalMode)
-	{
-		//spherical coordinates
-		if (header.pointFields.sphericalRangeField)
-		{
-			arrays.xData.resize(chunkSize);
-			dbufs.emplace_back( node.destImageFile(), "sphericalRange", arrays.xData.data(), chunkSize, true, (prototype.get("sphericalRange").type() == e57::E57_SCALED_INTEGER) );
-		}
-		if (header.pointFields.sphericalAzimuthField)
-		{
-			arrays.yData.resize(chunkSize);
-			dbufs.emplace_back( node.destImageFile(), "sphericalAzimuth", arrays.yData.data(), chunkSize, true, (prototype.get("sphericalAzimuth").type() == e57::E57_SCALED_INTEGER) );
-		}
-		if (header.pointFields.sphericalElevationField)
-		{
-			arrays.zData.resize(chunkSize);
-			dbufs.emplace_back( node.destImageFile(), "sphericalElevation", arrays.zData.data(), chunkSize, true, (prototype.get("sphericalElevation").type() == e57::E57_SCALED_INTEGER) );
-		}
-		//data validity
-		if (header.pointFields.sphericalInvalidStateField)
-		{
-			arrays.isInvalidData.resize(chunkSize);
-			dbufs.emplace_back( node.destImageFile(), "sphericalInvalidState", arrays.isInvalidData.data(), chunkSize, true, (prototype.get("sphericalInvalidState").type() == e57::E57_SCALED_INTEGER) );
-		}
-	}
-	else
-	{
-		//cartesian coordinates
-		if (header.pointFields.cartesianXField)
-		{
-			arrays.xData.resize(chunkSize);
-			dbufs.emplace_back( node.destImageFile(), "cartesianX", arrays.xData.data(), chunkSize, true, (prototype.get("cartesianX").type() == e57::E57_SCALED_INTEGER) );
-		}
-		if (header.pointFields.cartesianYField)
-		{
-			arrays.yData.resize(chunkSize);
-			dbufs.emplace_back( node.destImageFile(), "cartesianY", arrays.yData.data(), chunkSize, true, (prototype.get("cartesianY").type() == e57::E57_SCALED_INTEGER) );
-		}
-		if (header.pointFields.cartesianZField)
-		{
-			arrays.zData.resize(chunkSize);
-			dbufs.emplace_back( node.destImageFile(), "cartesianZ", arrays.zData.data(), chunkSize, true, (prototype.get("cartesianZ").type() == e57::E57_SCALED_INTEGER) );
-		}
-
-		//data validity
-		if ( header.pointFields.cartesianInvalidStateField)
-		{
-			arrays.isInvalidData.resize(chunkSize);
-			dbufs.emplace_back( node.destImageFile(), "cartesianInvalidState", arrays.isInvalidData.data(), chunkSize, true, (prototype.get("cartesianInvalidState").type() == e57::E57_SCALED_INTEGER) );
-		}
-	}
+	//spherical or cartesian coordinates
+	AddCoordinateBuffers(node, prototype, info, chunkSize, arrays, dbufs);
 
 	//normals
 	bool hasNormals = (  header.pointFields.normXField
@@ -1950,16 +2191,7 @@ static ccHObject* LoadScan(const e57::Node& node, QString& guidStr, ccProgressDi
 	//Read the point data
 	e57::CompressedVectorReader dataReader = points.reader(dbufs);
 
-	//local progress bar
-	CCCoreLib::NormalizedProgress nprogress(progressDlg, static_cast<unsigned>(pointCount / chunkSize));
-	if (progressDlg)
-	{
-		progressDlg->setMethodTitle(QObject::tr("Read E57 file"));
-		progressDlg->setInfo(QObject::tr("Scan #%1 - %2 points").arg(s_absoluteScanIndex).arg(pointCount));
-		progressDlg->start();
-		QApplication::processEvents();
-	}
-	CCVector3d Pshift(0, 0, 0);
+	const CCVector3d& Pshift = info.Pshift;
 	unsigned size = 0;
 	int64_t realCount = 0;
 	int64_t invalidCount = 0;
@@ -1974,55 +2206,7 @@ static ccHObject* LoadScan(const e57::Node& node, QString& guidStr, ccProgressDi
 				continue;
 			}
 
-			CCVector3d Pd(0, 0, 0);
-			if (sphericalMode)
-			{
-				double r = (arrays.xData.empty() ? 0 : arrays.xData[i]);
-				double theta = (arrays.yData.empty() ? 0 : arrays.yData[i]);	//Azimuth
-				double phi = (arrays.zData.empty() ? 0 : arrays.zData[i]);		//Elevation
-
-				double cos_phi = cos(phi);
-				Pd.x = r * cos_phi * cos(theta);
-				Pd.y = r * cos_phi * sin(theta);
-				Pd.z = r * sin(phi);
-			}
-			//DGM TODO: not handled yet (-->what are the standard cylindrical field names?)
-			/*else if (cylindricalMode)
-			{
-				//from cylindrical coordinates
-				assert(arrays.xData);
-				double theta = (arrays.yData ? arrays.yData[i] : 0);
-				Pd.x = arrays.xData[i] * cos(theta);
-				Pd.y = arrays.xData[i] * sin(theta);
-				if (arrays.zData)
-					Pd.z = arrays.zData[i];
-			}
-			//*/
-			else //cartesian
-			{
-				if (!arrays.xData.empty())
-					Pd.x = arrays.xData[i];
-				if (!arrays.yData.empty())
-					Pd.y = arrays.yData[i];
-				if (!arrays.zData.empty())
-					Pd.z = arrays.zData[i];
-			}
-
-			//first point: check for 'big' coordinates
-			if (	realCount == 0
-				&& (!validPoseMat || !poseMatWasShifted) )
-			{
-				bool preserveCoordinateShift = true;
-				if (FileIOFilter::HandleGlobalShift(Pd, Pshift, preserveCoordinateShift, s_loadParameters))
-				{
-					if (preserveCoordinateShift)
-					{
-						cloud->setGlobalShift(Pshift);
-					}
-					ccLog::Warning("[E57Filter::loadFile] Cloud %s has been recentered! Translation: (%.2f ; %.2f ; %.2f)", qPrintable(guidStr), Pshift.x, Pshift.y, Pshift.z);
-				}
-			}
-
+			const CCVector3d Pd = GetBufferPoint(arrays, i, info.sphericalMode);
 			const CCVector3 P = CCVector3::fromArray((Pd + Pshift).u);
 			cloud->addPoint(P);
 
@@ -2047,19 +2231,6 @@ static ccHObject* LoadScan(const e57::Node& node, QString& guidStr, ccProgressDi
 					//ScalarType intensity = (ScalarType)((arrays.intData[i] - intOffset)/intRange); //Normalize intensity to 0 - 1.
 					const ScalarType intensity = static_cast<ScalarType>(arrays.intData[i]);
 					intensitySF->setValue(static_cast<unsigned>(realCount),intensity);
-
-					//track max intensity (for proper visualization)
-					if (s_absoluteScanIndex != 0 || realCount != 0)
-					{
-						if (s_maxIntensity < intensity)
-							s_maxIntensity = intensity;
-						else if (s_minIntensity > intensity)
-							s_minIntensity = intensity;
-					}
-					else
-					{
-						s_maxIntensity = s_minIntensity = intensity;
-					}
 				}
 				else
 				{
@@ -2090,10 +2261,9 @@ static ccHObject* LoadScan(const e57::Node& node, QString& guidStr, ccProgressDi
 			realCount++;
 		}
 		
-		if (progressDlg && !nprogress.oneStep())
+		if (!nprogress.oneStep() || cancelRequested)
 		{
-			QApplication::processEvents();
-			s_cancelRequestedByUser = true;
+			cancelRequested = true;
 			break;
 		}
 	}
@@ -2140,9 +2310,9 @@ static ccHObject* LoadScan(const e57::Node& node, QString& guidStr, ccProgressDi
 	cloud->setVisible(true);
 
 	//we don't deal with virtual transformation (yet)
-	if (validPoseMat)
+	if (info.validPoseMat)
 	{
-		const ccGLMatrix poseMatf(poseMat.data());
+		const ccGLMatrix poseMatf(info.poseMat.data());
 		
 		cloud->applyGLTransformation_recursive(&poseMatf);
 		//this transformation is of no interest for the user
@@ -2329,12 +2499,21 @@ static ccHObject* LoadImage(const e57::Node& node, QString& associatedData3DGuid
 		//DGM: TODO
 	}
 
-	QImage qImage;
+	//the image is only decoded when first accessed (see ccImage::setEncodedData)
 	assert(imageBits);
-	bool loadResult = qImage.loadFromData(imageBits, static_cast<int>(visualRefRepresentation->imageSize), imageFormat);
+	QByteArray imageData(reinterpret_cast<const char*>(imageBits), static_cast<int>(visualRefRepresentation->imageSize));
 	delete[] imageBits;
 	imageBits = nullptr;
 
+	QSize imageSize;
+	{
+		QBuffer imageBuffer(&imageData);
+		imageBuffer.open(QIODevice::ReadOnly);
+		QImageReader imageReader(&imageBuffer, imageFormat);
+		imageSize = imageReader.size(); //only reads the image header
+	}
+	bool loadResult = imageSize.isValid();
+
 	if (!loadResult)
 	{
 		ccLog::Warning("[E57] Failed to load image from blob data!");
@@ -2394,7 +2573,7 @@ static ccHObject* LoadImage(const e57::Node& node, QString& associatedData3DGuid
 	}
 
 	assert(imageObj);
-	imageObj->setData(qImage);
+	imageObj->setEncodedData(imageData, imageFormat, imageSize);
 	imageObj->setName(imageName);
 
 	//don't forget image aspect ratio
@@ -2594,12 +2773,21 @@ static std::pair<ccImage*, std::vector<double>> LoadImageLaz(const e57::Node& no
 		//DGM: TODO
 	}
 
-	QImage qImage;
+	//the image is only decoded when first accessed (see ccImage::setEncodedData)
 	assert(imageBits);
-	bool loadResult = qImage.loadFromData(imageBits, static_cast<int>(visualRefRepresentation->imageSize), imageFormat);
+	QByteArray imageData(reinterpret_cast<const char*>(imageBits), static_cast<int>(visualRefRepresentation->imageSize));
 	delete[] imageBits;
 	imageBits = nullptr;
 
+	QSize imageSize;
+	{
+		QBuffer imageBuffer(&imageData);
+		imageBuffer.open(QIODevice::ReadOnly);
+		QImageReader imageReader(&imageBuffer, imageFormat);
+		imageSize = imageReader.size(); //only reads the image header
+	}
+	bool loadResult = imageSize.isValid();
+
 	if (!loadResult)
 	{
 		ccLog::Warning("[E57] Failed to load image from blob data!");
@@ -2660,7 +2848,7 @@ static std::pair<ccImage*, std::vector<double>> LoadImageLaz(const e57::Node& no
 	}
 
 	assert(imageObj);
-	imageObj->setData(qImage);
+	imageObj->setEncodedData(imageData, imageFormat, imageSize);
 	imageObj->setName(imageName);
 
 	//don't forget image aspect ratio
@@ -2751,42 +2939,110 @@ CC_FILE_ERROR E57Filter::loadFile(const QString& filename, ccHObject& container,
 
 			unsigned scanCount = static_cast<unsigned>(data3D.childCount());
 
+			//static states
+			s_absoluteScanIndex = 0;
+			s_cancelRequestedByUser = false;
+
+			//the scans are prepared in order first (as the Global Shift may be asked to the user)
+			std::vector<E57ScanInfo> scanInfos(scanCount);
+			std::vector<bool> validScans(scanCount, false);
+			unsigned blockCount = 0;
+			for (unsigned i = 0; i < scanCount; ++i)
+			{
+				validScans[i] = PrepareScan(data3D.get(i), scanInfos[i]);
+				if (validScans[i])
+				{
+					blockCount += static_cast<unsigned>((scanInfos[i].pointCount + s_blockSize - 1) / s_blockSize);
+				}
+			}
+
 			//global progress bar
 			QScopedPointer<ccProgressDialog> progressDlg(nullptr);
 			if (parameters.parentWidget)
 			{
 				progressDlg.reset(new ccProgressDialog(true, parameters.parentWidget));
 				progressDlg->setAutoClose(false);
-			}
-
-			bool showGlobalProgress = (scanCount > 10);
-			if (progressDlg && showGlobalProgress)
-			{
-				//Too many scans, will display a global progress bar
 				progressDlg->setMethodTitle(QObject::tr("Read E57 file"));
 				progressDlg->setInfo(QObject::tr("Scans: %1").arg(scanCount));
 				progressDlg->start();
 				QApplication::processEvents();
 			}
-			CCCoreLib::NormalizedProgress nprogress(progressDlg.data(), showGlobalProgress ? scanCount : 100);
+			CCCoreLib::NormalizedProgress nprogress(progressDlg.data(), std::max(1u, blockCount));
+
+			//then the scans are read concurrently: as an E57 file can't be shared
+			//between threads, each thread opens its own reader
+			int threadCount = (s_maxThreadCount > 0 ? s_maxThreadCount : CCCoreLib::TaskScheduler::IdealThreadCount());
+			unsigned readerCount = std::max(1u, std::min(static_cast<unsigned>(std::max(1, threadCount)), scanCount));
+			std::vector<e57::ImageFile> readers;
+			readers.push_back(imf);
+			while (readers.size() < readerCount)
+			{
+				e57::ImageFile reader(filename.toStdString(), "r", e57::CHECKSUM_POLICY_SPARSE);
+				if (!reader.isOpen())
+				{
+					break;
+				}
+				if (!reader.extensionsLookupPrefix("nor", _normalsExtension))
+				{
+					reader.extensionsAdd("nor", normalsExtension);
+				}
+				readers.push_back(reader);
+			}
+
+			//the color scales must be created before the scans are read (see LoadScan)
+			ccColorScalesManager::GetUniqueInstance();
+
+			std::vector<ccHObject*> loadedScans(scanCount, nullptr);
+			std::atomic<unsigned> nextScanIndex(0);
+			std::atomic<bool> cancelRequested(false);
+			std::mutex exceptionMutex;
+			std::exception_ptr readerException;
+
+			CCCoreLib::TaskScheduler scheduler(static_cast<int>(readers.size()));
+			scheduler.run(static_cast<unsigned>(readers.size()), [&](unsigned readerIndex)
+			{
+				try
+				{
+					e57::VectorNode readerData3D(readers[readerIndex].root().get("/data3D"));
+					for (unsigned i = nextScanIndex++; i < scanCount && !cancelRequested; i = nextScanIndex++)
+					{
+						if (validScans[i])
+						{
+							loadedScans[i] = LoadScan(readerData3D.get(i), scanInfos[i], s_blockSize, nprogress, cancelRequested);
+						}
+					}
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> lock(exceptionMutex);
+					if (!readerException)
+					{
+						readerException = std::current_exception();
+					}
+					cancelRequested = true;
+					return false;
+				}
+				return true;
+			});
+
+			for (size_t i = 1; i < readers.size(); ++i)
+			{
+				readers[i].close();
+			}
+			if (cancelRequested)
+			{
+				s_cancelRequestedByUser = true;
+			}
 
-			//static states
-			s_absoluteScanIndex = 0;
-			s_cancelRequestedByUser = false;
-			s_minIntensity = s_maxIntensity = 0;
-			
 			for (unsigned i = 0; i < scanCount; ++i)
 			{
-				const e57::Node scanNode = data3D.get(i);
-				QString scanGUID;
-				
-				scan = LoadScan(scanNode, scanGUID, showGlobalProgress ? nullptr : progressDlg.data());
-				
+				scan = loadedScans[i];
 				if (scan)
 				{
 					if (scan->getName().isEmpty())
 					{
 						QString name("Scan ");
+						const e57::Node scanNode = data3D.get(i);
 						e57::ustring nodeName = scanNode.elementName();
 						if (scanNode.elementName() == "Point Laz")
 						{
@@ -2803,16 +3059,11 @@ CC_FILE_ERROR E57Filter::loadFile(const QString& filename, ccHObject& container,
 					container.addChild(scan);
 
 					//we also add the scan to the GUID/object map
-					if (!scanGUID.isEmpty())
+					if (!scanInfos[i].guid.isEmpty())
 					{
-						scans.insert(scanGUID, scan);
+						scans.insert(scanInfos[i].guid, scan);
 					}
 				}
-				
-				if ((showGlobalProgress && progressDlg && !nprogress.oneStep()) || s_cancelRequestedByUser)
-				{
-					break;
-				}
 				++s_absoluteScanIndex;
 			}
 
@@ -2822,6 +3073,11 @@ CC_FILE_ERROR E57Filter::loadFile(const QString& filename, ccHObject& container,
 				QApplication::processEvents();
 			}
 
+			if (readerException)
+			{
+				std::rethrow_exception(readerException);
+			}
+
 			//set global max intensity (saturation) for proper display
 			for (unsigned i = 0; i < container.getChildrenNumber(); ++i)
 			{
@@ -0,0 +1,116 @@
+//##########################################################################
+//#                                                                        #
+//#                              CLOUDCOMPARE                              #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                    COPYRIGHT: CloudCompare project                     #
+//#                                                                        #
+//##########################################################################
+
+#ifndef CC_LAS_STREAM_INGESTOR_HEADER
+#define CC_LAS_STREAM_INGESTOR_HEADER
+
+//Local
+#include "LASFields.h"
+
+//qCC_io
+#include <FileIOFilter.h>
+
+//Qt
+#include <QString>
+#include <QStringList>
+
+//System
+#include <vector>
+
+namespace CCCoreLib
+{
+	class GenericProgressCallback;
+}
+
+//! Streaming ingestion of LAS/LAZ files into an out-of-core store (see ccOutOfCoreCloud)
+/** The input files are split in ranges of points, each range being decoded by its own
+	PDAL pipeline (LasReader + StreamCallbackFilter) in parallel. The global shift, the
+	classification filter and the decimation are applied on the fly, and the points are
+	dispatched in spatial tiles (cells of an octree built on the global bounding-box)
+	stored in temporary files. The tiles are then sorted (in parallel) and written in the
+	octree order, so that the 64K points chunks of the store are spatially coherent
+	(which is what the LOD display and the out-of-core processes expect).
+	The whole set of points never has to fit in memory.
+**/
+class LASStreamIngestor
+{
+public:
+
+	//! Ingestion parameters
+	struct Parameters
+	{
+		//! Input LAS/LAZ files
+		QStringList filenames;
+		//! Output store filename
+		QString outputFilename;
+		//! Whether the global shift should be determined automatically (if necessary)
+		bool autoShift = true;
+		//! Global shift (if autoShift is false)
+		CCVector3d globalShift = CCVector3d(0, 0, 0);
+		//! Classes to keep (all the points are kept if empty)
+		std::vector<int> classes;
+		//! Decimation step (one point out of 'decimationStep' is kept)
+		unsigned decimationStep = 1;
+		//! Number of points decoded by each pipeline (range of a file)
+		unsigned rangeSize = (1 << 20);
+		//! Octree level of the tiles (-1 = automatic: ~1M points per tile)
+		int tileLevel = -1;
+		//! Whether to load the colors (if any)
+		bool loadColors = true;
+		//! Whether colors are always coded on 8 bits
+		bool forced8bitRgbMode = false;
+		//! Standard fields loaded as scalar fields
+		/** Supported: intensity, return number, number of returns, classification,
+			scan angle rank, user data and point source ID.
+		**/
+		std::vector<LAS_FIELDS> scalarFields = { LAS_INTENSITY, LAS_CLASSIFICATION };
+		//! Max number of threads (0 = all)
+		int maxThreadCount = 0;
+	};
+
+	//! Ingestion report
+	struct Report
+	{
+		//! Number of points in the input files
+		qint64 inputPointCount = 0;
+		//! Number of points written in the store
+		qint64 outputPointCount = 0;
+		//! Number of (non empty) tiles
+		unsigned tileCount = 0;
+		//! Global shift
+		CCVector3d globalShift = CCVector3d(0, 0, 0);
+		//! Decoding time (in seconds)
+		double decodingTime = 0.0;
+		//! Writing time (in seconds)
+		double writingTime = 0.0;
+
+		//! Returns the decoding throughput (input points per second)
+		inline double decodingThroughput() const { return decodingTime > 0 ? inputPointCount / decodingTime : 0.0; }
+		//! Returns the overall throughput (input points per second)
+		inline double overallThroughput() const { return decodingTime + writingTime > 0 ? inputPointCount / (decodingTime + writingTime) : 0.0; }
+	};
+
+	//! Ingests a set of LAS/LAZ files
+	/** \param parameters ingestion parameters
+		\param[out] report ingestion report (throughput, etc.)
+		\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+		\return error code
+	**/
+	static CC_FILE_ERROR Ingest(const Parameters& parameters, Report& report, CCCoreLib::GenericProgressCallback* progressCb = nullptr);
+};
+
+#endif //CC_LAS_STREAM_INGESTOR_HEADER
@@ -0,0 +1,239 @@
+//##########################################################################
+//#                                                                        #
+//#                              CLOUDCOMPARE                              #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                    COPYRIGHT: CloudCompare project                     #
+//#                                                                        #
+//##########################################################################
+
+#ifndef PDAL_IO_PLUGIN_COMMANDS_HEADER
+#define PDAL_IO_PLUGIN_COMMANDS_HEADER
+
+#include "ccCommandLineInterface.h"
+
+//Local
+#include "LASStreamIngestor.h"
+
+//qCC_db
+#include <ccOutOfCoreCloud.h>
+#include <ccProgressDialog.h>
+
+static const char COMMAND_LAS_INGEST[]				= "LAS_INGEST";
+static const char COMMAND_LAS_INGEST_CLASSES[]		= "CLASSES";
+static const char COMMAND_LAS_INGEST_DECIMATE[]		= "DECIMATE";
+static const char COMMAND_LAS_INGEST_RANGE_SIZE[]	= "RANGE_SIZE";
+static const char COMMAND_LAS_INGEST_TILE_LEVEL[]	= "TILE_LEVEL";
+static const char COMMAND_LAS_INGEST_NO_COLOR[]		= "NO_COLOR";
+static const char COMMAND_LAS_INGEST_SF[]			= "SF";
+static const char COMMAND_LAS_INGEST_PREVIEW[]		= "PREVIEW";
+static const char COMMAND_LAS_INGEST_MAX_THREAD_COUNT[]	= "MAX_THREAD_COUNT";
+
+//! Streams LAS/LAZ files into an out-of-core store (see LASStreamIngestor)
+/** Syntax: -LAS_INGEST [options] {output store} {input file 1} [input file 2] ...
+**/
+struct CommandLASIngest : public ccCommandLineInterface::Command
+{
+	CommandLASIngest() : ccCommandLineInterface::Command("LAS ingestion", COMMAND_LAS_INGEST) {}
+
+	virtual bool process(ccCommandLineInterface& cmd) override
+	{
+		cmd.print("[LAS INGESTION]");
+
+		LASStreamIngestor::Parameters params;
+		unsigned previewPointCount = 0;
+
+		bool coordinatesShiftWasEnabled = cmd.coordinatesShiftWasEnabled();
+
+		//look for additional parameters
+		while (!cmd.arguments().empty())
+		{
+			const QString& ARGUMENT = cmd.arguments().front();
+			if (cmd.nextCommandIsGlobalShift())
+			{
+				//local option confirmed, we can move on
+				cmd.arguments().pop_front();
+
+				if (!cmd.processGlobalShiftCommand())
+				{
+					//error message already issued
+					return false;
+				}
+			}
+			else if (ccCommandLineInterface::IsCommand(ARGUMENT, COMMAND_LAS_INGEST_CLASSES))
+			{
+				cmd.arguments().pop_front();
+				if (cmd.arguments().empty())
+				{
+					return cmd.error(QObject::tr("Missing parameter: class list after \"-%1\"").arg(COMMAND_LAS_INGEST_CLASSES));
+				}
+				for (const QString& token : cmd.arguments().takeFirst().split(',', QString::SkipEmptyParts))
+				{
+					bool ok = false;
+					int classValue = token.toInt(&ok);
+					if (!ok || classValue < 0 || classValue > 255)
+					{
+						return cmd.error(QObject::tr("Invalid parameter: class list after \"-%1\"").arg(COMMAND_LAS_INGEST_CLASSES));
+					}
+					params.classes.push_back(classValue);
+				}
+			}
+			else if (ccCommandLineInterface::IsCommand(ARGUMENT, COMMAND_LAS_INGEST_DECIMATE))
+			{
+				cmd.arguments().pop_front();
+				bool ok = false;
+				params.decimationStep = (cmd.arguments().empty() ? 0 : cmd.arguments().takeFirst().toUInt(&ok));
+				if (!ok || params.decimationStep == 0)
+				{
+					return cmd.error(QObject::tr("Invalid parameter: value after \"-%1\"").arg(COMMAND_LAS_INGEST_DECIMATE));
+				}
+			}
+			else if (ccCommandLineInterface::IsCommand(ARGUMENT, COMMAND_LAS_INGEST_RANGE_SIZE))
+			{
+				cmd.arguments().pop_front();
+				bool ok = false;
+				params.rangeSize = (cmd.arguments().empty() ? 0 : cmd.arguments().takeFirst().toUInt(&ok));
+				if (!ok || params.rangeSize == 0)
+				{
+					return cmd.error(QObject::tr("Invalid parameter: value after \"-%1\"").arg(COMMAND_LAS_INGEST_RANGE_SIZE));
+				}
+			}
+			else if (ccCommandLineInterface::IsCommand(ARGUMENT, COMMAND_LAS_INGEST_TILE_LEVEL))
+			{
+				cmd.arguments().pop_front();
+				bool ok = false;
+				params.tileLevel = (cmd.arguments().empty() ? -1 : cmd.arguments().takeFirst().toInt(&ok));
+				if (!ok || params.tileLevel < 0)
+				{
+					return cmd.error(QObject::tr("Invalid parameter: value after \"-%1\"").arg(COMMAND_LAS_INGEST_TILE_LEVEL));
+				}
+			}
+			else if (ccCommandLineInterface::IsCommand(ARGUMENT, COMMAND_LAS_INGEST_NO_COLOR))
+			{
+				cmd.arguments().pop_front();
+				params.loadColors = false;
+			}
+			else if (ccCommandLineInterface::IsCommand(ARGUMENT, COMMAND_LAS_INGEST_SF))
+			{
+				cmd.arguments().pop_front();
+				if (cmd.arguments().empty())
+				{
+					return cmd.error(QObject::tr("Missing parameter: field list after \"-%1\"").arg(COMMAND_LAS_INGEST_SF));
+				}
+				params.scalarFields.clear();
+				for (const QString& token : cmd.arguments().takeFirst().split(',', QString::SkipEmptyParts))
+				{
+					LAS_FIELDS field = LAS_INVALID;
+					for (int i = LAS_INTENSITY; i <= LAS_POINT_SOURCE_ID; ++i)
+					{
+						if (QString(LAS_FIELD_NAMES[i]).remove(' ').compare(token, Qt::CaseInsensitive) == 0)
+						{
+							field = static_cast<LAS_FIELDS>(i);
+							break;
+						}
+					}
+					if (field == LAS_INVALID)
+					{
+						return cmd.error(QObject::tr("Invalid parameter: unknown field '%1' after \"-%2\"").arg(token, COMMAND_LAS_INGEST_SF));
+					}
+					params.scalarFields.push_back(field);
+				}
+			}
+			else if (ccCommandLineInterface::IsCommand(ARGUMENT, COMMAND_LAS_INGEST_PREVIEW))
+			{
+				cmd.arguments().pop_front();
+				bool ok = false;
+				previewPointCount = (cmd.arguments().empty() ? 0 : cmd.arguments().takeFirst().toUInt(&ok));
+				if (!ok || previewPointCount == 0)
+				{
+					return cmd.error(QObject::tr("Invalid parameter: value after \"-%1\"").arg(COMMAND_LAS_INGEST_PREVIEW));
+				}
+			}
+			else if (ccCommandLineInterface::IsCommand(ARGUMENT, COMMAND_LAS_INGEST_MAX_THREAD_COUNT))
+			{
+				cmd.arguments().pop_front();
+				bool ok = false;
+				params.maxThreadCount = (cmd.arguments().empty() ? -1 : cmd.arguments().takeFirst().toInt(&ok));
+				if (!ok || params.maxThreadCount < 0)
+				{
+					return cmd.error(QObject::tr("Invalid parameter: value after \"-%1\"").arg(COMMAND_LAS_INGEST_MAX_THREAD_COUNT));
+				}
+			}
+			else
+			{
+				break; //as soon as we encounter an unrecognized argument, we break the local loop to go back to the main one!
+			}
+		}
+
+		//output store
+		if (cmd.arguments().empty())
+		{
+			return cmd.error(QObject::tr("Missing parameter: output filename after \"-%1\"").arg(COMMAND_LAS_INGEST));
+		}
+		params.outputFilename = cmd.arguments().takeFirst();
+
+		//input files (up to the next command)
+		while (!cmd.arguments().empty() && !cmd.arguments().front().startsWith('-'))
+		{
+			params.filenames << cmd.arguments().takeFirst();
+		}
+		if (params.filenames.isEmpty())
+		{
+			return cmd.error(QObject::tr("Missing parameter: input filename(s) after \"-%1\"").arg(COMMAND_LAS_INGEST));
+		}
+
+		const ccCommandLineInterface::CLLoadParameters& loadParams = cmd.fileLoadingParams();
+		if (loadParams.m_coordinatesShiftEnabled)
+		{
+			params.autoShift = false;
+			params.globalShift = loadParams.m_coordinatesShift;
+		}
+
+		cmd.print(QObject::tr("Ingesting %1 file(s) into '%2'").arg(params.filenames.size()).arg(params.outputFilename));
+
+		LASStreamIngestor::Report report;
+		CC_FILE_ERROR result = LASStreamIngestor::Ingest(params, report, cmd.progressDialog());
+		if (result != CC_FERR_NO_ERROR)
+		{
+			FileIOFilter::DisplayErrorMessage(result, "ingesting", params.outputFilename);
+			return cmd.error(QObject::tr("LAS ingestion failed"));
+		}
+
+		cmd.print(QObject::tr("%L1 input points - %L2 points written in %3 tile(s)").arg(report.inputPointCount).arg(report.outputPointCount).arg(report.tileCount));
+		cmd.print(QObject::tr("Global shift: (%1 ; %2 ; %3)").arg(report.globalShift.x, 0, 'f', 3).arg(report.globalShift.y, 0, 'f', 3).arg(report.globalShift.z, 0, 'f', 3));
+		cmd.print(QObject::tr("Throughput: %L1 points/s (decoding) - %L2 points/s (overall)").arg(static_cast<qint64>(report.decodingThroughput())).arg(static_cast<qint64>(report.overallThroughput())));
+
+		if (!coordinatesShiftWasEnabled)
+		{
+			//store semi-persistent parameters
+			cmd.storeCoordinatesShiftParams();
+		}
+
+		if (previewPointCount != 0)
+		{
+			ccOutOfCoreCloud store;
+			if (!store.open(params.outputFilename))
+			{
+				return cmd.error(QObject::tr("Failed to open the store '%1'").arg(params.outputFilename));
+			}
+			ccPointCloud* preview = store.createPreview(previewPointCount);
+			if (!preview)
+			{
+				return cmd.error(QObject::tr("Not enough memory"));
+			}
+			cmd.clouds().emplace_back(CLCloudDesc(preview, params.outputFilename, 0));
+		}
+
+		return true;
+	}
+};
+
+#endif //PDAL_IO_PLUGIN_COMMANDS_HEADER
@@ -0,0 +1,620 @@
+//##########################################################################
+//#                                                                        #
+//#                              CLOUDCOMPARE                              #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                    COPYRIGHT: CloudCompare project                     #
+//#                                                                        #
+//##########################################################################
+
+#include "LASStreamIngestor.h"
+
+//qCC_db
+#include <ccLog.h>
+#include <ccOutOfCoreCloud.h>
+
+//CCCoreLib
+#include <GenericProgressCallback.h>
+#include <TaskScheduler.h>
+
+//Qt
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+
+//pdal
+#include <pdal/Options.hpp>
+#include <pdal/PointTable.hpp>
+#include <pdal/io/LasHeader.hpp>
+#include <pdal/io/LasReader.hpp>
+#include <pdal/filters/StreamCallbackFilter.hpp>
+
+//System
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <mutex>
+
+using namespace pdal;
+
+//! Max number of scalar fields (see LASStreamIngestor::Parameters::scalarFields)
+static const unsigned c_maxSFCount = 7;
+//! Octree level of the Morton codes
+static const unsigned c_codeLevel = 21;
+//! Target number of points per tile (automatic tile level)
+static const qint64 c_tileTargetSize = (1 << 20);
+//! Max octree level of the tiles
+static const int c_maxTileLevel = 7;
+//! Number of locks shared by the tile files (a tile is always guarded by the same lock)
+static const size_t c_tileLockCount = 256;
+
+//! Point record (in the tile files)
+struct IngestedPoint
+{
+	//! Morton code (octree order)
+	uint64_t code;
+	//! Global index (input order, to sort the points with identical codes)
+	qint64 index;
+	//! Local coordinates
+	CCVector3 P;
+	//! Color (16 bits per component, as in the LAS files)
+	uint16_t rgb[3];
+	//! Scalar values
+	ScalarType values[c_maxSFCount];
+};
+
+//! Octree order (the input order is kept for identical codes)
+static inline bool IngestedPointLess(const IngestedPoint& a, const IngestedPoint& b)
+{
+	return (a.code < b.code || (a.code == b.code && a.index < b.index));
+}
+
+//! Input file
+struct IngestedFile
+{
+	QString filename;
+	qint64 pointCount = 0;
+	qint64 firstPointIndex = 0;
+	uint8_t pointFormat = 0;
+};
+
+//! Range of points of a file (decoded by a single pipeline)
+struct IngestedRange
+{
+	unsigned fileIndex = 0;
+	qint64 start = 0;
+	qint64 count = 0;
+};
+
+//! Returns the PDAL dimension of a (supported) standard field
+static Dimension::Id ScalarFieldId(LAS_FIELDS field)
+{
+	switch (field)
+	{
+	case LAS_INTENSITY:
+		return Dimension::Id::Intensity;
+	case LAS_RETURN_NUMBER:
+		return Dimension::Id::ReturnNumber;
+	case LAS_NUMBER_OF_RETURNS:
+		return Dimension::Id::NumberOfReturns;
+	case LAS_CLASSIFICATION:
+		return Dimension::Id::Classification;
+	case LAS_SCAN_ANGLE_RANK:
+		return Dimension::Id::ScanAngleRank;
+	case LAS_USER_DATA:
+		return Dimension::Id::UserData;
+	case LAS_POINT_SOURCE_ID:
+		return Dimension::Id::PointSourceId;
+	default:
+		return Dimension::Id::Unknown;
+	}
+}
+
+//! Spreads the 21 first bits of a value (one bit out of three)
+static inline uint64_t SpreadBits(uint32_t value)
+{
+	uint64_t x = value & 0x1FFFFF;
+	x = (x | (x << 32)) & 0x001F00000000FFFFULL;
+	x = (x | (x << 16)) & 0x001F0000FF0000FFULL;
+	x = (x | (x <<  8)) & 0x100F00F00F00F00FULL;
+	x = (x | (x <<  4)) & 0x10C30C30C30C30C3ULL;
+	x = (x | (x <<  2)) & 0x1249249249249249ULL;
+	return x;
+}
+
+//! Returns the tile file of a given tile
+static QString TileFilename(const QTemporaryDir& tempDir, uint64_t tileCode)
+{
+	return tempDir.filePath(QString("tile_%1.tmp").arg(tileCode, 0, 16));
+}
+
+CC_FILE_ERROR LASStreamIngestor::Ingest(const Parameters& parameters, Report& report, CCCoreLib::GenericProgressCallback* progressCb/*=nullptr*/)
+{
+	report = Report();
+
+	if (parameters.filenames.isEmpty() || parameters.outputFilename.isEmpty() || parameters.rangeSize == 0)
+	{
+		return CC_FERR_BAD_ARGUMENT;
+	}
+
+	std::vector<LAS_FIELDS> sfFields;
+	QStringList sfNames;
+	for (LAS_FIELDS field : parameters.scalarFields)
+	{
+		if (ScalarFieldId(field) == Dimension::Id::Unknown || sfFields.size() == c_maxSFCount)
+		{
+			ccLog::Warning(QString("[LAS] Field '%1' can't be ingested (ignored)").arg(field < LAS_INVALID ? LAS_FIELD_NAMES[field] : "invalid"));
+			continue;
+		}
+		sfFields.push_back(field);
+		sfNames << LAS_FIELD_NAMES[field];
+	}
+
+	//classes to keep
+	bool filterClasses = !parameters.classes.empty();
+	std::vector<bool> keepClass(256, !filterClasses);
+	for (int c : parameters.classes)
+	{
+		if (c >= 0 && c < 256)
+			keepClass[c] = true;
+	}
+
+	unsigned decimationStep = std::max(1u, parameters.decimationStep);
+
+	QElapsedTimer timer;
+	timer.start();
+
+	//read the headers
+	std::vector<IngestedFile> files;
+	std::vector<IngestedRange> ranges;
+	CCVector3d bbMin, bbMax;
+	bool hasColors = false;
+	try
+	{
+		for (const QString& filename : parameters.filenames)
+		{
+			Options options;
+			options.add("filename", filename.toStdString());
+			LasReader reader;
+			reader.setOptions(options);
+			FixedPointTable table(100);
+			reader.prepare(table);
+			const LasHeader& header = reader.header();
+
+			IngestedFile file;
+			file.filename = filename;
+			file.pointCount = static_cast<qint64>(header.pointCount());
+			file.firstPointIndex = report.inputPointCount;
+			file.pointFormat = header.pointFormat();
+			if (file.pointCount == 0)
+			{
+				ccLog::Warning(QString("[LAS] File '%1' is empty").arg(filename));
+				continue;
+			}
+
+			CCVector3d fileMin(header.minX(), header.minY(), header.minZ());
+			CCVector3d fileMax(header.maxX(), header.maxY(), header.maxZ());
+			if (files.empty())
+			{
+				bbMin = fileMin;
+				bbMax = fileMax;
+			}
+			else
+			{
+				bbMin = CCVector3d(std::min(bbMin.x, fileMin.x), std::min(bbMin.y, fileMin.y), std::min(bbMin.z, fileMin.z));
+				bbMax = CCVector3d(std::max(bbMax.x, fileMax.x), std::max(bbMax.y, fileMax.y), std::max(bbMax.z, fileMax.z));
+			}
+
+			//point formats with colors
+			switch (file.pointFormat)
+			{
+			case 2:
+			case 3:
+			case 5:
+			case 7:
+			case 8:
+			case 10:
+				hasColors = parameters.loadColors;
+				break;
+			default:
+				break;
+			}
+
+			for (qint64 start = 0; start < file.pointCount; start += parameters.rangeSize)
+			{
+				IngestedRange range;
+				range.fileIndex = static_cast<unsigned>(files.size());
+				range.start = start;
+				range.count = std::min<qint64>(parameters.rangeSize, file.pointCount - start);
+				ranges.push_back(range);
+			}
+
+			report.inputPointCount += file.pointCount;
+			files.push_back(file);
+		}
+	}
+	catch (const pdal_error& e)
+	{
+		ccLog::Warning(QString("[LAS] PDAL exception: %1").arg(e.what()));
+		return CC_FERR_THIRD_PARTY_LIB_FAILURE;
+	}
+	catch (const std::bad_alloc&)
+	{
+		return CC_FERR_NOT_ENOUGH_MEMORY;
+	}
+
+	if (files.empty())
+	{
+		return CC_FERR_NO_LOAD;
+	}
+	if (report.inputPointCount / decimationStep >= static_cast<qint64>(std::numeric_limits<unsigned>::max()))
+	{
+		ccLog::Warning("[LAS] Too many points for a single store (use decimation or class filters)");
+		return CC_FERR_BAD_ARGUMENT;
+	}
+
+	//global shift
+	CCVector3d shift = parameters.globalShift;
+	if (parameters.autoShift)
+	{
+		shift = CCVector3d(0, 0, 0);
+		if (ccGlobalShiftManager::NeedShift(bbMin) || ccGlobalShiftManager::NeedShift(bbMax))
+		{
+			shift = ccGlobalShiftManager::BestShift(bbMin);
+		}
+	}
+	report.globalShift = shift;
+
+	//octree of the global bounding-box (local coordinates)
+	CCVector3d localMin = bbMin + shift;
+	double boxSize = std::max(bbMax.x - bbMin.x, std::max(bbMax.y - bbMin.y, bbMax.z - bbMin.z));
+	double cellSize = std::max(boxSize, 1.0e-6) / (1 << c_codeLevel);
+
+	int tileLevel = parameters.tileLevel;
+	if (tileLevel < 0)
+	{
+		tileLevel = 0;
+		while (tileLevel < c_maxTileLevel && ((report.inputPointCount / decimationStep) >> (3 * tileLevel)) > c_tileTargetSize)
+		{
+			++tileLevel;
+		}
+	}
+	tileLevel = std::min(tileLevel, c_maxTileLevel);
+	const unsigned tileBitShift = 3 * (c_codeLevel - static_cast<unsigned>(tileLevel));
+
+	//temporary tile files (next to the output store)
+	QTemporaryDir tempDir(QFileInfo(parameters.outputFilename).absoluteDir().filePath(".las_ingestion_XXXXXX"));
+	if (!tempDir.isValid())
+	{
+		ccLog::Warning("[LAS] Failed to create the temporary folder");
+		return CC_FERR_WRITING;
+	}
+
+	int threadCount = (parameters.maxThreadCount > 0 ? parameters.maxThreadCount : CCCoreLib::TaskScheduler::IdealThreadCount());
+	CCCoreLib::TaskScheduler scheduler(threadCount);
+
+	//first pass: the ranges are decoded in parallel and dispatched in the tiles
+	if (progressCb)
+	{
+		if (progressCb->textCanBeEdited())
+		{
+			progressCb->setMethodTitle("LAS ingestion");
+			progressCb->setInfo(qPrintable(QString("Decoding %1 file(s) (%L2 points)").arg(files.size()).arg(report.inputPointCount)));
+		}
+		progressCb->update(0);
+		progressCb->start();
+	}
+	CCCoreLib::NormalizedProgress nProgress(progressCb, static_cast<unsigned>(ranges.size()));
+
+	std::map<uint64_t, qint64> tileSizes;
+	std::vector<std::mutex> tileMutexes(c_tileLockCount);
+	std::mutex sharedMutex; //tile sizes and error
+	std::atomic<bool> colorsOn16Bits(false);
+	CC_FILE_ERROR error = CC_FERR_NO_ERROR;
+
+	bool decoded = scheduler.run(static_cast<unsigned>(ranges.size()), [&](unsigned rangeIndex)
+	{
+		const IngestedRange& range = ranges[rangeIndex];
+		const IngestedFile& file = files[range.fileIndex];
+
+		std::vector<IngestedPoint> points;
+		try
+		{
+			points.reserve(static_cast<size_t>(range.count / decimationStep + 1));
+
+			Options options;
+			options.add("filename", file.filename.toStdString());
+			options.add("start", range.start);
+			options.add("count", range.count);
+			LasReader reader;
+			reader.setOptions(options);
+
+			std::vector<Dimension::Id> sfIds;
+			for (LAS_FIELDS field : sfFields)
+			{
+				sfIds.push_back(ScalarFieldId(field));
+			}
+
+			qint64 pointIndex = file.firstPointIndex + range.start;
+			qint64 lastPointIndex = pointIndex + range.count;
+			bool has16BitColors = false;
+			StreamCallbackFilter filter;
+			filter.setInput(reader);
+			filter.setCallback([&](PointRef& point)
+			{
+				qint64 index = pointIndex++;
+				if (index >= lastPointIndex || (index % decimationStep) != 0)
+				{
+					return false;
+				}
+
+				if (filterClasses)
+				{
+					int classification = point.getFieldAs<int>(Dimension::Id::Classification);
+					if (file.pointFormat <= 5)
+						classification &= 31; //bit #0-4 of the 'Classification' field
+					if (!keepClass[classification & 255])
+					{
+						return false;
+					}
+				}
+
+				IngestedPoint P;
+				P.index = index;
+				CCVector3d Plocal(	point.getFieldAs<double>(Dimension::Id::X) + shift.x,
+									point.getFieldAs<double>(Dimension::Id::Y) + shift.y,
+									point.getFieldAs<double>(Dimension::Id::Z) + shift.z );
+				P.P = CCVector3::fromArray(Plocal.u);
+
+				uint32_t cell[3];
+				for (unsigned d = 0; d < 3; ++d)
+				{
+					double c = std::floor((Plocal.u[d] - localMin.u[d]) / cellSize);
+					cell[d] = static_cast<uint32_t>(std::min(std::max(c, 0.0), static_cast<double>((1 << c_codeLevel) - 1)));
+				}
+				P.code = SpreadBits(cell[0]) | (SpreadBits(cell[1]) << 1) | (SpreadBits(cell[2]) << 2);
+
+				if (hasColors)
+				{
+					P.rgb[0] = point.getFieldAs<uint16_t>(Dimension::Id::Red);
+					P.rgb[1] = point.getFieldAs<uint16_t>(Dimension::Id::Green);
+					P.rgb[2] = point.getFieldAs<uint16_t>(Dimension::Id::Blue);
+					has16BitColors |= ((P.rgb[0] | P.rgb[1] | P.rgb[2]) & 0xFF00) != 0;
+				}
+				else
+				{
+					P.rgb[0] = P.rgb[1] = P.rgb[2] = 0;
+				}
+
+				for (size_t i = 0; i < sfIds.size(); ++i)
+				{
+					P.values[i] = point.getFieldAs<ScalarType>(sfIds[i]);
+				}
+
+				points.push_back(P);
+				return true;
+			});
+
+			FixedPointTable table(1000);
+			filter.prepare(table);
+			filter.execute(table);
+
+			if (has16BitColors)
+			{
+				colorsOn16Bits = true;
+			}
+		}
+		catch (const pdal_error& e)
+		{
+			ccLog::Warning(QString("[LAS] PDAL exception ('%1'): %2").arg(file.filename).arg(e.what()));
+			std::lock_guard<std::mutex> lock(sharedMutex);
+			error = CC_FERR_THIRD_PARTY_LIB_FAILURE;
+			return false;
+		}
+		catch (const std::bad_alloc&)
+		{
+			std::lock_guard<std::mutex> lock(sharedMutex);
+			error = CC_FERR_NOT_ENOUGH_MEMORY;
+			return false;
+		}
+
+		//the points are sorted in the octree order, then each tile is appended to its file
+		//(only the ranges appending to the same tile wait for each other)
+		std::sort(points.begin(), points.end(), IngestedPointLess);
+
+		std::vector< std::pair<uint64_t, qint64> > rangeTileSizes;
+		for (size_t first = 0; first < points.size();)
+		{
+			uint64_t tileCode = (points[first].code >> tileBitShift);
+			size_t last = first + 1;
+			while (last < points.size() && (points[last].code >> tileBitShift) == tileCode)
+			{
+				++last;
+			}
+
+			{
+				std::lock_guard<std::mutex> tileLock(tileMutexes[tileCode % c_tileLockCount]);
+				QFile tileFile(TileFilename(tempDir, tileCode));
+				qint64 byteCount = static_cast<qint64>((last - first) * sizeof(IngestedPoint));
+				if (!tileFile.open(QFile::WriteOnly | QFile::Append) || tileFile.write(reinterpret_cast<const char*>(points.data() + first), byteCount) != byteCount)
+				{
+					std::lock_guard<std::mutex> lock(sharedMutex);
+					error = CC_FERR_WRITING;
+					return false;
+				}
+			}
+			rangeTileSizes.emplace_back(tileCode, static_cast<qint64>(last - first));
+
+			first = last;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(sharedMutex);
+			for (const auto& tile : rangeTileSizes)
+			{
+				tileSizes[tile.first] += tile.second;
+			}
+		}
+
+		return nProgress.oneStep();
+	},
+	[&](unsigned rangeIndex) { return static_cast<unsigned>(ranges[rangeIndex].count); },
+	progressCb);
+
+	if (progressCb)
+	{
+		progressCb->stop();
+	}
+
+	report.decodingTime = timer.nsecsElapsed() / 1.0e9;
+
+	if (!decoded)
+	{
+		return (error != CC_FERR_NO_ERROR ? error : CC_FERR_CANCELED_BY_USER);
+	}
+
+	//second pass: the tiles are sorted (in parallel) and written in the octree order
+	timer.restart();
+
+	std::vector<uint64_t> tileCodes;
+	qint64 outputPointCount = 0;
+	try
+	{
+		tileCodes.reserve(tileSizes.size());
+		for (const auto& tile : tileSizes)
+		{
+			tileCodes.push_back(tile.first); //std::map: sorted by code
+			outputPointCount += tile.second;
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		return CC_FERR_NOT_ENOUGH_MEMORY;
+	}
+
+	unsigned colorBitShift = (colorsOn16Bits && !parameters.forced8bitRgbMode ? 8 : 0);
+
+	ccOutOfCoreCloud::Writer writer;
+	if (!writer.open(parameters.outputFilename, hasColors, false, sfNames, shift))
+	{
+		return CC_FERR_WRITING;
+	}
+
+	if (progressCb)
+	{
+		if (progressCb->textCanBeEdited())
+		{
+			progressCb->setMethodTitle("LAS ingestion");
+			progressCb->setInfo(qPrintable(QString("Writing %1 tile(s) (%L2 points)").arg(tileCodes.size()).arg(outputPointCount)));
+		}
+		progressCb->update(0);
+		progressCb->start();
+	}
+	CCCoreLib::NormalizedProgress wProgress(progressCb, static_cast<unsigned>(tileCodes.size()));
+
+	bool written = true;
+	size_t batchSize = static_cast<size_t>(std::max(1, threadCount));
+	std::vector< std::vector<IngestedPoint> > batch(batchSize);
+	for (size_t batchStart = 0; batchStart < tileCodes.size() && written; batchStart += batchSize)
+	{
+		size_t batchCount = std::min(batchSize, tileCodes.size() - batchStart);
+
+		//load and sort the tiles of the batch in parallel
+		written = scheduler.run(static_cast<unsigned>(batchCount), [&](unsigned i)
+		{
+			uint64_t tileCode = tileCodes[batchStart + i];
+			std::vector<IngestedPoint>& points = batch[i];
+			try
+			{
+				points.resize(static_cast<size_t>(tileSizes.at(tileCode)));
+			}
+			catch (const std::bad_alloc&)
+			{
+				std::lock_guard<std::mutex> lock(sharedMutex);
+				error = CC_FERR_NOT_ENOUGH_MEMORY;
+				return false;
+			}
+
+			QFile tileFile(TileFilename(tempDir, tileCode));
+			qint64 byteCount = static_cast<qint64>(points.size() * sizeof(IngestedPoint));
+			if (!tileFile.open(QFile::ReadOnly) || tileFile.read(reinterpret_cast<char*>(points.data()), byteCount) != byteCount)
+			{
+				std::lock_guard<std::mutex> lock(sharedMutex);
+				error = CC_FERR_READING;
+				return false;
+			}
+			tileFile.close();
+			tileFile.remove();
+
+			//the ranges are appended in their completion order: the global index restores the input order for identical codes
+			std::sort(points.begin(), points.end(), IngestedPointLess);
+			return true;
+		},
+		[&](unsigned i) { return static_cast<unsigned>(std::min<qint64>(tileSizes.at(tileCodes[batchStart + i]), std::numeric_limits<unsigned>::max())); });
+
+		//write the tiles (in order)
+		for (size_t i = 0; i < batchCount && written; ++i)
+		{
+			std::vector<IngestedPoint>& points = batch[i];
+			for (const IngestedPoint& P : points)
+			{
+				ccColor::Rgba color(static_cast<ColorCompType>(P.rgb[0] >> colorBitShift),
+									static_cast<ColorCompType>(P.rgb[1] >> colorBitShift),
+									static_cast<ColorCompType>(P.rgb[2] >> colorBitShift),
+									ccColor::MAX);
+				if (!writer.addPoint(P.P, color, 0, P.values))
+				{
+					error = CC_FERR_WRITING;
+					written = false;
+					break;
+				}
+			}
+			points.clear();
+			points.shrink_to_fit();
+
+			if (written && !wProgress.oneStep())
+			{
+				written = false;
+			}
+		}
+	}
+
+	if (progressCb)
+	{
+		progressCb->stop();
+	}
+
+	if (!written || !writer.close())
+	{
+		QFile::remove(parameters.outputFilename);
+		return (error != CC_FERR_NO_ERROR ? error : (written ? CC_FERR_WRITING : CC_FERR_CANCELED_BY_USER));
+	}
+
+	report.writingTime = timer.nsecsElapsed() / 1.0e9;
+	report.outputPointCount = writer.size();
+	report.tileCount = static_cast<unsigned>(tileCodes.size());
+
+	ccLog::Print(QString("[LAS] Ingestion: %L1 points decoded in %2 s (%L3 points/s) - %L4 points written in %5 tiles (octree level %6) in %7 s - overall: %L8 points/s")
+					.arg(report.inputPointCount)
+					.arg(report.decodingTime, 0, 'f', 2)
+					.arg(static_cast<qint64>(report.decodingThroughput()))
+					.arg(report.outputPointCount)
+					.arg(report.tileCount)
+					.arg(tileLevel)
+					.arg(report.writingTime, 0, 'f', 2)
+					.arg(static_cast<qint64>(report.overallThroughput())));
+
+	return CC_FERR_NO_ERROR;
+}
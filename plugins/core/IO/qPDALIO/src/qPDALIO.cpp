@@ -18,6 +18,7 @@
 #include "qPDALIO.h"
 
 #include "LASFilter.h"
+#include "qPDALIOCommands.h"
 
 
 qPDALIO::qPDALIO( QObject *parent ) :
@@ -28,7 +29,7 @@ qPDALIO::qPDALIO( QObject *parent ) :
 
 void qPDALIO::registerCommands( ccCommandLineInterface *cmd )
 {
-	Q_UNUSED( cmd );
+	cmd->registerCommand( ccCommandLineInterface::Command::Shared( new CommandLASIngest ) );
 }
 
 ccIOPluginInterface::FilterList qPDALIO::getFilters()
@@ -35,6 +35,7 @@ class ccScalarField;
 namespace CCCoreLib {
 	class GenericProgressCallback;
 	class DgmOctree;
+	class NeighbourhoodCache;
 }
 
 //! Helper: pre-computed cos and sin values between 0 and Pi
@@ -78,6 +79,10 @@ public:
 	static size_t TestVectorsOverlap(const std::vector<float>& first, const std::vector<float>& second);
 
 	//! Computes the 'descriptors' for various scales on core points only
+	/** A neighbourhood cache (RADIUS) computed on the source cloud with a radius greater than or equal
+		to the biggest scale / 2 can be used instead of the octree, if the core points are the source
+		cloud itself or a subset of it (ReferenceCloud).
+	**/
 	static bool ComputeCorePointsDescriptors(	CCCoreLib::GenericIndexedCloud* corePoints,
 												CorePointDescSet& corePointsDescriptors,
 												ccGenericPointCloud* sourceCloud,
@@ -88,7 +93,8 @@ public:
 												int maxThreadCount = 0,
 												CCCoreLib::GenericProgressCallback* progressCb = nullptr,
 												CCCoreLib::DgmOctree* inputOctree = nullptr,
-												std::vector<ccScalarField*>* roughnessSFs = nullptr /*for tests*/); 
+												std::vector<ccScalarField*>* roughnessSFs = nullptr /*for tests*/,
+												const CCCoreLib::NeighbourhoodCache* cache = nullptr);
 
 	//! Returns a long description of a given entity (name + [ID])
 	static QString GetEntityName(ccHObject* obj);
@@ -23,7 +23,9 @@
 //CCCoreLib
 #include <DistanceComputationTools.h>
 #include <Neighbourhood.h>
+#include <NeighbourhoodCache.h>
 #include <ParallelSort.h>
+#include <ReferenceCloud.h>
 
 //qCC_db
 #include <ccPointCloud.h>
@@ -46,6 +48,8 @@ static struct
 	ccGenericPointCloud* sourceCloud;
 	CCCoreLib::DgmOctree* octree;
 	unsigned char octreeLevel;
+	const CCCoreLib::NeighbourhoodCache* cache; //used instead of the octree if set
+	CCCoreLib::ReferenceCloud* corePointsRef; //if the core points are a subset of the source cloud (only used with the cache)
 	CorePointDescSet* descriptors;
 	bool invalidDescriptors;
 
@@ -71,10 +75,21 @@ void ComputeCorePointDescriptor(unsigned index)
 
 	//extract the neighbors (maximum radius)
 	float maxRadius = s_computeCorePointsDescParams.descriptors->scales().front()/2;
-	int n = s_computeCorePointsDescParams.octree->getPointsInSphericalNeighbourhood(*P,
+	int n = 0;
+	if (s_computeCorePointsDescParams.cache)
+	{
+		//the neighbors are already known (and sorted)
+		unsigned sourceIndex = (s_computeCorePointsDescParams.corePointsRef ? s_computeCorePointsDescParams.corePointsRef->getPointGlobalIndex(index) : index);
+		const CCCoreLib::NeighbourhoodCache* cache = s_computeCorePointsDescParams.cache;
+		n = static_cast<int>(cache->getNeighbours(sourceIndex, cache->countInSphere(sourceIndex, maxRadius), neighbours));
+	}
+	else
+	{
+		n = s_computeCorePointsDescParams.octree->getPointsInSphericalNeighbourhood(*P,
 																				maxRadius,
 																				neighbours,
 																				s_computeCorePointsDescParams.octreeLevel);
+	}
 
 	if (n != 0)
 	{
@@ -212,7 +227,8 @@ bool qCanupoTools::ComputeCorePointsDescriptors(CCCoreLib::GenericIndexedCloud*
 												int maxThreadCount/*=0*/,
 												CCCoreLib::GenericProgressCallback* progressCb/*=0*/,
 												CCCoreLib::DgmOctree* inputOctree/*=0*/,
-												std::vector<ccScalarField*>* roughnessSFs/*=0*/)
+												std::vector<ccScalarField*>* roughnessSFs/*=0*/,
+												const CCCoreLib::NeighbourhoodCache* cache/*=nullptr*/)
 {
 	assert(corePoints && sourceCloud);
 	assert(!sortedScales.empty());
@@ -249,8 +265,30 @@ bool qCanupoTools::ComputeCorePointsDescriptors(CCCoreLib::GenericIndexedCloud*
 	corePointsDescriptors.setDescriptorID(descriptorID);
 	corePointsDescriptors.setDimPerScale(s_computeCorePointsDescParams.computer->dimPerScale());
 
+	PointCoordinateType biggestRadius = sortedScales.front()/2; //we extract the biggest neighborhood
+
+	//the cache can be used if it contains the biggest neighborhood of each core point
+	CCCoreLib::ReferenceCloud* corePointsRef = nullptr;
+	if (cache && cache->canProvideRadius(sourceCloud, biggestRadius))
+	{
+		if (corePoints != static_cast<CCCoreLib::GenericIndexedCloud*>(sourceCloud))
+		{
+			corePointsRef = dynamic_cast<CCCoreLib::ReferenceCloud*>(corePoints);
+			if (!corePointsRef || corePointsRef->getAssociatedCloud() != sourceCloud)
+			{
+				//the core points are not part of the source cloud
+				cache = nullptr;
+				corePointsRef = nullptr;
+			}
+		}
+	}
+	else
+	{
+		cache = nullptr;
+	}
+
 	CCCoreLib::DgmOctree* theOctree = inputOctree;
-	if (!theOctree)
+	if (!theOctree && !cache)
 	{
 		theOctree = new CCCoreLib::DgmOctree(sourceCloud);
 		if (theOctree->build(progressCb) == 0)
@@ -294,14 +332,15 @@ bool qCanupoTools::ComputeCorePointsDescriptors(CCCoreLib::GenericIndexedCloud*
 		return false;
 	}
 
-	PointCoordinateType biggestRadius = sortedScales.front()/2; //we extract the biggest neighborhood
-	unsigned char octreeLevel = theOctree->findBestLevelForAGivenNeighbourhoodSizeExtraction(biggestRadius);
+	unsigned char octreeLevel = (theOctree ? theOctree->findBestLevelForAGivenNeighbourhoodSizeExtraction(biggestRadius) : 0);
 
 	s_computeCorePointsDescParams.corePoints = corePoints;
 	s_computeCorePointsDescParams.descriptors = &corePointsDescriptors;
 	s_computeCorePointsDescParams.sourceCloud = sourceCloud;
 	s_computeCorePointsDescParams.octree = theOctree;
 	s_computeCorePointsDescParams.octreeLevel = octreeLevel;
+	s_computeCorePointsDescParams.cache = cache;
+	s_computeCorePointsDescParams.corePointsRef = corePointsRef;
 	s_computeCorePointsDescParams.nProgress = progressCb ? &nProgress : nullptr;
 	s_computeCorePointsDescParams.processCanceled = false;
 	s_computeCorePointsDescParams.errorOccurred = false;
@@ -367,6 +406,8 @@ bool qCanupoTools::ComputeCorePointsDescriptors(CCCoreLib::GenericIndexedCloud*
 	s_computeCorePointsDescParams.sourceCloud = nullptr;
 	s_computeCorePointsDescParams.octree = nullptr;
 	s_computeCorePointsDescParams.octreeLevel = 0;
+	s_computeCorePointsDescParams.cache = nullptr;
+	s_computeCorePointsDescParams.corePointsRef = nullptr;
 	s_computeCorePointsDescParams.nProgress = nullptr;
 	s_computeCorePointsDescParams.processCanceled = false;
 	s_computeCorePointsDescParams.errorOccurred = false;
@@ -0,0 +1,488 @@
+//##########################################################################
+//#                                                                        #
+//#                       CLOUDCOMPARE PLUGIN: Libpointmatcher             #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#            COPYRIGHT: UNIVERSITE EUROPEENNE DE BRETAGNE                #
+//#                                                                        #
+//##########################################################################
+
+#ifndef LIBPOINTMATCHER_PLUGIN_COMMANDS_HEADER
+#define LIBPOINTMATCHER_PLUGIN_COMMANDS_HEADER
+
+//CloudCompare
+#include "ccCommandLineInterface.h"
+
+//Local
+#include "LibpointmatcherConvergence.h"
+#include "LibpointmatcherProcess.h"
+#include "LibpointmatcherTools.h"
+
+//qCC_db
+#include <ccPointCloud.h>
+#include <ccScalarField.h>
+
+//Qt
+#include <QDateTime>
+#include <QFile>
+#include <QTextStream>
+
+//system
+#include <algorithm>
+#include <fstream>
+
+/** The configuration files use the libpointmatcher YAML syntax (JSON being a subset
+	of YAML, JSON files are accepted as well):
+	- LPM_SUBSAMPLE expects a filter chain (list of 'DataPointsFilters')
+	- LPM_ICP and LPM_CONVERGENCE expect an ICP chain ('readingDataPointsFilters',
+	'referenceDataPointsFilters', 'matcher', 'outlierFilters', 'errorMinimizer', etc.)
+**/
+static const char COMMAND_LPM_SUBSAMPLE[] = "LPM_SUBSAMPLE";
+static const char COMMAND_LPM_ICP[] = "LPM_ICP";
+static const char COMMAND_LPM_CONVERGENCE[] = "LPM_CONVERGENCE";
+static const char COMMAND_LPM_USE_NORMALS[] = "USE_NORMALS";
+static const char COMMAND_LPM_REFERENCE_IS_FIRST[] = "REFERENCE_IS_FIRST";
+static const char COMMAND_LPM_PADDING[] = "PADDING";
+static const char COMMAND_LPM_MAX_THREAD_COUNT[] = "MAX_THREAD_COUNT";
+static const char COMMAND_LPM_M3C2_CYLINDER[] = "M3C2_CYLINDER";
+static const char COMMAND_LPM_M3C2_MEDIAN[] = "M3C2_MEDIAN";
+
+//! Opens a libpointmatcher configuration file
+static bool OpenLPMConfigFile(ccCommandLineInterface& cmd, const char* command, std::ifstream& stream)
+{
+	if (cmd.arguments().empty())
+	{
+		return cmd.error(QObject::tr("Missing parameter: configuration filename after \"-%1\"").arg(command));
+	}
+
+	QString configFilename(cmd.arguments().takeFirst());
+	cmd.print(QObject::tr("Configuration file: '%1'").arg(configFilename));
+
+	stream.open(QFile::encodeName(configFilename).constData());
+	if (!stream.is_open())
+	{
+		return cmd.error(QObject::tr("Failed to open configuration file '%1'").arg(configFilename));
+	}
+
+	return true;
+}
+
+//! Loads an ICP chain from a libpointmatcher configuration file
+static bool LoadLPMICPChain(ccCommandLineInterface& cmd, const char* command, PM::ICP& icp)
+{
+	std::ifstream stream;
+	if (!OpenLPMConfigFile(cmd, command, stream))
+	{
+		return false;
+	}
+
+	try
+	{
+		icp.loadFromYaml(stream);
+	}
+	catch (const std::exception& e)
+	{
+		return cmd.error(QObject::tr("Invalid configuration file: %1").arg(e.what()));
+	}
+
+	return true;
+}
+
+//! Converts a cloud to the libpointmatcher format (with its normals if requested)
+static DP ToLPMCloud(ccPointCloud* cloud, bool useNormals)
+{
+	return (useNormals && cloud->hasNormals())	? LibpointmatcherTools::ccNormalsToPointMatcher(cloud)
+												: LibpointmatcherTools::ccToPointMatcher(cloud);
+}
+
+struct CommandLPMSubsample : public ccCommandLineInterface::Command
+{
+	CommandLPMSubsample() : ccCommandLineInterface::Command("Libpointmatcher subsampling", COMMAND_LPM_SUBSAMPLE) {}
+
+	virtual bool process(ccCommandLineInterface& cmd) override
+	{
+		cmd.print("[LIBPOINTMATCHER]");
+
+		std::ifstream stream;
+		if (!OpenLPMConfigFile(cmd, COMMAND_LPM_SUBSAMPLE, stream))
+		{
+			return false;
+		}
+
+		bool useNormals = false;
+		if (!cmd.arguments().empty() && ccCommandLineInterface::IsCommand(cmd.arguments().front(), COMMAND_LPM_USE_NORMALS))
+		{
+			cmd.arguments().pop_front();
+			useNormals = true;
+		}
+
+		PM::DataPointsFilters filters;
+		try
+		{
+			filters = PM::DataPointsFilters(stream);
+		}
+		catch (const std::exception& e)
+		{
+			return cmd.error(QObject::tr("Invalid configuration file: %1").arg(e.what()));
+		}
+
+		if (cmd.clouds().empty())
+		{
+			return cmd.error(QObject::tr("No point cloud to subsample (be sure to open one with \"-O [cloud filename]\" before \"-%1\")").arg(COMMAND_LPM_SUBSAMPLE));
+		}
+
+		for (size_t i = 0; i < cmd.clouds().size(); ++i)
+		{
+			ccPointCloud* cloud = cmd.clouds()[i].pc;
+			cmd.print(QObject::tr("\tProcessing cloud #%1 (%2)").arg(i + 1).arg(!cloud->getName().isEmpty() ? cloud->getName() : "no name"));
+
+			DP convertedCloud = (useNormals && cloud->hasNormals())	? LibpointmatcherTools::ccNormalsToPointMatcherSubsample(cloud)
+																	: LibpointmatcherTools::ccToPointMatcherSubsample(cloud);
+			try
+			{
+				filters.apply(convertedCloud);
+			}
+			catch (const std::exception& e)
+			{
+				return cmd.error(QObject::tr("Subsampling process failed: %1").arg(e.what()));
+			}
+
+			CCCoreLib::ReferenceCloud* refCloud = LibpointmatcherTools::pointmatcherToCCSubsample(&convertedCloud, cloud);
+			if (!refCloud)
+			{
+				return cmd.error(QObject::tr("Subsampling process failed!"));
+			}
+			if (refCloud->size() == 0)
+			{
+				//nothing was removed (or everything was)
+				cmd.warning(QObject::tr("\tCloud left unchanged"));
+				delete refCloud;
+				continue;
+			}
+			cmd.print(QObject::tr("\tResult: %1 points").arg(refCloud->size()));
+
+			//save output
+			ccPointCloud* result = cloud->partialClone(refCloud);
+			delete refCloud;
+			refCloud = nullptr;
+
+			if (!result)
+			{
+				return cmd.error(QObject::tr("Not enough memory!"));
+			}
+
+			result->setName(cloud->getName() + QObject::tr(".subsample"));
+			if (cmd.autoSaveMode())
+			{
+				CLCloudDesc cloudDesc(result, cmd.clouds()[i].basename, cmd.clouds()[i].path, cmd.clouds()[i].indexInFile);
+				QString errorStr = cmd.exportEntity(cloudDesc, "LPM_SUBSAMPLED");
+				if (!errorStr.isEmpty())
+				{
+					delete result;
+					return cmd.error(errorStr);
+				}
+			}
+			//replace current cloud by this one
+			delete cmd.clouds()[i].pc;
+			cmd.clouds()[i].pc = result;
+			cmd.clouds()[i].basename += QObject::tr("_LPM_SUBSAMPLED");
+		}
+
+		return true;
+	}
+};
+
+struct CommandLPMICP : public ccCommandLineInterface::Command
+{
+	CommandLPMICP() : ccCommandLineInterface::Command("Libpointmatcher ICP", COMMAND_LPM_ICP) {}
+
+	virtual bool process(ccCommandLineInterface& cmd) override
+	{
+		cmd.print("[LIBPOINTMATCHER ICP]");
+
+		PM::ICP icp;
+		if (!LoadLPMICPChain(cmd, COMMAND_LPM_ICP, icp))
+		{
+			return false;
+		}
+
+		bool useNormals = false;
+		bool referenceIsFirst = false;
+		while (!cmd.arguments().empty())
+		{
+			const QString& ARGUMENT = cmd.arguments().front();
+			if (ccCommandLineInterface::IsCommand(ARGUMENT, COMMAND_LPM_USE_NORMALS))
+			{
+				cmd.arguments().pop_front();
+				useNormals = true;
+			}
+			else if (ccCommandLineInterface::IsCommand(ARGUMENT, COMMAND_LPM_REFERENCE_IS_FIRST))
+			{
+				cmd.arguments().pop_front();
+				referenceIsFirst = true;
+			}
+			else
+			{
+				break;
+			}
+		}
+
+		if (cmd.clouds().size() < 2)
+		{
+			return cmd.error(QObject::tr("Not enough clouds loaded (2 are expected: data and reference)"));
+		}
+
+		//data first, reference next
+		CLCloudDesc* dataDesc = &cmd.clouds()[0];
+		CLCloudDesc* refDesc = &cmd.clouds()[1];
+		if (referenceIsFirst)
+		{
+			std::swap(dataDesc, refDesc);
+		}
+
+		PM::TransformationParameters T;
+		try
+		{
+			T = icp(ToLPMCloud(dataDesc->pc, useNormals), ToLPMCloud(refDesc->pc, useNormals));
+		}
+		catch (const std::exception& e)
+		{
+			return cmd.error(QObject::tr("ICP failed: %1").arg(e.what()));
+		}
+
+		ccGLMatrixd transMatd = LibpointmatcherProcess::convertingOutputMatrix(T);
+		ccGLMatrix transMat(transMatd.data());
+		dataDesc->pc->applyGLTransformation_recursive(&transMat);
+		cmd.print(QObject::tr("Entity '%1' has been registered").arg(dataDesc->pc->getName()));
+
+		//save matrix in a separate text file
+		{
+			QString txtFilename = QObject::tr("%1/%2_LPM_REGISTRATION_MATRIX").arg(dataDesc->path, dataDesc->basename);
+			if (cmd.addTimestamp())
+				txtFilename += QObject::tr("_%1").arg(QDateTime::currentDateTime().toString("yyyy-MM-dd_hh'h'mm"));
+			txtFilename += QObject::tr(".txt");
+			QFile txtFile(txtFilename);
+			if (txtFile.open(QIODevice::WriteOnly | QIODevice::Text))
+			{
+				QTextStream txtStream(&txtFile);
+				txtStream << transMatd.toString(cmd.numericalPrecision(), ' ') << endl;
+			}
+			else
+			{
+				cmd.warning(QObject::tr("Failed to save the registration matrix to '%1'").arg(txtFilename));
+			}
+		}
+
+		dataDesc->basename += QObject::tr("_LPM_REGISTERED");
+		if (cmd.autoSaveMode())
+		{
+			QString errorStr = cmd.exportEntity(*dataDesc);
+			if (!errorStr.isEmpty())
+			{
+				return cmd.error(errorStr);
+			}
+		}
+
+		return true;
+	}
+};
+
+struct CommandLPMConvergence : public ccCommandLineInterface::Command
+{
+	CommandLPMConvergence() : ccCommandLineInterface::Command("Libpointmatcher convergence", COMMAND_LPM_CONVERGENCE) {}
+
+	virtual bool process(ccCommandLineInterface& cmd) override
+	{
+		cmd.print("[LIBPOINTMATCHER CONVERGENCE]");
+
+		PM::ICP icp;
+		if (!LoadLPMICPChain(cmd, COMMAND_LPM_CONVERGENCE, icp))
+		{
+			return false;
+		}
+
+		LibpointmatcherConvergence::Parameters params;
+		params.filtersRef.assign(icp.referenceDataPointsFilters.begin(), icp.referenceDataPointsFilters.end());
+		params.filtersRead.assign(icp.readingDataPointsFilters.begin(), icp.readingDataPointsFilters.end());
+		params.matcher = icp.matcher;
+		params.outlierFilters.assign(icp.outlierFilters.begin(), icp.outlierFilters.end());
+		params.errorMinimizer = icp.errorMinimizer;
+		params.checkers.assign(icp.transformationCheckers.begin(), icp.transformationCheckers.end());
+
+		bool computeM3C2 = false;
+		LibpointmatcherProcess::M3C2Options m3c2Options;
+
+		while (!cmd.arguments().empty())
+		{
+			const QString& ARGUMENT = cmd.arguments().front();
+			if (ccCommandLineInterface::IsCommand(ARGUMENT, COMMAND_LPM_USE_NORMALS))
+			{
+				cmd.arguments().pop_front();
+				params.useExistingNormalsRef = params.useExistingNormalsRead = true;
+			}
+			else if (ccCommandLineInterface::IsCommand(ARGUMENT, COMMAND_LPM_PADDING))
+			{
+				cmd.arguments().pop_front();
+				bool ok = false;
+				params.refPadding = cmd.arguments().isEmpty() ? 0.0f : cmd.arguments().takeFirst().toFloat(&ok);
+				if (!ok || params.refPadding < 0)
+				{
+					return cmd.error(QObject::tr("Invalid parameter: value after \"-%1\"").arg(COMMAND_LPM_PADDING));
+				}
+			}
+			else if (ccCommandLineInterface::IsCommand(ARGUMENT, COMMAND_LPM_MAX_THREAD_COUNT))
+			{
+				cmd.arguments().pop_front();
+				bool ok = false;
+				params.maxThreadCount = cmd.arguments().isEmpty() ? 0 : cmd.arguments().takeFirst().toInt(&ok);
+				if (!ok || params.maxThreadCount < 0)
+				{
+					return cmd.error(QObject::tr("Invalid parameter: value after \"-%1\"").arg(COMMAND_LPM_MAX_THREAD_COUNT));
+				}
+				m3c2Options.maxThreadCount = params.maxThreadCount;
+			}
+			else if (ccCommandLineInterface::IsCommand(ARGUMENT, COMMAND_LPM_M3C2_CYLINDER))
+			{
+				cmd.arguments().pop_front();
+				bool okDiameter = false;
+				bool okHalfHeight = false;
+				if (cmd.arguments().size() >= 2)
+				{
+					m3c2Options.cylDiameter = cmd.arguments().takeFirst().toDouble(&okDiameter);
+					m3c2Options.cylHalfHeight = cmd.arguments().takeFirst().toDouble(&okHalfHeight);
+				}
+				if (!okDiameter || !okHalfHeight || m3c2Options.cylDiameter <= 0 || m3c2Options.cylHalfHeight <= 0)
+				{
+					return cmd.error(QObject::tr("Invalid parameters: diameter and half height expected after \"-%1\"").arg(COMMAND_LPM_M3C2_CYLINDER));
+				}
+				computeM3C2 = true;
+			}
+			else if (ccCommandLineInterface::IsCommand(ARGUMENT, COMMAND_LPM_M3C2_MEDIAN))
+			{
+				cmd.arguments().pop_front();
+				m3c2Options.useMedian = true;
+			}
+			else
+			{
+				break;
+			}
+		}
+
+		if (cmd.clouds().size() < 2)
+		{
+			return cmd.error(QObject::tr("Not enough clouds loaded (the reference first, then at least one slice)"));
+		}
+
+		CLCloudDesc& refDesc = cmd.clouds()[0];
+		std::vector<ccPointCloud*> slices;
+		for (size_t i = 1; i < cmd.clouds().size(); ++i)
+		{
+			slices.push_back(cmd.clouds()[i].pc);
+		}
+		cmd.print(QObject::tr("Reference: '%1' - %2 slice(s)").arg(refDesc.pc->getName()).arg(slices.size()));
+
+		//the transformations are streamed to this file as soon as each slice is registered
+		QString txtFilename = QObject::tr("%1/%2_LPM_CONVERGENCE").arg(refDesc.path, refDesc.basename);
+		if (cmd.addTimestamp())
+			txtFilename += QObject::tr("_%1").arg(QDateTime::currentDateTime().toString("yyyy-MM-dd_hh'h'mm"));
+		txtFilename += QObject::tr(".txt");
+		QFile txtFile(txtFilename);
+		if (!txtFile.open(QIODevice::WriteOnly | QIODevice::Text))
+		{
+			return cmd.error(QObject::tr("Failed to open file '%1' for writing").arg(txtFilename));
+		}
+		QTextStream txtStream(&txtFile);
+		txtStream << "//slice name preparation_s icp_s read_points ref_points M3C2_mean M3C2_std_dev M3C2_valid_count m00 m01 m02 m03 m10 m11 m12 m13 m20 m21 m22 m23 m30 m31 m32 m33" << endl;
+
+		LibpointmatcherConvergence engine(params);
+		QString errorMessage;
+		if (!engine.setReference(refDesc.pc, errorMessage))
+		{
+			return cmd.error(errorMessage);
+		}
+
+		auto onSliceRegistered = [&](size_t sliceIndex, const ccGLMatrixd& Tabsolute, const LibpointmatcherConvergence::SliceTiming& timing) -> bool
+		{
+			CLCloudDesc& sliceDesc = cmd.clouds()[sliceIndex + 1];
+
+			ccGLMatrix transMat(Tabsolute.data());
+			sliceDesc.pc->applyGLTransformation_recursive(&transMat);
+			sliceDesc.basename += QObject::tr("_LPM_REGISTERED");
+
+			//M3C2 distances between the registered slice and the reference
+			ScalarType m3c2Mean = CCCoreLib::NAN_VALUE;
+			ScalarType m3c2Variance = CCCoreLib::NAN_VALUE;
+			unsigned m3c2Count = 0;
+			if (computeM3C2)
+			{
+				QString m3c2ErrorMessage;
+				if (LibpointmatcherProcess::Compute(m3c2Options, m3c2ErrorMessage, sliceDesc.pc, refDesc.pc, false, cmd.widgetParent()))
+				{
+					int sfIdx = sliceDesc.pc->getScalarFieldIndexByName("M3C2 distance");
+					CCCoreLib::ScalarField* sf = (sfIdx >= 0 ? sliceDesc.pc->getScalarField(sfIdx) : nullptr);
+					if (sf)
+					{
+						sf->computeMeanAndVariance(m3c2Mean, &m3c2Variance);
+						m3c2Count = static_cast<unsigned>(std::count_if(sf->begin(), sf->end(), CCCoreLib::ScalarField::ValidValue));
+					}
+				}
+				else
+				{
+					cmd.warning(QObject::tr("M3C2 failed on slice #%1: %2").arg(sliceIndex + 1).arg(m3c2ErrorMessage));
+				}
+			}
+
+			int precision = cmd.numericalPrecision();
+			txtStream	<< sliceIndex + 1 << ' '
+						<< '"' << sliceDesc.pc->getName() << '"' << ' '
+						<< QString::number(timing.preparation, 'f', 3) << ' '
+						<< QString::number(timing.icp, 'f', 3) << ' '
+						<< timing.readPointCount << ' '
+						<< timing.refPointCount << ' '
+						<< QString::number(m3c2Mean, 'f', precision) << ' '
+						<< QString::number(std::sqrt(m3c2Variance), 'f', precision) << ' '
+						<< m3c2Count;
+			const double* mat = Tabsolute.data();
+			for (unsigned r = 0; r < 4; ++r)
+			{
+				for (unsigned c = 0; c < 4; ++c)
+				{
+					txtStream << ' ' << QString::number(mat[c * 4 + r], 'f', precision);
+				}
+			}
+			txtStream << endl; //flushes the stream
+
+			if (cmd.autoSaveMode())
+			{
+				QString errorStr = cmd.exportEntity(sliceDesc);
+				if (!errorStr.isEmpty())
+				{
+					cmd.error(errorStr);
+					return false;
+				}
+			}
+
+			return true;
+		};
+
+		std::vector<ccGLMatrixd> transformations = engine.run(slices, errorMessage, onSliceRegistered);
+		if (transformations.size() != slices.size())
+		{
+			return cmd.error(errorMessage);
+		}
+
+		cmd.print(QObject::tr("Transformations saved to '%1'").arg(txtFilename));
+
+		return true;
+	}
+};
+
+#endif //LIBPOINTMATCHER_PLUGIN_COMMANDS_HEADER
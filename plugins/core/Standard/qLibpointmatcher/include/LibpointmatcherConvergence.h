@@ -0,0 +1,172 @@
+//##########################################################################
+//#                                                                        #
+//#                       CLOUDCOMPARE PLUGIN: Libpointmatcher             #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#            COPYRIGHT: UNIVERSITE EUROPEENNE DE BRETAGNE                #
+//#                                                                        #
+//##########################################################################
+
+#ifndef LIBPOINTMATCHER_CONVERGENCE_HEADER
+#define LIBPOINTMATCHER_CONVERGENCE_HEADER
+
+//Local
+#include "LibpointmatcherTools.h"
+
+//qCC_db
+#include <ccGLMatrix.h>
+
+//Qt
+#include <QString>
+
+//system
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+class ccPointCloud;
+
+//! Uniform grid index over a (filtered) reference DataPoints cloud
+/** Used to fetch the reference subset around each slice without scanning
+	(and clipping) the whole reference cloud every time.
+**/
+class LibpointmatcherReferenceIndex
+{
+public:
+
+	//! Builds the index
+	/** \warning the reference cloud must not be modified or destroyed while the index is used
+	**/
+	bool build(const DP& reference, float cellSize);
+
+	//! Returns whether the index is ready
+	bool isValid() const { return m_reference != nullptr; }
+
+	//! Extracts the reference points strictly inside the given bounds enlarged by 'padding'
+	/** Same semantic as LibpointmatcherTools::boundsFilter(bounds, false, padding).
+		\param bounds (Xmax,Ymax,Zmax,Xmin,Ymin,Zmin) as returned by LibpointmatcherTools::getBounds
+		\param padding extra padding
+	**/
+	DP extract(const std::vector<float>& bounds, float padding) const;
+
+protected:
+
+	//! Returns the key of the cell containing a given point
+	uint64_t cellKey(float x, float y, float z) const;
+
+	//! Indexed reference cloud
+	const DP* m_reference = nullptr;
+	//! Cell size
+	float m_cellSize = 0;
+	//! Grid origin (min corner of the reference cloud)
+	float m_origin[3] = { 0, 0, 0 };
+	//! Point indexes sorted by cell
+	std::vector<unsigned> m_sortedIndexes;
+	//! Cell key --> [begin, end) range in m_sortedIndexes
+	std::unordered_map<uint64_t, std::pair<unsigned, unsigned>> m_cells;
+};
+
+//! Slice-by-slice ('convergence') ICP engine
+/** The reference cloud is filtered and indexed once. Each slice is then registered
+	against the reference subset fetched from the index around its pre-aligned bounds.
+	As the initial pose of a slice depends on the result of the previous one, the ICP
+	steps are chained, while the conversion and filtering of the next slices (which
+	don't depend on it) run ahead in parallel.
+**/
+class LibpointmatcherConvergence
+{
+public:
+
+	//! Convergence parameters
+	struct Parameters
+	{
+		//reference filter chain
+		std::vector<std::shared_ptr<PM::DataPointsFilter>> filtersRef;
+		std::vector<bool> needNormalsRef;
+		bool useExistingNormalsRef = false;
+		bool refNeedsNormalsICP = false;
+
+		//slices ('reading') filter chain
+		std::vector<std::shared_ptr<PM::DataPointsFilter>> filtersRead;
+		std::vector<bool> needNormalsRead;
+		bool useExistingNormalsRead = false;
+		bool readNeedsNormalsICP = false;
+
+		//surface normals filter (inserted in the chains when necessary)
+		std::shared_ptr<PM::DataPointsFilter> normalParams;
+
+		//ICP chain
+		std::shared_ptr<PM::Matcher> matcher;
+		std::vector<std::shared_ptr<PM::OutlierFilter>> outlierFilters;
+		std::shared_ptr<PM::ErrorMinimizer> errorMinimizer;
+		std::vector<std::shared_ptr<PM::TransformationChecker>> checkers;
+
+		//! Extra padding around each slice bounds to fetch the reference subset
+		float refPadding = 2.0f;
+		//! Max thread count for the slices preparation (0 = ideal thread count)
+		int maxThreadCount = 0;
+	};
+
+	//! Per-slice timing (in seconds)
+	struct SliceTiming
+	{
+		double preparation = 0;	//conversion & filtering (in parallel)
+		double waiting = 0;		//time the ICP chain waited for the slice to be prepared
+		double fetch = 0;		//reference subset extraction
+		double icp = 0;			//ICP
+		unsigned readPointCount = 0;
+		unsigned refPointCount = 0;
+	};
+
+	//! Callback triggered each time a slice has been registered (return false to stop the process)
+	using SliceCallback = std::function<bool(size_t sliceIndex, const ccGLMatrixd& Tabsolute, const SliceTiming& timing)>;
+
+	//! Default constructor
+	explicit LibpointmatcherConvergence(const Parameters& params);
+
+	//! Converts, filters and indexes the reference cloud (to be called once)
+	bool setReference(ccPointCloud* reference, QString& errorMessage);
+
+	//! Registers all slices (in sequence)
+	/** \return the absolute transformation of each registered slice (on error, only the
+		slices registered before the failing one, and errorMessage is set)
+	**/
+	std::vector<ccGLMatrixd> run(	const std::vector<ccPointCloud*>& slices,
+									QString& errorMessage,
+									SliceCallback callback = nullptr);
+
+	//! Returns the timing of each registered slice (after run)
+	const std::vector<SliceTiming>& timings() const { return m_timings; }
+
+	//! Builds a filter chain, inserting the normals filter when necessary
+	/** \param cloneFilters whether the filters should be cloned (to be applied concurrently)
+	**/
+	static PM::DataPointsFilters BuildFilterChain(	const std::vector<std::shared_ptr<PM::DataPointsFilter>>& filters,
+													const std::vector<bool>& needNormals,
+													bool hasNormalDescriptors,
+													bool needsNormalsICP,
+													const std::shared_ptr<PM::DataPointsFilter>& normalParams,
+													bool cloneFilters);
+
+protected:
+
+	Parameters m_params;
+
+	//! Filtered reference cloud
+	DP m_reference;
+	//! Reference index
+	LibpointmatcherReferenceIndex m_referenceIndex;
+
+	//! Timings
+	std::vector<SliceTiming> m_timings;
+};
+
+#endif //LIBPOINTMATCHER_CONVERGENCE_HEADER
@@ -49,6 +49,20 @@ public:
 		ccMainAppInterface* app/*=nullptr*/);
 	// Transfrom T eigen matrix to a CCGLMatrix
 	static ccGLMatrixd convertingOutputMatrix(Eigen::MatrixXf m);
+
+	//! M3C2 distances parameters
+	struct M3C2Options
+	{
+		double cylDiameter = 1.0;
+		double cylHalfHeight = 1.0;
+		double registrationRms = 0.0; //0 = not used
+		bool useMedian = false;
+		bool singlePass4Depth = false;
+		int maxThreadCount = 0; //0 = ideal thread count
+	};
+	//! Returns the M3C2 distances parameters set in the convergence dialog
+	static M3C2Options GetM3C2Options(const LibpointmatcherConvergenceDialog& dlg);
+
 	static bool Compute(const LibpointmatcherConvergenceDialog& dlg,
 		QString& errorMessage,
 		ccPointCloud* cloud1,
@@ -56,6 +70,13 @@ public:
 		bool allowDialogs,
 		QWidget* parentWidget = nullptr,
 		ccMainAppInterface* app = nullptr);
+	static bool Compute(const M3C2Options& options,
+		QString& errorMessage,
+		ccPointCloud* cloud1,
+		ccPointCloud* cloud2,
+		bool allowDialogs,
+		QWidget* parentWidget = nullptr,
+		ccMainAppInterface* app = nullptr);
 
 };
 
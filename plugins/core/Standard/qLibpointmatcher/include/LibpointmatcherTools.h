@@ -111,6 +111,13 @@ public:
 								ccMainAppInterface* app = 0,
 								unsigned probingCount = 1000);
 
+	//! Read-only view on the points coordinates of a cloud (no copy)
+	typedef Eigen::Map<const Eigen::Matrix<float, 3, Eigen::Dynamic>> ConstPointsMap;
+	//! Returns a read-only view on the points coordinates of a cloud (as a 3xN column-major matrix)
+	/** \warning the view is invalidated as soon as the cloud is resized
+	**/
+	static ConstPointsMap pointsMap(const ccPointCloud* cloud);
+
 	// Converts a CloudCompare Entity to a Point Matcher Entity
 	static DP ccToPointMatcher(ccPointCloud* cloud);
 	static DP ccToPointMatcherSubsample(ccPointCloud* cloud);
@@ -120,7 +127,7 @@ public:
 	// Converts a pointMatcher Entity to a Cloudcompare ReferenceCloud 
 	static CCCoreLib::ReferenceCloud* pointmatcherToCC(DP* cloud, ccPointCloud* ref);
 	static CCCoreLib::ReferenceCloud* pointmatcherToCCSubsample(DP* cloud, ccPointCloud* ref);
-	// Subsamples from Libpointmatcher
+	// Subsamples from Libpointmatcher (pass the input cloud with std::move to avoid a copy)
 	static DP filter(DP cloud, std::vector< std::shared_ptr<PM::DataPointsFilter>> filters, std::shared_ptr<PM::DataPointsFilter> normalParams, std::vector<bool> needNormals, bool hasNormalDescriptors );
 	//! returns the bounds of a DP cloud (Xmax,Ymax,Zmax,Xmin,Ymin,Zmin)
 	static std::vector<float> getBounds(DP* cloud);
@@ -28,6 +28,7 @@
 #include "LibpointmatcherConvergenceDialog.h"
 #include "LibpointmatcherDisclaimerDialog.h"
 #include "LibpointmatcherProcess.h"
+#include "LibpointmatcherCommands.h"
 
 //qCC_db
 #include <ccPointCloud.h>
@@ -91,6 +92,18 @@ QList<QAction *> Libpointmatcher::getActions()
 							m_actionConvergence};
 }
 
+void Libpointmatcher::registerCommands(ccCommandLineInterface* cmd)
+{
+	if (!cmd)
+	{
+		assert(false);
+		return;
+	}
+	cmd->registerCommand(ccCommandLineInterface::Command::Shared(new CommandLPMSubsample));
+	cmd->registerCommand(ccCommandLineInterface::Command::Shared(new CommandLPMICP));
+	cmd->registerCommand(ccCommandLineInterface::Command::Shared(new CommandLPMConvergence));
+}
+
 void Libpointmatcher::applyTransformationEntity(ccGLMatrixd transMat, ccHObject* entity)
 {
 	//if the transformation is partly converted to global shift/scale
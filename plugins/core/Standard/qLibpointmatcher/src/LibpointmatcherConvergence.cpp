@@ -0,0 +1,488 @@
+//##########################################################################
+//#                                                                        #
+//#                       CLOUDCOMPARE PLUGIN: Libpointmatcher             #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#            COPYRIGHT: UNIVERSITE EUROPEENNE DE BRETAGNE                #
+//#                                                                        #
+//##########################################################################
+
+#include "LibpointmatcherConvergence.h"
+
+//local
+#include "LibpointmatcherProcess.h"
+
+//qCC_db
+#include <ccLog.h>
+#include <ccPointCloud.h>
+
+//Qt
+#include <QElapsedTimer>
+#include <QFuture>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrentRun>
+
+//system
+#include <algorithm>
+#include <cmath>
+
+//! Number of bits per dimension in a reference index cell key
+static const unsigned CELL_KEY_BITS = 21;
+static const uint64_t CELL_KEY_MASK = (static_cast<uint64_t>(1) << CELL_KEY_BITS) - 1;
+
+bool LibpointmatcherReferenceIndex::build(const DP& reference, float cellSize)
+{
+	m_reference = nullptr;
+	m_sortedIndexes.clear();
+	m_cells.clear();
+
+	unsigned pointCount = reference.getNbPoints();
+	if (pointCount == 0 || cellSize <= 0)
+	{
+		return false;
+	}
+
+	DP::ConstView viewX(reference.getFeatureViewByName("x"));
+	DP::ConstView viewY(reference.getFeatureViewByName("y"));
+	DP::ConstView viewZ(reference.getFeatureViewByName("z"));
+
+	m_origin[0] = viewX.minCoeff();
+	m_origin[1] = viewY.minCoeff();
+	m_origin[2] = viewZ.minCoeff();
+
+	//make sure the grid can't overflow the cell keys
+	float maxExtent = std::max(	viewX.maxCoeff() - m_origin[0],
+								std::max(viewY.maxCoeff() - m_origin[1], viewZ.maxCoeff() - m_origin[2]));
+	m_cellSize = std::max(cellSize, maxExtent / static_cast<float>(CELL_KEY_MASK));
+
+	std::vector<std::pair<uint64_t, unsigned>> keys;
+	try
+	{
+		keys.resize(pointCount);
+		m_sortedIndexes.resize(pointCount);
+	}
+	catch (const std::bad_alloc&)
+	{
+		ccLog::Warning("[Libpointmatcher] Not enough memory to index the reference cloud");
+		m_sortedIndexes.clear();
+		return false;
+	}
+
+	int count = static_cast<int>(pointCount);
+#if defined(_OPENMP)
+#pragma omp parallel for
+#endif
+	for (int i = 0; i < count; ++i)
+	{
+		keys[i] = { cellKey(viewX(0, i), viewY(0, i), viewZ(0, i)), static_cast<unsigned>(i) };
+	}
+
+	//points are sorted by cell (and by index inside each cell)
+	std::sort(keys.begin(), keys.end());
+
+	unsigned cellBegin = 0;
+	for (unsigned i = 0; i < pointCount; ++i)
+	{
+		m_sortedIndexes[i] = keys[i].second;
+		if (i + 1 == pointCount || keys[i + 1].first != keys[i].first)
+		{
+			m_cells[keys[i].first] = { cellBegin, i + 1 };
+			cellBegin = i + 1;
+		}
+	}
+
+	m_reference = &reference;
+	return true;
+}
+
+uint64_t LibpointmatcherReferenceIndex::cellKey(float x, float y, float z) const
+{
+	uint64_t cx = static_cast<uint64_t>(std::max(0.0f, (x - m_origin[0]) / m_cellSize));
+	uint64_t cy = static_cast<uint64_t>(std::max(0.0f, (y - m_origin[1]) / m_cellSize));
+	uint64_t cz = static_cast<uint64_t>(std::max(0.0f, (z - m_origin[2]) / m_cellSize));
+
+	return	 std::min(cx, CELL_KEY_MASK)
+		|	(std::min(cy, CELL_KEY_MASK) << CELL_KEY_BITS)
+		|	(std::min(cz, CELL_KEY_MASK) << (2 * CELL_KEY_BITS));
+}
+
+DP LibpointmatcherReferenceIndex::extract(const std::vector<float>& bounds, float padding) const
+{
+	if (!m_reference || bounds.size() < 6)
+	{
+		assert(false);
+		return DP();
+	}
+
+	const float maxB[3] = { bounds[0] + padding, bounds[1] + padding, bounds[2] + padding };
+	const float minB[3] = { bounds[3] - padding, bounds[4] - padding, bounds[5] - padding };
+
+	//range of cells overlapping the box
+	uint64_t cellMin[3];
+	uint64_t cellMax[3];
+	uint64_t cellCount = 1;
+	for (unsigned d = 0; d < 3; ++d)
+	{
+		if (maxB[d] < m_origin[d])
+		{
+			//the box is outside of the grid
+			return m_reference->createSimilarEmpty(0);
+		}
+		cellMin[d] = static_cast<uint64_t>(std::max(0.0f, (minB[d] - m_origin[d]) / m_cellSize));
+		cellMax[d] = static_cast<uint64_t>((maxB[d] - m_origin[d]) / m_cellSize);
+		cellMin[d] = std::min(cellMin[d], CELL_KEY_MASK);
+		cellMax[d] = std::min(cellMax[d], CELL_KEY_MASK);
+		cellCount *= (cellMax[d] - cellMin[d] + 1);
+	}
+
+	DP::ConstView viewX(m_reference->getFeatureViewByName("x"));
+	DP::ConstView viewY(m_reference->getFeatureViewByName("y"));
+	DP::ConstView viewZ(m_reference->getFeatureViewByName("z"));
+
+	std::vector<unsigned> selected;
+	auto testCell = [&](const std::pair<unsigned, unsigned>& range)
+	{
+		for (unsigned k = range.first; k < range.second; ++k)
+		{
+			unsigned index = m_sortedIndexes[k];
+			float x = viewX(0, index);
+			float y = viewY(0, index);
+			float z = viewZ(0, index);
+			//same test as the 'BoundingBoxDataPointsFilter'
+			if (	x > minB[0] && x < maxB[0]
+				&&	y > minB[1] && y < maxB[1]
+				&&	z > minB[2] && z < maxB[2])
+			{
+				selected.push_back(index);
+			}
+		}
+	};
+
+	if (cellCount <= m_cells.size())
+	{
+		for (uint64_t cz = cellMin[2]; cz <= cellMax[2]; ++cz)
+		{
+			for (uint64_t cy = cellMin[1]; cy <= cellMax[1]; ++cy)
+			{
+				for (uint64_t cx = cellMin[0]; cx <= cellMax[0]; ++cx)
+				{
+					auto it = m_cells.find(cx | (cy << CELL_KEY_BITS) | (cz << (2 * CELL_KEY_BITS)));
+					if (it != m_cells.end())
+					{
+						testCell(it->second);
+					}
+				}
+			}
+		}
+	}
+	else
+	{
+		//the box is larger than the populated part of the grid
+		for (const auto& cell : m_cells)
+		{
+			uint64_t cx = (cell.first & CELL_KEY_MASK);
+			uint64_t cy = ((cell.first >> CELL_KEY_BITS) & CELL_KEY_MASK);
+			uint64_t cz = (cell.first >> (2 * CELL_KEY_BITS));
+			if (	cx >= cellMin[0] && cx <= cellMax[0]
+				&&	cy >= cellMin[1] && cy <= cellMax[1]
+				&&	cz >= cellMin[2] && cz <= cellMax[2])
+			{
+				testCell(cell.second);
+			}
+		}
+	}
+
+	//keep the original order (as the bounding box filter would)
+	std::sort(selected.begin(), selected.end());
+
+	DP subset = m_reference->createSimilarEmpty(static_cast<DP::Index>(selected.size()));
+	for (size_t j = 0; j < selected.size(); ++j)
+	{
+		subset.setColFrom(static_cast<DP::Index>(j), *m_reference, static_cast<DP::Index>(selected[j]));
+	}
+
+	return subset;
+}
+
+//! Clones a filter (so that it can be applied concurrently)
+static std::shared_ptr<PM::DataPointsFilter> CloneFilter(const std::shared_ptr<PM::DataPointsFilter>& filter)
+{
+	if (!filter)
+	{
+		return filter;
+	}
+	return PM::get().DataPointsFilterRegistrar.create(filter->className, filter->parameters);
+}
+
+PM::DataPointsFilters LibpointmatcherConvergence::BuildFilterChain(	const std::vector<std::shared_ptr<PM::DataPointsFilter>>& filters,
+																	const std::vector<bool>& needNormals,
+																	bool hasNormalDescriptors,
+																	bool needsNormalsICP,
+																	const std::shared_ptr<PM::DataPointsFilter>& normalParams,
+																	bool cloneFilters)
+{
+	PM::DataPointsFilters chain;
+	chain.init();
+
+	bool hasNormalsDescriptorsIter = false;
+	for (size_t i = 0; i < filters.size(); i++)
+	{
+		if (i < needNormals.size() && needNormals[i] && !hasNormalDescriptors)
+		{
+			//Enable Surface Creating
+			chain.push_back(cloneFilters ? CloneFilter(normalParams) : normalParams);
+			// Prevent from redoing the surface creating normals on the next iteration
+			hasNormalsDescriptorsIter = true;
+		}
+		chain.push_back(cloneFilters ? CloneFilter(filters[i]) : filters[i]);
+	}
+	// Because of the algorithm we need more than simple normals with descriptors such as densities, eigen etc..
+	if (!hasNormalsDescriptorsIter && needsNormalsICP)
+	{
+		chain.push_back(cloneFilters ? CloneFilter(normalParams) : normalParams);
+	}
+
+	return chain;
+}
+
+LibpointmatcherConvergence::LibpointmatcherConvergence(const Parameters& params)
+	: m_params(params)
+{
+}
+
+bool LibpointmatcherConvergence::setReference(ccPointCloud* reference, QString& errorMessage)
+{
+	if (!reference)
+	{
+		assert(false);
+		return false;
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+
+	//Transforming to libpointmatcher format
+	bool refHasNormalDescriptors = (reference->hasNormals() && m_params.useExistingNormalsRef);
+	m_reference = refHasNormalDescriptors	? LibpointmatcherTools::ccNormalsToPointMatcher(reference)
+											: LibpointmatcherTools::ccToPointMatcher(reference);
+
+	//Subsampling the ref (only once)
+	PM::DataPointsFilters chain = BuildFilterChain(	m_params.filtersRef,
+													m_params.needNormalsRef,
+													refHasNormalDescriptors,
+													m_params.refNeedsNormalsICP,
+													m_params.normalParams,
+													false);
+	try
+	{
+		chain.apply(m_reference); //cause an exception
+	}
+	catch (const std::exception& e)
+	{
+		errorMessage = QString("The Filter Subsample for the reference due to Error: %1").arg(e.what());
+		return false;
+	}
+
+	//Indexing the ref (only once)
+	if (!m_referenceIndex.build(m_reference, std::max(m_params.refPadding, 0.1f)))
+	{
+		errorMessage = "Failed to index the reference cloud";
+		return false;
+	}
+
+	ccLog::Print(QString("[Libpointmatcher] Reference filtered and indexed in %1 s. (%2 points)").arg(timer.elapsed() / 1000.0, 0, 'f', 3).arg(m_reference.getNbPoints()));
+
+	return true;
+}
+
+//! A slice converted to the libpointmatcher format and filtered
+struct PreparedSlice
+{
+	DP cloud;
+	double preparationTime = 0;
+	QString errorMessage;
+};
+
+std::vector<ccGLMatrixd> LibpointmatcherConvergence::run(	const std::vector<ccPointCloud*>& slices,
+															QString& errorMessage,
+															SliceCallback callback/*=nullptr*/)
+{
+	std::vector<ccGLMatrixd> TabsoluteList;
+	m_timings.clear();
+
+	if (!m_referenceIndex.isValid())
+	{
+		errorMessage = "Reference cloud not set";
+		assert(false);
+		return TabsoluteList;
+	}
+
+	//Intiate ICP always the same data
+	PM::ICP icp;
+	//KD Tree Matcher
+	icp.matcher = m_params.matcher;
+	//Outlier Filters
+	for (const std::shared_ptr<PM::OutlierFilter>& outlierFilter : m_params.outlierFilters)
+	{
+		icp.outlierFilters.push_back(outlierFilter);
+	}
+	// Error Minimizer
+	icp.errorMinimizer = m_params.errorMinimizer;
+	// Tranformation Checkers
+	for (const std::shared_ptr<PM::TransformationChecker>& checker : m_params.checkers)
+	{
+		icp.transformationCheckers.push_back(checker);
+	}
+	// Inspectors Not useful but necessary for the ICP chain of Libpointmatcher
+	icp.inspector = PM::get().InspectorRegistrar.create("NullInspector");
+	// Rigid Transformation, useless but necessary for the Libpointmatcher IP
+	std::shared_ptr<PM::Transformation> rigidTrans = PM::get().TransformationRegistrar.create("RigidTransformation");
+	icp.transformations.push_back(rigidTrans);
+	//the reference and slices are already filtered: no filters in the ICP chain
+
+	//slices preparation (conversion + filtering) doesn't depend on the previous
+	//slice transformation: it runs ahead on a dedicated pool
+	int maxThreadCount = m_params.maxThreadCount > 0 ? m_params.maxThreadCount : QThread::idealThreadCount();
+	QThreadPool pool;
+	pool.setMaxThreadCount(std::max(1, maxThreadCount));
+	//bounded look-ahead (so as to bound memory consumption)
+	const size_t lookAhead = static_cast<size_t>(pool.maxThreadCount()) + 1;
+
+	const Parameters& params = m_params;
+	auto prepareSlice = [&params](ccPointCloud* slice) -> PreparedSlice
+	{
+		PreparedSlice prepared;
+		QElapsedTimer timer;
+		timer.start();
+
+		//Transorming the slice to the DP format
+		bool readHasNormalDescriptors = (slice->hasNormals() && params.useExistingNormalsRead);
+		prepared.cloud = readHasNormalDescriptors	? LibpointmatcherTools::ccNormalsToPointMatcher(slice)
+													: LibpointmatcherTools::ccToPointMatcher(slice);
+
+		// Subsampling Slice (with its own filters instances, as several slices are filtered concurrently)
+		PM::DataPointsFilters chain = BuildFilterChain(	params.filtersRead,
+														params.needNormalsRead,
+														readHasNormalDescriptors,
+														params.readNeedsNormalsICP,
+														params.normalParams,
+														true);
+		try
+		{
+			chain.apply(prepared.cloud); //cause an exception
+		}
+		catch (const std::exception& e)
+		{
+			prepared.errorMessage = e.what();
+		}
+
+		prepared.preparationTime = timer.elapsed() / 1000.0;
+		return prepared;
+	};
+
+	std::vector<QFuture<PreparedSlice>> futures(slices.size());
+	size_t launchedCount = 0;
+
+	PM::TransformationParameters Tcurrent = PM::TransformationParameters::Identity(4, 4);
+	PM::TransformationParameters Trelative;
+
+	QElapsedTimer totalTimer;
+	totalTimer.start();
+
+	for (size_t i = 0; i < slices.size(); i++)
+	{
+		while (launchedCount < slices.size() && launchedCount < i + lookAhead)
+		{
+			futures[launchedCount] = QtConcurrent::run(&pool, prepareSlice, slices[launchedCount]);
+			++launchedCount;
+		}
+
+		SliceTiming timing;
+		QElapsedTimer timer;
+
+		timer.start();
+		PreparedSlice prepared = futures[i].result();
+		futures[i] = QFuture<PreparedSlice>(); //release the slice as soon as possible
+		timing.waiting = timer.elapsed() / 1000.0;
+		timing.preparation = prepared.preparationTime;
+
+		if (!prepared.errorMessage.isEmpty())
+		{
+			errorMessage = QString("The Filter did not work at the segment: %1 due to Error: %2").arg(i).arg(prepared.errorMessage);
+			pool.clear();
+			return TabsoluteList; // Kill the process
+		}
+		DP& convertedCloudSlice = prepared.cloud;
+		timing.readPointCount = convertedCloudSlice.getNbPoints();
+
+		// Applying transformation to slice
+		if (!rigidTrans->checkParameters(Tcurrent))
+		{
+			Tcurrent = rigidTrans->correctParameters(Tcurrent);
+		}
+
+		try
+		{
+			convertedCloudSlice = rigidTrans->compute(convertedCloudSlice, Tcurrent);
+		}
+		catch (const std::exception& e)
+		{
+			errorMessage = QString("The preCompute did not work properly because %1").arg(e.what());
+			pool.clear();
+			return TabsoluteList; // Kill the process
+		}
+
+		// Fetching the Ref subset based on the slice bounds and extra padding
+		timer.start();
+		DP refSubset = m_referenceIndex.extract(LibpointmatcherTools::getBounds(&convertedCloudSlice), m_params.refPadding);
+		timing.fetch = timer.elapsed() / 1000.0;
+		timing.refPointCount = refSubset.getNbPoints();
+
+		timer.start();
+		try
+		{
+			Trelative = icp(convertedCloudSlice, refSubset); //cause an exception
+		}
+		catch (const std::exception& e)
+		{
+			errorMessage = QString("The ICP did not work at the segment: %1 due to Error: %2").arg(i).arg(e.what());
+			pool.clear();
+			return TabsoluteList; // Kill the process
+		}
+		timing.icp = timer.elapsed() / 1000.0;
+
+		Tcurrent = Tcurrent * Trelative;
+		TabsoluteList.push_back(LibpointmatcherProcess::convertingOutputMatrix(Tcurrent));
+		m_timings.push_back(timing);
+
+		ccLog::Print(QString("[Libpointmatcher] Slice %1/%2: preparation %3 s. (waited %4 s.), reference fetch %5 s. (%6 points), ICP %7 s. (%8 points)")
+						.arg(i + 1)
+						.arg(slices.size())
+						.arg(timing.preparation, 0, 'f', 3)
+						.arg(timing.waiting, 0, 'f', 3)
+						.arg(timing.fetch, 0, 'f', 3)
+						.arg(timing.refPointCount)
+						.arg(timing.icp, 0, 'f', 3)
+						.arg(timing.readPointCount));
+
+		if (callback && !callback(i, TabsoluteList.back(), timing))
+		{
+			errorMessage = "Process canceled";
+			pool.clear();
+			return TabsoluteList;
+		}
+	}
+
+	ccLog::Print(QString("[Libpointmatcher] %1 slices registered in %2 s.").arg(slices.size()).arg(totalTimer.elapsed() / 1000.0, 0, 'f', 3));
+
+	return TabsoluteList;
+}
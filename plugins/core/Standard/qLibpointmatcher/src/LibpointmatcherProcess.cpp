@@ -19,6 +19,7 @@
 
 //local
 #include "LibpointmatcherTools.h"
+#include "LibpointmatcherConvergence.h"
 #include "LibpointmatcherDialog.h"
 #include "Libpointmatcher.h"
 
@@ -438,7 +439,24 @@ void ComputeM3C2DistForPoint(unsigned index)
 	}
 }
 
+LibpointmatcherProcess::M3C2Options LibpointmatcherProcess::GetM3C2Options(const LibpointmatcherConvergenceDialog& dlg)
+{
+	M3C2Options options;
+	options.cylDiameter = dlg.cylDiameterDoubleSpinBox->value();
+	options.cylHalfHeight = dlg.cylHalfHeightDoubleSpinBox->value();
+	options.registrationRms = dlg.rmsCheckBox->isChecked() ? dlg.rmsDoubleSpinBox->value() : 0.0;
+	options.useMedian = dlg.useMedianCheckBox->isChecked();
+	options.singlePass4Depth = dlg.useSinglePass4DepthCheckBox->isChecked();
+	options.maxThreadCount = dlg.maxThreadCountSpinBox->value();
+	return options;
+}
+
 bool LibpointmatcherProcess::Compute(const LibpointmatcherConvergenceDialog& dlg, QString& errorMessage, ccPointCloud* cloud1, ccPointCloud* cloud2, bool allowDialogs, QWidget* parentWidget/*=nullptr*/, ccMainAppInterface* app/*=nullptr*/)
+{
+	return Compute(GetM3C2Options(dlg), errorMessage, cloud1, cloud2, allowDialogs, parentWidget, app);
+}
+
+bool LibpointmatcherProcess::Compute(const M3C2Options& options, QString& errorMessage, ccPointCloud* cloud1, ccPointCloud* cloud2, bool allowDialogs, QWidget* parentWidget/*=nullptr*/, ccMainAppInterface* app/*=nullptr*/)
 {
 	errorMessage.clear();
 
@@ -450,7 +468,7 @@ bool LibpointmatcherProcess::Compute(const LibpointmatcherConvergenceDialog& dlg
 
 	//normals computation parameters
 	double normalScale = 0.1195;
-	double projectionScale = dlg.cylDiameterDoubleSpinBox->value();
+	double projectionScale = options.cylDiameter;
 	LibpointmatcherNormals::ComputationMode normMode = LibpointmatcherNormals::USE_CLOUD1_NORMALS;
 	double samplingDist = 0.059;
 	ccScalarField* normalScaleSF = nullptr; //normal scale (multi-scale mode only)
@@ -458,21 +476,21 @@ bool LibpointmatcherProcess::Compute(const LibpointmatcherConvergenceDialog& dlg
 	//other parameters are stored in 's_M3C2Params' for parallel call
 	s_M3C2Params = M3C2Params();
 	s_M3C2Params.projectionRadius = static_cast<PointCoordinateType>(projectionScale / 2); //we want the radius in fact ;)
-	s_M3C2Params.projectionDepth = static_cast<PointCoordinateType>(dlg.cylHalfHeightDoubleSpinBox->value());
+	s_M3C2Params.projectionDepth = static_cast<PointCoordinateType>(options.cylHalfHeight);
 	s_M3C2Params.corePoints = cloud1;
-	s_M3C2Params.registrationRms = dlg.rmsCheckBox->isChecked() ? dlg.rmsDoubleSpinBox->value() : 0.0;
+	s_M3C2Params.registrationRms = options.registrationRms;
 	//s_M3C2Params.exportOption = dlg.getExportOption();
 	s_M3C2Params.exportOption = LibpointmatcherDialog::PROJECT_ON_CORE_POINTS;
 	s_M3C2Params.keepOriginalCloud = true;
-	s_M3C2Params.useMedian = dlg.useMedianCheckBox->isChecked();
+	s_M3C2Params.useMedian = options.useMedian;
 	s_M3C2Params.minPoints4Stats = 5;
-	s_M3C2Params.progressiveSearch = !dlg.useSinglePass4DepthCheckBox->isChecked();
+	s_M3C2Params.progressiveSearch = !options.singlePass4Depth;
 	s_M3C2Params.onlyPositiveSearch = false;
 
 	
 
 	//max thread count
-	int maxThreadCount = dlg.maxThreadCountSpinBox->value();
+	int maxThreadCount = options.maxThreadCount;
 
 	//progress dialog
 	ccProgressDialog pDlg(parentWidget);
@@ -1021,9 +1039,8 @@ bool LibpointmatcherProcess::Subsample(const LibpointmatcherDialog& dlg, ccHObje
 	// Iterate through the different filters
 	
 	
-	// Filtering with DP format
-	DP filteredCloud;
-	filteredCloud = LibpointmatcherTools::filter(convertedCloud, dlg.getFilters(), dlg.getNormalParams(),dlg.needNormals(), hasNormalDescriptors);
+	// Filtering with DP format (the converted cloud is moved, not copied)
+	DP filteredCloud = LibpointmatcherTools::filter(std::move(convertedCloud), dlg.getFilters(), dlg.getNormalParams(),dlg.needNormals(), hasNormalDescriptors);
 	if (filteredCloud.getNbPoints()<1)
 	{
 		errorMessage = "Failed to compute!";
@@ -1214,188 +1231,43 @@ ccGLMatrixd LibpointmatcherProcess::ICP(const LibpointmatcherOutlierDialog& dlg,
 std::vector<ccGLMatrixd> LibpointmatcherProcess::convergence(const LibpointmatcherConvergenceDialog& dlg, QString& errorMessage, QWidget* parentWidget/*=nullptr*/, ccMainAppInterface* app/*=nullptr*/)
 {
 	errorMessage.clear();
-	PM::TransformationParameters Trelative;
-	std::vector<ccGLMatrixd> TabsoluteList;
-	//start the job
-	bool error = false;
-
-	//Normals checking
-	bool refHasNormalDescriptors;
-	bool readHasNormalDescriptors;
-
 
-	//Transforming to libpointmatcher format
-
-	DP convertedCloudRef;
-	if (dlg.getCloudRefConvergence()->hasNormals() && dlg.needAtLeastOneNormalRef() && dlg.useAtLeastOneNormalRef())
+	LibpointmatcherConvergence::Parameters params;
+	params.filtersRef = dlg.getFiltersRef();
+	params.needNormalsRef = dlg.needNormalsRef();
+	params.useExistingNormalsRef = dlg.needAtLeastOneNormalRef() && dlg.useAtLeastOneNormalRef();
+	params.refNeedsNormalsICP = dlg.refCloudNeedNormalsICP();
+	params.filtersRead = dlg.getFiltersRead();
+	for (size_t i = 0; i < params.filtersRead.size(); i++)
 	{
-		//Has Normals and will be added
-		convertedCloudRef = LibpointmatcherTools::ccNormalsToPointMatcher(dlg.getCloudRefConvergence());
-		refHasNormalDescriptors = true;
+		params.needNormalsRead.push_back(dlg.getNeedNormalsRead(static_cast<int>(i)));
 	}
-	else
+	params.useExistingNormalsRead = dlg.needAtLeastOneNormalRead() && dlg.useAtLeastOneNormalRead();
+	params.readNeedsNormalsICP = dlg.readCloudNeedNormalsICP();
+	params.normalParams = dlg.getNormalParams();
+	params.matcher = dlg.getKdTree();
+	params.outlierFilters.push_back(dlg.getOutlierFilter());
+	params.errorMinimizer = dlg.getErrorMinimizer();
+	params.checkers = dlg.getCheckers();
+	params.maxThreadCount = dlg.maxThreadCountSpinBox->value();
+
+	// Filtering and indexing the ref (only once)
+	LibpointmatcherConvergence engine(params);
+	if (!engine.setReference(dlg.getCloudRefConvergence(), errorMessage))
 	{
-		convertedCloudRef = LibpointmatcherTools::ccToPointMatcher(dlg.getCloudRefConvergence());
-		refHasNormalDescriptors = false;
+		ccLog::Error(errorMessage);
+		return {}; // Kill the process
 	}
 
-	//Subsampling the ref filter (To do only once)
-	PM::DataPointsFilters list;
-	list.init();
-
-	bool refHasNormalsDescriptorsIter = false;
-	for (int i = 0; i < dlg.getFiltersRef().size(); i++) {
-		if (dlg.getNeedNormalsRef(i) && !refHasNormalDescriptors)
-		{
-			//Enable Surface Creating 
-			list.push_back(dlg.getNormalParams());
-			// Prevent from redoing the surface creating normals on the next iteration
-			refHasNormalsDescriptorsIter = true;
-		}
-		list.push_back(dlg.getFiltersRef()[i]);
-	}
-	// Because of the algorithm we need more than simple normals with descriptors such as densities, eigen etc.. 
-	if (!refHasNormalsDescriptorsIter && dlg.refCloudNeedNormalsICP()) {
-		list.push_back(dlg.getNormalParams());
-	}
-	try
-	{
-		list.apply(convertedCloudRef); //cause an exception 
-	}
-	catch (std::exception e)
+	// Iterating through the different slices
+	std::vector<ccGLMatrixd> TabsoluteList = engine.run(dlg.getSliceList(), errorMessage);
+	if (!errorMessage.isEmpty() || TabsoluteList.empty())
 	{
-		ccLog::Error(QString("The Filter Subsample for the reference due to Error: %1").arg(e.what()));
+		//the transformations of the slices registered before the failure are still returned
+		ccLog::Error(errorMessage);
 		return TabsoluteList; // Kill the process
 	}
-	
-	// Starting the iteration loop through the different slices
-	DP convertedCloudSlice;
-	PM::ICP icp;
-	PM::TransformationParameters Tcurrent =
-		PM::TransformationParameters::Identity(4, 4);
-	std::vector<ccPointCloud*> sliceList = dlg.getSliceList();
-	std::shared_ptr<PM::DataPointsFilter> refBoundsFilter;
-
-	//Intiate ICP always the same data
-	//KD Tree Matcher
-	icp.matcher = dlg.getKdTree();
-
-	//Outlier Filter
-	icp.outlierFilters.push_back(dlg.getOutlierFilter());
-
-	// Error Minimizer
-	icp.errorMinimizer = dlg.getErrorMinimizer();
-
-	// Tranformation Checkers
-	for (int i = 0; i < dlg.getCheckers().size(); i++)
-	{
-		icp.transformationCheckers.push_back(dlg.getCheckers()[i]);
-	}
-
-	// Inspectors Not useful but necessary for the ICP chain of Libpointmatcher
-	std::shared_ptr<PM::Inspector> nullInspect =
-		PM::get().InspectorRegistrar.create("NullInspector");
-	icp.inspector = nullInspect;
-
-	// Rigid Transformation, useless but necessary for the Libpointmatcher IP 
-	std::shared_ptr<PM::Transformation> rigidTrans =
-		PM::get().TransformationRegistrar.create("RigidTransformation");
-	icp.transformations.push_back(rigidTrans);
-
-	// Identity Filter
-	std::shared_ptr<PM::DataPointsFilter> filterIdentity =
-		PM::get().DataPointsFilterRegistrar.create(
-			"IdentityDataPointsFilter");
-	icp.referenceDataPointsFilters.push_back(filterIdentity);
-	icp.readingDataPointsFilters.push_back(filterIdentity);
-	
-	for (int i = 0; i < sliceList.size(); i++)
-	{
-		//Reinitiate ICP
-		list.clear();
-		icp.referenceDataPointsFilters.clear();
-		icp.readingDataPointsFilters.clear();
-
-
-		//Transorming the slice to the DP format
-		if (sliceList[i]->hasNormals() && dlg.needAtLeastOneNormalRead() && dlg.useAtLeastOneNormalRead())
-		{
-			//Has Normals and will be added
-			convertedCloudSlice = LibpointmatcherTools::ccNormalsToPointMatcher(sliceList[i]);
-			readHasNormalDescriptors = true;
-		}
-		else
-		{
-			convertedCloudSlice = LibpointmatcherTools::ccToPointMatcher(sliceList[i]);
-			readHasNormalDescriptors = false;
-
-		}
-
-		// Subsampling Slice
-		bool readHasNormalsDescriptorsIter = false;
-
-		for (int j = 0; j < dlg.getFiltersRead().size(); j++) {
-			if (dlg.getNeedNormalsRead(j) && !readHasNormalDescriptors)
-			{
-				//Enable Surface Creating 
-				list.push_back(dlg.getNormalParams());
-				// Prevent from redoing the surface creating normals on the next iteration
-				readHasNormalsDescriptorsIter = true;
-			}
-			list.push_back(dlg.getFiltersRead()[j]);
-		}
-		// Because of the algorithm we need more than simple normals with descriptors such as densities, eigen etc.. 
-		if (!readHasNormalsDescriptorsIter && dlg.readCloudNeedNormalsICP()) {
-			list.push_back(dlg.getNormalParams());
-		}
-		// Applying Filter to slice clouds
-		try
-		{
-			list.apply(convertedCloudSlice); //cause an exception 
-		}
-		catch (std::exception e)
-		{
-			ccLog::Error(QString("The Filter did not work at the segment: %1 due to Error: %2").arg(QString::number(i)).arg(e.what()));
-			return TabsoluteList; // Kill the process
-		}
-		// Applying transformation to slice
-		if (!rigidTrans->checkParameters(Tcurrent)) {
-			Tcurrent = rigidTrans->correctParameters(Tcurrent);
-		}
-
 
-		try
-		{
-			convertedCloudSlice = rigidTrans->compute(convertedCloudSlice, Tcurrent);
-		}
-		catch (std::exception e)
-		{
-			ccLog::Error(QString("The preCompute did not work properly because %1").arg(QString(e.what())));
-			return TabsoluteList; // Kill the process
-		}
-
-		// Applying Bound filter to the Ref Based on the slice and extra padding
-		std::vector<float> boundVector =LibpointmatcherTools::getBounds(&convertedCloudSlice);
-		refBoundsFilter = LibpointmatcherTools::boundsFilter(boundVector, false, 2.0);
-			
-		icp.referenceDataPointsFilters.push_back(refBoundsFilter);
-
-		try
-		{
-			Trelative = icp(convertedCloudSlice, convertedCloudRef); //cause an exception 
-		}
-		catch (std::exception e)
-		{
-			ccLog::Error(QString("The ICP did not work at the segment: %1 due to Error: %2").arg(QString::number(i)).arg(e.what()));
-			return TabsoluteList; // Kill the process
-		}
-		Tcurrent = Tcurrent * Trelative;
-		ccGLMatrixd TtoAdd = convertingOutputMatrix(Tcurrent);
-		TabsoluteList.push_back(TtoAdd);
-
-	}
 	ccLog::Print(QString("Slices ICP converged Properly"));
 	return TabsoluteList;
 }
-
-
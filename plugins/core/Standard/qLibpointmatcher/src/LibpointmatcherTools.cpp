@@ -93,10 +93,19 @@ void ComputeCorePointNormal(unsigned index)
 			double radius = s_corePointsNormalsParams.radii[radiiCount - 1 - i]; //we start from the biggest
 			double squareRadius = radius*radius;
 
+			//fill the subset at once (no lock per point)
 			subset.clear(false);
+			unsigned* subsetIndexes = subset.appendPointIndexSpan(static_cast<unsigned>(n));
+			if (!subsetIndexes)
+			{
+				//not enough memory
+				break;
+			}
+			unsigned subsetSize = 0;
 			for (unsigned j = 0; j < static_cast<unsigned>(n); ++j)
 				if (neighbours[j].squareDistd <= squareRadius)
-					subset.addPointIndex(neighbours[j].pointIndex);
+					subsetIndexes[subsetSize++] = neighbours[j].pointIndex;
+			subset.resize(subsetSize);
 
 			//as we start from the biggest neighborhood, if we have less than 3 points for the current radius
 			//it won't be better for the next one(s)!
@@ -805,288 +814,141 @@ bool LibpointmatcherTools::GuessBestParams(	ccPointCloud* cloud1,
 
 	return success;
 }
-DP LibpointmatcherTools::ccToPointMatcher(ccPointCloud* cloud)
+LibpointmatcherTools::ConstPointsMap LibpointmatcherTools::pointsMap(const ccPointCloud* cloud)
 {
-	typedef DP::Label Label;
-	typedef DP::Labels Labels;
-	typedef DP::View View;
-
-	if (cloud->size() <= 0)
-		return DP();
-	Labels featLabels;
-	Labels descLabels;
-	std::vector<bool> isFeature;
-	featLabels.push_back(Label("x", 1));
-	isFeature.push_back(true);
-	featLabels.push_back(Label("y", 1));
-	isFeature.push_back(true);
-	featLabels.push_back(Label("z", 1));
-	isFeature.push_back(true);
-
-	descLabels.push_back(Label("i", 1));
-	isFeature.push_back(false);
-
-	featLabels.push_back(Label("pad", 1));
-
-	DP cloudDP(featLabels, descLabels, cloud->size());
-	cloudDP.getFeatureViewByName("pad").setConstant(1);
-	// fill cloud
-	View view(cloudDP.getFeatureViewByName("x"));
-	View viewIndex(cloudDP.getDescriptorRowViewByName("i", 0));
-	const CCVector3* P3D;
+	static_assert(sizeof(CCVector3) == 3 * sizeof(float), "CCVector3 must be made of 3 contiguous floats");
 
-	int cloudSize = static_cast<int>(cloud->size());
-#if defined(_OPENMP)
-#pragma omp parallel for
-#endif
-	for (int i = 0; i < cloudSize; ++i)
-	{
-		P3D = cloud->getPoint(i);
-		view(0, i) = P3D->x;
-		view(1, i) = P3D->y;
-		view(2, i) = P3D->z;
-		viewIndex(0, i) = i;
-
-	}
-
-	return cloudDP;
+	unsigned pointCount = cloud ? cloud->size() : 0;
+	return ConstPointsMap(pointCount != 0 ? cloud->getPoint(0)->u : nullptr, 3, pointCount);
 }
-DP LibpointmatcherTools::ccNormalsToPointMatcher(ccPointCloud* cloud)
+
+//! Converts a cloud to the libpointmatcher format
+/** \param cloud input cloud
+	\param withNormals whether normals should be exported as descriptors
+	\param indexAsFeature whether the point indexes are stored as a feature (instead of the 'pad' row) or as a descriptor
+**/
+static DP ToPointMatcher(const ccPointCloud* cloud, bool withNormals, bool indexAsFeature)
 {
 	typedef DP::Label Label;
 	typedef DP::Labels Labels;
 	typedef DP::View View;
 
-	if (cloud->size() <= 0)
+	if (!cloud || cloud->size() == 0)
 		return DP();
+
 	Labels featLabels;
 	Labels descLabels;
-	std::vector<bool> isFeature;
 	featLabels.push_back(Label("x", 1));
-	isFeature.push_back(true);
 	featLabels.push_back(Label("y", 1));
-	isFeature.push_back(true);
 	featLabels.push_back(Label("z", 1));
-	isFeature.push_back(true);
-
-
-	descLabels.push_back(Label("i", 1));
-	isFeature.push_back(false);
+	if (indexAsFeature)
+	{
+		featLabels.push_back(Label("i", 1));
+	}
+	else
+	{
+		descLabels.push_back(Label("i", 1));
+		featLabels.push_back(Label("pad", 1));
+	}
+	if (withNormals)
+	{
+		descLabels.push_back(Label("normals", 3));
+	}
 
-	descLabels.push_back(Label("normals", 3));
-	isFeature.push_back(false);
-	isFeature.push_back(false);
-	isFeature.push_back(false);
+	unsigned pointCount = cloud->size();
+	DP cloudDP(featLabels, descLabels, pointCount);
 
-	featLabels.push_back(Label("pad", 1));
+	// fill cloud (straight from the cloud storage)
+	cloudDP.features.topRows(3) = LibpointmatcherTools::pointsMap(cloud);
 
+	// fill indexes (in bulk)
+	View viewIndex(indexAsFeature ? cloudDP.getFeatureViewByName("i") : cloudDP.getDescriptorViewByName("i"));
+	viewIndex = Eigen::RowVectorXf::LinSpaced(pointCount, 0.0f, static_cast<float>(pointCount - 1));
+	if (!indexAsFeature)
+	{
+		cloudDP.getFeatureViewByName("pad").setConstant(1);
+	}
 
-	DP cloudDP(featLabels, descLabels, cloud->size());
-	cloudDP.getFeatureViewByName("pad").setConstant(1);
-	// fill cloud
-	View view(cloudDP.getFeatureViewByName("x"));
-	View viewIndex(cloudDP.getDescriptorRowViewByName("i", 0));
-	View viewNormalX(cloudDP.getDescriptorRowViewByName("normals", 0));
-	View viewNormalY(cloudDP.getDescriptorRowViewByName("normals", 1));
-	View viewNormalZ(cloudDP.getDescriptorRowViewByName("normals", 2));
-	const CCVector3* P3D;
-	CCVector3 N3D;
-	int cloudSize = static_cast<int>(cloud->size());
+	// fill normals (compressed, so they have to be decoded)
+	if (withNormals)
+	{
+		View viewNormals(cloudDP.getDescriptorViewByName("normals"));
+		int cloudSize = static_cast<int>(pointCount);
 #if defined(_OPENMP)
 #pragma omp parallel for
 #endif
-	for (int i = 0; i < cloudSize; ++i)
-	{
-		P3D = cloud->getPoint(i);
-		N3D = cloud->getPointNormal(i);
-
-		view(0, i) = P3D->x;
-		view(1, i) = P3D->y;
-		view(2, i) = P3D->z;
-		viewIndex(0, i) = i;
-		viewNormalX(0, i) = N3D.x;
-		viewNormalY(0, i) = N3D.y;
-		viewNormalZ(0, i) = N3D.z;
-
+		for (int i = 0; i < cloudSize; ++i)
+		{
+			const CCVector3& N = cloud->getPointNormal(i);
+			viewNormals(0, i) = N.x;
+			viewNormals(1, i) = N.y;
+			viewNormals(2, i) = N.z;
+		}
 	}
 
 	return cloudDP;
 }
-CCCoreLib::ReferenceCloud* LibpointmatcherTools::pointmatcherToCC(DP* cloud, ccPointCloud* ref)
+
+//! Converts the point indexes of a filtered cloud back to a reference cloud
+static CCCoreLib::ReferenceCloud* ToReferenceCloud(const DP& cloud, bool indexAsFeature, ccPointCloud* ref)
 {
-	typedef DP::View View;
 	CCCoreLib::ReferenceCloud* newCloud = new CCCoreLib::ReferenceCloud(ref);
+	DP::ConstView viewIndex(indexAsFeature ? cloud.getFeatureViewByName("i") : cloud.getDescriptorViewByName("i"));
 
 	//we have less points than requested?!
 	unsigned theCloudSize = ref->size();
-	unsigned newNumberOfPoints = cloud->features.cols();
+	unsigned newNumberOfPoints = static_cast<unsigned>(viewIndex.cols());
 
-	if (theCloudSize <= newNumberOfPoints)
+	if (theCloudSize <= newNumberOfPoints || newNumberOfPoints == 0)
 	{
 		ccLog::Print(QString("Nothing to subsample returning nothing"));
 		return newCloud;
-		
 	}
-	if (cloud->features.cols() == 0)
+
+	//We then add the point indexes that were returned by the filtering of the point cloud
+	//(all at once, so as to avoid locking the reference cloud for each point)
+	unsigned* indexes = newCloud->appendPointIndexSpan(newNumberOfPoints);
+	if (!indexes)
 	{
-		ccLog::Print(QString("Nothing to subsample returning nothing"));
-		return  newCloud;
-		
+		ccLog::Warning("[Libpointmatcher] Not enough memory");
+		return newCloud;
 	}
-	
-	//We then add the point indexes that were returned by the filtering of the point cloud
-	View viewIndex(cloud->getDescriptorViewByName("i"));
-	int cloudSize = static_cast<int>(newNumberOfPoints);
-#if defined(_OPENMP)
-#pragma omp parallel for
-#endif
-	for (int i = 0; i < cloudSize; ++i)
+	for (unsigned i = 0; i < newNumberOfPoints; ++i)
 	{
-		newCloud->addPointIndex(viewIndex(0, i));
+		indexes[i] = static_cast<unsigned>(viewIndex(0, i));
 	}
 
 	return newCloud;
 }
 
-DP LibpointmatcherTools::ccToPointMatcherSubsample(ccPointCloud* cloud)
+DP LibpointmatcherTools::ccToPointMatcher(ccPointCloud* cloud)
 {
-	typedef DP::Label Label;
-	typedef DP::Labels Labels;
-	typedef DP::View View;
-
-	if (cloud->size() <= 0)
-		return DP();
-	Labels featLabels;
-	Labels descLabels;
-	std::vector<bool> isFeature;
-	featLabels.push_back(Label("x", 1));
-	isFeature.push_back(true);
-	featLabels.push_back(Label("y", 1));
-	isFeature.push_back(true);
-	featLabels.push_back(Label("z", 1));
-	isFeature.push_back(true);
-
-	featLabels.push_back(Label("i", 1));
-	isFeature.push_back(false);
-
-	//featLabels.push_back(Label("pad", 1));
-
-	DP cloudDP(featLabels, descLabels, cloud->size());
-	//cloudDP.getFeatureViewByName("pad").setConstant(1);
-	// fill cloud
-	View view(cloudDP.getFeatureViewByName("x"));
-	const CCVector3* P3D;
+	return ToPointMatcher(cloud, false, false);
+}
 
-	int cloudSize = static_cast<int>(cloud->size());
-#if defined(_OPENMP)
-#pragma omp parallel for
-#endif
-	for (int i = 0; i < cloudSize; ++i)
-	{
-		P3D = cloud->getPoint(i);
-		view(0, i) = P3D->x;
-		view(1, i) = P3D->y;
-		view(2, i) = P3D->z;
-		view(3, i) = i;
+DP LibpointmatcherTools::ccNormalsToPointMatcher(ccPointCloud* cloud)
+{
+	return ToPointMatcher(cloud, true, false);
+}
 
-	}
+CCCoreLib::ReferenceCloud* LibpointmatcherTools::pointmatcherToCC(DP* cloud, ccPointCloud* ref)
+{
+	return ToReferenceCloud(*cloud, false, ref);
+}
 
-	return cloudDP;
+DP LibpointmatcherTools::ccToPointMatcherSubsample(ccPointCloud* cloud)
+{
+	return ToPointMatcher(cloud, false, true);
 }
+
 DP LibpointmatcherTools::ccNormalsToPointMatcherSubsample(ccPointCloud* cloud)
 {
-	typedef DP::Label Label;
-	typedef DP::Labels Labels;
-	typedef DP::View View;
-
-	if (cloud->size() <= 0)
-		return DP();
-	Labels featLabels;
-	Labels descLabels;
-	std::vector<bool> isFeature;
-	featLabels.push_back(Label("x", 1));
-	isFeature.push_back(true);
-	featLabels.push_back(Label("y", 1));
-	isFeature.push_back(true);
-	featLabels.push_back(Label("z", 1));
-	isFeature.push_back(true);
-
-
-	featLabels.push_back(Label("i", 1));
-	isFeature.push_back(false);
-
-	descLabels.push_back(Label("normals", 3));
-	isFeature.push_back(false);
-	isFeature.push_back(false);
-	isFeature.push_back(false);
-
-	//featLabels.push_back(Label("pad", 1));
-
-
-	DP cloudDP(featLabels, descLabels, cloud->size());
-	//cloudDP.getFeatureViewByName("pad").setConstant(1);
-	// fill cloud
-	View view(cloudDP.getFeatureViewByName("x"));
-	View viewNormalX(cloudDP.getDescriptorRowViewByName("normals", 0));
-	View viewNormalY(cloudDP.getDescriptorRowViewByName("normals", 1));
-	View viewNormalZ(cloudDP.getDescriptorRowViewByName("normals", 2));
-	const CCVector3* P3D;
-	CCVector3 N3D;
-	int cloudSize = static_cast<int>(cloud->size());
-#if defined(_OPENMP)
-#pragma omp parallel for
-#endif
-	for (int i = 0; i < cloudSize; ++i)
-	{
-		P3D = cloud->getPoint(i);
-		N3D = cloud->getPointNormal(i);
-
-		view(0, i) = P3D->x;
-		view(1, i) = P3D->y;
-		view(2, i) = P3D->z;
-		view(3, i) = i;
-		viewNormalX(0, i) = N3D.x;
-		viewNormalY(0, i) = N3D.y;
-		viewNormalZ(0, i) = N3D.z;
-
-	}
-
-	return cloudDP;
+	return ToPointMatcher(cloud, true, true);
 }
+
 CCCoreLib::ReferenceCloud* LibpointmatcherTools::pointmatcherToCCSubsample(DP* cloud, ccPointCloud* ref)
 {
-	typedef DP::View View;
-	CCCoreLib::ReferenceCloud* newCloud = new CCCoreLib::ReferenceCloud(ref);
-
-	//we have less points than requested?!
-	unsigned theCloudSize = ref->size();
-	unsigned newNumberOfPoints = cloud->features.cols();
-
-	if (theCloudSize <= newNumberOfPoints)
-	{
-		ccLog::Print(QString("Nothing to subsample returning nothing"));
-		return newCloud;
-
-	}
-	if (cloud->features.cols() == 0)
-	{
-		ccLog::Print(QString("Nothing to subsample returning nothing"));
-		return  newCloud;
-
-	}
-
-	//We then add the point indexes that were returned by the filtering of the point cloud
-	View viewIndex(cloud->getFeatureViewByName("i"));
-	int cloudSize = static_cast<int>(newNumberOfPoints);
-#if defined(_OPENMP)
-#pragma omp parallel for
-#endif
-	for (int i = 0; i < cloudSize; ++i)
-	{
-		newCloud->addPointIndex(viewIndex(0, i));
-	}
-
-	return newCloud;
+	return ToReferenceCloud(*cloud, true, ref);
 }
 
 DP  LibpointmatcherTools::filter(DP cloud, std::vector< std::shared_ptr<PM::DataPointsFilter>> filters, std::shared_ptr<PM::DataPointsFilter> normalParams, std::vector<bool> needNormals, bool hasNormalDescriptors)
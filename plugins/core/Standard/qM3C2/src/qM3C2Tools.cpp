@@ -92,10 +92,19 @@ void ComputeCorePointNormal(unsigned index)
 			double radius = s_corePointsNormalsParams.radii[radiiCount - 1 - i]; //we start from the biggest
 			double squareRadius = radius*radius;
 
+			//fill the subset at once (no lock per point)
 			subset.clear(false);
+			unsigned* subsetIndexes = subset.appendPointIndexSpan(static_cast<unsigned>(n));
+			if (!subsetIndexes)
+			{
+				//not enough memory
+				break;
+			}
+			unsigned subsetSize = 0;
 			for (unsigned j = 0; j < static_cast<unsigned>(n); ++j)
 				if (neighbours[j].squareDistd <= squareRadius)
-					subset.addPointIndex(neighbours[j].pointIndex);
+					subsetIndexes[subsetSize++] = neighbours[j].pointIndex;
+			subset.resize(subsetSize);
 
 			//as we start from the biggest neighborhood, if we have less than 3 points for the current radius
 			//it won't be better for the next one(s)!
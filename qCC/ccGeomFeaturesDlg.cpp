@@ -17,10 +17,16 @@
 
 #include "ccGeomFeaturesDlg.h"
 
+//qCC_db
+#include <ccLog.h>
+
 //Qt
 #include <QPushButton>
 #include <QDialogButtonBox>
 
+//system
+#include <algorithm>
+
 ccGeomFeaturesDlg::ccGeomFeaturesDlg(QWidget* parent/*=nullptr*/)
 	: QDialog(parent, Qt::Tool)
 	, Ui::GeomFeaturesDialog()
@@ -110,6 +116,31 @@ void ccGeomFeaturesDlg::setRadius(double r)
 	radiusDoubleSpinBox->setValue(r);
 }
 
+std::vector<double> ccGeomFeaturesDlg::getRadii() const
+{
+	std::vector<double> radii{ getRadius() };
+
+	QStringList radiiStr = additionalRadiiLineEdit->text().simplified().split(QChar(' '), QString::SkipEmptyParts);
+	for (const QString& radiusStr : radiiStr)
+	{
+		bool ok = false;
+		double radius = radiusStr.toDouble(&ok);
+		if (ok && radius > 0)
+		{
+			radii.push_back(radius);
+		}
+		else
+		{
+			ccLog::Warning(QString("[Geometric features] Invalid radius: '%1' (ignored)").arg(radiusStr));
+		}
+	}
+
+	std::sort(radii.begin(), radii.end());
+	radii.erase(std::unique(radii.begin(), radii.end()), radii.end());
+
+	return radii;
+}
+
 void ccGeomFeaturesDlg::reset()
 {
 	for (const Option& opt : m_options)
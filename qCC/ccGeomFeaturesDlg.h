@@ -42,6 +42,8 @@ public:
 	void setRadius(double r);
 	//! Returns	the kernel radius (for 'precise' mode only)
 	double getRadius() const;
+	//! Returns all the kernel radii (the main one and the additional ones, in increasing order)
+	std::vector<double> getRadii() const;
 
 	//! Reset the whole dialog
 	void reset();
@@ -16,6 +16,7 @@
 //##########################################################################
 
 #include "ccImageDrawer.h"
+#include "ccPanoramaProjectionCache.h"
 
 #include <ManualSegmentationTools.h>
 #include <SquareMatrix.h>
@@ -97,6 +98,8 @@ ccImageDrawer::ccImageDrawer(QWidget *parent) : QWidget(parent)
 , m_radio_plane("Plan")
 , m_radio_poly("Polyline")
 , m_radio_cross("Cross Section")
+, m_imageScale(1.0)
+, m_projectedCloudID(ccUniqueIDGenerator::InvalidUniqueID)
 {
 	m_button_ok.setText("Create Plane");
 	m_button_ok.setParent(this);
@@ -287,29 +290,41 @@ void ccImageDrawer::initPolyObject() {
 	MainWindow::TheInstance()->addToDB(m_polylineObject);
 }
 
-bool ccImageDrawer::setImage(QPixmap &image) {
-	if (image.width()<=0 || image.height() <= 0)
+bool ccImageDrawer::setImage(QPixmap &image, qreal scale/*=1.0*/) {
+	if (image.width()<=0 || image.height() <= 0 || scale <= 0)
 	{
 		return false;
 	}
-	qreal rw = static_cast<qreal>(width()) / static_cast<qreal>(image.width());
-	qreal rh = static_cast<qreal>(height()) / static_cast<qreal>(image.height()/2);// height is /2 because we dont need top and bottom
+	m_image = QPixmap(image);
+	m_image_backup = QPixmap(image);
+	m_imageScale = scale;
+
+	qreal rw = static_cast<qreal>(width()) / static_cast<qreal>(imageWidth());
+	qreal rh = static_cast<qreal>(height()) / static_cast<qreal>(imageHeight()/2);// height is /2 because we dont need top and bottom
 	if (rh < rw) { rw = rh; }
 
 	if(m_tf_scale.isIdentity() && m_tf_trans.isIdentity())
 	{
 		m_tf_rotate = 0;
 		m_tf_scale.scale(rw, rw);
-		m_tf_trans.translate(0, -(image.height() / 4));
+		m_tf_trans.translate(0, -(imageHeight() / 4));
 	}
-	m_image = QPixmap(image);
-	m_image_backup = QPixmap(image);
 	bright(m_bright.value());
 	contrast(m_contrast.value());
 	update();
 	return true;
 }
 
+int ccImageDrawer::imageWidth() const
+{
+	return qRound(m_image.width() * m_imageScale);
+}
+
+int ccImageDrawer::imageHeight() const
+{
+	return qRound(m_image.height() * m_imageScale);
+}
+
 void ccImageDrawer::setBrushParameters(qreal opacity, QColor color) {
 	m_opacity = opacity;
 	m_brush_color = color;
@@ -325,16 +340,16 @@ void ccImageDrawer::paintEvent(QPaintEvent *event) {
 	painter.begin(this);
 
 	QTransform rotating;
-	rotating.translate(m_image.width() / 2, m_image.height() / 2);
+	rotating.translate(imageWidth() / 2, imageHeight() / 2);
 	rotating.rotate(m_tf_rotate);
-	rotating.translate(-m_image.width() / 2, -m_image.height() / 2);
+	rotating.translate(-imageWidth() / 2, -imageHeight() / 2);
 
 	painter.setWorldTransform(rotating * m_tf_trans * m_tf_scale, true);
 
 	switch (m_draw_type)
 	{
 		case DRAW_PLANE:
-			painter.drawPixmap(0, 0, m_image);
+			painter.drawPixmap(QRectF(0, 0, imageWidth(), imageHeight()), m_image, QRectF(m_image.rect()));
 			m_brush.setColor(QColor(150, 0, 0));
 			m_brush.setStyle(Qt::SolidPattern);
 			m_pen.setColor(QColor(255, 0, 0));
@@ -345,7 +360,7 @@ void ccImageDrawer::paintEvent(QPaintEvent *event) {
 			painter.drawPolygon(m_polygon);
 			break;
 		case DRAW_POLYLINE:
-			painter.drawPixmap(0, 0, m_image);
+			painter.drawPixmap(QRectF(0, 0, imageWidth(), imageHeight()), m_image, QRectF(m_image.rect()));
 			m_pen.setColor(QColor(255, 0, 0));
 			m_pen.setWidth(20);
 			painter.setBrush(m_brush);
@@ -354,7 +369,7 @@ void ccImageDrawer::paintEvent(QPaintEvent *event) {
 			painter.drawPolyline(m_polygon);
 			break;
 		case DRAW_SECTION:
-			painter.drawPixmap(0, 0, m_image);
+			painter.drawPixmap(QRectF(0, 0, imageWidth(), imageHeight()), m_image, QRectF(m_image.rect()));
 			m_pen.setColor(QColor(255, 0, 0));
 			m_pen.setWidth(20);
 			painter.setBrush(m_brush);
@@ -363,7 +378,7 @@ void ccImageDrawer::paintEvent(QPaintEvent *event) {
 			if (m_polygon.size() == 1)
 			{
 				QPoint pt1(0, m_polygon[0].y());
-				QPoint pt2(m_image.width() - 1, m_polygon[0].y());
+				QPoint pt2(imageWidth() - 1, m_polygon[0].y());
 				QPolygon tempPoly;
 				tempPoly.push_back(pt1);
 				tempPoly.push_back(pt2);
@@ -457,12 +472,12 @@ void ccImageDrawer::callbackClear() {
 
 void ccImageDrawer::callbackExpand() {
 
-	if (m_image.width() <= 0 || m_image.height() <= 0)
+	if (imageWidth() <= 0 || imageHeight() <= 0)
 	{
 		return;
 	}
-	qreal rw = static_cast<qreal>(width()) / static_cast<qreal>(m_image.width());
-	qreal rh = static_cast<qreal>(height()) / static_cast<qreal>(m_image.height() / 2);// height is /2 because we dont need top and bottom
+	qreal rw = static_cast<qreal>(width()) / static_cast<qreal>(imageWidth());
+	qreal rh = static_cast<qreal>(height()) / static_cast<qreal>(imageHeight() / 2);// height is /2 because we dont need top and bottom
 	if (rh < rw) { rw = rh; }
 
 	m_tf_scale = QTransform();
@@ -470,7 +485,7 @@ void ccImageDrawer::callbackExpand() {
 
 	m_tf_rotate = 0;
 	m_tf_scale.scale(rw, rw);
-	m_tf_trans.translate(0, -(m_image.height() / 4));
+	m_tf_trans.translate(0, -(imageHeight() / 4));
 	update();
 }
 
@@ -567,7 +582,7 @@ void ccImageDrawer::togglePause()
 }
 bool ccImageDrawer::isInsideImage(QPoint point)
 {
-	QSize imageSize = m_image.size();
+	QSize imageSize(imageWidth(), imageHeight());
 	if (point.x() >= 0 && point.x() <= imageSize.width() && point.y() >= 0 && point.y() <= imageSize.height())
 	{
 		return true;
@@ -592,9 +607,9 @@ void ccImageDrawer::mousePressEvent(QMouseEvent *event) {
 			
 			
 			QTransform rotating;
-			rotating.translate(m_image.width() / 2, m_image.height() / 2);
+			rotating.translate(imageWidth() / 2, imageHeight() / 2);
 			rotating.rotate(m_tf_rotate);
-			rotating.translate(-m_image.width() / 2, -m_image.height() / 2);
+			rotating.translate(-imageWidth() / 2, -imageHeight() / 2);
 			QTransform tf = rotating * m_tf_trans * m_tf_scale;
 
 			if (isInsideImage(tf.inverted().map(event->pos())))
@@ -781,16 +796,16 @@ void ccImageDrawer::generateSquarePolygonFromPoint(QPoint pt, float squareWidth)
 		pt.y() - squareWidth > 0 ? pt.y() - squareWidth : 0,
 		0);
 	// topRight
-	CCVector3 topRight(pt.x() + squareWidth > (float)m_image.width() ? pt.x() + squareWidth : (float)m_image.width(),
+	CCVector3 topRight(pt.x() + squareWidth > (float)imageWidth() ? pt.x() + squareWidth : (float)imageWidth(),
 		pt.y() - squareWidth > 0 ? pt.y() - squareWidth : 0,
 		0);
 	// bottomRight
-	CCVector3 bottomRight(pt.x() + squareWidth > (float)m_image.width() ? pt.x() + squareWidth : (float)m_image.width(),
-		pt.y() + squareWidth > (float)m_image.height() ? pt.y() + squareWidth : (float)m_image.height(),
+	CCVector3 bottomRight(pt.x() + squareWidth > (float)imageWidth() ? pt.x() + squareWidth : (float)imageWidth(),
+		pt.y() + squareWidth > (float)imageHeight() ? pt.y() + squareWidth : (float)imageHeight(),
 		0);
 	// bottomLeft
 	CCVector3 bottomLeft(pt.x() - squareWidth > 0 ? pt.x() - squareWidth : 0,
-		pt.y() + squareWidth > (float)m_image.height() ? pt.y() + squareWidth : (float)m_image.height(),
+		pt.y() + squareWidth > (float)imageHeight() ? pt.y() + squareWidth : (float)imageHeight(),
 		0);
 
 
@@ -864,25 +879,8 @@ void ccImageDrawer::sectionToPoly(float degPrecision)
 	// Get the point cloud of the biggest rectangle based on the polyline
 	ccGLWindow* glWindow = MainWindow::GetActiveGLWindow();
 	ccPointCloud* pointCloud = MainWindow::TheInstance()->ccGetStichedImageViewer()->getCurrentPointCloud();
-	std::vector<double> transform = m_viewParameters;
 	double maxDist = m_zFar;
-	float pxPrecision = degPrecision / 360 * m_image.width();
-
-
-	ccGLMatrixd poseMat;
-	CCCoreLib::SquareMatrixd rotMat(3);
-	double quaternion[4];
-	quaternion[0] = transform[3];
-	quaternion[1] = transform[4];
-	quaternion[2] = transform[5];
-	quaternion[3] = transform[6];
-	rotMat.initFromQuaternion(quaternion);
-	rotMat.toGlMatrix(poseMat.data());
-	poseMat.getTranslation()[0] = transform[0];
-	poseMat.getTranslation()[1] = transform[1];
-	poseMat.getTranslation()[2] = transform[2];
-	// Inverting mat for points
-	poseMat.invert();
+	float pxPrecision = degPrecision / 360 * imageWidth();
 
 	if (!glWindow || !pointCloud)
 	{
@@ -904,17 +902,20 @@ void ccImageDrawer::sectionToPoly(float degPrecision)
 	ccGenericPointCloud* cloud = ccHObjectCaster::ToGenericPointCloud(pointCloud);
 	if (!cloud) { return; };
 
-	int cloudSize = static_cast<int>(cloud->size());
-	//we project each point and we check if it falls inside the segmentation polyline
-	bool atLeast1point = false;
-	// We create a temporary pair of xyz and uvz in order accelerate speed (act as the points kept in the whole cloud)
-
+	// Projection of the cloud in the current panorama (cached)
+	ccPanoramaProjectionCache::ProjectionShared projection = currentProjection(cloud);
+	if (!projection)
+	{
+		ccLog::Error("Failed to project the cloud in the panorama");
+		return;
+	}
+	const std::vector<ccPanoramaProjectionCache::ProjectedPoint>& projectedPoints = projection->points();
 
 	// we create the segmentation polyline  (the big big retangle)
 
 	// Get min and max
-	float maxX = m_image.width();
-	float maxY = m_polygon[0].y() + 2*pxPrecision > m_image.height()? m_image.height():m_polygon[0].y() + 2*pxPrecision;
+	float maxX = imageWidth();
+	float maxY = m_polygon[0].y() + 2*pxPrecision > imageHeight()? imageHeight():m_polygon[0].y() + 2*pxPrecision;
 	float minX = 0;
 	float minY =  m_polygon[0].y() - 2*pxPrecision < 0 ? 0 : m_polygon[0].y() - 2*pxPrecision;
 
@@ -939,53 +940,10 @@ void ccImageDrawer::sectionToPoly(float degPrecision)
 	// Closing Polyline 
 	m_segmentationPoly->setClosed(true);
 
-	ccPointCloud* cloudSegmented = new ccPointCloud();
-	ccPointCloud* cloudHpr = new ccPointCloud();
-	cloudSegmented->reserve(static_cast<unsigned>(cloudSize));
-	for (int i = 0; i < cloudSize; ++i)
-	{
-		CCVector3d P3D(cloud->getPoint(i)->x, cloud->getPoint(i)->y, cloud->getPoint(i)->z);
-
-		CCVector3d Q2D;
-		projectSpherical(P3D, Q2D, poseMat);
-		bool pointInside = false;
-
-		if (Q2D.z <= maxDist)
-		{
-			CCVector2 P2D(static_cast<PointCoordinateType>(Q2D.x),
-				static_cast<PointCoordinateType>(Q2D.y));
-
-			pointInside = CCCoreLib::ManualSegmentationTools::isPointInsidePoly(P2D, m_segmentationPoly);
-
-		}
-		if (pointInside)
-		{
-			atLeast1point = true;
-			// add to temp point cloud
-			cloudSegmented->addPoint(*cloud->getPoint(i));
-		}
-	}
-	
-	//cloudHpr = doAction(cloudSegmented, CCVector3d(transform[0], transform[1], transform[2]));
-	*cloudHpr = *cloudSegmented;
-	delete cloudSegmented;
-	
-	//get all the points to a pair
-	std::vector<std::pair<CCVector3d, CCVector3d>> tempCloud;
-	for (int i = 0; i < cloudHpr->size(); i++)
-	{
-		CCVector3d P3D(cloudHpr->getPoint(i)->x, cloudHpr->getPoint(i)->y, cloudHpr->getPoint(i)->z);
-		CCVector3d Q2D;
-		projectSpherical(P3D, Q2D, poseMat);
-		tempCloud.push_back(std::make_pair(P3D, Q2D));
-	}
-	delete cloudHpr;
-	
-
 	// generate smoother polygon line
 	float xAccumulated = 0;
 	std::vector<CCVector2> ptList;
-	while (xAccumulated < m_image.width())
+	while (xAccumulated < imageWidth())
 	{
 		CCVector2 P2D(xAccumulated, m_polygon[0].y());
 		ptList.push_back(P2D);
@@ -999,23 +957,22 @@ void ccImageDrawer::sectionToPoly(float degPrecision)
 	finalPolyline->setColor(ccColor::Rgb(255, 0, 0));
 	finalPolyline->setWidth(2);
 	int polylineId = 0;
+	std::vector<unsigned> candidates;
 	for (int j = 0; j < ptList.size(); j++)
 	{
 		float u = ptList[j][0];
 		float v = ptList[j][1];
 		int ptsFound = 0;
 		CCVector3d P3D(0, 0, 0);
-		float xSum = 0;
-		float ySum = 0;
-		float zSum = 0;
-		for (int i = 0; i < tempCloud.size(); ++i)
+		// Finding points (only in the buckets around (u, v), inside the section rectangle)
+		projection->getPointsInRect(std::max(u - pxPrecision, minX), std::max(v - pxPrecision, minY), std::min(u + pxPrecision, maxX), std::min(v + pxPrecision, maxY), maxDist, candidates);
+		for (unsigned pos : candidates)
 		{
-			// Findind points
-			CCVector3d P2D = tempCloud[i].second;
-			float ptDistance = sqrt(pow(u - P2D[0], 2) + pow(v - P2D[1], 2));
+			const ccPanoramaProjectionCache::ProjectedPoint& P2D = projectedPoints[pos];
+			float ptDistance = sqrt(pow(u - P2D.u, 2) + pow(v - P2D.v, 2));
 			if (ptDistance < pxPrecision)
 			{
-				P3D += tempCloud[i].first;
+				P3D += CCVector3d::fromArray(cloud->getPoint(P2D.index)->u);
 				ptsFound++;
 			}
 		}
@@ -1088,7 +1045,7 @@ void ccImageDrawer::segmentToPoly(float degPrecision, bool exportImage)
 	ccPointCloud* pointCloud = MainWindow::TheInstance()->ccGetStichedImageViewer()->getCurrentPointCloud();
 	std::vector<double> transform = m_viewParameters;
 	double maxDist = m_zFar;
-	float pxPrecision = degPrecision / 360 * m_image.width();
+	float pxPrecision = degPrecision / 360 * imageWidth();
 
 
 	ccGLMatrixd poseMat;
@@ -1126,20 +1083,22 @@ void ccImageDrawer::segmentToPoly(float degPrecision, bool exportImage)
 	ccGenericPointCloud* cloud = ccHObjectCaster::ToGenericPointCloud(pointCloud);
 	if (!cloud) { return; };
 
-	int cloudSize = static_cast<int>(cloud->size());
-	//we project each point and we check if it falls inside the segmentation polyline
-	bool atLeast1point = false;
-
-	// We create a temporary pair of xyz and uvz in order accelerate speed (act as the points kept in the whole cloud)
-	
+	// Projection of the cloud in the current panorama (cached)
+	ccPanoramaProjectionCache::ProjectionShared projection = currentProjection(cloud);
+	if (!projection)
+	{
+		ccLog::Error("Failed to project the cloud in the panorama");
+		return;
+	}
+	const std::vector<ccPanoramaProjectionCache::ProjectedPoint>& projectedPoints = projection->points();
 
 	// we create the segmentation polyline  (the big big retangle)
 
 	// Get min and max
 	float maxX = 0;
 	float maxY = 0;
-	float minX = m_image.width();
-	float minY = m_image.height();
+	float minX = imageWidth();
+	float minY = imageHeight();
 
 	for (int i = 0; i < m_polygon.count(); i++)
 	{
@@ -1163,13 +1122,13 @@ void ccImageDrawer::segmentToPoly(float degPrecision, bool exportImage)
 	}
 
 	float paddingPx = 100;
-	float maxXImg = maxX + paddingPx > (float)m_image.width() ? (float)m_image.width() : maxX + paddingPx;
-	float maxYImg = maxY + paddingPx > (float)m_image.height() ? (float)m_image.height() : maxY + paddingPx;
+	float maxXImg = maxX + paddingPx > (float)imageWidth() ? (float)imageWidth() : maxX + paddingPx;
+	float maxYImg = maxY + paddingPx > (float)imageHeight() ? (float)imageHeight() : maxY + paddingPx;
 	float minXImg = minX - paddingPx < 0 ? 0 : minX - paddingPx;
 	float minYImg = minY - paddingPx < 0 ? 0 : minY - paddingPx;
 
-	maxX = maxX + pxPrecision > (float)m_image.width() ? (float)m_image.width() : maxX + pxPrecision;
-	maxY = maxY + pxPrecision > (float)m_image.height() ? (float)m_image.height() : maxY + pxPrecision;
+	maxX = maxX + pxPrecision > (float)imageWidth() ? (float)imageWidth() : maxX + pxPrecision;
+	maxY = maxY + pxPrecision > (float)imageHeight() ? (float)imageHeight() : maxY + pxPrecision;
 	minX = minX - pxPrecision < 0 ? 0 : minX - pxPrecision;
 	minY = minY - pxPrecision < 0 ? 0 : minY - pxPrecision;
 
@@ -1197,36 +1156,36 @@ void ccImageDrawer::segmentToPoly(float degPrecision, bool exportImage)
 	// Closing Polyline 
 	m_segmentationPoly->setClosed(true);
 
-	ccPointCloud* cloudSegmented = new ccPointCloud;
-	ccPointCloud* cloudHpr = new ccPointCloud;
+	// only the points of the buckets overlapping the rectangle are tested
+	std::vector<unsigned> candidates;
+	projection->getPointsInRect(minX, minY, maxX, maxY, maxDist, candidates);
 
-	for (int i = 0; i < cloudSize; ++i)
+	ccPointCloud* cloudSegmented = new ccPointCloud;
+	if (!cloudSegmented->reserve(static_cast<unsigned>(candidates.size())))
 	{
-		CCVector3d P3D(cloud->getPoint(i)->x, cloud->getPoint(i)->y, cloud->getPoint(i)->z);
-
-		CCVector3d Q2D;
-		projectSpherical(P3D, Q2D, poseMat);
-		bool pointInside = false;
-
-		if (Q2D.z <= maxDist)
-		{
-			CCVector2 P2D(static_cast<PointCoordinateType>(Q2D.x),
-				static_cast<PointCoordinateType>(Q2D.y));
-
-			pointInside = CCCoreLib::ManualSegmentationTools::isPointInsidePoly(P2D, m_segmentationPoly);
-
-		}
-		if (pointInside)
-		{
-			atLeast1point = true;
-			// add to temp point cloud
-			cloudSegmented->addPoint(*cloud->getPoint(i));
-		}
+		ccLog::Error("Not enough memory");
+		delete cloudSegmented;
+		return;
+	}
+	for (unsigned pos : candidates)
+	{
+		const ccPanoramaProjectionCache::ProjectedPoint& P = projectedPoints[pos];
+		// add to temp point cloud
+		cloudSegmented->addPoint(*cloud->getPoint(P.index));
 	}
 
-	cloudHpr = doAction(cloudSegmented, CCVector3d(transform[0], transform[1], transform[2]));
+	ccPointCloud* cloudHpr = doAction(cloudSegmented, CCVector3d(transform[0], transform[1], transform[2]));
 	//*cloudHpr = *cloudSegmented;
 	delete cloudSegmented;
+	if (!cloudHpr)
+	{
+		ccLog::Error("Hidden points removal failed");
+		if (m_pointCloudIsHidden)
+		{
+			pointCloud->setEnabled(false);
+		}
+		return;
+	}
 
 	//get all the points to a pair
 	std::vector<std::pair<CCVector3d, CCVector3d>> tempCloud;
@@ -1322,7 +1281,26 @@ void ccImageDrawer::segmentToPoly(float degPrecision, bool exportImage)
 		}
 		ccImage* polyImage(new ccImage());
 		QRect rect(QPoint(minXImg, minYImg), QPoint(maxXImg, maxYImg));
-		QImage croppedImage = m_image.toImage().copy(rect);
+		QImage croppedImage;
+		if (m_imageScale != 1.0)
+		{
+			//the displayed image is a downscaled preview: crop the full resolution image instead
+			QImage fullImage = MainWindow::TheInstance()->ccGetStichedImageViewer()->displayedFullResolutionImage();
+			if (!fullImage.isNull())
+			{
+				croppedImage = fullImage.copy(rect);
+			}
+			else
+			{
+				ccLog::Warning("Full resolution image not available, the crack image is cropped from the preview");
+				rect = QRectF(rect.x() / m_imageScale, rect.y() / m_imageScale, rect.width() / m_imageScale, rect.height() / m_imageScale).toAlignedRect();
+				croppedImage = m_image.toImage().copy(rect);
+			}
+		}
+		else
+		{
+			croppedImage = m_image.toImage().copy(rect);
+		}
 		polyImage->setData(croppedImage);
 		polyImage->setName(QString("ImageCrack_z%2m-%1").arg(nbrId).arg((int)bbMax.z));
 		m_polylineObject->addChild(polyImage);
@@ -1336,26 +1314,8 @@ bool ccImageDrawer::segmentSpherical(bool keepPointsInside)
 {
 	ccGLWindow* glWindow = MainWindow::GetActiveGLWindow();
 	ccPointCloud* pointCloud = MainWindow::TheInstance()->ccGetStichedImageViewer()->getCurrentPointCloud();
-	std::vector<double> transform = m_viewParameters;
-
-
 	double maxDist = m_zFar;
 
-	ccGLMatrixd poseMat;
-	CCCoreLib::SquareMatrixd rotMat(3);
-	double quaternion[4];
-	quaternion[0] = transform[3];
-	quaternion[1] = transform[4];
-	quaternion[2] = transform[5];
-	quaternion[3] = transform[6];
-	rotMat.initFromQuaternion(quaternion);
-	rotMat.toGlMatrix(poseMat.data());
-	poseMat.getTranslation()[0] = transform[0];
-	poseMat.getTranslation()[1] = transform[1];
-	poseMat.getTranslation()[2] = transform[2];
-	// Inverting mat for points
-	poseMat.invert();
-
 	if (!glWindow || !pointCloud)
 	{
 		return false;
@@ -1389,46 +1349,89 @@ bool ccImageDrawer::segmentSpherical(bool keepPointsInside)
 		cloud->resetVisibilityArray();
 	};
 	int cloudSize = static_cast<int>(cloud->size());
-	//we project each point and we check if it falls inside the segmentation polyline
-	bool atLeast1point = false;
-	
-#if defined(_OPENMP)
-#pragma omp parallel for
-#endif
-	
-	//for (int i = 0; i < pointIndexInsideRadius.size(); ++i)
-	
 
-	for (int i = 0; i < cloudSize; ++i)
+	// Projection of the cloud in the current panorama (cached: re-segmenting the same panorama is almost free)
+	ccPanoramaProjectionCache::ProjectionShared projection = currentProjection(cloud);
+	if (!projection)
 	{
-		//int idxPt = pointIndexInsideRadius[i].pointIndex;
-		//if (visibilityArray[idxPt] == CCCoreLib::POINT_VISIBLE)
-		if (visibilityArray[i] == CCCoreLib::POINT_VISIBLE)
-		{
-			
-			CCVector3d P3D(cloud->getPoint(i)->x, cloud->getPoint(i)->y, cloud->getPoint(i)->z);
-			//CCVector3d P3D(cloud->getPoint(idxPt)->x, cloud->getPoint(idxPt)->y, cloud->getPoint(idxPt)->z);
-			//const CCVector3* P3Dinfo = pointIndexInsideRadius[i].point;
+		ccLog::Error("Failed to project the cloud in the panorama");
+		return false;
+	}
+	const std::vector<ccPanoramaProjectionCache::ProjectedPoint>& projectedPoints = projection->points();
 
-			CCVector3d Q2D;
-			//if (i % 1000000 == 0) { ccLog::Print(QString("Points before projection x: %1m y: %2m z: %3m").arg(P3D.x).arg(P3D.y).arg(P3D.z)); }
-			projectSpherical(P3D, Q2D, poseMat);
-			//if (i % 1000000 == 0) { ccLog::Print(QString("Points value from projection x: %1px y: %2px z: %3m").arg(Q2D.x).arg(Q2D.y).arg(Q2D.z)); }
-			bool pointInside = false;
+	// only the points of the buckets overlapping the polygon bounding-box are tested
+	CCVector3 polyMin;
+	CCVector3 polyMax;
+	m_segmentationPoly->getBoundingBox(polyMin, polyMax);
+	std::vector<unsigned> candidates;
+	projection->getPointsInRect(polyMin.x, polyMin.y, polyMax.x, polyMax.y, maxDist, candidates);
 
-			if (Q2D.z <= maxDist)
+	//we check if the (visible) candidates fall inside the segmentation polyline
+	int candidateCount = static_cast<int>(candidates.size());
+	std::vector<unsigned char> inside(candidates.size(), 0);
+	int insideCount = 0;
+#if defined(_OPENMP)
+#pragma omp parallel for reduction(+:insideCount)
+#endif
+	for (int i = 0; i < candidateCount; ++i)
+	{
+		const ccPanoramaProjectionCache::ProjectedPoint& P = projectedPoints[candidates[i]];
+		if (visibilityArray[P.index] == CCCoreLib::POINT_VISIBLE)
+		{
+			CCVector2 P2D(static_cast<PointCoordinateType>(P.u), static_cast<PointCoordinateType>(P.v));
+			if (CCCoreLib::ManualSegmentationTools::isPointInsidePoly(P2D, m_segmentationPoly))
 			{
-				CCVector2 P2D(static_cast<PointCoordinateType>(Q2D.x),
-					static_cast<PointCoordinateType>(Q2D.y));
+				inside[i] = 1;
+				++insideCount;
+			}
+		}
+	}
 
-				pointInside = CCCoreLib::ManualSegmentationTools::isPointInsidePoly(P2D, m_segmentationPoly);
+	if (keepPointsInside)
+	{
+		//the visible points outside of the polyline stay visible
+		for (int i = 0; i < candidateCount; ++i)
+		{
+			if (inside[i])
+			{
+				visibilityArray[projectedPoints[candidates[i]].index] = CCCoreLib::POINT_HIGHLIGHTED;
+			}
+		}
+	}
+	else
+	{
+		//all the visible points outside of the polyline are highlighted
+		std::vector<unsigned char> insideMask;
+		try
+		{
+			insideMask.resize(cloudSize, 0);
+		}
+		catch (const std::bad_alloc&)
+		{
+			ccLog::Error("Not enough memory");
+			return false;
+		}
+		for (int i = 0; i < candidateCount; ++i)
+		{
+			if (inside[i])
+			{
+				insideMask[projectedPoints[candidates[i]].index] = 1;
+			}
+		}
 
+#if defined(_OPENMP)
+#pragma omp parallel for
+#endif
+		for (int i = 0; i < cloudSize; ++i)
+		{
+			if (visibilityArray[i] == CCCoreLib::POINT_VISIBLE && !insideMask[i])
+			{
+				visibilityArray[i] = CCCoreLib::POINT_HIGHLIGHTED;
 			}
-			if (pointInside) { atLeast1point = true; }
-			//visibilityArray[idxPt] = (keepPointsInside != pointInside ? CCCoreLib::POINT_VISIBLE : CCCoreLib::POINT_HIGHLIGHTED);
-			visibilityArray[i] = (keepPointsInside != pointInside ? CCCoreLib::POINT_VISIBLE : CCCoreLib::POINT_HIGHLIGHTED);
 		}
 	}
+	bool atLeast1point = (insideCount != 0);
+
 	if (m_pointCloudIsHidden)
 	{
 		pointCloud->setEnabled(false);
@@ -1440,19 +1443,21 @@ bool ccImageDrawer::segmentSpherical(bool keepPointsInside)
 	return atLeast1point;
 }
 
+ccPanoramaProjectionCache::ProjectionShared ccImageDrawer::currentProjection(ccGenericPointCloud* cloud)
+{
+	//the projections of the previously projected cloud are released (it may even have been deleted)
+	if (cloud && cloud->getUniqueID() != m_projectedCloudID)
+	{
+		m_projectionCache.clear(m_projectedCloudID);
+		m_projectedCloudID = cloud->getUniqueID();
+	}
+
+	return m_projectionCache.projection(cloud, m_viewParameters, imageWidth(), imageHeight(), m_zFar);
+}
+
 void ccImageDrawer::projectSpherical(CCVector3d P3D, CCVector3d &Q2D, ccGLMatrixd poseMat)
 {
-	poseMat.apply(P3D);
-	// Transform to spherical
-	double radius = P3D.norm(); // radius
-	double theta = atan2(P3D.x, P3D.y); // longitude
-	double phi = asin(P3D.z / radius); // latitude
-	// Convert to the size of the image 
-	float u = ((float)m_image.width() / 2) * ( 1 + theta / M_PI);
-	float v = ((float)m_image.height() / 2) * (1 - phi / M_PI_2);
-
-	Q2D = CCVector3d(u, v, radius);
-	return;
+	ccPanoramaProjectionCache::ProjectSpherical(poseMat, imageWidth(), imageHeight(), P3D, Q2D);
 }
 
 
@@ -1599,8 +1604,19 @@ void ccImageDrawer::createPlan(ccPointCloud* pointCloud)
 
 bool ccImageDrawer::setImageInformation(ccImage* imageCC, std::vector<double> viewParameters)
 {
-	
-	if (!setImage(QPixmap::fromImage(imageCC->data())))
+	if (!imageCC)
+	{
+		ccLog::Error("Could not load the image associated to the node");
+		return false;
+	}
+
+	return setImageInformation(imageCC->data(), viewParameters);
+}
+
+bool ccImageDrawer::setImageInformation(const QImage& image, std::vector<double> viewParameters, double scale/*=1.0*/)
+{
+	QPixmap pixmap = QPixmap::fromImage(image);
+	if (image.isNull() || !setImage(pixmap, scale))
 	{
 		ccLog::Error("Could not load the image associated to the node");
 		return false;
@@ -1753,7 +1769,6 @@ ccPointCloud* ccImageDrawer::doAction(ccPointCloud* cloud, CCVector3d viewPoint)
 
 		CCCoreLib::ReferenceCloud visiblePoints(theOctree->associatedCloud());
 
-		unsigned visiblePointCount = 0;
 		unsigned visibleCellsCount = visibleCells->size();
 
 		CCCoreLib::DgmOctree::cellIndexesContainer cellIndexes;
@@ -1768,16 +1783,8 @@ ccPointCloud* ccImageDrawer::doAction(ccPointCloud* cloud, CCVector3d viewPoint)
 			//cell index
 			unsigned index = visibleCells->getPointGlobalIndex(i);
 
-			//points in this cell...
-			CCCoreLib::ReferenceCloud Yk(theOctree->associatedCloud());
-			theOctree->getPointsInCellByCellIndex(&Yk, cellIndexes[index], static_cast<unsigned char>(octreeLevel));
-			//...are all visible
-			/*unsigned count = Yk.size();
-			for (unsigned j=0;j<count;++j)
-				pointsVisibility->setValue(Yk.getPointGlobalIndex(j),POINT_VISIBLE);
-			visiblePointCount += count;
-			*/
-			if (!visiblePoints.add(Yk))
+			//points in this cell are all visible (directly appended to the visible points)
+			if (!theOctree->getPointsInCellByCellIndex(&visiblePoints, cellIndexes[index], static_cast<unsigned char>(octreeLevel), false))
 			{
 				ccLog::Error("Not enough memory!");
 				return resultCloud;
@@ -1786,7 +1793,7 @@ ccPointCloud* ccImageDrawer::doAction(ccPointCloud* cloud, CCVector3d viewPoint)
 
 		visibleCells.reset(nullptr);
 
-		ccLog::Print(QString("[HPR] Visible points: %1").arg(visiblePointCount));
+		ccLog::Print(QString("[HPR] Visible points: %1").arg(visiblePoints.size()));
 
 		if (visiblePoints.size() == cloud->size())
 		{
@@ -40,6 +40,8 @@
 
 #include <CloudSamplingTools.h>
 
+#include "ccPanoramaProjectionCache.h"
+
 enum DRAW_TYPE {
 	DRAW_PLANE,	/**< Plane **/
 	DRAW_POLYLINE,	/**< Polyline **/
@@ -68,6 +70,8 @@ private:
 
 	QPixmap m_image;
 	QPixmap m_image_backup;
+	//! Full resolution pixels per pixel of m_image (> 1 for a downscaled preview)
+	qreal m_imageScale;
 	QColor m_brush_color;
 	QPolygon m_polygon;
 	
@@ -103,12 +107,19 @@ private:
 
 	bool m_pointCloudIsHidden;
 
+	// Projections of the cloud in the panoramas (per pose, see currentProjection)
+	ccPanoramaProjectionCache m_projectionCache;
+	// Unique ID of the last projected cloud
+	unsigned m_projectedCloudID;
+	// Returns the projection of a cloud in the current panorama (m_zFar max range)
+	ccPanoramaProjectionCache::ProjectionShared currentProjection(ccGenericPointCloud* cloud);
+
 public:
 	explicit ccImageDrawer(QWidget *parent = nullptr);
 	//! Destructor
 	virtual ~ccImageDrawer();
 
-	bool setImage(QPixmap & image);
+	bool setImage(QPixmap & image, qreal scale = 1.0);
 	void setBrushParameters(qreal opacity, QColor color);
 	QPolygon getPolylines(void);
 
@@ -133,6 +144,9 @@ public:
 
 	//Image
 	bool isInsideImage(QPoint);
+	//Image size (in full resolution pixels)
+	int imageWidth() const;
+	int imageHeight() const;
 
 	//disable - enbable widget
 	void disableAllWidget();
@@ -140,6 +154,9 @@ public:
 
 	// set the pose, position true= successful false = error  block drawing
 	bool setImageInformation(ccImage* imageCC, std::vector<double> viewParameters);
+	// same as above, with an image read outside of the DB (see ccPanoramaImageStore)
+	// 'scale' is the ratio between the full resolution size and the size of 'image' (for previews)
+	bool setImageInformation(const QImage& image, std::vector<double> viewParameters, double scale = 1.0);
 
 	// Return float x,y,z,qw,qx,qy,qz
 	std::vector<double> m_viewParameters;
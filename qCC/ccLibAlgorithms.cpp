@@ -18,9 +18,11 @@
 #include "ccLibAlgorithms.h"
 
 //CCCoreLib
+#include <FlatKdTree.h>
 #include <ScalarFieldTools.h>
 
 //qCC_db
+#include <ccIndexCache.h>
 #include <ccOctree.h>
 #include <ccPointCloud.h>
 #include <ccScalarField.h>
@@ -115,68 +117,12 @@ namespace ccLibAlgorithms
 		return sigma;
 	}
 
-	bool ComputeGeomCharacteristics(const GeomCharacteristicSet& characteristics,
-									PointCoordinateType radius,
-									ccHObject::Container& entities,
-									QWidget* parent/*=nullptr*/)
-	{
-		//no feature case
-		if (characteristics.empty())
-		{
-			//nothing to do
-			assert(false);
-			return true;
-		}
-		
-		//single features case
-		if (characteristics.size() == 1)
-		{
-			return ComputeGeomCharacteristic(	characteristics.front().charac,
-												characteristics.front().subOption,
-												radius,
-												entities,
-												parent);
-		}
-
-		//multiple features case
-		QScopedPointer<ccProgressDialog> pDlg;
-		if (parent)
-		{
-			pDlg.reset(new ccProgressDialog(true, parent));
-			pDlg->setAutoClose(false);
-		}
-		
-		for (const GeomCharacteristic& g : characteristics)
-		{
-			if (!ComputeGeomCharacteristic(	g.charac,
-											g.subOption,
-											radius,
-											entities,
-											parent,
-											pDlg.data()))
-			{
-				return false;
-			}
-		}
-
-		return true;
-	}
-
-
-	bool ComputeGeomCharacteristic(	CCCoreLib::GeometricalAnalysisTools::GeomCharacteristic c,
-									int subOption,
-									PointCoordinateType radius,
-									ccHObject::Container& entities,
-									QWidget* parent/*= nullptr*/,
-									ccProgressDialog* progressDialog/*=nullptr*/)
+	//! Generates the name of the scalar field of a geometric characteristic
+	static bool GetGeomCharacteristicSFName(CCCoreLib::GeometricalAnalysisTools::GeomCharacteristic c,
+											int subOption,
+											PointCoordinateType radius,
+											QString& sfName)
 	{
-		size_t selNum = entities.size();
-		if (selNum < 1)
-			return false;
-
-		//generate the right SF name
-		QString sfName;
-
 		switch (c)
 		{
 		case CCCoreLib::GeometricalAnalysisTools::Feature:
@@ -278,6 +224,236 @@ namespace ccLibAlgorithms
 			return false;
 		}
 
+		return true;
+	}
+
+	//! Returns the message corresponding to a GeometricalAnalysisTools error code
+	static QString GetGeomCharacteristicErrorMessage(CCCoreLib::GeometricalAnalysisTools::ErrorCode result)
+	{
+		QString errorMessage;
+		switch (result)
+		{
+		case CCCoreLib::GeometricalAnalysisTools::InvalidInput:
+			errorMessage = "Internal error (invalid input)";
+			break;
+		case CCCoreLib::GeometricalAnalysisTools::NotEnoughPoints:
+			errorMessage = "Not enough points";
+			break;
+		case CCCoreLib::GeometricalAnalysisTools::OctreeComputationFailed:
+			errorMessage = "Failed to compute octree (not enough memory?)";
+			break;
+		case CCCoreLib::GeometricalAnalysisTools::ProcessFailed:
+			errorMessage = "Process failed";
+			break;
+		case CCCoreLib::GeometricalAnalysisTools::UnhandledCharacteristic:
+			errorMessage = "Internal error (unhandled characteristic)";
+			break;
+		case CCCoreLib::GeometricalAnalysisTools::NotEnoughMemory:
+			errorMessage = "Not enough memory";
+			break;
+		case CCCoreLib::GeometricalAnalysisTools::ProcessCancelledByUser:
+			errorMessage = "Process cancelled by user";
+			break;
+		default:
+			assert(false);
+			errorMessage = "Unknown error";
+			break;
+		}
+
+		return errorMessage;
+	}
+
+	bool ComputeGeomCharacteristics(const GeomCharacteristicSet& characteristics,
+									const std::vector<PointCoordinateType>& radii,
+									ccHObject::Container& entities,
+									QWidget* parent/*=nullptr*/)
+	{
+		//no feature case
+		if (characteristics.empty() || radii.empty())
+		{
+			//nothing to do
+			assert(false);
+			return true;
+		}
+		
+		//single feature case
+		if (characteristics.size() == 1 && radii.size() == 1)
+		{
+			return ComputeGeomCharacteristic(	characteristics.front().charac,
+												characteristics.front().subOption,
+												radii.front(),
+												entities,
+												parent);
+		}
+
+		//multiple features case
+		QScopedPointer<ccProgressDialog> pDlg;
+		if (parent)
+		{
+			pDlg.reset(new ccProgressDialog(true, parent));
+			pDlg->setAutoClose(false);
+		}
+
+		//the approximate density doesn't depend on the radius (it is computed apart)
+		for (const GeomCharacteristic& g : characteristics)
+		{
+			if (g.charac == CCCoreLib::GeometricalAnalysisTools::ApproxLocalDensity)
+			{
+				if (!ComputeGeomCharacteristic(g.charac, g.subOption, 0, entities, parent, pDlg.data()))
+				{
+					return false;
+				}
+			}
+		}
+
+		for (ccHObject* entity : entities)
+		{
+			if (!entity->isKindOf(CC_TYPES::POINT_CLOUD))
+			{
+				continue;
+			}
+
+			if (!entity->isA(CC_TYPES::POINT_CLOUD))
+			{
+				//we can't create the scalar fields on other types of clouds: the characteristics are computed one by one
+				ccHObject::Container cloudEntity{ entity };
+				for (PointCoordinateType radius : radii)
+				{
+					for (const GeomCharacteristic& g : characteristics)
+					{
+						if (	g.charac != CCCoreLib::GeometricalAnalysisTools::ApproxLocalDensity
+							&&	!ComputeGeomCharacteristic(g.charac, g.subOption, radius, cloudEntity, parent, pDlg.data()))
+						{
+							return false;
+						}
+					}
+				}
+				continue;
+			}
+
+			ccPointCloud* pc = static_cast<ccPointCloud*>(entity);
+
+			//all the characteristics are computed in a single pass (each one with its own scalar field)
+			std::vector<CCCoreLib::GeometricalAnalysisTools::CharacteristicRequest> requests;
+			QStringList newSFNames;
+			int lastSfIdx = -1;
+			bool sfCreated = true;
+			for (PointCoordinateType radius : radii)
+			{
+				for (const GeomCharacteristic& g : characteristics)
+				{
+					if (g.charac == CCCoreLib::GeometricalAnalysisTools::ApproxLocalDensity)
+					{
+						continue;
+					}
+
+					QString sfName;
+					if (!GetGeomCharacteristicSFName(g.charac, g.subOption, radius, sfName))
+					{
+						return false;
+					}
+
+					int sfIdx = pc->getScalarFieldIndexByName(qPrintable(sfName));
+					if (sfIdx < 0)
+					{
+						sfIdx = pc->addScalarField(qPrintable(sfName));
+						if (sfIdx < 0)
+						{
+							ccConsole::Error(QString("Failed to create scalar field on cloud '%1' (not enough memory?)").arg(pc->getName()));
+							sfCreated = false;
+							break;
+						}
+						newSFNames << sfName;
+					}
+
+					requests.emplace_back(g.charac, g.subOption, radius, pc->getScalarField(sfIdx));
+					lastSfIdx = sfIdx;
+				}
+
+				if (!sfCreated)
+				{
+					break;
+				}
+			}
+
+			if (sfCreated && requests.empty())
+			{
+				//only the approximate density was requested
+				continue;
+			}
+
+			CCCoreLib::GeometricalAnalysisTools::ErrorCode result = CCCoreLib::GeometricalAnalysisTools::NotEnoughMemory;
+			if (sfCreated)
+			{
+				//use the KD-tree saved next to the BIN file (or save it there)
+				CCCoreLib::FlatKdTree kdTree;
+				quint64 contentHash = 0;
+				bool hasKdTree = false;
+				if (ccIndexCache::IsClean(pc, contentHash))
+				{
+					hasKdTree = ccIndexCache::LoadKdTree(pc, kdTree, contentHash);
+					if (!hasKdTree && kdTree.buildFromCloud(pc, pDlg.data()))
+					{
+						//save it for the next time (not a big deal if it fails, a warning is already issued)
+						ccIndexCache::SaveKdTree(pc, kdTree, contentHash);
+						hasKdTree = true;
+					}
+				}
+
+				result = CCCoreLib::GeometricalAnalysisTools::ComputeCharacteristics(requests, pc, pDlg.data(), nullptr, hasKdTree ? &kdTree : nullptr);
+			}
+
+			if (result == CCCoreLib::GeometricalAnalysisTools::NoError)
+			{
+				for (const CCCoreLib::GeometricalAnalysisTools::CharacteristicRequest& request : requests)
+				{
+					request.sf->computeMinAndMax();
+				}
+				pc->setCurrentDisplayedScalarField(lastSfIdx);
+				pc->showSF(true);
+				pc->prepareDisplayForRefresh();
+			}
+			else
+			{
+				ccConsole::Warning(QString("Failed to apply processing to cloud '%1'").arg(pc->getName()));
+				ccConsole::Warning(GetGeomCharacteristicErrorMessage(result));
+
+				//remove the scalar fields we have created
+				for (const QString& sfName : newSFNames)
+				{
+					int sfIdx = pc->getScalarFieldIndexByName(qPrintable(sfName));
+					if (sfIdx >= 0)
+					{
+						pc->deleteScalarField(sfIdx);
+					}
+				}
+
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+
+	bool ComputeGeomCharacteristic(	CCCoreLib::GeometricalAnalysisTools::GeomCharacteristic c,
+									int subOption,
+									PointCoordinateType radius,
+									ccHObject::Container& entities,
+									QWidget* parent/*= nullptr*/,
+									ccProgressDialog* progressDialog/*=nullptr*/)
+	{
+		size_t selNum = entities.size();
+		if (selNum < 1)
+			return false;
+
+		//generate the right SF name
+		QString sfName;
+		if (!GetGeomCharacteristicSFName(c, subOption, radius, sfName))
+		{
+			return false;
+		}
+
 		ccProgressDialog* pDlg = progressDialog;
 		if (!pDlg && parent)
 		{
@@ -339,38 +515,8 @@ namespace ccLibAlgorithms
 				}
 				else
 				{
-					QString errorMessage;
-					switch (result)
-					{
-					case CCCoreLib::GeometricalAnalysisTools::InvalidInput:
-						errorMessage = "Internal error (invalid input)";
-						break;
-					case CCCoreLib::GeometricalAnalysisTools::NotEnoughPoints:
-						errorMessage = "Not enough points";
-						break;
-					case CCCoreLib::GeometricalAnalysisTools::OctreeComputationFailed:
-						errorMessage = "Failed to compute octree (not enough memory?)";
-						break;
-					case CCCoreLib::GeometricalAnalysisTools::ProcessFailed:
-						errorMessage = "Process failed";
-						break;
-					case CCCoreLib::GeometricalAnalysisTools::UnhandledCharacteristic:
-						errorMessage = "Internal error (unhandled characteristic)";
-						break;
-					case CCCoreLib::GeometricalAnalysisTools::NotEnoughMemory:
-						errorMessage = "Not enough memory";
-						break;
-					case CCCoreLib::GeometricalAnalysisTools::ProcessCancelledByUser:
-						errorMessage = "Process cancelled by user";
-						break;
-					default:
-						assert(false);
-						errorMessage = "Unknown error";
-						break;
-					}
-					
 					ccConsole::Warning(QString("Failed to apply processing to cloud '%1'").arg(cloud->getName()));
-					ccConsole::Warning(errorMessage);
+					ccConsole::Warning(GetGeomCharacteristicErrorMessage(result));
 					
 					if (pc && sfIdx >= 0)
 					{
@@ -52,8 +52,11 @@ namespace ccLibAlgorithms
 	typedef std::vector<GeomCharacteristic> GeomCharacteristicSet;
 
 	//! Computes geometrical characteristics (see GeometricalAnalysisTools::GeomCharacteristic) on a set of entities
+	/** Each characteristic is computed at each radius. Except for the approximate density, they are
+		all computed in a single pass on each cloud (see GeometricalAnalysisTools::ComputeCharacteristics).
+	**/
 	bool ComputeGeomCharacteristics(const GeomCharacteristicSet& characteristics,
-									PointCoordinateType radius,
+									const std::vector<PointCoordinateType>& radii,
 									ccHObject::Container& entities,
 									QWidget* parent = nullptr);
 	
@@ -0,0 +1,257 @@
+//##########################################################################
+//#                                                                        #
+//#                              CLOUDCOMPARE                              #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                    COPYRIGHT: CloudCompare project                     #
+//#                                                                        #
+//##########################################################################
+
+#include "ccPanoramaImageStore.h"
+
+//qCC_db
+#include <ccLog.h>
+#include <ccPointCloud.h>
+
+//Qt
+#include <QDir>
+#include <QImageReader>
+#include <QMutexLocker>
+#include <QtConcurrent>
+
+//system
+#include <algorithm>
+#include <cassert>
+
+//! Default memory budget (in MB)
+static const int s_defaultMemoryBudget_mb = 1024;
+
+ccPanoramaImageStore::ccPanoramaImageStore(QObject* parent/*=nullptr*/)
+	: QObject(parent)
+	, m_generation(0)
+{
+	m_cache.setMaxCost(s_defaultMemoryBudget_mb * 1024);
+	//decoding is mostly I/O and memory bound: a couple of threads are enough (and keep the UI responsive)
+	m_threadPool.setMaxThreadCount(2);
+}
+
+ccPanoramaImageStore::~ccPanoramaImageStore()
+{
+	m_threadPool.clear();
+	m_threadPool.waitForDone();
+}
+
+void ccPanoramaImageStore::setSource(const QString& folder, const QString& prefix, const QString& suffix)
+{
+	if (folder == m_folder && prefix == m_prefix && suffix == m_suffix)
+	{
+		return;
+	}
+
+	m_threadPool.clear(); //remove the queued decodings
+
+	QMutexLocker locker(&m_mutex);
+	m_folder = folder;
+	m_prefix = prefix;
+	m_suffix = suffix;
+	++m_generation;
+	m_cache.clear();
+	m_pending.clear();
+	m_fullSizes.clear();
+}
+
+bool ccPanoramaImageStore::setSource(ccPointCloud* cloud)
+{
+	if (!cloud || cloud->getImageFolder().isEmpty())
+	{
+		setSource(QString(), QString(), QString());
+		return false;
+	}
+
+	setSource(cloud->getImageFolder(), cloud->getImagePrefix(), cloud->getImageSuffix());
+	return true;
+}
+
+void ccPanoramaImageStore::setMemoryBudget(int budget_mb)
+{
+	QMutexLocker locker(&m_mutex);
+	m_cache.setMaxCost(std::max(1, budget_mb) * 1024);
+}
+
+void ccPanoramaImageStore::clear()
+{
+	QMutexLocker locker(&m_mutex);
+	m_cache.clear();
+}
+
+QString ccPanoramaImageStore::imagePath(int imageId) const
+{
+	return QDir(m_folder).filePath(m_prefix + QString::number(imageId) + m_suffix);
+}
+
+QImage ccPanoramaImageStore::Decode(const QString& path, int level, QSize& fullSize)
+{
+	QImageReader reader(path);
+	fullSize = reader.size();
+	if (level > 0 && fullSize.isValid())
+	{
+		//the (JPEG) decoder can directly produce a downscaled image
+		reader.setScaledSize(QSize(std::max(1, fullSize.width() >> level), std::max(1, fullSize.height() >> level)));
+	}
+
+	QImage image = reader.read();
+	if (image.isNull())
+	{
+		ccLog::Warning(QString("[Panoramas] Failed to read '%1': %2").arg(path, reader.errorString()));
+	}
+	else if (level == 0)
+	{
+		fullSize = image.size();
+	}
+	return image;
+}
+
+QSize ccPanoramaImageStore::imageSize(int imageId)
+{
+	QString path;
+	{
+		QMutexLocker locker(&m_mutex);
+		QHash<int, QSize>::const_iterator it = m_fullSizes.constFind(imageId);
+		if (it != m_fullSizes.constEnd())
+		{
+			return it.value();
+		}
+		path = imagePath(imageId);
+	}
+
+	//only reads the header
+	QSize size = QImageReader(path).size();
+	if (size.isValid())
+	{
+		QMutexLocker locker(&m_mutex);
+		m_fullSizes.insert(imageId, size);
+	}
+	return size;
+}
+
+void ccPanoramaImageStore::insert(quint64 key, const QImage& image)
+{
+	//cost = size in KB
+	int cost = std::max(1, static_cast<int>((static_cast<qint64>(image.bytesPerLine()) * image.height()) / 1024));
+	m_cache.insert(key, new QImage(image), cost);
+}
+
+QImage ccPanoramaImageStore::cachedImage(int imageId, int level/*=0*/) const
+{
+	QMutexLocker locker(&m_mutex);
+	QImage* image = m_cache.object(Key(imageId, level));
+	return (image ? *image : QImage());
+}
+
+QImage ccPanoramaImageStore::bestCachedImage(int imageId, int& level) const
+{
+	QMutexLocker locker(&m_mutex);
+	for (int l = 0; l <= MaxMipLevel; ++l)
+	{
+		QImage* image = m_cache.object(Key(imageId, l));
+		if (image)
+		{
+			level = l;
+			return *image;
+		}
+	}
+	return QImage();
+}
+
+QImage ccPanoramaImageStore::image(int imageId, int level/*=0*/)
+{
+	level = std::max(0, std::min(level, MaxMipLevel));
+	quint64 key = Key(imageId, level);
+
+	QString path;
+	quint32 generation = 0;
+	{
+		QMutexLocker locker(&m_mutex);
+		QImage* image = m_cache.object(key);
+		if (image)
+		{
+			return *image;
+		}
+		if (m_folder.isEmpty())
+		{
+			return QImage();
+		}
+		path = imagePath(imageId);
+		generation = m_generation;
+	}
+
+	//decode it now (even if it is being prefetched: the user is waiting for it)
+	QSize fullSize;
+	QImage image = Decode(path, level, fullSize);
+	if (!image.isNull())
+	{
+		QMutexLocker locker(&m_mutex);
+		if (generation == m_generation)
+		{
+			insert(key, image);
+			m_fullSizes.insert(imageId, fullSize);
+		}
+	}
+	return image;
+}
+
+void ccPanoramaImageStore::prefetch(const std::vector<int>& imageIds, int level/*=0*/)
+{
+	level = std::max(0, std::min(level, MaxMipLevel));
+
+	QMutexLocker locker(&m_mutex);
+	if (m_folder.isEmpty())
+	{
+		return;
+	}
+
+	for (int imageId : imageIds)
+	{
+		quint64 key = Key(imageId, level);
+		if (m_pending.contains(key) || m_cache.contains(key))
+		{
+			continue;
+		}
+		m_pending.insert(key);
+
+		QString path = imagePath(imageId);
+		quint32 generation = m_generation;
+		QtConcurrent::run(&m_threadPool, [this, path, imageId, level, key, generation]()
+		{
+			QSize fullSize;
+			QImage image = Decode(path, level, fullSize);
+
+			{
+				QMutexLocker locker(&m_mutex);
+				if (generation != m_generation)
+				{
+					//the source has changed in the meantime
+					return;
+				}
+				m_pending.remove(key);
+				if (image.isNull())
+				{
+					return;
+				}
+				insert(key, image);
+				m_fullSizes.insert(imageId, fullSize);
+			}
+
+			//queued to the receivers' thread
+			emit imageReady(imageId, level);
+		});
+	}
+}
@@ -0,0 +1,142 @@
+//##########################################################################
+//#                                                                        #
+//#                              CLOUDCOMPARE                              #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                    COPYRIGHT: CloudCompare project                     #
+//#                                                                        #
+//##########################################################################
+
+#ifndef CC_PANORAMA_IMAGE_STORE_HEADER
+#define CC_PANORAMA_IMAGE_STORE_HEADER
+
+//Qt
+#include <QCache>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QThreadPool>
+
+//system
+#include <vector>
+
+class ccPointCloud;
+
+//! Out-of-core store of the panoramas associated to the trajectory nodes
+/** The images are referenced by their 'imageId' (folder + prefix + imageId + suffix)
+	and only decoded on demand. The decoded images are kept in a LRU cache bounded
+	by a memory budget. Downscaled versions (mip levels) can be requested as well:
+	level n is 2^n times smaller than the original image (and much faster to decode
+	for JPEG files).
+	The neighbouring images can be decoded in advance on background threads (see prefetch).
+**/
+class ccPanoramaImageStore : public QObject
+{
+	Q_OBJECT
+
+public:
+
+	//! Max mip level
+	static const int MaxMipLevel = 4;
+
+	//! Default constructor
+	explicit ccPanoramaImageStore(QObject* parent = nullptr);
+	//! Destructor (waits for the pending decodings)
+	~ccPanoramaImageStore() override;
+
+	//! Sets the images location
+	/** Clears the cache if the location changes.
+	**/
+	void setSource(const QString& folder, const QString& prefix, const QString& suffix);
+
+	//! Sets the images location from a cloud (see ccPointCloud::getImageFolder)
+	/** \return whether the cloud has an image folder
+	**/
+	bool setSource(ccPointCloud* cloud);
+
+	//! Returns whether a source has been set
+	bool hasSource() const { return !m_folder.isEmpty(); }
+
+	//! Sets the memory budget of the cache (in MB)
+	void setMemoryBudget(int budget_mb);
+
+	//! Clears the cache
+	void clear();
+
+	//! Returns the file path of an image
+	QString imagePath(int imageId) const;
+
+	//! Returns an image (decoded now if not in the cache)
+	/** \return a null image if the file can't be read
+	**/
+	QImage image(int imageId, int level = 0);
+
+	//! Returns an image only if it is already in the cache
+	QImage cachedImage(int imageId, int level = 0) const;
+
+	//! Returns the full resolution size of an image (read from the file header if necessary)
+	QSize imageSize(int imageId);
+
+	//! Returns the best cached version of an image (i.e. the cached image with the lowest level)
+	/** \param[out] level the level of the returned image (if any)
+	**/
+	QImage bestCachedImage(int imageId, int& level) const;
+
+	//! Decodes images in the background (if they are not already cached or being decoded)
+	/** The 'imageReady' signal is emitted each time an image has been decoded.
+		\param imageIds the images (in order of priority)
+		\param level mip level
+	**/
+	void prefetch(const std::vector<int>& imageIds, int level = 0);
+
+signals:
+
+	//! Emitted when a prefetched image has been decoded
+	void imageReady(int imageId, int level);
+
+protected:
+
+	//! Returns the cache key of an image
+	static inline quint64 Key(int imageId, int level) { return (static_cast<quint64>(static_cast<quint32>(imageId)) << 8) | static_cast<quint64>(level); }
+
+	//! Decodes an image file (thread-safe)
+	/** \param[out] fullSize the full resolution size of the image
+	**/
+	static QImage Decode(const QString& path, int level, QSize& fullSize);
+
+	//! Inserts an image in the cache
+	void insert(quint64 key, const QImage& image);
+
+	//! Cache (the cost unit is the KB)
+	QCache<quint64, QImage> m_cache;
+	//! Images being decoded in the background
+	QSet<quint64> m_pending;
+	//! Full resolution size of the images (imageId --> size)
+	QHash<int, QSize> m_fullSizes;
+	//! Mutex protecting the cache and the pending set
+	mutable QMutex m_mutex;
+	//! Background decoding threads
+	QThreadPool m_threadPool;
+
+	//! Images folder
+	QString m_folder;
+	//! Images prefix
+	QString m_prefix;
+	//! Images suffix
+	QString m_suffix;
+	//! Source generation (to discard the images decoded for a previous source)
+	quint32 m_generation;
+};
+
+#endif //CC_PANORAMA_IMAGE_STORE_HEADER
@@ -0,0 +1,279 @@
+//##########################################################################
+//#                                                                        #
+//#                              CLOUDCOMPARE                              #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                    COPYRIGHT: CloudCompare project                     #
+//#                                                                        #
+//##########################################################################
+
+#include "ccPanoramaProjectionCache.h"
+
+//qCC_db
+#include <ccGenericPointCloud.h>
+#include <ccLog.h>
+#include <ccOctree.h>
+
+//CCCoreLib
+#include <SquareMatrix.h>
+
+//system
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#if defined(_OPENMP)
+//OpenMP
+#include <omp.h>
+#endif
+
+size_t ccPanoramaProjectionCache::Projection::memoryUsage() const
+{
+	return sizeof(Projection)
+		+ m_points.capacity() * sizeof(ProjectedPoint)
+		+ m_bucketStart.capacity() * sizeof(unsigned);
+}
+
+void ccPanoramaProjectionCache::Projection::getPointsInRect(float minU, float minV, float maxU, float maxV, double maxRange, std::vector<unsigned>& positions) const
+{
+	positions.clear();
+	if (m_points.empty() || maxU < minU || maxV < minV)
+	{
+		return;
+	}
+
+	int minX = std::max(0, static_cast<int>(std::floor(minU / BucketSize)));
+	int minY = std::max(0, static_cast<int>(std::floor(minV / BucketSize)));
+	int maxX = std::min(m_bucketsX - 1, static_cast<int>(std::floor(maxU / BucketSize)));
+	int maxY = std::min(m_bucketsY - 1, static_cast<int>(std::floor(maxV / BucketSize)));
+
+	for (int y = minY; y <= maxY; ++y)
+	{
+		for (int x = minX; x <= maxX; ++x)
+		{
+			int bucket = y * m_bucketsX + x;
+			for (unsigned i = m_bucketStart[bucket]; i < m_bucketStart[bucket + 1]; ++i)
+			{
+				const ProjectedPoint& P = m_points[i];
+				if (P.u >= minU && P.u <= maxU && P.v >= minV && P.v <= maxV && P.range <= maxRange)
+				{
+					positions.push_back(i);
+				}
+			}
+		}
+	}
+}
+
+ccPanoramaProjectionCache::ccPanoramaProjectionCache(size_t maxMemory_mb/*=512*/)
+	: m_maxMemory(maxMemory_mb << 20)
+{
+}
+
+void ccPanoramaProjectionCache::clear(unsigned cloudID)
+{
+	m_projections.remove_if([cloudID](const ProjectionShared& p) { return p->m_cloudID == cloudID; });
+}
+
+void ccPanoramaProjectionCache::clear()
+{
+	m_projections.clear();
+}
+
+ccGLMatrixd ccPanoramaProjectionCache::ToCamera(const std::vector<double>& viewParameters)
+{
+	assert(viewParameters.size() == 7);
+
+	// viewParameter = [x,y,z,qw,qx,qy,qz]
+	ccGLMatrixd poseMat;
+	CCCoreLib::SquareMatrixd rotMat(3);
+	rotMat.initFromQuaternion(viewParameters.data() + 3);
+	rotMat.toGlMatrix(poseMat.data());
+	poseMat.getTranslation()[0] = viewParameters[0];
+	poseMat.getTranslation()[1] = viewParameters[1];
+	poseMat.getTranslation()[2] = viewParameters[2];
+
+	return poseMat.inverse();
+}
+
+void ccPanoramaProjectionCache::ProjectSpherical(const ccGLMatrixd& toCamera, int imageWidth, int imageHeight, const CCVector3d& P, CCVector3d& Q2D)
+{
+	CCVector3d Pc = toCamera * P;
+	// Transform to spherical
+	double radius = Pc.norm(); // radius
+	double theta = atan2(Pc.x, Pc.y); // longitude
+	double phi = asin(Pc.z / radius); // latitude
+	// Convert to the size of the image
+	float u = (static_cast<float>(imageWidth) / 2) * (1 + theta / M_PI);
+	float v = (static_cast<float>(imageHeight) / 2) * (1 - phi / M_PI_2);
+
+	Q2D = CCVector3d(u, v, radius);
+}
+
+ccPanoramaProjectionCache::Projection* ccPanoramaProjectionCache::Compute(ccGenericPointCloud* cloud, const std::vector<double>& viewParameters, int imageWidth, int imageHeight, double maxRange)
+{
+	ccOctree::Shared octree = cloud->getOctree();
+	if (!octree)
+	{
+		octree = cloud->computeOctree(nullptr, false);
+		if (!octree)
+		{
+			ccLog::Warning("[ccPanoramaProjectionCache] Failed to compute the cloud octree");
+			return nullptr;
+		}
+	}
+
+	Projection* projection = nullptr;
+	try
+	{
+		projection = new Projection;
+		projection->m_cloudID = cloud->getUniqueID();
+		projection->m_cloudSize = cloud->size();
+		cloud->getBoundingBox(projection->m_cloudMin, projection->m_cloudMax);
+		projection->m_viewParameters = viewParameters;
+		projection->m_imageWidth = imageWidth;
+		projection->m_imageHeight = imageHeight;
+		projection->m_maxRange = maxRange;
+		projection->m_bucketsX = std::max(1, (imageWidth + BucketSize - 1) / BucketSize);
+		projection->m_bucketsY = std::max(1, (imageHeight + BucketSize - 1) / BucketSize);
+
+		//pre-select the points inside the sphere of radius 'maxRange'
+		CCVector3 center(	static_cast<PointCoordinateType>(viewParameters[0]),
+							static_cast<PointCoordinateType>(viewParameters[1]),
+							static_cast<PointCoordinateType>(viewParameters[2]) );
+		PointCoordinateType radius = static_cast<PointCoordinateType>(maxRange);
+		unsigned char level = octree->findBestLevelForAGivenNeighbourhoodSizeExtraction(radius);
+		CCCoreLib::DgmOctree::NeighboursSet neighbours;
+		octree->getPointsInSphericalNeighbourhood(center, radius, neighbours, level);
+
+		//project them (in parallel)
+		ccGLMatrixd toCamera = ToCamera(viewParameters);
+		int count = static_cast<int>(neighbours.size());
+		int bucketCount = projection->m_bucketsX * projection->m_bucketsY;
+		std::vector<ProjectedPoint> projected(count);
+		std::vector<int> buckets(count);
+
+#if defined(_OPENMP)
+#pragma omp parallel for
+#endif
+		for (int i = 0; i < count; ++i)
+		{
+			CCVector3d Q2D;
+			ProjectSpherical(toCamera, imageWidth, imageHeight, CCVector3d::fromArray(neighbours[i].point->u), Q2D);
+
+			ProjectedPoint& P = projected[i];
+			P.index = neighbours[i].pointIndex;
+			P.u = static_cast<float>(Q2D.x);
+			P.v = static_cast<float>(Q2D.y);
+			P.range = static_cast<float>(Q2D.z);
+
+			//(NaN coordinates, i.e. a point at the camera center, end up in the first bucket)
+			float fx = P.u / BucketSize;
+			float fy = P.v / BucketSize;
+			int x = (fx >= 0 ? std::min(static_cast<int>(fx), projection->m_bucketsX - 1) : 0);
+			int y = (fy >= 0 ? std::min(static_cast<int>(fy), projection->m_bucketsY - 1) : 0);
+			buckets[i] = y * projection->m_bucketsX + x;
+		}
+		neighbours.clear();
+		neighbours.shrink_to_fit();
+
+		//sort them by bucket (counting sort)
+		projection->m_bucketStart.resize(bucketCount + 1, 0);
+		for (int i = 0; i < count; ++i)
+		{
+			++projection->m_bucketStart[buckets[i] + 1];
+		}
+		for (int b = 0; b < bucketCount; ++b)
+		{
+			projection->m_bucketStart[b + 1] += projection->m_bucketStart[b];
+		}
+		std::vector<unsigned> fillPos(projection->m_bucketStart.begin(), projection->m_bucketStart.end() - 1);
+		projection->m_points.resize(count);
+		for (int i = 0; i < count; ++i)
+		{
+			projection->m_points[fillPos[buckets[i]]++] = projected[i];
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		ccLog::Warning("[ccPanoramaProjectionCache] Not enough memory");
+		delete projection;
+		return nullptr;
+	}
+
+	return projection;
+}
+
+ccPanoramaProjectionCache::ProjectionShared ccPanoramaProjectionCache::projection(	ccGenericPointCloud* cloud,
+																					const std::vector<double>& viewParameters,
+																					int imageWidth,
+																					int imageHeight,
+																					double maxRange)
+{
+	if (!cloud || viewParameters.size() != 7 || imageWidth <= 0 || imageHeight <= 0 || maxRange <= 0)
+	{
+		return ProjectionShared();
+	}
+
+	CCVector3 cloudMin;
+	CCVector3 cloudMax;
+	cloud->getBoundingBox(cloudMin, cloudMax);
+
+	for (std::list<ProjectionShared>::iterator it = m_projections.begin(); it != m_projections.end(); ++it)
+	{
+		const Projection& p = **it;
+		if (	p.m_cloudID == cloud->getUniqueID()
+			&&	p.m_imageWidth == imageWidth
+			&&	p.m_imageHeight == imageHeight
+			&&	p.m_viewParameters == viewParameters)
+		{
+			if (	p.m_cloudSize == cloud->size()
+				&&	(p.m_cloudMin - cloudMin).norm2() == 0
+				&&	(p.m_cloudMax - cloudMax).norm2() == 0
+				&&	p.m_maxRange >= maxRange)
+			{
+				//move it to the front
+				ProjectionShared projection = *it;
+				m_projections.erase(it);
+				m_projections.push_front(projection);
+				return projection;
+			}
+
+			//outdated (or too short range)
+			m_projections.erase(it);
+			break;
+		}
+	}
+
+	ProjectionShared projection(Compute(cloud, viewParameters, imageWidth, imageHeight, maxRange));
+	if (!projection)
+	{
+		return projection;
+	}
+	m_projections.push_front(projection);
+
+	//release the least recently used projections (but always keep the current one)
+	size_t memory = 0;
+	for (std::list<ProjectionShared>::iterator it = m_projections.begin(); it != m_projections.end(); )
+	{
+		size_t projectionMemory = (*it)->memoryUsage();
+		if (it != m_projections.begin() && memory + projectionMemory > m_maxMemory)
+		{
+			it = m_projections.erase(it);
+		}
+		else
+		{
+			memory += projectionMemory;
+			++it;
+		}
+	}
+
+	return projection;
+}
@@ -0,0 +1,169 @@
+//##########################################################################
+//#                                                                        #
+//#                              CLOUDCOMPARE                              #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                    COPYRIGHT: CloudCompare project                     #
+//#                                                                        #
+//##########################################################################
+
+#ifndef CC_PANORAMA_PROJECTION_CACHE_HEADER
+#define CC_PANORAMA_PROJECTION_CACHE_HEADER
+
+//qCC_db
+#include <ccGLMatrix.h>
+
+//Qt
+#include <QSharedPointer>
+
+//system
+#include <list>
+#include <vector>
+
+class ccGenericPointCloud;
+
+//! Cache of the projections of a cloud in the (equirectangular) panoramas of the trajectory poses
+/** For a given pose, only the points closer than a max range are projected (they are
+	extracted with the cloud octree). The projected points are sorted by square pixel
+	'buckets', so that the points falling in an image area can be retrieved without
+	testing the whole cloud.
+	The most recently used projections are kept in memory (up to a memory budget).
+**/
+class ccPanoramaProjectionCache
+{
+public:
+
+	//! Projected point
+	struct ProjectedPoint
+	{
+		//! Point index (in the cloud)
+		unsigned index;
+		//! Horizontal image coordinate (in pixels)
+		float u;
+		//! Vertical image coordinate (in pixels)
+		float v;
+		//! Distance to the camera center
+		float range;
+	};
+
+	//! Projection of a cloud in a panorama
+	class Projection
+	{
+	public:
+
+		//! Returns the projected points (sorted by bucket)
+		inline const std::vector<ProjectedPoint>& points() const { return m_points; }
+
+		//! Returns the max range of the projected points
+		inline double maxRange() const { return m_maxRange; }
+
+		//! Returns the memory used by this projection (in bytes)
+		size_t memoryUsage() const;
+
+		//! Returns the points falling inside an image area
+		/** \param minU min horizontal image coordinate
+			\param minV min vertical image coordinate
+			\param maxU max horizontal image coordinate
+			\param maxV max vertical image coordinate
+			\param maxRange max distance to the camera center
+			\param[out] positions positions of the points in the 'points' array
+		**/
+		void getPointsInRect(float minU, float minV, float maxU, float maxV, double maxRange, std::vector<unsigned>& positions) const;
+
+	protected:
+
+		friend class ccPanoramaProjectionCache;
+
+		//! Key: cloud unique ID (a deleted cloud address may be reused)
+		unsigned m_cloudID = 0;
+		//! Key: cloud size
+		unsigned m_cloudSize = 0;
+		//! Key: cloud bounding-box (to detect transformations)
+		CCVector3 m_cloudMin;
+		//! Key: cloud bounding-box (to detect transformations)
+		CCVector3 m_cloudMax;
+		//! Key: pose (x,y,z,qw,qx,qy,qz)
+		std::vector<double> m_viewParameters;
+		//! Key: image width
+		int m_imageWidth = 0;
+		//! Key: image height
+		int m_imageHeight = 0;
+		//! Max range of the projected points
+		double m_maxRange = 0;
+
+		//! Number of buckets along the image width
+		int m_bucketsX = 0;
+		//! Number of buckets along the image height
+		int m_bucketsY = 0;
+		//! Start of each bucket in the 'm_points' array (+ the end of the last one)
+		std::vector<unsigned> m_bucketStart;
+		//! Projected points (sorted by bucket)
+		std::vector<ProjectedPoint> m_points;
+	};
+
+	//! Shared projection
+	using ProjectionShared = QSharedPointer<const Projection>;
+
+	//! Default constructor
+	/** \param maxMemory_mb max memory used by the cached projections (in MB)
+	**/
+	explicit ccPanoramaProjectionCache(size_t maxMemory_mb = 512);
+
+	//! Returns the projection of a cloud in a panorama (computed if necessary)
+	/** The cloud octree is computed if it doesn't exist yet.
+		\param cloud cloud
+		\param viewParameters pose of the panorama (x,y,z,qw,qx,qy,qz)
+		\param imageWidth panorama width (in pixels)
+		\param imageHeight panorama height (in pixels)
+		\param maxRange max distance to the camera center
+		\return the projection (or a null pointer if an error occurred)
+	**/
+	ProjectionShared projection(ccGenericPointCloud* cloud,
+								const std::vector<double>& viewParameters,
+								int imageWidth,
+								int imageHeight,
+								double maxRange);
+
+	//! Removes all the projections of a given cloud
+	/** \param cloudID unique ID of the cloud (see ccObject::getUniqueID)
+	**/
+	void clear(unsigned cloudID);
+
+	//! Removes all the projections
+	void clear();
+
+	//! Returns the global to camera transformation of a pose (x,y,z,qw,qx,qy,qz)
+	static ccGLMatrixd ToCamera(const std::vector<double>& viewParameters);
+
+	//! Projects a point in an equirectangular panorama (see ccImageDrawer::projectSpherical)
+	/** \param toCamera global to camera transformation
+		\param imageWidth panorama width (in pixels)
+		\param imageHeight panorama height (in pixels)
+		\param P 3D point
+		\param[out] Q2D image coordinates (u, v) and range
+	**/
+	static void ProjectSpherical(const ccGLMatrixd& toCamera, int imageWidth, int imageHeight, const CCVector3d& P, CCVector3d& Q2D);
+
+	//! Bucket size (in pixels)
+	static const int BucketSize = 32;
+
+protected:
+
+	//! Computes a projection
+	static Projection* Compute(ccGenericPointCloud* cloud, const std::vector<double>& viewParameters, int imageWidth, int imageHeight, double maxRange);
+
+	//! Projections (the most recently used first)
+	std::list<ProjectionShared> m_projections;
+	//! Max memory (in bytes)
+	size_t m_maxMemory;
+};
+
+#endif //CC_PANORAMA_PROJECTION_CACHE_HEADER
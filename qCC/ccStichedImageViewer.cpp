@@ -26,6 +26,7 @@
 #include "ccPointPickingGenericInterface.h"
 #include "mainwindow.h"
 #include "CCCoreLib.h"
+#include "VisibilityTools.h"
 
 #include "DxfFilter.h"
 
@@ -39,6 +40,7 @@
 #include <ccPointCloud.h>
 #include <ccImageDrawer.h>
 #include <ccScalarField.h>
+#include <ccTrajectoryIndex.h>
 #include <ccColorScalesManager.h>
 //Qt
 #include <QApplication>
@@ -64,6 +66,7 @@
 
 
 //system
+#include <algorithm>
 #include <cassert>
 #include <fstream>
 #ifdef QT_DEBUG
@@ -109,6 +112,9 @@ ccStichedImageViewer::ccStichedImageViewer(QWidget* parent = nullptr, ccPickingH
 	, m_forward(1.0,0.0,0.0)
 	, m_up(0.0, 0.0, 1.0)
 	, m_currentTransform{0,0,0,1,0,0,0} //x,y,z,qw,qx,qy,qz
+	, m_imageStore(new ccPanoramaImageStore(this))
+	, m_displayedImageId(-1)
+	, m_displayedImageLevel(0)
 {
 	QWidget* iconOptions;
 	m_ui->setupUi(this);
@@ -136,6 +142,7 @@ ccStichedImageViewer::ccStichedImageViewer(QWidget* parent = nullptr, ccPickingH
 	connect(m_ui->exportCSVPlan, &QToolButton::clicked, this, &ccStichedImageViewer::planeToFile);
 	connect(m_ui->importCSVPlan, &QToolButton::clicked, this, &ccStichedImageViewer::planeFromFile);
 	connect(m_ui->spinBoxNode, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, &ccStichedImageViewer::updateNodeId);
+	connect(m_imageStore, &ccPanoramaImageStore::imageReady, this, &ccStichedImageViewer::onPanoramaReady);
 	connect(m_ui->spinBoxNodeSpeed, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, &ccStichedImageViewer::changeStepNode);
 	connect(m_ui->spinBoxPlan, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, &ccStichedImageViewer::setSizePlan);
 	connect(m_ui->spinBoxFar, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, &ccStichedImageViewer::setSpinFar);
@@ -300,16 +307,149 @@ void ccStichedImageViewer::updateStichedImage(int id)
 
 	// viewParameter = [x,y,z,qw,qx,qy,qz]
 	std::vector<double> viewParameter{ x,y,z,qw,qx,qy,qz };
+
+	// The panoramas are read from the image folder of the trajectory, or else of the cloud (the folder
+	// may have been changed in the properties). The source is only set once, as changing it clears the cache.
+	ccPointCloud* imageSource = m_currentTrajectory;
+	if (!imageSource || imageSource->getImageFolder().isEmpty())
+	{
+		imageSource = m_currentPointCloud;
+	}
+	m_imageStore->setSource(imageSource);
+
+	if (m_imageStore->hasSource())
+	{
+		int level = 0;
+		double scale = 1.0;
+		QImage image = m_imageStore->bestCachedImage(imageIdValue, level);
+		if (image.isNull())
+		{
+			// not prefetched: the user has to wait
+			level = 0;
+			image = m_imageStore->image(imageIdValue, 0);
+		}
+		else if (level > 0)
+		{
+			// the preview is displayed by the drawer as if it was at the full resolution size (the drawer
+			// works in full resolution pixels) while the full resolution image is decoded in the background
+			QSize fullSize = m_imageStore->imageSize(imageIdValue);
+			if (fullSize.isValid())
+			{
+				scale = static_cast<double>(fullSize.width()) / image.width();
+				m_imageStore->prefetch({ imageIdValue }, 0);
+			}
+			else
+			{
+				level = 0;
+				image = m_imageStore->image(imageIdValue, 0);
+			}
+		}
+
+		if (!image.isNull())
+		{
+			m_displayedImageId = imageIdValue;
+			m_displayedImageLevel = level;
+			m_displayedViewParameters = viewParameter;
+			m_imageDrawer->setImageInformation(image, viewParameter, scale);
+			return;
+		}
+	}
+
+	// Former behavior: the images have been loaded in the DB
 	ccHObject* imageObject = MainWindow::TheInstance()->dbRootObject()->find(imageIdValue);
-	if (!imageObject->isA(CC_TYPES::IMAGE))
+	if (!imageObject || !imageObject->isA(CC_TYPES::IMAGE))
 	{
 		return;
 	}
 	
+	m_displayedImageId = imageIdValue;
+	m_displayedImageLevel = 0;
+	m_displayedViewParameters = viewParameter;
 	m_imageDrawer->setImageInformation(ccHObjectCaster::ToImage(imageObject), viewParameter);
 
 }
 
+int ccStichedImageViewer::imageIdOfNode(int node) const
+{
+	if (!m_currentTrajectory || node < 0 || static_cast<unsigned>(node) >= m_currentTrajectory->size())
+	{
+		return -1;
+	}
+
+	int imageIdField = m_currentTrajectory->getScalarFieldIndexByName("imageId");
+	if (imageIdField == -1)
+	{
+		return -1;
+	}
+
+	return static_cast<int>(m_currentTrajectory->getScalarField(imageIdField)->getValue(node));
+}
+
+void ccStichedImageViewer::prefetchNeighbours(int node)
+{
+	if (!m_imageStore->hasSource())
+	{
+		return;
+	}
+
+	int step = std::max(1, m_ui->spinBoxNode->singleStep());
+
+	// the next/previous nodes at full resolution
+	std::vector<int> nearIds;
+	for (int i : { 1, -1, 2, -2 })
+	{
+		int imageId = imageIdOfNode(node + i * step);
+		if (imageId >= 0)
+		{
+			nearIds.push_back(imageId);
+		}
+	}
+	m_imageStore->prefetch(nearIds, 0);
+
+	// a wider ring as previews (for fast scrolling)
+	static const int s_previewLevel = 2;
+	std::vector<int> farIds;
+	for (int i = 3; i <= 8; ++i)
+	{
+		for (int sign : { 1, -1 })
+		{
+			int imageId = imageIdOfNode(node + sign * i * step);
+			if (imageId >= 0)
+			{
+				farIds.push_back(imageId);
+			}
+		}
+	}
+	m_imageStore->prefetch(farIds, s_previewLevel);
+}
+
+void ccStichedImageViewer::onPanoramaReady(int imageId, int level)
+{
+	// swap the displayed preview for the full resolution image
+	if (level != 0 || imageId != m_displayedImageId || m_displayedImageLevel == 0 || m_currentPicking)
+	{
+		return;
+	}
+
+	QImage image = m_imageStore->cachedImage(imageId, 0);
+	if (!image.isNull())
+	{
+		m_displayedImageLevel = 0;
+		m_imageDrawer->setImageInformation(image, m_displayedViewParameters);
+	}
+}
+
+QImage ccStichedImageViewer::displayedFullResolutionImage()
+{
+	if (!m_imageStore->hasSource() || m_displayedImageId < 0)
+	{
+		return QImage();
+	}
+
+	// the user has to wait if the full resolution image is still being decoded
+	return m_imageStore->image(m_displayedImageId, 0);
+}
+
 
 
 
@@ -404,6 +544,14 @@ void ccStichedImageViewer::onItemPicked(const PickedItem& pi)
 
 int ccStichedImageViewer::closestPoseToPoint(const CCVector3* pt)
 {
+	// Use the spatial index of the trajectory (built when the trajectory was attached)
+	const ccTrajectoryIndex* index = trajectoryIndex();
+	if (index)
+	{
+		int closestId = index->closestPose(CCVector3d::fromArray(pt->u));
+		return std::max(closestId, 0);
+	}
+
 	double minDistance = DBL_MAX;
 	int closestId = 0;
 	for (int i = 0; i < m_currentTrajectory->size(); i++)
@@ -420,6 +568,17 @@ int ccStichedImageViewer::closestPoseToPoint(const CCVector3* pt)
 	return closestId; 
 }
 
+const ccTrajectoryIndex* ccStichedImageViewer::trajectoryIndex() const
+{
+	if (!m_currentPointCloud || !m_currentTrajectory || m_currentPointCloud->getTrajectoryCloud() != m_currentTrajectory)
+	{
+		return nullptr;
+	}
+
+	const ccTrajectoryIndex* index = m_currentPointCloud->getTrajectoryIndex();
+	return (index && !index->empty() ? index : nullptr);
+}
+
 
 void ccStichedImageViewer::keyPressEvent(QKeyEvent* event)
 {
@@ -639,6 +798,8 @@ void ccStichedImageViewer::updateNodeId(int id)
 	setCameraNodePosition();
 	// Stiched image
 	updateStichedImage(id);
+	// Anticipates the next moves along the trajectory
+	prefetchNeighbours(id);
 }
 
 
@@ -887,282 +1048,87 @@ void ccStichedImageViewer::setCameraNodePosition()
 }
 
 
-ccImage* ccStichedImageViewer::generateImageUnroll(float zMax, float zMin)
-{
+//! Max number of pixels of an unrolled image (512 MB in ARGB32, QImage can't allocate more than 2 GB)
+static const double s_maxUnrollImagePixels = static_cast<double>(1 << 27);
 
-	if (!m_unrolledCloud) { return nullptr; }
-	//Generate a new view
-	ccViewportParameters imageViewport;
-	CCVector3 bbMin;
-	CCVector3 bbMax;
-	ccImage* img(new ccImage);
-	QImage image;
-	m_unrolledCloud->getBoundingBox(bbMin, bbMax);
-
-	ccGLWindow* win = MainWindow::GetActiveGLWindow();
-	float windowHeight = (float)win->glHeight();
-	float windowWidth = (float)win->glWidth();
-	//double targetWidth = sqrt(pow((bbMax-bbMin).x,2)+ pow((bbMax - bbMin).y, 2));
-	double targetWidth = (bbMax-bbMin).x;
-	double targetHeight = (bbMax-bbMin).y;
-	double targetRatio = targetHeight/targetWidth;
-	double windowRatio = windowHeight / windowWidth;
-	//ccLog::Error(QString("Target Height: %1 ratioTarget: %2 ratioWindow: %3").arg(targetHeight).arg(targetRatio).arg(windowRatio));
-	
-	//Center image
-	double focalDistance;
-	CCVector3d eye(0, 0, 1);
-	CCVector3d center(0, 0, 0);
-	CCVector3d top(0, 1, 0);
-	imageViewport.viewMat = ccGLMatrixd::FromViewDirAndUpDir(center - eye, top);
-	CCVector3d P((bbMax + bbMin).x / 2, (bbMax + bbMin).y / 2, 0);
-	ccLog::Print(QString("Center Camera %1, %2, %3").arg(P.x).arg(P.y).arg(P.z));
-	imageViewport.setCameraCenter(P, false);
-
-
-	if (targetRatio > windowRatio)
+//! Returns the smallest pixel size (above 'pixelSize') for which an image of the given area can be allocated
+static double ClampUnrollPixelSize(double width, double height, double pixelSize)
+{
+	double minPixelSize = std::sqrt(width * height / s_maxUnrollImagePixels);
+	if (pixelSize < minPixelSize)
 	{
-		//Optimizing Height
-		double zoom = targetHeight * 200 / windowHeight;
-
-		if (windowHeight < windowWidth)
-		{
-			targetHeight *= static_cast<double>(windowWidth / windowHeight);
-			focalDistance = targetHeight / (imageViewport.computeDistanceToWidthRatio());
-		}
-		else
-		{
-			double distance = (windowWidth / 2)/ std::tan(CCCoreLib::DegreesToRadians(imageViewport.fov_deg / 2.0));
-			double newFOV = atan((windowHeight / 2) / distance);
-			ccLog::Print(QString::number(newFOV));
-			//double multipleHeight = targetHeight / windowHeight;
-			targetHeight *= static_cast<double>(windowWidth / windowHeight);
-			focalDistance = targetHeight / (2*std::tan(newFOV));
-		}
-	
-		imageViewport.setFocalDistance(focalDistance);
-		win->setViewportParameters(imageViewport);
-		win->redraw();
-		
-		while (image.isNull())
-		{
-			image = win->renderToImage(zoom, true, false, true);
-			if (zoom < 1)
-			{
-				ccLog::Error("Could not export Bg Image, due to momory shortage");
-				return nullptr;
-			}
-			if (image.isNull())
-			{
-				zoom -= 1;
-			}
-		}
-		ccLog::Print(QString("Image created at zoom of %1").arg(zoom));
+		ccLog::Warning(QString("[Unroll] Image too large: pixel size increased from %1 to %2 m/pixel").arg(pixelSize).arg(minPixelSize));
+		return minPixelSize;
+	}
+	return pixelSize;
+}
 
-		// Image should be adapted to the height
-		qreal imgHeight = image.height();
-		qreal theoricalWidth = imgHeight / targetRatio;
-		qreal crop = (image.width() - theoricalWidth) / 2;
-		QRect rect(crop, 0, theoricalWidth, imgHeight);
-		image = image.copy(rect);
+ccOrthoRasterizer::Parameters ccStichedImageViewer::unrollRasterParameters(double pixelSize, int sfIndex) const
+{
+	ccOrthoRasterizer::Parameters params;
+	params.pixelSize = pixelSize;
+	params.splatRadius = 1;
+	if (sfIndex >= 0)
+	{
+		params.colorSource = ccOrthoRasterizer::SCALAR_FIELD;
+		params.sfIndex = sfIndex;
+	}
+	else if (m_unrolledCloud->sfShown() && m_unrolledCloud->getCurrentDisplayedScalarField())
+	{
+		params.colorSource = ccOrthoRasterizer::SCALAR_FIELD;
+	}
+	else if (m_unrolledCloud->hasColors())
+	{
+		params.colorSource = ccOrthoRasterizer::RGB_COLORS;
 	}
 	else
 	{
-		//Optimizing Width
-		double zoom = targetWidth * 200 / windowWidth;
-
-		if (windowHeight > windowWidth)
-		{
-			targetWidth *= static_cast<double>(windowWidth / windowHeight);
-		}
-		
-		focalDistance = targetWidth / (imageViewport.computeDistanceToWidthRatio());
-		
-		imageViewport.setFocalDistance(focalDistance);
-		win->setViewportParameters(imageViewport);
-		win->redraw();
-		
-		while (image.isNull())
-		{
-			image = win->renderToImage(zoom, true, false, true);
-			zoom -= 1;
-			if (zoom < 1)
-			{
-				ccLog::Error("Could not export Bg Image, due to momory shortage");
-				return nullptr;
-			}
-			if (image.isNull())
-			{
-				zoom -= 1;
-			}
-		}
-		ccLog::Print(QString("Image created at zoom of %1").arg(zoom));
-		
-		// Image should be adapted to the width
-		qreal imgWidth = image.width();
-		qreal theoricalHeight = imgWidth * targetRatio;
-		qreal crop = (image.height() - theoricalHeight) / 2;
-		QRect rect(0, crop, imgWidth, theoricalHeight);
-		image = image.copy(rect);
-	}
-	img->setData(image);
-	bbMin = CCVector3(bbMin.x, bbMin.y, 0);
-	bbMax = CCVector3(bbMax.x, bbMax.y, 0);
-	ccBBox box(bbMin,bbMax);
-	img->setPositionBox(box);
-	return img;
-
-	//win->setCameraPos(P);
-	//CCVector3d v(0, 0, focalDistance);
-	//win->moveCamera(v);
-
+		params.colorSource = ccOrthoRasterizer::DEFAULT_COLOR;
+	}
+	return params;
 }
 
-std::vector<ccImage*> ccStichedImageViewer::generateImagesUnroll(float zMax, float zMin, float slice)
+ccImage* ccStichedImageViewer::generateImageUnroll(float zMax, float zMin, double pixelSize/*=0.005*/, int sfIndex/*=-1*/)
 {
-	std::vector<ccImage*> imagesOutput;
-	if (!m_unrolledCloud) { return imagesOutput; }
-	
-	//get init slice
-	float initY = floor(zMin / slice) * slice;
-	while (initY < zMax)
-	{
-		float bottomY = initY;
-		float topY = initY + slice;
-		//Generate a new view
-		ccViewportParameters imageViewport;
-		CCVector3 bbMin;
-		CCVector3 bbMax;
-		ccImage* img(new ccImage);
-		QImage image;
-		m_unrolledCloud->getBoundingBox(bbMin, bbMax);
-		bbMin.y = bottomY;
-		bbMax.y = topY;
-
-		ccGLWindow* win = MainWindow::GetActiveGLWindow();
-		float windowHeight = (float)win->glHeight();
-		float windowWidth = (float)win->glWidth();
-		//double targetWidth = sqrt(pow((bbMax-bbMin).x,2)+ pow((bbMax - bbMin).y, 2));
-		double targetWidth = (bbMax - bbMin).x;
-		double targetHeight = (bbMax - bbMin).y;
-		double targetRatio = targetHeight / targetWidth;
-		double windowRatio = windowHeight / windowWidth;
-		//ccLog::Error(QString("Target Height: %1 ratioTarget: %2 ratioWindow: %3").arg(targetHeight).arg(targetRatio).arg(windowRatio));
-
-		//Center image
-		double focalDistance;
-		CCVector3d eye(0, 0, 1);
-		CCVector3d center(0, 0, 0);
-		CCVector3d top(0, 1, 0);
-		imageViewport.viewMat = ccGLMatrixd::FromViewDirAndUpDir(center - eye, top);
-		CCVector3d P((bbMax + bbMin).x / 2, (bbMax + bbMin).y / 2, 0);
-		ccLog::Print(QString("Center Camera %1, %2, %3").arg(P.x).arg(P.y).arg(P.z));
-		imageViewport.setCameraCenter(P, false);
-		
-		if (targetRatio > windowRatio)
-		{
-			//Optimizing Height
-			double zoom = targetHeight * 200 / windowHeight;
+	if (!m_unrolledCloud || pixelSize <= 0) { return nullptr; }
 
-			if (windowHeight < windowWidth)
-			{
-				targetHeight *= static_cast<double>(windowWidth / windowHeight);
-				focalDistance = targetHeight / (imageViewport.computeDistanceToWidthRatio());
-			}
-			else
-			{
-				double distance = (windowWidth / 2) / std::tan(CCCoreLib::DegreesToRadians(imageViewport.fov_deg / 2.0));
-				double newFOV = atan((windowHeight / 2) / distance);
-				ccLog::Print(QString::number(newFOV));
-				//double multipleHeight = targetHeight / windowHeight;
-				targetHeight *= static_cast<double>(windowWidth / windowHeight);
-				focalDistance = targetHeight / (2 * std::tan(newFOV));
-			}
-
-			imageViewport.setFocalDistance(focalDistance);
-			win->setViewportParameters(imageViewport);
-			win->setPointSize(2);
-			win->redraw();
-
-			while (image.isNull())
-			{
-				image = win->renderToImage(zoom, true, false, true);
-				if (zoom < 1)
-				{
-					ccLog::Error("Could not export Bg Image, due to momory shortage");
-					return imagesOutput;
-				}
-				if (image.isNull())
-				{
-					zoom -= 1;
-				}
-			}
-			ccLog::Print(QString("Image created at zoom of %1").arg(zoom));
-
-			// Image should be adapted to the height
-			qreal imgHeight = image.height();
-			qreal theoricalWidth = imgHeight / targetRatio;
-			qreal crop = (image.width() - theoricalWidth) / 2;
-			QRect rect(crop, 0, theoricalWidth, imgHeight);
-			image = image.copy(rect);
-		}
-		else
-		{
-			//Optimizing Width
-			double zoom = targetWidth * 200 / windowWidth;
+	CCVector3 bbMin;
+	CCVector3 bbMax;
+	m_unrolledCloud->getBoundingBox(bbMin, bbMax);
+	ccBBox area(CCVector3(bbMin.x, zMin, 0), CCVector3(bbMax.x, zMax, 0));
+	pixelSize = ClampUnrollPixelSize(bbMax.x - bbMin.x, zMax - zMin, pixelSize);
 
-			if (windowHeight > windowWidth)
-			{
-				targetWidth *= static_cast<double>(windowWidth / windowHeight);
-			}
+	std::vector<ccOrthoRasterizer::Sheet> sheets;
+	if (!ccOrthoRasterizer::Render(m_unrolledCloud, area, unrollRasterParameters(pixelSize, sfIndex), sheets) || sheets.empty())
+	{
+		ccLog::Error("Could not export Bg Image");
+		return nullptr;
+	}
 
-			focalDistance = targetWidth / (imageViewport.computeDistanceToWidthRatio());
+	ccImage* img = new ccImage;
+	img->setData(sheets.front().image);
+	img->setPositionBox(sheets.front().box);
+	ccLog::Print(QString("Image created: %1 x %2 pixels").arg(img->getW()).arg(img->getH()));
+	return img;
+}
 
-			imageViewport.setFocalDistance(focalDistance);
-			win->setViewportParameters(imageViewport);
-			win->setPointSize(2);
-			win->redraw();
+ccImage* ccStichedImageViewer::generateSheetUnroll(const ccOrthoRasterizer::Binning& binning, int firstRow, int rowCount, int sfIndex/*=-1*/)
+{
+	if (!m_unrolledCloud || binning.cloud != m_unrolledCloud || rowCount <= 0) { return nullptr; }
 
-			while (image.isNull())
-			{
-				image = win->renderToImage(zoom, true, false, true);
-				zoom -= 1;
-				if (zoom < 1)
-				{
-					ccLog::Error("Could not export Bg Image, due to momory shortage");
-					return imagesOutput;
-				}
-				if (image.isNull())
-				{
-					zoom -= 1;
-				}
-			}
-			ccLog::Print(QString("Image created at zoom of %1").arg(zoom));
-
-			// Image should be adapted to the width
-			qreal imgWidth = image.width();
-			qreal theoricalHeight = imgWidth * targetRatio;
-			qreal crop = (image.height() - theoricalHeight) / 2;
-			QRect rect(0, crop, imgWidth, theoricalHeight);
-			image = image.copy(rect);
-		}
-		img->setData(image);
-		bbMin = CCVector3(bbMin.x, bbMin.y, 0);
-		bbMax = CCVector3(bbMax.x, bbMax.y, 0);
-		ccBBox box(bbMin, bbMax);
-		img->setPositionBox(box);
-		imagesOutput.push_back(img);
-		
-		// Iterate
-		initY += slice;
+	//only the tiles overlapping the sheet are rendered
+	std::vector<ccOrthoRasterizer::Sheet> sheets;
+	QRect window(0, firstRow, binning.width, rowCount);
+	if (!ccOrthoRasterizer::Render(binning, window, unrollRasterParameters(binning.pixelSize, sfIndex), sheets) || sheets.empty())
+	{
+		ccLog::Error("Could not export Bg Image");
+		return nullptr;
 	}
-	
-	return imagesOutput;
-
-	//win->setCameraPos(P);
-	//CCVector3d v(0, 0, focalDistance);
-	//win->moveCamera(v);
 
+	ccImage* img = new ccImage;
+	img->setData(sheets.front().image);
+	img->setPositionBox(sheets.front().box);
+	return img;
 }
 
 void ccStichedImageViewer::unrollClick() 
@@ -1182,41 +1148,56 @@ void ccStichedImageViewer::unrollClick()
 }
 
 void ccStichedImageViewer::actionUnroll(ccPointCloud* currentCloud, ccPointCloud* &outCloudUnrolled,
-											float radius, CCVector3 center, bool exportDistance,
+											float radius, CCVector3 center, bool exportDistance, bool followTrajectory,
 											CCCoreLib::GenericProgressCallback* progressCb)
 {	
-	ccPointCloud::UnrollCylinderParams params;
-	params.axisDim = 2;
-	params.center = center;
-	params.radius = radius;
-
-	outCloudUnrolled = currentCloud->unroll(ccPointCloud::UnrollMode::CYLINDER, &params, exportDistance, 0, 360,progressCb);
-	// Apply sf to oldCloud
-	if (exportDistance)
-	{
-		int sfIdxUnrolled = outCloudUnrolled->getScalarFieldIndexByName("Deviation");
-		int sfIdxCloud = currentCloud->addScalarField("Deviation");
-		if (sfIdxCloud < 0 || sfIdxUnrolled < 0)
+	outCloudUnrolled = nullptr;
+
+	ccPointCloud::UnrollMode mode = ccPointCloud::UnrollMode::CYLINDER;
+	ccPointCloud::UnrollCylinderParams cylinderParams;
+	ccPointCloud::UnrollTrajectoryParams trajectoryParams;
+	ccPointCloud::UnrollBaseParams* params = &cylinderParams;
+	if (followTrajectory)
+	{
+		ccPointCloud* trajectory = currentCloud->getTrajectoryCloud() ? currentCloud->getTrajectoryCloud() : m_currentTrajectory;
+		if (!trajectory)
 		{
-			ccLog::Warning("[Unroll] Not enough memory to init the deviation scalar field");
+			ccLog::Error("[Unroll] No trajectory is associated to the cloud");
+			return;
+		}
+		trajectoryParams.axisDim = 2;
+		trajectoryParams.radius = radius;
+		trajectoryParams.trajectory = trajectory;
+		//the spline control points are spaced by (at least) the radius to smooth the poses
+		trajectoryParams.controlStep = radius;
+
+		mode = ccPointCloud::UnrollMode::TRAJECTORY;
+		params = &trajectoryParams;
+	}
+	else
+	{
+		cylinderParams.axisDim = 2;
+		cylinderParams.center = center;
+		cylinderParams.radius = radius;
+	}
+
+	// The deviation is directly written in the original cloud (and shared with the unrolled view)
+	outCloudUnrolled = currentCloud->createUnrolledView(mode, params, exportDistance, progressCb);
+	if (outCloudUnrolled && exportDistance)
+	{
+		int sfIdx = currentCloud->getScalarFieldIndexByName("Deviation");
+		if (sfIdx < 0)
+		{
+			ccLog::Warning("[Unroll] Failed to compute the deviation scalar field");
 		}
-		
 		else
 		{
-			CCCoreLib::ScalarField* deviationSFUnrolled = outCloudUnrolled->getScalarField(sfIdxUnrolled);
-			CCCoreLib::ScalarField* deviationSFCloud = currentCloud->getScalarField(sfIdxCloud);
-			for (int i = 0; i < currentCloud->size(); i++)
-			{
-				deviationSFCloud->setValue(i, deviationSFUnrolled->at(i));
-				
-			}
-			deviationSFCloud->computeMinAndMax();
-			ccScalarField* sfU = static_cast<ccScalarField*>(deviationSFUnrolled);
-			ccScalarField* sfC = static_cast<ccScalarField*>(deviationSFCloud);
-			sfU->setColorScale(ccColorScalesManager::GetDefaultScale(ccColorScalesManager::CONVERGENCE));
-			sfC->setColorScale(ccColorScalesManager::GetDefaultScale(ccColorScalesManager::CONVERGENCE));
+			ccScalarField* deviationSF = static_cast<ccScalarField*>(currentCloud->getScalarField(sfIdx));
+			deviationSF->setColorScale(ccColorScalesManager::GetDefaultScale(ccColorScalesManager::CONVERGENCE));
+			currentCloud->setCurrentDisplayedScalarField(sfIdx);
+			outCloudUnrolled->setCurrentDisplayedScalarField(sfIdx);
+			outCloudUnrolled->showSF(true);
 		}
-		
 	}
 	return;
 }
@@ -1225,343 +1206,112 @@ void ccStichedImageViewer::cleanUnrollOctree(int octreeLevel, float radius, ccPo
 											ccPointCloud* &outCleanUnrolled, ccPointCloud* &outCloudClean, ccPointCloud* &outCloudRemaining,
 											CCCoreLib::GenericProgressCallback* progressCb)
 {
-	//ccPointCloud* unrolledCloudClean(new ccPointCloud);
-	//ccPointCloud* cloudClean(new ccPointCloud);
-	//ccPointCloud* cloudRemaining(new ccPointCloud);
-	//unique parameter: the octree subdivision level
+	outCleanUnrolled = nullptr;
+	outCloudClean = nullptr;
+	outCloudRemaining = nullptr;
 
 	assert(octreeLevel >= 0 && octreeLevel <= CCCoreLib::DgmOctree::MAX_OCTREE_LEVEL);
-	if (progressCb)
-	{
-		progressCb->setMethodTitle("Cleaning Cloud");
-		progressCb->setInfo(qPrintable(QString("Number of points = %1").arg(octreeLevel)));
-	}
-	
-
-	ccOctree::Shared theOctree = unrolledCloud->getOctree();
-	if (!theOctree)
+	if (!currentCloud || !unrolledCloud || currentCloud->size() != unrolledCloud->size())
 	{
-		theOctree = unrolledCloud->computeOctree();
-	}
-	
-	if (!theOctree)
-	{
-		ccLog::Error("Couldn't compute octree!");
+		assert(false);
 		return;
 	}
 
-	ccOctree::Shared cloudOctree = currentCloud->getOctree();
-	if (!cloudOctree)
-	{
-		cloudOctree = currentCloud->computeOctree();
-	}
-
-	if (!cloudOctree)
-	{
-		ccLog::Error("Couldn't compute octree!");
-		return;
-	}
-
-	
+	//the depth buffer pixels have the size of the octree cells at the given level
 	CCVector3 bbMin;
 	CCVector3 bbMax;
-	theOctree.data()->getBoundingBox(bbMin, bbMax);
-	
-	// New Approach
-	
-	float leafSize = theOctree.data()->getCellSize(octreeLevel);
-	
-	CCCoreLib::DgmOctree::cellCodesContainer cellCodes;
-	int octreeNumber = theOctree.data()->getCellNumber(octreeLevel);
-	try
-	{
-		cellCodes.reserve(octreeNumber);
-	}
-	catch (const std::bad_alloc&)
-	{
-		ccLog::Error("Not enough memory");
-		return;
-	}
-		
-	//ccLog::Error(QString("Qty of cells %1").arg(OctreeNumber));
-	// Get cell codes
-	theOctree.data()->getCellCodes(octreeLevel, cellCodes, false);
-	
-
-	std::vector < std::vector<std::pair<unsigned long long, int>>> zDepthMat;
-	std::pair<unsigned long long, int> initPair = std::make_pair(0, INT_MAX);
-	int zDepthMatWidth = (int)round((bbMax.x - bbMin.x) / leafSize);
-	int zDepthMatHeight = (int)round((bbMax.y - bbMin.y) / leafSize);
-	zDepthMat.resize(zDepthMatHeight);
-	for (int i = 0; i < zDepthMatHeight; i++)
-	{
-		zDepthMat[i].resize(zDepthMatWidth);
-		std::fill(zDepthMat[i].begin(), zDepthMat[i].end(), initPair);
-	}
-
-	CCCoreLib::NormalizedProgress nprogress(progressCb, cellCodes.size());
-	if (progressCb)
-	{
-		if (progressCb->textCanBeEdited())
-		{
-			progressCb->setInfo(qPrintable(QString("Number of cells = %1").arg(cellCodes.size())));
-		}
-		progressCb->update(0);
-		progressCb->start();
-	}
-
-	// Keeping the smallestZ cell in the 2D grid
-	for (int i = 0; i < cellCodes.size(); i++)
-	{
-		unsigned long long cellCode = cellCodes[i];
-		Tuple3i pos;
-		theOctree->getCellPos(cellCode, octreeLevel, pos, false);
-
-		unsigned long long savedCellCode = zDepthMat[pos.y][pos.x].first;
-		if (savedCellCode == 0)
-		{
-			zDepthMat[pos.y][pos.x].first = cellCode;
-			zDepthMat[pos.y][pos.x].second = pos.z;
-		}
-		else
-		{
-			if (zDepthMat[pos.y][pos.x].second > pos.z)
-			{
-				zDepthMat[pos.y][pos.x].first = cellCode;
-				zDepthMat[pos.y][pos.x].second = pos.z;
-			}
-		}
-		if (progressCb && !nprogress.oneStep())
+	unrolledCloud->getBoundingBox(bbMin, bbMax);
+	CCVector3 bbDiag = bbMax - bbMin;
+	PointCoordinateType cellSize = std::max(bbDiag.x, std::max(bbDiag.y, bbDiag.z)) / (1 << octreeLevel);
+
+	//in the unrolled cloud, Z = -distance to the axis: the walls are the deepest points
+	CCCoreLib::VisibilityTools::DepthBufferParams params;
+	params.mode = CCCoreLib::VisibilityTools::PLANAR;
+	params.pixelSize = cellSize;
+	params.neighbourhood = 1;
+	params.depthTolerance = 2 * cellSize;
+	params.reverseDepth = true;
+
+	std::vector<unsigned char> visibility;
+	unsigned visibleCount = 0;
+	if (!CCCoreLib::VisibilityTools::ComputeVisibility(unrolledCloud, params, visibility, &visibleCount, progressCb))
+	{
+		if (progressCb && progressCb->isCancelRequested())
 		{
 			ccLog::Warning("Process cancelled by user");
-			return;
-		}
-	}
-
-	
-	
-
-	int max = pow(2, octreeLevel);
-	std::vector<unsigned long long> cellClean;
-	std::vector<unsigned long long> cellHidden;
-
-	nprogress.reset();
-	if (progressCb)
-	{
-		if (progressCb->textCanBeEdited())
-		{
-			progressCb->setInfo(qPrintable(QString("Number of cells visible = %1").arg(cellCodes.size())));
-		}
-		progressCb->update(0);
-		progressCb->start();
-	}
-	// Adding surrounding and visible octrees 
-	for (int i = 0; i < cellCodes.size(); i++)
-	{
-		unsigned long long cellCode = cellCodes[i];
-		Tuple3i pos;
-		theOctree->getCellPos(cellCode, octreeLevel, pos, false);
-		
-		
-		int savedZPos = zDepthMat[pos.y][pos.x].second;
-
-		//getNeighborCellsAround
-		if (savedZPos == pos.z ||
-			// middle
-			zDepthMat[pos.y+1 >= max ? max : pos.y + 1][pos.x].second == pos.z ||
-			zDepthMat[pos.y][pos.x + 1 >= max ? max : pos.x + 1 ].second == pos.z ||
-			zDepthMat[pos.y + 1 >= max ? max : pos.y + 1][pos.x + 1 >= max ? max : pos.x + 1].second == pos.z ||
-			zDepthMat[pos.y - 1 <= 0 ? 0 : pos.y - 1][pos.x].second == pos.z ||
-			zDepthMat[pos.y][pos.x - 1 <= 0 ? 0 : pos.x - 1].second == pos.z ||
-			zDepthMat[pos.y - 1 <= 0 ? 0 : pos.y - 1][pos.x - 1 <= 0 ? 0 : pos.x - 1].second == pos.z ||
-			//back
-			savedZPos == pos.z - 1 ||
-			savedZPos == pos.z - 2 ||
-			zDepthMat[pos.y + 1 >= max ? max : pos.y + 1][pos.x].second == pos.z - 1 ||
-			zDepthMat[pos.y][pos.x + 1 >= max ? max : pos.x + 1].second == pos.z - 1 ||
-			zDepthMat[pos.y + 1 >= max ? max : pos.y + 1][pos.x + 1 >= max ? max : pos.x + 1].second == pos.z - 1 ||
-			zDepthMat[pos.y - 1 <= 0 ? 0 : pos.y - 1][pos.x].second == pos.z - 1 ||
-			zDepthMat[pos.y][pos.x - 1 <= 0 ? 0 : pos.x - 1].second == pos.z - 1 ||
-			zDepthMat[pos.y - 1 <= 0 ? 0 : pos.y - 1][pos.x - 1 <= 0 ? 0 : pos.x - 1].second == pos.z - 1 ||
-			//front
-			savedZPos == pos.z + 1 ||
-			savedZPos == pos.z + 2 ||
-			zDepthMat[pos.y + 1 >= max ? max : pos.y + 1][pos.x].second == pos.z + 1 ||
-			zDepthMat[pos.y][pos.x + 1 >= max ? max : pos.x + 1].second == pos.z + 1 ||
-			zDepthMat[pos.y + 1 >= max ? max : pos.y + 1][pos.x + 1 >= max ? max : pos.x + 1].second == pos.z + 1 ||
-			zDepthMat[pos.y - 1 <= 0 ? 0 : pos.y - 1][pos.x].second == pos.z + 1 ||
-			zDepthMat[pos.y][pos.x - 1 <= 0 ? 0 : pos.x - 1].second == pos.z + 1 ||
-			zDepthMat[pos.y - 1 <= 0 ? 0 : pos.y - 1][pos.x - 1 <= 0 ? 0 : pos.x - 1].second == pos.z + 1 			
-			)
-		{
-			cellClean.push_back(cellCode);
 		}
 		else
 		{
-			cellHidden.push_back(cellCode);	
-		}
-		if (progressCb && !nprogress.oneStep())
-		{
-			ccLog::Warning("Process cancelled by user");
-			return;
+			ccLog::Error("Failed to compute the points visibility (not enough memory?)");
 		}
+		return;
 	}
-	if (progressCb)
+
+	if (visibleCount == unrolledCloud->size())
 	{
-		progressCb->stop();
+		ccLog::Error("No points were removed!");
+		return;
 	}
 
+	//the unrolled cloud and the input cloud share the same point indexes
+	//(the visibility is either POINT_VISIBLE or POINT_HIDDEN)
 	CCCoreLib::ReferenceCloud unrolledRefCloud(unrolledCloud);
-	CCCoreLib::ReferenceCloud unrolledObstructRefCloud(unrolledCloud);
 	CCCoreLib::ReferenceCloud visibleRefCloud(currentCloud);
 	CCCoreLib::ReferenceCloud obstructRefCloud(currentCloud);
-	
-	theOctree->getPointsInCellsWithSortedCellCodes(cellClean, octreeLevel, &unrolledRefCloud);
-	for (int i = 0; i < unrolledRefCloud.size(); i++)
+	unsigned pointCount = currentCloud->size();
+	if (	!unrolledRefCloud.addFlaggedPointIndexes(visibility.data(), pointCount, CCCoreLib::POINT_VISIBLE)
+		||	!visibleRefCloud.addFlaggedPointIndexes(visibility.data(), pointCount, CCCoreLib::POINT_VISIBLE)
+		||	!obstructRefCloud.addFlaggedPointIndexes(visibility.data(), pointCount, CCCoreLib::POINT_HIDDEN))
 	{
-		int index = unrolledRefCloud.getPointGlobalIndex(i);
-		visibleRefCloud.addPointIndex(index);
+		ccLog::Error("Not enough memory!");
+		return;
 	}
-
-	theOctree->getPointsInCellsWithSortedCellCodes(cellHidden, octreeLevel, &unrolledObstructRefCloud);
-	for (int i = 0; i < unrolledObstructRefCloud.size(); i++)
-	{
-		int index = unrolledObstructRefCloud.getPointGlobalIndex(i);
-		obstructRefCloud.addPointIndex(index);
+	assert(visibleRefCloud.size() == visibleCount && obstructRefCloud.size() == pointCount - visibleCount);
+	visibility.clear();
+	visibility.shrink_to_fit();
+
+	//create clouds from visibility selection
+	outCleanUnrolled = unrolledCloud->partialClone(&unrolledRefCloud);
+	outCloudClean = currentCloud->partialClone(&visibleRefCloud);
+	outCloudRemaining = currentCloud->partialClone(&obstructRefCloud);
+	if (!outCleanUnrolled || !outCloudClean || !outCloudRemaining)
+	{
+		ccLog::Error("Not enough memory!");
+		delete outCleanUnrolled;
+		outCleanUnrolled = nullptr;
+		delete outCloudClean;
+		outCloudClean = nullptr;
+		delete outCloudRemaining;
+		outCloudRemaining = nullptr;
+		return;
 	}
 
-		if (visibleRefCloud.size() == unrolledCloud->size())
-		{
-			ccLog::Error("No points were removed!");
-		}
-		else
-		{
-			//create cloud from visibility selection
-			outCleanUnrolled = unrolledCloud->partialClone(&unrolledRefCloud);
-			unrolledRefCloud.clear();
-			unrolledCloud->clear();
-			if (!outCleanUnrolled)
-			{
-				ccLog::Error("Not enough memory!");
-				return;
-			}
-			
-			
-
-
-			QString nameCloud = currentCloud->getName();
-			outCloudClean = currentCloud->partialClone(&visibleRefCloud);
-			outCloudClean->setImagePointCloud(true);
-			outCloudClean->setTrajectoryCloud(m_currentTrajectory);
-			outCloudClean->setName(QString("%1.clean").arg(nameCloud));
-			visibleRefCloud.clear();
-
-			if (!outCloudClean)
-			{
-				ccLog::Error("Not enough memory!");
-				return;
-			}
+	QString nameCloud = currentCloud->getName();
+	outCloudClean->setImagePointCloud(true);
+	outCloudClean->setTrajectoryCloud(m_currentTrajectory);
+	outCloudClean->setName(QString("%1.clean").arg(nameCloud));
+	outCloudRemaining->setImagePointCloud(true);
+	outCloudRemaining->setTrajectoryCloud(m_currentTrajectory);
+	outCloudRemaining->setName(QString("%1.remaining").arg(nameCloud));
 
-			outCloudRemaining = currentCloud->partialClone(&obstructRefCloud);
-			outCloudRemaining->setImagePointCloud(true);
-			outCloudRemaining->setTrajectoryCloud(m_currentTrajectory);
-			outCloudRemaining->setName(QString("%1.remaining").arg(nameCloud));
-			obstructRefCloud.clear();
-			if (!outCloudRemaining)
-			{
-				ccLog::Error("Not enough memory!");
-				return;
-			}
-			currentCloud->clear();
-		}
-	
-	return;
+	unrolledCloud->clear();
+	currentCloud->clear();
 }
 
-CCCoreLib::ReferenceCloud * ccStichedImageViewer::removeHiddenPoints(CCCoreLib::GenericIndexedCloudPersist * theCloud, CCVector3 bbMin, CCVector3 bbMax, float leafSize)
+CCCoreLib::ReferenceCloud * ccStichedImageViewer::removeHiddenPoints(CCCoreLib::GenericIndexedCloudPersist * theCloud, float leafSize)
 {
 	assert(theCloud);
 
-	unsigned nbPoints = theCloud->size();
-	if (nbPoints == 0)
+	if (theCloud->size() == 0)
 		return nullptr;
 
-	//less than 4 points? no need for calculation, we return the whole cloud
-	if (nbPoints < 4)
-	{
-		CCCoreLib::ReferenceCloud* visiblePoints = new CCCoreLib::ReferenceCloud(theCloud);
-		if (!visiblePoints->addPointIndex(0, nbPoints)) //well even for less than 4 points we never know ;)
-		{
-			//not enough memory!
-			delete visiblePoints;
-			visiblePoints = nullptr;
-		}
-		return visiblePoints;
-	}
-
-	// Create a 2D matrix
+	//keeps the highest point (Z) of each cell
+	CCCoreLib::VisibilityTools::DepthBufferParams params;
+	params.mode = CCCoreLib::VisibilityTools::PLANAR;
+	params.pixelSize = leafSize;
+	params.neighbourhood = 0;
 
-	//unrolledCloud->getBoundingBox(bbMin, bbMax);
-	int zDepthMatWidth = (int)ceil((bbMax.x - bbMin.x) / leafSize);
-	int zDepthMatHeight = (int)ceil((bbMax.y - bbMin.y) / leafSize);
-	std::vector<std::vector<int>> zDepthMat;
-	zDepthMat.resize(zDepthMatHeight);
-	for (int i = 0; i < zDepthMatHeight; i++)
-	{
-		zDepthMat[i].resize(zDepthMatWidth);
-		std::fill(zDepthMat[i].begin(), zDepthMat[i].end(), -1);
-	}
-
-	// Iterate throught all the center points and update if the leaf size is closer 
-	int visibleSize = 0;
-	for (int i = 0; i < nbPoints; ++i)
-	{
-		float Px = theCloud->getPoint(i)->x - bbMin.x;
-		float Py = theCloud->getPoint(i)->y - bbMin.y;
-		float Pz = theCloud->getPoint(i)->z;
-		int row = (int)floor(Py / leafSize);
-		int column = (int)floor(Px / leafSize);
-		int ptIdLocked = zDepthMat[row][column];
-		if (ptIdLocked == -1)
-		{
-			zDepthMat[row][column] = i;
-			visibleSize++;
-		}
-		else
-		{
-			float lockedZ = theCloud->getPoint(ptIdLocked)->z;
-			if (lockedZ < Pz)
-			{
-				// We update the id because the depth is smaller
-				zDepthMat[row][column] = i;
-			}
-		}
-	}
-	//ccLog::Error(QString("Visible size %1").arg(visibleSize));
-	int gg = 0;
-	CCCoreLib::ReferenceCloud* visiblePoints = new CCCoreLib::ReferenceCloud(theCloud);
-	if (visibleSize != 0 && visiblePoints->reserve(visibleSize))
-	{
-		for (int row = 0; row < zDepthMatHeight; ++row)
-		{
-			for (int col = 0; col < zDepthMatWidth; ++col)
-			{
-				int visibleIndex = zDepthMat[row][col];
-				if (visibleIndex != -1)
-				{
-					visiblePoints->addPointIndex(visibleIndex);
-					gg++;
-				}
-			}
-		}
-		//ccLog::Error(QString("Visiblepoints size %1").arg(gg));;
-		return visiblePoints;
-	}
-	else //not enough memory
-	{
-		delete visiblePoints;
-		visiblePoints = nullptr;
-	}
+	return CCCoreLib::VisibilityTools::RemoveHiddenPoints(theCloud, params);
 }
 
 void ccStichedImageViewer::rollingPoint(CCVector3 &point, float radius)
@@ -1605,29 +1355,8 @@ void ccStichedImageViewer::saveDxf()
 	// Output file
 	//selectedFile;
 
-	// Generate images unrolled
-	// hide everthing else first
-	ccHObject* root = MainWindow::TheInstance()->dbRootObject();
-	root->toggleVisibility_recursive();
-	m_unrolledCloud->setEnabled(true);
-	m_unrolledCloud->setVisible(true);
-	
 	CCVector3 bbMin, bbMax;
 	m_unrolledCloud->getBoundingBox(bbMin, bbMax);
-	std::vector<std::vector<ccImage*>> bgImages;
-	for (int i = 0; i < m_unrolledCloud->getNumberOfScalarFields(); i++)
-	{
-		m_unrolledCloud->setCurrentDisplayedScalarField(i);
-		
-		std::vector<ccImage*> images = generateImagesUnroll(bbMax.y, bbMin.y,10);
-		if (!images.empty())
-		{
-			bgImages.push_back(images);
-		}
-	}
-	m_unrolledCloud->setEnabled(false);
-	m_unrolledCloud->setVisible(false);
-	root->toggleVisibility_recursive();
 
 	// Query to get all crack images
 	ccHObject::Container filteredChildrenPolyline, filteredChildrenImage;
@@ -1664,6 +1393,22 @@ void ccStichedImageViewer::saveDxf()
 
 
 
+	// Tag each crack with the closest trajectory node that sees it (batch query)
+	std::vector<int> crackNodes(crackPairs.size(), -1);
+	if (const ccTrajectoryIndex* index = trajectoryIndex())
+	{
+		std::vector<CCVector3d> crackCenters;
+		crackCenters.reserve(crackPairs.size());
+		for (const std::pair<ccPolyline*, ccImage*>& crackPair : crackPairs)
+		{
+			crackCenters.push_back(CCVector3d::fromArray(crackPair.first->getOwnBB().getCenter().u));
+		}
+
+		ccTrajectoryIndex::FieldOfView fov;
+		fov.zFar = m_imageDrawer->m_zFar;
+		index->closestPosesSeeingPoints(crackCenters, fov, crackNodes);
+	}
+
 	// Unroll cracks
 	float radius = m_radius;
 	float circumference = 2 * M_PI * radius;
@@ -1688,9 +1433,13 @@ void ccStichedImageViewer::saveDxf()
 			transPt.y = transPt.z;//y
 			transPt.z = -depth;//z
 			crackCloud->addPoint(transPt);
-			unrolledCrack->addPointIndex(j);
 			//ccLog::Print(QString("unrolled crack: %1, %2, %3").arg(transPt.x).arg(transPt.y).arg(transPt.z));
 		}
+		//the polyline vertices are all the unrolled points (in order)
+		if (crackCloud->size() != 0)
+		{
+			unrolledCrack->addPointIndex(0, crackCloud->size());
+		}
 		
 		crackPairs[i].first = unrolledCrack;
 	}
@@ -1712,6 +1461,7 @@ void ccStichedImageViewer::saveDxf()
 	//Sort cracks and crack images
 	crackPairs = apply_permutation(crackPairs, p);
 	depthSort = apply_permutation(depthSort, p);
+	crackNodes = apply_permutation(crackNodes, p);
 
 	// Creating linkers and positionning crack images
 	std::vector<std::vector<CCVector3>> linkers;
@@ -1725,20 +1475,7 @@ void ccStichedImageViewer::saveDxf()
 	//Layers
 	QJsonObject layersNode;
 	
-	// Add both the bg images and the cracks as layers
-	QStringList layersBgImages;
-	for (int i = 0; i < bgImages.size(); i++)
-	{
-		QString  layerName = QString("shaftImage_%1").arg(i);
-		layersBgImages.push_back(layerName);
-		QJsonObject layer;
-		layer["color"] = "";
-		layer["type"] = "";
-		layer["width"] = "";
-		layer["locked"] = "1";
-		layersNode[layerName] = layer;
-	}
-	
+	// Add the cracks as layers (the bg images layers are added with the images)
 	QStringList layersCrack;
 	for (int i = 0; i < crackPairs.size(); i++)
 	{
@@ -1768,16 +1505,46 @@ void ccStichedImageViewer::saveDxf()
 	QDir dir(folderImageAbsolutePath);
 	dir.mkdir(folderImageAbsolutePath);
 
+	// Generate the unrolled images (offscreen, one set of 10 m sheets per scalar field)
+	// The cloud is binned once for all the sheets and scalar fields, and each sheet is
+	// written (and released) right away, so as to limit the memory consumption
+	static const float sheetSlice = 10.0f;
+	float firstSheetY = std::floor(bbMin.y / sheetSlice) * sheetSlice;
+	int sheetCount = std::max(1, static_cast<int>(std::ceil((bbMax.y - firstSheetY) / sheetSlice)));
+
+	//the sheet height is an exact number of pixels
+	double sheetPixelSize = ClampUnrollPixelSize(bbMax.x - bbMin.x, sheetSlice, 0.005);
+	int sheetRows = static_cast<int>(std::max(1.0, std::round(sheetSlice / sheetPixelSize)));
+	sheetPixelSize = static_cast<double>(sheetSlice) / sheetRows;
+
+	ccOrthoRasterizer::Binning sheetBinning;
+	{
+		ccBBox sheetArea(CCVector3(bbMin.x, firstSheetY, 0), CCVector3(bbMax.x, firstSheetY + sheetCount * sheetSlice, 0));
+		if (!ccOrthoRasterizer::Bin(m_unrolledCloud, sheetArea, unrollRasterParameters(sheetPixelSize, -1), sheetBinning))
+		{
+			ccLog::Error("Could not export Bg Image");
+			sheetCount = 0;
+		}
+	}
+
 	QJsonObject imagesNode;
-	for (int i = 0; i < bgImages.size(); i++)
+	int bgLayerCount = 0;
+	int bgImageCount = 0;
+	for (int sfIndex = 0; sfIndex < static_cast<int>(m_unrolledCloud->getNumberOfScalarFields()); sfIndex++)
 	{
-		QString layerName = layersBgImages[i];
-		std::vector<ccImage*> croppedImages = bgImages[i];
-		for (int j = 0; j < croppedImages.size(); j++)
+		QString layerName = QString("shaftImage_%1").arg(bgLayerCount);
+		int layerImageCount = 0;
+		for (int j = 0; j < sheetCount; j++)
 		{
+			ccImage* img = generateSheetUnroll(sheetBinning, j * sheetRows, sheetRows, sfIndex);
+			if (!img)
+			{
+				//error message already issued
+				break;
+			}
+
 			QJsonObject image;
-			QString imageName = QString("bgImage_%1_%2").arg(i).arg(j);
-			ccImage* img = croppedImages[j];
+			QString imageName = QString("bgImage_%1_%2").arg(bgLayerCount).arg(layerImageCount);
 			CCVector3 minC;
 			CCVector3 maxC;
 			minC = img->getPositionBox().minCorner();
@@ -1794,14 +1561,27 @@ void ccStichedImageViewer::saveDxf()
 			image["zlb"] = QString::number(0);
 			image["relPath"] = QString("./" + currentName + "/" + imageName + ".png");
 
-			
 			imagesNode[imageName] = image;
 			// Export the image in a file
 			//ccLog::Error(QString("Saving Img to:%1").arg(folderImageAbsolutePath + QString("/") + imageName + QString(".png")));
 			img->getImage().save(folderImageAbsolutePath + QString("/") + imageName + QString(".png"));
+			delete img;
+			++layerImageCount;
+		}
+
+		if (layerImageCount != 0)
+		{
+			QJsonObject layer;
+			layer["color"] = "";
+			layer["type"] = "";
+			layer["width"] = "";
+			layer["locked"] = "1";
+			layersNode[layerName] = layer;
+			++bgLayerCount;
+			bgImageCount += layerImageCount;
 		}
-		
 	}
+	ccLog::Print(QString("%1 image(s) created (%2 layer(s))").arg(bgImageCount).arg(bgLayerCount));
 
 	for (int i = 0; i < crackPairs.size(); i++)
 	{
@@ -1861,6 +1641,11 @@ void ccStichedImageViewer::saveDxf()
 		polylineNode["color"] = "";
 		polylineNode["width"] = "0.3";
 		polylineNode["type"] = "";
+		if (crackNodes[i] >= 0)
+		{
+			polylineNode["node"] = crackNodes[i];
+			polylineNode["imageId"] = imageIdOfNode(crackNodes[i]);
+		}
 		polylinesNode[polyName] = polylineNode;
 	}
 
@@ -32,6 +32,8 @@ namespace Ui {
 #include <QKeyEvent>
 #include <QVector3D>
 #include <ccImageDrawer.h>
+#include <ccOrthoRasterizer.h>
+#include "ccPanoramaImageStore.h"
 #include <ccPickingHub.h>
 #include <ccPickingListener.h>
 #include <ccViewportParameters.h>
@@ -51,6 +53,7 @@ enum CAM_VIEW_ORIENTATION {
 
 
 class MainWindow;
+class ccTrajectoryIndex;
 
 //! Custom QListWidget to allow for the copy of all selected elements when using CTRL+C
 
@@ -95,6 +98,10 @@ public:
 	void setCurrentTrajectory(ccPointCloud* cloud) { m_currentTrajectory =cloud ; }
 	void setUnrolledCloud(ccPointCloud* cloud) { m_unrolledCloud =cloud ; }
 
+	// Returns the full resolution version of the displayed panorama (decoded now if a preview is displayed)
+	// A null image is returned if the panorama is not read from the image folder
+	QImage displayedFullResolutionImage();
+
 	//! plan call
 	int getPlanSize();
 
@@ -116,8 +123,9 @@ public:
 	//! Change Step Size for node trajectory
 	void changeStepNode(int);
 
+	//! Unrolls the cloud around a vertical axis, or along its trajectory if 'followTrajectory' is true
 	void actionUnroll(ccPointCloud* currentCloud, ccPointCloud* &outCloudUnrolled,
-		float radius, CCVector3 center, bool exportDistance,
+		float radius, CCVector3 center, bool exportDistance, bool followTrajectory = false,
 		CCCoreLib::GenericProgressCallback* progressCb =nullptr);
 
 	void cleanUnrollOctree(int octreeLevel, float radius, ccPointCloud* currentCloud, ccPointCloud* unrolledCloud,
@@ -131,6 +139,9 @@ public slots:
 	void nodeUp();
 	void nodeDown();
 
+	//! Called when a prefetched panorama has been decoded
+	void onPanoramaReady(int imageId, int level);
+
 protected: 
 	//! Picking hub
 	ccPickingHub* m_pickingHub;
@@ -139,6 +150,9 @@ private:
 
 	//Export .dxf file
 	void saveDxf();
+
+	// Rasterization parameters of the unrolled cloud sheets
+	ccOrthoRasterizer::Parameters unrollRasterParameters(double pixelSize, int sfIndex) const;
 	
 	//  Export to CSV file ( X,Y,Z, dip. dip_dir)
 	bool planeToFile();
@@ -212,6 +226,20 @@ private:
 
 	std::vector<double> m_currentTransform{ 0,0,0,1,0,0,0 };
 
+	// Returns the image id of a trajectory node (-1 if none)
+	int imageIdOfNode(int node) const;
+	// Decodes the panoramas of the nodes around the current one in the background
+	void prefetchNeighbours(int node);
+
+	// Panoramas read on demand from the image folder
+	ccPanoramaImageStore* m_imageStore;
+	// Displayed panorama
+	int m_displayedImageId;
+	// Displayed panorama mip level (> 0 while a preview is displayed)
+	int m_displayedImageLevel;
+	// View parameters of the displayed panorama
+	std::vector<double> m_displayedViewParameters;
+
 
 	
 	//change the view orientation of the following cam
@@ -232,17 +260,20 @@ private:
 
 	// Get closest point id
 	int closestPoseToPoint(const CCVector3* pt);
+	// Returns the spatial index of the current trajectory (if any)
+	const ccTrajectoryIndex* trajectoryIndex() const;
 	void chooseImageAction();
 	
 	
 
-	// generate image unrolled
-	ccImage* generateImageUnroll(float zMax, float zMin);
-	std::vector<ccImage*> generateImagesUnroll(float zMax, float zMin, float slice);
+	// generate image unrolled (offscreen, 'pixelSize' in m/pixel, 'sfIndex' = -1 for the current display)
+	ccImage* generateImageUnroll(float zMax, float zMin, double pixelSize = 0.005, int sfIndex = -1);
+	// generate the image of a single sheet (pixel rows [firstRow, firstRow + rowCount[ of an unrolled cloud binned once for all the sheets)
+	ccImage* generateSheetUnroll(const ccOrthoRasterizer::Binning& binning, int firstRow, int rowCount, int sfIndex = -1);
 
 	// Clean Cloud
 	
-	CCCoreLib::ReferenceCloud* removeHiddenPoints(CCCoreLib::GenericIndexedCloudPersist * theCloud,CCVector3 bbMin, CCVector3 bbMax, float leafSize);
+	CCCoreLib::ReferenceCloud* removeHiddenPoints(CCCoreLib::GenericIndexedCloudPersist * theCloud, float leafSize);
 	void unrollClick();
 	void rollingPoint(CCVector3 &point, float radius);
 
@@ -30,6 +30,7 @@ ccUnrollCleanDlg::ccUnrollCleanDlg(float biggestSize, QWidget* parent/*=0*/)
 	m_biggestSize = biggestSize;
 
 	connect(m_ui->checkBoxClean, &QCheckBox::stateChanged, this, &ccUnrollCleanDlg::cleanStateChanged);
+	connect(m_ui->checkBoxTrajectory, &QCheckBox::stateChanged, this, &ccUnrollCleanDlg::trajectoryStateChanged);
 	connect(m_ui->spinBoxOctreeLevel, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, &ccUnrollCleanDlg::setOctreeLevel);
 
 	m_ui->checkBoxClean->setChecked(true);
@@ -54,6 +55,10 @@ bool ccUnrollCleanDlg::isDistanceEnabled() const
 	return (m_ui->checkBoxDistance->checkState() == Qt::Checked);
 }
 
+bool ccUnrollCleanDlg::isTrajectoryEnabled() const
+{
+	return (m_ui->checkBoxTrajectory->checkState() == Qt::Checked);
+}
 
 CCVector3 ccUnrollCleanDlg::getAxisPosition() const
 {
@@ -84,6 +89,12 @@ void ccUnrollCleanDlg::cleanStateChanged(int checkState)
 	}
 }
 
+void ccUnrollCleanDlg::trajectoryStateChanged(int checkState)
+{
+	//the axis position is useless when following the trajectory
+	m_ui->axisFrame->setEnabled(checkState != Qt::Checked);
+}
+
 void ccUnrollCleanDlg::setOctreeLevel(int octreeLevel)
 {
 	float octreeSize = m_biggestSize / pow(2, octreeLevel);
@@ -104,6 +115,7 @@ void ccUnrollCleanDlg::toPersistentSettings() const
 		settings.setValue("octreeLevel", m_ui->spinBoxOctreeLevel->value());
 		settings.setValue("clean", m_ui->checkBoxClean->isChecked());
 		settings.setValue("exportDistance", m_ui->checkBoxDistance->isChecked());
+		settings.setValue("followTrajectory", m_ui->checkBoxTrajectory->isChecked());
 		settings.setValue("x", m_ui->doubleSpinBoxAxisX->value());
 		settings.setValue("y", m_ui->doubleSpinBoxAxisY->value());
 		//save the axis center as semi-persistent only
@@ -123,6 +135,7 @@ void ccUnrollCleanDlg::fromPersistentSettings()
 		double y = settings.value("y", m_ui->doubleSpinBoxAxisY->value()).toDouble();
 		bool clean = settings.value("clean", m_ui->checkBoxClean->isChecked()).toBool();
 		bool exportDistance = settings.value("exportDistance", m_ui->checkBoxDistance->isChecked()).toBool();
+		bool followTrajectory = settings.value("followTrajectory", m_ui->checkBoxTrajectory->isChecked()).toBool();
 
 
 		m_ui->radiusDoubleSpinBox->setValue(radius);
@@ -131,6 +144,8 @@ void ccUnrollCleanDlg::fromPersistentSettings()
 		m_ui->checkBoxClean->setChecked(clean);
 		if (!clean) { m_ui->spinBoxOctreeLevel->setEnabled(false);}
 		m_ui->checkBoxDistance->setChecked(exportDistance);
+		m_ui->checkBoxTrajectory->setChecked(followTrajectory);
+		trajectoryStateChanged(followTrajectory ? Qt::Checked : Qt::Unchecked);
 
 		m_ui->doubleSpinBoxAxisX->setValue(x);
 		m_ui->doubleSpinBoxAxisY->setValue(y);
@@ -40,6 +40,8 @@ public:
 	
 	bool isCleanEnabled() const;
 	bool isDistanceEnabled() const;
+	//! Whether the cloud should be unrolled along the trajectory (instead of a vertical axis)
+	bool isTrajectoryEnabled() const;
 	CCVector3 getAxisPosition() const;
 	double getRadius() const;
 	int getOctreeLevel() const;
@@ -50,6 +52,7 @@ public:
 
 protected:
 	void cleanStateChanged(int checkState);
+	void trajectoryStateChanged(int checkState);
 	void setOctreeLevel(int octreeLevel);
 
 protected:
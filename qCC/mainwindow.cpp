@@ -5801,6 +5801,7 @@ void MainWindow::doActionUnrollClean()
 	float radius = unrollCleanDlg.getRadius();
 	bool exportDistance = unrollCleanDlg.isDistanceEnabled();
 	bool clean = unrollCleanDlg.isCleanEnabled();
+	bool followTrajectory = unrollCleanDlg.isTrajectoryEnabled();
 	CCVector3 center = unrollCleanDlg.getAxisPosition();
 	int octreeLevel = unrollCleanDlg.getOctreeLevel();
 	
@@ -5808,13 +5809,17 @@ void MainWindow::doActionUnrollClean()
 	//let's rock unroll ;)
 	ccProgressDialog pDlg(true, this);
 	
-	ccPointCloud* unrolledCloud;
-	m_stichedImageViewer->actionUnroll(currentPointCloud,unrolledCloud, radius, center, exportDistance, &pDlg);
+	ccPointCloud* unrolledCloud = nullptr;
+	m_stichedImageViewer->actionUnroll(currentPointCloud,unrolledCloud, radius, center, exportDistance, followTrajectory, &pDlg);
+	if (!unrolledCloud)
+	{
+		return;
+	}
 	if (clean)
 	{
-		ccPointCloud* outCleanCloud;
-		ccPointCloud* outRemainingCloud;
-		ccPointCloud* outUnrolledCloud;
+		ccPointCloud* outCleanCloud = nullptr;
+		ccPointCloud* outRemainingCloud = nullptr;
+		ccPointCloud* outUnrolledCloud = nullptr;
 
 		m_ccStichedImageViewer->cleanUnrollOctree(octreeLevel, radius, currentPointCloud, unrolledCloud, outUnrolledCloud, outCleanCloud, outRemainingCloud, &pDlg);
 		if (!outUnrolledCloud || !outCleanCloud || !outRemainingCloud)  return; 
@@ -8655,14 +8660,26 @@ void MainWindow::doComputeGeometricFeature()
 	if (!gfDlg.exec())
 		return;
 
-	radius = gfDlg.getRadius();
+	std::vector<PointCoordinateType> radii;
+	try
+	{
+		for (double r : gfDlg.getRadii())
+		{
+			radii.push_back(static_cast<PointCoordinateType>(r));
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		ccLog::Error("Not enough memory");
+		return;
+	}
 	if (!gfDlg.getSelectedFeatures(s_selectedCharacteristics))
 	{
 		ccLog::Error("Not enough memory");
 		return;
 	}
 
-	ccLibAlgorithms::ComputeGeomCharacteristics(s_selectedCharacteristics, static_cast<PointCoordinateType>(radius), m_selectedEntities, this);
+	ccLibAlgorithms::ComputeGeomCharacteristics(s_selectedCharacteristics, radii, m_selectedEntities, this);
 
 	refreshAll();
 	updateUI();